@@ -0,0 +1,151 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled for AVX2 regardless of the flags used for the rest of the file.
+// Only called when the CPU supports it. See select_kernels() in bin2.c.
+// Each loop makes 8 to 32 samples at a time and leaves the rest to the plain
+// kernels. Samples are written no further along than they're read, so `dst`
+// may be `a`.
+
+// Puts the 64-bit quarters of a packed pair of vectors back in order.
+#define UNPACK_ORDER ((3 << 6) | (1 << 4) | (2 << 2))
+
+BIN2_TARGET("avx2")
+static void
+bin2_u8_avx2(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i q[2];
+        for (int k = 0; k < 2; ++k) {
+            const size_t j = 2 * i + 32 * k;
+            const __m256i va = _mm256_loadu_si256((const __m256i*)(a + j));
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+            // Sums of neighboring samples, in 16 bits.
+            const __m256i s = _mm256_add_epi16(_mm256_maddubs_epi16(va, ones),
+                                               _mm256_maddubs_epi16(vb, ones));
+            q[k] = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+        }
+        const __m256i v = _mm256_packus_epi16(q[0], q[1]);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(v, UNPACK_ORDER));
+    }
+    bin2_u8_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx2")
+static void
+bin2_i8_avx2(int8_t* dst, const int8_t* a, const int8_t* b, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i q[2];
+        for (int k = 0; k < 2; ++k) {
+            const size_t j = 2 * i + 32 * k;
+            const __m256i va = _mm256_loadu_si256((const __m256i*)(a + j));
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+            const __m256i s = _mm256_add_epi16(_mm256_maddubs_epi16(ones, va),
+                                               _mm256_maddubs_epi16(ones, vb));
+            // Rounds the magnitude, then puts the sign back.
+            const __m256i m =
+              _mm256_srli_epi16(_mm256_add_epi16(_mm256_abs_epi16(s), two), 2);
+            q[k] = _mm256_sign_epi16(m, s);
+        }
+        const __m256i v = _mm256_packs_epi16(q[0], q[1]);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(v, UNPACK_ORDER));
+    }
+    bin2_i8_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx2")
+static void
+bin2_u16_avx2(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t n)
+{
+    const __m256i lo = _mm256_set1_epi32(0xffff);
+    const __m256i two = _mm256_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i q[2];
+        for (int k = 0; k < 2; ++k) {
+            const size_t j = 2 * i + 16 * k;
+            const __m256i va = _mm256_loadu_si256((const __m256i*)(a + j));
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+            const __m256i sa = _mm256_add_epi32(_mm256_and_si256(va, lo),
+                                                _mm256_srli_epi32(va, 16));
+            const __m256i sb = _mm256_add_epi32(_mm256_and_si256(vb, lo),
+                                                _mm256_srli_epi32(vb, 16));
+            const __m256i s = _mm256_add_epi32(sa, sb);
+            q[k] = _mm256_srli_epi32(_mm256_add_epi32(s, two), 2);
+        }
+        const __m256i v = _mm256_packus_epi32(q[0], q[1]);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(v, UNPACK_ORDER));
+    }
+    bin2_u16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx2")
+static void
+bin2_i16_avx2(int16_t* dst, const int16_t* a, const int16_t* b, size_t n)
+{
+    const __m256i two = _mm256_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i q[2];
+        for (int k = 0; k < 2; ++k) {
+            const size_t j = 2 * i + 16 * k;
+            const __m256i va = _mm256_loadu_si256((const __m256i*)(a + j));
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+            // Sign-extends the even samples and the odd ones.
+            const __m256i sa =
+              _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(va, 16), 16),
+                               _mm256_srai_epi32(va, 16));
+            const __m256i sb =
+              _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(vb, 16), 16),
+                               _mm256_srai_epi32(vb, 16));
+            const __m256i s = _mm256_add_epi32(sa, sb);
+            const __m256i m =
+              _mm256_srli_epi32(_mm256_add_epi32(_mm256_abs_epi32(s), two), 2);
+            q[k] = _mm256_sign_epi32(m, s);
+        }
+        const __m256i v = _mm256_packs_epi32(q[0], q[1]);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(v, UNPACK_ORDER));
+    }
+    bin2_i16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx2")
+static void
+bin2_f32_avx2(float* dst, const float* a, const float* b, size_t n)
+{
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 a0 = _mm256_loadu_ps(a + 2 * i);
+        const __m256 a1 = _mm256_loadu_ps(a + 2 * i + 8);
+        const __m256 b0 = _mm256_loadu_ps(b + 2 * i);
+        const __m256 b1 = _mm256_loadu_ps(b + 2 * i + 8);
+        // Even and odd samples, with the same 64-bit quarters out of order
+        // as a packed pair.
+        const __m256 ae = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 ao = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 be = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 bo = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+        // Same order of additions as the plain kernel.
+        const __m256 s =
+          _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(ae, ao), be), bo);
+        const __m256d v = _mm256_castps_pd(_mm256_mul_ps(s, quarter));
+        _mm256_storeu_ps(
+          dst + i, _mm256_castpd_ps(_mm256_permute4x64_pd(v, UNPACK_ORDER)));
+    }
+    bin2_f32_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+#undef UNPACK_ORDER
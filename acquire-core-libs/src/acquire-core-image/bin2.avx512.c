@@ -0,0 +1,84 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled for AVX-512F regardless of the flags used for the rest of the file.
+// Only called when the CPU supports it. See select_kernels() in bin2.c.
+// AVX-512F has no 8-bit arithmetic, so 8-bit samples use the AVX2 kernels.
+// Each loop makes 16 samples at a time and leaves the rest to the plain
+// kernels.
+
+BIN2_TARGET("avx512f")
+static void
+bin2_u16_avx512(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t n)
+{
+    const __m512i lo = _mm512_set1_epi32(0xffff);
+    const __m512i two = _mm512_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i va = _mm512_loadu_si512(a + 2 * i);
+        const __m512i vb = _mm512_loadu_si512(b + 2 * i);
+        const __m512i sa = _mm512_add_epi32(_mm512_and_si512(va, lo),
+                                            _mm512_srli_epi32(va, 16));
+        const __m512i sb = _mm512_add_epi32(_mm512_and_si512(vb, lo),
+                                            _mm512_srli_epi32(vb, 16));
+        const __m512i s = _mm512_add_epi32(sa, sb);
+        const __m512i q = _mm512_srli_epi32(_mm512_add_epi32(s, two), 2);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtepi32_epi16(q));
+    }
+    bin2_u16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx512f")
+static void
+bin2_i16_avx512(int16_t* dst, const int16_t* a, const int16_t* b, size_t n)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i two = _mm512_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i va = _mm512_loadu_si512(a + 2 * i);
+        const __m512i vb = _mm512_loadu_si512(b + 2 * i);
+        const __m512i sa =
+          _mm512_add_epi32(_mm512_srai_epi32(_mm512_slli_epi32(va, 16), 16),
+                           _mm512_srai_epi32(va, 16));
+        const __m512i sb =
+          _mm512_add_epi32(_mm512_srai_epi32(_mm512_slli_epi32(vb, 16), 16),
+                           _mm512_srai_epi32(vb, 16));
+        const __m512i s = _mm512_add_epi32(sa, sb);
+        // Rounds the magnitude, then negates where the sum was negative.
+        const __m512i m =
+          _mm512_srli_epi32(_mm512_add_epi32(_mm512_abs_epi32(s), two), 2);
+        const __m512i q = _mm512_mask_sub_epi32(
+          m, _mm512_cmplt_epi32_mask(s, zero), zero, m);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtepi32_epi16(q));
+    }
+    bin2_i16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+BIN2_TARGET("avx512f")
+static void
+bin2_f32_avx512(float* dst, const float* a, const float* b, size_t n)
+{
+    const __m512i even = _mm512_set_epi32(
+      30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(
+      31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 a0 = _mm512_loadu_ps(a + 2 * i);
+        const __m512 a1 = _mm512_loadu_ps(a + 2 * i + 16);
+        const __m512 b0 = _mm512_loadu_ps(b + 2 * i);
+        const __m512 b1 = _mm512_loadu_ps(b + 2 * i + 16);
+        const __m512 ae = _mm512_permutex2var_ps(a0, even, a1);
+        const __m512 ao = _mm512_permutex2var_ps(a0, odd, a1);
+        const __m512 be = _mm512_permutex2var_ps(b0, even, b1);
+        const __m512 bo = _mm512_permutex2var_ps(b0, odd, b1);
+        // Same order of additions as the plain kernel.
+        const __m512 s =
+          _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(ae, ao), be), bo);
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(s, quarter));
+    }
+    bin2_f32_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
@@ -0,0 +1,350 @@
+#include "bin2.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BIN2_HAS_X86_KERNELS
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define BIN2_HAS_NEON_KERNELS
+#endif
+
+// Lets a function use instructions the rest of the file isn't compiled for.
+// MSVC makes every intrinsic available without it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define BIN2_TARGET(isa)
+#else
+#define BIN2_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#include "bin2.plain.c"
+#ifdef BIN2_HAS_X86_KERNELS
+#include "bin2.avx2.c"
+#include "bin2.avx512.c"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+#ifdef BIN2_HAS_NEON_KERNELS
+#include "bin2.neon.c"
+#endif
+
+/// Loops that bin a pair of rows of single-channel pixels, one set per
+/// instruction set.
+struct bin2_kernels
+{
+    const char* name;
+    void (*u8)(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t n);
+    void (*u16)(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t n);
+    void (*i8)(int8_t* dst, const int8_t* a, const int8_t* b, size_t n);
+    void (*i16)(int16_t* dst, const int16_t* a, const int16_t* b, size_t n);
+    void (*f32)(float* dst, const float* a, const float* b, size_t n);
+};
+
+static const struct bin2_kernels kernels_plain = {
+    .name = "plain",
+    .u8 = bin2_u8_plain,
+    .u16 = bin2_u16_plain,
+    .i8 = bin2_i8_plain,
+    .i16 = bin2_i16_plain,
+    .f32 = bin2_f32_plain,
+};
+
+#ifdef BIN2_HAS_X86_KERNELS
+static const struct bin2_kernels kernels_avx2 = {
+    .name = "avx2",
+    .u8 = bin2_u8_avx2,
+    .u16 = bin2_u16_avx2,
+    .i8 = bin2_i8_avx2,
+    .i16 = bin2_i16_avx2,
+    .f32 = bin2_f32_avx2,
+};
+
+static const struct bin2_kernels kernels_avx512 = {
+    .name = "avx512",
+    .u8 = bin2_u8_avx2,
+    .u16 = bin2_u16_avx512,
+    .i8 = bin2_i8_avx2,
+    .i16 = bin2_i16_avx512,
+    .f32 = bin2_f32_avx512,
+};
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static int
+cpu_supports(int cpuid7_ebx_bit, unsigned long long xcr0_mask)
+{
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) // OSXSAVE
+        return 0;
+    if ((_xgetbv(0) & xcr0_mask) != xcr0_mask)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> cpuid7_ebx_bit) & 1;
+}
+#define CPU_SUPPORTS_AVX2 cpu_supports(5, 0x6)
+#define CPU_SUPPORTS_AVX512F cpu_supports(16, 0xe6)
+#else
+#define CPU_SUPPORTS_AVX2 __builtin_cpu_supports("avx2")
+#define CPU_SUPPORTS_AVX512F __builtin_cpu_supports("avx512f")
+#endif
+#endif // BIN2_HAS_X86_KERNELS
+
+#ifdef BIN2_HAS_NEON_KERNELS
+static const struct bin2_kernels kernels_neon = {
+    .name = "neon",
+    .u8 = bin2_u8_neon,
+    .u16 = bin2_u16_neon,
+    .i8 = bin2_i8_neon,
+    .i16 = bin2_i16_neon,
+    .f32 = bin2_f32_neon,
+};
+#endif
+
+/// Picks the widest kernels this CPU supports.
+static const struct bin2_kernels*
+select_kernels(void)
+{
+#ifdef BIN2_HAS_X86_KERNELS
+    if (CPU_SUPPORTS_AVX512F)
+        return &kernels_avx512;
+    if (CPU_SUPPORTS_AVX2)
+        return &kernels_avx2;
+#endif
+#ifdef BIN2_HAS_NEON_KERNELS
+    return &kernels_neon;
+#else
+    return &kernels_plain;
+#endif
+}
+
+/// Chosen on first use. Threads racing to choose all pick the same kernels.
+static const struct bin2_kernels*
+kernels(void)
+{
+    static const struct bin2_kernels* selected = 0;
+    if (!selected)
+        selected = select_kernels();
+    return selected;
+}
+
+/// Bins `height` rows with `k`. Pixels of more than one channel are binned a
+/// sample at a time, averaging the block's `sum` with `AVERAGE`.
+#define BIN2_ROWS(k, T, ACC, AVERAGE)                                          \
+    do {                                                                       \
+        T* const d = (T*)dst;                                                  \
+        const T* const s = (const T*)src;                                      \
+        for (uint32_t y = 0; y < height; ++y) {                                \
+            T* const out = d + y * dst_row_stride;                             \
+            const T* const a = s + 2 * y * src_row_stride;                     \
+            const T* const b = a + src_row_stride;                             \
+            if (channels == 1) {                                               \
+                (k)(out, a, b, width);                                         \
+                continue;                                                      \
+            }                                                                  \
+            for (size_t i = 0; i < (size_t)width * channels; ++i) {            \
+                const size_t j = 2 * (i - i % channels) + i % channels;        \
+                const ACC sum =                                                \
+                  (ACC)a[j] + a[j + channels] + b[j] + b[j + channels];        \
+                out[i] = (T)(AVERAGE);                                         \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+static int
+bin2_with(const struct bin2_kernels* k,
+          enum SampleType type,
+          void* dst,
+          int64_t dst_row_stride,
+          const void* src,
+          int64_t src_row_stride,
+          uint32_t width,
+          uint32_t height,
+          uint32_t channels)
+{
+    switch (type) {
+        case SampleType_u8:
+            BIN2_ROWS(k->u8, uint8_t, int32_t, quarter_round(sum));
+            return 1;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            BIN2_ROWS(k->u16, uint16_t, int32_t, quarter_round(sum));
+            return 1;
+        case SampleType_i8:
+            BIN2_ROWS(k->i8, int8_t, int32_t, quarter_round(sum));
+            return 1;
+        case SampleType_i16:
+            BIN2_ROWS(k->i16, int16_t, int32_t, quarter_round(sum));
+            return 1;
+        case SampleType_f32:
+            BIN2_ROWS(k->f32, float, float, sum / 4.0f);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+#undef BIN2_ROWS
+
+int
+bin2(enum SampleType type,
+     void* dst,
+     int64_t dst_row_stride,
+     const void* src,
+     int64_t src_row_stride,
+     uint32_t width,
+     uint32_t height,
+     uint32_t channels)
+{
+    return bin2_with(kernels(),
+                     type,
+                     dst,
+                     dst_row_stride,
+                     src,
+                     src_row_stride,
+                     width,
+                     height,
+                     channels);
+}
+
+const char*
+bin2_kernels_name(void)
+{
+    return kernels()->name;
+}
+
+//
+//  UNIT TESTS
+//
+
+#ifndef NO_UNIT_TESTS
+#include "logger.h"
+
+#define ERR(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            ERR(__VA_ARGS__);                                                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Runs one kernel on rows `a` and `b`, into a separate row and in place over
+/// a copy of `a`, and checks both against the plain kernel.
+#define EXPECT_SAME_BIN2(kernels, T, C, a, b, n)                               \
+    do {                                                                       \
+        C expected[sizeof(a) / sizeof(a[0]) / 2];                              \
+        C actual[sizeof(a) / sizeof(a[0]) / 2];                                \
+        C in_place[sizeof(a) / sizeof(a[0])];                                  \
+        memset(expected, 0, sizeof(expected));                                 \
+        memset(actual, 0, sizeof(actual));                                     \
+        memcpy(in_place, a, sizeof(in_place));                                 \
+        bin2_##T##_plain(expected, a, b, n);                                   \
+        (kernels)->T(actual, a, b, n);                                         \
+        (kernels)->T(in_place, in_place, b, n);                                \
+        EXPECT(memcmp(expected, actual, sizeof(expected)) == 0,                \
+               "%s " #T " differs for %d samples",                             \
+               (kernels)->name,                                                \
+               (int)n);                                                        \
+        EXPECT(memcmp(expected, in_place, n * sizeof(C)) == 0,                 \
+               "%s " #T " differs in place for %d samples",                    \
+               (kernels)->name,                                                \
+               (int)n);                                                        \
+    } while (0)
+
+int
+unit_test__bin2_kernels_match_plain()
+{
+    const struct bin2_kernels* all[] = {
+        &kernels_plain,
+#ifdef BIN2_HAS_X86_KERNELS
+        CPU_SUPPORTS_AVX2 ? &kernels_avx2 : 0,
+        CPU_SUPPORTS_AVX512F ? &kernels_avx512 : 0,
+#endif
+#ifdef BIN2_HAS_NEON_KERNELS
+        &kernels_neon,
+#endif
+    };
+    // Sizes around each vector width exercise the tails.
+    const size_t sizes[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100 };
+
+    // Two rows of 200 samples, spanning each type's range.
+    uint8_t u8[2][200];
+    uint16_t u16[2][200];
+    int8_t i8[2][200];
+    int16_t i16[2][200];
+    float f32[2][200];
+    for (int r = 0; r < 2; ++r) {
+        for (int i = 0; i < 200; ++i) {
+            const int k = 200 * r + i;
+            u8[r][i] = (uint8_t)(k * 37 + 255);
+            u16[r][i] = (uint16_t)(k * 2953 + 65535);
+            i8[r][i] = (int8_t)(k * 37 - 128);
+            i16[r][i] = (int16_t)(k * 2953 - 32768);
+            f32[r][i] = 0.1f * (float)(k * 37 % 101) - 5.0f;
+        }
+    }
+
+    for (size_t ik = 0; ik < sizeof(all) / sizeof(all[0]); ++ik) {
+        const struct bin2_kernels* k = all[ik];
+        if (!k)
+            continue;
+        for (size_t is = 0; is < sizeof(sizes) / sizeof(sizes[0]); ++is) {
+            const size_t n = sizes[is];
+            EXPECT_SAME_BIN2(k, u8, uint8_t, u8[0], u8[1], n);
+            EXPECT_SAME_BIN2(k, u16, uint16_t, u16[0], u16[1], n);
+            EXPECT_SAME_BIN2(k, i8, int8_t, i8[0], i8[1], n);
+            EXPECT_SAME_BIN2(k, i16, int16_t, i16[0], i16[1], n);
+            EXPECT_SAME_BIN2(k, f32, float, f32[0], f32[1], n);
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#undef EXPECT_SAME_BIN2
+
+/// bin2() rounds half away from zero, bins pixels of several channels and
+/// bins in place.
+int
+unit_test__bin2_averages_blocks()
+{
+    // 4x4 u8 image whose pixel at (x,y) is 10*y + x.
+    uint8_t u8[16];
+    for (int i = 0; i < 16; ++i)
+        u8[i] = (uint8_t)(10 * (i / 4) + i % 4);
+    uint8_t out[4] = { 0 };
+    CHECK(bin2(SampleType_u8, out, 2, u8, 4, 2, 2, 1));
+    // (0 + 1 + 10 + 11) / 4 = 5.5
+    CHECK(out[0] == 6);
+    // (22 + 23 + 32 + 33) / 4 = 27.5
+    CHECK(out[3] == 28);
+
+    // -0.5 and -0.75 round to -1, 0.5 to 1.
+    const int8_t i8[] = { -1, -1, -1, -2, 1, 1, //
+                          0,  0,  0,  0,  0, 0 };
+    int8_t i8_out[3] = { 0 };
+    CHECK(bin2(SampleType_i8, i8_out, 3, i8, 6, 3, 1, 1));
+    CHECK(i8_out[0] == -1 && i8_out[1] == -1 && i8_out[2] == 1);
+
+    // Two pixels of 2 channels each, binned in place into one.
+    float f32[] = { 1.0f, 10.0f, 3.0f, 30.0f, //
+                    5.0f, 50.0f, 7.0f, 70.0f };
+    CHECK(bin2(SampleType_f32, f32, 2, f32, 4, 1, 1, 2));
+    CHECK(f32[0] == 4.0f && f32[1] == 40.0f);
+
+    // u32 isn't supported.
+    CHECK(!bin2(SampleType_u32, out, 2, u8, 4, 2, 2, 1));
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
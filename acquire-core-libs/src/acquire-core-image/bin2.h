@@ -0,0 +1,48 @@
+#ifndef H_ACQUIRE_CORE_IMAGE_BIN2_V0
+#define H_ACQUIRE_CORE_IMAGE_BIN2_V0
+
+#include "device/props/components.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Averages each 2x2 block of pixels in `src` into a pixel of
+    /// `dst`.
+    /// @details Integers round half away from zero. Floats are summed a row
+    /// of the block at a time and divided by 4. A leftover row or column of
+    /// `src` is ignored.
+    ///
+    /// Uses the widest kernels the CPU supports. See bin2_kernels_name().
+    ///
+    /// `dst` may be `src` itself, binning in place, so long as
+    /// `dst_row_stride` is no more than `src_row_stride`.
+    /// @param[in] type u10, u12 and u14 are binned as u16. u32 isn't
+    ///                 supported.
+    /// @param[out] dst `width` by `height` pixels.
+    /// @param[in] dst_row_stride Samples from one row of `dst` to the next.
+    /// @param[in] src `2 * width` by `2 * height` pixels.
+    /// @param[in] src_row_stride Samples from one row of `src` to the next.
+    /// @param[in] channels Samples in each pixel, next to each other.
+    /// @returns 1 on success, or 0 if `type` isn't supported.
+    int bin2(enum SampleType type,
+             void* dst,
+             int64_t dst_row_stride,
+             const void* src,
+             int64_t src_row_stride,
+             uint32_t width,
+             uint32_t height,
+             uint32_t channels);
+
+    /// @returns The name of the kernels bin2() uses on this CPU: "avx512",
+    /// "avx2", "neon" or "plain".
+    const char* bin2_kernels_name(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_CORE_IMAGE_BIN2_V0
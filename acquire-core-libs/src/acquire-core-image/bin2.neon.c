@@ -0,0 +1,78 @@
+#include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NEON is always available on 64-bit ARM, so these need no runtime check.
+// Each loop makes 4 or 8 samples at a time and leaves the rest to the plain
+// kernels.
+
+static void
+bin2_u8_neon(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // Sums of neighboring samples, in 16 bits.
+        const uint16x8_t s =
+          vpadalq_u8(vpaddlq_u8(vld1q_u8(a + 2 * i)), vld1q_u8(b + 2 * i));
+        vst1_u8(dst + i, vrshrn_n_u16(s, 2));
+    }
+    bin2_u8_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+static void
+bin2_u16_neon(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32x4_t s =
+          vpadalq_u16(vpaddlq_u16(vld1q_u16(a + 2 * i)), vld1q_u16(b + 2 * i));
+        vst1_u16(dst + i, vrshrn_n_u32(s, 2));
+    }
+    bin2_u16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+static void
+bin2_i8_neon(int8_t* dst, const int8_t* a, const int8_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t s =
+          vpadalq_s8(vpaddlq_s8(vld1q_s8(a + 2 * i)), vld1q_s8(b + 2 * i));
+        // Rounds the magnitude, then negates where the sum was negative.
+        const int16x8_t m =
+          vshrq_n_s16(vaddq_s16(vabsq_s16(s), vdupq_n_s16(2)), 2);
+        vst1_s8(dst + i, vmovn_s16(vbslq_s16(vcltzq_s16(s), vnegq_s16(m), m)));
+    }
+    bin2_i8_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+static void
+bin2_i16_neon(int16_t* dst, const int16_t* a, const int16_t* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const int32x4_t s =
+          vpadalq_s16(vpaddlq_s16(vld1q_s16(a + 2 * i)), vld1q_s16(b + 2 * i));
+        const int32x4_t m =
+          vshrq_n_s32(vaddq_s32(vabsq_s32(s), vdupq_n_s32(2)), 2);
+        vst1_s16(dst + i,
+                 vmovn_s32(vbslq_s32(vcltzq_s32(s), vnegq_s32(m), m)));
+    }
+    bin2_i16_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
+
+static void
+bin2_f32_neon(float* dst, const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Loads the even samples into val[0] and the odd ones into val[1].
+        const float32x4x2_t va = vld2q_f32(a + 2 * i);
+        const float32x4x2_t vb = vld2q_f32(b + 2 * i);
+        // Same order of additions as the plain kernel.
+        const float32x4_t s = vaddq_f32(
+          vaddq_f32(vaddq_f32(va.val[0], va.val[1]), vb.val[0]), vb.val[1]);
+        vst1q_f32(dst + i, vmulq_n_f32(s, 0.25f));
+    }
+    bin2_f32_plain(dst + i, a + 2 * i, b + 2 * i, n - i);
+}
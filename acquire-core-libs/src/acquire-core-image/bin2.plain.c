@@ -0,0 +1,33 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/// Divides the sum of a 2x2 block by 4, rounding half away from zero.
+static inline int32_t
+quarter_round(int32_t sum)
+{
+    return sum >= 0 ? (sum + 2) >> 2 : -((-sum + 2) >> 2);
+}
+
+/// Averages the pairs of samples in rows `a` and `b`, each `2 * n` samples
+/// long, into the `n` samples of `dst`.
+#define BIN2_PLAIN(name, T)                                                    \
+    static void name(T* dst, const T* a, const T* b, size_t n)                 \
+    {                                                                          \
+        for (size_t i = 0; i < n; ++i)                                         \
+            dst[i] = (T)quarter_round((int32_t)a[2 * i] + a[2 * i + 1] +       \
+                                      b[2 * i] + b[2 * i + 1]);                \
+    }
+
+BIN2_PLAIN(bin2_u8_plain, uint8_t)
+BIN2_PLAIN(bin2_u16_plain, uint16_t)
+BIN2_PLAIN(bin2_i8_plain, int8_t)
+BIN2_PLAIN(bin2_i16_plain, int16_t)
+
+#undef BIN2_PLAIN
+
+static void
+bin2_f32_plain(float* dst, const float* a, const float* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = (a[2 * i] + a[2 * i + 1] + b[2 * i] + b[2 * i + 1]) / 4.0f;
+}
@@ -0,0 +1,151 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled for AVX2 regardless of the flags used for the rest of the file.
+// Only called when the CPU supports it. See select_kernels() in convert.c.
+// Each loop converts 8 samples at a time and leaves the rest to the plain
+// kernels.
+
+// Moves the low 64 bits of each 128-bit lane next to each other.
+#define LOW_HALVES ((2 << 2) | 0)
+
+#define CONVERT_TO_F32_AVX2(name, T, LOAD, WIDEN, TAIL)                        \
+    CONVERT_TARGET("avx2")                                                     \
+    static void name(float* dst, const T* src, size_t n)                       \
+    {                                                                          \
+        size_t i = 0;                                                          \
+        for (; i + 8 <= n; i += 8) {                                           \
+            const __m256i v = WIDEN(LOAD((const __m128i*)(src + i)));          \
+            _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));                  \
+        }                                                                      \
+        TAIL(dst + i, src + i, n - i);                                         \
+    }
+
+CONVERT_TO_F32_AVX2(to_f32_u8_avx2,
+                    uint8_t,
+                    _mm_loadl_epi64,
+                    _mm256_cvtepu8_epi32,
+                    to_f32_u8_plain)
+CONVERT_TO_F32_AVX2(to_f32_u16_avx2,
+                    uint16_t,
+                    _mm_loadu_si128,
+                    _mm256_cvtepu16_epi32,
+                    to_f32_u16_plain)
+CONVERT_TO_F32_AVX2(to_f32_i8_avx2,
+                    int8_t,
+                    _mm_loadl_epi64,
+                    _mm256_cvtepi8_epi32,
+                    to_f32_i8_plain)
+CONVERT_TO_F32_AVX2(to_f32_i16_avx2,
+                    int16_t,
+                    _mm_loadu_si128,
+                    _mm256_cvtepi16_epi32,
+                    to_f32_i16_plain)
+
+#undef CONVERT_TO_F32_AVX2
+
+/// Converts the high and low 16 bits separately. Both are exact as floats,
+/// so their sum is rounded just once, as a plain conversion would be.
+CONVERT_TARGET("avx2")
+static void
+to_f32_u32_avx2(float* dst, const uint32_t* src, size_t n)
+{
+    const __m256i lo16 = _mm256_set1_epi32(0xffff);
+    const __m256 two16 = _mm256_set1_ps(65536.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+        const __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(v, lo16));
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(hi, two16), lo));
+    }
+    to_f32_u32_plain(dst + i, src + i, n - i);
+}
+
+/// Clamps 8 floats to `[lo,hi]` and rounds them half up, as 32-bit integers.
+/// max() returns its second argument for NaN, which sends NaN to `lo`.
+CONVERT_TARGET("avx2")
+static inline __m256i
+clamp_and_round(const float* src, __m256 lo, __m256 hi)
+{
+    const __m256 v =
+      _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), lo), hi);
+    const __m256 r = _mm256_floor_ps(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+    return _mm256_cvttps_epi32(r);
+}
+
+CONVERT_TARGET("avx2")
+static void
+from_f32_u8_avx2(uint8_t* dst, const float* src, float lo, float hi, size_t n)
+{
+    const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    // After packing, each lane's first 4 bytes hold its 4 samples.
+    const __m256i order = _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = clamp_and_round(src + i, vlo, vhi);
+        const __m256i w = _mm256_packus_epi32(v, v);
+        const __m256i b = _mm256_packus_epi16(w, w);
+        _mm_storel_epi64(
+          (__m128i*)(dst + i),
+          _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(b, order)));
+    }
+    from_f32_u8_plain(dst + i, src + i, lo, hi, n - i);
+}
+
+CONVERT_TARGET("avx2")
+static void
+from_f32_i8_avx2(int8_t* dst, const float* src, float lo, float hi, size_t n)
+{
+    const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    const __m256i order = _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = clamp_and_round(src + i, vlo, vhi);
+        const __m256i w = _mm256_packs_epi32(v, v);
+        const __m256i b = _mm256_packs_epi16(w, w);
+        _mm_storel_epi64(
+          (__m128i*)(dst + i),
+          _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(b, order)));
+    }
+    from_f32_i8_plain(dst + i, src + i, lo, hi, n - i);
+}
+
+CONVERT_TARGET("avx2")
+static void
+from_f32_u16_avx2(uint16_t* dst,
+                  const float* src,
+                  float lo,
+                  float hi,
+                  size_t n)
+{
+    const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = clamp_and_round(src + i, vlo, vhi);
+        const __m256i w = _mm256_packus_epi32(v, v);
+        _mm_storeu_si128(
+          (__m128i*)(dst + i),
+          _mm256_castsi256_si128(_mm256_permute4x64_epi64(w, LOW_HALVES)));
+    }
+    from_f32_u16_plain(dst + i, src + i, lo, hi, n - i);
+}
+
+CONVERT_TARGET("avx2")
+static void
+from_f32_i16_avx2(int16_t* dst, const float* src, float lo, float hi, size_t n)
+{
+    const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = clamp_and_round(src + i, vlo, vhi);
+        const __m256i w = _mm256_packs_epi32(v, v);
+        _mm_storeu_si128(
+          (__m128i*)(dst + i),
+          _mm256_castsi256_si128(_mm256_permute4x64_epi64(w, LOW_HALVES)));
+    }
+    from_f32_i16_plain(dst + i, src + i, lo, hi, n - i);
+}
+
+#undef LOW_HALVES
@@ -0,0 +1,348 @@
+#include "convert.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CONVERT_HAS_X86_KERNELS
+#endif
+
+// Lets a function use instructions the rest of the file isn't compiled for.
+// MSVC makes every intrinsic available without it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CONVERT_TARGET(isa)
+#else
+#define CONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#include "convert.plain.c"
+#ifdef CONVERT_HAS_X86_KERNELS
+#include "convert.avx2.c"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+/// Loops that convert samples to and from floats, one set per instruction
+/// set. The `from_f32` loops clamp to `[lo,hi]`.
+struct convert_kernels
+{
+    const char* name;
+    void (*to_f32_u8)(float* dst, const uint8_t* src, size_t n);
+    void (*to_f32_u16)(float* dst, const uint16_t* src, size_t n);
+    void (*to_f32_i8)(float* dst, const int8_t* src, size_t n);
+    void (*to_f32_i16)(float* dst, const int16_t* src, size_t n);
+    void (*to_f32_u32)(float* dst, const uint32_t* src, size_t n);
+    void (*from_f32_u8)(uint8_t* dst,
+                        const float* src,
+                        float lo,
+                        float hi,
+                        size_t n);
+    void (*from_f32_u16)(uint16_t* dst,
+                         const float* src,
+                         float lo,
+                         float hi,
+                         size_t n);
+    void (*from_f32_i8)(int8_t* dst,
+                        const float* src,
+                        float lo,
+                        float hi,
+                        size_t n);
+    void (*from_f32_i16)(int16_t* dst,
+                         const float* src,
+                         float lo,
+                         float hi,
+                         size_t n);
+    void (*from_f32_u32)(uint32_t* dst,
+                         const float* src,
+                         float lo,
+                         float hi,
+                         size_t n);
+};
+
+static const struct convert_kernels kernels_plain = {
+    .name = "plain",
+    .to_f32_u8 = to_f32_u8_plain,
+    .to_f32_u16 = to_f32_u16_plain,
+    .to_f32_i8 = to_f32_i8_plain,
+    .to_f32_i16 = to_f32_i16_plain,
+    .to_f32_u32 = to_f32_u32_plain,
+    .from_f32_u8 = from_f32_u8_plain,
+    .from_f32_u16 = from_f32_u16_plain,
+    .from_f32_i8 = from_f32_i8_plain,
+    .from_f32_i16 = from_f32_i16_plain,
+    .from_f32_u32 = from_f32_u32_plain,
+};
+
+#ifdef CONVERT_HAS_X86_KERNELS
+static const struct convert_kernels kernels_avx2 = {
+    .name = "avx2",
+    .to_f32_u8 = to_f32_u8_avx2,
+    .to_f32_u16 = to_f32_u16_avx2,
+    .to_f32_i8 = to_f32_i8_avx2,
+    .to_f32_i16 = to_f32_i16_avx2,
+    .to_f32_u32 = to_f32_u32_avx2,
+    .from_f32_u8 = from_f32_u8_avx2,
+    .from_f32_u16 = from_f32_u16_avx2,
+    .from_f32_i8 = from_f32_i8_avx2,
+    .from_f32_i16 = from_f32_i16_avx2,
+    // Samples past 2^31 don't fit the signed conversion AVX2 has.
+    .from_f32_u32 = from_f32_u32_plain,
+};
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static int
+cpu_supports_avx2(void)
+{
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) // OSXSAVE
+        return 0;
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+}
+#define CPU_SUPPORTS_AVX2 cpu_supports_avx2()
+#else
+#define CPU_SUPPORTS_AVX2 __builtin_cpu_supports("avx2")
+#endif
+#endif // CONVERT_HAS_X86_KERNELS
+
+/// Picks the widest kernels this CPU supports.
+static const struct convert_kernels*
+select_kernels(void)
+{
+#ifdef CONVERT_HAS_X86_KERNELS
+    if (CPU_SUPPORTS_AVX2)
+        return &kernels_avx2;
+#endif
+    return &kernels_plain;
+}
+
+/// Chosen on first use. Threads racing to choose all pick the same kernels.
+static const struct convert_kernels*
+kernels(void)
+{
+    static const struct convert_kernels* selected = 0;
+    if (!selected)
+        selected = select_kernels();
+    return selected;
+}
+
+static int
+convert_to_f32_with(const struct convert_kernels* k,
+                    float* dst,
+                    enum SampleType type,
+                    const void* src,
+                    size_t n)
+{
+    switch (type) {
+        case SampleType_u8:
+            k->to_f32_u8(dst, (const uint8_t*)src, n);
+            return 1;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            k->to_f32_u16(dst, (const uint16_t*)src, n);
+            return 1;
+        case SampleType_i8:
+            k->to_f32_i8(dst, (const int8_t*)src, n);
+            return 1;
+        case SampleType_i16:
+            k->to_f32_i16(dst, (const int16_t*)src, n);
+            return 1;
+        case SampleType_f32:
+            memmove(dst, src, n * sizeof(float));
+            return 1;
+        case SampleType_u32:
+            k->to_f32_u32(dst, (const uint32_t*)src, n);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int
+convert_from_f32_with(const struct convert_kernels* k,
+                      void* dst,
+                      enum SampleType type,
+                      const float* src,
+                      size_t n)
+{
+    switch (type) {
+        case SampleType_u8:
+            k->from_f32_u8((uint8_t*)dst, src, 0.0f, 255.0f, n);
+            return 1;
+        case SampleType_u10:
+            k->from_f32_u16((uint16_t*)dst, src, 0.0f, 1023.0f, n);
+            return 1;
+        case SampleType_u12:
+            k->from_f32_u16((uint16_t*)dst, src, 0.0f, 4095.0f, n);
+            return 1;
+        case SampleType_u14:
+            k->from_f32_u16((uint16_t*)dst, src, 0.0f, 16383.0f, n);
+            return 1;
+        case SampleType_u16:
+            k->from_f32_u16((uint16_t*)dst, src, 0.0f, 65535.0f, n);
+            return 1;
+        case SampleType_i8:
+            k->from_f32_i8((int8_t*)dst, src, -128.0f, 127.0f, n);
+            return 1;
+        case SampleType_i16:
+            k->from_f32_i16((int16_t*)dst, src, -32768.0f, 32767.0f, n);
+            return 1;
+        case SampleType_f32:
+            memmove(dst, src, n * sizeof(float));
+            return 1;
+        case SampleType_u32:
+            // The largest float below 2^32.
+            k->from_f32_u32((uint32_t*)dst, src, 0.0f, 4294967040.0f, n);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int
+convert_to_f32(float* dst, enum SampleType type, const void* src, size_t n)
+{
+    return convert_to_f32_with(kernels(), dst, type, src, n);
+}
+
+int
+convert_from_f32(void* dst, enum SampleType type, const float* src, size_t n)
+{
+    return convert_from_f32_with(kernels(), dst, type, src, n);
+}
+
+const char*
+convert_kernels_name(void)
+{
+    return kernels()->name;
+}
+
+//
+//  UNIT TESTS
+//
+
+#ifndef NO_UNIT_TESTS
+#include "logger.h"
+
+#include <math.h>
+
+#define ERR(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            ERR(__VA_ARGS__);                                                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+int
+unit_test__convert_kernels_match_plain()
+{
+    const struct convert_kernels* all[] = {
+        &kernels_plain,
+#ifdef CONVERT_HAS_X86_KERNELS
+        CPU_SUPPORTS_AVX2 ? &kernels_avx2 : 0,
+#endif
+    };
+    const enum SampleType types[] = {
+        SampleType_u8,  SampleType_u10, SampleType_u12,
+        SampleType_u14, SampleType_u16, SampleType_i8,
+        SampleType_i16, SampleType_f32, SampleType_u32,
+    };
+    // Sizes around the vector width exercise the tails.
+    const size_t sizes[] = { 0, 1, 7, 8, 9, 15, 16, 17, 100 };
+
+    // Floats past every type's range at both ends, halves, and NaN.
+    float f32[100];
+    for (int i = 0; i < 100; ++i)
+        f32[i] = 0.5f * (float)((i * 7919) % 2001 - 1000) * (float)(i % 5 + 1) *
+                 (float)(i % 3 ? 1 : 100);
+    f32[13] = NAN;
+    f32[42] = 4294967295.0f;
+    // Samples of every type, spanning its range.
+    uint32_t raw[100];
+    for (int i = 0; i < 100; ++i)
+        raw[i] = (uint32_t)i * 2654435761u;
+
+    for (size_t ik = 0; ik < sizeof(all) / sizeof(all[0]); ++ik) {
+        const struct convert_kernels* k = all[ik];
+        if (!k)
+            continue;
+        for (size_t it = 0; it < sizeof(types) / sizeof(types[0]); ++it) {
+            for (size_t is = 0; is < sizeof(sizes) / sizeof(sizes[0]); ++is) {
+                const size_t n = sizes[is];
+                uint32_t expected[100], actual[100];
+                float fexpected[100], factual[100];
+                memset(expected, 0, sizeof(expected));
+                memset(actual, 0, sizeof(actual));
+                CHECK(convert_from_f32_with(
+                  &kernels_plain, expected, types[it], f32, n));
+                CHECK(convert_from_f32_with(k, actual, types[it], f32, n));
+                EXPECT(memcmp(expected, actual, sizeof(expected)) == 0,
+                       "%s from f32 to type %d differs for %d samples",
+                       k->name,
+                       (int)types[it],
+                       (int)n);
+
+                memset(fexpected, 0, sizeof(fexpected));
+                memset(factual, 0, sizeof(factual));
+                CHECK(convert_to_f32_with(
+                  &kernels_plain, fexpected, types[it], raw, n));
+                CHECK(convert_to_f32_with(k, factual, types[it], raw, n));
+                EXPECT(memcmp(fexpected, factual, sizeof(fexpected)) == 0,
+                       "%s from type %d to f32 differs for %d samples",
+                       k->name,
+                       (int)types[it],
+                       (int)n);
+            }
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Floats round half up and clamp to each type's range, with NaN at the
+/// bottom.
+int
+unit_test__convert_rounds_and_clamps()
+{
+    const float in[] = { -1.5f, -0.5f, 0.49f, 0.5f, 2.5f, 300.0f, NAN,
+                         1e10f, -1e10f };
+    uint8_t u8[9] = { 0 };
+    CHECK(convert_from_f32(u8, SampleType_u8, in, 9));
+    const uint8_t u8_expected[] = { 0, 0, 0, 1, 3, 255, 0, 255, 0 };
+    CHECK(memcmp(u8, u8_expected, sizeof(u8)) == 0);
+
+    int16_t i16[9] = { 0 };
+    CHECK(convert_from_f32(i16, SampleType_i16, in, 9));
+    const int16_t i16_expected[] = { -1,    0,      0,     1,     3,
+                                     300,   -32768, 32767, -32768 };
+    CHECK(memcmp(i16, i16_expected, sizeof(i16)) == 0);
+
+    uint16_t u10[9] = { 0 };
+    CHECK(convert_from_f32(u10, SampleType_u10, in, 9));
+    CHECK(u10[5] == 300 && u10[7] == 1023);
+
+    const int8_t i8[] = { -128, -1, 0, 127 };
+    float f32[4] = { 0 };
+    CHECK(convert_to_f32(f32, SampleType_i8, i8, 4));
+    CHECK(f32[0] == -128.0f && f32[1] == -1.0f && f32[3] == 127.0f);
+
+    CHECK(!convert_to_f32(f32, SampleType_Unknown, i8, 4));
+    CHECK(!convert_from_f32(u8, SampleType_Unknown, in, 4));
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
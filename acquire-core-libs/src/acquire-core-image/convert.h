@@ -0,0 +1,46 @@
+#ifndef H_ACQUIRE_CORE_IMAGE_CONVERT_V0
+#define H_ACQUIRE_CORE_IMAGE_CONVERT_V0
+
+#include "device/props/components.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Converts `n` samples of `type` in `src` to floats in `dst`.
+    /// @details u32 samples above 2^24 round to the nearest float.
+    ///
+    /// Uses the widest kernels the CPU supports. See
+    /// convert_kernels_name().
+    /// @param[in] type u10, u12 and u14 are read as u16.
+    /// @returns 1 on success, or 0 if `type` isn't supported.
+    int convert_to_f32(float* dst,
+                       enum SampleType type,
+                       const void* src,
+                       size_t n);
+
+    /// @brief Converts `n` floats in `src` to samples of `type` in `dst`.
+    /// @details Floats are clamped to the range of `type`, then rounded
+    /// half up. NaN becomes the lowest value. u10, u12 and u14 are clamped
+    /// to their own range and written as u16.
+    ///
+    /// Uses the widest kernels the CPU supports. See
+    /// convert_kernels_name().
+    /// @returns 1 on success, or 0 if `type` isn't supported.
+    int convert_from_f32(void* dst,
+                         enum SampleType type,
+                         const float* src,
+                         size_t n);
+
+    /// @returns The name of the kernels convert_to_f32() and
+    /// convert_from_f32() use on this CPU: "avx2" or "plain".
+    const char* convert_kernels_name(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_CORE_IMAGE_CONVERT_V0
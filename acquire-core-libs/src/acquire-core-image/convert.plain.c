@@ -0,0 +1,41 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONVERT_TO_F32_PLAIN(name, T)                                          \
+    static void name(float* dst, const T* src, size_t n)                       \
+    {                                                                          \
+        for (size_t i = 0; i < n; ++i)                                         \
+            dst[i] = (float)src[i];                                            \
+    }
+
+CONVERT_TO_F32_PLAIN(to_f32_u8_plain, uint8_t)
+CONVERT_TO_F32_PLAIN(to_f32_u16_plain, uint16_t)
+CONVERT_TO_F32_PLAIN(to_f32_i8_plain, int8_t)
+CONVERT_TO_F32_PLAIN(to_f32_i16_plain, int16_t)
+CONVERT_TO_F32_PLAIN(to_f32_u32_plain, uint32_t)
+
+#undef CONVERT_TO_F32_PLAIN
+
+/// Clamps to `[lo,hi]`, sending NaN to `lo`, then rounds half up. `hi` lets
+/// u10, u12 and u14 share the u16 loop.
+#define CONVERT_FROM_F32_PLAIN(name, T)                                        \
+    static void name(T* dst, const float* src, float lo, float hi, size_t n)   \
+    {                                                                          \
+        for (size_t i = 0; i < n; ++i) {                                       \
+            float v = src[i];                                                  \
+            if (!(v >= lo))                                                    \
+                v = lo;                                                        \
+            if (v > hi)                                                        \
+                v = hi;                                                        \
+            dst[i] = (T)floorf(v + 0.5f);                                      \
+        }                                                                      \
+    }
+
+CONVERT_FROM_F32_PLAIN(from_f32_u8_plain, uint8_t)
+CONVERT_FROM_F32_PLAIN(from_f32_u16_plain, uint16_t)
+CONVERT_FROM_F32_PLAIN(from_f32_i8_plain, int8_t)
+CONVERT_FROM_F32_PLAIN(from_f32_i16_plain, int16_t)
+CONVERT_FROM_F32_PLAIN(from_f32_u32_plain, uint32_t)
+
+#undef CONVERT_FROM_F32_PLAIN
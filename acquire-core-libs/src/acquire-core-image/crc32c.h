@@ -0,0 +1,36 @@
+#ifndef H_ACQUIRE_CORE_IMAGE_CRC32C_V0
+#define H_ACQUIRE_CORE_IMAGE_CRC32C_V0
+
+#include "device/props/components.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Extends `crc`, the CRC32C (Castagnoli) of the bytes before
+    /// `data`, over `nbytes` more.
+    /// @details Start with a `crc` of 0. The CRC of "123456789" is
+    /// 0xE3069283.
+    ///
+    /// Uses the CPU's crc32 instruction where it has one. See
+    /// crc32c_kernels_name().
+    uint32_t crc32c(uint32_t crc, const void* data, size_t nbytes);
+
+    /// @returns The CRC32C of the data of `frame`: `bytes_of_data` bytes
+    /// when it's compressed, otherwise `bytes_of_image(&frame->shape)`.
+    /// See `VideoFrame::checksum`.
+    uint32_t crc32c_of_frame(const struct VideoFrame* frame);
+
+    /// @returns The name of the kernels crc32c() uses on this CPU: "sse4.2",
+    /// "armv8-crc" or "plain".
+    const char* crc32c_kernels_name(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_CORE_IMAGE_CRC32C_V0
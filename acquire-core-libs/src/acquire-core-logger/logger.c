@@ -1,11 +1,89 @@
 #include "logger.h"
+#include "platform.h"
+
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+/// Messages the ring holds. A power of two.
+#ifndef LOGGER_ASYNC_CAPACITY
+#define LOGGER_ASYNC_CAPACITY 1024
+#endif
+
+/// Most arguments a queued message can carry. `*` widths and precisions
+/// count as arguments.
+#define MAX_ARGS 16
+
+enum arg_kind
+{
+    Arg_Int,
+    Arg_Long,
+    Arg_LongLong,
+    Arg_Size,
+    Arg_IntMax,
+    Arg_PtrDiff,
+    Arg_Double,
+    Arg_Pointer,
+    Arg_String,
+};
+
+/// One queued message. The format, file and function strings are kept by
+/// pointer, since they're string literals in practice. Arguments are copied
+/// out of the caller's `va_list`, with `%s` strings copied into `text`.
+struct record
+{
+    /// Vyukov's bounded queue: equals the position it can be written at
+    /// when free, and that position plus one once written.
+    size_t sequence;
+
+    const char* fmt;
+    const char* file;
+    const char* function;
+    int line;
+    int is_error;
+    uint8_t nargs;
+    uint8_t kinds[MAX_ARGS];
+    union
+    {
+        long long i;
+        size_t z;
+        intmax_t j;
+        ptrdiff_t t;
+        double d;
+        const void* p;
+        /// For `Arg_String`, the offset of the copy in `text`.
+        uint16_t s;
+    } args[MAX_ARGS];
+    char text[256];
+};
+
+uint32_t aq_logger_enabled_[2] = { LogModule_All, LogModule_All };
 
 static struct
 {
     acquire_reporter_t reporter;
-} globals = { 0 };
+
+    /// An `enum LogLevel`.
+    uint32_t min_level;
+    uint32_t modules;
+
+    /// Nonzero while aq_logger() queues messages.
+    uint32_t is_async;
+    /// Set once the ring's sequence numbers have been initialized.
+    uint32_t is_ring_ready;
+
+    /// Count of messages dropped because the ring was full.
+    size_t dropped;
+    /// Next position to write. Shared by the logging threads.
+    size_t tail;
+    /// Next position to read. Only touched by the thread that drains.
+    size_t head;
+    struct record ring[LOGGER_ASYNC_CAPACITY];
+} globals = { .modules = LogModule_All };
 
 void
 logger_set_reporter(acquire_reporter_t reporter)
@@ -13,6 +91,312 @@ logger_set_reporter(acquire_reporter_t reporter)
     globals.reporter = reporter;
 }
 
+static void
+update_enabled(void)
+{
+    for (int i = 0; i < 2; ++i)
+        store_relaxed(aq_logger_enabled_ + i,
+                      globals.min_level <= (uint32_t)i ? globals.modules : 0);
+}
+
+void
+logger_set_min_level(enum LogLevel level)
+{
+    store_relaxed(&globals.min_level, (uint32_t)level);
+    update_enabled();
+}
+
+void
+logger_set_modules(uint32_t modules)
+{
+    globals.modules = modules;
+    update_enabled();
+}
+
+static void
+report_now(int is_error,
+           const char* file,
+           int line,
+           const char* function,
+           const char* fmt,
+           va_list ap)
+{
+    acquire_reporter_t reporter = globals.reporter;
+    if (reporter) {
+        char buf[1024] = { 0 };
+        vsnprintf(buf, sizeof(buf), fmt, ap); // NOLINT
+        reporter(is_error, file, line, function, buf);
+    }
+}
+
+/// Copies the arguments `fmt` asks for out of `ap`.
+/// @returns 0 if `fmt` uses something that can't be deferred, like `%n`,
+///          `%L` or more than `MAX_ARGS` arguments.
+static int
+capture(struct record* r, const char* fmt, va_list ap)
+{
+    size_t ntext = 0;
+    r->nargs = 0;
+    for (const char* c = fmt; *c; ++c) {
+        if (*c != '%')
+            continue;
+        if (*++c == '%')
+            continue;
+        while (*c && strchr("-+ #0", *c))
+            ++c;
+        for (int field = 0; field < 2; ++field) {
+            if (*c == '*') {
+                if (r->nargs == MAX_ARGS)
+                    return 0;
+                r->kinds[r->nargs] = Arg_Int;
+                r->args[r->nargs++].i = va_arg(ap, int);
+                ++c;
+            }
+            while (*c >= '0' && *c <= '9')
+                ++c;
+            if (field == 0 && *c == '.')
+                ++c;
+            else
+                break;
+        }
+
+        enum arg_kind kind = Arg_Int;
+        switch (*c) {
+            case 'h':
+                c += (c[1] == 'h') ? 2 : 1;
+                break;
+            case 'l':
+                if (c[1] == 'l') {
+                    kind = Arg_LongLong;
+                    c += 2;
+                } else {
+                    kind = Arg_Long;
+                    ++c;
+                }
+                break;
+            case 'z':
+                kind = Arg_Size;
+                ++c;
+                break;
+            case 'j':
+                kind = Arg_IntMax;
+                ++c;
+                break;
+            case 't':
+                kind = Arg_PtrDiff;
+                ++c;
+                break;
+            default:
+                break;
+        }
+
+        if (r->nargs == MAX_ARGS)
+            return 0;
+        switch (*c) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+                if (*c == 'c' && kind != Arg_Int)
+                    return 0; // %lc
+                switch (kind) {
+                    case Arg_Long:
+                        r->args[r->nargs].i = va_arg(ap, long);
+                        break;
+                    case Arg_LongLong:
+                        r->args[r->nargs].i = va_arg(ap, long long);
+                        break;
+                    case Arg_Size:
+                        r->args[r->nargs].z = va_arg(ap, size_t);
+                        break;
+                    case Arg_IntMax:
+                        r->args[r->nargs].j = va_arg(ap, intmax_t);
+                        break;
+                    case Arg_PtrDiff:
+                        r->args[r->nargs].t = va_arg(ap, ptrdiff_t);
+                        break;
+                    default:
+                        r->args[r->nargs].i = va_arg(ap, int);
+                        break;
+                }
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                kind = Arg_Double;
+                r->args[r->nargs].d = va_arg(ap, double);
+                break;
+            case 'p':
+                kind = Arg_Pointer;
+                r->args[r->nargs].p = va_arg(ap, const void*);
+                break;
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                if (kind != Arg_Int)
+                    return 0; // %ls
+                kind = Arg_String;
+                if (!s)
+                    s = "(null)";
+                // Strings that don't fit are cut short.
+                const size_t n = strlen(s);
+                const size_t room = sizeof(r->text) - ntext - 1;
+                const size_t m = n < room ? n : room;
+                memcpy(r->text + ntext, s, m); // NOLINT
+                r->text[ntext + m] = '\0';
+                r->args[r->nargs].s = (uint16_t)ntext;
+                ntext += m + 1;
+                if (ntext > sizeof(r->text) - 1)
+                    ntext = sizeof(r->text) - 1;
+                break;
+            }
+            default:
+                return 0;
+        }
+        r->kinds[r->nargs++] = (uint8_t)kind;
+    }
+    return 1;
+}
+
+/// Formats one conversion, `spec` through `end`, with `r`'s arguments
+/// starting at `*iarg`.
+static int
+format_one(char* buf,
+           size_t nbytes,
+           const char* spec,
+           const char* end,
+           const struct record* r,
+           uint8_t* iarg)
+{
+    // Substitute `*` widths and precisions, so that snprintf() only ever
+    // takes the one value.
+    char f[64] = { 0 };
+    size_t n = 0;
+    for (const char* c = spec; c < end && n < sizeof(f) - 24; ++c) {
+        if (*c == '*') {
+            const int v = (int)r->args[(*iarg)++].i;
+            if (c[-1] == '.' && v < 0)
+                --n; // a negative precision is taken as if it were omitted
+            else
+                n += snprintf(f + n, sizeof(f) - n, "%d", v); // NOLINT
+        } else {
+            f[n++] = *c;
+        }
+    }
+
+    const uint8_t i = (*iarg)++;
+    switch ((enum arg_kind)r->kinds[i]) {
+        case Arg_Long:
+            return snprintf(buf, nbytes, f, (long)r->args[i].i); // NOLINT
+        case Arg_LongLong:
+            return snprintf(buf, nbytes, f, r->args[i].i); // NOLINT
+        case Arg_Size:
+            return snprintf(buf, nbytes, f, r->args[i].z); // NOLINT
+        case Arg_IntMax:
+            return snprintf(buf, nbytes, f, r->args[i].j); // NOLINT
+        case Arg_PtrDiff:
+            return snprintf(buf, nbytes, f, r->args[i].t); // NOLINT
+        case Arg_Double:
+            return snprintf(buf, nbytes, f, r->args[i].d); // NOLINT
+        case Arg_Pointer:
+            return snprintf(buf, nbytes, f, r->args[i].p); // NOLINT
+        case Arg_String:
+            return snprintf(buf, nbytes, f, r->text + r->args[i].s); // NOLINT
+        default:
+            return snprintf(buf, nbytes, f, (int)r->args[i].i); // NOLINT
+    }
+}
+
+/// Expands a queued message into `buf`, truncating it to fit.
+static void
+format_record(char* buf, size_t nbytes, const struct record* r)
+{
+    size_t n = 0;
+    uint8_t iarg = 0;
+    const char* c = r->fmt;
+    while (*c && n < nbytes - 1) {
+        if (*c != '%') {
+            buf[n++] = *c++;
+            continue;
+        }
+        if (c[1] == '%') {
+            buf[n++] = '%';
+            c += 2;
+            continue;
+        }
+        // Find the end of the conversion. capture() already checked it.
+        const char* end = c + 1;
+        while (!strchr("diuoxXceEfFgGaAps", *end))
+            ++end;
+        ++end;
+        const int m = format_one(buf + n, nbytes - n, c, end, r, &iarg);
+        if (m > 0)
+            n += ((size_t)m < nbytes - n) ? (size_t)m : nbytes - n - 1;
+        c = end;
+    }
+    buf[n] = '\0';
+}
+
+static void
+init_ring(void)
+{
+    for (size_t i = 0; i < countof(globals.ring); ++i)
+        store_relaxed(&globals.ring[i].sequence, i);
+}
+
+/// Queues a message, or counts it as dropped if the ring is full.
+static void
+enqueue(int is_error,
+        const char* file,
+        int line,
+        const char* function,
+        const char* fmt,
+        va_list ap)
+{
+    struct record* r = 0;
+    size_t pos = load_relaxed(&globals.tail);
+    for (;;) {
+        r = globals.ring + (pos & (countof(globals.ring) - 1));
+        const size_t seq = load_acquire(&r->sequence);
+        const ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+        if (dif == 0) {
+            if (compare_exchange_acq_rel(&globals.tail, &pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            fetch_add_relaxed(&globals.dropped, 1);
+            return;
+        } else {
+            pos = load_relaxed(&globals.tail);
+        }
+    }
+
+    r->file = file;
+    r->function = function;
+    r->line = line;
+    r->is_error = is_error;
+    va_list aq;
+    va_copy(aq, ap);
+    if (capture(r, fmt, aq)) {
+        r->fmt = fmt;
+    } else {
+        // Can't be deferred, so pay for formatting it here.
+        vsnprintf(r->text, sizeof(r->text), fmt, ap); // NOLINT
+        r->fmt = "%s";
+        r->nargs = 1;
+        r->kinds[0] = Arg_String;
+        r->args[0].s = 0;
+    }
+    va_end(aq);
+    store_release(&r->sequence, pos + 1);
+}
+
 void
 aq_logger(int is_error,
           const char* file,
@@ -21,13 +405,62 @@ aq_logger(int is_error,
           const char* fmt,
           ...)
 {
-    acquire_reporter_t reporter = globals.reporter;
-    if (reporter) {
-        char buf[1024] = { 0 };
-        va_list ap;
-        va_start(ap, fmt);
-        vsnprintf(buf, sizeof(buf), fmt, ap); // NOLINT
-        va_end(ap);
-        reporter(is_error, file, line, function, buf);
+    if (!globals.reporter ||
+        (uint32_t)(is_error != 0) < load_relaxed(&globals.min_level))
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    if (load_acquire(&globals.is_async))
+        enqueue(is_error, file, line, function, fmt, ap);
+    else
+        report_now(is_error, file, line, function, fmt, ap);
+    va_end(ap);
+}
+
+void
+logger_async_begin(void)
+{
+    if (!load_acquire(&globals.is_ring_ready)) {
+        init_ring();
+        store_release(&globals.is_ring_ready, 1);
     }
+    store_release(&globals.is_async, 1);
+}
+
+size_t
+logger_async_drain(void)
+{
+    size_t count = 0;
+    if (!load_acquire(&globals.is_ring_ready))
+        return 0;
+    for (;;) {
+        const size_t pos = globals.head;
+        struct record* r = globals.ring + (pos & (countof(globals.ring) - 1));
+        if (load_acquire(&r->sequence) != pos + 1)
+            break;
+
+        acquire_reporter_t reporter = globals.reporter;
+        if (reporter) {
+            char buf[1024] = { 0 };
+            format_record(buf, sizeof(buf), r);
+            reporter(r->is_error, r->file, r->line, r->function, buf);
+        }
+        store_release(&r->sequence, pos + countof(globals.ring));
+        globals.head = pos + 1;
+        ++count;
+    }
+    return count;
+}
+
+void
+logger_async_end(void)
+{
+    store_release(&globals.is_async, 0);
+    logger_async_drain();
+}
+
+size_t
+logger_async_dropped(void)
+{
+    return load_relaxed(&globals.dropped);
 }
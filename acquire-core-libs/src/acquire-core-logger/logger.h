@@ -1,11 +1,34 @@
 #ifndef H_ACQUIRE_LOGGER_V0
 #define H_ACQUIRE_LOGGER_V0
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    enum LogLevel
+    {
+        /// Matches `is_error == 0`.
+        LogLevel_Info,
+        /// Matches `is_error != 0`.
+        LogLevel_Error,
+        /// Turns logging off.
+        LogLevel_None,
+    };
+
+    /// Bits for logger_set_modules(), one per part of the project.
+    enum LogModule
+    {
+        LogModule_Platform = 1 << 0,
+        LogModule_Device = 1 << 1,
+        LogModule_Runtime = 1 << 2,
+        LogModule_Driver = 1 << 3,
+        LogModule_All = 0x7fffffff,
+    };
+
     typedef void (*acquire_reporter_t)(int is_error,
                                        const char* file,
                                        int line,
@@ -17,6 +40,32 @@ extern "C"
     /// @see acquire_reporter_ts
     void logger_set_reporter(acquire_reporter_t reporter);
 
+    /// @brief Only report messages at `level` or above.
+    /// @details Defaults to LogLevel_Info. Messages below the level cost a
+    /// load and a branch: they're dropped before their arguments are
+    /// formatted.
+    void logger_set_min_level(enum LogLevel level);
+
+    /// @brief Only report messages logged by the LogModule's set in `modules`.
+    /// @details Defaults to LogModule_All. Only checked by AQ_LOG(), since
+    /// aq_logger() doesn't know where it's called from. Each library that
+    /// links the logger, including each driver, has its own settings.
+    void logger_set_modules(uint32_t modules);
+
+    /// Bit `m` of element `i` is set when messages from module `m` with
+    /// `is_error == i` are reported. Read through aq_logger_is_enabled().
+    extern uint32_t aq_logger_enabled_[2];
+
+    static inline int aq_logger_is_enabled(int is_error, uint32_t module)
+    {
+        const uint32_t* p = aq_logger_enabled_ + (is_error != 0);
+#if defined(_MSC_VER) && !defined(__clang__)
+        return (*(const volatile uint32_t*)p & module) != 0;
+#else
+        return (__atomic_load_n(p, __ATOMIC_RELAXED) & module) != 0;
+#endif
+    }
+
     void aq_logger(int is_error,
                    const char* file,
                    int line,
@@ -24,8 +73,42 @@ extern "C"
                    const char* fmt,
                    ...);
 
+    /// @brief Queue messages instead of reporting them from the thread that
+    /// logs them.
+    /// @details While on, aq_logger() copies the format pointer and its
+    /// arguments into a lock-free ring and returns. Formatting and calls to
+    /// the reporter happen in logger_async_drain(). Strings passed with `%s`
+    /// are copied, up to 255 bytes per message in all. The format, file and
+    /// function strings are kept by pointer, so they must outlive the message.
+    /// Messages that find the ring full are dropped and counted rather than
+    /// waited on. Formats that can't be deferred, like `%Lf`, are formatted
+    /// when they're logged.
+    void logger_async_begin(void);
+
+    /// @brief Formats the queued messages and hands them to the reporter, in
+    /// the order they were queued.
+    /// @details Only one thread may drain at a time.
+    /// @returns The number of messages reported.
+    size_t logger_async_drain(void);
+
+    /// @brief Goes back to reporting messages as they're logged, after
+    /// draining what was queued.
+    void logger_async_end(void);
+
+    /// @returns The number of messages dropped because the ring was full.
+    size_t logger_async_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
 
+/// Logs a message from `module`, skipping the call altogether when the
+/// message would be filtered out. See logger_set_min_level() and
+/// logger_set_modules().
+#define AQ_LOG(module, is_error, ...)                                          \
+    (aq_logger_is_enabled((is_error), (module))                                \
+       ? aq_logger(                                                            \
+           (is_error), __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)          \
+       : (void)0)
+
 #endif // H_ACQUIRE_LOGGER_V0
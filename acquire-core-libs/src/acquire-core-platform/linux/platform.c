@@ -3,16 +3,44 @@
 #include "platform.h"
 #include "logger.h"
 
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_TSC_CLOCK
+#include <cpuid.h>
+#include <pthread.h>
+#include <x86intrin.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#define LOG(...) AQ_LOG(LogModule_Platform, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
 #define TRACE(...)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
@@ -34,10 +62,53 @@
         }                                                                      \
     } while (0)
 
+/// Used for O_DIRECT files when the kernel can't say what alignment they
+/// need. Covers devices with 512 byte and 4 KiB sectors.
+#define BYTES_OF_DIRECT_IO_ALIGNMENT (4096)
+
+static uint32_t
+direct_io_alignment(int fid)
+{
+    uint32_t out = BYTES_OF_DIRECT_IO_ALIGNMENT;
+#ifdef STATX_DIOALIGN
+    struct statx stx = { 0 };
+    if (statx(fid, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+        (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align) {
+        out = stx.stx_dio_offset_align > stx.stx_dio_mem_align
+                ? stx.stx_dio_offset_align
+                : stx.stx_dio_mem_align;
+    }
+#endif
+    return out;
+}
+
 int
 file_create(struct file* file, const char* filename, size_t bytesof_filename)
 {
-    file->fid = open(filename, O_RDWR | O_CREAT | O_NONBLOCK, 0666);
+    return file_create_with_flags(file, filename, bytesof_filename, 0);
+}
+
+int
+file_create_with_flags(struct file* file,
+                       const char* filename,
+                       size_t bytesof_filename,
+                       uint32_t flags)
+{
+    const int oflags = O_RDWR | O_CREAT | O_NONBLOCK;
+    file->fid = -1;
+    file->alignment_bytes = 1;
+    if (flags & FileCreate_Unbuffered) {
+        file->fid = open(filename, oflags | O_DIRECT, 0666);
+        if (file->fid >= 0)
+            file->alignment_bytes = direct_io_alignment(file->fid);
+        else if (errno == EINVAL)
+            LOG("\"%s\" can't bypass the page cache. Writing through it.",
+                filename);
+        else
+            CHECK_POSIX(errno);
+    }
+    if (file->fid < 0)
+        file->fid = open(filename, oflags, 0666);
     if (file->fid < 0) {
         CHECK_POSIX(errno);
     } else {
@@ -50,87 +121,1215 @@ file_create(struct file* file, const char* filename, size_t bytesof_filename)
         }
     }
     return 1;
-Error:
-    LOGE("Failed to create \"%s\"", filename);
-    return 0;
+Error:
+    LOGE("Failed to create \"%s\"", filename);
+    return 0;
+}
+
+void
+file_close(struct file* file)
+{
+    if (close(file->fid) < 0)
+        CHECK_POSIX(errno);
+Error:;
+}
+
+size_t
+file_alignment_bytes(const struct file* file)
+{
+    return file->alignment_bytes ? file->alignment_bytes : 1;
+}
+
+uint64_t
+file_align_up(const struct file* file, uint64_t nbytes)
+{
+    const uint64_t a = file_alignment_bytes(file);
+    return a * ((nbytes + a - 1) / a);
+}
+
+int
+file_truncate(struct file* file, uint64_t nbytes)
+{
+    if (ftruncate(file->fid, (off_t)nbytes) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_preallocate(struct file* file, uint64_t offset, uint64_t nbytes)
+{
+    if (fallocate(
+          file->fid, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)nbytes) < 0) {
+        if (errno == EOPNOTSUPP)
+            return 0;
+        CHECK_POSIX(errno);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_sync(const struct file* file)
+{
+    if (fsync(file->fid) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_datasync(const struct file* file)
+{
+    if (fdatasync(file->fid) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_write(const struct file* file,
+           uint64_t offset,
+           const uint8_t* cur,
+           const uint8_t* end)
+{
+    int retries = 0;
+    while (cur < end && retries < 3) {
+        size_t remaining = end - cur;
+        ssize_t written = pwrite(file->fid, cur, remaining, offset);
+        if (written < 0) {
+            CHECK_POSIX(errno);
+        }
+        retries += (written == 0);
+        offset += written;
+        cur += written;
+    }
+    return (retries < 3);
+Error:
+    return 0;
+}
+
+/// file_writev() hands the system at most this many pieces at a time.
+#define FILE_WRITEV_BATCH (64)
+
+int
+file_writev(const struct file* file,
+            uint64_t offset,
+            const struct file_iovec* iov,
+            size_t n)
+{
+    struct iovec batch[FILE_WRITEV_BATCH];
+    size_t i = 0;    // first piece not completely written
+    size_t skip = 0; // bytes of that piece already written
+    int retries = 0;
+    for (;;) {
+        while (i < n && iov[i].beg + skip == iov[i].end) {
+            ++i;
+            skip = 0;
+        }
+        if (i == n)
+            return 1;
+        if (retries >= 3)
+            return 0;
+
+        int m = 0;
+        for (; m < FILE_WRITEV_BATCH && i + m < n; ++m) {
+            const uint8_t* beg = iov[i + m].beg + (m ? 0 : skip);
+            batch[m].iov_base = (void*)beg;
+            batch[m].iov_len = iov[i + m].end - beg;
+        }
+        ssize_t written = pwritev(file->fid, batch, m, (off_t)offset);
+        if (written < 0) {
+            CHECK_POSIX(errno);
+        }
+        retries += (written == 0);
+        offset += written;
+
+        // Move past what was written.
+        size_t w = (size_t)written;
+        while (w) {
+            const size_t left = (iov[i].end - iov[i].beg) - skip;
+            if (w < left) {
+                skip += w;
+                w = 0;
+            } else {
+                w -= left;
+                skip = 0;
+                ++i;
+            }
+        }
+    }
+Error:
+    return 0;
+}
+
+int
+file_exists(const char* filename, size_t nbytes)
+{
+    int ret = access(filename, F_OK);
+    if (ret < 0) {
+        if (errno == ENOENT)
+            return 0;
+        CHECK_POSIX(errno);
+    }
+    return ret == 0;
+Error:
+    return 0;
+}
+
+int
+file_is_writable(const char* filename, size_t nbytes)
+{
+    if (file_exists(filename, nbytes)) {
+        int ret = access(filename, W_OK);
+        if (ret < 0)
+            CHECK_POSIX(errno);
+    } else {
+        // file doesn't exist, try to create
+        int fid = open(filename, O_RDWR | O_CREAT | O_NONBLOCK, 0666);
+        if (fid < 0)
+            CHECK_POSIX(errno);
+        close(fid);
+        unlink(filename);
+    }
+    return 1;
+Error:
+    LOGE("path \"%s\" not writable", filename);
+    return 0;
+}
+
+/// Asynchronous writes are split into pieces no larger than this, since the
+/// kernel reports the size of each write in 32 bits.
+#define BYTES_OF_ASYNC_WRITE_MAX (1ULL << 30)
+
+#ifdef HAVE_IO_URING
+/// A write submitted to the ring. Kept until it's reaped so short writes can
+/// be finished.
+struct uring_request
+{
+    uint64_t offset;
+    struct iovec iov;
+    int is_busy;
+};
+
+/// An io_uring set up without liburing. See io_uring_setup(2).
+struct uring
+{
+    int fd;
+    uint8_t *sq_ring, *cq_ring;
+    size_t bytes_of_sq_ring, bytes_of_cq_ring;
+    struct io_uring_sqe* sqes;
+    size_t bytes_of_sqes;
+    uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+    uint32_t *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    /// One per slot in the queue. A write's slot is its `user_data`.
+    struct uring_request* requests;
+};
+
+static void*
+map_ring(int fd, size_t nbytes, off_t offset)
+{
+    void* out = mmap(
+      0, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (out == MAP_FAILED) ? 0 : out;
+}
+
+static void
+uring_destroy(struct uring* self)
+{
+    if (self->sqes)
+        munmap(self->sqes, self->bytes_of_sqes);
+    if (self->cq_ring && self->cq_ring != self->sq_ring)
+        munmap(self->cq_ring, self->bytes_of_cq_ring);
+    if (self->sq_ring)
+        munmap(self->sq_ring, self->bytes_of_sq_ring);
+    if (self->fd >= 0)
+        close(self->fd);
+    free(self->requests);
+    free(self);
+}
+
+/// @returns A ring with room for `entries` writes, or 0 if io_uring isn't
+/// available.
+static struct uring*
+uring_create(uint32_t entries)
+{
+    struct uring* self = 0;
+    struct io_uring_params params = { 0 };
+    CHECK(self = calloc(1, sizeof(*self)));
+    self->fd = -1;
+    CHECK(self->requests = calloc(entries, sizeof(*self->requests)));
+
+    self->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (self->fd < 0) {
+        LOG("io_uring is not available: %s. Writing synchronously.",
+            strerror(errno));
+        goto Error;
+    }
+
+    const int is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    self->bytes_of_sq_ring =
+      params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    self->bytes_of_cq_ring =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (is_single_mmap && self->bytes_of_cq_ring > self->bytes_of_sq_ring)
+        self->bytes_of_sq_ring = self->bytes_of_cq_ring;
+    CHECK(self->sq_ring =
+            map_ring(self->fd, self->bytes_of_sq_ring, IORING_OFF_SQ_RING));
+    CHECK(self->cq_ring =
+            is_single_mmap ? self->sq_ring
+                           : map_ring(self->fd,
+                                      self->bytes_of_cq_ring,
+                                      IORING_OFF_CQ_RING));
+    self->bytes_of_sqes = params.sq_entries * sizeof(struct io_uring_sqe);
+    CHECK(self->sqes =
+            map_ring(self->fd, self->bytes_of_sqes, IORING_OFF_SQES));
+
+    self->sq_head = (uint32_t*)(self->sq_ring + params.sq_off.head);
+    self->sq_tail = (uint32_t*)(self->sq_ring + params.sq_off.tail);
+    self->sq_mask = (uint32_t*)(self->sq_ring + params.sq_off.ring_mask);
+    self->sq_array = (uint32_t*)(self->sq_ring + params.sq_off.array);
+    self->cq_head = (uint32_t*)(self->cq_ring + params.cq_off.head);
+    self->cq_tail = (uint32_t*)(self->cq_ring + params.cq_off.tail);
+    self->cq_mask = (uint32_t*)(self->cq_ring + params.cq_off.ring_mask);
+    self->cqes = (struct io_uring_cqe*)(self->cq_ring + params.cq_off.cqes);
+    return self;
+Error:
+    if (self)
+        uring_destroy(self);
+    return 0;
+}
+
+/// Submits whatever is queued and waits for `min_complete` completions.
+static int
+uring_enter(struct uring* self, uint32_t min_complete)
+{
+    const uint32_t to_submit =
+      *self->sq_tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+    const unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    if (!to_submit && !min_complete)
+        return 1;
+    long ret = 0;
+    do {
+        ret = syscall(
+          __NR_io_uring_enter, self->fd, to_submit, min_complete, flags, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Finishes the writes that have completed, after waiting for at least
+/// `min_complete` of them.
+static void
+uring_reap(struct file_async* self, uint32_t min_complete)
+{
+    struct uring* ring = self->ring_;
+    if (!uring_enter(ring, min_complete)) {
+        // Nothing more can be learned about the writes in flight.
+        for (uint32_t i = 0; i < self->queue_depth; ++i)
+            ring->requests[i].is_busy = 0;
+        self->inflight = 0;
+        self->has_failed = 1;
+        return;
+    }
+
+    uint32_t head = *ring->cq_head;
+    const uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe* cqe = ring->cqes + (head & *ring->cq_mask);
+        struct uring_request* req = ring->requests + cqe->user_data;
+        const uint8_t* beg = req->iov.iov_base;
+        const size_t nbytes = req->iov.iov_len;
+        if (cqe->res >= 0 || cqe->res == -EAGAIN || cqe->res == -EINTR) {
+            // Finish short writes, and writes the kernel asked to retry, here.
+            const size_t done = cqe->res > 0 ? (size_t)cqe->res : 0;
+            if (done < nbytes &&
+                !file_write(
+                  self->file, req->offset + done, beg + done, beg + nbytes))
+                self->has_failed = 1;
+        } else {
+            LOGE("Failed to write to file: %s", strerror(-cqe->res));
+            self->has_failed = 1;
+        }
+        req->is_busy = 0;
+        --self->inflight;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int
+uring_write(struct file_async* self,
+            uint64_t offset,
+            const uint8_t* cur,
+            const uint8_t* end)
+{
+    struct uring* ring = self->ring_;
+    while (cur < end) {
+        size_t nbytes = end - cur;
+        if (nbytes > BYTES_OF_ASYNC_WRITE_MAX)
+            nbytes = BYTES_OF_ASYNC_WRITE_MAX;
+        while (self->inflight == self->queue_depth)
+            uring_reap(self, 1);
+
+        uint32_t slot = 0;
+        while (ring->requests[slot].is_busy)
+            ++slot;
+        struct uring_request* req = ring->requests + slot;
+        *req = (struct uring_request){
+            .offset = offset,
+            .iov = { .iov_base = (void*)cur, .iov_len = nbytes },
+            .is_busy = 1,
+        };
+
+        const uint32_t tail = *ring->sq_tail;
+        const uint32_t index = tail & *ring->sq_mask;
+        struct io_uring_sqe* sqe = ring->sqes + index;
+        memset(sqe, 0, sizeof(*sqe)); // NOLINT
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = self->file->fid;
+        sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = slot;
+        ring->sq_array[index] = index;
+        __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++self->inflight;
+        // If this fails, the write stays queued and goes out with the next
+        // call to uring_enter().
+        CHECK(uring_enter(ring, 0));
+
+        cur += nbytes;
+        offset += nbytes;
+    }
+    return 1;
+Error:
+    self->has_failed = 1;
+    return 0;
+}
+#endif // HAVE_IO_URING
+
+int
+file_async_init(struct file_async* self,
+                const struct file* file,
+                uint32_t queue_depth)
+{
+    CHECK(queue_depth > 0);
+    *self = (struct file_async){ .file = file, .queue_depth = queue_depth };
+#ifdef HAVE_IO_URING
+    self->ring_ = uring_create(queue_depth);
+#endif
+    return 1;
+Error:
+    return 0;
+}
+
+void
+file_async_destroy(struct file_async* self)
+{
+    file_async_wait(self);
+#ifdef HAVE_IO_URING
+    if (self->ring_)
+        uring_destroy(self->ring_);
+#endif
+    self->ring_ = 0;
+}
+
+int
+file_async_write(struct file_async* self,
+                 uint64_t offset,
+                 const uint8_t* beg,
+                 const uint8_t* end)
+{
+#ifdef HAVE_IO_URING
+    if (self->ring_)
+        return uring_write(self, offset, beg, end);
+#endif
+    if (!file_write(self->file, offset, beg, end)) {
+        self->has_failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+uint32_t
+file_async_poll(struct file_async* self)
+{
+#ifdef HAVE_IO_URING
+    if (self->ring_)
+        uring_reap(self, 0);
+#endif
+    return self->inflight;
+}
+
+int
+file_async_wait(struct file_async* self)
+{
+#ifdef HAVE_IO_URING
+    while (self->inflight)
+        uring_reap(self, 1);
+#endif
+    const int is_ok = !self->has_failed;
+    self->has_failed = 0;
+    return is_ok;
+}
+
+/// memory_alloc() maps memory itself so it can ask for large pages. The size
+/// of the mapping is stored one page before the address that's handed out, so
+/// that address stays page-aligned and memory_free() knows what to unmap.
+#define BYTES_OF_LARGE_PAGE (2ULL << 20)
+
+static size_t
+round_up(size_t n, size_t multiple)
+{
+    return multiple * ((n + multiple - 1) / multiple);
+}
+
+static uint8_t*
+map_anonymous(size_t nbytes, int flags, int fd)
+{
+    void* out = mmap(
+      0, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | flags, fd, 0);
+    return (out == MAP_FAILED) ? 0 : (uint8_t*)out;
+}
+
+static uint8_t*
+map_large_pages(size_t nbytes);
+
+int
+file_map_init(struct file_map* self, struct file* file, size_t window_bytes)
+{
+    struct stat st = { 0 };
+    const long page = sysconf(_SC_PAGESIZE);
+    CHECK(page > 0);
+    if (fstat(file->fid, &st) < 0)
+        CHECK_POSIX(errno);
+    *self = (struct file_map){ .file = file,
+                               .granularity = (size_t)page,
+                               .size = (uint64_t)st.st_size };
+    self->window_bytes =
+      page * (((window_bytes ? window_bytes : 1) + page - 1) / page);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+file_map_unmap(struct file_map* self)
+{
+    int is_ok = 1;
+    if (self->data) {
+        is_ok = file_map_flush(self);
+        if (munmap(self->data, self->nbytes) < 0) {
+            LOGE("Failed to unmap file: %s", strerror(errno));
+            is_ok = 0;
+        }
+        self->data = 0;
+        self->nbytes = 0;
+    }
+    return is_ok;
+}
+
+uint8_t*
+file_map_at(struct file_map* self, uint64_t offset, size_t nbytes)
+{
+    if (!self->data || offset < self->offset ||
+        offset + nbytes > self->offset + self->nbytes) {
+        const uint64_t g = self->granularity;
+        const uint64_t beg = offset - offset % g;
+        uint64_t end = beg + self->window_bytes;
+        if (end < offset + nbytes)
+            end = g * ((offset + nbytes + g - 1) / g);
+        CHECK(file_map_unmap(self));
+        if (self->size < end) {
+            CHECK(file_truncate(self->file, end));
+            self->size = end;
+        }
+        void* data = mmap(0,
+                          end - beg,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          self->file->fid,
+                          (off_t)beg);
+        if (data == MAP_FAILED)
+            CHECK_POSIX(errno);
+        self->data = data;
+        self->offset = beg;
+        self->nbytes = end - beg;
+    }
+    return self->data + (offset - self->offset);
+Error:
+    return 0;
+}
+
+int
+file_map_flush(struct file_map* self)
+{
+    if (self->data && msync(self->data, self->nbytes, MS_ASYNC) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_map_destroy(struct file_map* self, uint64_t nbytes)
+{
+    int is_ok = file_map_unmap(self);
+    is_ok &= file_truncate(self->file, nbytes);
+    self->size = nbytes;
+    return is_ok;
+}
+
+/// Replaces the mapping with one of the first `nbytes` of the file.
+static int
+file_view_map(struct file_view* self, uint64_t nbytes)
+{
+    void* data = 0;
+    if (nbytes) {
+        data = mmap(0, (size_t)nbytes, PROT_READ, MAP_SHARED, self->fid, 0);
+        if (data == MAP_FAILED)
+            CHECK_POSIX(errno);
+    }
+    if (self->data && munmap((void*)self->data, (size_t)self->nbytes) < 0)
+        LOGE("Failed to unmap file: %s", strerror(errno));
+    self->data = data;
+    self->nbytes = nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_view_open(struct file_view* self,
+               const char* filename,
+               size_t bytesof_filename)
+{
+    *self = (struct file_view){ .fid = -1 };
+    // No lock is taken, so the file can be read while it's written.
+    if ((self->fid = open(filename, O_RDONLY)) < 0)
+        CHECK_POSIX(errno);
+    CHECK(file_view_update(self));
+    return 1;
+Error:
+    LOGE("Failed to open \"%s\" for reading", filename);
+    file_view_close(self);
+    return 0;
+}
+
+int
+file_view_update(struct file_view* self)
+{
+    struct stat st = { 0 };
+    if (fstat(self->fid, &st) < 0)
+        CHECK_POSIX(errno);
+    if ((uint64_t)st.st_size != self->nbytes)
+        CHECK(file_view_map(self, (uint64_t)st.st_size));
+    return 1;
+Error:
+    return 0;
+}
+
+void
+file_view_prefetch(const struct file_view* self,
+                   uint64_t offset,
+                   uint64_t nbytes)
+{
+    const long page = sysconf(_SC_PAGESIZE);
+    if (!self->data || page <= 0 || offset >= self->nbytes)
+        return;
+    if (nbytes > self->nbytes - offset)
+        nbytes = self->nbytes - offset;
+    // madvise() wants a page aligned address.
+    const uint64_t beg = offset - offset % (uint64_t)page;
+    madvise((void*)(self->data + beg), // NOLINT
+            (size_t)(offset + nbytes - beg),
+            MADV_WILLNEED);
+}
+
+void
+file_view_close(struct file_view* self)
+{
+    file_view_map(self, 0);
+    if (self->fid >= 0)
+        close(self->fid);
+    self->fid = -1;
+}
+
+/// Resolves `host` and `port`, and opens a socket on the first address that
+/// can be bound, when `is_passive`, or connected to otherwise.
+static int
+tcp_open(struct tcp_socket* self,
+         const char* host,
+         uint16_t port,
+         int is_passive)
+{
+    char service[8] = { 0 };
+    struct addrinfo hints = { 0 };
+    struct addrinfo *addrs = 0, *addr = 0;
+    self->fd = -1;
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = is_passive ? AI_PASSIVE : 0;
+    {
+        const int ecode = getaddrinfo(host, service, &hints, &addrs);
+        EXPECT(ecode == 0,
+               "Failed to resolve %s:%u: %s",
+               host,
+               (unsigned)port,
+               gai_strerror(ecode));
+    }
+    for (addr = addrs; addr; addr = addr->ai_next) {
+        const int one = 1;
+        self->fd = socket(addr->ai_family, addr->ai_socktype, 0);
+        if (self->fd < 0)
+            continue;
+        if (is_passive)
+            setsockopt(self->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        const int ret =
+          is_passive ? bind(self->fd, addr->ai_addr, addr->ai_addrlen)
+                     : connect(self->fd, addr->ai_addr, addr->ai_addrlen);
+        if (ret == 0)
+            break;
+        close(self->fd);
+        self->fd = -1;
+    }
+    EXPECT(self->fd >= 0,
+           "Failed to %s %s:%u: %s",
+           is_passive ? "listen on" : "connect to",
+           host,
+           (unsigned)port,
+           strerror(errno));
+    freeaddrinfo(addrs);
+    return 1;
+Error:
+    if (addrs)
+        freeaddrinfo(addrs);
+    return 0;
+}
+
+/// Sets the options every connection gets.
+static void
+tcp_configure(int fd)
+{
+    const int one = 1;
+    // Frames are sent in large pieces. Small ones, like the last few bytes
+    // of a stream, shouldn't wait for more to come.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int
+tcp_connect(struct tcp_socket* self, const char* host, uint16_t port)
+{
+    CHECK(self);
+    CHECK(host);
+    CHECK(tcp_open(self, host, port, 0));
+    tcp_configure(self->fd);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_listen(struct tcp_socket* self, const char* host, uint16_t* port)
+{
+    struct sockaddr_storage addr = { 0 };
+    socklen_t bytes_of_addr = sizeof(addr);
+    CHECK(self);
+    CHECK(port);
+    CHECK(tcp_open(self, host, *port, 1));
+    if (listen(self->fd, 8) < 0 ||
+        getsockname(self->fd, (struct sockaddr*)&addr, &bytes_of_addr) < 0) {
+        LOGE("Failed to listen on port %u: %s",
+             (unsigned)*port,
+             strerror(errno));
+        tcp_close(self);
+        goto Error;
+    }
+    *port = ntohs(addr.ss_family == AF_INET6
+                    ? ((struct sockaddr_in6*)&addr)->sin6_port
+                    : ((struct sockaddr_in*)&addr)->sin_port);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_accept(const struct tcp_socket* listener, struct tcp_socket* self)
+{
+    CHECK(listener);
+    CHECK(self);
+    do {
+        self->fd = accept(listener->fd, 0, 0);
+    } while (self->fd < 0 && errno == EINTR);
+    if (self->fd < 0)
+        CHECK_POSIX(errno);
+    tcp_configure(self->fd);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_sendv(const struct tcp_socket* self,
+          const struct file_iovec* iov,
+          size_t n,
+          size_t* nbytes)
+{
+    struct iovec batch[FILE_WRITEV_BATCH];
+    size_t i = 0;    // first piece not completely sent
+    size_t skip = 0; // bytes of that piece already sent
+    CHECK(self);
+    CHECK(nbytes);
+    *nbytes = 0;
+    for (;;) {
+        while (i < n && iov[i].beg + skip == iov[i].end) {
+            ++i;
+            skip = 0;
+        }
+        if (i == n)
+            return 1;
+
+        struct msghdr msg = { 0 };
+        int m = 0;
+        for (; m < FILE_WRITEV_BATCH && i + m < n; ++m) {
+            const uint8_t* beg = iov[i + m].beg + (m ? 0 : skip);
+            batch[m].iov_base = (void*)beg;
+            batch[m].iov_len = iov[i + m].end - beg;
+        }
+        msg.msg_iov = batch;
+        msg.msg_iovlen = m;
+        const ssize_t sent =
+          sendmsg(self->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            CHECK_POSIX(errno);
+        }
+        *nbytes += (size_t)sent;
+
+        // Move past what was sent.
+        size_t w = (size_t)sent;
+        while (w) {
+            const size_t left = (iov[i].end - iov[i].beg) - skip;
+            if (w < left) {
+                skip += w;
+                w = 0;
+            } else {
+                w -= left;
+                skip = 0;
+                ++i;
+            }
+        }
+    }
+Error:
+    return 0;
+}
+
+int
+tcp_wait_writable(const struct tcp_socket* self, float timeout_ms)
+{
+    struct pollfd p = { .fd = self->fd, .events = POLLOUT };
+    const int ms = timeout_ms > 0 ? (int)(timeout_ms + 0.999f) : 0;
+    int ret = 0;
+    do {
+        ret = poll(&p, 1, ms);
+    } while (ret < 0 && errno == EINTR);
+    // Errors and hang ups are left to the next send to report.
+    return ret != 0;
+}
+
+int
+tcp_recv(const struct tcp_socket* self, uint8_t* beg, uint8_t* end)
+{
+    while (beg < end) {
+        const ssize_t got = recv(self->fd, beg, end - beg, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        beg += got;
+    }
+    return 1;
 }
 
 void
-file_close(struct file* file)
+tcp_close(struct tcp_socket* self)
 {
-    if (close(file->fid) < 0)
-        CHECK_POSIX(errno);
-Error:;
+    if (self && self->fd >= 0)
+        close(self->fd);
+    if (self)
+        self->fd = -1;
 }
 
-int
-file_write(const struct file* file,
-           uint64_t offset,
-           const uint8_t* cur,
-           const uint8_t* end)
+/// Shared memory names are paths starting with a '/'. macOS takes at most 31
+/// characters.
+static int
+shared_memory_path(char* path, size_t bytes_of_path, const char* name)
 {
-    int retries = 0;
-    while (cur < end && retries < 3) {
-        size_t remaining = end - cur;
-        ssize_t written = pwrite(file->fid, cur, remaining, offset);
-        if (written < 0) {
-            CHECK_POSIX(errno);
-        }
-        retries += (written == 0);
-        offset += written;
-        cur += written;
+    size_t n = 0;
+    for (; name && name[n]; ++n) {
+        const char c = name[n];
+        EXPECT(n < 30 && (isalnum((unsigned char)c) || c == '-' || c == '_'),
+               "Invalid name for shared memory: \"%s\"",
+               name);
     }
-    return (retries < 3);
+    EXPECT(n > 0, "Expected a name for shared memory.");
+    snprintf(path, bytes_of_path, "/%s", name);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+shared_memory_map(struct shared_memory* self, int fd, uint64_t nbytes)
+{
+    void* data =
+      mmap(0, (size_t)nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        CHECK_POSIX(errno);
+    self->data = data;
+    self->nbytes = nbytes;
+    return 1;
 Error:
     return 0;
 }
 
 int
-file_exists(const char* filename, size_t nbytes)
+shared_memory_create(struct shared_memory* self,
+                     const char* name,
+                     uint64_t nbytes)
 {
-    int ret = access(filename, F_OK);
-    if (ret < 0) {
-        if (errno == ENOENT)
-            return 0;
+    int fd = -1;
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(self->path, sizeof(self->path), name));
+    shm_unlink(self->path);
+    if ((fd = shm_open(self->path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
         CHECK_POSIX(errno);
-    }
-    return ret == 0;
+    self->is_owner = 1;
+    if (ftruncate(fd, (off_t)nbytes) < 0)
+        CHECK_POSIX(errno);
+    CHECK(shared_memory_map(self, fd, nbytes));
+    close(fd);
+    return 1;
 Error:
+    LOGE("Failed to create %llu bytes of shared memory named \"%s\"",
+         (unsigned long long)nbytes,
+         name ? name : "(null)");
+    if (fd >= 0)
+        close(fd);
+    shared_memory_close(self);
     return 0;
 }
 
 int
-file_is_writable(const char* filename, size_t nbytes)
+shared_memory_open(struct shared_memory* self, const char* name)
 {
-    if (file_exists(filename, nbytes)) {
-        int ret = access(filename, W_OK);
-        if (ret < 0)
-            CHECK_POSIX(errno);
-    } else {
-        // file doesn't exist, try to create
-        int fid = open(filename, O_RDWR | O_CREAT | O_NONBLOCK, 0666);
-        if (fid < 0)
-            CHECK_POSIX(errno);
-        close(fid);
-        unlink(filename);
-    }
+    int fd = -1;
+    struct stat st = { 0 };
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(self->path, sizeof(self->path), name));
+    // Not logged, so callers can wait for the name to show up.
+    if ((fd = shm_open(self->path, O_RDWR, 0)) < 0)
+        goto Error;
+    if (fstat(fd, &st) < 0)
+        CHECK_POSIX(errno);
+    CHECK(shared_memory_map(self, fd, (uint64_t)st.st_size));
+    close(fd);
     return 1;
 Error:
-    LOGE("path \"%s\" not writable", filename);
+    if (fd >= 0)
+        close(fd);
+    shared_memory_close(self);
     return 0;
 }
 
+void
+shared_memory_close(struct shared_memory* self)
+{
+    if (self->data)
+        munmap(self->data, (size_t)self->nbytes);
+    if (self->is_owner)
+        shm_unlink(self->path);
+    *self = (struct shared_memory){ 0 };
+}
+
+uint64_t
+process_id()
+{
+    return (uint64_t)getpid();
+}
+
+int
+process_is_alive(uint64_t pid)
+{
+    // Signal 0 only checks that the process is there.
+    return pid && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
 void*
 memory_alloc(size_t capacity_bytes, enum AllocatorHint hint)
 {
-    return malloc(capacity_bytes);
+    return memory_alloc_on_node(capacity_bytes, hint, -1);
+}
+
+/// Asks the kernel to take the pages of `[base,base+nbytes)` from `node`
+/// when they're first touched. Without libnuma, so the system call is made
+/// directly.
+static void
+bind_to_node(uint8_t* base, size_t nbytes, int32_t node)
+{
+    // From <linux/mempolicy.h>. MPOL_PREFERRED falls back to other nodes
+    // when `node` runs out, where MPOL_BIND would fail the page fault.
+    const int mpol_preferred = 1;
+    unsigned long mask[2] = { 0 };
+    const int bits_per_word = 8 * sizeof(mask[0]);
+    if (node >= 2 * bits_per_word) {
+        LOG("Can't place memory on NUMA node %d.", (int)node);
+        return;
+    }
+    mask[node / bits_per_word] = 1UL << (node % bits_per_word);
+    if (syscall(SYS_mbind,
+                base,
+                nbytes,
+                mpol_preferred,
+                mask,
+                (unsigned long)(2 * bits_per_word),
+                0)) {
+        LOG("Failed to place %llu bytes on NUMA node %d (%s). Continuing "
+            "with the default placement.",
+            (unsigned long long)nbytes,
+            (int)node,
+            strerror(errno));
+    }
+}
+
+void*
+memory_alloc_on_node(size_t capacity_bytes,
+                     enum AllocatorHint hint,
+                     int32_t node)
+{
+    const size_t bytes_of_header = (size_t)sysconf(_SC_PAGESIZE);
+    size_t nbytes = bytes_of_header + capacity_bytes;
+    uint8_t* base = 0;
+
+    if (hint == AllocatorHint_Default) {
+        EXPECT(base = map_anonymous(nbytes, 0, -1),
+               "Failed to map %llu bytes: %s",
+               (unsigned long long)nbytes,
+               strerror(errno));
+        if (node >= 0)
+            bind_to_node(base, nbytes, node);
+    } else {
+        nbytes = round_up(nbytes, BYTES_OF_LARGE_PAGE);
+        CHECK(base = map_large_pages(nbytes));
+        // Before locking, which touches every page.
+        if (node >= 0)
+            bind_to_node(base, nbytes, node);
+        if (hint == AllocatorHint_LargePageLocked && mlock(base, nbytes)) {
+            LOG("Could not lock %llu bytes in memory (%s). "
+                "Check RLIMIT_MEMLOCK. Continuing with unlocked memory.",
+                (unsigned long long)nbytes,
+                strerror(errno));
+        }
+    }
+    *(size_t*)base = nbytes;
+    return base + bytes_of_header;
+Error:
+    return 0;
 }
 
 void
 memory_free(void* address)
 {
-    free(address);
+    if (!address)
+        return;
+    const size_t bytes_of_header = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t* base = (uint8_t*)address - bytes_of_header;
+    // Unmapping also unlocks.
+    if (munmap(base, *(size_t*)base)) {
+        LOGE("Failed to unmap memory at %p: %s", address, strerror(errno));
+    }
+}
+
+uint64_t
+memory_physical_bytes(void)
+{
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long bytes_of_page = sysconf(_SC_PAGESIZE);
+    return (pages > 0 && bytes_of_page > 0)
+             ? (uint64_t)pages * (uint64_t)bytes_of_page
+             : 0;
+}
+
+/// Reads the first line of the text file at `path` into `buf`.
+/// @returns 1 on success, otherwise 0.
+static int
+read_first_line(const char* path, char* buf, int nbytes)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return 0;
+    const int ok = fgets(buf, nbytes, f) != 0;
+    fclose(f);
+    return ok;
+}
+
+/// Calls `f(lo, hi, ctx)` for each range in a list like "0-3,8,10-11", as
+/// the kernel lists CPUs and nodes.
+static void
+for_each_range(const char* list,
+               void (*f)(unsigned long lo, unsigned long hi, void* ctx),
+               void* ctx)
+{
+    const char* s = list;
+    while (isdigit((unsigned char)*s)) {
+        char* end = 0;
+        const unsigned long lo = strtoul(s, &end, 10);
+        unsigned long hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtoul(s + 1, &end, 10);
+            s = end;
+        }
+        f(lo, hi, ctx);
+        if (*s == ',')
+            ++s;
+    }
+}
+
+static void
+count_to_last(unsigned long lo, unsigned long hi, void* ctx)
+{
+    (void)lo;
+    uint32_t* n = (uint32_t*)ctx;
+    if (hi + 1 > *n)
+        *n = (uint32_t)(hi + 1);
+}
+
+static void
+add_to_mask(unsigned long lo, unsigned long hi, void* ctx)
+{
+    uint64_t* mask = (uint64_t*)ctx;
+    for (unsigned long i = lo; i <= hi && i < 64; ++i)
+        *mask |= 1ULL << i;
+}
+
+uint32_t
+numa_node_count(void)
+{
+    char list[256] = { 0 };
+    uint32_t n = 0;
+    if (read_first_line(
+          "/sys/devices/system/node/possible", list, sizeof(list)))
+        for_each_range(list, count_to_last, &n);
+    return n ? n : 1;
+}
+
+uint64_t
+numa_node_affinity_mask(uint32_t node)
+{
+    char path[64] = { 0 }, list[1024] = { 0 };
+    uint64_t mask = 0;
+    snprintf(
+      path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    if (read_first_line(path, list, sizeof(list)))
+        for_each_range(list, add_to_mask, &mask);
+    return mask;
+}
+
+static uint8_t*
+map_large_pages(size_t nbytes)
+{
+    uint8_t* base = map_anonymous(nbytes, MAP_HUGETLB, -1);
+    if (base)
+        return base;
+    LOG("No huge pages available for %llu bytes (%s). "
+        "Falling back to transparent huge pages.",
+        (unsigned long long)nbytes,
+        strerror(errno));
+
+    EXPECT(base = map_anonymous(nbytes, 0, -1),
+           "Failed to map %llu bytes: %s",
+           (unsigned long long)nbytes,
+           strerror(errno));
+    if (madvise(base, nbytes, MADV_HUGEPAGE)) {
+        LOG("Transparent huge pages unavailable (%s). Using regular pages.",
+            strerror(errno));
+    }
+    return base;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__memory_alloc_large_page_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    CHECK(p = memory_alloc(nbytes, AllocatorHint_LargePage));
+    CHECK(((uintptr_t)p & 4095) == 0);
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    memory_free(p);
+    memory_free(0);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
+}
+
+/// Memory placed on the first node is usable, and lands there where the
+/// system says where pages are.
+int
+unit_test__memory_alloc_on_node_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    const uint32_t nodes = numa_node_count();
+    CHECK(nodes >= 1);
+    for (uint32_t i = 0; i < nodes; ++i)
+        LOG("NUMA node %u: CPUs %#llx",
+            i,
+            (unsigned long long)numa_node_affinity_mask(i));
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_LargePage, 0));
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    {
+        // Where the kernel put the page, from <linux/mempolicy.h>.
+        const unsigned long mpol_f_node = 1, mpol_f_addr = 2;
+        int node = -1;
+        if (syscall(SYS_get_mempolicy,
+                    &node,
+                    0,
+                    0,
+                    p,
+                    mpol_f_node | mpol_f_addr) == 0)
+            CHECK(node == 0);
+    }
+    memory_free(p);
+    p = 0;
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_Default, -1));
+    memory_free(p);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
 }
+#endif
 
 void
 clock_init(struct clock* clock)
@@ -179,6 +1378,154 @@ clock_tic(struct clock* clock)
     return (uint64_t)(1e9 * t.tv_sec) + (uint64_t)t.tv_nsec;
 }
 
+#ifdef HAVE_TSC_CLOCK
+
+// clock_tic_fast() reads the TSC when it ticks at a constant rate and the
+// kernel keeps time with it too, so both clocks advance together. Each thread
+// maps TSC ticks onto clock_tic() with a line through two reads of both,
+// re-drawn every TSC_RESYNC_NS from a longer baseline, so nothing is shared
+// between threads.
+
+/// Time between the reads the first line is drawn through.
+#define TSC_CALIBRATION_NS (10000000ULL)
+/// Time a line is used for before it's re-drawn.
+#define TSC_RESYNC_NS (100000000ULL)
+
+struct tsc_clock
+{
+    /// Where the line starts: a TSC read and the clock_tic() read with it.
+    uint64_t tsc0, tic0;
+    /// 0 until the first line is drawn.
+    double tics_per_tsc;
+    /// Past this TSC read, the line is re-drawn.
+    uint64_t tsc_resync;
+    /// The last value returned, so the thread never sees time go back when
+    /// the line moves.
+    uint64_t last;
+};
+
+static __thread struct tsc_clock tsc_clock_;
+static pthread_once_t tsc_clock_once_ = PTHREAD_ONCE_INIT;
+static int tsc_clock_is_usable_;
+
+static void
+tsc_clock_check(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    // CPUID 0x80000007 EDX bit 8: the TSC is invariant.
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+        !((edx >> 8) & 1))
+        return;
+    // Virtual machines may report an invariant TSC the kernel still won't
+    // trust, so only use it when the kernel does.
+    char name[16] = { 0 };
+    FILE* f = fopen(
+      "/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (!f)
+        return;
+    const int ok = fgets(name, sizeof(name), f) != 0;
+    fclose(f);
+    tsc_clock_is_usable_ = ok && strncmp(name, "tsc", 3) == 0;
+    LOG("clock_tic_fast() %s the TSC.",
+        tsc_clock_is_usable_ ? "reads" : "doesn't read");
+}
+
+/// Reads the TSC and clock_tic() together and moves the line to them. Of a
+/// few tries, keeps the one whose TSC reads either side of clock_tic() are
+/// closest, so the thread being preempted doesn't skew the line.
+static uint64_t
+tsc_clock_resync(struct tsc_clock* self)
+{
+    uint64_t tic = 0, tsc = 0, best = ~0ULL;
+    for (int i = 0; i < 3; ++i) {
+        const uint64_t before = __rdtsc();
+        const uint64_t t = clock_tic(0);
+        const uint64_t after = __rdtsc();
+        if (after - before < best) {
+            best = after - before;
+            tic = t;
+            tsc = before + (after - before) / 2;
+        }
+    }
+    if (!self->tsc0) {
+        self->tsc0 = tsc;
+        self->tic0 = tic;
+        self->tsc_resync = tsc;
+        return tic;
+    }
+    if (tic - self->tic0 < TSC_CALIBRATION_NS || tsc <= self->tsc0)
+        return tic; // Not far enough apart to draw a line through yet.
+    const double tics_per_tsc =
+      (double)(tic - self->tic0) / (double)(tsc - self->tsc0);
+    self->tsc0 = tsc;
+    self->tic0 = tic;
+    self->tics_per_tsc = tics_per_tsc;
+    self->tsc_resync = tsc + (uint64_t)(TSC_RESYNC_NS / tics_per_tsc);
+    return tic;
+}
+
+uint64_t
+clock_tic_fast(void)
+{
+    struct tsc_clock* const self = &tsc_clock_;
+    uint64_t tic;
+    // A line is only drawn once the TSC is known to be usable.
+    if (self->tics_per_tsc > 0.0) {
+        const uint64_t tsc = __rdtsc();
+        if (tsc >= self->tsc0 && tsc < self->tsc_resync)
+            tic = self->tic0 +
+                  (uint64_t)((double)(tsc - self->tsc0) * self->tics_per_tsc);
+        else
+            tic = tsc_clock_resync(self);
+    } else {
+        pthread_once(&tsc_clock_once_, tsc_clock_check);
+        if (!tsc_clock_is_usable_)
+            return clock_tic(0);
+        tic = tsc_clock_resync(self);
+    }
+    if (tic < self->last)
+        tic = self->last;
+    self->last = tic;
+    return tic;
+}
+
+#else
+
+uint64_t
+clock_tic_fast(void)
+{
+    return clock_tic(0);
+}
+
+#endif // HAVE_TSC_CLOCK
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_tic_fast_follows_clock_tic()
+{
+    uint64_t last = clock_tic_fast();
+    struct clock clock;
+    clock_init(&clock);
+    // Long enough for the line to be drawn and re-drawn.
+    while (clock_toc_ms(&clock) < 250.0) {
+        const uint64_t before = clock_tic(0);
+        const uint64_t fast = clock_tic_fast();
+        const uint64_t after = clock_tic(0);
+        CHECK(fast >= last);
+        // Within 50 us of the clock it stands in for.
+        EXPECT(fast + 50000 >= before && fast <= after + 50000,
+               "Expected %llu in [%llu, %llu].",
+               (unsigned long long)fast,
+               (unsigned long long)before,
+               (unsigned long long)after);
+        last = fast;
+    }
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int64_t
 clock_toc(struct clock* clock)
 {
@@ -196,6 +1543,13 @@ clock_toc_ms(struct clock* clock)
     return (double)(clock_toc(clock) * 1e-6);
 }
 
+int64_t
+clock_tics_to_ns(int64_t tics)
+{
+    // clock tics are in ns
+    return tics;
+}
+
 int8_t
 clock_cmp(struct clock* clock, uint64_t timestamp)
 {
@@ -247,6 +1601,58 @@ unit_test__clock_sleep_ms_accepts_null()
 }
 #endif
 
+void
+clock_sleep_precise_ms(struct clock* clock, float delay_ms, float spin_ms)
+{
+    struct clock dummy;
+    if (!clock) {
+        clock_init(&dummy);
+        clock = &dummy;
+    }
+
+    // clock tics are in ns
+    const int64_t deadline = (int64_t)(1e6 * delay_ms);
+    const int64_t sleep_ns =
+      deadline - (int64_t)(1e6 * spin_ms) - clock_toc(clock);
+    if (sleep_ns > 0) {
+        // CLOCK_MONOTONIC_RAW can't be slept on, so wake up by
+        // CLOCK_MONOTONIC instead.
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        const int64_t nsec = t.tv_nsec + sleep_ns;
+        t.tv_sec += (time_t)(nsec / 1000000000);
+        t.tv_nsec = (long)(nsec % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0) == EINTR)
+            ;
+    }
+    while (clock_toc(clock) < deadline)
+        ;
+    clock_tic(clock);
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_sleep_precise_ms_meets_deadline()
+{
+    struct clock total, each;
+    clock_init(&total);
+    for (int i = 0; i < 100; ++i) {
+        clock_init(&each);
+        const uint64_t beg = clock_tic(&each);
+        clock_sleep_precise_ms(&each, 0.25f, CLOCK_SLEEP_SPIN_MS);
+        CHECK(clock_tics_to_ns((int64_t)(clock_tic(0) - beg)) >= 250000);
+    }
+    // Generous, so busy machines don't fail.
+    const double elapsed_ms = clock_toc_ms(&total);
+    EXPECT(elapsed_ms >= 25.0 && elapsed_ms < 250.0,
+           "Expected 100 sleeps of 0.25 ms to take 25 ms. Took %f ms.",
+           elapsed_ms);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 void
 lock_init(struct lock* self)
 {
@@ -276,6 +1682,15 @@ Error:;
 void
 condition_variable_init(struct condition_variable* self)
 {
+    // Timed waits are measured against the monotonic clock so they aren't
+    // affected by changes to the wall clock.
+    pthread_condattr_t attr;
+    CHECK_POSIX(pthread_condattr_init(&attr));
+    CHECK_POSIX(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    CHECK_POSIX(pthread_cond_init(&self->inner_, &attr));
+    pthread_condattr_destroy(&attr);
+    return;
+Error:
     self->inner_ = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
 }
 
@@ -287,6 +1702,28 @@ condition_variable_wait(struct condition_variable* restrict self,
 Error:;
 }
 
+int
+condition_variable_timed_wait(struct condition_variable* restrict self,
+                              struct lock* restrict lock,
+                              uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    const int ecode =
+      pthread_cond_timedwait(&self->inner_, &lock->inner_, &deadline);
+    if (ecode == ETIMEDOUT)
+        return 0;
+    CHECK_POSIX(ecode);
+Error:
+    return 1;
+}
+
 void
 condition_variable_notify_all(struct condition_variable* self)
 {
@@ -373,6 +1810,131 @@ Error:
     return;
 }
 
+int
+thread_set_current_attributes(const struct thread_attributes* attributes)
+{
+    int is_ok = 1;
+    const pthread_t self = pthread_self();
+    if (attributes->name[0]) {
+        char name[16] = { 0 };
+        strncpy(name, attributes->name, sizeof(name) - 1); // NOLINT
+        if (pthread_setname_np(self, name)) {
+            LOG("Could not name thread \"%s\"", name);
+            is_ok = 0;
+        }
+    }
+    if (attributes->affinity_mask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int i = 0; i < 64; ++i)
+            if ((attributes->affinity_mask >> i) & 1)
+                CPU_SET(i, &cpus);
+        int ecode = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+        if (ecode) {
+            LOG("Could not set thread affinity to %#llx: %s",
+                (unsigned long long)attributes->affinity_mask,
+                strerror(ecode));
+            is_ok = 0;
+        }
+    }
+    switch (attributes->priority) {
+        case ThreadPriority_Default:
+            break;
+        case ThreadPriority_High:
+            // Niceness is per thread on Linux.
+            if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -10)) {
+                LOG("Could not raise thread priority: %s", strerror(errno));
+                is_ok = 0;
+            }
+            break;
+        case ThreadPriority_Realtime: {
+            struct sched_param param = {
+                .sched_priority = sched_get_priority_max(SCHED_FIFO) / 2,
+            };
+            int ecode = pthread_setschedparam(self, SCHED_FIFO, &param);
+            if (ecode) {
+                LOG("Could not use realtime scheduling: %s", strerror(ecode));
+                is_ok = 0;
+            }
+            break;
+        }
+    }
+    return is_ok;
+}
+
+int
+thread_get_cpu_time_us(struct thread* self, uint64_t* us)
+{
+    int is_ok = 0;
+    clockid_t cid;
+    struct timespec ts;
+    pthread_mutex_lock(&self->lock_);
+    if (self->is_live_ && !pthread_getcpuclockid(self->inner_, &cid) &&
+        !clock_gettime(cid, &ts)) {
+        *us = 1000000ULL * (uint64_t)ts.tv_sec + (uint64_t)ts.tv_nsec / 1000;
+        is_ok = 1;
+    }
+    pthread_mutex_unlock(&self->lock_);
+    return is_ok;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__thread_set_current_attributes_names_the_thread()
+{
+    const struct thread_attributes attributes = {
+        .priority = ThreadPriority_Default,
+        .name = "acq-unit-test",
+    };
+    CHECK(thread_set_current_attributes(&attributes));
+    char name[16] = { 0 };
+    CHECK(pthread_getname_np(pthread_self(), name, sizeof(name)) == 0);
+    CHECK(strcmp(name, "acq-unit-test") == 0);
+    return 1;
+Error:
+    return 0;
+}
+
+struct atomics_test_counters
+{
+    uint32_t added;
+    size_t exchanged;
+};
+
+static void
+atomics_test_worker(struct atomics_test_counters* counters)
+{
+    for (int i = 0; i < 10000; ++i) {
+        fetch_add_relaxed(&counters->added, 1);
+        size_t expected = load_relaxed(&counters->exchanged);
+        while (!compare_exchange_acq_rel(
+          &counters->exchanged, &expected, expected + 1))
+            cpu_relax();
+    }
+}
+
+int
+unit_test__atomics_count_across_threads()
+{
+    struct atomics_test_counters counters = { 0 };
+    struct thread threads[4];
+    for (int i = 0; i < 4; ++i) {
+        thread_init(threads + i);
+        CHECK(thread_create(
+          threads + i, (void (*)(void*))atomics_test_worker, &counters));
+    }
+    for (int i = 0; i < 4; ++i)
+        thread_join(threads + i);
+    CHECK(load_acquire(&counters.added) == 40000);
+    CHECK(load_acquire(&counters.exchanged) == 40000);
+    CHECK(exchange_acq_rel(&counters.added, 0) == 40000);
+    CHECK(counters.added == 0);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int
 lib_open(struct lib* self, const char* absolute_path)
 {
@@ -415,6 +1977,12 @@ Error:
     return out;
 }
 
+void*
+lib_find(struct lib* self, const char* name)
+{
+    return self && self->inner && name ? dlsym(self->inner, name) : 0;
+}
+
 // Returns the absolute path to the module containing this function.
 // Return value must be freed by caller
 static char*
@@ -1,6 +1,8 @@
 #include "platform.h"
 #include "logger.h"
 
+#include <ctype.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -10,10 +12,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/uio.h>
+#include <mach/mach.h>
+#include <mach/vm_statistics.h>
+#include <pthread/qos.h>
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Platform, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
 #define TRACE(...)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
@@ -41,13 +54,34 @@
         }                                                                      \
     } while (0)
 
+/// F_NOCACHE doesn't require aligned writes, but writes that aren't aligned
+/// to pages partly go through the cache.
+#define BYTES_OF_UNBUFFERED_ALIGNMENT (4096)
+
 int
 file_create(struct file* file, const char* filename, size_t bytesof_filename)
 {
+    return file_create_with_flags(file, filename, bytesof_filename, 0);
+}
+
+int
+file_create_with_flags(struct file* file,
+                       const char* filename,
+                       size_t bytesof_filename,
+                       uint32_t flags)
+{
+    file->alignment_bytes = 1;
     file->fid = open(filename, O_RDWR | O_CREAT | O_EXLOCK | O_NONBLOCK, 0666);
     if (file->fid < 0) {
         CHECK_POSIX(errno);
     }
+    if (flags & FileCreate_Unbuffered) {
+        if (fcntl(file->fid, F_NOCACHE, 1) < 0)
+            LOG("\"%s\" can't bypass the file cache. Writing through it.",
+                filename);
+        else
+            file->alignment_bytes = BYTES_OF_UNBUFFERED_ALIGNMENT;
+    }
     return 1;
 Error:
     LOGE("Failed to create \"%s\"", filename);
@@ -62,6 +96,70 @@ file_close(struct file* file)
 Error:;
 }
 
+size_t
+file_alignment_bytes(const struct file* file)
+{
+    return file->alignment_bytes ? file->alignment_bytes : 1;
+}
+
+uint64_t
+file_align_up(const struct file* file, uint64_t nbytes)
+{
+    const uint64_t a = file_alignment_bytes(file);
+    return a * ((nbytes + a - 1) / a);
+}
+
+int
+file_truncate(struct file* file, uint64_t nbytes)
+{
+    if (ftruncate(file->fid, (off_t)nbytes) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_preallocate(struct file* file, uint64_t offset, uint64_t nbytes)
+{
+    (void)offset;
+    // F_PREALLOCATE reserves space relative to what the file already has,
+    // not at an offset. Contiguous space is tried first.
+    fstore_t store = { .fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL,
+                       .fst_posmode = F_PEOFPOSMODE,
+                       .fst_offset = 0,
+                       .fst_length = (off_t)nbytes };
+    if (fcntl(file->fid, F_PREALLOCATE, &store) < 0) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(file->fid, F_PREALLOCATE, &store) < 0) {
+            if (errno == ENOTSUP)
+                return 0;
+            CHECK_POSIX(errno);
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_sync(const struct file* file)
+{
+    // fsync() only hands the data to the drive, which may keep it in its
+    // cache. F_FULLFSYNC asks the drive to flush it, where supported.
+    if (fcntl(file->fid, F_FULLFSYNC) < 0 && fsync(file->fid) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_datasync(const struct file* file)
+{
+    return file_sync(file);
+}
+
 int
 file_write(const struct file* file,
            uint64_t offset,
@@ -84,6 +182,60 @@ Error:
     return 0;
 }
 
+/// file_writev() hands the system at most this many pieces at a time.
+#define FILE_WRITEV_BATCH (64)
+
+int
+file_writev(const struct file* file,
+            uint64_t offset,
+            const struct file_iovec* iov,
+            size_t n)
+{
+    struct iovec batch[FILE_WRITEV_BATCH];
+    size_t i = 0;    // first piece not completely written
+    size_t skip = 0; // bytes of that piece already written
+    int retries = 0;
+    for (;;) {
+        while (i < n && iov[i].beg + skip == iov[i].end) {
+            ++i;
+            skip = 0;
+        }
+        if (i == n)
+            return 1;
+        if (retries >= 3)
+            return 0;
+
+        int m = 0;
+        for (; m < FILE_WRITEV_BATCH && i + m < n; ++m) {
+            const uint8_t* beg = iov[i + m].beg + (m ? 0 : skip);
+            batch[m].iov_base = (void*)beg;
+            batch[m].iov_len = iov[i + m].end - beg;
+        }
+        ssize_t written = pwritev(file->fid, batch, m, (off_t)offset);
+        if (written < 0) {
+            CHECK_POSIX(errno);
+        }
+        retries += (written == 0);
+        offset += written;
+
+        // Move past what was written.
+        size_t w = (size_t)written;
+        while (w) {
+            const size_t left = (iov[i].end - iov[i].beg) - skip;
+            if (w < left) {
+                skip += w;
+                w = 0;
+            } else {
+                w -= left;
+                skip = 0;
+                ++i;
+            }
+        }
+    }
+Error:
+    return 0;
+}
+
 int
 file_exists(const char* filename, size_t nbytes)
 {
@@ -119,17 +271,690 @@ Error:
     return 0;
 }
 
+/// Writes are synchronous on this platform, so none are ever in flight.
+int
+file_async_init(struct file_async* self,
+                const struct file* file,
+                uint32_t queue_depth)
+{
+    CHECK(queue_depth > 0);
+    *self = (struct file_async){ .file = file, .queue_depth = queue_depth };
+    return 1;
+Error:
+    return 0;
+}
+
+void
+file_async_destroy(struct file_async* self)
+{
+    file_async_wait(self);
+}
+
+int
+file_async_write(struct file_async* self,
+                 uint64_t offset,
+                 const uint8_t* beg,
+                 const uint8_t* end)
+{
+    if (!file_write(self->file, offset, beg, end)) {
+        self->has_failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+uint32_t
+file_async_poll(struct file_async* self)
+{
+    return 0;
+}
+
+int
+file_async_wait(struct file_async* self)
+{
+    const int is_ok = !self->has_failed;
+    self->has_failed = 0;
+    return is_ok;
+}
+
+/// memory_alloc() maps memory itself so it can ask for large pages. The size
+/// of the mapping is stored one page before the address that's handed out, so
+/// that address stays page-aligned and memory_free() knows what to unmap.
+#define BYTES_OF_LARGE_PAGE (2ULL << 20)
+
+static size_t
+round_up(size_t n, size_t multiple)
+{
+    return multiple * ((n + multiple - 1) / multiple);
+}
+
+static uint8_t*
+map_anonymous(size_t nbytes, int flags, int fd)
+{
+    void* out = mmap(
+      0, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | flags, fd, 0);
+    return (out == MAP_FAILED) ? 0 : (uint8_t*)out;
+}
+
+static uint8_t*
+map_large_pages(size_t nbytes);
+
+int
+file_map_init(struct file_map* self, struct file* file, size_t window_bytes)
+{
+    struct stat st = { 0 };
+    const long page = sysconf(_SC_PAGESIZE);
+    CHECK(page > 0);
+    if (fstat(file->fid, &st) < 0)
+        CHECK_POSIX(errno);
+    *self = (struct file_map){ .file = file,
+                               .granularity = (size_t)page,
+                               .size = (uint64_t)st.st_size };
+    self->window_bytes =
+      page * (((window_bytes ? window_bytes : 1) + page - 1) / page);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+file_map_unmap(struct file_map* self)
+{
+    int is_ok = 1;
+    if (self->data) {
+        is_ok = file_map_flush(self);
+        if (munmap(self->data, self->nbytes) < 0) {
+            LOGE("Failed to unmap file: %s", strerror(errno));
+            is_ok = 0;
+        }
+        self->data = 0;
+        self->nbytes = 0;
+    }
+    return is_ok;
+}
+
+uint8_t*
+file_map_at(struct file_map* self, uint64_t offset, size_t nbytes)
+{
+    if (!self->data || offset < self->offset ||
+        offset + nbytes > self->offset + self->nbytes) {
+        const uint64_t g = self->granularity;
+        const uint64_t beg = offset - offset % g;
+        uint64_t end = beg + self->window_bytes;
+        if (end < offset + nbytes)
+            end = g * ((offset + nbytes + g - 1) / g);
+        CHECK(file_map_unmap(self));
+        if (self->size < end) {
+            CHECK(file_truncate(self->file, end));
+            self->size = end;
+        }
+        void* data = mmap(0,
+                          end - beg,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          self->file->fid,
+                          (off_t)beg);
+        if (data == MAP_FAILED)
+            CHECK_POSIX(errno);
+        self->data = data;
+        self->offset = beg;
+        self->nbytes = end - beg;
+    }
+    return self->data + (offset - self->offset);
+Error:
+    return 0;
+}
+
+int
+file_map_flush(struct file_map* self)
+{
+    if (self->data && msync(self->data, self->nbytes, MS_ASYNC) < 0)
+        CHECK_POSIX(errno);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_map_destroy(struct file_map* self, uint64_t nbytes)
+{
+    int is_ok = file_map_unmap(self);
+    is_ok &= file_truncate(self->file, nbytes);
+    self->size = nbytes;
+    return is_ok;
+}
+
+/// Replaces the mapping with one of the first `nbytes` of the file.
+static int
+file_view_map(struct file_view* self, uint64_t nbytes)
+{
+    void* data = 0;
+    if (nbytes) {
+        data = mmap(0, (size_t)nbytes, PROT_READ, MAP_SHARED, self->fid, 0);
+        if (data == MAP_FAILED)
+            CHECK_POSIX(errno);
+    }
+    if (self->data && munmap((void*)self->data, (size_t)self->nbytes) < 0)
+        LOGE("Failed to unmap file: %s", strerror(errno));
+    self->data = data;
+    self->nbytes = nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_view_open(struct file_view* self,
+               const char* filename,
+               size_t bytesof_filename)
+{
+    *self = (struct file_view){ .fid = -1 };
+    // No lock is taken, so the file can be read while it's written.
+    if ((self->fid = open(filename, O_RDONLY)) < 0)
+        CHECK_POSIX(errno);
+    CHECK(file_view_update(self));
+    return 1;
+Error:
+    LOGE("Failed to open \"%s\" for reading", filename);
+    file_view_close(self);
+    return 0;
+}
+
+int
+file_view_update(struct file_view* self)
+{
+    struct stat st = { 0 };
+    if (fstat(self->fid, &st) < 0)
+        CHECK_POSIX(errno);
+    if ((uint64_t)st.st_size != self->nbytes)
+        CHECK(file_view_map(self, (uint64_t)st.st_size));
+    return 1;
+Error:
+    return 0;
+}
+
+void
+file_view_prefetch(const struct file_view* self,
+                   uint64_t offset,
+                   uint64_t nbytes)
+{
+    const long page = sysconf(_SC_PAGESIZE);
+    if (!self->data || page <= 0 || offset >= self->nbytes)
+        return;
+    if (nbytes > self->nbytes - offset)
+        nbytes = self->nbytes - offset;
+    // madvise() wants a page aligned address.
+    const uint64_t beg = offset - offset % (uint64_t)page;
+    madvise((void*)(self->data + beg), // NOLINT
+            (size_t)(offset + nbytes - beg),
+            MADV_WILLNEED);
+}
+
+void
+file_view_close(struct file_view* self)
+{
+    file_view_map(self, 0);
+    if (self->fid >= 0)
+        close(self->fid);
+    self->fid = -1;
+}
+
+/// Resolves `host` and `port`, and opens a socket on the first address that
+/// can be bound, when `is_passive`, or connected to otherwise.
+static int
+tcp_open(struct tcp_socket* self,
+         const char* host,
+         uint16_t port,
+         int is_passive)
+{
+    char service[8] = { 0 };
+    struct addrinfo hints = { 0 };
+    struct addrinfo *addrs = 0, *addr = 0;
+    self->fd = -1;
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = is_passive ? AI_PASSIVE : 0;
+    {
+        const int ecode = getaddrinfo(host, service, &hints, &addrs);
+        EXPECT(ecode == 0,
+               "Failed to resolve %s:%u: %s",
+               host,
+               (unsigned)port,
+               gai_strerror(ecode));
+    }
+    for (addr = addrs; addr; addr = addr->ai_next) {
+        const int one = 1;
+        self->fd = socket(addr->ai_family, addr->ai_socktype, 0);
+        if (self->fd < 0)
+            continue;
+        if (is_passive)
+            setsockopt(self->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        const int ret =
+          is_passive ? bind(self->fd, addr->ai_addr, addr->ai_addrlen)
+                     : connect(self->fd, addr->ai_addr, addr->ai_addrlen);
+        if (ret == 0)
+            break;
+        close(self->fd);
+        self->fd = -1;
+    }
+    EXPECT(self->fd >= 0,
+           "Failed to %s %s:%u: %s",
+           is_passive ? "listen on" : "connect to",
+           host,
+           (unsigned)port,
+           strerror(errno));
+    freeaddrinfo(addrs);
+    return 1;
+Error:
+    if (addrs)
+        freeaddrinfo(addrs);
+    return 0;
+}
+
+/// Sets the options every connection gets.
+static void
+tcp_configure(int fd)
+{
+    const int one = 1;
+    // Frames are sent in large pieces. Small ones, like the last few bytes
+    // of a stream, shouldn't wait for more to come.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // There's no MSG_NOSIGNAL here. A closed connection should fail the send
+    // rather than kill the process.
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+}
+
+int
+tcp_connect(struct tcp_socket* self, const char* host, uint16_t port)
+{
+    CHECK(self);
+    CHECK(host);
+    CHECK(tcp_open(self, host, port, 0));
+    tcp_configure(self->fd);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_listen(struct tcp_socket* self, const char* host, uint16_t* port)
+{
+    struct sockaddr_storage addr = { 0 };
+    socklen_t bytes_of_addr = sizeof(addr);
+    CHECK(self);
+    CHECK(port);
+    CHECK(tcp_open(self, host, *port, 1));
+    if (listen(self->fd, 8) < 0 ||
+        getsockname(self->fd, (struct sockaddr*)&addr, &bytes_of_addr) < 0) {
+        LOGE("Failed to listen on port %u: %s",
+             (unsigned)*port,
+             strerror(errno));
+        tcp_close(self);
+        goto Error;
+    }
+    *port = ntohs(addr.ss_family == AF_INET6
+                    ? ((struct sockaddr_in6*)&addr)->sin6_port
+                    : ((struct sockaddr_in*)&addr)->sin_port);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_accept(const struct tcp_socket* listener, struct tcp_socket* self)
+{
+    CHECK(listener);
+    CHECK(self);
+    do {
+        self->fd = accept(listener->fd, 0, 0);
+    } while (self->fd < 0 && errno == EINTR);
+    if (self->fd < 0)
+        CHECK_POSIX(errno);
+    tcp_configure(self->fd);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_sendv(const struct tcp_socket* self,
+          const struct file_iovec* iov,
+          size_t n,
+          size_t* nbytes)
+{
+    struct iovec batch[FILE_WRITEV_BATCH];
+    size_t i = 0;    // first piece not completely sent
+    size_t skip = 0; // bytes of that piece already sent
+    CHECK(self);
+    CHECK(nbytes);
+    *nbytes = 0;
+    for (;;) {
+        while (i < n && iov[i].beg + skip == iov[i].end) {
+            ++i;
+            skip = 0;
+        }
+        if (i == n)
+            return 1;
+
+        struct msghdr msg = { 0 };
+        int m = 0;
+        for (; m < FILE_WRITEV_BATCH && i + m < n; ++m) {
+            const uint8_t* beg = iov[i + m].beg + (m ? 0 : skip);
+            batch[m].iov_base = (void*)beg;
+            batch[m].iov_len = iov[i + m].end - beg;
+        }
+        msg.msg_iov = batch;
+        msg.msg_iovlen = m;
+        const ssize_t sent = sendmsg(self->fd, &msg, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            CHECK_POSIX(errno);
+        }
+        *nbytes += (size_t)sent;
+
+        // Move past what was sent.
+        size_t w = (size_t)sent;
+        while (w) {
+            const size_t left = (iov[i].end - iov[i].beg) - skip;
+            if (w < left) {
+                skip += w;
+                w = 0;
+            } else {
+                w -= left;
+                skip = 0;
+                ++i;
+            }
+        }
+    }
+Error:
+    return 0;
+}
+
+int
+tcp_wait_writable(const struct tcp_socket* self, float timeout_ms)
+{
+    struct pollfd p = { .fd = self->fd, .events = POLLOUT };
+    const int ms = timeout_ms > 0 ? (int)(timeout_ms + 0.999f) : 0;
+    int ret = 0;
+    do {
+        ret = poll(&p, 1, ms);
+    } while (ret < 0 && errno == EINTR);
+    // Errors and hang ups are left to the next send to report.
+    return ret != 0;
+}
+
+int
+tcp_recv(const struct tcp_socket* self, uint8_t* beg, uint8_t* end)
+{
+    while (beg < end) {
+        const ssize_t got = recv(self->fd, beg, end - beg, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        beg += got;
+    }
+    return 1;
+}
+
+void
+tcp_close(struct tcp_socket* self)
+{
+    if (self && self->fd >= 0)
+        close(self->fd);
+    if (self)
+        self->fd = -1;
+}
+
+/// Shared memory names are paths starting with a '/'. macOS takes at most 31
+/// characters.
+static int
+shared_memory_path(char* path, size_t bytes_of_path, const char* name)
+{
+    size_t n = 0;
+    for (; name && name[n]; ++n) {
+        const char c = name[n];
+        EXPECT(n < 30 && (isalnum((unsigned char)c) || c == '-' || c == '_'),
+               "Invalid name for shared memory: \"%s\"",
+               name);
+    }
+    EXPECT(n > 0, "Expected a name for shared memory.");
+    snprintf(path, bytes_of_path, "/%s", name);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+shared_memory_map(struct shared_memory* self, int fd, uint64_t nbytes)
+{
+    void* data =
+      mmap(0, (size_t)nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        CHECK_POSIX(errno);
+    self->data = data;
+    self->nbytes = nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+shared_memory_create(struct shared_memory* self,
+                     const char* name,
+                     uint64_t nbytes)
+{
+    int fd = -1;
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(self->path, sizeof(self->path), name));
+    shm_unlink(self->path);
+    if ((fd = shm_open(self->path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+        CHECK_POSIX(errno);
+    self->is_owner = 1;
+    if (ftruncate(fd, (off_t)nbytes) < 0)
+        CHECK_POSIX(errno);
+    CHECK(shared_memory_map(self, fd, nbytes));
+    close(fd);
+    return 1;
+Error:
+    LOGE("Failed to create %llu bytes of shared memory named \"%s\"",
+         (unsigned long long)nbytes,
+         name ? name : "(null)");
+    if (fd >= 0)
+        close(fd);
+    shared_memory_close(self);
+    return 0;
+}
+
+int
+shared_memory_open(struct shared_memory* self, const char* name)
+{
+    int fd = -1;
+    struct stat st = { 0 };
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(self->path, sizeof(self->path), name));
+    // Not logged, so callers can wait for the name to show up.
+    if ((fd = shm_open(self->path, O_RDWR, 0)) < 0)
+        goto Error;
+    if (fstat(fd, &st) < 0)
+        CHECK_POSIX(errno);
+    CHECK(shared_memory_map(self, fd, (uint64_t)st.st_size));
+    close(fd);
+    return 1;
+Error:
+    if (fd >= 0)
+        close(fd);
+    shared_memory_close(self);
+    return 0;
+}
+
+void
+shared_memory_close(struct shared_memory* self)
+{
+    if (self->data)
+        munmap(self->data, (size_t)self->nbytes);
+    if (self->is_owner)
+        shm_unlink(self->path);
+    *self = (struct shared_memory){ 0 };
+}
+
+uint64_t
+process_id()
+{
+    return (uint64_t)getpid();
+}
+
+int
+process_is_alive(uint64_t pid)
+{
+    // Signal 0 only checks that the process is there.
+    return pid && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
 void*
 memory_alloc(size_t capacity_bytes, enum AllocatorHint hint)
 {
-    return malloc(capacity_bytes);
+    const size_t bytes_of_header = (size_t)sysconf(_SC_PAGESIZE);
+    size_t nbytes = bytes_of_header + capacity_bytes;
+    uint8_t* base = 0;
+
+    if (hint == AllocatorHint_Default) {
+        EXPECT(base = map_anonymous(nbytes, 0, -1),
+               "Failed to map %llu bytes: %s",
+               (unsigned long long)nbytes,
+               strerror(errno));
+    } else {
+        nbytes = round_up(nbytes, BYTES_OF_LARGE_PAGE);
+        CHECK(base = map_large_pages(nbytes));
+        if (hint == AllocatorHint_LargePageLocked && mlock(base, nbytes)) {
+            LOG("Could not lock %llu bytes in memory (%s). "
+                "Check RLIMIT_MEMLOCK. Continuing with unlocked memory.",
+                (unsigned long long)nbytes,
+                strerror(errno));
+        }
+    }
+    *(size_t*)base = nbytes;
+    return base + bytes_of_header;
+Error:
+    return 0;
 }
 
 void
 memory_free(void* address)
 {
-    free(address);
+    if (!address)
+        return;
+    const size_t bytes_of_header = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t* base = (uint8_t*)address - bytes_of_header;
+    // Unmapping also unlocks.
+    if (munmap(base, *(size_t*)base)) {
+        LOGE("Failed to unmap memory at %p: %s", address, strerror(errno));
+    }
+}
+
+void*
+memory_alloc_on_node(size_t capacity_bytes,
+                     enum AllocatorHint hint,
+                     int32_t node)
+{
+    // macOS doesn't expose where memory is placed.
+    (void)node;
+    return memory_alloc(capacity_bytes, hint);
+}
+
+uint32_t
+numa_node_count(void)
+{
+    return 1;
+}
+
+uint64_t
+numa_node_affinity_mask(uint32_t node)
+{
+    // Thread affinity isn't supported on macOS.
+    (void)node;
+    return 0;
+}
+
+uint64_t
+memory_physical_bytes(void)
+{
+    uint64_t bytes = 0;
+    size_t size = sizeof(bytes);
+    return sysctlbyname("hw.memsize", &bytes, &size, 0, 0) == 0 ? bytes : 0;
+}
+
+static uint8_t*
+map_large_pages(size_t nbytes)
+{
+    uint8_t* base = 0;
+#ifdef VM_FLAGS_SUPERPAGE_SIZE_2MB
+    // Superpages are only supported on x86_64.
+    if ((base = map_anonymous(nbytes, 0, VM_FLAGS_SUPERPAGE_SIZE_2MB)))
+        return base;
+    LOG("No superpages available for %llu bytes (%s). "
+        "Using regular pages.",
+        (unsigned long long)nbytes,
+        strerror(errno));
+#endif
+    EXPECT(base = map_anonymous(nbytes, 0, -1),
+           "Failed to map %llu bytes: %s",
+           (unsigned long long)nbytes,
+           strerror(errno));
+    return base;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__memory_alloc_large_page_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    CHECK(p = memory_alloc(nbytes, AllocatorHint_LargePage));
+    CHECK(((uintptr_t)p & 4095) == 0);
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    memory_free(p);
+    memory_free(0);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
+}
+
+/// Memory placed on the first node is usable.
+int
+unit_test__memory_alloc_on_node_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    const uint32_t nodes = numa_node_count();
+    CHECK(nodes >= 1);
+    for (uint32_t i = 0; i < nodes; ++i)
+        LOG("NUMA node %u: CPUs %#llx",
+            i,
+            (unsigned long long)numa_node_affinity_mask(i));
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_LargePage, 0));
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    memory_free(p);
+    p = 0;
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_Default, -1));
+    memory_free(p);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
 }
+#endif
 
 void
 clock_init(struct clock* clock)
@@ -175,6 +1000,30 @@ clock_tic(struct clock* clock)
     return t;
 }
 
+uint64_t
+clock_tic_fast(void)
+{
+    return clock_tic(0);
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_tic_fast_follows_clock_tic()
+{
+    uint64_t last = clock_tic_fast();
+    struct clock clock;
+    clock_init(&clock);
+    while (clock_toc_ms(&clock) < 10.0) {
+        const uint64_t fast = clock_tic_fast();
+        CHECK(fast >= last);
+        last = fast;
+    }
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int64_t
 clock_toc(struct clock* clock)
 {
@@ -190,6 +1039,13 @@ clock_toc_ms(struct clock* clock)
     return (double)(clock_toc(clock) * 1e-6);
 }
 
+int64_t
+clock_tics_to_ns(int64_t tics)
+{
+    // clock tics are in ns
+    return tics;
+}
+
 int8_t
 clock_cmp(struct clock* clock, uint64_t timestamp)
 {
@@ -239,6 +1095,54 @@ unit_test__clock_sleep_ms_accepts_null()
 }
 #endif
 
+void
+clock_sleep_precise_ms(struct clock* clock, float delay_ms, float spin_ms)
+{
+    struct clock dummy;
+    if (!clock) {
+        clock_init(&dummy);
+        clock = &dummy;
+    }
+
+    // clock tics are in ns
+    const int64_t deadline = (int64_t)(1e6 * delay_ms);
+    const int64_t sleep_ns =
+      deadline - (int64_t)(1e6 * spin_ms) - clock_toc(clock);
+    if (sleep_ns > 0) {
+        // There's no absolute sleep here, but the spin covers for the
+        // difference.
+        const struct timespec t = { .tv_sec = (time_t)(sleep_ns / 1000000000),
+                                    .tv_nsec = (long)(sleep_ns % 1000000000) };
+        nanosleep(&t, 0);
+    }
+    while (clock_toc(clock) < deadline)
+        ;
+    clock_tic(clock);
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_sleep_precise_ms_meets_deadline()
+{
+    struct clock total, each;
+    clock_init(&total);
+    for (int i = 0; i < 100; ++i) {
+        clock_init(&each);
+        const uint64_t beg = clock_tic(&each);
+        clock_sleep_precise_ms(&each, 0.25f, CLOCK_SLEEP_SPIN_MS);
+        CHECK(clock_tics_to_ns((int64_t)(clock_tic(0) - beg)) >= 250000);
+    }
+    // Generous, so busy machines don't fail.
+    const double elapsed_ms = clock_toc_ms(&total);
+    EXPECT(elapsed_ms >= 25.0 && elapsed_ms < 250.0,
+           "Expected 100 sleeps of 0.25 ms to take 25 ms. Took %f ms.",
+           elapsed_ms);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 void
 lock_init(struct lock* self)
 {
@@ -279,6 +1183,24 @@ condition_variable_wait(struct condition_variable* restrict self,
 Error:;
 }
 
+int
+condition_variable_timed_wait(struct condition_variable* restrict self,
+                              struct lock* restrict lock,
+                              uint32_t timeout_ms)
+{
+    const struct timespec timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (long)(timeout_ms % 1000) * 1000000L,
+    };
+    const int ecode = pthread_cond_timedwait_relative_np(
+      &self->inner_, &lock->inner_, &timeout);
+    if (ecode == ETIMEDOUT)
+        return 0;
+    CHECK_POSIX(ecode);
+Error:
+    return 1;
+}
+
 void
 condition_variable_notify_all(struct condition_variable* self)
 {
@@ -350,6 +1272,129 @@ thread_join(struct thread* self)
 Error:;
 }
 
+int
+thread_set_current_attributes(const struct thread_attributes* attributes)
+{
+    int is_ok = 1;
+    if (attributes->name[0]) {
+        char name[16] = { 0 };
+        strncpy(name, attributes->name, sizeof(name) - 1); // NOLINT
+        if (pthread_setname_np(name)) {
+            LOG("Could not name thread \"%s\"", name);
+            is_ok = 0;
+        }
+    }
+    if (attributes->affinity_mask) {
+        // macOS only takes affinity hints that group threads together, not
+        // masks of CPUs.
+        LOG("Thread affinity is not supported on macOS. Ignoring mask %#llx.",
+            (unsigned long long)attributes->affinity_mask);
+        is_ok = 0;
+    }
+    switch (attributes->priority) {
+        case ThreadPriority_Default:
+            break;
+        case ThreadPriority_High: {
+            int ecode =
+              pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+            if (ecode) {
+                LOG("Could not raise thread priority: %s", strerror(ecode));
+                is_ok = 0;
+            }
+            break;
+        }
+        case ThreadPriority_Realtime: {
+            struct sched_param param = {
+                .sched_priority = sched_get_priority_max(SCHED_FIFO) / 2,
+            };
+            int ecode =
+              pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (ecode) {
+                LOG("Could not use realtime scheduling: %s", strerror(ecode));
+                is_ok = 0;
+            }
+            break;
+        }
+    }
+    return is_ok;
+}
+
+int
+thread_get_cpu_time_us(struct thread* self, uint64_t* us)
+{
+    if (!self->inner_)
+        return 0;
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    if (thread_info(pthread_mach_thread_np(self->inner_),
+                    THREAD_BASIC_INFO,
+                    (thread_info_t)&info,
+                    &count) != KERN_SUCCESS)
+        return 0;
+    *us = 1000000ULL * (uint64_t)(info.user_time.seconds +
+                                  info.system_time.seconds) +
+          (uint64_t)(info.user_time.microseconds +
+                     info.system_time.microseconds);
+    return 1;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__thread_set_current_attributes_names_the_thread()
+{
+    const struct thread_attributes attributes = {
+        .priority = ThreadPriority_Default,
+        .name = "acq-unit-test",
+    };
+    CHECK(thread_set_current_attributes(&attributes));
+    char name[16] = { 0 };
+    CHECK(pthread_getname_np(pthread_self(), name, sizeof(name)) == 0);
+    CHECK(strcmp(name, "acq-unit-test") == 0);
+    return 1;
+Error:
+    return 0;
+}
+
+struct atomics_test_counters
+{
+    uint32_t added;
+    size_t exchanged;
+};
+
+static void
+atomics_test_worker(struct atomics_test_counters* counters)
+{
+    for (int i = 0; i < 10000; ++i) {
+        fetch_add_relaxed(&counters->added, 1);
+        size_t expected = load_relaxed(&counters->exchanged);
+        while (!compare_exchange_acq_rel(
+          &counters->exchanged, &expected, expected + 1))
+            cpu_relax();
+    }
+}
+
+int
+unit_test__atomics_count_across_threads()
+{
+    struct atomics_test_counters counters = { 0 };
+    struct thread threads[4];
+    for (int i = 0; i < 4; ++i) {
+        thread_init(threads + i);
+        CHECK(thread_create(
+          threads + i, (void (*)(void*))atomics_test_worker, &counters));
+    }
+    for (int i = 0; i < 4; ++i)
+        thread_join(threads + i);
+    CHECK(load_acquire(&counters.added) == 40000);
+    CHECK(load_acquire(&counters.exchanged) == 40000);
+    CHECK(exchange_acq_rel(&counters.added, 0) == 40000);
+    CHECK(counters.added == 0);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int
 lib_open(struct lib* self, const char* absolute_path)
 {
@@ -392,6 +1437,12 @@ Error:
     return out;
 }
 
+void*
+lib_find(struct lib* self, const char* name)
+{
+    return self && self->inner && name ? dlsym(self->inner, name) : 0;
+}
+
 // Returns the absolute path to the module containing this function.
 // Return value must be freed by caller
 static char*
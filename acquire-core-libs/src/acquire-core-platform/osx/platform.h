@@ -40,12 +40,167 @@ extern "C"
     enum AllocatorHint
     {
         AllocatorHint_Default,
-        AllocatorHint_LargePage
+
+        /// Back the allocation with large pages when the system allows it,
+        /// otherwise fall back to regular pages.
+        AllocatorHint_LargePage,
+
+        /// Like `AllocatorHint_LargePage`, but also lock the pages in memory
+        /// so they can't be swapped out. This commits the whole allocation
+        /// up front.
+        AllocatorHint_LargePageLocked,
+    };
+
+    enum ThreadPriority
+    {
+        ThreadPriority_Default,
+
+        /// Favored over normal threads. May need elevated privileges.
+        ThreadPriority_High,
+
+        /// A realtime scheduling class. Needs elevated privileges on most
+        /// systems.
+        ThreadPriority_Realtime,
+    };
+
+    /// @brief How a thread should be scheduled.
+    /// @details Zeroed attributes leave everything at the system default.
+    struct thread_attributes
+    {
+        /// Bit `i` allows the thread to run on logical CPU `i`. 0 allows any
+        /// CPU.
+        uint64_t affinity_mask;
+        enum ThreadPriority priority;
+        /// Null terminated. Shown by debuggers and profilers. Names longer
+        /// than the system allows are truncated.
+        char name[16];
     };
 
     struct file
     {
         int fid;
+        /// See file_alignment_bytes().
+        uint32_t alignment_bytes;
+    };
+
+    /// One piece of a vectored write. See file_writev().
+    struct file_iovec
+    {
+        const uint8_t* beg;
+        const uint8_t* end;
+    };
+
+    /// Writes to a file that are in flight at once. See file_async_init().
+    /// Writes are synchronous on this platform.
+    struct file_async
+    {
+        const struct file* file;
+        uint32_t queue_depth;
+        /// Set when a write fails. Cleared by file_async_wait().
+        int has_failed;
+    };
+
+    /// A window into a file mapped into memory, for writing a file as it
+    /// grows. See file_map_init().
+    struct file_map
+    {
+        struct file* file;
+        /// Start of the mapped window, or 0 when nothing is mapped.
+        uint8_t* data;
+        /// Where the window starts in the file, and its size.
+        uint64_t offset;
+        size_t nbytes;
+        /// Smallest window file_map_at() maps.
+        size_t window_bytes;
+        /// Windows start at multiples of this.
+        size_t granularity;
+        /// Size the file has been grown to so the window fits.
+        uint64_t size;
+    };
+
+    /// A read only view of a whole file mapped into memory, for reading a
+    /// file that may still be growing. See file_view_open().
+    struct file_view
+    {
+        /// Start of the mapping, or 0 when nothing is mapped.
+        const uint8_t* data;
+        /// Size of the file when it was last mapped.
+        uint64_t nbytes;
+        int fid;
+    };
+
+    /// A TCP connection, or a socket listening for them. See tcp_connect().
+    struct tcp_socket
+    {
+        int fd;
+    };
+
+    /// Memory other processes can map by name. See shared_memory_create().
+    struct shared_memory
+    {
+        /// Start of the mapping, or 0 when nothing is mapped.
+        uint8_t* data;
+        uint64_t nbytes;
+        /// The name as the system knows it.
+        char path[32];
+        /// Set when this mapping created the name, so closing it removes it.
+        int is_owner;
+    };
+
+    /// Counts down from a number of tasks, waking the threads waiting for it
+    /// when it reaches 0. See latch_init().
+    struct latch
+    {
+        struct lock lock;
+        struct condition_variable notify_done;
+        size_t count;
+    };
+
+#define THREAD_POOL_MAX_THREADS (64)
+#define THREAD_POOL_QUEUE_CAPACITY (256)
+
+    struct thread_pool_task
+    {
+        void (*fn)(void* ctx);
+        void* ctx;
+        /// Counted down once `fn` returns. May be NULL.
+        struct latch* latch;
+    };
+
+    struct thread_pool;
+
+    struct thread_pool_worker
+    {
+        struct thread_pool* pool;
+        struct thread thread;
+        unsigned index;
+
+        /// Tasks queued on this worker, in `[head,tail)` modulo
+        /// THREAD_POOL_QUEUE_CAPACITY. The worker takes the newest. Other
+        /// threads steal the oldest.
+        struct lock lock;
+        struct thread_pool_task tasks[THREAD_POOL_QUEUE_CAPACITY];
+        size_t head, tail;
+    };
+
+    /// Threads that run tasks submitted from any thread. See
+    /// thread_pool_start().
+    struct thread_pool
+    {
+        struct thread_pool_worker* workers;
+        unsigned nworkers;
+
+        /// Applied by each worker when it starts, with its index appended to
+        /// the name.
+        struct thread_attributes attributes;
+
+        struct lock lock;
+        struct condition_variable notify_work;
+        /// Tasks submitted and not taken by a thread yet.
+        size_t queued;
+        /// Worker the next task is queued on.
+        unsigned next;
+        uint8_t is_stopping;
     };
 
     struct lib
@@ -90,15 +245,70 @@ extern "C"
     /// @see lib_open();
     void* lib_load(struct lib* self, const char* name);
 
+    /// @brief Like lib_load(), but for symbols the library may not have.
+    /// @return non-zero pointer to symbol if the library has it, otherwise 0,
+    /// without reporting an error.
+    void* lib_find(struct lib* self, const char* name);
+
     /// @brief Creates a new non-blocking file for writing.
     /// @return 1 on success, otherwise 0
     int file_create(struct file* file,
                     const char* filename,
                     size_t bytes_of_filename);
 
+    enum FileCreateFlags
+    {
+        /// Write around the operating system's file cache, so long streams
+        /// don't fill memory with cached pages. Writes must then be aligned:
+        /// see file_alignment_bytes(). Where the file system can't do this,
+        /// the file is created as usual.
+        FileCreate_Unbuffered = 1,
+    };
+
+    /// @brief Like file_create(), with any of `FileCreateFlags` in `flags`.
+    /// @return 1 on success, otherwise 0
+    int file_create_with_flags(struct file* file,
+                               const char* filename,
+                               size_t bytes_of_filename,
+                               uint32_t flags);
+
+    /// @returns What the offset, size and address of each write to `file`
+    /// must be a multiple of: 1 unless the file is unbuffered.
+    size_t file_alignment_bytes(const struct file* file);
+
+    /// @returns `nbytes` rounded up to a multiple of file_alignment_bytes().
+    uint64_t file_align_up(const struct file* file, uint64_t nbytes);
+
+    /// @brief Sets the size of `file` to `nbytes`, for example to drop the
+    /// padding after the last aligned write.
+    /// @return 1 on success, otherwise 0
+    int file_truncate(struct file* file, uint64_t nbytes);
+
+    /// @brief Asks the file system to reserve disk space for `nbytes` starting
+    /// at `offset`, without changing the size of `file`.
+    /// @details Writes into reserved space don't have to wait for the file
+    /// system to allocate it. Space reserved past the end of the file may be
+    /// kept until the file is truncated. On macOS, `nbytes` are reserved past
+    /// the space already allocated to the file, wherever `offset` is.
+    /// @return 1 if the space was reserved, otherwise 0, for example when the
+    /// file system doesn't support it. Writes work either way.
+    int file_preallocate(struct file* file, uint64_t offset, uint64_t nbytes);
+
+    /// @brief Waits until what's been written to `file`, and its size and
+    /// other metadata, is on the disk and would survive a power loss.
+    /// @return 1 on success, otherwise 0
+    int file_sync(const struct file* file);
+
+    /// @brief Like file_sync(), but skips metadata readers don't need to find
+    /// the data, like when the file was last changed, where the platform
+    /// allows it.
+    /// @return 1 on success, otherwise 0
+    int file_datasync(const struct file* file);
+
     void file_close(struct file* file);
 
     /// @brief Write the memory in `[beg,end)` to `file` starting at `offset`.
+    /// @details Several threads may write disjoint ranges of a file at once.
     /// @param file Writable file context
     /// @param offset byte offset from the beginning of the file
     /// @param beg Pointer to the first write
@@ -109,6 +319,16 @@ extern "C"
                    const uint8_t* beg,
                    const uint8_t* end);
 
+    /// @brief Writes the `n` pieces in `iov`, back to back, to `file`
+    /// starting at `offset`, with as few calls to the system as it allows.
+    /// @details Pieces may be empty. Several threads may write disjoint
+    /// ranges of a file at once.
+    /// @return 1 on success, otherwise 0
+    int file_writev(const struct file* file,
+                    uint64_t offset,
+                    const struct file_iovec* iov,
+                    size_t n);
+
     /// @param filename NULL-terminated path string
     /// @param nbytes length of the filename string in bytes
     /// @return 1 if the file exists, otherwise 0
@@ -119,10 +339,185 @@ extern "C"
     /// @return 1 if the file is writable, otherwise 0
     int file_is_writable(const char* filename, size_t nbytes);
 
+    /// @brief Prepares to keep up to `queue_depth` writes to `file` in flight
+    /// at once.
+    /// @details Writes are submitted with file_async_write() and finished with
+    /// file_async_wait(). Only one thread may use `self` at a time. `file`
+    /// must stay open until file_async_destroy().
+    /// @return 1 on success, otherwise 0
+    int file_async_init(struct file_async* self,
+                        const struct file* file,
+                        uint32_t queue_depth);
+
+    /// @brief Waits for the writes in flight and releases `self`.
+    void file_async_destroy(struct file_async* self);
+
+    /// @brief Submits a write of the memory in `[beg,end)` to `offset`.
+    /// @details The memory must not change until the write completes. Blocks
+    /// while `queue_depth` writes are in flight.
+    /// @return 1 if the write was submitted, otherwise 0
+    int file_async_write(struct file_async* self,
+                         uint64_t offset,
+                         const uint8_t* beg,
+                         const uint8_t* end);
+
+    /// @brief Reaps completed writes without blocking.
+    /// @return The number of writes still in flight.
+    uint32_t file_async_poll(struct file_async* self);
+
+    /// @brief Waits for every write in flight to complete.
+    /// @return 1 if every write submitted since the last wait succeeded,
+    /// otherwise 0
+    int file_async_wait(struct file_async* self);
+
+    /// @brief Prepares to write `file` through a window into it mapped into
+    /// memory.
+    /// @details Nothing is mapped until file_map_at(). Only one thread may use
+    /// `self` at a time. `file` must stay open until file_map_destroy().
+    /// @param[in] window_bytes Smallest window to map, rounded up to the
+    ///                         system's mapping granularity.
+    /// @return 1 on success, otherwise 0
+    int file_map_init(struct file_map* self,
+                      struct file* file,
+                      size_t window_bytes);
+
+    /// @brief Maps the `nbytes` of the file at `offset` into memory, growing
+    /// the file if it's smaller.
+    /// @details When the range is outside the current window, the window is
+    /// flushed with file_map_flush(), unmapped, and a new one mapped at
+    /// `offset`. Memory returned by earlier calls may be unmapped then.
+    /// @return Where to write the byte at `offset`, or 0 on failure.
+    uint8_t* file_map_at(struct file_map* self, uint64_t offset, size_t nbytes);
+
+    /// @brief Starts writing what changed in the window back to the file,
+    /// without waiting for it to finish.
+    /// @return 1 on success, otherwise 0
+    int file_map_flush(struct file_map* self);
+
+    /// @brief Flushes and unmaps the window, then sets the size of the file
+    /// to `nbytes` to cut off what the window grew it by.
+    /// @return 1 on success, otherwise 0
+    int file_map_destroy(struct file_map* self, uint64_t nbytes);
+
+    /// @brief Opens `filename` for reading, without keeping a writer out of
+    /// it, and maps all of it into memory.
+    /// @return 1 on success, otherwise 0
+    int file_view_open(struct file_view* self,
+                       const char* filename,
+                       size_t bytesof_filename);
+
+    /// @brief Maps the whole file again if its size has changed.
+    /// @details Memory from the mapping before may be unmapped then. Reading
+    /// past the end of a file that shrank after the last update faults.
+    /// @return 1 on success, otherwise 0
+    int file_view_update(struct file_view* self);
+
+    /// @brief Hints that the `nbytes` at `offset` will be read soon, so the
+    /// system can start reading them in.
+    void file_view_prefetch(const struct file_view* self,
+                            uint64_t offset,
+                            uint64_t nbytes);
+
+    /// @brief Unmaps the file and closes it.
+    void file_view_close(struct file_view* self);
+
+    /// @brief Connects to `port` on `host`, a name or a numeric address.
+    /// @details Sends on the connection don't wait. See tcp_sendv().
+    /// @return 1 on success, otherwise 0
+    int tcp_connect(struct tcp_socket* self, const char* host, uint16_t port);
+
+    /// @brief Listens for connections to `*port` on `host`.
+    /// @details When `*port` is 0 the system picks a free port, which is
+    /// written back to `*port`.
+    /// @return 1 on success, otherwise 0
+    int tcp_listen(struct tcp_socket* self, const char* host, uint16_t* port);
+
+    /// @brief Waits for a connection to `listener`, and opens `self` on it.
+    /// @details Receives on the connection wait for data. See tcp_recv().
+    /// @return 1 on success, otherwise 0
+    int tcp_accept(const struct tcp_socket* listener, struct tcp_socket* self);
+
+    /// @brief Sends as much of the `n` pieces in `iov`, back to back, as the
+    /// connection takes without waiting, with as few calls to the system as
+    /// it allows.
+    /// @param[out] nbytes The number of bytes sent. Less than all of them
+    ///                    when the connection's buffers filled up.
+    /// @return 1 on success, or 0 if the connection failed.
+    int tcp_sendv(const struct tcp_socket* self,
+                  const struct file_iovec* iov,
+                  size_t n,
+                  size_t* nbytes);
+
+    /// @brief Waits up to `timeout_ms` for room to send on the connection.
+    /// @return 1 when there's room, or when the connection failed so that the
+    /// next send reports it. 0 if the wait timed out.
+    int tcp_wait_writable(const struct tcp_socket* self, float timeout_ms);
+
+    /// @brief Receives exactly the bytes in `[beg,end)`.
+    /// @return 1 on success, or 0 if the connection closed or failed first.
+    int tcp_recv(const struct tcp_socket* self, uint8_t* beg, uint8_t* end);
+
+    /// @brief Closes the socket. What was sent is still delivered.
+    void tcp_close(struct tcp_socket* self);
+
+    /// @brief Creates `nbytes` of zeroed memory named `name`, that other
+    /// processes can map with shared_memory_open(), and maps it.
+    /// @details Names are up to 30 letters, digits, '-' and '_'. Memory left
+    /// under the same name by a process that didn't close it is replaced,
+    /// though processes that have it mapped keep it. On Windows the name
+    /// lasts until every process has closed it, and creating it again before
+    /// then fails.
+    /// @return 1 on success, otherwise 0
+    int shared_memory_create(struct shared_memory* self,
+                             const char* name,
+                             uint64_t nbytes);
+
+    /// @brief Maps all of the memory another process created as `name`, for
+    /// reading and writing.
+    /// @return 1 on success, otherwise 0. A name that isn't there isn't
+    /// logged as an error.
+    int shared_memory_open(struct shared_memory* self, const char* name);
+
+    /// @brief Unmaps the memory. Closing the mapping that created it removes
+    /// the name, so it can't be opened again.
+    void shared_memory_close(struct shared_memory* self);
+
+    /// @returns An id for the calling process, for process_is_alive().
+    uint64_t process_id();
+
+    /// @returns 1 while the process with id `pid` is running, otherwise 0.
+    int process_is_alive(uint64_t pid);
+
+    /// @brief Allocates `capacity_bytes` of page-aligned memory.
+    /// @details Falling back from large pages is not an error; the reason is
+    /// logged.
+    /// @returns The allocation, or 0 on failure. Release with memory_free().
     void* memory_alloc(size_t capacity_bytes, enum AllocatorHint hint);
 
     void memory_free(void* address);
 
+    /// @brief Like memory_alloc(), but places the pages on NUMA node `node`,
+    /// whichever thread touches them first.
+    /// @details A negative `node` is the same as memory_alloc(). When the
+    /// system can't place the pages, the reason is logged and they're placed
+    /// as memory_alloc() would.
+    /// @returns The allocation, or 0 on failure. Release with memory_free().
+    void* memory_alloc_on_node(size_t capacity_bytes,
+                               enum AllocatorHint hint,
+                               int32_t node);
+
+    /// @returns The number of NUMA nodes on the host: 1 when memory is
+    /// uniform, or when it's unknown.
+    uint32_t numa_node_count(void);
+
+    /// @returns Bit `i` set for each logical CPU `i` on NUMA node `node`, as
+    /// for `thread_attributes::affinity_mask`, or 0 when unknown. Only CPUs
+    /// below 64 are reported.
+    uint64_t numa_node_affinity_mask(uint32_t node);
+
+    /// @returns Bytes of physical memory on the host, or 0 if unknown.
+    uint64_t memory_physical_bytes(void);
+
     void clock_init(struct clock* clock);
 
     void clock_shift_ms(struct clock* clock, double ms);
@@ -131,6 +526,11 @@ extern "C"
     /// an arbitrary origin.
     uint64_t clock_tic(struct clock* clock);
 
+    /// @returns The same as clock_tic(0), for callers that read the clock
+    /// often, like once per frame. Reading the clock doesn't ask the kernel
+    /// on this platform, so this is clock_tic(0).
+    uint64_t clock_tic_fast(void);
+
     // FIXME: (nclack) Clock API: toc should reset, add clock_elapsed() for
     // reads.
 
@@ -140,6 +540,10 @@ extern "C"
     /// @returns the time in milliseconds relative to the origin.
     double clock_toc_ms(struct clock* clock);
 
+    /// @returns `tics`, for example a difference between two values returned
+    /// by clock_tic(), in nanoseconds.
+    int64_t clock_tics_to_ns(int64_t tics);
+
     /// @returns -1,0,or 1 when a new clock sample is prior, equal, or after the
     /// clock origin.
     int8_t clock_cmp_now(struct clock* clock);
@@ -155,6 +559,21 @@ extern "C"
     /// @param[in] delay_ms Time to sleep in milliseconds.
     void clock_sleep_ms(struct clock* clock, float delay_ms);
 
+    /// Time before a deadline clock_sleep_precise_ms() is usually told to spin
+    /// for: a little longer than this system oversleeps by.
+#define CLOCK_SLEEP_SPIN_MS (0.5f)
+
+    /// Like clock_sleep_ms(), but sleeps until `spin_ms` before the deadline
+    /// and then spins until it, so short and precise delays are honored.
+    /// Always resets the clock, even when the deadline has already passed.
+    ///
+    /// @param[in] clock May be null.
+    /// @param[in] delay_ms Time to sleep in milliseconds.
+    /// @param[in] spin_ms Time to spin for at the end, keeping a core busy.
+    void clock_sleep_precise_ms(struct clock* clock,
+                                float delay_ms,
+                                float spin_ms);
+
     void lock_init(struct lock* self);
 
     void lock_acquire(struct lock* self);
@@ -168,6 +587,15 @@ extern "C"
     void condition_variable_wait(struct condition_variable* __restrict self,
                                  struct lock* __restrict lock);
 
+    /// @brief Like condition_variable_wait() but gives up after `timeout_ms`.
+    /// @returns 0 if the wait timed out, otherwise 1. As with
+    /// condition_variable_wait(), callers should re-check their condition
+    /// after waking.
+    int condition_variable_timed_wait(
+      struct condition_variable* __restrict self,
+      struct lock* __restrict lock,
+      uint32_t timeout_ms);
+
     void condition_variable_notify_all(struct condition_variable* self);
 
     void event_init(struct event* self);
@@ -186,6 +614,105 @@ extern "C"
 
     void thread_join(struct thread* self);
 
+    /// @brief Applies `attributes` to the calling thread.
+    /// @details Whatever can't be applied, for example for lack of
+    /// privileges, is logged and skipped.
+    /// @returns 1 if every attribute was applied, otherwise 0.
+    int thread_set_current_attributes(
+      const struct thread_attributes* attributes);
+
+    /// @brief Reads how much CPU time `self` has used since it was created,
+    /// in microseconds.
+    /// @details Safe to call from any thread while `self` is running.
+    /// @returns 1 on success, or 0 if `self` isn't running or its CPU time
+    /// can't be read.
+    int thread_get_cpu_time_us(struct thread* self, uint64_t* us);
+
+    /// @brief Sets `self` to wait for `count` calls to latch_count_down().
+    void latch_init(struct latch* self, size_t count);
+
+    /// @brief Adds `count` to the number of calls to wait for.
+    void latch_add(struct latch* self, size_t count);
+
+    void latch_count_down(struct latch* self);
+
+    /// @returns 1 if the count reached 0, otherwise 0.
+    int latch_is_done(struct latch* self);
+
+    /// @brief Blocks until the count reaches 0.
+    /// @details From a task, use thread_pool_wait() instead, so the pool's
+    /// threads don't all end up waiting.
+    void latch_wait(struct latch* self);
+
+    /// @brief Starts `nthreads` workers, each with `attributes`.
+    /// @details `nthreads` is capped at THREAD_POOL_MAX_THREADS. A pool with
+    /// no workers runs each task on the thread submitting it. If a worker
+    /// can't be started, the pool makes do with the ones that did.
+    /// @param[in] attributes May be NULL. Sets the affinity, priority and
+    ///                       name of every worker.
+    /// @returns 1 on success, otherwise 0.
+    int thread_pool_start(struct thread_pool* self,
+                          unsigned nthreads,
+                          const struct thread_attributes* attributes);
+
+    /// @brief Runs the tasks still queued, then joins the workers.
+    void thread_pool_stop(struct thread_pool* self);
+
+    /// @brief Queues `fn(ctx)` to run on one of the pool's threads.
+    /// @details Safe to call from any thread, tasks included. Tasks are spread
+    /// across the workers, and idle workers steal from busy ones. When the
+    /// worker's queue is full the task runs on the calling thread instead.
+    /// @param[in] latch May be NULL. Counted down when the task finishes.
+    ///                  Add the task to it before submitting.
+    void thread_pool_submit(struct thread_pool* self,
+                            void (*fn)(void* ctx),
+                            void* ctx,
+                            struct latch* latch);
+
+    /// @brief Runs queued tasks on the calling thread until `latch` is done.
+    /// @details Waiting this way from a task can't deadlock the pool.
+    void thread_pool_wait(struct thread_pool* self, struct latch* latch);
+
+    //
+    // Atomics
+    //
+
+    // Loads, stores, read-modify-writes and fences for data shared between
+    // threads without a lock. They work on `uint32_t` and 64-bit `size_t`
+    // (or `uint64_t`) fields, which must be naturally aligned.
+    //
+    // - `load_relaxed()` and `store_relaxed()` suit counters with a single
+    //   writer that other threads sample.
+    // - `store_release()` publishes what the writer did before it, to a
+    //   thread that sees the value with `load_acquire()`. Stop flags want
+    //   this pair.
+    // - `fetch_add_*()` and `exchange_acq_rel()` return the previous value.
+    // - `compare_exchange_acq_rel(p, expected, desired)` stores `desired` if
+    //   `*p` equals `*expected` and returns 1. Otherwise it copies `*p` into
+    //   `*expected` and returns 0.
+    // - `cpu_relax()` goes in the body of spin loops.
+
+#define load_relaxed(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_relaxed(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define fetch_add_relaxed(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define fetch_add_acq_rel(p, v) __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define exchange_acq_rel(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define compare_exchange_acq_rel(p, expected, desired)                         \
+    __atomic_compare_exchange_n(                                               \
+      (p), (expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define fence_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define fence_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define fence_seq_cst() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cpu_relax()
+#endif
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
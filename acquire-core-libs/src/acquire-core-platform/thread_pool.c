@@ -0,0 +1,254 @@
+//! Latches and a work-stealing thread pool, built on the primitives each
+//! platform provides.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// How often a thread blocked in thread_pool_wait() looks for new tasks to
+/// help with.
+#define THREAD_POOL_WAIT_POLL_MS (1)
+
+void
+latch_init(struct latch* self, size_t count)
+{
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify_done);
+    self->count = count;
+}
+
+void
+latch_add(struct latch* self, size_t count)
+{
+    lock_acquire(&self->lock);
+    self->count += count;
+    lock_release(&self->lock);
+}
+
+void
+latch_count_down(struct latch* self)
+{
+    lock_acquire(&self->lock);
+    if (self->count && --self->count == 0)
+        condition_variable_notify_all(&self->notify_done);
+    lock_release(&self->lock);
+}
+
+int
+latch_is_done(struct latch* self)
+{
+    lock_acquire(&self->lock);
+    const int is_done = self->count == 0;
+    lock_release(&self->lock);
+    return is_done;
+}
+
+void
+latch_wait(struct latch* self)
+{
+    lock_acquire(&self->lock);
+    while (self->count)
+        condition_variable_wait(&self->notify_done, &self->lock);
+    lock_release(&self->lock);
+}
+
+static void
+run(const struct thread_pool_task* task)
+{
+    task->fn(task->ctx);
+    if (task->latch)
+        latch_count_down(task->latch);
+}
+
+/// Takes the newest task queued on `worker`, or the oldest if `is_stealing`.
+static int
+take(struct thread_pool_worker* worker,
+     int is_stealing,
+     struct thread_pool_task* task)
+{
+    int is_ok = 0;
+    lock_acquire(&worker->lock);
+    if (worker->head != worker->tail) {
+        if (is_stealing)
+            *task = worker->tasks[worker->head++ % THREAD_POOL_QUEUE_CAPACITY];
+        else
+            *task = worker->tasks[--worker->tail % THREAD_POOL_QUEUE_CAPACITY];
+        is_ok = 1;
+    }
+    lock_release(&worker->lock);
+    return is_ok;
+}
+
+/// Takes a task from worker `first`'s queue, or failing that steals one from
+/// the others.
+static int
+take_any(struct thread_pool* self,
+         unsigned first,
+         struct thread_pool_task* task)
+{
+    for (unsigned i = 0; i < self->nworkers; ++i) {
+        const unsigned w = (first + i) % self->nworkers;
+        if (take(self->workers + w, i > 0, task)) {
+            lock_acquire(&self->lock);
+            --self->queued;
+            lock_release(&self->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+worker_main(struct thread_pool_worker* self)
+{
+    struct thread_pool* const pool = self->pool;
+    struct thread_attributes attributes = pool->attributes;
+    if (attributes.name[0]) {
+        // "acq-pool" becomes "acq-pool.0" for the first worker.
+        char name[sizeof(attributes.name) + 8] = { 0 };
+        snprintf(
+          name, sizeof(name), "%s.%u", pool->attributes.name, self->index);
+        memcpy(attributes.name, name, sizeof(attributes.name) - 1);
+    }
+    thread_set_current_attributes(&attributes);
+
+    while (1) {
+        struct thread_pool_task task;
+        if (take_any(pool, self->index, &task)) {
+            run(&task);
+            continue;
+        }
+        lock_acquire(&pool->lock);
+        while (!pool->is_stopping && !pool->queued)
+            condition_variable_wait(&pool->notify_work, &pool->lock);
+        const int is_done = pool->is_stopping && !pool->queued;
+        lock_release(&pool->lock);
+        if (is_done)
+            break;
+    }
+}
+
+int
+thread_pool_start(struct thread_pool* self,
+                  unsigned nthreads,
+                  const struct thread_attributes* attributes)
+{
+    memset(self, 0, sizeof(*self));
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify_work);
+    if (attributes)
+        self->attributes = *attributes;
+    if (nthreads > THREAD_POOL_MAX_THREADS)
+        nthreads = THREAD_POOL_MAX_THREADS;
+    if (!nthreads)
+        return 1;
+
+    CHECK(self->workers = malloc(nthreads * sizeof(*self->workers)));
+    memset(self->workers, 0, nthreads * sizeof(*self->workers));
+    for (unsigned i = 0; i < nthreads; ++i) {
+        struct thread_pool_worker* w = self->workers + i;
+        *w = (struct thread_pool_worker){ .pool = self, .index = i };
+        lock_init(&w->lock);
+        thread_init(&w->thread);
+    }
+    // Workers look at each other's queues, so they're all set up before any
+    // of them starts. Tasks queued on a worker that didn't start are stolen
+    // by the others.
+    self->nworkers = nthreads;
+    for (unsigned i = 0; i < nthreads; ++i) {
+        struct thread_pool_worker* w = self->workers + i;
+        if (!thread_create(&w->thread, (void (*)(void*))worker_main, w)) {
+            LOGE("Started %u of %u thread pool workers.", i, nthreads);
+            if (i == 0)
+                self->nworkers = 0;
+            break;
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+void
+thread_pool_stop(struct thread_pool* self)
+{
+    lock_acquire(&self->lock);
+    self->is_stopping = 1;
+    condition_variable_notify_all(&self->notify_work);
+    lock_release(&self->lock);
+    for (unsigned i = 0; i < self->nworkers; ++i)
+        thread_join(&self->workers[i].thread);
+    free(self->workers);
+    self->workers = 0;
+    self->nworkers = 0;
+}
+
+void
+thread_pool_submit(struct thread_pool* self,
+                   void (*fn)(void* ctx),
+                   void* ctx,
+                   struct latch* latch)
+{
+    const struct thread_pool_task task = { .fn = fn,
+                                           .ctx = ctx,
+                                           .latch = latch };
+    if (!self->nworkers) {
+        run(&task);
+        return;
+    }
+
+    // Counted before it's queued, so a worker never takes a task that
+    // hasn't been counted yet.
+    lock_acquire(&self->lock);
+    struct thread_pool_worker* w = self->workers + self->next;
+    self->next = (self->next + 1) % self->nworkers;
+    ++self->queued;
+    lock_release(&self->lock);
+
+    lock_acquire(&w->lock);
+    const int is_full = w->tail - w->head == THREAD_POOL_QUEUE_CAPACITY;
+    if (!is_full)
+        w->tasks[w->tail++ % THREAD_POOL_QUEUE_CAPACITY] = task;
+    lock_release(&w->lock);
+
+    lock_acquire(&self->lock);
+    if (is_full)
+        --self->queued;
+    else
+        condition_variable_notify_all(&self->notify_work);
+    lock_release(&self->lock);
+
+    if (is_full)
+        run(&task);
+}
+
+void
+thread_pool_wait(struct thread_pool* self, struct latch* latch)
+{
+    while (!latch_is_done(latch)) {
+        struct thread_pool_task task;
+        if (take_any(self, 0, &task)) {
+            run(&task);
+            continue;
+        }
+        // Nothing to help with. The latch's tasks are running elsewhere, but
+        // they may queue more.
+        lock_acquire(&latch->lock);
+        if (latch->count)
+            condition_variable_timed_wait(
+              &latch->notify_done, &latch->lock, THREAD_POOL_WAIT_POLL_MS);
+        lock_release(&latch->lock);
+    }
+}
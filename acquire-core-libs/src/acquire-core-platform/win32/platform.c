@@ -3,12 +3,18 @@
 #include "platform.h"
 #include "logger.h"
 
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <ctype.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <math.h>
+#include <stdlib.h>
 
 #define L aq_logger
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Platform, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Platform, 1, __VA_ARGS__)
 
 // #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -64,21 +70,50 @@ errstr()
     return buf;
 }
 
+/// Used for unbuffered files when the volume can't say what alignment they
+/// need. Covers devices with 512 byte and 4 KiB sectors.
+#define BYTES_OF_UNBUFFERED_ALIGNMENT (4096)
+
 int
 file_create(struct file* file, const char* filename, size_t bytes_of_filename)
 {
+    return file_create_with_flags(file, filename, bytes_of_filename, 0);
+}
+
+int
+file_create_with_flags(struct file* file,
+                       const char* filename,
+                       size_t bytes_of_filename,
+                       uint32_t flags)
+{
+    const int is_unbuffered = (flags & FileCreate_Unbuffered) != 0;
     memset(file, 0, sizeof(*file));
+    file->alignment_bytes = 1;
 
     file->overlapped.hEvent = CreateEvent(0, TRUE, FALSE, 0);
     CHECK(file->overlapped.hEvent != INVALID_HANDLE_VALUE);
 
-    CHECK_HANDLE(file->hfile = CreateFileA(filename,
-                                           GENERIC_WRITE,
-                                           FILE_SHARE_READ,
-                                           0,
-                                           CREATE_ALWAYS,
-                                           FILE_FLAG_OVERLAPPED,
-                                           0));
+    CHECK_HANDLE(
+      file->hfile = CreateFileA(
+        filename,
+        GENERIC_WRITE,
+        FILE_SHARE_READ,
+        0,
+        CREATE_ALWAYS,
+        FILE_FLAG_OVERLAPPED | (is_unbuffered ? FILE_FLAG_NO_BUFFERING : 0),
+        0));
+    // Each file gets its own port, so file_async_wait() only sees its own
+    // completions. A handle can't leave a port, so it's made here once.
+    CHECK(file->hport = CreateIoCompletionPort(file->hfile, 0, 0, 1));
+    if (is_unbuffered) {
+        FILE_STORAGE_INFO info = { 0 };
+        file->alignment_bytes =
+          GetFileInformationByHandleEx(
+            file->hfile, FileStorageInfo, &info, sizeof(info)) &&
+              info.PhysicalBytesPerSectorForPerformance
+            ? info.PhysicalBytesPerSectorForPerformance
+            : BYTES_OF_UNBUFFERED_ALIGNMENT;
+    }
     return 1;
 Error:
     LOGE("Could not create \"%s\"", filename);
@@ -89,11 +124,83 @@ void
 file_close(struct file* file)
 {
     CHECK_WARN(CloseHandle(file->hfile));
+    if (file->hport)
+        CHECK_WARN(CloseHandle(file->hport));
     CHECK_WARN(CloseHandle(file->overlapped.hEvent));
     file->hfile = INVALID_HANDLE_VALUE;
+    file->hport = 0;
     file->overlapped.hEvent = INVALID_HANDLE_VALUE;
 }
 
+size_t
+file_alignment_bytes(const struct file* file)
+{
+    return file->alignment_bytes ? file->alignment_bytes : 1;
+}
+
+uint64_t
+file_align_up(const struct file* file, uint64_t nbytes)
+{
+    const uint64_t a = file_alignment_bytes(file);
+    return a * ((nbytes + a - 1) / a);
+}
+
+int
+file_truncate(struct file* file, uint64_t nbytes)
+{
+    FILE_END_OF_FILE_INFO info = { 0 };
+    info.EndOfFile.QuadPart = (LONGLONG)nbytes;
+    EXPECT(SetFileInformationByHandle(
+             file->hfile, FileEndOfFileInfo, &info, sizeof(info)),
+           "Failed to truncate file: %s",
+           errstr());
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_preallocate(struct file* file, uint64_t offset, uint64_t nbytes)
+{
+    // Growing the allocation size reserves clusters without moving the end
+    // of the file. SetFileValidData() would also skip zeroing them, but needs
+    // a privilege and exposes whatever the disk held before.
+    LARGE_INTEGER size = { 0 };
+    FILE_ALLOCATION_INFO info = { 0 };
+    EXPECT(GetFileSizeEx(file->hfile, &size),
+           "Failed to get file size: %s",
+           errstr());
+    info.AllocationSize.QuadPart = (LONGLONG)(offset + nbytes);
+    // An allocation size below the end of the file would truncate it.
+    if (info.AllocationSize.QuadPart <= size.QuadPart)
+        return 1;
+    EXPECT(SetFileInformationByHandle(
+             file->hfile, FileAllocationInfo, &info, sizeof(info)),
+           "Failed to reserve space for file: %s",
+           errstr());
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_sync(const struct file* file)
+{
+    EXPECT(FlushFileBuffers(file->hfile),
+           "Failed to flush file: %s",
+           errstr());
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_datasync(const struct file* file)
+{
+    // Windows has no way to leave out the metadata.
+    return file_sync(file);
+}
+
 int
 file_write(const struct file* file,
            uint64_t offset,
@@ -102,22 +209,49 @@ file_write(const struct file* file,
 {
     int retries = 0;
     HANDLE hfile = file->hfile;
-    OVERLAPPED ovl = file->overlapped;
+    // Each call waits on its own event, so concurrent writes don't see each
+    // other's completions. Setting the low bit of the event keeps the
+    // completion off the file's port, where file_async_wait() would find it.
+    HANDLE event = CreateEvent(0, TRUE, FALSE, 0);
+    CHECK(event);
+    OVERLAPPED ovl = { .hEvent = (HANDLE)((uintptr_t)event | 1) };
     while (cur < end && retries < 3) {
         DWORD written = 0;
         DWORD remaining = (DWORD)(end - cur); // may truncate
         ovl.Pointer = (void*)offset;
         WriteFile(hfile, cur, (DWORD)remaining, 0, &ovl);
-        CHECK(GetOverlappedResult(hfile, &ovl, &written, TRUE));
+        if (!GetOverlappedResult(hfile, &ovl, &written, TRUE)) {
+            LOGE("Failed to write to file: %s", errstr());
+            retries = 3;
+            break;
+        }
         retries += (written == 0);
         offset += written;
         cur += written;
     }
+    CloseHandle(event);
     return (retries < 3);
 Error:
     return 0;
 }
 
+/// WriteFileGather() only takes whole, page-aligned pages of files opened
+/// without buffering, so pieces are written one after the other.
+int
+file_writev(const struct file* file,
+            uint64_t offset,
+            const struct file_iovec* iov,
+            size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        CHECK(file_write(file, offset, iov[i].beg, iov[i].end));
+        offset += iov[i].end - iov[i].beg;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
 int
 file_exists(const char* filename, size_t _nbytes)
 {
@@ -165,12 +299,713 @@ file_is_writable(const char* filename, size_t nbytes)
     return 0;
 }
 
+/// Asynchronous writes are split into pieces no larger than this, since
+/// WriteFile() takes the size of a write in 32 bits.
+#define BYTES_OF_ASYNC_WRITE_MAX (1ULL << 30)
+
+/// Most completions collected by one call to GetQueuedCompletionStatusEx().
+#define FILE_ASYNC_REAP_BATCH (64)
+
+/// A write handed to WriteFile() and not reaped yet.
+struct overlapped_request
+{
+    OVERLAPPED overlapped;
+    uint64_t offset;
+    const uint8_t *beg, *end;
+    int is_busy;
+};
+
+int
+file_async_init(struct file_async* self,
+                const struct file* file,
+                uint32_t queue_depth)
+{
+    struct overlapped_request* requests = 0;
+    CHECK(queue_depth > 0);
+    CHECK(file->hport);
+    CHECK(requests = calloc(queue_depth, sizeof(*requests)));
+    *self = (struct file_async){
+        .file = file,
+        .queue_depth = queue_depth,
+        .requests_ = requests,
+    };
+    return 1;
+Error:
+    return 0;
+}
+
+/// Finishes `req`, whose completion was taken from the port.
+static void
+overlapped_finish(struct file_async* self, struct overlapped_request* req)
+{
+    DWORD written = 0;
+    // The write is done, so this doesn't wait. It turns the status into an
+    // error code.
+    if (!GetOverlappedResult(
+          self->file->hfile, &req->overlapped, &written, FALSE)) {
+        LOGE("Failed to write to file: %s", errstr());
+        self->has_failed = 1;
+    } else if (req->beg + written < req->end &&
+               !file_write(self->file,
+                           req->offset + written,
+                           req->beg + written,
+                           req->end)) {
+        self->has_failed = 1;
+    }
+    req->is_busy = 0;
+    --self->inflight;
+}
+
+/// Finishes the writes that have completed. When `is_blocking`, first waits
+/// for at least one of them.
+static void
+overlapped_reap(struct file_async* self, int is_blocking)
+{
+    OVERLAPPED_ENTRY entries[FILE_ASYNC_REAP_BATCH];
+    while (self->inflight) {
+        ULONG n = 0;
+        const ULONG capacity = self->inflight < FILE_ASYNC_REAP_BATCH
+                                 ? self->inflight
+                                 : FILE_ASYNC_REAP_BATCH;
+        if (!GetQueuedCompletionStatusEx(self->file->hport,
+                                         entries,
+                                         capacity,
+                                         &n,
+                                         is_blocking ? INFINITE : 0,
+                                         FALSE)) {
+            if (GetLastError() == WAIT_TIMEOUT)
+                return;
+            // Nothing more can be learned about the writes in flight.
+            LOGE("Failed to wait for writes: %s", errstr());
+            struct overlapped_request* requests = self->requests_;
+            for (uint32_t i = 0; i < self->queue_depth; ++i)
+                requests[i].is_busy = 0;
+            self->inflight = 0;
+            self->has_failed = 1;
+            return;
+        }
+        for (ULONG i = 0; i < n; ++i)
+            overlapped_finish(
+              self, (struct overlapped_request*)entries[i].lpOverlapped);
+        // Having waited once, take whatever else is ready without waiting.
+        if (n < capacity)
+            return;
+        is_blocking = 0;
+    }
+}
+
+void
+file_async_destroy(struct file_async* self)
+{
+    struct overlapped_request* requests = self->requests_;
+    file_async_wait(self);
+    free(requests);
+    self->requests_ = 0;
+}
+
+int
+file_async_write(struct file_async* self,
+                 uint64_t offset,
+                 const uint8_t* cur,
+                 const uint8_t* end)
+{
+    struct overlapped_request* requests = self->requests_;
+    while (cur < end) {
+        size_t nbytes = end - cur;
+        if (nbytes > BYTES_OF_ASYNC_WRITE_MAX)
+            nbytes = BYTES_OF_ASYNC_WRITE_MAX;
+        while (self->inflight == self->queue_depth)
+            overlapped_reap(self, 1);
+
+        uint32_t slot = 0;
+        while (requests[slot].is_busy)
+            ++slot;
+        struct overlapped_request* req = requests + slot;
+        req->offset = offset;
+        req->beg = cur;
+        req->end = cur + nbytes;
+        req->overlapped = (OVERLAPPED){ .Pointer = (void*)offset };
+        if (!WriteFile(
+              self->file->hfile, cur, (DWORD)nbytes, 0, &req->overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            LOGE("Failed to write to file: %s", errstr());
+            goto Error;
+        }
+        req->is_busy = 1;
+        ++self->inflight;
+
+        cur += nbytes;
+        offset += nbytes;
+    }
+    return 1;
+Error:
+    self->has_failed = 1;
+    return 0;
+}
+
+uint32_t
+file_async_poll(struct file_async* self)
+{
+    overlapped_reap(self, 0);
+    return self->inflight;
+}
+
+int
+file_async_wait(struct file_async* self)
+{
+    while (self->inflight)
+        overlapped_reap(self, 1);
+    const int is_ok = !self->has_failed;
+    self->has_failed = 0;
+    return is_ok;
+}
+
 void*
 mem_alloc_default(size_t capacity);
 
 void*
 mem_alloc_largepage(size_t capacity);
 
+int
+file_map_init(struct file_map* self, struct file* file, size_t window_bytes)
+{
+    SYSTEM_INFO info = { 0 };
+    LARGE_INTEGER size = { 0 };
+    GetSystemInfo(&info);
+    EXPECT(GetFileSizeEx(file->hfile, &size),
+           "Failed to get file size: %s",
+           errstr());
+    *self = (struct file_map){ .file = file,
+                               .granularity = info.dwAllocationGranularity,
+                               .size = (uint64_t)size.QuadPart };
+    self->window_bytes = self->granularity *
+                         (((window_bytes ? window_bytes : 1) +
+                           self->granularity - 1) /
+                          self->granularity);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+file_map_unmap(struct file_map* self)
+{
+    int is_ok = 1;
+    if (self->data) {
+        is_ok = file_map_flush(self);
+        if (!UnmapViewOfFile(self->data)) {
+            LOGE("Failed to unmap file: %s", errstr());
+            is_ok = 0;
+        }
+        self->data = 0;
+        self->nbytes = 0;
+    }
+    if (self->hmap) {
+        CloseHandle(self->hmap);
+        self->hmap = 0;
+    }
+    return is_ok;
+}
+
+uint8_t*
+file_map_at(struct file_map* self, uint64_t offset, size_t nbytes)
+{
+    if (!self->data || offset < self->offset ||
+        offset + nbytes > self->offset + self->nbytes) {
+        const uint64_t g = self->granularity;
+        const uint64_t beg = offset - offset % g;
+        uint64_t end = beg + self->window_bytes;
+        if (end < offset + nbytes)
+            end = g * ((offset + nbytes + g - 1) / g);
+        CHECK(file_map_unmap(self));
+        // A mapping object can't grow, so each window gets its own. Creating
+        // one larger than the file grows the file.
+        if (end > self->size)
+            self->size = end;
+        EXPECT(self->hmap = CreateFileMappingA(self->file->hfile,
+                                               0,
+                                               PAGE_READWRITE,
+                                               (DWORD)(self->size >> 32),
+                                               (DWORD)self->size,
+                                               0),
+               "Failed to map file: %s",
+               errstr());
+        EXPECT(self->data = MapViewOfFile(self->hmap,
+                                          FILE_MAP_WRITE,
+                                          (DWORD)(beg >> 32),
+                                          (DWORD)beg,
+                                          (SIZE_T)(end - beg)),
+               "Failed to map view of file: %s",
+               errstr());
+        self->offset = beg;
+        self->nbytes = end - beg;
+    }
+    return self->data + (offset - self->offset);
+Error:
+    file_map_unmap(self);
+    return 0;
+}
+
+int
+file_map_flush(struct file_map* self)
+{
+    // Starts writing dirty pages back without waiting for the disk.
+    EXPECT(!self->data || FlushViewOfFile(self->data, self->nbytes),
+           "Failed to flush mapped file: %s",
+           errstr());
+    return 1;
+Error:
+    return 0;
+}
+
+int
+file_map_destroy(struct file_map* self, uint64_t nbytes)
+{
+    // The file can't be truncated while a mapping of it is open.
+    int is_ok = file_map_unmap(self);
+    is_ok &= file_truncate(self->file, nbytes);
+    self->size = nbytes;
+    return is_ok;
+}
+
+static void
+file_view_unmap(struct file_view* self)
+{
+    if (self->data && !UnmapViewOfFile(self->data))
+        LOGE("Failed to unmap file: %s", errstr());
+    if (self->hmap)
+        CloseHandle(self->hmap);
+    self->data = 0;
+    self->hmap = 0;
+    self->nbytes = 0;
+}
+
+int
+file_view_open(struct file_view* self,
+               const char* filename,
+               size_t bytesof_filename)
+{
+    *self = (struct file_view){ .hfile = INVALID_HANDLE_VALUE };
+    // Writers open files for writing and share them for reading, so they
+    // have to be shared for writing here.
+    EXPECT(INVALID_HANDLE_VALUE !=
+             (self->hfile = CreateFileA(filename,
+                                        GENERIC_READ,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        0,
+                                        OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        0)),
+           "Failed to open \"%s\" for reading: %s",
+           filename,
+           errstr());
+    CHECK(file_view_update(self));
+    return 1;
+Error:
+    file_view_close(self);
+    return 0;
+}
+
+int
+file_view_update(struct file_view* self)
+{
+    LARGE_INTEGER size = { 0 };
+    EXPECT(GetFileSizeEx(self->hfile, &size),
+           "Failed to get file size: %s",
+           errstr());
+    if ((uint64_t)size.QuadPart == self->nbytes)
+        return 1;
+    // A mapping object can't grow, so each size gets its own. An empty file
+    // can't be mapped at all.
+    file_view_unmap(self);
+    if (size.QuadPart) {
+        EXPECT(self->hmap = CreateFileMappingA(
+                 self->hfile, 0, PAGE_READONLY, 0, 0, 0),
+               "Failed to map file: %s",
+               errstr());
+        EXPECT(self->data = MapViewOfFile(self->hmap, FILE_MAP_READ, 0, 0, 0),
+               "Failed to map view of file: %s",
+               errstr());
+        self->nbytes = (uint64_t)size.QuadPart;
+    }
+    return 1;
+Error:
+    file_view_unmap(self);
+    return 0;
+}
+
+void
+file_view_prefetch(const struct file_view* self,
+                   uint64_t offset,
+                   uint64_t nbytes)
+{
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+    if (!self->data || offset >= self->nbytes)
+        return;
+    if (nbytes > self->nbytes - offset)
+        nbytes = self->nbytes - offset;
+    WIN32_MEMORY_RANGE_ENTRY range = {
+        .VirtualAddress = (PVOID)(self->data + offset),
+        .NumberOfBytes = (SIZE_T)nbytes,
+    };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+void
+file_view_close(struct file_view* self)
+{
+    file_view_unmap(self);
+    if (self->hfile != INVALID_HANDLE_VALUE)
+        CloseHandle(self->hfile);
+    self->hfile = INVALID_HANDLE_VALUE;
+}
+
+/// tcp_sendv() hands the system at most this many pieces at a time.
+#define TCP_SENDV_BATCH (64)
+/// Winsock takes the size of each piece in 32 bits.
+#define TCP_MAX_PIECE_BYTES (1ULL << 30)
+
+/// Winsock is started for each socket that's opened and cleaned up when it's
+/// closed. It counts the starts, so it's only stopped after the last socket.
+static int
+tcp_startup()
+{
+    WSADATA data = { 0 };
+    const int ecode = WSAStartup(MAKEWORD(2, 2), &data);
+    EXPECT(ecode == 0, "Failed to start Winsock. Error %d", ecode);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Resolves `host` and `port`, and opens a socket on the first address that
+/// can be bound, when `is_passive`, or connected to otherwise.
+static int
+tcp_open(struct tcp_socket* self,
+         const char* host,
+         uint16_t port,
+         int is_passive)
+{
+    char service[8] = { 0 };
+    struct addrinfo hints = { 0 };
+    struct addrinfo *addrs = 0, *addr = 0;
+    SOCKET s = INVALID_SOCKET;
+    self->inner_ = (UINT_PTR)INVALID_SOCKET;
+    if (!tcp_startup())
+        return 0;
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = is_passive ? AI_PASSIVE : 0;
+    {
+        const int ecode = getaddrinfo(host, service, &hints, &addrs);
+        EXPECT(ecode == 0,
+               "Failed to resolve %s:%u. Error %d",
+               host,
+               (unsigned)port,
+               ecode);
+    }
+    for (addr = addrs; addr; addr = addr->ai_next) {
+        s = socket(addr->ai_family, addr->ai_socktype, 0);
+        if (s == INVALID_SOCKET)
+            continue;
+        const int ret =
+          is_passive ? bind(s, addr->ai_addr, (int)addr->ai_addrlen)
+                     : connect(s, addr->ai_addr, (int)addr->ai_addrlen);
+        if (ret == 0)
+            break;
+        closesocket(s);
+        s = INVALID_SOCKET;
+    }
+    EXPECT(s != INVALID_SOCKET,
+           "Failed to %s %s:%u. Error %d",
+           is_passive ? "listen on" : "connect to",
+           host,
+           (unsigned)port,
+           WSAGetLastError());
+    freeaddrinfo(addrs);
+    self->inner_ = (UINT_PTR)s;
+    return 1;
+Error:
+    if (addrs)
+        freeaddrinfo(addrs);
+    WSACleanup();
+    return 0;
+}
+
+int
+tcp_connect(struct tcp_socket* self, const char* host, uint16_t port)
+{
+    u_long is_nonblocking = 1;
+    const int one = 1;
+    CHECK(self);
+    CHECK(host);
+    CHECK(tcp_open(self, host, port, 0));
+    // Winsock has no per call flag for this, so the socket itself doesn't
+    // wait.
+    if (ioctlsocket((SOCKET)self->inner_, FIONBIO, &is_nonblocking) != 0) {
+        LOGE("Failed to configure socket. Error %d", WSAGetLastError());
+        tcp_close(self);
+        goto Error;
+    }
+    // Frames are sent in large pieces. Small ones, like the last few bytes
+    // of a stream, shouldn't wait for more to come.
+    setsockopt((SOCKET)self->inner_,
+               IPPROTO_TCP,
+               TCP_NODELAY,
+               (const char*)&one,
+               sizeof(one));
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_listen(struct tcp_socket* self, const char* host, uint16_t* port)
+{
+    struct sockaddr_storage addr = { 0 };
+    int bytes_of_addr = sizeof(addr);
+    CHECK(self);
+    CHECK(port);
+    CHECK(tcp_open(self, host, *port, 1));
+    if (listen((SOCKET)self->inner_, 8) != 0 ||
+        getsockname((SOCKET)self->inner_,
+                    (struct sockaddr*)&addr,
+                    &bytes_of_addr) != 0) {
+        LOGE("Failed to listen on port %u. Error %d",
+             (unsigned)*port,
+             WSAGetLastError());
+        tcp_close(self);
+        goto Error;
+    }
+    *port = ntohs(addr.ss_family == AF_INET6
+                    ? ((struct sockaddr_in6*)&addr)->sin6_port
+                    : ((struct sockaddr_in*)&addr)->sin_port);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_accept(const struct tcp_socket* listener, struct tcp_socket* self)
+{
+    SOCKET s = INVALID_SOCKET;
+    CHECK(listener);
+    CHECK(self);
+    CHECK(tcp_startup());
+    s = accept((SOCKET)listener->inner_, 0, 0);
+    if (s == INVALID_SOCKET) {
+        LOGE("Failed to accept a connection. Error %d", WSAGetLastError());
+        WSACleanup();
+        goto Error;
+    }
+    self->inner_ = (UINT_PTR)s;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+tcp_sendv(const struct tcp_socket* self,
+          const struct file_iovec* iov,
+          size_t n,
+          size_t* nbytes)
+{
+    WSABUF batch[TCP_SENDV_BATCH];
+    size_t i = 0;    // first piece not completely sent
+    size_t skip = 0; // bytes of that piece already sent
+    CHECK(self);
+    CHECK(nbytes);
+    *nbytes = 0;
+    for (;;) {
+        while (i < n && iov[i].beg + skip == iov[i].end) {
+            ++i;
+            skip = 0;
+        }
+        if (i == n)
+            return 1;
+
+        DWORD m = 0;
+        while (m < TCP_SENDV_BATCH && i + m < n) {
+            const uint8_t* beg = iov[i + m].beg + (m ? 0 : skip);
+            size_t len = iov[i + m].end - beg;
+            // A piece that's cut short ends the batch, so what's sent is
+            // always a prefix of the pieces.
+            const int is_cut = len > TCP_MAX_PIECE_BYTES;
+            if (is_cut)
+                len = TCP_MAX_PIECE_BYTES;
+            batch[m].buf = (CHAR*)beg;
+            batch[m].len = (ULONG)len;
+            ++m;
+            if (is_cut)
+                break;
+        }
+        DWORD sent = 0;
+        if (WSASend((SOCKET)self->inner_, batch, m, &sent, 0, 0, 0) != 0) {
+            const int ecode = WSAGetLastError();
+            if (ecode == WSAEWOULDBLOCK)
+                return 1;
+            EXPECT(ecode == WSAEINTR, "Failed to send. Error %d", ecode);
+            continue;
+        }
+        *nbytes += sent;
+
+        // Move past what was sent.
+        size_t w = sent;
+        while (w) {
+            const size_t left = (iov[i].end - iov[i].beg) - skip;
+            if (w < left) {
+                skip += w;
+                w = 0;
+            } else {
+                w -= left;
+                skip = 0;
+                ++i;
+            }
+        }
+    }
+Error:
+    return 0;
+}
+
+int
+tcp_wait_writable(const struct tcp_socket* self, float timeout_ms)
+{
+    WSAPOLLFD p = { .fd = (SOCKET)self->inner_, .events = POLLWRNORM };
+    const int ms = timeout_ms > 0 ? (int)(timeout_ms + 0.999f) : 0;
+    // Errors and hang ups are left to the next send to report.
+    return WSAPoll(&p, 1, ms) != 0;
+}
+
+int
+tcp_recv(const struct tcp_socket* self, uint8_t* beg, uint8_t* end)
+{
+    while (beg < end) {
+        const size_t left = end - beg;
+        const int got = recv((SOCKET)self->inner_,
+                             (char*)beg,
+                             (int)(left < TCP_MAX_PIECE_BYTES
+                                     ? left
+                                     : TCP_MAX_PIECE_BYTES),
+                             0);
+        if (got <= 0)
+            return 0;
+        beg += got;
+    }
+    return 1;
+}
+
+void
+tcp_close(struct tcp_socket* self)
+{
+    if (self && self->inner_ != (UINT_PTR)INVALID_SOCKET) {
+        closesocket((SOCKET)self->inner_);
+        WSACleanup();
+    }
+    if (self)
+        self->inner_ = (UINT_PTR)INVALID_SOCKET;
+}
+
+/// Names are kept local to the session.
+static int
+shared_memory_path(char* path, size_t bytes_of_path, const char* name)
+{
+    size_t n = 0;
+    for (; name && name[n]; ++n) {
+        const char c = name[n];
+        EXPECT(n < 30 && (isalnum((unsigned char)c) || c == '-' || c == '_'),
+               "Invalid name for shared memory: \"%s\"",
+               name);
+    }
+    EXPECT(n > 0, "Expected a name for shared memory.");
+    snprintf(path, bytes_of_path, "Local\\%s", name);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+shared_memory_create(struct shared_memory* self,
+                     const char* name,
+                     uint64_t nbytes)
+{
+    char path[40] = { 0 };
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(path, sizeof(path), name));
+    EXPECT(self->hmap = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                           0,
+                                           PAGE_READWRITE,
+                                           (DWORD)(nbytes >> 32),
+                                           (DWORD)nbytes,
+                                           path),
+           "Failed to create shared memory named \"%s\": %s",
+           name,
+           errstr());
+    EXPECT(GetLastError() != ERROR_ALREADY_EXISTS,
+           "Shared memory named \"%s\" is still open in another process.",
+           name);
+    EXPECT(self->data =
+             MapViewOfFile(self->hmap, FILE_MAP_ALL_ACCESS, 0, 0, nbytes),
+           "Failed to map shared memory named \"%s\": %s",
+           name,
+           errstr());
+    self->nbytes = nbytes;
+    return 1;
+Error:
+    shared_memory_close(self);
+    return 0;
+}
+
+int
+shared_memory_open(struct shared_memory* self, const char* name)
+{
+    char path[40] = { 0 };
+    MEMORY_BASIC_INFORMATION info = { 0 };
+    *self = (struct shared_memory){ 0 };
+    CHECK(shared_memory_path(path, sizeof(path), name));
+    // Not logged, so callers can wait for the name to show up.
+    if (!(self->hmap = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path)))
+        goto Error;
+    EXPECT(self->data = MapViewOfFile(self->hmap, FILE_MAP_ALL_ACCESS, 0, 0, 0),
+           "Failed to map shared memory named \"%s\": %s",
+           name,
+           errstr());
+    CHECK(VirtualQuery(self->data, &info, sizeof(info)));
+    self->nbytes = info.RegionSize;
+    return 1;
+Error:
+    shared_memory_close(self);
+    return 0;
+}
+
+void
+shared_memory_close(struct shared_memory* self)
+{
+    if (self->data)
+        UnmapViewOfFile(self->data);
+    if (self->hmap)
+        CloseHandle(self->hmap);
+    *self = (struct shared_memory){ 0 };
+}
+
+uint64_t
+process_id()
+{
+    return GetCurrentProcessId();
+}
+
+int
+process_is_alive(uint64_t pid)
+{
+    HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!h)
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    const int is_alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+    CloseHandle(h);
+    return is_alive;
+}
+
 void*
 memory_alloc(size_t capacity, enum AllocatorHint hint)
 {
@@ -178,16 +1013,18 @@ memory_alloc(size_t capacity, enum AllocatorHint hint)
         case AllocatorHint_Default:
             return mem_alloc_default(capacity);
         case AllocatorHint_LargePage:
+        case AllocatorHint_LargePageLocked: // large pages are never paged out
             return mem_alloc_largepage(capacity);
         default:
             return 0;
     }
 }
 
-void*
-mem_alloc_largepage(size_t capacity_)
+/// Enables the privilege large pages need, when the process may have it.
+/// @returns Whether it's enabled.
+static int
+enable_large_pages(void)
 {
-
     if (!globals.is_large_page_support_enabled_) {
         // Access control: Enable Large Page (2MB) Support
         LUID luid = { 0 };
@@ -204,9 +1041,14 @@ mem_alloc_largepage(size_t capacity_)
           (ERROR_SUCCESS ==
            AdjustTokenPrivileges(token, FALSE, &tp, sizeof(tp), NULL, NULL));
     }
+    return globals.is_large_page_support_enabled_;
+}
 
+void*
+mem_alloc_largepage(size_t capacity_)
+{
     void* buf = 0;
-    if (globals.is_large_page_support_enabled_) {
+    if (enable_large_pages()) {
         const size_t capacity = (capacity_ < GetLargePageMinimum())
                                   ? GetLargePageMinimum()
                                   : capacity_;
@@ -232,9 +1074,117 @@ mem_alloc_default(size_t capacity)
 void
 memory_free(void* address)
 {
-    VirtualFree(address, 0, MEM_RELEASE);
+    if (address)
+        VirtualFree(address, 0, MEM_RELEASE);
+}
+
+uint64_t
+memory_physical_bytes(void)
+{
+    MEMORYSTATUSEX status = { .dwLength = sizeof(status) };
+    return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+}
+
+void*
+memory_alloc_on_node(size_t capacity, enum AllocatorHint hint, int32_t node)
+{
+    if (node < 0)
+        return memory_alloc(capacity, hint);
+    void* buf = 0;
+    if (hint != AllocatorHint_Default && enable_large_pages()) {
+        const size_t n = (capacity < GetLargePageMinimum())
+                           ? GetLargePageMinimum()
+                           : capacity;
+        buf = VirtualAllocExNuma(GetCurrentProcess(),
+                                 NULL,
+                                 n,
+                                 MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                 PAGE_READWRITE,
+                                 (DWORD)node);
+    }
+    if (!buf)
+        buf = VirtualAllocExNuma(GetCurrentProcess(),
+                                 NULL,
+                                 capacity,
+                                 MEM_RESERVE | MEM_COMMIT,
+                                 PAGE_READWRITE,
+                                 (DWORD)node);
+    if (!buf) {
+        LOG("Failed to place %llu bytes on NUMA node %d: %s. Continuing with "
+            "the default placement.",
+            (unsigned long long)capacity,
+            (int)node,
+            errstr());
+        buf = memory_alloc(capacity, hint);
+    }
+    return buf;
+}
+
+uint32_t
+numa_node_count(void)
+{
+    ULONG highest = 0;
+    return GetNumaHighestNodeNumber(&highest) ? (uint32_t)highest + 1 : 1;
+}
+
+uint64_t
+numa_node_affinity_mask(uint32_t node)
+{
+    // Only CPUs in the first processor group fit in an affinity mask.
+    GROUP_AFFINITY affinity = { 0 };
+    if (node > 0xffff ||
+        !GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) ||
+        affinity.Group != 0)
+        return 0;
+    return (uint64_t)affinity.Mask;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__memory_alloc_large_page_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    CHECK(p = memory_alloc(nbytes, AllocatorHint_LargePage));
+    CHECK(((uintptr_t)p & 4095) == 0);
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    memory_free(p);
+    memory_free(0);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
 }
 
+/// Memory placed on the first node is usable.
+int
+unit_test__memory_alloc_on_node_is_usable()
+{
+    const size_t nbytes = (3ULL << 20) + 7;
+    uint8_t* p = 0;
+    const uint32_t nodes = numa_node_count();
+    CHECK(nodes >= 1);
+    for (uint32_t i = 0; i < nodes; ++i)
+        LOG("NUMA node %u: CPUs %#llx",
+            i,
+            (unsigned long long)numa_node_affinity_mask(i));
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_LargePage, 0));
+    p[0] = 1;
+    p[nbytes - 1] = 2;
+    CHECK(p[0] == 1 && p[nbytes - 1] == 2);
+    memory_free(p);
+    p = 0;
+    CHECK(p = memory_alloc_on_node(nbytes, AllocatorHint_Default, -1));
+    memory_free(p);
+    return 1;
+Error:
+    memory_free(p);
+    return 0;
+}
+#endif
+
 void
 clock_init(struct clock* clock)
 {
@@ -305,6 +1255,30 @@ clock_tic(struct clock* clock)
     return pt->QuadPart;
 }
 
+uint64_t
+clock_tic_fast(void)
+{
+    return clock_tic(0);
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_tic_fast_follows_clock_tic()
+{
+    uint64_t last = clock_tic_fast();
+    struct clock clock;
+    clock_init(&clock);
+    while (clock_toc_ms(&clock) < 10.0) {
+        const uint64_t fast = clock_tic_fast();
+        CHECK(fast >= last);
+        last = fast;
+    }
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int64_t
 clock_toc(struct clock* clock)
 {
@@ -316,8 +1290,18 @@ clock_toc(struct clock* clock)
 double
 clock_toc_ms(struct clock* clock)
 {
-    int64_t ms = clock_toc(clock) * 1000 / clock->ticks_per_second.QuadPart;
-    return (double)ms;
+    return 1e3 * (double)clock_toc(clock) /
+           (double)clock->ticks_per_second.QuadPart;
+}
+
+int64_t
+clock_tics_to_ns(int64_t tics)
+{
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    // Split to avoid overflowing for long intervals.
+    return (tics / f.QuadPart) * 1000000000LL +
+           (tics % f.QuadPart) * 1000000000LL / f.QuadPart;
 }
 
 void
@@ -347,6 +1331,67 @@ unit_test__clock_sleep_ms_accepts_null()
 }
 #endif
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION (0x00000002)
+#endif
+
+void
+clock_sleep_precise_ms(struct clock* clock, float delay_ms, float spin_ms)
+{
+    struct clock dummy;
+    if (!clock) {
+        clock_init(&dummy);
+        clock = &dummy;
+    }
+
+    const int64_t deadline =
+      (int64_t)(1e-3 * delay_ms * (double)clock->ticks_per_second.QuadPart);
+    const double sleep_ms = delay_ms - spin_ms - clock_toc_ms(clock);
+    if (sleep_ms > 0) {
+        // High resolution timers wake up within about half a millisecond,
+        // where Sleep() is bound to the system timer's period. They need
+        // Windows 10 1803.
+        HANDLE timer = CreateWaitableTimerExW(
+          0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!timer)
+            timer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
+        // Negative due times are relative, in units of 100 ns.
+        LARGE_INTEGER due = { .QuadPart = -(LONGLONG)(1e4 * sleep_ms) };
+        if (timer && SetWaitableTimer(timer, &due, 0, 0, 0, FALSE))
+            WaitForSingleObject(timer, INFINITE);
+        else
+            Sleep((DWORD)sleep_ms);
+        if (timer)
+            CloseHandle(timer);
+    }
+    while (clock_toc(clock) < deadline)
+        YieldProcessor();
+    clock_tic(clock);
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__clock_sleep_precise_ms_meets_deadline()
+{
+    struct clock total, each;
+    clock_init(&total);
+    for (int i = 0; i < 100; ++i) {
+        clock_init(&each);
+        const uint64_t beg = clock_tic(&each);
+        clock_sleep_precise_ms(&each, 0.25f, CLOCK_SLEEP_SPIN_MS);
+        CHECK(clock_tics_to_ns((int64_t)(clock_tic(0) - beg)) >= 250000);
+    }
+    // Generous, so busy machines don't fail.
+    const double elapsed_ms = clock_toc_ms(&total);
+    EXPECT(elapsed_ms >= 25.0 && elapsed_ms < 250.0,
+           "Expected 100 sleeps of 0.25 ms to take 25 ms. Took %f ms.",
+           elapsed_ms);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 void
 lock_init(struct lock* self)
 {
@@ -390,6 +1435,18 @@ condition_variable_wait(struct condition_variable* restrict self,
     SleepConditionVariableSRW(&self->inner_, &lock->inner_, INFINITE, 0);
 }
 
+int
+condition_variable_timed_wait(struct condition_variable* restrict self,
+                              struct lock* restrict lock,
+                              uint32_t timeout_ms)
+{
+    if (!SleepConditionVariableSRW(
+          &self->inner_, &lock->inner_, timeout_ms, 0)) {
+        return GetLastError() != ERROR_TIMEOUT;
+    }
+    return 1;
+}
+
 void
 event_init(struct event* self)
 {
@@ -444,6 +1501,125 @@ thread_join(struct thread* self)
     }
 }
 
+int
+thread_set_current_attributes(const struct thread_attributes* attributes)
+{
+    int is_ok = 1;
+    HANDLE self = GetCurrentThread();
+    if (attributes->name[0]) {
+        // SetThreadDescription() is only available since Windows 10 1607.
+        typedef HRESULT(WINAPI * set_description_t)(HANDLE, PCWSTR);
+        set_description_t set_description = (set_description_t)GetProcAddress(
+          GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription");
+        const int max_chars = (int)sizeof(attributes->name) - 1;
+        wchar_t name[sizeof(attributes->name)] = { 0 };
+        MultiByteToWideChar(CP_UTF8,
+                            0,
+                            attributes->name,
+                            (int)strnlen(attributes->name, max_chars),
+                            name,
+                            max_chars);
+        if (!set_description || FAILED(set_description(self, name))) {
+            LOG("Could not name thread \"%s\"", attributes->name);
+            is_ok = 0;
+        }
+    }
+    if (attributes->affinity_mask &&
+        !SetThreadAffinityMask(self, (DWORD_PTR)attributes->affinity_mask)) {
+        LOG("Could not set thread affinity to %#llx: %s",
+            (unsigned long long)attributes->affinity_mask,
+            errstr());
+        is_ok = 0;
+    }
+    int priority = THREAD_PRIORITY_NORMAL;
+    switch (attributes->priority) {
+        case ThreadPriority_Default:
+            break;
+        case ThreadPriority_High:
+            priority = THREAD_PRIORITY_HIGHEST;
+            break;
+        case ThreadPriority_Realtime:
+            priority = THREAD_PRIORITY_TIME_CRITICAL;
+            break;
+    }
+    if (priority != THREAD_PRIORITY_NORMAL &&
+        !SetThreadPriority(self, priority)) {
+        LOG("Could not raise thread priority: %s", errstr());
+        is_ok = 0;
+    }
+    return is_ok;
+}
+
+int
+thread_get_cpu_time_us(struct thread* self, uint64_t* us)
+{
+    FILETIME created, exited, kernel, user;
+    if (self->inner_ == INVALID_HANDLE_VALUE ||
+        !GetThreadTimes(self->inner_, &created, &exited, &kernel, &user))
+        return 0;
+    // FILETIMEs are in 100 ns units.
+    const uint64_t k =
+      ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    const uint64_t u =
+      ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    *us = (k + u) / 10;
+    return 1;
+}
+
+#ifndef NO_UNIT_TESTS
+int
+unit_test__thread_set_current_attributes_names_the_thread()
+{
+    const struct thread_attributes attributes = {
+        .priority = ThreadPriority_Default,
+        .name = "acq-unit-test",
+    };
+    CHECK(thread_set_current_attributes(&attributes));
+    return 1;
+Error:
+    return 0;
+}
+
+struct atomics_test_counters
+{
+    uint32_t added;
+    size_t exchanged;
+};
+
+static void
+atomics_test_worker(struct atomics_test_counters* counters)
+{
+    for (int i = 0; i < 10000; ++i) {
+        fetch_add_relaxed(&counters->added, 1);
+        size_t expected = load_relaxed(&counters->exchanged);
+        while (!compare_exchange_acq_rel(
+          &counters->exchanged, &expected, expected + 1))
+            cpu_relax();
+    }
+}
+
+int
+unit_test__atomics_count_across_threads()
+{
+    struct atomics_test_counters counters = { 0 };
+    struct thread threads[4];
+    for (int i = 0; i < 4; ++i) {
+        thread_init(threads + i);
+        CHECK(thread_create(
+          threads + i, (void (*)(void*))atomics_test_worker, &counters));
+    }
+    for (int i = 0; i < 4; ++i)
+        thread_join(threads + i);
+    CHECK(load_acquire(&counters.added) == 40000);
+    CHECK(load_acquire(&counters.exchanged) == 40000);
+    CHECK(exchange_acq_rel(&counters.added, 0) == 40000);
+    CHECK(counters.added == 0);
+    return 1;
+Error:
+    return 0;
+}
+#endif
+
 int
 lib_open(struct lib* self, const char* absolute_path)
 {
@@ -487,6 +1663,12 @@ Error:
     return out;
 }
 
+void*
+lib_find(struct lib* self, const char* name)
+{
+    return self && self->inner && name ? GetProcAddress(self->inner, name) : 0;
+}
+
 // `strings` must be NULL-terminated.
 // Caller must free the returned string.
 static char*
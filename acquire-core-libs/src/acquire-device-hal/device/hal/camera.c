@@ -2,12 +2,14 @@
 #include "camera.h"
 #include "logger.h"
 #include "driver.h"
+#include "loader.h"
+#include "platform.h"
 
 #define countof(e) (sizeof(e) / sizeof(*(e)))
 #define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -65,6 +67,15 @@ camera_close(struct Camera* self)
 Error:;
 }
 
+/// Whether the camera's driver was built with the members version 1 of the
+/// kit appended to `struct Camera`. When it wasn't, they hold whatever the
+/// driver keeps after its `struct Camera`, so they must not be touched.
+static int
+has_kit_v1(const struct Camera* self)
+{
+    return driver_kit_version(self->device.driver) >= 1;
+}
+
 static uint8_t
 max_u8(uint8_t a, uint8_t b)
 {
@@ -82,7 +93,11 @@ camera_set(struct Camera* self, struct CameraProperties* settings)
     CHECK(self);
     CHECK(settings);
     settings->binning = max_u8(1, settings->binning);
-    switch (ecode = self->set(self, settings)) {
+    ecode = self->set(self, settings);
+    // 0 is left to cameras that can't tell when their shape changes.
+    if (has_kit_v1(self) && !++self->shape_generation)
+        ++self->shape_generation;
+    switch (ecode) {
         case Device_Ok:
             if (self->state != DeviceState_Running)
                 self->state = DeviceState_Armed;
@@ -202,6 +217,154 @@ Error:
     return Device_Err;
 }
 
+/// Waits for a ready frame by polling cameras without a `get_frame_timeout`.
+/// Cameras that can't say whether a frame is ready are waited on.
+static enum DeviceStatusCode
+get_frame_polling(struct Camera* self,
+                  void* im,
+                  size_t* nbytes,
+                  struct ImageInfo* info,
+                  uint32_t timeout_ms)
+{
+    if (has_kit_v1(self) && self->get_ready_frame_count) {
+        struct clock clock;
+        clock_init(&clock);
+        uint32_t nready = 0;
+        for (;;) {
+            enum DeviceStatusCode ecode =
+              self->get_ready_frame_count(self, &nready);
+            if (ecode != Device_Ok)
+                return ecode;
+            if (nready)
+                break;
+            if (clock_toc_ms(&clock) >= timeout_ms) {
+                *nbytes = 0;
+                return Device_Ok;
+            }
+            clock_sleep_ms(0, 2.0f);
+        }
+    }
+    return self->get_frame(self, im, nbytes, info);
+}
+
+enum DeviceStatusCode
+camera_get_frame_timeout(struct Camera* self,
+                         void* im,
+                         size_t* nbytes,
+                         struct ImageInfo* info,
+                         uint32_t timeout_ms)
+{
+    CHECK(self);
+    CHECK(nbytes);
+    CHECK(self->state == DeviceState_Running);
+    enum DeviceStatusCode ecode =
+      has_kit_v1(self) && self->get_frame_timeout
+        ? self->get_frame_timeout(self, im, nbytes, info, timeout_ms)
+        : get_frame_polling(self, im, nbytes, info, timeout_ms);
+    if (ecode != Device_Ok) {
+        camera_stop(self);
+        self->state = DeviceState_AwaitingConfiguration;
+    }
+    return ecode;
+Error:
+    return Device_Err;
+}
+
+/// Gets frames one at a time for cameras without a `get_frames`.
+static enum DeviceStatusCode
+get_frames_one_at_a_time(struct Camera* self,
+                         uint8_t* im,
+                         size_t stride,
+                         size_t bytes_of_frame,
+                         uint32_t* count,
+                         struct ImageInfo* info)
+{
+    enum DeviceStatusCode ecode = Device_Ok;
+    uint32_t n = 0;
+    uint32_t nready = 1; // The first frame is waited for.
+    const int is_v1 = has_kit_v1(self);
+    while (n < *count && nready) {
+        uint8_t* const frame = im + n * stride;
+        size_t nbytes = bytes_of_frame;
+        if (is_v1 && self->lend_buffer &&
+            (ecode = self->lend_buffer(self, frame, nbytes)) != Device_Ok)
+            break;
+        if ((ecode = self->get_frame(self, frame, &nbytes, info + n)) !=
+              Device_Ok ||
+            !nbytes)
+            break;
+        ++n;
+        if (--nready == 0 && is_v1 && self->get_ready_frame_count &&
+            (ecode = self->get_ready_frame_count(self, &nready)) != Device_Ok)
+            break;
+    }
+    *count = n;
+    return ecode;
+}
+
+enum DeviceStatusCode
+camera_get_frames(struct Camera* self,
+                  void* im,
+                  size_t stride,
+                  size_t bytes_of_frame,
+                  uint32_t* count,
+                  struct ImageInfo* info)
+{
+    CHECK(self);
+    CHECK(im);
+    CHECK(count);
+    CHECK(info);
+    CHECK(self->state == DeviceState_Running);
+    enum DeviceStatusCode ecode =
+      has_kit_v1(self) && self->get_frames
+        ? self->get_frames(self, im, stride, bytes_of_frame, count, info)
+        : get_frames_one_at_a_time(
+            self, im, stride, bytes_of_frame, count, info);
+    if (ecode != Device_Ok) {
+        camera_stop(self);
+        self->state = DeviceState_AwaitingConfiguration;
+    }
+    return ecode;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+camera_get_ready_frame_count(const struct Camera* self, uint32_t* count)
+{
+    CHECK(self);
+    CHECK(count);
+    *count = 0;
+    if (self->state == DeviceState_Running && has_kit_v1(self) &&
+        self->get_ready_frame_count)
+        return self->get_ready_frame_count(self, count);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+camera_lend_buffer(struct Camera* self, void* im, size_t nbytes)
+{
+    CHECK(self);
+    CHECK(im);
+    if (self->state == DeviceState_Running && has_kit_v1(self) &&
+        self->lend_buffer)
+        return self->lend_buffer(self, im, nbytes);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+uint32_t
+camera_get_shape_generation(const struct Camera* self)
+{
+    CHECK(self);
+    return has_kit_v1(self) ? self->shape_generation : 0;
+Error:
+    return 0;
+}
+
 enum DeviceState
 camera_get_state(const struct Camera* const camera)
 {
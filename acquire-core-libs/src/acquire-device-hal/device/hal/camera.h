@@ -37,6 +37,51 @@ extern "C"
                                            size_t* nbytes,
                                            struct ImageInfo* info);
 
+    /// @brief Like camera_get_frame(), but waits at most `timeout_ms` for a
+    /// frame.
+    /// @details `*nbytes` is set to 0 when no frame came in time. Cameras
+    /// without a `get_frame_timeout` of their own are polled for ready frames
+    /// every couple of milliseconds when they can report them, and are
+    /// otherwise waited on without a timeout.
+    enum DeviceStatusCode camera_get_frame_timeout(struct Camera* camera,
+                                                   void* im,
+                                                   size_t* nbytes,
+                                                   struct ImageInfo* info,
+                                                   uint32_t timeout_ms);
+
+    /// @brief Gets up to `*count` frames, `stride` bytes apart in `im`, with
+    /// room for `bytes_of_frame` bytes each.
+    /// @details Waits for the first frame, like camera_get_frame(), and then
+    /// only takes frames that are ready. Cameras without a `get_frames` of
+    /// their own are asked for one frame at a time, each lent its slot, for
+    /// as long as they report frames ready. On return `*count` holds the
+    /// number of frames written, each described by its element of `info`.
+    enum DeviceStatusCode camera_get_frames(struct Camera* camera,
+                                            void* im,
+                                            size_t stride,
+                                            size_t bytes_of_frame,
+                                            uint32_t* count,
+                                            struct ImageInfo* info);
+
+    /// @brief Number of frames camera_get_frame() can return without waiting.
+    /// @details `*count` is 0 when the camera doesn't report it.
+    enum DeviceStatusCode camera_get_ready_frame_count(
+      const struct Camera* camera,
+      uint32_t* count);
+
+    /// @brief Lends `im` to the camera for the next frame.
+    /// @details Pass the same buffer to the next camera_get_frame(). Does
+    /// nothing for cameras that don't capture in place.
+    enum DeviceStatusCode camera_lend_buffer(struct Camera* camera,
+                                             void* im,
+                                             size_t nbytes);
+
+    /// @brief Changes whenever the camera's image shape may have changed.
+    /// @details 0 when the camera can't tell, as for drivers built before
+    /// version 1 of the kit, so the shape has to be queried every time.
+    /// @see camera_get_image_shape()
+    uint32_t camera_get_shape_generation(const struct Camera* camera);
+
     enum DeviceState camera_get_state(const struct Camera* camera);
 
 #ifdef __cplusplus
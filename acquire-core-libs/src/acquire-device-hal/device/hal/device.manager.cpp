@@ -1,8 +1,13 @@
 #include "device.manager.h"
 #include "loader.h"
 #include "logger.h"
+#include "platform.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 #include <cstring>
@@ -12,8 +17,8 @@
 // static driver initializers
 //
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -33,12 +38,55 @@
 
 namespace {
 
+/// Drivers to load, in the order their devices are listed. A driver's index
+/// here is its `driver_id`.
+const char* const driver_names[] = {
+    "acquire-driver-common",    "acquire-driver-hdcam",
+    "acquire-driver-zarr",      "acquire-driver-egrabber",
+    "acquire-driver-spinnaker", "acquire-driver-pvcam",
+};
+constexpr size_t driver_count = sizeof(driver_names) / sizeof(*driver_names);
+
 enum class State
 {
     Initialized,
     Shutdown
 };
 
+struct DeviceEnumerationResult
+{
+    enum DeviceStatusCode status_;
+    struct DeviceIdentifier identifier_;
+
+    DeviceEnumerationResult(enum DeviceStatusCode status,
+                            const struct DeviceIdentifier& identifier);
+};
+
+DeviceEnumerationResult::DeviceEnumerationResult(
+  DeviceStatusCode status,
+  const DeviceIdentifier& identifier)
+  : status_(status)
+  , identifier_(identifier)
+{
+}
+
+/// Devices found through each driver, kept for every device manager in the
+/// process, so those after the first needn't load a driver to list its
+/// devices. Drivers that failed to load are kept with no devices.
+struct EnumerationCache
+{
+    std::mutex lock;
+    bool is_valid[driver_count] = {};
+    std::vector<DeviceEnumerationResult> devices[driver_count];
+};
+
+EnumerationCache&
+enumeration_cache()
+{
+    static EnumerationCache cache;
+    return cache;
+}
+
 class DeviceManagerV0
 {
   public:
@@ -53,11 +101,13 @@ class DeviceManagerV0
 
     void operator=(DeviceManagerV0 const&) = delete;
 
-    size_t count() const noexcept;
-    const DeviceIdentifier* get(size_t index);
-    const DeviceIdentifier* select(DeviceKind kind,
-                                   const std::string& name) const;
+    size_t count();
+    DeviceIdentifier get(size_t index);
+    bool select(DeviceKind kind,
+                const std::string& name,
+                DeviceIdentifier* out);
     Driver* get_driver(const struct DeviceIdentifier*);
+    void refresh();
 
   private:
     void init(void (*reporter)(int is_error,
@@ -67,35 +117,39 @@ class DeviceManagerV0
                                const char* msg));
     void shutdown();
     void guard_state();
-
-    struct DeviceEnumerationResult
-    {
-        enum DeviceStatusCode status_;
-        struct DeviceIdentifier identifier_;
-
-        DeviceEnumerationResult(enum DeviceStatusCode status,
-                                const struct DeviceIdentifier& identifier);
-    };
-
+    bool load(size_t first, size_t last);
+    void enumerate(size_t driver_id,
+                   std::vector<DeviceEnumerationResult>* found);
+    const DeviceIdentifier* find(DeviceKind kind,
+                                 const std::string& name) const;
+
+    // Guards everything below, since drivers may be loaded on first use.
+    std::mutex lock_;
+    void (*reporter_)(int is_error,
+                      const char* file,
+                      int line,
+                      const char* function,
+                      const char* msg);
     std::vector<DeviceEnumerationResult> identifiers_;
+    // Indexed by driver_id. Null for drivers that failed to load or haven't
+    // been loaded yet. Drivers whose devices were listed from the cache are
+    // loaded when first asked for.
     std::vector<Driver*> drivers_;
+    // Indexed by driver_id. Set once loading the driver has been tried.
+    std::vector<uint8_t> tried_;
+    // The devices of drivers up to this one have been listed.
+    size_t nloaded_;
     State state_;
 };
 
-DeviceManagerV0::DeviceEnumerationResult::DeviceEnumerationResult(
-  DeviceStatusCode status,
-  const DeviceIdentifier& identifier)
-  : status_(status)
-  , identifier_(identifier)
-{
-}
-
 DeviceManagerV0::DeviceManagerV0(void (*reporter)(int is_error,
                                                   const char* file,
                                                   int line,
                                                   const char* function,
                                                   const char* msg))
-  : state_(State::Shutdown)
+  : reporter_(nullptr)
+  , nloaded_(0)
+  , state_(State::Shutdown)
 {
     init(reporter);
     CHECK(state_ == State::Initialized);
@@ -115,43 +169,135 @@ DeviceManagerV0::init(void (*reporter)(int is_error,
                                        const char* function,
                                        const char* msg))
 {
-    drivers_.push_back(driver_load("acquire-driver-common", reporter));
-    drivers_.push_back(driver_load("acquire-driver-hdcam", reporter));
-    drivers_.push_back(driver_load("acquire-driver-zarr", reporter));
-    drivers_.push_back(driver_load("acquire-driver-egrabber", reporter));
-    drivers_.push_back(driver_load("acquire-driver-spinnaker", reporter));
-    drivers_.push_back(driver_load("acquire-driver-pvcam", reporter));
-
-    // enumerate devices
-    const DeviceIdentifier dflt{ 0, 0, DeviceKind_Unknown, "" };
+    std::scoped_lock lock(lock_);
+    reporter_ = reporter;
+    identifiers_.clear();
+    drivers_.assign(driver_count, nullptr);
+    tried_.assign(driver_count, 0);
+    nloaded_ = 0;
+
+    // Lazily, only the simulated devices are loaded up front.
+    const char* lazy = getenv(DEVICE_MANAGER_LAZY_ENV);
+    load(0, (lazy && *lazy && strcmp(lazy, "0")) ? 1 : driver_count);
+    state_ = State::Initialized;
+}
 
-    uint8_t driver_id = 0;
-    for (const auto driver : drivers_) {
-        if (driver) {
-            uint32_t n = driver->device_count(driver);
-            for (uint32_t i = 0; i < n; ++i) {
-                auto& ident = identifiers_.emplace_back(Device_Err, dflt);
-                CHECK_NOTHROW(Device_Ok == (ident.status_ = driver->describe(
-                                              driver, &ident.identifier_, i)));
-                // It's important to populate the driver_id after invoking
-                // driver->describe().
-                ident.identifier_.driver_id = driver_id;
+/// Lists the devices of drivers `first` up to `last`, from the cache where it
+/// has them and otherwise by loading and enumerating the drivers at the same
+/// time, so slow vendor SDKs don't hold each other up. Devices are listed in
+/// driver order regardless. Expects `lock_` to be held.
+/// @returns true if any driver's devices were listed.
+bool
+DeviceManagerV0::load(size_t first, size_t last)
+{
+    first = std::max(first, nloaded_);
+    if (first >= last)
+        return false;
+
+    struct clock clock;
+    clock_init(&clock);
+    auto& cache = enumeration_cache();
+    std::vector<std::vector<DeviceEnumerationResult>> found(last - first);
+    std::vector<uint8_t> is_cached(last - first, 0);
+    int ncached = 0;
+    {
+        std::scoped_lock cache_lock(cache.lock);
+        for (size_t id = first; id < last; ++id) {
+            if ((is_cached[id - first] = cache.is_valid[id])) {
+                found[id - first] = cache.devices[id];
+                ++ncached;
             }
         }
-        ++driver_id;
     }
-    state_ = State::Initialized;
+
+    std::vector<std::thread> threads;
+    for (size_t id = first; id < last; ++id) {
+        if (!is_cached[id - first])
+            threads.emplace_back([this, id, &found, first]() {
+                enumerate(id, &found[id - first]);
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    {
+        std::scoped_lock cache_lock(cache.lock);
+        for (size_t id = first; id < last; ++id) {
+            if (!is_cached[id - first]) {
+                cache.devices[id] = found[id - first];
+                cache.is_valid[id] = true;
+            }
+        }
+    }
+    for (const auto& idents : found)
+        identifiers_.insert(identifiers_.end(), idents.begin(), idents.end());
+    nloaded_ = last;
+    LOG("Enumerated drivers %d-%d in %f ms, %d from the cache",
+        (int)first,
+        (int)last - 1,
+        clock_toc_ms(&clock),
+        ncached);
+    return true;
+}
+
+/// Loads driver `driver_id`, unless it already is, and appends its devices
+/// to `found`. Called for different drivers at the same time.
+void
+DeviceManagerV0::enumerate(size_t driver_id,
+                           std::vector<DeviceEnumerationResult>* found)
+{
+    if (!drivers_[driver_id]) {
+        drivers_[driver_id] = driver_load(driver_names[driver_id], reporter_);
+        tried_[driver_id] = 1;
+    }
+    Driver* driver = drivers_[driver_id];
+    if (!driver)
+        return;
+    const DeviceIdentifier dflt{ 0, 0, DeviceKind_Unknown, "" };
+    uint32_t n = driver->device_count(driver);
+    for (uint32_t i = 0; i < n; ++i) {
+        auto& ident = found->emplace_back(Device_Err, dflt);
+        CHECK_NOTHROW(Device_Ok == (ident.status_ = driver->describe(
+                                      driver, &ident.identifier_, i)));
+        // It's important to populate the driver_id after invoking
+        // driver->describe().
+        ident.identifier_.driver_id = (uint8_t)driver_id;
+    }
+}
+
+/// Forgets what's in the cache and lists this manager's devices again
+/// through their drivers, loading any that haven't been.
+void
+DeviceManagerV0::refresh()
+{
+    guard_state();
+    std::scoped_lock lock(lock_);
+    {
+        auto& cache = enumeration_cache();
+        std::scoped_lock cache_lock(cache.lock);
+        for (auto& is_valid : cache.is_valid)
+            is_valid = false;
+    }
+    const size_t n = nloaded_;
+    identifiers_.clear();
+    nloaded_ = 0;
+    load(0, n);
 }
 
 void
 DeviceManagerV0::shutdown()
 {
+    std::scoped_lock lock(lock_);
     if (state_ != State::Shutdown) {
         for (auto driver : drivers_) {
             if (driver) {
                 CHECK_NOTHROW(Device_Ok == driver->shutdown(driver));
             }
         }
+        drivers_.clear();
+        tried_.clear();
+        identifiers_.clear();
+        nloaded_ = 0;
         state_ = State::Shutdown;
     }
 }
@@ -166,18 +312,22 @@ DeviceManagerV0::guard_state()
 }
 
 size_t
-DeviceManagerV0::count() const noexcept
+DeviceManagerV0::count()
 {
+    std::scoped_lock lock(lock_);
+    load(0, driver_count);
     return identifiers_.size();
 }
 
-const struct DeviceIdentifier*
+struct DeviceIdentifier
 DeviceManagerV0::get(size_t index)
 {
     guard_state();
+    std::scoped_lock lock(lock_);
+    load(0, driver_count);
     const auto& ident_result = identifiers_.at(index);
     if (ident_result.status_ == Device_Ok) {
-        return &ident_result.identifier_;
+        return ident_result.identifier_;
     } else {
         char ident_str[80] = { 0 };
         char msg[256] = { 0 };
@@ -195,11 +345,35 @@ Driver*
 DeviceManagerV0::get_driver(const struct DeviceIdentifier* identifier)
 {
     CHECK(identifier);
-    return drivers_.at(identifier->driver_id);
+    std::scoped_lock lock(lock_);
+    const size_t id = identifier->driver_id;
+    // Devices listed from the cache are found before their driver is loaded.
+    if (!drivers_.at(id) && !tried_[id]) {
+        drivers_[id] = driver_load(driver_names[id], reporter_);
+        tried_[id] = 1;
+    }
+    return drivers_[id];
+}
+
+/// Copies the first device of `kind` whose name matches `name` into `out`.
+/// Identifiers are copied under the lock since a refresh moves them.
+bool
+DeviceManagerV0::select(DeviceKind kind,
+                        const std::string& name,
+                        DeviceIdentifier* out)
+{
+    std::scoped_lock lock(lock_);
+    const DeviceIdentifier* found = find(kind, name);
+    // Drivers whose devices haven't been listed yet might have it.
+    if (!found && load(0, driver_count))
+        found = find(kind, name);
+    if (found)
+        *out = *found;
+    return found;
 }
 
 const struct DeviceIdentifier*
-DeviceManagerV0::select(DeviceKind kind, const std::string& name) const
+DeviceManagerV0::find(DeviceKind kind, const std::string& name) const
 {
     std::regex re(name.c_str(),
                   std::regex_constants::icase | std::regex_constants::optimize);
@@ -298,7 +472,25 @@ device_manager_get(struct DeviceIdentifier* out,
         EXPECT(self_, "Expected non-NULL pointer for `self`");
         EXPECT(self_->impl, "Expected non-NULL pointer for `self->impl`");
         auto self = (DeviceManagerV0*)self_->impl;
-        memcpy(out, self->get(index), sizeof(*out));
+        *out = self->get(index);
+        return Device_Ok;
+    } catch (std::exception& e) {
+        LOGE(e.what());
+        return Device_Err;
+    } catch (...) {
+        LOGE("Unhandled exception");
+        return Device_Err;
+    }
+}
+
+extern "C" enum DeviceStatusCode
+device_manager_refresh(const struct DeviceManager* self_)
+{
+    try {
+        EXPECT(self_, "Expected non-NULL pointer for `self`");
+        EXPECT(self_->impl, "Expected non-NULL pointer for `self->impl`");
+        auto* self = (DeviceManagerV0*)self_->impl;
+        self->refresh();
         return Device_Ok;
     } catch (std::exception& e) {
         LOGE(e.what());
@@ -356,9 +548,7 @@ device_manager_select_inner_(const struct DeviceManager* self_,
             }
         }
 
-        const auto result = self->select(kind, name);
-        if (result) {
-            memcpy(out, result, sizeof(*out));
+        if (self->select(kind, name, out)) {
             return Device_Ok;
         } else {
             LOGE("Device not found: %s %s",
@@ -8,6 +8,12 @@ extern "C"
 {
 #endif
 
+/// When set to anything but "0" or an empty string, device_manager_init()
+/// only loads acquire-driver-common, with the simulated devices. The other
+/// drivers are loaded when a device is asked for that it doesn't have, or
+/// when every device is listed.
+#define DEVICE_MANAGER_LAZY_ENV "ACQUIRE_LAZY_DRIVER_LOADING"
+
     struct DeviceManager
     {
         void* impl;
@@ -74,6 +80,17 @@ extern "C"
       enum DeviceKind kind,
       struct DeviceIdentifier* out);
 
+    /// Lists devices afresh through their drivers.
+    ///
+    /// The devices found through each driver are kept for every device
+    /// manager in the process, so runtimes after the first list them without
+    /// loading the drivers, which are loaded when a device is first opened.
+    /// Call this to pick up devices plugged in or removed since, or drivers
+    /// that failed to load before. Only the drivers whose devices this
+    /// manager has already listed are enumerated again.
+    enum DeviceStatusCode device_manager_refresh(
+      const struct DeviceManager* self);
+
     struct Driver* device_manager_get_driver(
       const struct DeviceManager* self,
       const struct DeviceIdentifier* identifier);
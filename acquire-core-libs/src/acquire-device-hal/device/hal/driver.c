@@ -2,8 +2,8 @@
 #include "platform.h"
 #include "logger.h"
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -0,0 +1,190 @@
+#include "signals.h"
+#include "logger.h"
+#include "device/hal/driver.h"
+#include "device/hal/device.manager.h"
+
+#define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK_NOJUMP(e)                                                        \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+        }                                                                      \
+    } while (0)
+
+struct Signal*
+signal_open(const struct DeviceManager* system,
+            const struct DeviceIdentifier* identifier)
+{
+    struct Signal* self = 0;
+
+    CHECK(identifier);
+    CHECK(identifier->kind == DeviceKind_Signals);
+
+    {
+        struct Device* device = 0;
+        CHECK(Device_Ok ==
+              driver_open_device(device_manager_get_driver(system, identifier),
+                                 identifier->device_id,
+                                 &device));
+
+        self = containerof(device, struct Signal, device);
+    }
+
+    // Check the required interface functions are non-null
+    CHECK(self->set != NULL);
+    CHECK(self->get != NULL);
+    CHECK(self->get_meta != NULL);
+    CHECK(self->start != NULL);
+    CHECK(self->stop != NULL);
+    CHECK(self->write_ao != NULL);
+
+    return self;
+Error:
+    return 0;
+}
+
+void
+signal_close(struct Signal* self)
+{
+    CHECK(self);
+    struct Driver* const d = self->device.driver;
+    CHECK_NOJUMP(Device_Ok == d->close(d, &self->device));
+    self->state = DeviceState_Closed;
+Error:;
+}
+
+enum DeviceStatusCode
+signal_set(struct Signal* self, struct SignalProperties* settings)
+{
+    enum DeviceStatusCode ecode;
+    // Neither can be NULL
+    CHECK(self);
+    CHECK(settings);
+    switch (ecode = self->set(self, settings)) {
+        case Device_Ok:
+            if (self->state != DeviceState_Running)
+                self->state = DeviceState_Armed;
+            break;
+        case Device_Err:
+            signal_stop(self);
+            self->state = DeviceState_AwaitingConfiguration;
+            break;
+    }
+    return ecode;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+signal_get(const struct Signal* self, struct SignalProperties* settings)
+{
+    // Neither can be NULL
+    CHECK(self);
+    CHECK(settings);
+    return self->get(self, settings);
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+signal_get_meta(const struct Signal* self, struct SignalPropertyMetadata* meta)
+{
+    // Neither can be NULL
+    CHECK(self);
+    CHECK(meta);
+    return self->get_meta(self, meta);
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+signal_start(struct Signal* self)
+{
+    enum DeviceStatusCode ecode;
+    CHECK(self);
+    switch (ecode = self->start(self)) {
+        case Device_Ok:
+            self->state = DeviceState_Running;
+            break;
+        case Device_Err:
+            self->state = DeviceState_AwaitingConfiguration;
+            break;
+    }
+    return ecode;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+signal_stop(struct Signal* self)
+{
+    enum DeviceStatusCode ecode = Device_Ok;
+    CHECK(self);
+    if (self->state == DeviceState_Running) {
+        LOG("SIGNAL STOP %s", self->device.identifier.name);
+        switch (ecode = self->stop(self)) {
+            case Device_Ok:
+                self->state = DeviceState_Armed;
+                break;
+            case Device_Err:
+                self->state = DeviceState_AwaitingConfiguration;
+                break;
+        }
+    }
+Finalize:
+    return ecode;
+Error:
+    ecode = Device_Err;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+signal_write_ao(struct Signal* self, uint8_t* buf, size_t nbytes)
+{
+    CHECK(self);
+    CHECK(buf || !nbytes);
+    return self->write_ao(self, buf, nbytes);
+Error:
+    return Device_Err;
+}
+
+int
+signal_can_report_output_position(const struct Signal* self)
+{
+    return self && self->get_output_position;
+}
+
+enum DeviceStatusCode
+signal_get_output_position(const struct Signal* self, uint64_t* samples)
+{
+    CHECK(self);
+    CHECK(samples);
+    CHECK(self->get_output_position);
+    return self->get_output_position(self, samples);
+Error:
+    return Device_Err;
+}
+
+size_t
+signal_bytes_per_output_sample(const struct SignalProperties* settings)
+{
+    size_t nbytes = 0;
+    const uint8_t n = settings->channels.line_count;
+    for (uint8_t i = 0; i < n && i < countof(settings->channels.lines); ++i) {
+        const struct Channel* line = settings->channels.lines + i;
+        if (line->signal_io_kind == Signal_Output)
+            nbytes += bytes_of_type(line->sample_type);
+    }
+    return nbytes;
+}
@@ -0,0 +1,54 @@
+#ifndef H_ACQUIRE_HAL_SIGNALS_V0
+#define H_ACQUIRE_HAL_SIGNALS_V0
+
+#include "device/hal/device.manager.h"
+#include "device/kit/experimental/signals.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct Signal* signal_open(const struct DeviceManager* system,
+                               const struct DeviceIdentifier* identifier);
+
+    void signal_close(struct Signal* self);
+
+    enum DeviceStatusCode signal_set(struct Signal* self,
+                                     struct SignalProperties* settings);
+
+    enum DeviceStatusCode signal_get(const struct Signal* self,
+                                     struct SignalProperties* settings);
+
+    enum DeviceStatusCode signal_get_meta(const struct Signal* self,
+                                          struct SignalPropertyMetadata* meta);
+
+    enum DeviceStatusCode signal_start(struct Signal* self);
+
+    enum DeviceStatusCode signal_stop(struct Signal* self);
+
+    /// @brief Queues `nbytes` of interleaved samples for the device's
+    /// output lines after any queued before.
+    enum DeviceStatusCode signal_write_ao(struct Signal* self,
+                                          uint8_t* buf,
+                                          size_t nbytes);
+
+    /// @returns 1 if the device reports how far its output has got with
+    /// `signal_get_output_position()`, otherwise 0.
+    int signal_can_report_output_position(const struct Signal* self);
+
+    /// @brief Sets `*samples` to the number of samples per line the device
+    /// has output since it was started.
+    enum DeviceStatusCode signal_get_output_position(const struct Signal* self,
+                                                     uint64_t* samples);
+
+    /// @returns The bytes one sample of every output line in `settings`
+    /// takes, as they're interleaved for `signal_write_ao()`.
+    size_t signal_bytes_per_output_sample(
+      const struct SignalProperties* settings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // H_ACQUIRE_HAL_SIGNALS_V0
@@ -2,11 +2,12 @@
 #include "logger.h"
 #include "device/hal/driver.h"
 #include "device/hal/device.manager.h"
+#include "platform.h"
 
 #define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -57,8 +58,8 @@ stage_axis_close(struct StageAxis* self)
 {
     CHECK(self);
     struct Driver* const d = self->device.driver;
+    // close() frees the device, so nothing may touch `self` after it.
     CHECK_NOJUMP(Device_Ok == d->close(d, &self->device));
-    self->state = DeviceState_Closed;
 Error:;
 }
 
@@ -148,3 +149,29 @@ Error:
     ecode = Device_Err;
     goto Finalize;
 }
+
+enum DeviceStatusCode
+stage_axis_get_position_samples(struct StageAxis* self,
+                                struct StageAxisPositionSample* samples,
+                                uint32_t* count)
+{
+    CHECK(self);
+    CHECK(samples);
+    CHECK(count);
+    if (self->get_position_samples)
+        return self->get_position_samples(self, samples, count);
+    if (!*count)
+        return Device_Ok;
+    struct StageAxisProperties settings = { 0 };
+    const uint64_t now = clock_tic(0);
+    CHECK(Device_Ok == self->get(self, &settings));
+    samples[0] = (struct StageAxisPositionSample){
+        .timestamp = now,
+        .position = settings.immediate.position,
+        .velocity = settings.immediate.velocity,
+    };
+    *count = 1;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
@@ -29,6 +29,17 @@ extern "C"
 
     enum DeviceStatusCode stage_axis_stop(struct StageAxis* self);
 
+    /// @brief Collects up to `*count` of the position samples the axis took
+    /// since the last call, oldest first.
+    /// @details Axes that don't stream samples report one, of where
+    /// `get()` says the axis is now.
+    /// @param[in,out] count Room in `samples` on the way in, the number of
+    ///                      samples copied on the way out.
+    enum DeviceStatusCode stage_axis_get_position_samples(
+      struct StageAxis* self,
+      struct StageAxisPositionSample* samples,
+      uint32_t* count);
+
 #ifdef __cplusplus
 }
 #endif
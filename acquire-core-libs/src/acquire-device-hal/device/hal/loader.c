@@ -6,9 +6,8 @@
 
 #define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define ERR(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!((e))) {                                                          \
@@ -33,6 +32,7 @@ struct Loader
     struct Driver driver;
     struct Driver* inner;
     struct lib lib;
+    uint32_t kit_version;
 };
 
 static unsigned
@@ -124,6 +124,14 @@ driver_load(const char* relative_path,
            "Failed to initialize driver at \"%s\"",
            relative_path);
 
+    // Drivers built before the kit was versioned don't report it.
+    uint32_t (*kit_version)() =
+      lib_find(&self->lib, "acquire_driver_kit_version_v0");
+    self->kit_version = kit_version ? kit_version() : 0;
+    TRACE("LOADER: %s built with device kit version %u",
+          relative_path,
+          self->kit_version);
+
     return &self->driver;
 Error:
     if (self) {
@@ -132,3 +140,12 @@ Error:
     }
     return 0;
 }
+
+uint32_t
+driver_kit_version(const struct Driver* driver)
+{
+    // Loaded drivers are recognized by the functions the loader gives them.
+    if (driver && driver->open == open)
+        return containerof(driver, struct Loader, driver)->kit_version;
+    return ACQUIRE_DEVICE_KIT_VERSION;
+}
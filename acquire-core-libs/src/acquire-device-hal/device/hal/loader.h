@@ -37,6 +37,13 @@ extern "C"
                                                 const char* function,
                                                 const char* msg));
 
+    /// @brief The `ACQUIRE_DEVICE_KIT_VERSION` the devices of `driver` were
+    /// built with.
+    /// @details For a driver loaded by driver_load(), what the library's
+    /// `acquire_driver_kit_version_v0()` reports, or 0 if it has none. Any
+    /// other driver was built into the process, with these headers.
+    uint32_t driver_kit_version(const struct Driver* driver);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -2,6 +2,7 @@
 #include "logger.h"
 #include "device.manager.h"
 #include "driver.h"
+#include "loader.h"
 
 #include <stddef.h>
 #include <string.h>
@@ -10,8 +11,8 @@
 #define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
 #define countof(e) (sizeof(e) / sizeof((e)[0]))
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -194,12 +195,137 @@ storage_append(struct Storage* self,
     CHECK(self);
     CHECK(self->state == DeviceState_Running);
     CHECK(end >= beg);
-    if (beg < end) {
-        size_t nbytes = (uint8_t*)end - (uint8_t*)beg;
-        // FIXME: (nclack) api inconsistency. What happens if we don't consume
-        // all bytes?
+    // A device that takes only part of the packet is waiting on whatever it
+    // writes to. It's handed the rest until it has taken everything, so the
+    // caller is held back for as long as storage is.
+    while (beg < end) {
+        const size_t remaining = (uint8_t*)end - (uint8_t*)beg;
+        size_t nbytes = remaining;
         self->state = self->append(self, beg, &nbytes);
         CHECK(self->state == DeviceState_Running);
+        CHECK(nbytes <= remaining);
+        beg = (const struct VideoFrame*)((const uint8_t*)beg + nbytes);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+/// Whether the storage's driver was built with the members version 1 of the
+/// kit appended to `struct Storage`. When it wasn't, they hold whatever the
+/// driver keeps after its `struct Storage`, so they must not be touched.
+static int
+has_kit_v1(const struct Storage* self)
+{
+    return driver_kit_version(self->device.driver) >= 1;
+}
+
+int
+storage_supports_concurrent_append(const struct Storage* self)
+{
+    return self && has_kit_v1(self) && self->append_at;
+}
+
+enum DeviceStatusCode
+storage_append_at(struct Storage* self,
+                  const struct VideoFrame* beg,
+                  const struct VideoFrame* end,
+                  uint64_t first_frame_index,
+                  uint64_t offset)
+{
+    CHECK(self);
+    CHECK(storage_supports_concurrent_append(self));
+    CHECK(self->state == DeviceState_Running);
+    CHECK(end >= beg);
+    if (beg < end) {
+        const enum DeviceState state =
+          self->append_at(self,
+                          beg,
+                          (uint8_t*)end - (uint8_t*)beg,
+                          first_frame_index,
+                          offset);
+        // Other threads may be appending, so the state only changes when
+        // the device fails.
+        if (state != DeviceState_Running) {
+            self->state = state;
+            goto Error;
+        }
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+storage_supports_async_append(const struct Storage* self)
+{
+    return self && has_kit_v1(self) && self->append_async;
+}
+
+enum DeviceStatusCode
+storage_append_async(struct Storage* self,
+                     const struct VideoFrame* beg,
+                     const struct VideoFrame* end,
+                     void (*done)(void* ctx, size_t n),
+                     void* ctx)
+{
+    CHECK(self);
+    CHECK(storage_supports_async_append(self));
+    CHECK(done);
+    CHECK(self->state == DeviceState_Running);
+    CHECK(end >= beg);
+    if (beg < end) {
+        self->state = self->append_async(
+          self, beg, (uint8_t*)end - (uint8_t*)beg, done, ctx);
+        CHECK(self->state == DeviceState_Running);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+storage_supports_chunk_assembly(const struct Storage* self)
+{
+    return self && has_kit_v1(self) && self->append_chunks;
+}
+
+enum DeviceStatusCode
+storage_append_chunks(struct Storage* self,
+                      const struct StorageChunk* chunks,
+                      size_t count)
+{
+    CHECK(self);
+    CHECK(storage_supports_chunk_assembly(self));
+    CHECK(chunks || !count);
+    CHECK(self->state == DeviceState_Running);
+    if (count) {
+        self->state = self->append_chunks(self, chunks, count);
+        CHECK(self->state == DeviceState_Running);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+storage_supports_annotations(const struct Storage* self)
+{
+    return self && has_kit_v1(self) && self->append_annotations;
+}
+
+enum DeviceStatusCode
+storage_append_annotations(struct Storage* self,
+                           const struct FrameAnnotation* annotations,
+                           size_t nbytes)
+{
+    CHECK(self);
+    CHECK(storage_supports_annotations(self));
+    CHECK(annotations || !nbytes);
+    CHECK(self->state == DeviceState_Running);
+    if (nbytes) {
+        self->state = self->append_annotations(self, annotations, nbytes);
+        CHECK(self->state == DeviceState_Running);
     }
     return Device_Ok;
 Error:
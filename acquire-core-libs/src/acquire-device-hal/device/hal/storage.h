@@ -57,12 +57,66 @@ extern "C"
     enum DeviceStatusCode storage_stop(struct Storage* storage);
 
     /// @brief Append data in `[beg,end)` to Storage
+    /// @details Returns once the device has taken the whole packet. Devices
+    /// that take part of it at a time are called again with the rest.
     /// @param[in] beg The beginning of the packet of frames to write.
     /// @param[in] end The end of the packet of frames to write.
     enum DeviceStatusCode storage_append(struct Storage* self,
                                          const struct VideoFrame* beg,
                                          const struct VideoFrame* end);
 
+    /// @returns 1 if `storage_append_at()` may be called from several threads
+    /// at once, otherwise 0.
+    int storage_supports_concurrent_append(const struct Storage* self);
+
+    /// @brief Append the packet of frames in `[beg,end)`, which starts
+    /// `first_frame_index` frames and `offset` bytes into the stream.
+    /// @details Safe to call from several threads at once when
+    /// `storage_supports_concurrent_append()`. Packets may be appended in any
+    /// order.
+    enum DeviceStatusCode storage_append_at(struct Storage* self,
+                                            const struct VideoFrame* beg,
+                                            const struct VideoFrame* end,
+                                            uint64_t first_frame_index,
+                                            uint64_t offset);
+
+    /// @returns 1 if the storage device can finish appends after
+    /// `storage_append_async()` returns, otherwise 0.
+    int storage_supports_async_append(const struct Storage* self);
+
+    /// @brief Append the packet of frames in `[beg,end)` without waiting for
+    /// it to be written.
+    /// @details `[beg,end)` has to stay readable until `done(ctx, n)` has
+    /// reported its last byte. Bytes are reported in the order they were
+    /// appended, and all of them by the time storage_stop() returns.
+    enum DeviceStatusCode storage_append_async(struct Storage* self,
+                                               const struct VideoFrame* beg,
+                                               const struct VideoFrame* end,
+                                               void (*done)(void* ctx,
+                                                            size_t n),
+                                               void* ctx);
+
+    /// @returns 1 if the storage device takes chunks assembled by the
+    /// runtime with `storage_append_chunks()` instead of frames, otherwise 0.
+    int storage_supports_chunk_assembly(const struct Storage* self);
+
+    /// @brief Append a layer of `count` chunks assembled from frames.
+    enum DeviceStatusCode storage_append_chunks(
+      struct Storage* self,
+      const struct StorageChunk* chunks,
+      size_t count);
+
+    /// @returns 1 if the storage device stores client annotations with
+    /// `storage_append_annotations()`, otherwise 0.
+    int storage_supports_annotations(const struct Storage* self);
+
+    /// @brief Append `nbytes` of annotations joined to frames not yet
+    /// appended.
+    enum DeviceStatusCode storage_append_annotations(
+      struct Storage* self,
+      const struct FrameAnnotation* annotations,
+      size_t nbytes);
+
     /// @brief Close the storage device.
     /// @details The storage device is deallocated and any resources it was
     /// using are freed.
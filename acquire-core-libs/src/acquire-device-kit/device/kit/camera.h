@@ -56,6 +56,62 @@ extern "C"
                                            void* im,
                                            size_t* nbytes,
                                            struct ImageInfo* info);
+
+        // The members below are only used for drivers that report version 1
+        // or later of the kit. See `ACQUIRE_DEVICE_KIT_VERSION`.
+
+        /// @brief Optional. Reports how many frames `get_frame` can return
+        ///        right now without waiting.
+        /// @details Lets the runtime reserve room for a burst of frames at
+        ///          once. May be NULL, in which case frames are requested one
+        ///          at a time.
+        enum DeviceStatusCode (*get_ready_frame_count)(const struct Camera*,
+                                                       uint32_t* count);
+
+        /// @brief Optional. Lends the camera the buffer the next call to
+        ///        `get_frame` will be given, so a frame can be captured
+        ///        straight into it.
+        /// @details The camera may write the next frame into `im` at any time
+        ///          until that call to `get_frame` returns, and then skip
+        ///          copying it. The buffer is not lent after that. May be
+        ///          NULL, in which case `get_frame` copies every frame.
+        enum DeviceStatusCode (*lend_buffer)(struct Camera*,
+                                             void* im,
+                                             size_t nbytes);
+
+        /// @brief Optional. Gets up to `*count` frames in one call, waiting
+        ///        only for the first.
+        /// @details Frame `i` is written straight to `(uint8_t*)im + i *
+        ///          stride`, which has room for `bytes_of_frame` bytes, and is
+        ///          described by `info[i]`. On return `*count` holds the
+        ///          number of frames written, which is 0 if the camera stopped
+        ///          before one was ready. May be NULL, in which case frames
+        ///          are gotten one `get_frame` at a time.
+        enum DeviceStatusCode (*get_frames)(struct Camera*,
+                                            void* im,
+                                            size_t stride,
+                                            size_t bytes_of_frame,
+                                            uint32_t* count,
+                                            struct ImageInfo* info);
+
+        /// @brief Optional. Like `get_frame`, but gives up once `timeout_ms`
+        ///        pass without a frame.
+        /// @details Sets `*nbytes` to 0 when no frame was ready in time, as
+        ///          when the camera stops. A `timeout_ms` of 0 only polls.
+        ///          May be NULL, in which case the runtime polls
+        ///          `get_ready_frame_count` if there is one, and otherwise
+        ///          waits in `get_frame`.
+        enum DeviceStatusCode (*get_frame_timeout)(struct Camera*,
+                                                   void* im,
+                                                   size_t* nbytes,
+                                                   struct ImageInfo* info,
+                                                   uint32_t timeout_ms);
+
+        /// @brief Incremented whenever the shape reported by `get_shape` may
+        ///        have changed, so callers only query it again when needed.
+        /// @details camera_set() increments it. A driver whose shape can change
+        ///          on its own must increment it as well.
+        uint32_t shape_generation;
     };
 
 #ifdef __cplusplus
@@ -61,6 +61,33 @@ extern "C"
         enum DeviceStatusCode (*shutdown)(struct Driver* self);
     };
 
+/// Version of the device interfaces in `device/kit`.
+///
+/// Drivers embed `struct Camera` and `struct Storage` at the start of structs
+/// of their own, so members appended to them after a driver was built would
+/// be read out of the driver's private fields. Each version only appends
+/// members, and the HAL doesn't touch those a driver's version lacks.
+///
+/// Version 1 appends `get_ready_frame_count`, `lend_buffer`, `get_frames`,
+/// `get_frame_timeout` and `shape_generation` to `struct Camera`, and
+/// `append_at`, `append_async`, `append_chunks` and `append_annotations` to
+/// `struct Storage`.
+#define ACQUIRE_DEVICE_KIT_VERSION (1)
+
+    /// Reports the `ACQUIRE_DEVICE_KIT_VERSION` the driver was built with.
+    /// Drivers built against version 1 or later must define it as:
+    ///
+    /// ```
+    /// acquire_export uint32_t
+    /// acquire_driver_kit_version_v0()
+    /// {
+    ///     return ACQUIRE_DEVICE_KIT_VERSION;
+    /// }
+    /// ```
+    ///
+    /// A driver that doesn't export it is taken to be version 0.
+    acquire_export uint32_t acquire_driver_kit_version_v0(void);
+
     acquire_export struct Driver* acquire_driver_init_v0(
       void (*reporter)(int is_error,
                        const char* file,
@@ -17,18 +17,28 @@ extern "C"
         struct Device device;
         enum DeviceState state;
 
-        enum DeviceState (*set)(struct Signal* self,
-                                struct SignalProperties* settings);
-        enum DeviceState (*get)(const struct Signal* self,
-                                struct SignalProperties* settings);
-        enum DeviceState (*get_meta)(const struct Signal* self,
-                                     struct SignalPropertyMetadata* meta);
-        enum DeviceState (*start)(struct Signal* self);
-        enum DeviceState (*stop)(struct Signal* self);
-
-        enum DeviceState (*write_ao)(struct Signal* self,
-                                     uint8_t* buf,
-                                     size_t nbytes);
+        enum DeviceStatusCode (*set)(struct Signal* self,
+                                     struct SignalProperties* settings);
+        enum DeviceStatusCode (*get)(const struct Signal* self,
+                                     struct SignalProperties* settings);
+        enum DeviceStatusCode (*get_meta)(const struct Signal* self,
+                                          struct SignalPropertyMetadata* meta);
+        enum DeviceStatusCode (*start)(struct Signal* self);
+        enum DeviceStatusCode (*stop)(struct Signal* self);
+
+        /// Queues `nbytes` of samples for output after any queued before,
+        /// and returns once they're queued. Samples are interleaved over the
+        /// output lines, in line order. May be called before start() to
+        /// fill the device's buffer. Devices without get_output_position()
+        /// should block until there's room, so the device paces the writes.
+        enum DeviceStatusCode (*write_ao)(struct Signal* self,
+                                          uint8_t* buf,
+                                          size_t nbytes);
+
+        /// Optional. Sets `*samples` to the number of samples per line the
+        /// device has output since it was started. Mustn't block.
+        enum DeviceStatusCode (*get_output_position)(const struct Signal* self,
+                                                     uint64_t* samples);
         // TODO: Finish Signal.
     };
 
@@ -22,6 +22,16 @@ extern "C"
           struct StageAxisPropertyMetadata* meta);
         enum DeviceStatusCode (*start)(struct StageAxis*);
         enum DeviceStatusCode (*stop)(struct StageAxis*);
+
+        /// Optional. Copies up to `*count` of the position samples taken
+        /// since the last call, oldest first, into `samples` and sets
+        /// `*count` to the number copied. Mustn't block. Only called while
+        /// the axis is running. Samples that aren't collected in time may
+        /// be dropped.
+        enum DeviceStatusCode (*get_position_samples)(
+          struct StageAxis*,
+          struct StageAxisPositionSample* samples,
+          uint32_t* count);
     };
 
 #ifdef __cplusplus
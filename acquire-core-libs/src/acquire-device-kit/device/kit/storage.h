@@ -10,6 +10,7 @@ extern "C"
 #endif
     struct StorageProperties;
     struct VideoFrame;
+    struct FrameAnnotation;
 
     struct Storage
     {
@@ -29,7 +30,9 @@ extern "C"
         /// @param nbytes [in,out] The number of bytes in the packet to write.
         ///                        The Storage device can consume 0 to *nbytes
         ///                        from the packet, and must set *nbytes to be
-        ///                        the number of consumed bytes.
+        ///                        the number of consumed bytes. Only whole
+        ///                        frames may be consumed. The rest is
+        ///                        appended by another call.
         enum DeviceState (*append)(struct Storage* self,
                                    const struct VideoFrame* frame,
                                    size_t* nbytes);
@@ -43,6 +46,66 @@ extern "C"
         /// @param shape [in] The image shape to expect.
         void (*reserve_image_shape)(struct Storage* self,
                                     const struct ImageShape* shape);
+
+        // The members below are only used for drivers that report version 1
+        // or later of the kit. See `ACQUIRE_DEVICE_KIT_VERSION`.
+
+        /// @brief Optional. Like `append`, but may be called from several
+        ///        threads at once.
+        /// @details Every byte since `start` is passed exactly once, but
+        ///          packets may arrive in any order. `first_frame_index` and
+        ///          `offset` count the frames and bytes appended before
+        ///          `frame`, so the device can place the packet without
+        ///          waiting for the ones before it. The whole packet must be
+        ///          consumed. May be NULL, in which case `append` is only
+        ///          called from one thread.
+        enum DeviceState (*append_at)(struct Storage* self,
+                                      const struct VideoFrame* frame,
+                                      size_t nbytes,
+                                      uint64_t first_frame_index,
+                                      uint64_t offset);
+
+        /// @brief Optional. Like `append`, but may return before the packet
+        ///        is written.
+        /// @details The whole packet is taken, and must stay readable until
+        ///          the device calls `done(ctx, n)` for its last byte. Calls to
+        ///          `done` report bytes finished in the order they were
+        ///          appended, one call at a time, from any thread, possibly
+        ///          before this returns. Every byte is reported, even ones
+        ///          that failed to be written, by the time `stop` returns. A
+        ///          failed write is reported by the state the next call to
+        ///          this or `stop` returns. May be NULL, in which case every
+        ///          append is finished when it returns.
+        enum DeviceState (*append_async)(struct Storage* self,
+                                         const struct VideoFrame* frame,
+                                         size_t nbytes,
+                                         void (*done)(void* ctx, size_t n),
+                                         void* ctx);
+
+        /// @brief Optional. Takes finished chunks of the array described by
+        ///        the `acquisition_dimensions` last applied, in place of
+        ///        frames.
+        /// @details When this is set the runtime assembles frames into
+        ///          chunks itself and never calls the other appends. Chunks
+        ///          come a layer at a time: every chunk up to the next chunk
+        ///          boundary along the append dimension, in order. The last
+        ///          layer may be partly filled. `chunks` is only readable
+        ///          until this returns.
+        enum DeviceState (*append_chunks)(struct Storage* self,
+                                          const struct StorageChunk* chunks,
+                                          size_t count);
+
+        /// @brief Optional. Takes client annotations joined to frames, laid
+        ///        out back to back in `[annotations,annotations+nbytes)`.
+        /// @details Called from the thread appending frames, between appends,
+        ///          before the frames the annotations were joined to are
+        ///          appended. `annotations` is only readable until this
+        ///          returns. May be NULL, in which case annotations are
+        ///          dropped.
+        enum DeviceState (*append_annotations)(
+          struct Storage* self,
+          const struct FrameAnnotation* annotations,
+          size_t nbytes);
     };
 
 #ifdef __cplusplus
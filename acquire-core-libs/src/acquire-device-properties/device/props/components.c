@@ -1,5 +1,8 @@
 #include "components.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define countof(e) (sizeof(e) / sizeof(*(e)))
 
 const char*
@@ -20,6 +23,10 @@ sample_type_as_string(enum SampleType type)
         XXX(u10),
         XXX(u12),
         XXX(u14),
+        XXX(u32),
+        XXX(u10p),
+        XXX(u12p),
+        XXX(u14p),
 #undef XXX
     };
     // clang-format on
@@ -32,7 +39,7 @@ sample_type_as_string(enum SampleType type)
 size_t
 bytes_of_type(enum SampleType type)
 {
-    size_t table[SampleTypeCount]; // = { 1, 2, 1, 2, 4, 2, 2, 2 };
+    size_t table[SampleTypeCount]; // = { 1, 2, 1, 2, 4, 2, 2, 2, 4, 2, 2, 2 };
 
     // clang-format off
 #define XXX(s, b) table[(s)] = (b)
@@ -44,6 +51,10 @@ bytes_of_type(enum SampleType type)
         XXX(SampleType_u10, 2);
         XXX(SampleType_u12, 2);
         XXX(SampleType_u14, 2);
+        XXX(SampleType_u32, 4);
+        XXX(SampleType_u10p, 2);
+        XXX(SampleType_u12p, 2);
+        XXX(SampleType_u14p, 2);
 #undef XXX
     // clang-format on
     if (type >= countof(table))
@@ -52,10 +63,364 @@ bytes_of_type(enum SampleType type)
     return table[type];
 }
 
+uint8_t
+bits_of_type(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u10p:
+            return 10;
+        case SampleType_u12p:
+            return 12;
+        case SampleType_u14p:
+            return 14;
+        default:
+            return (uint8_t)(8 * bytes_of_type(type));
+    }
+}
+
 size_t
 bytes_of_image(const struct ImageShape* const shape)
 {
-    return shape->strides.planes * bytes_of_type(shape->type);
+    return (shape->strides.planes * bits_of_type(shape->type) + 7) / 8;
+}
+
+enum SampleType
+sample_type_unpacked(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u10p:
+            return SampleType_u10;
+        case SampleType_u12p:
+            return SampleType_u12;
+        case SampleType_u14p:
+            return SampleType_u14;
+        default:
+            return type;
+    }
+}
+
+void
+pack_samples(uint8_t* dst,
+             const uint16_t* src,
+             enum SampleType type,
+             size_t n)
+{
+    if (sample_type_unpacked(type) == type)
+        return;
+    const unsigned b = bits_of_type(type);
+    const uint64_t mask = (1ULL << b) - 1;
+    uint64_t acc = 0;
+    unsigned nbits = 0;
+    for (size_t i = 0; i < n; ++i) {
+        acc |= (src[i] & mask) << nbits;
+        for (nbits += b; nbits >= 8; nbits -= 8, acc >>= 8)
+            *dst++ = (uint8_t)acc;
+    }
+    if (nbits)
+        *dst = (uint8_t)acc;
+}
+
+void
+unpack_samples(uint16_t* dst,
+               const uint8_t* src,
+               enum SampleType type,
+               size_t n)
+{
+    if (sample_type_unpacked(type) == type)
+        return;
+    const unsigned b = bits_of_type(type);
+    const uint64_t mask = (1ULL << b) - 1;
+    uint64_t acc = 0;
+    unsigned nbits = 0;
+    for (size_t i = 0; i < n; ++i) {
+        for (; nbits < b; nbits += 8)
+            acc |= (uint64_t)*src++ << nbits;
+        dst[i] = (uint16_t)(acc & mask);
+        acc >>= b;
+        nbits -= b;
+    }
+}
+
+//
+//  FRAME COMPRESSION
+//
+//  Blocks are compressed in the LZ4 block format, with a greedy matcher
+//  searching a small hash table of the positions of earlier 4-byte strings.
+//
+
+#define LZ4_HASH_LOG (12)
+#define LZ4_MIN_MATCH (4)
+// The format ends every block with at least this many literals.
+#define LZ4_LAST_LITERALS (5)
+// No match starts in the last 12 bytes of a block.
+#define LZ4_MATCH_FIND_LIMIT (12)
+#define LZ4_MAX_OFFSET (65535)
+
+static uint32_t
+read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v)); // NOLINT
+    return v;
+}
+
+static uint32_t
+lz4_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+/// Writes what's left of a length after the 15 its token holds.
+static uint8_t*
+put_length(uint8_t* op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/// Writes `nlit` literals from `lit`, followed by a match of `mlen` bytes
+/// `offset` back, unless `mlen` is 0.
+/// @returns The end of what was written, or 0 if it wouldn't fit.
+static uint8_t*
+put_sequence(uint8_t* op,
+             const uint8_t* oend,
+             const uint8_t* lit,
+             size_t nlit,
+             size_t offset,
+             size_t mlen)
+{
+    const size_t ml = mlen ? mlen - LZ4_MIN_MATCH : 0;
+    if ((size_t)(oend - op) < 1 + nlit + nlit / 255 + 1 + 2 + ml / 255 + 1)
+        return 0;
+    uint8_t* const token = op++;
+    *token = (uint8_t)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15)
+        op = put_length(op, nlit - 15);
+    memcpy(op, lit, nlit); // NOLINT
+    op += nlit;
+    if (mlen) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(ml < 15 ? ml : 15);
+        if (ml >= 15)
+            op = put_length(op, ml - 15);
+    }
+    return op;
+}
+
+/// @returns Bytes written to `dst`, or 0 if they'd take `cap` or more.
+static size_t
+lz4_compress(uint8_t* dst, size_t cap, const uint8_t* src, size_t n)
+{
+    if (cap < 2)
+        return 0;
+    uint32_t table[1 << LZ4_HASH_LOG] = { 0 };
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    uint8_t* op = dst;
+    const uint8_t* const oend = dst + cap - 1;
+    if (n > LZ4_MATCH_FIND_LIMIT) {
+        const uint8_t* const find_limit = src + n - LZ4_MATCH_FIND_LIMIT;
+        const uint8_t* const match_limit = src + n - LZ4_LAST_LITERALS;
+        // Steps grow over data that doesn't match, so it's passed quickly.
+        unsigned misses = 0;
+        while (ip <= find_limit) {
+            const uint32_t h = lz4_hash(read32(ip));
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET ||
+                read32(ref) != read32(ip)) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            const uint8_t* end = ip + LZ4_MIN_MATCH;
+            const uint8_t* r = ref + LZ4_MIN_MATCH;
+            while (end < match_limit && *end == *r) {
+                ++end;
+                ++r;
+            }
+            op = put_sequence(op,
+                              oend,
+                              anchor,
+                              (size_t)(ip - anchor),
+                              (size_t)(ip - ref),
+                              (size_t)(end - ip));
+            if (!op)
+                return 0;
+            ip = anchor = end;
+        }
+    }
+    op = put_sequence(op, oend, anchor, (size_t)(src + n - anchor), 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+/// Reads the rest of a length its token says is at least 15.
+/// @returns 0 if the input ends first.
+static int
+get_length(const uint8_t** ip, const uint8_t* iend, size_t* len)
+{
+    unsigned b = 255;
+    while (b == 255) {
+        if (*ip >= iend)
+            return 0;
+        b = *(*ip)++;
+        *len += b;
+    }
+    return 1;
+}
+
+/// @returns 1 if `src` decodes to exactly `n` bytes, otherwise 0.
+static int
+lz4_decompress(uint8_t* dst, size_t n, const uint8_t* src, size_t nsrc)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + nsrc;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + n;
+    while (ip < iend) {
+        const unsigned token = *ip++;
+        size_t nlit = token >> 4;
+        if (nlit == 15 && !get_length(&ip, iend, &nlit))
+            return 0;
+        if ((size_t)(iend - ip) < nlit || (size_t)(oend - op) < nlit)
+            return 0;
+        memcpy(op, ip, nlit); // NOLINT
+        op += nlit;
+        ip += nlit;
+        if (ip == iend)
+            break; // The last sequence has no match.
+        if (iend - ip < 2)
+            return 0;
+        const size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !get_length(&ip, iend, &mlen))
+            return 0;
+        mlen += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) ||
+            (size_t)(oend - op) < mlen)
+            return 0;
+        const uint8_t* ref = op - offset;
+        if (offset >= mlen) {
+            memcpy(op, ref, mlen); // NOLINT
+            op += mlen;
+        } else {
+            // Overlapping matches repeat the last `offset` bytes.
+            for (size_t i = 0; i < mlen; ++i)
+                *op++ = *ref++;
+        }
+    }
+    return op == oend;
+}
+
+/// Bytes of a sample the shuffle regroups, or 1 for packed samples, which
+/// don't fill whole bytes.
+static size_t
+shuffle_width(enum SampleType type)
+{
+    return sample_type_unpacked(type) == type ? bytes_of_type(type) : 1;
+}
+
+/// Writes byte `b` of every `w`-byte sample of `src` to plane `b` of `dst`.
+/// A partial sample at the end is copied as it is.
+static void
+shuffle(uint8_t* dst, const uint8_t* src, size_t nbytes, size_t w)
+{
+    const size_t n = nbytes / w;
+    for (size_t b = 0; b < w; ++b)
+        for (size_t i = 0; i < n; ++i)
+            dst[b * n + i] = src[i * w + b];
+    memcpy(dst + n * w, src + n * w, nbytes - n * w); // NOLINT
+}
+
+static void
+unshuffle(uint8_t* dst, const uint8_t* src, size_t nbytes, size_t w)
+{
+    const size_t n = nbytes / w;
+    for (size_t b = 0; b < w; ++b)
+        for (size_t i = 0; i < n; ++i)
+            dst[i * w + b] = src[b * n + i];
+    memcpy(dst + n * w, src + n * w, nbytes - n * w); // NOLINT
+}
+
+size_t
+frame_compress_block(enum FrameCompression codec,
+                     enum SampleType type,
+                     uint8_t* dst,
+                     const uint8_t* src,
+                     size_t nbytes,
+                     uint8_t* scratch)
+{
+    switch (codec) {
+        case FrameCompression_Lz4:
+            return lz4_compress(dst, nbytes, src, nbytes);
+        case FrameCompression_ShuffleLz4:
+            shuffle(scratch, src, nbytes, shuffle_width(type));
+            return lz4_compress(dst, nbytes, scratch, nbytes);
+        default:
+            return 0;
+    }
+}
+
+int
+frame_decompress(const struct VideoFrame* frame, uint8_t* dst, size_t nbytes)
+{
+    const size_t bytes_of_samples = bytes_of_image(&frame->shape);
+    if (nbytes < bytes_of_samples)
+        return 0;
+    if (frame->compression == FrameCompression_None) {
+        memcpy(dst, frame->data, bytes_of_samples); // NOLINT
+        return 1;
+    }
+    if (frame->compression >= FrameCompressionCount ||
+        frame->bytes_of_data < sizeof(struct frame_compression_header))
+        return 0;
+
+    const struct frame_compression_header* const header =
+      (const struct frame_compression_header*)frame->data;
+    const size_t bpb = header->bytes_per_block;
+    const size_t nblocks = header->nblocks;
+    const size_t bytes_of_header =
+      sizeof(*header) + nblocks * sizeof(header->bytes_of_block[0]);
+    if (!bpb || nblocks != (bytes_of_samples + bpb - 1) / bpb ||
+        frame->bytes_of_data < bytes_of_header)
+        return 0;
+
+    const int is_shuffled = frame->compression == FrameCompression_ShuffleLz4;
+    const size_t w = shuffle_width(frame->shape.type);
+    uint8_t* const scratch = is_shuffled ? malloc(bpb) : 0;
+    if (is_shuffled && !scratch)
+        return 0;
+    const uint8_t* src = frame->data + bytes_of_header;
+    const uint8_t* const end = frame->data + frame->bytes_of_data;
+    int is_ok = 1;
+    for (size_t i = 0; is_ok && i < nblocks; ++i) {
+        const size_t offset = i * bpb;
+        const size_t n =
+          bytes_of_samples - offset < bpb ? bytes_of_samples - offset : bpb;
+        const size_t m = header->bytes_of_block[i];
+        if (m > (size_t)(end - src)) {
+            is_ok = 0;
+        } else if (m == n) {
+            memcpy(dst + offset, src, n); // NOLINT
+        } else if (is_shuffled) {
+            is_ok = lz4_decompress(scratch, n, src, m);
+            if (is_ok)
+                unshuffle(dst + offset, scratch, n, w);
+        } else {
+            is_ok = lz4_decompress(dst + offset, n, src, m);
+        }
+        src += m;
+    }
+    free(scratch);
+    return is_ok;
 }
 
 //
@@ -65,9 +430,10 @@ bytes_of_image(const struct ImageShape* const shape)
 #ifndef NO_UNIT_TESTS
 #include "logger.h"
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define ERR(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -100,4 +466,159 @@ Error:
     return 0;
 }
 
-#endif // NO_UNIT_TESTS
\ No newline at end of file
+int
+unit_test__packed_samples_round_trip()
+{
+    uint16_t in[13], out[13];
+    uint8_t packed[24];
+    for (int i = 0; i < 13; ++i)
+        in[i] = (uint16_t)(i * 2731 + 0xffff);
+    {
+        // Six 12-bit samples in 9 bytes; the last is rounded up.
+        const struct ImageShape shape = {
+            .dims = { .channels = 1, .width = 3, .height = 2, .planes = 1 },
+            .strides = { .channels = 1, .width = 1, .height = 3, .planes = 6 },
+            .type = SampleType_u12p,
+        };
+        CHECK(bytes_of_image(&shape) == 9);
+        const struct ImageShape odd = {
+            .strides = { .planes = 5 },
+            .type = SampleType_u10p,
+        };
+        CHECK(bytes_of_image(&odd) == 7);
+    }
+    for (int t = SampleType_u10p; t <= SampleType_u14p; ++t) {
+        const unsigned b = bits_of_type(t);
+        const uint16_t mask = (uint16_t)((1u << b) - 1);
+        memset(packed, 0xa5, sizeof(packed));
+        pack_samples(packed, in, t, 13);
+        // Bits past the last sample are cleared, bytes after it untouched.
+        CHECK(packed[13 * b / 8] >> (13 * b % 8) == 0);
+        CHECK(packed[13 * b / 8 + 1] == 0xa5);
+        unpack_samples(out, packed, t, 13);
+        for (int i = 0; i < 13; ++i)
+            CHECK(out[i] == (in[i] & mask));
+    }
+    // The first 12-bit samples, 0xfff and 0xaaa, fill 3 bytes low bits first.
+    CHECK(sample_type_unpacked(SampleType_u12p) == SampleType_u12);
+    CHECK(sample_type_unpacked(SampleType_u16) == SampleType_u16);
+    pack_samples(packed, in, SampleType_u12p, 2);
+    CHECK(packed[0] == 0xff && packed[1] == 0xaf && packed[2] == 0xaa);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Compresses `frame`'s samples into `out` the way the runtime does.
+static int
+compress_frame(struct VideoFrame* out,
+               const struct VideoFrame* frame,
+               enum FrameCompression codec)
+{
+    const size_t nbytes = bytes_of_image(&frame->shape);
+    const size_t bpb = FRAME_COMPRESSION_BLOCK_BYTES;
+    struct frame_compression_header* header =
+      (struct frame_compression_header*)out->data;
+    *out = *frame;
+    out->compression = codec;
+    header->nblocks = (uint32_t)((nbytes + bpb - 1) / bpb);
+    header->bytes_per_block = (uint32_t)bpb;
+    uint8_t* dst = (uint8_t*)(header->bytes_of_block + header->nblocks);
+    uint8_t* scratch = malloc(bpb);
+    CHECK(scratch);
+    for (uint32_t i = 0; i < header->nblocks; ++i) {
+        const size_t n = nbytes - i * bpb < bpb ? nbytes - i * bpb : bpb;
+        size_t m = frame_compress_block(
+          codec, frame->shape.type, dst, frame->data + i * bpb, n, scratch);
+        CHECK(m < n);
+        if (!m) {
+            memcpy(dst, frame->data + i * bpb, n); // NOLINT
+            m = n;
+        }
+        header->bytes_of_block[i] = (uint32_t)m;
+        dst += m;
+    }
+    free(scratch);
+    out->bytes_of_data = (uint32_t)(dst - out->data);
+    return 1;
+Error:
+    free(scratch);
+    return 0;
+}
+
+int
+unit_test__frame_compression_round_trips()
+{
+    // Two blocks, the second partial. The top half is a ramp with noise in
+    // its low bits, the bottom half noise that doesn't compress.
+    const uint32_t w = 512, h = 384;
+    const size_t nbytes = (size_t)w * h * 2;
+    const size_t bytes_of_frame = sizeof(struct VideoFrame) + 2 * nbytes;
+    struct VideoFrame* in = calloc(1, bytes_of_frame);
+    struct VideoFrame* out = calloc(1, bytes_of_frame);
+    uint8_t* samples = malloc(nbytes);
+    CHECK(in && out && samples);
+    in->shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = w, .height = h, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = w,
+                     .planes = (int64_t)w * h },
+        .type = SampleType_u16,
+    };
+    uint32_t seed = 1;
+    uint16_t* px = (uint16_t*)in->data;
+    for (size_t i = 0; i < (size_t)w * h; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        px[i] = (uint16_t)(i < (size_t)w * h / 2 ? (i / 64) + (seed >> 29)
+                                                  : (seed >> 16));
+    }
+
+    CHECK(frame_decompress(in, samples, nbytes));
+    CHECK(memcmp(samples, in->data, nbytes) == 0);
+    CHECK(!frame_decompress(in, samples, nbytes - 1));
+
+    size_t bytes_of_data[FrameCompressionCount] = { 0 };
+    for (int c = FrameCompression_Lz4; c < FrameCompressionCount; ++c) {
+        CHECK(compress_frame(out, in, (enum FrameCompression)c));
+        CHECK(out->bytes_of_data < nbytes);
+        bytes_of_data[c] = out->bytes_of_data;
+        memset(samples, 0, nbytes);
+        CHECK(frame_decompress(out, samples, nbytes));
+        CHECK(memcmp(samples, in->data, nbytes) == 0);
+
+        // Truncated or corrupt data is rejected, not read past.
+        out->bytes_of_data -= 1;
+        CHECK(!frame_decompress(out, samples, nbytes));
+        out->bytes_of_data += 1;
+        ((struct frame_compression_header*)out->data)->bytes_of_block[0] += 1;
+        CHECK(!frame_decompress(out, samples, nbytes));
+    }
+    // Shuffling puts the high bytes of the ramp together.
+    CHECK(bytes_of_data[FrameCompression_ShuffleLz4] <
+          bytes_of_data[FrameCompression_Lz4]);
+
+    // Noise doesn't shrink.
+    for (size_t i = 0; i < nbytes; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        in->data[i] = (uint8_t)(seed >> 24);
+    }
+    CHECK(!frame_compress_block(FrameCompression_Lz4,
+                                SampleType_u8,
+                                out->data,
+                                in->data,
+                                FRAME_COMPRESSION_BLOCK_BYTES,
+                                samples));
+
+    free(in);
+    free(out);
+    free(samples);
+    return 1;
+Error:
+    free(in);
+    free(out);
+    free(samples);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -75,10 +75,28 @@ extern "C"
         SampleType_u10, // unpacked 10 bit in 2 bytes
         SampleType_u12, // unpacked 12 bit in 2 bytes
         SampleType_u14, // unpacked 14 bit in 2 bytes
+        SampleType_u32,
+        SampleType_u10p, // packed 10 bit, see pack_samples()
+        SampleType_u12p, // packed 12 bit
+        SampleType_u14p, // packed 14 bit
         SampleTypeCount,
         SampleType_Unknown
     };
 
+    /// Lossless codecs the runtime can compress frames with on their way
+    /// to storage. See `VideoFrame::compression`.
+    enum FrameCompression
+    {
+        FrameCompression_None = 0,
+        /// LZ4 blocks.
+        FrameCompression_Lz4,
+        /// The bytes of the samples are regrouped by significance, all the
+        /// low bytes first, before LZ4. Compresses images of samples wider
+        /// than a byte much better.
+        FrameCompression_ShuffleLz4,
+        FrameCompressionCount
+    };
+
     struct SampleRateHz
     {
         uint64_t numerator, denominator;
@@ -130,6 +148,78 @@ extern "C"
             uint64_t hardware;
             uint64_t acq_thread;
         } timestamps;
+        // Members are only ever added here, after those above and before
+        // `data`, so drivers and clients built against an older header still
+        // find the ones they know where they expect them.
+        /// Number of frames the camera dropped between the previous frame and
+        /// this one, judging by `hardware_frame_id`. For an averaged frame,
+        /// the total over the frames that went into it.
+        uint64_t hardware_frame_gap;
+        /// Where the stage axis streaming alongside the video was at
+        /// `timestamps.acq_thread`, interpolated between the samples either
+        /// side of it. Only set when `has_stage_position` is.
+        float stage_position;
+        uint32_t has_stage_position;
+        /// A `FrameCompression`. When it isn't `FrameCompression_None`,
+        /// `data` holds `bytes_of_data` bytes that frame_decompress() turns
+        /// back into the samples, starting with a `frame_compression_header`.
+        uint32_t compression;
+        uint32_t bytes_of_data;
+        /// CRC32C of `data` as it was when the frame was made, see
+        /// crc32c_of_frame(), so storage can keep it and readers can tell
+        /// whether the frame survived. Only set when `has_checksum` is.
+        uint32_t checksum;
+        uint32_t has_checksum;
+#pragma warning(suppress : 4200)
+        uint8_t data[];
+    };
+
+/// Bytes of samples compressed on their own, so the blocks of a frame can
+/// be compressed on several threads.
+#define FRAME_COMPRESSION_BLOCK_BYTES (1 << 18)
+
+    /// Starts the data of a compressed frame. Block `i` holds the bytes of
+    /// samples `[i*bytes_per_block,(i+1)*bytes_per_block)`, and takes
+    /// `bytes_of_block[i]` bytes after the blocks before it. The first block
+    /// follows `bytes_of_block`. A block that didn't shrink is stored as it
+    /// is, taking as many bytes as its samples.
+    struct frame_compression_header
+    {
+        uint32_t nblocks;
+        uint32_t bytes_per_block;
+#pragma warning(suppress : 4200)
+        uint32_t bytes_of_block[];
+    };
+
+    /// How a `FrameAnnotation` is joined to a frame of its stream.
+    enum FrameAnnotationJoin
+    {
+        /// To the frame whose `frame_id` is the annotation's.
+        FrameAnnotationJoin_FrameId = 0,
+        /// To the first frame whose `timestamps.acq_thread` is no earlier
+        /// than the annotation's `timestamp`.
+        FrameAnnotationJoin_Timestamp,
+        FrameAnnotationJoinCount
+    };
+
+    /// A small record from the client, stored with the frame it was joined
+    /// to. Records are laid out back to back, each taking
+    /// `bytes_of_annotation` bytes, a multiple of 8.
+    struct FrameAnnotation
+    {
+        uint32_t bytes_of_annotation;
+        uint32_t bytes_of_data;
+        /// The frame the record was joined to. A record pushed after its
+        /// frame was stored is joined to the next frame stored instead.
+        uint64_t frame_id;
+        /// In clock_tic() tics, like `VideoFrame::timestamps.acq_thread`.
+        /// The client's, for records joined by timestamp, otherwise when the
+        /// record was pushed.
+        uint64_t timestamp;
+        /// Chosen by the client, to tell kinds of records apart.
+        uint32_t tag;
+        /// A `FrameAnnotationJoin`.
+        uint32_t join;
 #pragma warning(suppress : 4200)
         uint8_t data[];
     };
@@ -142,9 +232,62 @@ extern "C"
     };
 
     const char* sample_type_as_string(enum SampleType type);
+
+    /// @returns The bytes a sample takes. Packed samples don't fill whole
+    /// bytes, so for them this is the size of the unpacked sample.
     size_t bytes_of_type(enum SampleType type);
+
+    /// @returns The bits a sample takes, packed or not.
+    uint8_t bits_of_type(enum SampleType type);
+
+    /// @returns The bytes of an image of `shape`, with packed samples
+    /// rounded up to a whole byte at the end of the image.
     size_t bytes_of_image(const struct ImageShape* shape);
 
+    /// @returns The type packed samples of `type` unpack to, as
+    /// `SampleType_u12` for `SampleType_u12p`, or `type` itself if it isn't
+    /// packed.
+    enum SampleType sample_type_unpacked(enum SampleType type);
+
+    /// @brief Packs `n` 16-bit samples into `dst` as `type`.
+    /// @details Packed samples are a stream of bits, with sample `i` in bits
+    /// `[i*b,(i+1)*b)` for `b = bits_of_type(type)`, starting from the least
+    /// significant bit of the first byte. Bits above `b` in `src` are
+    /// dropped. `dst` takes `(n*b+7)/8` bytes. Does nothing when `type`
+    /// isn't packed.
+    void pack_samples(uint8_t* dst,
+                      const uint16_t* src,
+                      enum SampleType type,
+                      size_t n);
+
+    /// @brief Unpacks `n` samples of `type` from `src` into 16-bit samples.
+    /// Does nothing when `type` isn't packed.
+    void unpack_samples(uint16_t* dst,
+                        const uint8_t* src,
+                        enum SampleType type,
+                        size_t n);
+
+    /// @brief Compresses `nbytes` of samples of `type`, one block of a
+    /// frame, into `dst`, which holds `nbytes`.
+    /// @details `scratch` holds `nbytes` for the shuffle. Blocks start on a
+    /// whole sample. Safe to call from several threads at once.
+    /// @returns The bytes written to `dst`, or 0 when the block doesn't get
+    /// any smaller.
+    size_t frame_compress_block(enum FrameCompression codec,
+                                enum SampleType type,
+                                uint8_t* dst,
+                                const uint8_t* src,
+                                size_t nbytes,
+                                uint8_t* scratch);
+
+    /// @brief Writes the samples of `frame`, compressed or not, to `dst`,
+    /// which holds `nbytes`.
+    /// @returns 1 on success, or 0 if `dst` is smaller than
+    /// `bytes_of_image(&frame->shape)` or the compressed data is corrupt.
+    int frame_decompress(const struct VideoFrame* frame,
+                         uint8_t* dst,
+                         size_t nbytes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -69,9 +69,8 @@ device_state_as_string(enum DeviceState state)
 #ifndef NO_UNIT_TESTS
 #include "logger.h"
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define ERR(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -21,6 +21,16 @@ extern "C"
         struct PID feedback;
     };
 
+    /// Where a stage axis was at one moment while it was running.
+    struct StageAxisPositionSample
+    {
+        /// When the sample was taken, in the tics of clock_tic(), the clock
+        /// the runtime stamps frames with.
+        uint64_t timestamp;
+        float position;
+        float velocity;
+    };
+
     struct StageAxisPropertyMetadata
     {
         struct Property position;
@@ -6,8 +6,8 @@
 
 #define countof(e) (sizeof(e) / sizeof((e)[0]))
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Device, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Device, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -255,6 +255,123 @@ Error:
     return 0;
 }
 
+int
+storage_properties_set_enable_unbuffered_io(struct StorageProperties* out,
+                                            uint8_t enable)
+{
+    CHECK(out);
+    out->enable_unbuffered_io = enable;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_enable_memory_mapped_io(struct StorageProperties* out,
+                                               uint8_t enable)
+{
+    CHECK(out);
+    out->enable_memory_mapped_io = enable;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_compression(struct StorageProperties* out,
+                                   enum StorageCompression compression)
+{
+    CHECK(out);
+    EXPECT(compression < StorageCompressionCount,
+           "Unknown compression %d.",
+           (int)compression);
+    out->compression = compression;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_rollover(struct StorageProperties* out,
+                                uint64_t max_frames_per_file,
+                                uint64_t max_bytes_per_file)
+{
+    CHECK(out);
+    out->max_frames_per_file = max_frames_per_file;
+    out->max_bytes_per_file = max_bytes_per_file;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_enable_frame_index(struct StorageProperties* out,
+                                          uint8_t enable)
+{
+    CHECK(out);
+    out->enable_frame_index = enable;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_disable_frame_descriptions(
+  struct StorageProperties* out,
+  uint8_t disable)
+{
+    CHECK(out);
+    out->disable_frame_descriptions = disable;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_enable_compact_frame_headers(
+  struct StorageProperties* out,
+  uint8_t enable)
+{
+    CHECK(out);
+    out->enable_compact_frame_headers = enable;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_durability(struct StorageProperties* out,
+                                  enum StorageDurability durability,
+                                  uint32_t interval_ms,
+                                  uint64_t interval_bytes)
+{
+    CHECK(out);
+    CHECK(durability < StorageDurabilityCount);
+    out->durability = durability;
+    out->durability_interval_ms = interval_ms;
+    out->durability_interval_bytes = interval_bytes;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+storage_properties_set_staging(struct StorageProperties* out,
+                               const char* staging_uri,
+                               size_t bytes_of_staging_uri,
+                               uint64_t migration_bytes_per_second)
+{
+    CHECK(out);
+    const struct String s = { .is_ref = 1,
+                              .nbytes = bytes_of_staging_uri,
+                              .str = (char*)staging_uri };
+    CHECK(copy_string(&out->staging_uri, &s));
+    out->migration_bytes_per_second = migration_bytes_per_second;
+    return 1;
+Error:
+    return 0;
+}
+
 int
 storage_properties_init(struct StorageProperties* out,
                         uint32_t first_frame_id,
@@ -290,9 +407,12 @@ int
 storage_properties_copy(struct StorageProperties* dst,
                         const struct StorageProperties* src)
 {
-    // 1. Copy everything except the strings
+    // 1. Copy everything except the strings and dimensions
     {
-        struct String tmp_uri, tmp_meta, tmp_access_key, tmp_secret_key;
+        struct String tmp_uri, tmp_meta, tmp_access_key, tmp_secret_key,
+          tmp_staging;
+        struct storage_properties_dimensions_s tmp_dims =
+          dst->acquisition_dimensions;
         memcpy(&tmp_uri, &dst->uri, sizeof(struct String)); // NOLINT
         memcpy(&tmp_meta,                                   // NOLINT
                &dst->external_metadata_json,
@@ -303,6 +423,9 @@ storage_properties_copy(struct StorageProperties* dst,
         memcpy(&tmp_secret_key,
                &dst->secret_access_key,
                sizeof(struct String)); // NOLINT
+        memcpy(&tmp_staging,
+               &dst->staging_uri,
+               sizeof(struct String)); // NOLINT
 
         memcpy(dst, src, sizeof(*dst));                     // NOLINT
         memcpy(&dst->uri, &tmp_uri, sizeof(struct String)); // NOLINT
@@ -315,6 +438,10 @@ storage_properties_copy(struct StorageProperties* dst,
         memcpy(&dst->secret_access_key,
                &tmp_secret_key,
                sizeof(struct String)); // NOLINT
+        memcpy(&dst->staging_uri,
+               &tmp_staging,
+               sizeof(struct String)); // NOLINT
+        dst->acquisition_dimensions = tmp_dims;
     }
 
     // 2. Reallocate and copy the Strings
@@ -323,11 +450,12 @@ storage_properties_copy(struct StorageProperties* dst,
       copy_string(&dst->external_metadata_json, &src->external_metadata_json));
     CHECK(copy_string(&dst->access_key_id, &src->access_key_id));
     CHECK(copy_string(&dst->secret_access_key, &src->secret_access_key));
+    CHECK(copy_string(&dst->staging_uri, &src->staging_uri));
 
     // 3. Copy the dimensions
-    if (src->acquisition_dimensions.data) {
+    if (dst->acquisition_dimensions.data)
         storage_properties_dimensions_destroy(dst);
-
+    if (src->acquisition_dimensions.data) {
         CHECK(storage_properties_dimensions_init(
           dst, src->acquisition_dimensions.size));
         for (size_t i = 0; i < src->acquisition_dimensions.size; ++i) {
@@ -347,7 +475,8 @@ storage_properties_destroy(struct StorageProperties* self)
     struct String* const strings[] = { &self->uri,
                                        &self->external_metadata_json,
                                        &self->access_key_id,
-                                       &self->secret_access_key };
+                                       &self->secret_access_key,
+                                       &self->staging_uri };
     for (int i = 0; i < countof(strings); ++i) {
         if (strings[i]->is_ref == 0 && strings[i]->str) {
             free(strings[i]->str);
@@ -355,7 +484,8 @@ storage_properties_destroy(struct StorageProperties* self)
         }
     }
 
-    storage_properties_dimensions_destroy(self);
+    if (self->acquisition_dimensions.data)
+        storage_properties_dimensions_destroy(self);
 }
 
 #ifndef NO_UNIT_TESTS
@@ -569,6 +699,33 @@ Error:
     return 0;
 }
 
+int
+unit_test__storage_properties_set_staging()
+{
+    struct StorageProperties props = { 0 }, copy = { 0 };
+    const char staging_uri[] = "/scratch/staging";
+
+    CHECK(storage_properties_set_staging(
+      &props, staging_uri, sizeof(staging_uri), 1 << 20));
+    CHECK(0 == strcmp(props.staging_uri.str, staging_uri));
+    CHECK(0 == props.staging_uri.is_ref);
+    CHECK(props.migration_bytes_per_second == 1 << 20);
+
+    // The copy owns its own string.
+    CHECK(storage_properties_copy(&copy, &props));
+    CHECK(copy.staging_uri.str != props.staging_uri.str);
+    CHECK(0 == strcmp(copy.staging_uri.str, staging_uri));
+    CHECK(copy.migration_bytes_per_second == 1 << 20);
+
+    storage_properties_destroy(&props);
+    storage_properties_destroy(&copy);
+    return 1;
+Error:
+    storage_properties_destroy(&props);
+    storage_properties_destroy(&copy);
+    return 0;
+}
+
 int
 unit_test__dimension_init()
 {
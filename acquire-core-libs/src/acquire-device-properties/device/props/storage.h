@@ -20,6 +20,32 @@ extern "C"
         DimensionTypeCount
     };
 
+    /// Lossless codecs storage devices may compress image data with.
+    enum StorageCompression
+    {
+        StorageCompression_None = 0,
+        StorageCompression_Lzw,
+        StorageCompression_Deflate,
+        StorageCompression_Zstd,
+        StorageCompressionCount
+    };
+
+    /// When storage devices make what they've written survive a power loss,
+    /// rather than leaving it to the operating system to write back.
+    enum StorageDurability
+    {
+        /// Never. Frames may be lost if the machine goes down, even after
+        /// the stream stops.
+        StorageDurability_None = 0,
+        /// Every so often while the stream runs, from a thread of the
+        /// device's own so appends don't wait on the disk, and when each file
+        /// is closed. Frames written since the last sync may be lost.
+        StorageDurability_Periodic,
+        /// When each file is closed.
+        StorageDurability_OnStop,
+        StorageDurabilityCount
+    };
+
     struct StorageDimension
     {
         // the name of the dimension as it appears in the metadata, e.g.,
@@ -39,6 +65,21 @@ extern "C"
         uint32_t shard_size_chunks;
     };
 
+    /// A chunk of the array described by `acquisition_dimensions`, assembled
+    /// from frames by the runtime.
+    struct StorageChunk
+    {
+        /// Where the chunk sits in the grid of chunks, counted in chunks along
+        /// each acquisition dimension, in the same order.
+        const uint32_t* lattice_position;
+
+        /// The chunk's pixels, contiguous, with the first dimension varying
+        /// fastest. Chunks at the edges of the array are padded with zeros to
+        /// a full chunk.
+        const uint8_t* data;
+        size_t bytes_of_data;
+    };
+
     /// Properties for a storage driver.
     struct StorageProperties
     {
@@ -64,6 +105,73 @@ extern "C"
 
         /// Enable multiscale storage if true.
         uint8_t enable_multiscale;
+
+        /// Write around the operating system's file cache if true, so long
+        /// acquisitions don't fill memory with cached pages. Only honored by
+        /// devices that report `unbuffered_io_is_supported`.
+        uint8_t enable_unbuffered_io;
+
+        /// Write by copying frames into a window of the file mapped into
+        /// memory if true. Saves a system call per write, but a write that
+        /// fails, say because the disk is full, crashes the process instead of
+        /// stopping the stream. Takes precedence over `enable_unbuffered_io`.
+        /// Only honored by devices that report `memory_mapped_io_is_supported`.
+        uint8_t enable_memory_mapped_io;
+
+        /// Compress image data with this codec. Only honored by devices that
+        /// set its bit in `StoragePropertyMetadata::supported_compression`.
+        enum StorageCompression compression;
+
+        /// Start a new file, named like `uri` with a number before its
+        /// extension, before a frame that would take the current one past
+        /// `max_frames_per_file` frames or `max_bytes_per_file` bytes. 0 for
+        /// no limit. Only honored by devices that report
+        /// `rollover_is_supported`.
+        uint64_t max_frames_per_file;
+        uint64_t max_bytes_per_file;
+
+        /// Write an index of where each frame is next to each file, so
+        /// readers can seek to a frame without scanning the file. Only honored
+        /// by devices that report `frame_index_is_supported`.
+        uint8_t enable_frame_index;
+
+        /// Leave out the description holding each frame's ids and timestamps
+        /// that is otherwise written with every frame, when readers get them
+        /// from the frame index or don't need them. Only honored by devices
+        /// that report `frame_descriptions_are_optional`.
+        uint8_t disable_frame_descriptions;
+
+        /// A file format option: write each frame with a small fixed header
+        /// holding its ids, timestamps and stage position, instead of its
+        /// whole `VideoFrame` header. The shape is written once, and again
+        /// whenever it changes. Saves disk space on streams of small frames.
+        /// Frames handed to the device, and those read through the monitor,
+        /// still carry the whole header. Only honored by devices that report
+        /// `compact_frame_headers_are_supported`.
+        uint8_t enable_compact_frame_headers;
+
+        /// When what's written is synced to the disk. Only honored by devices
+        /// that report `durability_is_supported`.
+        enum StorageDurability durability;
+
+        /// With `StorageDurability_Periodic`, sync once
+        /// `durability_interval_ms` have passed or `durability_interval_bytes`
+        /// have been written since the last sync, whichever comes first. 0
+        /// for no limit. With both 0, sync every second.
+        uint32_t durability_interval_ms;
+        uint64_t durability_interval_bytes;
+
+        /// Write files to this directory first, and move each one to where
+        /// `uri` says in the background once it's finished, so a stream
+        /// isn't held to the speed of the disk `uri` is on. Empty to write
+        /// to `uri` directly. Only honored by devices that report
+        /// `staging_is_supported`.
+        struct String staging_uri;
+
+        /// Most bytes per second moving files out of `staging_uri` may read
+        /// and write, to leave the disks room for the streams. 0 for no
+        /// limit.
+        uint64_t migration_bytes_per_second;
     };
 
     struct StoragePropertyMetadata
@@ -72,6 +180,37 @@ extern "C"
         uint8_t sharding_is_supported;
         uint8_t multiscale_is_supported;
         uint8_t s3_is_supported;
+        uint8_t unbuffered_io_is_supported;
+        uint8_t memory_mapped_io_is_supported;
+        /// Bit `i` is set when the device can compress with
+        /// `StorageCompression` `i`. Depends on the libraries the device was
+        /// built with.
+        uint32_t supported_compression;
+        uint8_t rollover_is_supported;
+        uint8_t frame_index_is_supported;
+        uint8_t frame_descriptions_are_optional;
+        uint8_t compact_frame_headers_are_supported;
+        uint8_t durability_is_supported;
+        /// The device stores frames compressed by the runtime as they are,
+        /// with the settings last applied to it. See
+        /// `VideoFrame::compression`.
+        uint8_t compressed_frames_are_supported;
+
+        /// Frames the device can write without copying start at, and are
+        /// padded out to, a multiple of this many bytes. 0 when it doesn't
+        /// care. Depends on the settings last applied to the device.
+        uint32_t io_alignment_bytes;
+        /// Size of the appends the device writes most efficiently. 0 when it
+        /// has no preference.
+        uint64_t preferred_append_bytes;
+        /// Appends the device can have in flight at once when it finishes
+        /// them asynchronously. 0 when it has no limit of its own.
+        uint32_t max_appends_in_flight;
+        /// Several threads may append to the device at once, with the
+        /// settings last applied to it.
+        uint8_t concurrent_append_is_supported;
+        /// The device can write to `StorageProperties::staging_uri` first.
+        uint8_t staging_is_supported;
     };
 
     /// Initializes StorageProperties, allocating string storage on the heap
@@ -181,6 +320,95 @@ extern "C"
     int storage_properties_set_enable_multiscale(struct StorageProperties* out,
                                                  uint8_t enable);
 
+    /// @brief Set whether `out` writes around the file cache.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] enable A flag to enable or disable unbuffered writes.
+    int storage_properties_set_enable_unbuffered_io(
+      struct StorageProperties* out,
+      uint8_t enable);
+
+    /// @brief Set whether `out` writes through memory mapped files.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] enable A flag to enable or disable memory mapped writes.
+    int storage_properties_set_enable_memory_mapped_io(
+      struct StorageProperties* out,
+      uint8_t enable);
+
+    /// @brief Set the codec `out` compresses image data with.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] compression The codec, or `StorageCompression_None`.
+    int storage_properties_set_compression(
+      struct StorageProperties* out,
+      enum StorageCompression compression);
+
+    /// @brief Set when `out` starts a new file.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] max_frames_per_file Most frames in a file, or 0 for no
+    ///                                limit.
+    /// @param[in] max_bytes_per_file Most bytes in a file, or 0 for no limit.
+    ///                               A frame bigger than this gets a file of
+    ///                               its own.
+    int storage_properties_set_rollover(struct StorageProperties* out,
+                                        uint64_t max_frames_per_file,
+                                        uint64_t max_bytes_per_file);
+
+    /// @brief Set whether `out` writes an index of frames next to each file.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] enable A flag to enable or disable the index.
+    int storage_properties_set_enable_frame_index(
+      struct StorageProperties* out,
+      uint8_t enable);
+
+    /// @brief Set whether `out` leaves out the description of each frame.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] disable A flag to leave out or write the descriptions.
+    int storage_properties_set_disable_frame_descriptions(
+      struct StorageProperties* out,
+      uint8_t disable);
+
+    /// @brief Set whether `out` writes frames to disk with compact headers.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] enable A flag to enable or disable compact headers.
+    int storage_properties_set_enable_compact_frame_headers(
+      struct StorageProperties* out,
+      uint8_t enable);
+
+    /// @brief Set when what `out` writes is synced to the disk.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] durability When to sync.
+    /// @param[in] interval_ms With `StorageDurability_Periodic`, most
+    ///                        milliseconds between syncs, or 0 for no limit.
+    /// @param[in] interval_bytes With `StorageDurability_Periodic`, most bytes
+    ///                           written between syncs, or 0 for no limit.
+    int storage_properties_set_durability(struct StorageProperties* out,
+                                          enum StorageDurability durability,
+                                          uint32_t interval_ms,
+                                          uint64_t interval_bytes);
+
+    /// @brief Set where `out` writes files before moving them to its uri.
+    /// Copies the string into storage owned by the properties struct.
+    /// @returns 1 on success, otherwise 0
+    /// @param[in, out] out The storage properties to change.
+    /// @param[in] staging_uri Pointer to the beginning of the staging
+    ///                        directory's path.
+    /// @param[in] bytes_of_staging_uri The number of bytes in the path.
+    ///                                 Should include the terminating NULL.
+    /// @param[in] migration_bytes_per_second Most bytes per second moving
+    ///                                       files may take, or 0 for no
+    ///                                       limit.
+    int storage_properties_set_staging(struct StorageProperties* out,
+                                       const char* staging_uri,
+                                       size_t bytes_of_staging_uri,
+                                       uint64_t migration_bytes_per_second);
+
     /// Free allocated string storage.
     void storage_properties_destroy(struct StorageProperties* self);
 
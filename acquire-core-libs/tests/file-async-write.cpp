@@ -0,0 +1,100 @@
+//! @file file-async-write.cpp
+//! Test that writes submitted with file_async_write() all land where they
+//! were asked to, in any order and with more writes than the queue holds.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    const size_t nchunks = 64;
+    const size_t bytes_per_chunk = 1 << 16;
+    std::vector<uint8_t> data(nchunks * bytes_per_chunk);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 7 + (i >> 16));
+
+    remove(filename);
+    try {
+        struct file file;
+        struct file_async async;
+        CHECK(!file_async_init(&async, &file, 0));
+
+        CHECK(file_create(&file, SIZED(filename)));
+        CHECK(file_async_init(&async, &file, 4));
+        // Back to front, so the writes don't land in order.
+        for (size_t i = nchunks; i-- > 0;) {
+            const uint8_t* beg = data.data() + i * bytes_per_chunk;
+            CHECK(file_async_write(
+              &async, i * bytes_per_chunk, beg, beg + bytes_per_chunk));
+            CHECK(file_async_poll(&async) <= 4);
+        }
+        CHECK(file_async_wait(&async));
+        CHECK(file_async_poll(&async) == 0);
+        file_async_destroy(&async);
+        file_close(&file);
+
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> actual(data.size() + 1);
+        in.read((char*)actual.data(), (std::streamsize)actual.size());
+        EXPECT(in.gcount() == (std::streamsize)data.size(),
+               "Expected %d bytes. Got %d.",
+               (int)data.size(),
+               (int)in.gcount());
+        in.close();
+        actual.resize(data.size());
+        CHECK(actual == data);
+
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    remove(filename);
+    return 1;
+}
@@ -0,0 +1,101 @@
+//! @file file-create-unbuffered.cpp
+//! Test that aligned writes to a file created with FileCreate_Unbuffered land
+//! where they were asked to, and that file_truncate() drops the padding after
+//! the last one.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    uint8_t* buf = 0;
+    remove(filename);
+    try {
+        struct file file;
+        CHECK(file_create_with_flags(
+          &file, SIZED(filename), FileCreate_Unbuffered));
+        const size_t alignment = file_alignment_bytes(&file);
+        LOG("Alignment: %d bytes", (int)alignment);
+        CHECK(alignment > 0);
+        CHECK(file_align_up(&file, 0) == 0);
+        CHECK(file_align_up(&file, 1) == alignment);
+        CHECK(file_align_up(&file, alignment) == alignment);
+
+        // An odd size, padded out to the alignment.
+        const size_t nbytes = 3 * alignment + 5;
+        const size_t padded = file_align_up(&file, nbytes);
+        CHECK(buf = (uint8_t*)memory_alloc(padded, AllocatorHint_Default));
+        for (size_t i = 0; i < padded; ++i)
+            buf[i] = (uint8_t)(i < nbytes ? i * 13 : 0);
+        CHECK(file_write(&file, 0, buf, buf + padded));
+        CHECK(file_truncate(&file, nbytes));
+        file_close(&file);
+
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> actual(padded);
+        in.read((char*)actual.data(), (std::streamsize)actual.size());
+        EXPECT(in.gcount() == (std::streamsize)nbytes,
+               "Expected %d bytes. Got %d.",
+               (int)nbytes,
+               (int)in.gcount());
+        in.close();
+        CHECK(0 == memcmp(actual.data(), buf, nbytes));
+
+        memory_free(buf);
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    if (buf)
+        memory_free(buf);
+    remove(filename);
+    return 1;
+}
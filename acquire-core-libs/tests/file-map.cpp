@@ -0,0 +1,112 @@
+//! @file file-map.cpp
+//! Test that writes through file_map_at() land where they were asked to as
+//! the window moves along a growing file, including writes that straddle or
+//! are larger than a window, and that file_map_destroy() cuts the file to
+//! size.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 13 + (i >> 10));
+
+    remove(filename);
+    try {
+        struct file file;
+        struct file_map map;
+        CHECK(file_create(&file, SIZED(filename)));
+        CHECK(file_map_init(&map, &file, 1));
+        CHECK(map.window_bytes == map.granularity);
+        CHECK(0 == map.data);
+
+        // Writes of odd sizes, some bigger than a window.
+        size_t offset = 0;
+        for (size_t i = 0; offset < data.size(); ++i) {
+            size_t n = 1 + (i * 7919) % (3 * map.granularity);
+            if (n > data.size() - offset)
+                n = data.size() - offset;
+            uint8_t* dst = 0;
+            CHECK(dst = file_map_at(&map, offset, n));
+            memcpy(dst, data.data() + offset, n); // NOLINT
+            offset += n;
+        }
+        CHECK(map.size >= data.size());
+        // Going back moves the window too.
+        {
+            uint8_t* dst = 0;
+            CHECK(dst = file_map_at(&map, 1, 1));
+            CHECK(*dst == data[1]);
+        }
+        CHECK(file_map_destroy(&map, data.size()));
+        CHECK(0 == map.data);
+        file_close(&file);
+
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> actual(data.size() + 1);
+        in.read((char*)actual.data(), (std::streamsize)actual.size());
+        EXPECT(in.gcount() == (std::streamsize)data.size(),
+               "Expected %d bytes. Got %d.",
+               (int)data.size(),
+               (int)in.gcount());
+        in.close();
+        CHECK(std::equal(data.begin(), data.end(), actual.begin()));
+
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    remove(filename);
+    return 1;
+}
@@ -0,0 +1,102 @@
+//! @file file-preallocate.cpp
+//! Test that file_preallocate() leaves the size of a file alone, that writes
+//! into the reserved space land where they were asked to, and that
+//! file_truncate() gives the rest of the space back.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+static std::streamsize
+file_size(const char* filename)
+{
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    return in.tellg();
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    std::vector<uint8_t> data(12345);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 13);
+
+    remove(filename);
+    try {
+        struct file file;
+        CHECK(file_create(&file, SIZED(filename)));
+        const int is_reserved = file_preallocate(&file, 0, 1 << 20);
+        LOG("Reserved space: %s", is_reserved ? "yes" : "no");
+        // Reserving past what is already reserved, and inside it.
+        file_preallocate(&file, 1 << 20, 1 << 20);
+        file_preallocate(&file, 100, 1000);
+        CHECK(file_size(filename) == 0);
+
+        CHECK(file_write(&file, 0, data.data(), data.data() + data.size()));
+        CHECK(file_size(filename) == (std::streamsize)data.size());
+        CHECK(file_truncate(&file, data.size()));
+        file_close(&file);
+
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> actual(data.size() + 1);
+        in.read((char*)actual.data(), (std::streamsize)actual.size());
+        EXPECT(in.gcount() == (std::streamsize)data.size(),
+               "Expected %d bytes. Got %d.",
+               (int)data.size(),
+               (int)in.gcount());
+        in.close();
+        CHECK(std::equal(data.begin(), data.end(), actual.begin()));
+
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    remove(filename);
+    return 1;
+}
@@ -0,0 +1,101 @@
+//! @file file-view.cpp
+//! Test that file_view_open() maps all of a file for reading while another
+//! handle writes to it, that file_view_update() follows the file as it grows
+//! and shrinks, and that a file that doesn't exist can't be viewed.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 13 + (i >> 10));
+    const size_t half = data.size() / 2;
+
+    remove(filename);
+    try {
+        struct file file;
+        struct file_view view;
+        CHECK(!file_view_open(&view, SIZED(filename)));
+
+        // The writer keeps the file open throughout.
+        CHECK(file_create(&file, SIZED(filename)));
+        CHECK(file_view_open(&view, SIZED(filename)));
+        CHECK(0 == view.nbytes);
+        CHECK(0 == view.data);
+
+        CHECK(file_write(&file, 0, data.data(), data.data() + half));
+        CHECK(file_view_update(&view));
+        CHECK(view.nbytes == half);
+        CHECK(0 == memcmp(view.data, data.data(), half));
+
+        CHECK(file_write(
+          &file, half, data.data() + half, data.data() + data.size()));
+        CHECK(file_view_update(&view));
+        CHECK(view.nbytes == data.size());
+        file_view_prefetch(&view, 1, data.size());
+        CHECK(0 == memcmp(view.data, data.data(), data.size()));
+
+        CHECK(file_truncate(&file, half));
+        CHECK(file_view_update(&view));
+        CHECK(view.nbytes == half);
+        CHECK(0 == memcmp(view.data, data.data(), half));
+
+        file_view_close(&view);
+        CHECK(0 == view.data);
+        file_close(&file);
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    remove(filename);
+    return 1;
+}
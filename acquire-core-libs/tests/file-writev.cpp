@@ -0,0 +1,100 @@
+//! @file file-writev.cpp
+//! Test that file_writev() writes its pieces back to back, including empty
+//! pieces and more pieces than go to the system at once.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    const char filename[] = TEST ".bin";
+    std::vector<uint8_t> data(1 << 16);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    remove(filename);
+    try {
+        // Pieces of 0 to 9 bytes taken in order from `data`, after a gap
+        // at the start of the file.
+        const uint64_t offset = 100;
+        std::vector<file_iovec> iov;
+        size_t nbytes = 0;
+        for (size_t i = 0; nbytes + 10 < data.size(); ++i) {
+            const uint8_t* beg = data.data() + nbytes;
+            iov.push_back({ beg, beg + i % 10 });
+            nbytes += i % 10;
+        }
+        CHECK(iov.size() > 64);
+
+        struct file file;
+        CHECK(file_create(&file, SIZED(filename)));
+        CHECK(file_writev(&file, offset, iov.data(), iov.size()));
+        CHECK(file_writev(&file, offset, iov.data(), 0));
+        file_close(&file);
+
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> actual(offset + nbytes + 1);
+        in.read((char*)actual.data(), (std::streamsize)actual.size());
+        EXPECT(in.gcount() == (std::streamsize)(offset + nbytes),
+               "Expected %d bytes. Got %d.",
+               (int)(offset + nbytes),
+               (int)in.gcount());
+        in.close();
+        CHECK(std::equal(data.begin(),
+                         data.begin() + (std::ptrdiff_t)nbytes,
+                         actual.begin() + (std::ptrdiff_t)offset));
+
+        remove(filename);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    remove(filename);
+    return 1;
+}
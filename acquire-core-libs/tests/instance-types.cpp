@@ -5,6 +5,7 @@
 #include "device/kit/storage.h"
 #include "device/kit/camera.h"
 
+#include <stddef.h>
 #include <stdio.h>
 
 #define EXPECT(e, ...)                                                         \
@@ -32,8 +33,13 @@ main(int n, char** args)
 
     // If these fail, you may need a version bump on the interface.
     ASSERT_EQ(int, "%d", sizeof(struct Driver), 40);
-    ASSERT_EQ(int, "%d", sizeof(struct Camera), 344);
-    ASSERT_EQ(int, "%d", sizeof(struct Storage), 344);
+    ASSERT_EQ(int, "%d", sizeof(struct Camera), 384);
+    ASSERT_EQ(int, "%d", sizeof(struct Storage), 376);
+
+    // Frames only grow at the end, so the header older builds know about
+    // stays put.
+    ASSERT_EQ(int, "%d", offsetof(struct VideoFrame, timestamps), 80);
+    ASSERT_EQ(int, "%d", sizeof(struct VideoFrame), 128);
 
     return error_code;
 }
@@ -0,0 +1,194 @@
+//! @file logger-async.cpp
+//! Test that messages logged asynchronously from several threads are
+//! reported with the same text they'd have had synchronously, in order for
+//! each thread, and that messages which find the ring full are counted as
+//! dropped.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+static std::vector<std::string> messages;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    messages.emplace_back(msg);
+}
+
+void
+print(int is_error,
+      const char* file,
+      int line,
+      const char* function,
+      const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+#define NTHREADS 4
+#define NMESSAGES 200
+
+static void
+log_many(void* ctx)
+{
+    const int id = (int)(size_t)ctx;
+    for (int i = 0; i < NMESSAGES; ++i)
+        LOG("thread %d message %d", id, i);
+}
+
+static void
+check_formats()
+{
+    const char* name = "name";
+    char local[32] = "a local string";
+    std::vector<std::string> expected;
+    char buf[1024];
+
+#define BOTH(...)                                                              \
+    do {                                                                       \
+        LOG(__VA_ARGS__);                                                      \
+        snprintf(buf, sizeof(buf), __VA_ARGS__);                               \
+        expected.emplace_back(buf);                                            \
+    } while (0)
+
+    BOTH("no arguments, 100%%");
+    BOTH("%d %i %u %x %X %o %c", -1, 2, 3u, 0xab, 0xcd, 8, 'z');
+    BOTH("%hhd %hd %ld %lld %zu %jd %td",
+         (char)-4,
+         (short)-5,
+         -6L,
+         -7LL,
+         (size_t)8,
+         (intmax_t)9,
+         (ptrdiff_t)10);
+    BOTH("%5.2f|%-8.3e|%g|%+d|% d|%#x|%08.3f",
+         3.14159,
+         2.5e9,
+         0.1,
+         1,
+         2,
+         3,
+         1.5);
+    BOTH("[%*d] [%-*d] [%.*s] [%.*f] [%*.*f]",
+         6,
+         42,
+         6,
+         42,
+         3,
+         "abcdef",
+         -1,
+         2.0,
+         8,
+         2,
+         2.0);
+    BOTH("%s and %s and %10s", name, local, "right");
+    BOTH("%p", (void*)&expected);
+    BOTH("%s", (const char*)nullptr);
+    BOTH("%.1Lf can't be deferred", 1.5L);
+#undef BOTH
+    // Strings are copied, so changing them later doesn't change the message.
+    memset(local, 'x', sizeof(local) - 1);
+
+    logger_async_drain();
+    CHECK(messages.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        EXPECT(messages[i] == expected[i],
+               "Expected \"%s\". Got \"%s\".",
+               expected[i].c_str(),
+               messages[i].c_str());
+}
+
+static void
+check_threads()
+{
+    struct thread threads[NTHREADS];
+    for (size_t i = 0; i < NTHREADS; ++i) {
+        thread_init(threads + i);
+        CHECK(thread_create(threads + i, log_many, (void*)i));
+    }
+    for (size_t i = 0; i < NTHREADS; ++i)
+        thread_join(threads + i);
+    CHECK(logger_async_drain() == NTHREADS * NMESSAGES);
+
+    int next[NTHREADS] = { 0 };
+    for (const auto& m : messages) {
+        int id = -1, i = -1;
+        CHECK(sscanf(m.c_str(), "thread %d message %d", &id, &i) == 2);
+        CHECK(id >= 0 && id < NTHREADS);
+        EXPECT(i == next[id]++,
+               "Thread %d's messages are out of order: %s",
+               id,
+               m.c_str());
+    }
+}
+
+static void
+check_drops()
+{
+    const size_t dropped = logger_async_dropped();
+    for (int i = 0; i < 5000; ++i)
+        LOG("message %d", i);
+    const size_t reported = logger_async_drain();
+    CHECK(reported > 0 && reported < 5000);
+    CHECK(logger_async_dropped() - dropped == 5000 - reported);
+    for (size_t i = 0; i < reported; ++i)
+        CHECK(messages[i] == "message " + std::to_string(i));
+}
+
+int
+main()
+{
+    logger_set_reporter(reporter);
+    logger_async_begin();
+    try {
+        check_formats();
+        messages.clear();
+        check_threads();
+        messages.clear();
+        check_drops();
+        messages.clear();
+
+        // Back to synchronous: reported right away.
+        logger_async_end();
+        LOG("now");
+        CHECK(messages.size() == 1 && messages[0] == "now");
+        return 0;
+    } catch (const std::exception& e) {
+        logger_async_end();
+        logger_set_reporter(print);
+        ERR("%s", e.what());
+    } catch (...) {
+        logger_async_end();
+        logger_set_reporter(print);
+        ERR("Unknown exception");
+    }
+    return 1;
+}
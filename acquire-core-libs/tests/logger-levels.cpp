@@ -0,0 +1,104 @@
+//! @file logger-levels.cpp
+//! Test that messages below the minimum level or from disabled modules
+//! aren't reported, and that AQ_LOG() doesn't evaluate the arguments of
+//! messages that are filtered out.
+
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+static std::vector<std::string> messages;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    messages.emplace_back(msg);
+}
+
+static int evaluated = 0;
+
+static int
+touch()
+{
+    return ++evaluated;
+}
+
+static void
+check(size_t nmessages, int nevaluated)
+{
+    EXPECT(messages.size() == nmessages,
+           "Expected %d messages. Got %d.",
+           (int)nmessages,
+           (int)messages.size());
+    EXPECT(evaluated == nevaluated,
+           "Expected arguments to be evaluated %d times. Got %d.",
+           nevaluated,
+           evaluated);
+}
+
+int
+main()
+{
+    logger_set_reporter(reporter);
+    try {
+        // Everything is on by default.
+        AQ_LOG(LogModule_Runtime, 0, "info %d", touch());
+        AQ_LOG(LogModule_Runtime, 1, "error %d", touch());
+        check(2, 2);
+
+        logger_set_min_level(LogLevel_Error);
+        AQ_LOG(LogModule_Runtime, 0, "info %d", touch());
+        aq_logger(0, __FILE__, __LINE__, __FUNCTION__, "info");
+        check(2, 2);
+        AQ_LOG(LogModule_Runtime, 1, "error %d", touch());
+        aq_logger(1, __FILE__, __LINE__, __FUNCTION__, "error");
+        check(4, 3);
+
+        logger_set_min_level(LogLevel_None);
+        AQ_LOG(LogModule_Runtime, 1, "error %d", touch());
+        aq_logger(1, __FILE__, __LINE__, __FUNCTION__, "error");
+        check(4, 3);
+
+        logger_set_min_level(LogLevel_Info);
+        logger_set_modules(LogModule_All & ~LogModule_Runtime);
+        AQ_LOG(LogModule_Runtime, 0, "info %d", touch());
+        AQ_LOG(LogModule_Runtime, 1, "error %d", touch());
+        check(4, 3);
+        AQ_LOG(LogModule_Platform, 0, "info %d", touch());
+        AQ_LOG(LogModule_Driver, 1, "error %d", touch());
+        check(6, 5);
+
+        // Modules don't apply to direct calls.
+        logger_set_modules(0);
+        aq_logger(0, __FILE__, __LINE__, __FUNCTION__, "info");
+        check(7, 5);
+
+        logger_set_modules(LogModule_All);
+        AQ_LOG(LogModule_Device, 0, "info %d", touch());
+        check(8, 6);
+        CHECK(messages.back() == "info 6");
+        return 0;
+    } catch (const std::exception& e) {
+        fprintf(stderr, "ERROR %s\n", e.what());
+    } catch (...) {
+        fprintf(stderr, "ERROR Unknown exception\n");
+    }
+    return 1;
+}
@@ -0,0 +1,159 @@
+//! @file tcp-socket.cpp
+//! Test that tcp_sendv() sends its pieces back to back over a loopback
+//! connection, that it stops without waiting once the connection's buffers
+//! are full, and that tcp_wait_writable() waits until the reader makes room.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <stdexcept>
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Much more than loopback connections buffer.
+static const size_t bytes_sent = 64ULL << 20;
+
+struct receiver
+{
+    struct tcp_socket socket;
+    std::vector<uint8_t> data;
+    int ok;
+};
+
+static void
+receive(void* receiver_)
+{
+    auto* receiver = (struct receiver*)receiver_;
+    uint8_t* beg = receiver->data.data();
+    // Received in pieces that don't line up with the ones sent.
+    const size_t step = 100003;
+    int ok = 1;
+    for (size_t i = 0; ok && i < receiver->data.size(); i += step) {
+        const size_t n = std::min(step, receiver->data.size() - i);
+        ok = tcp_recv(&receiver->socket, beg + i, beg + i + n);
+    }
+    // The sender closes once it's done, so there's nothing more.
+    uint8_t extra = 0;
+    receiver->ok = ok && !tcp_recv(&receiver->socket, &extra, &extra + 1);
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+
+    std::vector<uint8_t> data(bytes_sent);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    // Pieces of 0 to 99999 bytes taken in order from `data`.
+    std::vector<file_iovec> iov;
+    for (size_t i = 0, offset = 0; offset < data.size(); ++i) {
+        const size_t n = std::min((i * 7919) % 100000, data.size() - offset);
+        const uint8_t* beg = data.data() + offset;
+        iov.push_back({ beg, beg + n });
+        offset += n;
+    }
+    CHECK(iov.size() > 64);
+
+    struct tcp_socket listener = {}, sender = {};
+    auto* receiver = new struct receiver();
+    struct thread thread;
+    thread_init(&thread);
+    int is_listening = 0, is_sending = 0, is_receiving = 0, is_running = 0;
+    int retval = 1;
+    try {
+        uint16_t port = 0;
+        CHECK(tcp_listen(&listener, "127.0.0.1", &port));
+        is_listening = 1;
+        CHECK(port != 0);
+        CHECK(tcp_connect(&sender, "127.0.0.1", port));
+        is_sending = 1;
+        CHECK(tcp_accept(&listener, &receiver->socket));
+        is_receiving = 1;
+
+        // Nothing's read yet, so the send stops once the buffers are full,
+        // and there's no room until the reader starts.
+        size_t nbytes = 0;
+        CHECK(tcp_sendv(&sender, iov.data(), iov.size(), &nbytes));
+        EXPECT(nbytes < bytes_sent,
+               "Expected the connection to fill up. Sent %llu bytes.",
+               (unsigned long long)nbytes);
+        CHECK(!tcp_wait_writable(&sender, 50.0f));
+
+        receiver->data.resize(bytes_sent);
+        CHECK(thread_create(&thread, receive, receiver));
+        is_running = 1;
+        size_t total = nbytes, i = 0, skip = nbytes;
+        while (total < bytes_sent) {
+            CHECK(tcp_wait_writable(&sender, 1000.0f));
+            // Skip the pieces already sent, and the start of the one that
+            // was cut off.
+            while (skip >= (size_t)(iov[i].end - iov[i].beg)) {
+                skip -= iov[i].end - iov[i].beg;
+                ++i;
+            }
+            std::vector<file_iovec> rest(iov.begin() + (ptrdiff_t)i,
+                                         iov.end());
+            rest[0].beg += skip;
+            CHECK(tcp_sendv(&sender, rest.data(), rest.size(), &nbytes));
+            total += nbytes;
+            skip += nbytes;
+        }
+        CHECK(total == bytes_sent);
+        tcp_close(&sender);
+        is_sending = 0;
+        thread_join(&thread);
+        is_running = 0;
+
+        CHECK(receiver->ok);
+        CHECK(receiver->data == data);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    if (is_sending)
+        tcp_close(&sender);
+    // The receiver stops once the sender is closed.
+    if (is_running)
+        thread_join(&thread);
+    if (is_receiving)
+        tcp_close(&receiver->socket);
+    if (is_listening)
+        tcp_close(&listener);
+    delete receiver;
+    return retval;
+}
@@ -0,0 +1,140 @@
+//! @file thread-pool.cpp
+//! Test that a thread pool runs every task submitted to it, including more
+//! than its queues hold, that tasks can submit and wait for tasks of their
+//! own, and that stopping runs what was still queued.
+
+#include "platform.h"
+#include "logger.h"
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+struct Job
+{
+    struct thread_pool* pool;
+    std::atomic<uint32_t>* counts;
+    size_t index;
+};
+
+static void
+count(void* ctx)
+{
+    const Job* job = (const Job*)ctx;
+    ++job->counts[job->index];
+}
+
+/// Counts `index` ten times from subtasks, and waits for them.
+static void
+fan_out(void* ctx)
+{
+    const Job* job = (const Job*)ctx;
+    struct latch latch;
+    latch_init(&latch, 10);
+    std::vector<Job> jobs(10, *job);
+    for (auto& j : jobs)
+        thread_pool_submit(job->pool, count, &j, &latch);
+    thread_pool_wait(job->pool, &latch);
+}
+
+static void
+run(unsigned nthreads)
+{
+    struct thread_attributes attributes = {};
+    snprintf(attributes.name, sizeof(attributes.name), "test-pool");
+    struct thread_pool pool;
+    CHECK(thread_pool_start(&pool, nthreads, &attributes));
+
+    // More tasks than every queue holds.
+    const size_t ntasks = 8 * (nthreads + 1) * THREAD_POOL_QUEUE_CAPACITY;
+    std::vector<std::atomic<uint32_t>> counts(ntasks);
+    std::vector<Job> jobs(ntasks);
+    {
+        struct latch latch;
+        latch_init(&latch, ntasks);
+        for (size_t i = 0; i < ntasks; ++i) {
+            jobs[i] = { &pool, counts.data(), i };
+            thread_pool_submit(&pool, count, &jobs[i], &latch);
+        }
+        latch_wait(&latch);
+        CHECK(latch_is_done(&latch));
+        for (size_t i = 0; i < ntasks; ++i)
+            EXPECT(counts[i] == 1,
+                   "Expected task %d to run once. Ran %d times.",
+                   (int)i,
+                   (int)counts[i]);
+    }
+
+    // Nested tasks, more of them than there are threads.
+    {
+        struct latch latch;
+        latch_init(&latch, 0);
+        for (size_t i = 0; i < 4 * (nthreads + 1); ++i) {
+            latch_add(&latch, 1);
+            thread_pool_submit(&pool, fan_out, &jobs[i], &latch);
+        }
+        thread_pool_wait(&pool, &latch);
+        for (size_t i = 0; i < 4 * (nthreads + 1); ++i)
+            CHECK(counts[i] == 11);
+    }
+
+    // Whatever is still queued runs before the workers are joined.
+    for (size_t i = 0; i < 100; ++i)
+        thread_pool_submit(&pool, count, &jobs[i], 0);
+    thread_pool_stop(&pool);
+    for (size_t i = 0; i < 100; ++i)
+        CHECK(counts[i] == (i < 4 * (nthreads + 1) ? 12u : 2u));
+}
+
+int
+main(int argc, char** argv)
+{
+    logger_set_reporter(reporter);
+    try {
+        run(0);
+        run(1);
+        run(4);
+        return 0;
+    } catch (const std::exception& e) {
+        ERR("%s", e.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+    return 1;
+}
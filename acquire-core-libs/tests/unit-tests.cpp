@@ -67,10 +67,17 @@ extern "C"
 {
     // core-platform
     int unit_test__monotonic_clock_increases_monotonically();
+    int unit_test__clock_tic_fast_follows_clock_tic();
+    int unit_test__memory_alloc_large_page_is_usable();
+    int unit_test__memory_alloc_on_node_is_usable();
+    int unit_test__thread_set_current_attributes_names_the_thread();
+    int unit_test__clock_sleep_precise_ms_meets_deadline();
+    int unit_test__atomics_count_across_threads();
     // device-properties
     int unit_test__storage__storage_property_string_check();
     int unit_test__storage__copy_string();
     int unit_test__storage_properties_set_access_key_and_secret();
+    int unit_test__storage_properties_set_staging();
     int unit_test__dimension_init();
     int unit_test__storage_properties_dimensions_init();
     int unit_test__storage_properties_dimensions_destroy();
@@ -79,6 +86,14 @@ extern "C"
     int unit_test__sample_type_as_string__is_defined_for_all();
     int unit_test__dimension_type_as_string__is_defined_for_all();
     int unit_test__bytes_of_type__is_defined_for_all();
+    int unit_test__packed_samples_round_trip();
+    int unit_test__frame_compression_round_trips();
+    // core-image
+    int unit_test__bin2_kernels_match_plain();
+    int unit_test__bin2_averages_blocks();
+    int unit_test__crc32c_kernels_match_plain();
+    int unit_test__convert_kernels_match_plain();
+    int unit_test__convert_rounds_and_clamps();
 }
 
 int
@@ -97,9 +112,16 @@ main()
     const std::vector<testcase> tests{
 #define CASE(e) { .name = #e, .test = (e) }
         CASE(unit_test__monotonic_clock_increases_monotonically),
+        CASE(unit_test__clock_tic_fast_follows_clock_tic),
+        CASE(unit_test__memory_alloc_large_page_is_usable),
+        CASE(unit_test__memory_alloc_on_node_is_usable),
+        CASE(unit_test__thread_set_current_attributes_names_the_thread),
+        CASE(unit_test__clock_sleep_precise_ms_meets_deadline),
+        CASE(unit_test__atomics_count_across_threads),
         CASE(unit_test__storage__storage_property_string_check),
         CASE(unit_test__storage__copy_string),
         CASE(unit_test__storage_properties_set_access_key_and_secret),
+        CASE(unit_test__storage_properties_set_staging),
         CASE(unit_test__dimension_init),
         CASE(unit_test__storage_properties_dimensions_init),
         CASE(unit_test__storage_properties_dimensions_destroy),
@@ -108,6 +130,13 @@ main()
         CASE(unit_test__sample_type_as_string__is_defined_for_all),
         CASE(unit_test__dimension_type_as_string__is_defined_for_all),
         CASE(unit_test__bytes_of_type__is_defined_for_all),
+        CASE(unit_test__packed_samples_round_trip),
+        CASE(unit_test__frame_compression_round_trips),
+        CASE(unit_test__bin2_kernels_match_plain),
+        CASE(unit_test__bin2_averages_blocks),
+        CASE(unit_test__crc32c_kernels_match_plain),
+        CASE(unit_test__convert_kernels_match_plain),
+        CASE(unit_test__convert_rounds_and_clamps),
 #undef CASE
     };
 
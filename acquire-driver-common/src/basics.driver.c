@@ -1,10 +1,13 @@
 #include "device/kit/driver.h"
 #include "device/kit/camera.h"
 #include "device/kit/storage.h"
+#include "device/kit/experimental/stage.axis.h"
 #include "identifiers.h"
 #include "logger.h"
 
+#include "simcams/playback.camera.h"
 #include "simcams/simulated.camera.h"
+#include "simcams/simulated.stage.h"
 #include "storage/basic.storage.h"
 
 #include <stdlib.h>
@@ -12,9 +15,8 @@
 
 #define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
 
-#define L aq_logger
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -27,6 +29,8 @@
 struct BasicsDriver
 {
     struct Driver driver;
+    /// Shared by the simulated cameras. See SIMCAM_SYNC_CAMERAS_ENV.
+    struct simcam_bus* bus;
 };
 
 const char*
@@ -38,10 +42,14 @@ basic_device_kind_to_string(enum BasicDeviceKind kind)
         CASE(BasicDevice_Camera_Random);
         CASE(BasicDevice_Camera_Sin);
         CASE(BasicDevice_Camera_Empty);
+        CASE(BasicDevice_Camera_Playback);
         CASE(BasicDevice_Storage_Raw);
         CASE(BasicDevice_Storage_Tiff);
         CASE(BasicDevice_Storage_Trash);
         CASE(BasicDevice_Storage_SideBySideTiffJson);
+        CASE(BasicDevice_Storage_Tcp);
+        CASE(BasicDevice_Storage_StagedTiff);
+        CASE(BasicDevice_StageAxis_Simulated);
         CASE(BasicDeviceKindCount);
 #undef CASE
         default:
@@ -86,10 +94,14 @@ basic_device_describe(const struct Driver* driver,
         XXX(Camera,Random,"simulated: uniform random"),
         XXX(Camera,Sin,"simulated: radial sin"),
         XXX(Camera,Empty,"simulated: empty"),
+        XXX(Camera,Playback,"simulated: playback"),
         XXX(Storage,Raw,"raw"),
         XXX(Storage,Tiff,"tiff"),
         XXX(Storage,Trash,"trash"),
         XXX(Storage,SideBySideTiffJson,"tiff-json"),
+        XXX(Storage,Tcp,"tcp"),
+        XXX(Storage,StagedTiff,"tiff-staged"),
+        XXX(StageAxis,Simulated,"simulated: stage"),
     };
     // clang-format on
 #undef XXX
@@ -112,19 +124,35 @@ basic_device_open(struct Driver* driver,
         case BasicDevice_Camera_Sin:
         case BasicDevice_Camera_Empty: {
             struct Camera* camera = 0;
-            CHECK(camera = simcam_make_camera(device_id));
+            CHECK(camera = simcam_make_camera(
+                    device_id,
+                    containerof(driver, struct BasicsDriver, driver)->bus));
+            *out = &camera->device;
+            break;
+        }
+        case BasicDevice_Camera_Playback: {
+            struct Camera* camera = 0;
+            CHECK(camera = playback_make_camera());
             *out = &camera->device;
             break;
         }
         case BasicDevice_Storage_Raw:
         case BasicDevice_Storage_Tiff:
         case BasicDevice_Storage_Trash:
-        case BasicDevice_Storage_SideBySideTiffJson: {
+        case BasicDevice_Storage_SideBySideTiffJson:
+        case BasicDevice_Storage_Tcp:
+        case BasicDevice_Storage_StagedTiff: {
             struct Storage* storage = 0;
             CHECK(storage = basics_make_storage(device_id));
             *out = &storage->device;
             break;
         }
+        case BasicDevice_StageAxis_Simulated: {
+            struct StageAxis* axis = 0;
+            CHECK(axis = simstage_make_stage_axis());
+            *out = &axis->device;
+            break;
+        }
         default:
             LOGE("Invalid parameter `device_id`. Got: %d", device_id);
             goto Error;
@@ -145,14 +173,24 @@ basic_device_close(struct Driver* driver, struct Device* in)
             struct Camera* camera = containerof(in, struct Camera, device);
             return simcam_close_camera(camera);
         }
+        case BasicDevice_Camera_Playback: {
+            struct Camera* camera = containerof(in, struct Camera, device);
+            return playback_close_camera(camera);
+        }
         case BasicDevice_Storage_Raw:
         case BasicDevice_Storage_Tiff:
         case BasicDevice_Storage_Trash:
-        case BasicDevice_Storage_SideBySideTiffJson: {
+        case BasicDevice_Storage_SideBySideTiffJson:
+        case BasicDevice_Storage_Tcp:
+        case BasicDevice_Storage_StagedTiff: {
             struct Storage* writer = containerof(in, struct Storage, device);
             writer->destroy(writer);
             return Device_Ok;
         }
+        case BasicDevice_StageAxis_Simulated: {
+            struct StageAxis* axis = containerof(in, struct StageAxis, device);
+            return simstage_close_stage_axis(axis);
+        }
         default: {
             char buf[128] = { 0 };
             device_identifier_as_debug_string(
@@ -170,11 +208,19 @@ basic_device_shutdown_driver(struct Driver* driver)
 {
     if (driver) {
         basics_storage_shutdown(driver);
+        simcam_bus_destroy(
+          containerof(driver, struct BasicsDriver, driver)->bus);
         free(driver);
     }
     return Device_Ok;
 }
 
+acquire_export uint32_t
+acquire_driver_kit_version_v0()
+{
+    return ACQUIRE_DEVICE_KIT_VERSION;
+}
+
 acquire_export struct Driver*
 acquire_driver_init_v0(void (*reporter)(int is_error,
                                         const char* file,
@@ -192,6 +238,10 @@ acquire_driver_init_v0(void (*reporter)(int is_error,
                     .close = basic_device_close,
                     .shutdown = basic_device_shutdown_driver },
     };
+    if (!(self->bus = simcam_bus_create())) {
+        free(self);
+        goto Error;
+    }
 
     return &self->driver;
 Error:
@@ -11,10 +11,14 @@ extern "C"
         BasicDevice_Camera_Random,
         BasicDevice_Camera_Sin,
         BasicDevice_Camera_Empty,
+        BasicDevice_Camera_Playback,
         BasicDevice_Storage_Raw,
         BasicDevice_Storage_Tiff,
         BasicDevice_Storage_Trash,
         BasicDevice_Storage_SideBySideTiffJson,
+        BasicDevice_Storage_Tcp,
+        BasicDevice_Storage_StagedTiff,
+        BasicDevice_StageAxis_Simulated,
         BasicDeviceKindCount
     };
 
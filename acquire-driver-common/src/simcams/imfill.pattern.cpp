@@ -1,7 +1,11 @@
 #include "device/props/components.h"
 #include "platform.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <iterator>
+#include <thread>
 
 namespace {
 /// This is used for animating the parameter in im_fill_pattern.
@@ -31,72 +35,152 @@ get_animation_time_sec()
     return t;
 }
 
+/// The pattern's phase is looked up in a table with this many entries per
+/// turn.
+constexpr uint32_t lut_size = 1 << 12;
+constexpr double pi = 3.14159265358979323846;
+
+/// `127 * (sin(2 pi k / lut_size) + 1)`, the pattern's value at each phase.
+const float*
+sine_lut()
+{
+    static const std::array<float, lut_size> lut = [] {
+        std::array<float, lut_size> out{};
+        for (uint32_t k = 0; k < lut_size; ++k)
+            out[k] = (float)(127.0 * (sin(2.0 * pi * k / lut_size) + 1.0));
+        return out;
+    }();
+    return lut.data();
+}
+
+/// Rows `[beg,end)` of a pattern.
+template<typename T>
+struct pattern_rows
+{
+    const struct ImageShape* shape;
+    float cx, cy, t;
+    T* buf;
+    uint32_t beg, end;
+};
+
+/// Fills rows of `127 * (sin(6.28 * (10 t + r^2 / 100)) + 1)`, where `r` is
+/// the distance from the center.
+template<typename T>
+void
+fill_pattern_rows(void* ctx)
+{
+    const auto* rows = (const pattern_rows<T>*)ctx;
+    const float* const lut = sine_lut();
+    // Table entries per unit of phase.
+    const float scale = (float)(6.28 / (2.0 * pi) * lut_size);
+    const int64_t sw = rows->shape->strides.width;
+    const int64_t sh = rows->shape->strides.height;
+    const uint32_t w = rows->shape->dims.width;
+    for (uint32_t y = rows->beg; y < rows->end; ++y) {
+        const float dy = y - rows->cy;
+        // Only the x term changes along a row.
+        const float base = rows->t * 10.0f + dy * dy * 1e-2f;
+        T* const row = rows->buf + sh * y;
+        for (uint32_t x = 0; x < w; ++x) {
+            const float dx = x - rows->cx;
+            const float phase = base + dx * dx * 1e-2f;
+            const uint32_t k =
+              (uint32_t)(int64_t)(phase * scale) & (lut_size - 1);
+            row[sw * x] = (T)lut[k];
+        }
+    }
+}
+
 template<typename T>
 void
 im_fill_pattern(const struct ImageShape* const shape,
                 float ox,
                 float oy,
-                T* buf)
+                T* buf,
+                struct thread_pool* pool)
 {
-    float t = get_animation_time_sec();
-
+    const float t = get_animation_time_sec();
     const float cx = ox + 0.5f * (float)shape->dims.width;
     const float cy = oy + 0.5f * (float)shape->dims.height;
-    for (uint32_t y = 0; y < shape->dims.height; ++y) {
-        const float dy = y - cy;
-        const float dy2 = dy * dy;
-        for (uint32_t x = 0; x < shape->dims.width; ++x) {
-            const size_t o = (size_t)shape->strides.width * x +
-                             (size_t)shape->strides.height * y;
-            const float dx = x - cx;
-            const float dx2 = dx * dx;
-            buf[o] =
-              (T)(127.0f *
-                  (sinf(6.28f * (t * 10.0f + (dx2 + dy2) * 1e-2f)) + 1.0f));
-        }
+    const uint32_t h = shape->dims.height;
+
+    // A few blocks of rows per thread, so they even out.
+    pattern_rows<T> blocks[64];
+    uint32_t nblocks =
+      (pool && pool->nworkers) ? 4 * (pool->nworkers + 1) : 1;
+    nblocks = std::min({ nblocks, (uint32_t)std::size(blocks), h });
+    if (nblocks <= 1) {
+        pattern_rows<T> all = { shape, cx, cy, t, buf, 0, h };
+        fill_pattern_rows<T>(&all);
+        return;
     }
+
+    struct latch latch;
+    latch_init(&latch, nblocks);
+    for (uint32_t i = 0; i < nblocks; ++i) {
+        blocks[i] = { shape,
+                      cx,
+                      cy,
+                      t,
+                      buf,
+                      (uint32_t)((uint64_t)h * i / nblocks),
+                      (uint32_t)((uint64_t)h * (i + 1) / nblocks) };
+        thread_pool_submit(pool, fill_pattern_rows<T>, blocks + i, &latch);
+    }
+    thread_pool_wait(pool, &latch);
 }
 } // end namespace ::{anonymous}
 
 extern "C"
 {
+    unsigned im_fill_pattern_thread_count()
+    {
+        const unsigned n = std::thread::hardware_concurrency();
+        return std::min(n > 1 ? n - 1 : 0, 7u);
+    }
+
     void im_fill_pattern_u8(const struct ImageShape* shape,
                             float ox,
                             float oy,
-                            uint8_t* buf)
+                            uint8_t* buf,
+                            struct thread_pool* pool)
     {
-        im_fill_pattern<uint8_t>(shape, ox, oy, buf);
+        im_fill_pattern<uint8_t>(shape, ox, oy, buf, pool);
     }
 
     void im_fill_pattern_i8(const struct ImageShape* shape,
                             float ox,
                             float oy,
-                            int8_t* buf)
+                            int8_t* buf,
+                            struct thread_pool* pool)
     {
-        im_fill_pattern<int8_t>(shape, ox, oy, buf);
+        im_fill_pattern<int8_t>(shape, ox, oy, buf, pool);
     }
 
     void im_fill_pattern_u16(const struct ImageShape* shape,
                              float ox,
                              float oy,
-                             uint16_t* buf)
+                             uint16_t* buf,
+                             struct thread_pool* pool)
     {
-        im_fill_pattern<uint16_t>(shape, ox, oy, buf);
+        im_fill_pattern<uint16_t>(shape, ox, oy, buf, pool);
     }
 
     void im_fill_pattern_i16(const struct ImageShape* shape,
                              float ox,
                              float oy,
-                             int16_t* buf)
+                             int16_t* buf,
+                             struct thread_pool* pool)
     {
-        im_fill_pattern<int16_t>(shape, ox, oy, buf);
+        im_fill_pattern<int16_t>(shape, ox, oy, buf, pool);
     }
 
     void im_fill_pattern_f32(const struct ImageShape* shape,
                              float ox,
                              float oy,
-                             float* buf)
+                             float* buf,
+                             struct thread_pool* pool)
     {
-        im_fill_pattern<float>(shape, ox, oy, buf);
+        im_fill_pattern<float>(shape, ox, oy, buf, pool);
     }
 };
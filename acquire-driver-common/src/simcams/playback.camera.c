@@ -0,0 +1,808 @@
+#include "playback.camera.h"
+
+#include "device/kit/camera.h"
+#include "device/props/camera.h"
+#include "device/props/components.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Frames are asked for from disk this many at a time, a window ahead of the
+/// frame being replayed.
+#define PLAYBACK_READAHEAD (16)
+
+/// The most frames reported ready at once, so the runtime can take them as
+/// one batch.
+#define PLAYBACK_MAX_READY (64)
+
+/// Longest a paced frame waits before checking whether the camera stopped.
+#define PLAYBACK_SLEEP_MS (10.0)
+
+enum playback_format
+{
+    Playback_None,
+    Playback_Raw,
+    Playback_Tiff,
+};
+
+/// Where the pixels of a TIFF page start and when the page was recorded.
+struct tiff_page
+{
+    uint64_t offset;
+    uint64_t timestamp;
+};
+
+struct PlaybackCamera
+{
+    struct CameraProperties properties;
+    struct ImageShape shape;
+
+    enum playback_format format;
+    int is_paced;
+
+    struct raw_reader raw;
+    struct
+    {
+        struct file_view view;
+        struct tiff_page* pages;
+        size_t npages, capacity;
+    } tiff;
+
+    /// Timestamp of the first frame in the file. When it has none, paced
+    /// frames are `exposure_time_us` apart instead.
+    uint64_t first_timestamp;
+
+    struct
+    {
+        int is_running;
+        /// Index in the file of the frame replayed next.
+        size_t next;
+        /// Frames handed out since the camera started.
+        uint64_t frame_id;
+        /// Started when the first frame of the current pass was due.
+        struct clock pace;
+    } stream;
+
+    struct Camera camera;
+};
+
+static void
+compute_strides(struct ImageShape* shape)
+{
+    uint32_t* dims = (uint32_t*)&shape->dims;
+    int64_t* st = (int64_t*)&shape->strides;
+    st[0] = 1;
+    for (int i = 1; i < 4; ++i)
+        st[i] = st[i - 1] * dims[i - 1];
+}
+
+static uint64_t
+frame_timestamp(const struct VideoFrame* frame)
+{
+    return frame->timestamps.hardware ? frame->timestamps.hardware
+                                      : frame->timestamps.acq_thread;
+}
+
+//
+//  TIFF
+//
+
+/// Loads the little-endian integer of `nbytes` at `p`.
+static uint64_t
+load_le(const uint8_t* p, size_t nbytes)
+{
+    uint64_t v = 0;
+    for (size_t i = nbytes; i-- > 0;)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+struct tiff_tag
+{
+    uint64_t count;
+    size_t bytes_of_value;
+    const uint8_t* values;
+};
+
+static size_t
+bytes_of_tiff_type(uint16_t type)
+{
+    switch (type) {
+        case 1: // byte
+        case 2: // ascii
+        case 6: // signed byte
+        case 7: // undefined
+            return 1;
+        case 3: // short
+        case 8: // signed short
+            return 2;
+        case 4:  // long
+        case 9:  // signed long
+        case 13: // ifd
+            return 4;
+        case 16: // long8
+        case 17: // signed long8
+        case 18: // ifd8
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/// Finds the values of the tag `entry`, which are in the entry when they fit
+/// and elsewhere in the file otherwise.
+static int
+read_tiff_tag(const struct file_view* view,
+              int is_big,
+              const uint8_t* entry,
+              struct tiff_tag* tag)
+{
+    const size_t bytes_of_inline = is_big ? 8 : 4;
+    const size_t nbytes = bytes_of_tiff_type((uint16_t)load_le(entry + 2, 2));
+    tag->count = load_le(entry + 4, is_big ? 8 : 4);
+    tag->bytes_of_value = nbytes;
+    tag->values = entry + (is_big ? 12 : 8);
+    if (!nbytes || !tag->count || tag->count > view->nbytes / nbytes)
+        return 0;
+    if (tag->count * nbytes > bytes_of_inline) {
+        const uint64_t offset = load_le(tag->values, bytes_of_inline);
+        if (offset > view->nbytes ||
+            tag->count * nbytes > view->nbytes - offset)
+            return 0;
+        tag->values = view->data + offset;
+    }
+    return 1;
+}
+
+static uint64_t
+tiff_tag_value(const struct tiff_tag* tag, uint64_t i)
+{
+    return load_le(tag->values + i * tag->bytes_of_value, tag->bytes_of_value);
+}
+
+/// @returns The hardware timestamp the TIFF writer puts in each page's
+/// description, or the runtime's when there's no hardware one. 0 if there's
+/// neither.
+static uint64_t
+description_timestamp(const struct tiff_tag* tag)
+{
+    char buf[256] = { 0 };
+    const size_t n = tag->count < sizeof(buf) ? tag->count : sizeof(buf) - 1;
+    memcpy(buf, tag->values, n); // NOLINT
+    static const char* const keys[] = { "\"hardware\":", "\"runtime\":" };
+    for (size_t i = 0; i < countof(keys); ++i) {
+        const char* p = strstr(buf, keys[i]);
+        const uint64_t v = p ? strtoull(p + strlen(keys[i]), 0, 10) : 0;
+        if (v)
+            return v;
+    }
+    return 0;
+}
+
+static enum SampleType
+tiff_sample_type(uint64_t bits, uint64_t format)
+{
+    // clang-format off
+    switch ((bits << 8) | format) {
+        case (8 << 8) | 1: return SampleType_u8;
+        case (8 << 8) | 2: return SampleType_i8;
+        case (16 << 8) | 1: return SampleType_u16;
+        case (16 << 8) | 2: return SampleType_i16;
+        case (32 << 8) | 1: return SampleType_u32;
+        case (32 << 8) | 3: return SampleType_f32;
+        default: return SampleType_Unknown;
+    }
+    // clang-format on
+}
+
+/// Reads the ifd at `offset`, the page's pixels and shape, and where the
+/// next ifd is.
+/// @returns 0 on error, otherwise 1. `is_reduced` is set for the reduced
+/// resolution pages that aren't frames, for which only `next` is read.
+static int
+read_tiff_ifd(const struct file_view* view,
+              int is_big,
+              uint64_t offset,
+              struct tiff_page* page,
+              struct ImageShape* shape,
+              int* is_reduced,
+              uint64_t* next)
+{
+    const size_t bytes_of_count = is_big ? 8 : 2;
+    const size_t bytes_of_entry = is_big ? 20 : 12;
+    const size_t bytes_of_next = is_big ? 8 : 4;
+    EXPECT(offset < view->nbytes &&
+             view->nbytes - offset >= bytes_of_count + bytes_of_next,
+           "TIFF: The ifd at %llu is past the end of the file.",
+           (unsigned long long)offset);
+    const uint8_t* const ifd = view->data + offset;
+    const uint64_t ntags = load_le(ifd, bytes_of_count);
+    EXPECT(ntags <= (view->nbytes - offset - bytes_of_count - bytes_of_next) /
+                      bytes_of_entry,
+           "TIFF: The ifd at %llu is cut short.",
+           (unsigned long long)offset);
+
+    uint64_t subfile_type = 0, width = 0, height = 0, bits = 0;
+    uint64_t compression = 1, samples_per_pixel = 1, sample_format = 1;
+    int has_tiles = 0;
+    struct tiff_tag offsets = { 0 }, counts = { 0 };
+    page->timestamp = 0;
+    for (uint64_t i = 0; i < ntags; ++i) {
+        const uint8_t* const entry = ifd + bytes_of_count + i * bytes_of_entry;
+        const uint16_t id = (uint16_t)load_le(entry, 2);
+        if (id == 322) // tile width
+            has_tiles = 1;
+        if (id != 254 && id != 256 && id != 257 && id != 258 && id != 259 &&
+            id != 270 && id != 273 && id != 277 && id != 279 && id != 339)
+            continue;
+        struct tiff_tag tag = { 0 };
+        EXPECT(read_tiff_tag(view, is_big, entry, &tag),
+               "TIFF: Bad tag %d in the ifd at %llu.",
+               (int)id,
+               (unsigned long long)offset);
+        // clang-format off
+        switch (id) {
+            case 254: subfile_type = tiff_tag_value(&tag, 0); break;
+            case 256: width = tiff_tag_value(&tag, 0); break;
+            case 257: height = tiff_tag_value(&tag, 0); break;
+            case 258: bits = tiff_tag_value(&tag, 0); break;
+            case 259: compression = tiff_tag_value(&tag, 0); break;
+            case 270: page->timestamp = description_timestamp(&tag); break;
+            case 273: offsets = tag; break;
+            case 277: samples_per_pixel = tiff_tag_value(&tag, 0); break;
+            case 279: counts = tag; break;
+            case 339: sample_format = tiff_tag_value(&tag, 0); break;
+            default: break;
+        }
+        // clang-format on
+    }
+    *next = load_le(ifd + bytes_of_count + ntags * bytes_of_entry,
+                    bytes_of_next);
+    *is_reduced = subfile_type & 1;
+    if (*is_reduced)
+        return 1;
+
+    EXPECT(compression == 1 && !has_tiles,
+           "TIFF: Only uncompressed, stripped pages can be replayed. The one "
+           "at %llu isn't.",
+           (unsigned long long)offset);
+    EXPECT(samples_per_pixel == 1,
+           "TIFF: Expected one sample per pixel. Got %llu.",
+           (unsigned long long)samples_per_pixel);
+    const enum SampleType type = tiff_sample_type(bits, sample_format);
+    EXPECT(type != SampleType_Unknown,
+           "TIFF: Unsupported sample type: %llu bits, format %llu.",
+           (unsigned long long)bits,
+           (unsigned long long)sample_format);
+    EXPECT(width && width <= UINT32_MAX && height && height <= UINT32_MAX,
+           "TIFF: Bad page shape %llux%llu.",
+           (unsigned long long)width,
+           (unsigned long long)height);
+    *shape = (struct ImageShape){
+        .dims = { .channels = 1,
+                  .width = (uint32_t)width,
+                  .height = (uint32_t)height,
+                  .planes = 1 },
+        .type = type,
+    };
+    compute_strides(shape);
+
+    // The pixels are replayed straight from the file, so the strips must
+    // follow one another.
+    EXPECT(offsets.count && offsets.count == counts.count,
+           "TIFF: Bad strips in the ifd at %llu.",
+           (unsigned long long)offset);
+    page->offset = tiff_tag_value(&offsets, 0);
+    uint64_t end = page->offset;
+    for (uint64_t i = 0; i < offsets.count; ++i) {
+        EXPECT(tiff_tag_value(&offsets, i) == end,
+               "TIFF: The strips in the ifd at %llu aren't contiguous.",
+               (unsigned long long)offset);
+        const uint64_t n = tiff_tag_value(&counts, i);
+        EXPECT(end <= view->nbytes && n <= view->nbytes - end,
+               "TIFF: The strips in the ifd at %llu are past the end of the "
+               "file.",
+               (unsigned long long)offset);
+        end += n;
+    }
+    EXPECT(end - page->offset == bytes_of_image(shape),
+           "TIFF: Expected %llu bytes of pixels in the ifd at %llu. Got %llu.",
+           (unsigned long long)bytes_of_image(shape),
+           (unsigned long long)offset,
+           (unsigned long long)(end - page->offset));
+    return 1;
+Error:
+    return 0;
+}
+
+/// @returns 1 if the start of `view` looks like a little-endian TIFF or
+/// BigTIFF header, otherwise 0.
+/// @details A raw file starts with the size of its first frame, whose high
+/// bytes are 0, where a TIFF header has the offset of the first ifd, or 8.
+static int
+is_tiff(const struct file_view* view)
+{
+    const uint8_t* d = view->data;
+    return view->nbytes >= 16 && d[0] == 'I' && d[1] == 'I' &&
+           (d[2] == 42 || d[2] == 43) && d[3] == 0 && load_le(d + 4, 4);
+}
+
+static int
+open_tiff(struct PlaybackCamera* self, const char* path)
+{
+    const struct file_view* view = &self->tiff.view;
+    const int is_big = view->data[2] == 43;
+    uint64_t offset = is_big ? load_le(view->data + 8, 8)
+                             : load_le(view->data + 4, 4);
+    uint64_t last = 0;
+    while (offset) {
+        // Pages are written one after the other, which also keeps a bad
+        // file from looping.
+        EXPECT(offset > last,
+               "TIFF: The ifd at %llu comes before the one at %llu.",
+               (unsigned long long)offset,
+               (unsigned long long)last);
+        last = offset;
+
+        struct tiff_page page = { 0 };
+        struct ImageShape shape = { 0 };
+        int is_reduced = 0;
+        CHECK(read_tiff_ifd(
+          view, is_big, offset, &page, &shape, &is_reduced, &offset));
+        if (is_reduced)
+            continue;
+        if (!self->tiff.npages)
+            self->shape = shape;
+        EXPECT(shape.type == self->shape.type &&
+                 shape.dims.width == self->shape.dims.width &&
+                 shape.dims.height == self->shape.dims.height,
+               "Playback: Every page of \"%s\" must have the shape of the "
+               "first.",
+               path);
+
+        if (self->tiff.npages == self->tiff.capacity) {
+            const size_t capacity =
+              self->tiff.capacity ? 2 * self->tiff.capacity : 64;
+            struct tiff_page* pages =
+              realloc(self->tiff.pages, capacity * sizeof(*pages));
+            CHECK(pages);
+            self->tiff.pages = pages;
+            self->tiff.capacity = capacity;
+        }
+        self->tiff.pages[self->tiff.npages++] = page;
+    }
+    EXPECT(self->tiff.npages, "Playback: \"%s\" holds no frames.", path);
+    self->first_timestamp = self->tiff.pages[0].timestamp;
+    return 1;
+Error:
+    return 0;
+}
+
+//
+//  FRAMES
+//
+
+static size_t
+frame_count(const struct PlaybackCamera* self)
+{
+    switch (self->format) {
+        case Playback_Raw:
+            return raw_reader_frame_count(&self->raw);
+        case Playback_Tiff:
+            return self->tiff.npages;
+        default:
+            return 0;
+    }
+}
+
+/// @returns The pixels of the `i`th frame in the file, or NULL if it doesn't
+/// have the shape of the first. Frames written compressed are returned
+/// whole in `compressed` instead, which is otherwise set to NULL.
+static const uint8_t*
+frame_at(const struct PlaybackCamera* self,
+         size_t i,
+         uint64_t* timestamp,
+         const struct VideoFrame** compressed)
+{
+    *compressed = 0;
+    switch (self->format) {
+        case Playback_Raw: {
+            struct VideoFrame frame = { 0 };
+            const uint8_t* data = 0;
+            if (!raw_reader_frame_header(&self->raw, i, &frame, &data) ||
+                bytes_of_image(&frame.shape) != bytes_of_image(&self->shape))
+                return 0;
+            *timestamp = frame_timestamp(&frame);
+            // Only files with full headers hold compressed frames.
+            if (frame.compression != FrameCompression_None)
+                *compressed = raw_reader_frame(&self->raw, i);
+            return data;
+        }
+        case Playback_Tiff:
+            if (i >= self->tiff.npages)
+                return 0;
+            *timestamp = self->tiff.pages[i].timestamp;
+            return self->tiff.view.data + self->tiff.pages[i].offset;
+        default:
+            return 0;
+    }
+}
+
+/// Asks for frames `beg` up to but not including `end` to be read in.
+static void
+prefetch(const struct PlaybackCamera* self, size_t beg, size_t end)
+{
+    const size_t n = frame_count(self);
+    end = end < n ? end : n;
+    switch (self->format) {
+        case Playback_Raw:
+            raw_reader_prefetch(&self->raw, beg, end);
+            break;
+        case Playback_Tiff:
+            for (size_t i = beg; i < end; ++i)
+                file_view_prefetch(&self->tiff.view,
+                                   self->tiff.pages[i].offset,
+                                   bytes_of_image(&self->shape));
+            break;
+        default:
+            break;
+    }
+}
+
+/// @returns How long after the first frame of a pass the `i`th frame, taken
+/// at `timestamp`, is due, in ms.
+static double
+due_ms(const struct PlaybackCamera* self, size_t i, uint64_t timestamp)
+{
+    if (!self->first_timestamp)
+        return (double)i * self->properties.exposure_time_us * 1e-3;
+    if (timestamp < self->first_timestamp)
+        return 0;
+    return (double)clock_tics_to_ns(
+             (int64_t)(timestamp - self->first_timestamp)) *
+           1e-6;
+}
+
+/// Sleeps until `ms` after the start of the pass.
+/// @returns 0 if the camera was stopped first, otherwise 1.
+static int
+wait_until(struct PlaybackCamera* self, double ms)
+{
+    while (self->stream.is_running) {
+        const double remaining = ms - clock_toc_ms(&self->stream.pace);
+        if (remaining <= 0)
+            return 1;
+        clock_sleep_ms(0,
+                       remaining < PLAYBACK_SLEEP_MS ? remaining
+                                                     : PLAYBACK_SLEEP_MS);
+    }
+    return 0;
+}
+
+static void
+close_file(struct PlaybackCamera* self)
+{
+    switch (self->format) {
+        case Playback_Raw:
+            raw_reader_close(&self->raw);
+            break;
+        case Playback_Tiff:
+            file_view_close(&self->tiff.view);
+            break;
+        default:
+            break;
+    }
+    free(self->tiff.pages);
+    memset(&self->raw, 0, sizeof(self->raw));        // NOLINT
+    memset(&self->tiff, 0, sizeof(self->tiff));      // NOLINT
+    memset(&self->shape, 0, sizeof(self->shape));    // NOLINT
+    self->format = Playback_None;
+    self->first_timestamp = 0;
+}
+
+static int
+open_file(struct PlaybackCamera* self, const char* path)
+{
+    close_file(self);
+    EXPECT(file_view_open(&self->tiff.view, path, strlen(path) + 1),
+           "Playback: Failed to open \"%s\".",
+           path);
+    if (is_tiff(&self->tiff.view)) {
+        self->format = Playback_Tiff;
+        CHECK(open_tiff(self, path));
+    } else {
+        file_view_close(&self->tiff.view);
+        memset(&self->tiff.view, 0, sizeof(self->tiff.view)); // NOLINT
+        EXPECT(raw_reader_open(&self->raw, path),
+               "Playback: Failed to read \"%s\" as a raw file.",
+               path);
+        self->format = Playback_Raw;
+        EXPECT(raw_reader_frame_count(&self->raw),
+               "Playback: \"%s\" holds no frames.",
+               path);
+        struct VideoFrame first = { 0 };
+        const uint8_t* data = 0;
+        CHECK(raw_reader_frame_header(&self->raw, 0, &first, &data));
+        self->shape = first.shape;
+        self->first_timestamp = frame_timestamp(&first);
+    }
+    LOG("Playback: Replaying %llu frames of %ux%u from \"%s\".",
+        (unsigned long long)frame_count(self),
+        self->shape.dims.width,
+        self->shape.dims.height,
+        path);
+    return 1;
+Error:
+    close_file(self);
+    return 0;
+}
+
+//
+//  CAMERA INTERFACE
+//
+
+static enum DeviceStatusCode
+playback_get_meta(const struct Camera* camera,
+                  struct CameraPropertyMetadata* meta)
+{
+    const struct PlaybackCamera* self =
+      containerof(camera, const struct PlaybackCamera, camera);
+    // The shape and type come from the file.
+    const float w = (float)self->shape.dims.width;
+    const float h = (float)self->shape.dims.height;
+    const uint64_t readable = (1ULL << SampleType_u8) |
+                              (1ULL << SampleType_u16) |
+                              (1ULL << SampleType_i8) |
+                              (1ULL << SampleType_i16) |
+                              (1ULL << SampleType_f32) |
+                              (1ULL << SampleType_u32);
+
+    *meta = (struct CameraPropertyMetadata){
+        .line_interval_us = { 0 },
+        .exposure_time_us = { .high = 1.0e6f, .writable = 1, },
+        .binning = { .low = 1.0f, .high = 1.0f, },
+        .shape = {
+            .x = { .low = w, .high = w, },
+            .y = { .low = h, .high = h, },
+        },
+        .offset = { 0 },
+        .supported_pixel_types =
+          self->format ? (1ULL << self->shape.type) : readable,
+        .digital_lines = { 0 },
+        .triggers = { 0 },
+    };
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+playback_set(struct Camera* camera, struct CameraProperties* settings)
+{
+    struct PlaybackCamera* self =
+      containerof(camera, struct PlaybackCamera, camera);
+    const char* path = getenv(PLAYBACK_PATH_ENV);
+    const char* mode = getenv(PLAYBACK_MODE_ENV);
+    EXPECT(path && path[0],
+           "Playback: Set %s to the raw or TIFF file to replay.",
+           PLAYBACK_PATH_ENV);
+    EXPECT(!mode || !strcmp(mode, "paced") || !strcmp(mode, "fast"),
+           "Playback: Expected %s to be \"paced\" or \"fast\". Got \"%s\".",
+           PLAYBACK_MODE_ENV,
+           mode);
+    self->is_paced = !mode || strcmp(mode, "fast") != 0;
+
+    // Opened again each time, in case the file has changed.
+    CHECK(open_file(self, path));
+
+    self->properties = *settings;
+    self->properties.binning = 1;
+    self->properties.pixel_type = self->shape.type;
+    self->properties.offset = (struct camera_properties_offset_s){ 0 };
+    self->properties.shape = (struct camera_properties_shape_s){
+        .x = self->shape.dims.width,
+        .y = self->shape.dims.height,
+    };
+    self->properties.input_triggers =
+      (struct camera_properties_input_triggers_s){ 0 };
+    self->properties.output_triggers =
+      (struct camera_properties_output_triggers_s){ 0 };
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+static enum DeviceStatusCode
+playback_get(const struct Camera* camera, struct CameraProperties* settings)
+{
+    const struct PlaybackCamera* self =
+      containerof(camera, const struct PlaybackCamera, camera);
+    *settings = self->properties;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+playback_get_shape(const struct Camera* camera, struct ImageShape* shape)
+{
+    const struct PlaybackCamera* self =
+      containerof(camera, const struct PlaybackCamera, camera);
+    *shape = self->shape;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+playback_start(struct Camera* camera)
+{
+    struct PlaybackCamera* self =
+      containerof(camera, struct PlaybackCamera, camera);
+    EXPECT(self->format != Playback_None,
+           "Playback: No file to replay. Set %s and configure the camera.",
+           PLAYBACK_PATH_ENV);
+    self->stream.next = 0;
+    self->stream.frame_id = 0;
+    clock_init(&self->stream.pace);
+    prefetch(self, 0, 2 * PLAYBACK_READAHEAD);
+    self->stream.is_running = 1;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+static enum DeviceStatusCode
+playback_stop(struct Camera* camera)
+{
+    struct PlaybackCamera* self =
+      containerof(camera, struct PlaybackCamera, camera);
+    self->stream.is_running = 0;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+playback_execute_trigger(struct Camera* camera)
+{
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+playback_get_frame(struct Camera* camera,
+                   void* im,
+                   size_t* nbytes,
+                   struct ImageInfo* info_out)
+{
+    struct PlaybackCamera* self =
+      containerof(camera, struct PlaybackCamera, camera);
+    const size_t bytes_of_frame = bytes_of_image(&self->shape);
+    CHECK(*nbytes >= bytes_of_frame);
+    CHECK(self->stream.is_running);
+
+    // The file is replayed over and over, the first frame of each pass
+    // due as soon as the last one is out.
+    if (self->stream.next >= frame_count(self)) {
+        self->stream.next = 0;
+        clock_init(&self->stream.pace);
+    }
+    const size_t i = self->stream.next;
+    if (i % PLAYBACK_READAHEAD == 0)
+        prefetch(self, i + PLAYBACK_READAHEAD, i + 2 * PLAYBACK_READAHEAD);
+
+    uint64_t timestamp = 0;
+    const struct VideoFrame* compressed = 0;
+    const uint8_t* pixels = frame_at(self, i, &timestamp, &compressed);
+    EXPECT(pixels,
+           "Playback: Frame %llu doesn't have the shape of the first.",
+           (unsigned long long)i);
+    if (self->is_paced && !wait_until(self, due_ms(self, i, timestamp))) {
+        *nbytes = 0; // stopped
+        return Device_Ok;
+    }
+
+    if (compressed) {
+        EXPECT(frame_decompress(compressed, im, *nbytes),
+               "Playback: Frame %llu holds corrupt compressed data.",
+               (unsigned long long)i);
+    } else {
+        memcpy(im, pixels, bytes_of_frame); // NOLINT
+    }
+    info_out->shape = self->shape;
+    info_out->hardware_frame_id = self->stream.frame_id++;
+    // Frames keep the time they were recorded, so a recording of a replay
+    // replays paced like the original. Each pass repeats them.
+    info_out->hardware_timestamp = timestamp ? timestamp : clock_tic(0);
+    ++self->stream.next;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+static enum DeviceStatusCode
+playback_get_ready_frame_count(const struct Camera* camera, uint32_t* count)
+{
+    const struct PlaybackCamera* self =
+      containerof(camera, const struct PlaybackCamera, camera);
+    *count = 0;
+    if (!self->stream.is_running)
+        return Device_Ok;
+    if (!self->is_paced) {
+        *count = PLAYBACK_MAX_READY;
+        return Device_Ok;
+    }
+
+    struct clock pace = self->stream.pace;
+    const double now = clock_toc_ms(&pace);
+    const size_t n = frame_count(self);
+    // The first frame of the next pass is due as soon as the last is out.
+    if (self->stream.next >= n) {
+        *count = 1;
+        return Device_Ok;
+    }
+    for (size_t i = self->stream.next; i < n && *count < PLAYBACK_MAX_READY;
+         ++i) {
+        uint64_t timestamp = 0;
+        const struct VideoFrame* compressed = 0;
+        if (!frame_at(self, i, &timestamp, &compressed) ||
+            due_ms(self, i, timestamp) > now)
+            break;
+        ++*count;
+    }
+    return Device_Ok;
+}
+
+enum DeviceStatusCode
+playback_close_camera(struct Camera* camera_)
+{
+    EXPECT(camera_, "Invalid NULL parameter");
+    struct PlaybackCamera* camera =
+      containerof(camera_, struct PlaybackCamera, camera);
+    playback_stop(&camera->camera);
+    close_file(camera);
+    free(camera);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+struct Camera*
+playback_make_camera(void)
+{
+    struct PlaybackCamera* self = malloc(sizeof(*self));
+    EXPECT(self, "Allocation of %llu bytes failed.", sizeof(*self));
+    *self = (struct PlaybackCamera){
+        .properties = {
+          .exposure_time_us = 10000,
+          .readout_direction = Direction_Forward,
+          .binning = 1,
+          .pixel_type = SampleType_u8,
+        },
+        .camera = {
+          .state = DeviceState_AwaitingConfiguration,
+          .set = playback_set,
+          .get = playback_get,
+          .get_meta = playback_get_meta,
+          .get_shape = playback_get_shape,
+          .start = playback_start,
+          .stop = playback_stop,
+          .execute_trigger = playback_execute_trigger,
+          .get_frame = playback_get_frame,
+          .get_ready_frame_count = playback_get_ready_frame_count,
+        },
+    };
+    return &self->camera;
+Error:
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef H_ACQUIRE_DRIVER_BASICS_PLAYBACK_CAMERA_V0
+#define H_ACQUIRE_DRIVER_BASICS_PLAYBACK_CAMERA_V0
+
+#include "device/kit/driver.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Names the raw or TIFF file the playback camera replays. Read when the
+/// camera is configured.
+#define PLAYBACK_PATH_ENV "ACQUIRE_PLAYBACK_PATH"
+
+/// "paced", the default, replays frames as far apart as they were recorded.
+/// "fast" replays them as fast as they can be read.
+#define PLAYBACK_MODE_ENV "ACQUIRE_PLAYBACK_MODE"
+
+    struct Camera* playback_make_camera(void);
+    enum DeviceStatusCode playback_close_camera(struct Camera* camera);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_DRIVER_BASICS_PLAYBACK_CAMERA_V0
@@ -0,0 +1,68 @@
+#ifdef __AVX2__
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Independent xorshift128+ generators, 4 to a vector. Two vectors are
+/// stepped at a time to hide the latency of each step. Kept as plain words,
+/// since whatever holds this may not be aligned for vectors.
+struct rand_lanes
+{
+    uint64_t s0[8], s1[8];
+};
+
+static uint64_t
+splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void
+rand_seed(struct rand_lanes* self, uint64_t seed)
+{
+    for (int i = 0; i < 8; ++i) {
+        self->s0[i] = splitmix64(&seed);
+        self->s1[i] = splitmix64(&seed);
+    }
+}
+
+static inline __m256i
+rand_step(__m256i* s0, __m256i* s1)
+{
+    __m256i x = *s0;
+    const __m256i y = *s1;
+    const __m256i out = _mm256_add_epi64(x, y);
+    *s0 = y;
+    x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 23));
+    *s1 = _mm256_xor_si256(
+      _mm256_xor_si256(x, y),
+      _mm256_xor_si256(_mm256_srli_epi64(x, 17), _mm256_srli_epi64(y, 26)));
+    return out;
+}
+
+/// Fills `nbytes`, a multiple of 32, of `buf`. `buf` needn't be aligned.
+static void
+rand_fill(struct rand_lanes* self, uint8_t* buf, size_t nbytes)
+{
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)self->s0);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)self->s1);
+    __m256i b0 = _mm256_loadu_si256((const __m256i*)(self->s0 + 4));
+    __m256i b1 = _mm256_loadu_si256((const __m256i*)(self->s1 + 4));
+    __m256i* out = (__m256i*)buf;
+    const size_t n = nbytes / sizeof(__m256i);
+    size_t i = 0;
+    for (; i + 1 < n; i += 2) {
+        _mm256_storeu_si256(out + i, rand_step(&a0, &a1));
+        _mm256_storeu_si256(out + i + 1, rand_step(&b0, &b1));
+    }
+    if (i < n)
+        _mm256_storeu_si256(out + i, rand_step(&a0, &a1));
+    _mm256_storeu_si256((__m256i*)self->s0, a0);
+    _mm256_storeu_si256((__m256i*)self->s1, a1);
+    _mm256_storeu_si256((__m256i*)(self->s0 + 4), b0);
+    _mm256_storeu_si256((__m256i*)(self->s1 + 4), b1);
+}
+#endif
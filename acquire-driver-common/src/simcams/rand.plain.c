@@ -0,0 +1,50 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Independent xorshift128+ generators, each making 8 bytes of a 32-byte
+/// block.
+struct rand_lanes
+{
+    uint64_t s0[4], s1[4];
+};
+
+static uint64_t
+splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void
+rand_seed(struct rand_lanes* self, uint64_t seed)
+{
+    for (int i = 0; i < 4; ++i) {
+        self->s0[i] = splitmix64(&seed);
+        self->s1[i] = splitmix64(&seed);
+    }
+}
+
+/// Fills `nbytes`, a multiple of 32, of `buf`.
+static void
+rand_fill(struct rand_lanes* self, uint8_t* buf, size_t nbytes)
+{
+    uint64_t s0[4], s1[4], out[4];
+    memcpy(s0, self->s0, sizeof(s0)); // NOLINT
+    memcpy(s1, self->s1, sizeof(s1)); // NOLINT
+    for (const uint8_t* end = buf + nbytes; buf < end; buf += sizeof(out)) {
+        for (int i = 0; i < 4; ++i) {
+            uint64_t x = s0[i];
+            const uint64_t y = s1[i];
+            out[i] = x + y;
+            s0[i] = y;
+            x ^= x << 23;
+            s1[i] = x ^ y ^ (x >> 17) ^ (y >> 26);
+        }
+        memcpy(buf, out, sizeof(out)); // NOLINT
+    }
+    memcpy(self->s0, s0, sizeof(s0)); // NOLINT
+    memcpy(self->s1, s1, sizeof(s1)); // NOLINT
+}
@@ -6,6 +6,7 @@
 #include "device/props/components.h"
 #include "platform.h"
 #include "logger.h"
+#include "bin2.h"
 
 #include <math.h>
 #include <stdlib.h>
@@ -15,21 +16,29 @@
 #include "pcg_basic.h"
 
 #ifdef __AVX2__
-#include "bin2.avx2.c"
+#include "rand.avx2.c"
 #else
-#include "bin2.plain.c"
+#include "rand.plain.c"
 #endif
 
 #define MAX_IMAGE_WIDTH (1ULL << 13)
 #define MAX_IMAGE_HEIGHT (1ULL << 13)
 #define MAX_BYTES_PER_PIXEL (4)
 
+/// Frames are rendered into one slot of the ring while another is copied out.
+/// Needs at least 3: the newest frame, the one being copied out and the one
+/// being rendered.
+#define SIMCAM_RING_CAPACITY (4)
+
+/// Longest the streamer sleeps before checking whether it's been stopped.
+#define SIMCAM_MAX_SLEEP_MS (100.0)
+
 #define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
 #define countof(e) (sizeof(e) / sizeof(*(e)))
 
 #define L aq_logger
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 
 // #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -49,10 +58,51 @@
 #define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
 
 #define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
 
 uint8_t
 popcount_u8(uint8_t value);
 
+/// Ticks the streamers of synchronized cameras in lockstep, like a trigger
+/// shared by several cameras. See SIMCAM_SYNC_CAMERAS_ENV.
+struct simcam_bus
+{
+    /// Held while cameras join or leave, so the generator is started and
+    /// stopped by one at a time.
+    struct lock control;
+
+    /// Guards everything below.
+    struct lock lock;
+    struct condition_variable ticked;
+    /// Cameras streaming on the bus.
+    uint32_t nsubscribers;
+    /// Cameras the first tick waits for.
+    uint32_t nexpected;
+    double period_ms;
+    /// Number of the last tick, counting from 0 each time the generator
+    /// starts, or -1 before the first.
+    int64_t tick;
+    /// When the last tick was, in clock tics.
+    uint64_t timestamp;
+    int is_running;
+    struct thread thread;
+};
+
+/// A frame the streamer rendered, till it's handed out.
+struct simcam_rendered_frame
+{
+    /// Unbinned shape.
+    struct ImageShape full;
+    /// Set when rendered into the lent buffer, otherwise into ring slot
+    /// `slot`.
+    int is_lent;
+    int slot;
+    /// Tick of the bus, for synchronized cameras.
+    int64_t tick;
+    uint64_t tick_timestamp;
+    uint32_t drop_every;
+};
+
 struct SimulatedCamera
 {
     struct CameraProperties properties;
@@ -60,27 +110,134 @@ struct SimulatedCamera
 
     struct
     {
+        /// Its origin is when the last frame was due.
         struct clock throttle;
         int is_running;
         struct thread thread;
     } streamer;
 
+    /// When frames are due. Read from the environment when configured. See
+    /// simulated.camera.h. Guarded by `im.lock`.
+    struct simcam_pacing
+    {
+        /// Frames per second, or 0 to space frames an exposure time apart.
+        float frame_rate_hz;
+        /// Frames in each burst, or 0 for no bursts.
+        uint32_t burst_frames;
+        float burst_idle_ms;
+        float jitter_ms;
+    } pacing;
+
+    /// Faults injected into the streamer's frames, for seeing how the rest of
+    /// the pipeline copes. Read from the environment when configured. See
+    /// simulated.camera.h. Guarded by `im.lock`.
+    struct simcam_faults
+    {
+        /// Skips the id after every this many frames, or 0 for none.
+        uint32_t drop_every;
+        float stall_probability;
+        float stall_ms;
+        /// Frames between changes of shape, or 0 for none.
+        uint32_t reshape_every;
+    } faults;
+
     struct
     {
-        void* data;
         struct ImageShape shape;
+        /// Shape of frame `frame_id`. Smaller than `shape` while the
+        /// streamer's reshaping.
+        struct ImageShape frame_shape;
         struct lock lock;
         int64_t frame_id;
         int64_t last_emitted_frame_id;
         struct condition_variable frame_ready;
     } im;
 
+    /// Frames are rendered and copied out without holding `im.lock`, so the
+    /// streamer and simcam_get_frame() each work on a slot of their own.
+    /// Guarded by `im.lock`.
+    struct
+    {
+        /// One allocation for every slot.
+        void* buffer;
+        /// Aligned to 32 bytes for the vector loops that fill them.
+        uint8_t* data[SIMCAM_RING_CAPACITY];
+        /// Bytes in each slot. Enough for the unbinned image.
+        size_t nbytes;
+        /// Slot holding frame `im.frame_id`, or -1 if there's none yet.
+        int newest;
+        /// Slot being copied out by simcam_get_frame(), or -1.
+        int reading;
+        /// Slot being rendered into by the streamer, or -1.
+        int rendering;
+    } ring;
+
+    /// Buffer lent by simcam_lend_buffer() for the next frame to be rendered
+    /// into directly.
+    struct
+    {
+        void* data;
+        size_t nbytes;
+        /// Id of the frame rendered into `data`, or -1 if none was yet.
+        int64_t frame_id;
+        /// Set while the streamer renders into `data`.
+        int is_rendering;
+    } lent;
+
     struct
     {
         int triggered;
         struct condition_variable trigger_ready;
+        /// Set while a rendered frame waits for a trigger. The trigger hands
+        /// `armed` out itself, so the frame doesn't wait for the streamer to
+        /// wake up first.
+        int is_armed;
+        struct simcam_rendered_frame armed;
     } software_trigger;
 
+    /// Makes the random camera's frames. Only used by the streamer, or with
+    /// no frame being rendered.
+    struct rand_lanes rng;
+
+    /// Noise made up front when SIMCAM_NOISE_POOL_ENV is set. Random frames
+    /// are copied from random offsets into it, wrapping around. Only used by
+    /// the streamer, or with no frame being rendered.
+    struct
+    {
+        uint8_t* data;
+        /// A multiple of 32, at least twice the unbinned image.
+        size_t nbytes;
+    } noise;
+
+    /// Frames made when streaming starts, when SIMCAM_REPLAY_FRAMES_ENV is
+    /// set, and handed out by simcam_get_frame() in place of the streamer's.
+    struct
+    {
+        /// Frames to make, read when configured.
+        uint32_t requested;
+        uint8_t* data;
+        /// Bytes from one frame to the next.
+        size_t stride;
+        /// Frames made for the current stream, or 0 when it has a streamer.
+        uint32_t nframes;
+        /// Id of the last frame handed out.
+        int64_t frame_id;
+    } replay;
+
+    /// Frames are made on the ticks of `bus` instead of on the camera's own
+    /// schedule while `sync.is_subscribed`.
+    struct simcam_bus* bus;
+    struct
+    {
+        /// Cameras on the bus, read when configured, or 0 to not sync.
+        uint32_t ncameras;
+        int is_subscribed;
+    } sync;
+
+    /// Splits the sin camera's frames into blocks of rows while streaming.
+    struct thread_pool pattern_pool;
+    int has_pattern_pool;
+
     uint64_t hardware_timestamp;
     struct Camera camera;
 };
@@ -93,42 +250,58 @@ aligned_bytes_of_image(const struct ImageShape* const shape)
 }
 
 static void
-im_fill_rand(const struct ImageShape* const shape, uint8_t* buf)
+im_fill_rand(struct SimulatedCamera* self,
+             const struct ImageShape* const shape,
+             uint8_t* buf)
 {
     const size_t nbytes = aligned_bytes_of_image(shape);
-    const uint8_t* const end = buf + nbytes;
-    for (uint8_t* p = buf; p < end; p += 4)
-        *(uint32_t*)p = pcg32_random();
+    if (!self->noise.data) {
+        rand_fill(&self->rng, buf, nbytes);
+        return;
+    }
+    const size_t offset =
+      (size_t)pcg32_boundedrand((uint32_t)(self->noise.nbytes >> 5)) << 5;
+    const size_t n = min(nbytes, self->noise.nbytes - offset);
+    memcpy(buf, self->noise.data + offset, n); // NOLINT
+    memcpy(buf + n, self->noise.data, nbytes - n); // NOLINT
 }
 
 void
 im_fill_pattern_u8(const struct ImageShape* const shape,
                    float ox,
                    float oy,
-                   uint8_t* buf);
+                   uint8_t* buf,
+                   struct thread_pool* pool);
 void
 im_fill_pattern_i8(const struct ImageShape* const shape,
                    float ox,
                    float oy,
-                   int8_t* buf);
+                   int8_t* buf,
+                   struct thread_pool* pool);
 
 void
 im_fill_pattern_u16(const struct ImageShape* const shape,
                     float ox,
                     float oy,
-                    uint16_t* buf);
+                    uint16_t* buf,
+                    struct thread_pool* pool);
 
 void
 im_fill_pattern_i16(const struct ImageShape* const shape,
                     float ox,
                     float oy,
-                    int16_t* buf);
+                    int16_t* buf,
+                    struct thread_pool* pool);
 
 void
 im_fill_pattern_f32(const struct ImageShape* const shape,
                     float ox,
                     float oy,
-                    float* buf);
+                    float* buf,
+                    struct thread_pool* pool);
+
+unsigned
+im_fill_pattern_thread_count(void);
 
 static const char*
 sample_type_to_string(enum SampleType type)
@@ -158,23 +331,24 @@ static void
 im_fill_pattern(const struct ImageShape* const shape,
                 float ox,
                 float oy,
-                uint8_t* buf)
+                uint8_t* buf,
+                struct thread_pool* pool)
 {
     switch (shape->type) {
         case SampleType_u8:
-            im_fill_pattern_u8(shape, ox, oy, buf);
+            im_fill_pattern_u8(shape, ox, oy, buf, pool);
             break;
         case SampleType_i8:
-            im_fill_pattern_i8(shape, ox, oy, (int8_t*)buf);
+            im_fill_pattern_i8(shape, ox, oy, (int8_t*)buf, pool);
             break;
         case SampleType_u16:
-            im_fill_pattern_u16(shape, ox, oy, (uint16_t*)buf);
+            im_fill_pattern_u16(shape, ox, oy, (uint16_t*)buf, pool);
             break;
         case SampleType_i16:
-            im_fill_pattern_i16(shape, ox, oy, (int16_t*)buf);
+            im_fill_pattern_i16(shape, ox, oy, (int16_t*)buf, pool);
             break;
         case SampleType_f32:
-            im_fill_pattern_f32(shape, ox, oy, (float*)buf);
+            im_fill_pattern_f32(shape, ox, oy, (float*)buf, pool);
             break;
         default:
             LOGE("Unsupported pixel type for this simcam: %s",
@@ -202,7 +376,7 @@ compute_full_resolution_shape_and_offset(const struct SimulatedCamera* self,
     const uint32_t h = b * self->properties.shape.y;
     offset[0] = b * self->properties.offset.x;
     offset[1] = b * self->properties.offset.y;
-    shape->type = self->im.shape.type;
+    shape->type = self->properties.pixel_type;
     shape->dims = (struct image_dims_s){
         .channels = 1,
         .width = w,
@@ -212,62 +386,360 @@ compute_full_resolution_shape_and_offset(const struct SimulatedCamera* self,
     compute_strides(shape);
 }
 
+/// Halves the width and height of unbinned shape `full`, keeping them
+/// multiples of the binning.
+static void
+halve_full_shape(const struct SimulatedCamera* self, struct ImageShape* full)
+{
+    const uint32_t b = self->properties.binning;
+    full->dims.width = b * max(1, full->dims.width / b / 2);
+    full->dims.height = b * max(1, full->dims.height / b / 2);
+    compute_strides(full);
+}
+
+/// @returns The shape of a frame rendered at unbinned shape `full`.
+static struct ImageShape
+binned_shape(const struct SimulatedCamera* self, const struct ImageShape* full)
+{
+    const uint32_t b = self->properties.binning;
+    struct ImageShape shape = *full;
+    shape.dims.width /= b;
+    shape.dims.height /= b;
+    compute_strides(&shape);
+    return shape;
+}
+
+/// Renders a frame of unbinned shape `full` into `data` and bins it in place.
+static void
+render_frame(struct SimulatedCamera* self,
+             const struct ImageShape* full,
+             const uint32_t origin[2],
+             uint8_t* data)
+{
+    switch (self->kind) {
+        case BasicDevice_Camera_Random:
+            im_fill_rand(self, full, data);
+            break;
+        case BasicDevice_Camera_Sin:
+            ECHO(im_fill_pattern(full,
+                                 (float)origin[0],
+                                 (float)origin[1],
+                                 data,
+                                 self->has_pattern_pool
+                                   ? &self->pattern_pool
+                                   : 0));
+            break;
+        case BasicDevice_Camera_Empty:
+            break; // do nothing
+        default:
+            LOGE("Unexpected index for the kind of simulated camera. Got: %d",
+                 self->kind);
+    }
+
+    uint32_t w = full->dims.width;
+    uint32_t h = full->dims.height;
+    for (int b = self->properties.binning >> 1; b; b >>= 1) {
+        // Binned in place, one 2x2 step at a time.
+        ECHO(bin2(full->type, data, w / 2, data, w, w / 2, h / 2, 1));
+        w >>= 1;
+        h >>= 1;
+    }
+}
+
+/// Sleeps until `ms` after the origin of `due`. Long sleeps are sliced so
+/// clearing `is_running` doesn't have to wait for them.
+static void
+sleep_while_running(const int* is_running, struct clock* due, double ms)
+{
+    while (*is_running && ms - clock_toc_ms(due) > SIMCAM_MAX_SLEEP_MS)
+        clock_sleep_ms(0, SIMCAM_MAX_SLEEP_MS);
+    if (*is_running && ms > 0)
+        clock_sleep_precise_ms(due, (float)ms, CLOCK_SLEEP_SPIN_MS);
+}
+
+/// Waits until frame `nframes`, counting from 0, is due.
+/// @details Frames are due a period apart, counted from when the last one was
+/// due rather than from when it was done, so rendering doesn't slow the rate.
+/// When the streamer has fallen a whole period behind, the schedule starts
+/// over from now instead of catching up with a run of frames.
+static void
+wait_for_frame(struct SimulatedCamera* self,
+               const struct simcam_pacing* pacing,
+               uint64_t nframes)
+{
+    double period_ms = pacing->frame_rate_hz > 0
+                         ? 1e3 / pacing->frame_rate_hz
+                         : 1e-3 * self->properties.exposure_time_us;
+    if (pacing->burst_frames)
+        period_ms =
+          (nframes % pacing->burst_frames) ? 0.0 : pacing->burst_idle_ms;
+
+    double wait_ms = period_ms;
+    if (pacing->jitter_ms > 0) {
+        const double u = pcg32_random() / 4294967296.0;
+        wait_ms += (2.0 * u - 1.0) * pacing->jitter_ms;
+    }
+
+    if (clock_toc_ms(&self->streamer.throttle) > 2.0 * period_ms) {
+        clock_tic(&self->streamer.throttle);
+        return;
+    }
+    struct clock due = self->streamer.throttle;
+    clock_shift_ms(&self->streamer.throttle, period_ms);
+    sleep_while_running(&self->streamer.is_running, &due, wait_ms);
+}
+
+/// @returns Non-zero, with a chance of `faults->stall_probability`, if the
+/// streamer should stall before handing out the frame it's made.
+static int
+is_stalling(const struct simcam_faults* faults)
+{
+    return faults->stall_ms > 0 &&
+           pcg32_random() / 4294967296.0 < faults->stall_probability;
+}
+
+/// Ticks every `period_ms`, counting from when the last tick was due, until
+/// the last camera leaves the bus.
+static void
+simcam_bus_thread(struct simcam_bus* self)
+{
+    struct clock throttle;
+    clock_init(&throttle);
+    while (self->is_running) {
+        ECHO(lock_acquire(&self->lock));
+        ++self->tick;
+        self->timestamp = clock_tic(0);
+        ECHO(condition_variable_notify_all(&self->ticked));
+        ECHO(lock_release(&self->lock));
+
+        if (clock_toc_ms(&throttle) > 2.0 * self->period_ms) {
+            clock_tic(&throttle);
+            continue;
+        }
+        struct clock due = throttle;
+        clock_shift_ms(&throttle, self->period_ms);
+        sleep_while_running(&self->is_running, &due, self->period_ms);
+    }
+}
+
+/// Adds a camera to `self`, starting the generator once `nexpected` cameras
+/// have joined. The first camera to join decides `nexpected` and
+/// `period_ms`.
+static int
+simcam_bus_join(struct simcam_bus* self, uint32_t nexpected, double period_ms)
+{
+    int ok = 1;
+    lock_acquire(&self->control);
+    lock_acquire(&self->lock);
+    if (!self->nsubscribers) {
+        self->nexpected = nexpected;
+        self->period_ms = period_ms;
+    }
+    ++self->nsubscribers;
+    const int starts =
+      !self->is_running && self->nsubscribers >= self->nexpected;
+    if (starts) {
+        self->tick = -1;
+        self->is_running = 1;
+    }
+    lock_release(&self->lock);
+    if (starts &&
+        !(ok = thread_create(
+            &self->thread, (void (*)(void*))simcam_bus_thread, self))) {
+        lock_acquire(&self->lock);
+        self->is_running = 0;
+        --self->nsubscribers;
+        lock_release(&self->lock);
+    }
+    lock_release(&self->control);
+    return ok;
+}
+
+/// Removes a camera from `self`, stopping the generator when it's the last.
+static void
+simcam_bus_leave(struct simcam_bus* self)
+{
+    lock_acquire(&self->control);
+    lock_acquire(&self->lock);
+    --self->nsubscribers;
+    const int stops = !self->nsubscribers && self->is_running;
+    if (stops)
+        self->is_running = 0;
+    lock_release(&self->lock);
+    if (stops)
+        thread_join(&self->thread);
+    lock_release(&self->control);
+}
+
+/// Waits for a tick after `last` while `*is_running`.
+/// @returns The tick, with when it was in `timestamp`, or -1 when stopped.
+static int64_t
+simcam_bus_wait(struct simcam_bus* self,
+                int64_t last,
+                const int* is_running,
+                uint64_t* timestamp)
+{
+    lock_acquire(&self->lock);
+    while (*is_running && self->tick <= last)
+        condition_variable_wait(&self->ticked, &self->lock);
+    const int64_t tick = *is_running ? self->tick : -1;
+    *timestamp = self->timestamp;
+    lock_release(&self->lock);
+    return tick;
+}
+
+/// Wakes every camera waiting on `self`, so those that have been stopped
+/// notice.
+static void
+simcam_bus_wake(struct simcam_bus* self)
+{
+    lock_acquire(&self->lock);
+    condition_variable_notify_all(&self->ticked);
+    lock_release(&self->lock);
+}
+
+struct simcam_bus*
+simcam_bus_create(void)
+{
+    struct simcam_bus* self = malloc(sizeof(*self));
+    EXPECT(self, "Allocation of %llu bytes failed.", sizeof(*self));
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->tick = -1;
+    lock_init(&self->control);
+    lock_init(&self->lock);
+    condition_variable_init(&self->ticked);
+    thread_init(&self->thread);
+    return self;
+Error:
+    return 0;
+}
+
+void
+simcam_bus_destroy(struct simcam_bus* self)
+{
+    free(self);
+}
+
+/// Hands out `frame`, waking simcam_get_frame(). Call with `im.lock` held.
+static void
+emit_frame(struct SimulatedCamera* self,
+           const struct simcam_rendered_frame* frame)
+{
+    if (self->sync.is_subscribed) {
+        self->hardware_timestamp = frame->tick_timestamp;
+        self->im.frame_id = frame->tick;
+    } else {
+        self->hardware_timestamp = clock_tic(0);
+        ++self->im.frame_id;
+        if (frame->drop_every &&
+            (self->im.frame_id + 1) % frame->drop_every == 0)
+            ++self->im.frame_id; // dropped
+    }
+    self->im.frame_shape = binned_shape(self, &frame->full);
+    if (frame->is_lent) {
+        self->lent.is_rendering = 0;
+        self->lent.frame_id = self->im.frame_id;
+    } else {
+        self->ring.newest = frame->slot;
+        self->ring.rendering = -1;
+    }
+    ECHO(condition_variable_notify_all(&self->im.frame_ready));
+}
+
 static void
 simulated_camera_streamer_thread(struct SimulatedCamera* self)
 {
     clock_init(&self->streamer.throttle);
+    uint64_t nframes = 0;
+    int64_t tick = -1;
 
     while (self->streamer.is_running) {
         struct ImageShape full = { 0 };
         uint32_t origin[2] = { 0, 0 };
 
-        ECHO(lock_acquire(&self->im.lock));
-        ECHO(compute_full_resolution_shape_and_offset(self, &full, origin));
+        uint64_t tick_timestamp = 0;
+        if (self->sync.is_subscribed &&
+            (tick = simcam_bus_wait(self->bus,
+                                    tick,
+                                    &self->streamer.is_running,
+                                    &tick_timestamp)) < 0)
+            break;
 
-        switch (self->kind) {
-            case BasicDevice_Camera_Random:
-                im_fill_rand(&full, self->im.data);
-                break;
-            case BasicDevice_Camera_Sin:
-                ECHO(im_fill_pattern(
-                  &full, (float)origin[0], (float)origin[1], self->im.data));
-                break;
-            case BasicDevice_Camera_Empty:
-                break; // do nothing
-            default:
-                LOGE(
-                  "Unexpected index for the kind of simulated camera. Got: %d",
-                  self->kind);
+        ECHO(lock_acquire(&self->im.lock));
+        const struct simcam_faults faults = self->faults;
+        if (self->sync.is_subscribed && faults.drop_every &&
+            (tick + 1) % faults.drop_every == 0) {
+            ECHO(lock_release(&self->im.lock));
+            continue;
         }
-        {
-            int w = full.dims.width;
-            int h = full.dims.height;
-            int b = self->properties.binning >> 1;
-            while (b) {
-                ECHO(bin2(self->im.data, w, h));
-                b >>= 1;
-                w >>= 1;
-                h >>= 1;
+        ECHO(compute_full_resolution_shape_and_offset(self, &full, origin));
+        if (faults.reshape_every && (nframes / faults.reshape_every) % 2)
+            halve_full_shape(self, &full);
+
+        // Render straight into a lent buffer that hasn't been filled yet, as
+        // long as the unbinned image fits and no other frame is waiting to be
+        // handed out. Otherwise, into a slot that's neither the newest frame
+        // nor being copied out.
+        uint8_t* data = 0;
+        int slot = -1;
+        const int is_lent =
+          self->lent.data && self->lent.frame_id < 0 &&
+          self->lent.nbytes >= aligned_bytes_of_image(&full) &&
+          self->im.last_emitted_frame_id >= self->im.frame_id;
+        if (is_lent) {
+            data = self->lent.data;
+            self->lent.is_rendering = 1;
+        } else {
+            for (int i = 1; i <= SIMCAM_RING_CAPACITY; ++i) {
+                slot = (self->ring.newest + i) % SIMCAM_RING_CAPACITY;
+                if (slot != self->ring.newest && slot != self->ring.reading)
+                    break;
             }
+            data = self->ring.data[slot];
+            self->ring.rendering = slot;
+        }
+        ECHO(lock_release(&self->im.lock));
+
+        render_frame(self, &full, origin, data);
+        if (is_stalling(&faults)) {
+            struct clock stall;
+            clock_init(&stall);
+            sleep_while_running(
+              &self->streamer.is_running, &stall, faults.stall_ms);
+            // The next frame is due a period after this one's handed out.
+            clock_tic(&self->streamer.throttle);
         }
 
-        if (self->properties.input_triggers.frame_start.enable) {
-            while (!self->software_trigger.triggered) {
+        const struct simcam_rendered_frame frame = {
+            .full = full,
+            .is_lent = is_lent,
+            .slot = slot,
+            .tick = tick,
+            .tick_timestamp = tick_timestamp,
+            .drop_every = faults.drop_every,
+        };
+        ECHO(lock_acquire(&self->im.lock));
+        if (self->properties.input_triggers.frame_start.enable &&
+            !self->software_trigger.triggered) {
+            // Waits for simcam_execute_trigger() to hand the frame out.
+            self->software_trigger.armed = frame;
+            self->software_trigger.is_armed = 1;
+            while (self->software_trigger.is_armed) {
                 ECHO(condition_variable_wait(
                   &self->software_trigger.trigger_ready, &self->im.lock));
             }
+        } else {
+            // Triggered while the frame was being rendered.
             self->software_trigger.triggered = 0;
+            emit_frame(self, &frame);
         }
 
-        self->hardware_timestamp = clock_tic(0);
-        ++self->im.frame_id;
-
-        ECHO(condition_variable_notify_all(&self->im.frame_ready));
+        const struct simcam_pacing pacing = self->pacing;
         ECHO(lock_release(&self->im.lock));
 
-        if (self->streamer.is_running)
-            clock_sleep_ms(&self->streamer.throttle,
-                           self->properties.exposure_time_us * 1e-3f);
+        ++nframes;
+        if (self->streamer.is_running && !self->sync.is_subscribed)
+            wait_for_frame(self, &pacing, nframes);
     }
 }
 
@@ -323,6 +795,102 @@ simcam_get_meta(const struct Camera* camera,
 static enum DeviceStatusCode
 simcam_execute_trigger(struct Camera* camera);
 
+static void
+free_ring(struct SimulatedCamera* self)
+{
+    free(self->ring.buffer);
+    memset(self->ring.data, 0, sizeof(self->ring.data)); // NOLINT
+    self->ring.buffer = 0;
+    self->ring.nbytes = 0;
+}
+
+static void
+free_noise(struct SimulatedCamera* self)
+{
+    free(self->noise.data);
+    self->noise.data = 0;
+    self->noise.nbytes = 0;
+}
+
+static void
+free_replay(struct SimulatedCamera* self)
+{
+    free(self->replay.data);
+    self->replay.data = 0;
+    self->replay.stride = 0;
+    self->replay.nframes = 0;
+}
+
+/// Makes the `replay.requested` frames handed out in place of the
+/// streamer's.
+static int
+make_replay(struct SimulatedCamera* self)
+{
+    struct ImageShape full = { 0 };
+    uint32_t origin[2] = { 0, 0 };
+    compute_full_resolution_shape_and_offset(self, &full, origin);
+    const size_t stride = aligned_bytes_of_image(&self->im.shape);
+    const uint32_t n = self->replay.requested;
+
+    free_replay(self);
+    // Rendered at full resolution in a slot of the ring, which no streamer is
+    // using.
+    EXPECT(self->ring.nbytes >= aligned_bytes_of_image(&full),
+           "Replay started before the camera was configured.");
+    EXPECT(self->replay.data = malloc(n * stride),
+           "Allocation of %llu bytes failed.",
+           (unsigned long long)(n * stride));
+    for (uint32_t i = 0; i < n; ++i) {
+        render_frame(self, &full, origin, self->ring.data[0]);
+        memcpy(self->replay.data + i * stride, // NOLINT
+               self->ring.data[0],
+               bytes_of_image(&self->im.shape));
+    }
+    self->replay.stride = stride;
+    self->replay.nframes = n;
+    self->replay.frame_id = -1;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Makes a pool of noise with room for `nbytes`, a multiple of 32, from
+/// anywhere in it.
+static int
+make_noise(struct SimulatedCamera* self, size_t nbytes)
+{
+    free_noise(self);
+    if (!(self->noise.data = malloc(2 * nbytes)))
+        return 0;
+    self->noise.nbytes = 2 * nbytes;
+    rand_fill(&self->rng, self->noise.data, self->noise.nbytes);
+    return 1;
+}
+
+/// Reallocates every slot to `nbytes`, a multiple of 32. What they held is
+/// lost.
+static int
+grow_ring(struct SimulatedCamera* self, size_t nbytes)
+{
+    free_ring(self);
+    if (!(self->ring.buffer = malloc(SIMCAM_RING_CAPACITY * nbytes + 31)))
+        return 0;
+    uint8_t* const beg =
+      (uint8_t*)((((uintptr_t)self->ring.buffer + 31) >> 5) << 5);
+    for (int i = 0; i < SIMCAM_RING_CAPACITY; ++i)
+        self->ring.data[i] = beg + i * nbytes;
+    self->ring.nbytes = nbytes;
+    return 1;
+}
+
+/// @returns The number in environment variable `name`, or 0 if it isn't set.
+static float
+getenv_float(const char* name)
+{
+    const char* value = getenv(name);
+    return value ? strtof(value, 0) : 0.0f;
+}
+
 #define clamp(v, L, H) (((v) < (L)) ? (L) : (((v) > (H)) ? (H) : (v)))
 
 static enum DeviceStatusCode
@@ -375,9 +943,78 @@ simcam_set(struct Camera* camera, struct CameraProperties* settings)
         .y = shape->dims.height,
     };
 
-    size_t nbytes = aligned_bytes_of_image(shape);
-    self->im.data = malloc(nbytes);
-    EXPECT(self->im.data, "Allocation of %llu bytes failed.", nbytes);
+    // Frames are rendered at full resolution and binned in place.
+    struct ImageShape full = { 0 };
+    uint32_t origin[2] = { 0, 0 };
+    compute_full_resolution_shape_and_offset(self, &full, origin);
+    const size_t nbytes = aligned_bytes_of_image(&full);
+    const char* pool = getenv(SIMCAM_NOISE_POOL_ENV);
+    const int use_noise =
+      self->kind == BasicDevice_Camera_Random && pool && atoi(pool) > 0;
+    const int grows_ring = nbytes > self->ring.nbytes;
+    const int changes_noise = use_noise ? 2 * nbytes > self->noise.nbytes
+                                        : self->noise.data != 0;
+    if (grows_ring || changes_noise) {
+        // Might be streaming, so wait until nothing is being rendered or
+        // copied out.
+        lock_acquire(&self->im.lock);
+        while (self->ring.rendering >= 0 || self->ring.reading >= 0 ||
+               self->lent.is_rendering)
+            condition_variable_wait(&self->im.frame_ready, &self->im.lock);
+        int ok = !grows_ring || grow_ring(self, nbytes);
+        if (ok && changes_noise) {
+            if (use_noise)
+                ok = make_noise(self, nbytes);
+            else
+                free_noise(self);
+        }
+        lock_release(&self->im.lock);
+        EXPECT(ok,
+               "Allocation of %llu bytes failed.",
+               (unsigned long long)nbytes);
+    }
+
+    {
+        const float burst_frames = getenv_float(SIMCAM_BURST_FRAMES_ENV);
+        const struct simcam_pacing pacing = {
+            .frame_rate_hz = getenv_float(SIMCAM_FRAME_RATE_ENV),
+            .burst_frames = burst_frames > 0 ? (uint32_t)burst_frames : 0,
+            .burst_idle_ms = getenv_float(SIMCAM_BURST_IDLE_MS_ENV),
+            .jitter_ms = 1e-3f * getenv_float(SIMCAM_JITTER_US_ENV),
+        };
+        EXPECT(pacing.frame_rate_hz >= 0 && burst_frames >= 0 &&
+                 pacing.burst_idle_ms >= 0 && pacing.jitter_ms >= 0,
+               "Simulated camera pacing can't be negative.");
+        lock_acquire(&self->im.lock);
+        self->pacing = pacing;
+        lock_release(&self->im.lock);
+    }
+    {
+        const float drop_every = getenv_float(SIMCAM_DROP_EVERY_ENV);
+        const float reshape_every = getenv_float(SIMCAM_RESHAPE_EVERY_ENV);
+        const struct simcam_faults faults = {
+            .drop_every = drop_every > 0 ? (uint32_t)drop_every : 0,
+            .stall_probability = getenv_float(SIMCAM_STALL_PROBABILITY_ENV),
+            .stall_ms = getenv_float(SIMCAM_STALL_MS_ENV),
+            .reshape_every = reshape_every > 0 ? (uint32_t)reshape_every : 0,
+        };
+        EXPECT(faults.drop_every != 1, "Can't drop every frame.");
+        EXPECT(drop_every >= 0 && reshape_every >= 0 &&
+                 faults.stall_probability >= 0 &&
+                 faults.stall_probability <= 1 && faults.stall_ms >= 0,
+               "Simulated camera faults are out of range.");
+        lock_acquire(&self->im.lock);
+        self->faults = faults;
+        lock_release(&self->im.lock);
+    }
+    {
+        const float ncameras = getenv_float(SIMCAM_SYNC_CAMERAS_ENV);
+        self->sync.ncameras = ncameras > 0 ? (uint32_t)ncameras : 0;
+    }
+    {
+        const float replay = getenv_float(SIMCAM_REPLAY_FRAMES_ENV);
+        self->replay.requested = replay > 0 ? (uint32_t)replay : 0;
+    }
 
     return Device_Ok;
 Error:
@@ -410,12 +1047,47 @@ simcam_start(struct Camera* camera)
     self->streamer.is_running = 1;
     self->im.last_emitted_frame_id = -1;
     self->im.frame_id = -1;
+    self->ring.newest = -1;
+    self->ring.reading = -1;
+    self->ring.rendering = -1;
+    self->lent.data = 0;
+    self->lent.is_rendering = 0;
+    // Left over from stopping, which fires one to wake the streamer.
+    self->software_trigger.triggered = 0;
+    self->software_trigger.is_armed = 0;
+    if (self->replay.requested) {
+        CHECK(make_replay(self));
+        LOG("Simulated camera: replaying %u frames.", self->replay.nframes);
+        return Device_Ok;
+    }
+    free_replay(self);
+    if (self->kind == BasicDevice_Camera_Sin) {
+        struct thread_attributes attributes = { .name = "simcam-pattern" };
+        CHECK(thread_pool_start(&self->pattern_pool,
+                                im_fill_pattern_thread_count(),
+                                &attributes));
+        self->has_pattern_pool = 1;
+    }
+    if (self->sync.ncameras) {
+        const double period_ms =
+          self->pacing.frame_rate_hz > 0
+            ? 1e3 / self->pacing.frame_rate_hz
+            : 1e-3 * self->properties.exposure_time_us;
+        CHECK(simcam_bus_join(self->bus, self->sync.ncameras, period_ms));
+        self->sync.is_subscribed = 1;
+    }
     TRACE("SIMULATED CAMERA: thread launch");
     CHECK(thread_create(&self->streamer.thread,
                         (void (*)(void*))simulated_camera_streamer_thread,
                         self));
     return Device_Ok;
 Error:
+    if (self->sync.is_subscribed)
+        simcam_bus_leave(self->bus);
+    self->sync.is_subscribed = 0;
+    if (self->has_pattern_pool)
+        thread_pool_stop(&self->pattern_pool);
+    self->has_pattern_pool = 0;
     return Device_Err;
 }
 
@@ -426,7 +1098,12 @@ simcam_execute_trigger(struct Camera* camera)
       containerof(camera, struct SimulatedCamera, camera);
 
     lock_acquire(&self->im.lock);
-    self->software_trigger.triggered = 1;
+    if (self->software_trigger.is_armed) {
+        emit_frame(self, &self->software_trigger.armed);
+        self->software_trigger.is_armed = 0;
+    } else {
+        self->software_trigger.triggered = 1;
+    }
     condition_variable_notify_all(&self->software_trigger.trigger_ready);
     lock_release(&self->im.lock);
 
@@ -439,44 +1116,108 @@ simcam_stop(struct Camera* camera)
     struct SimulatedCamera* self =
       containerof(camera, struct SimulatedCamera, camera);
     self->streamer.is_running = 0;
+    if (self->replay.nframes)
+        return Device_Ok; // No streamer was started.
     simcam_execute_trigger(camera);
     condition_variable_notify_all(&self->im.frame_ready);
+    if (self->sync.is_subscribed)
+        simcam_bus_wake(self->bus);
 
     TRACE("SIMULATED CAMERA: thread join");
     ECHO(thread_join(&self->streamer.thread));
+    if (self->sync.is_subscribed)
+        simcam_bus_leave(self->bus);
+    self->sync.is_subscribed = 0;
+    if (self->has_pattern_pool)
+        thread_pool_stop(&self->pattern_pool);
+    self->has_pattern_pool = 0;
 
     TRACE("SIMULATED CAMERA: exiting");
     return Device_Ok;
 }
 
+/// Waits for the next frame and copies it into `im`, or gives up after
+/// `*timeout_ms` with `*nbytes` set to 0.  Waits as long as it takes when
+/// `timeout_ms` is NULL.
 static enum DeviceStatusCode
-simcam_get_frame(struct Camera* camera,
-                 void* im,
-                 size_t* nbytes,
-                 struct ImageInfo* info_out)
+get_frame(struct SimulatedCamera* self,
+          void* im,
+          size_t* nbytes,
+          struct ImageInfo* info_out,
+          const uint32_t* timeout_ms)
 {
-    struct SimulatedCamera* self =
-      containerof(camera, struct SimulatedCamera, camera);
     CHECK(*nbytes >= bytes_of_image(&self->im.shape));
     CHECK(self->streamer.is_running);
 
+    const uint32_t nreplay = self->replay.nframes;
+    if (nreplay) {
+        const int64_t id = ++self->replay.frame_id;
+        info_out->shape = self->im.shape;
+        info_out->hardware_frame_id = id;
+        info_out->hardware_timestamp = clock_tic(0);
+        memcpy(im, // NOLINT
+               self->replay.data + (id % nreplay) * self->replay.stride,
+               bytes_of_image(&self->im.shape));
+        return Device_Ok;
+    }
+
     TRACE("last: %5d current %5d",
           self->im.last_emitted_frame_id,
           self->im.frame_id);
+    struct clock clock;
+    clock_init(&clock);
     ECHO(lock_acquire(&self->im.lock));
-    while (self->streamer.is_running &&
-           self->im.last_emitted_frame_id >= self->im.frame_id) {
-        ECHO(condition_variable_wait(&self->im.frame_ready, &self->im.lock));
+    // A frame being rendered into `im` has to be finished before `im` can be
+    // handed back, even when stopping or out of time.
+    int is_timed_out = 0;
+    while (self->lent.is_rendering ||
+           (self->streamer.is_running && !is_timed_out &&
+            self->im.last_emitted_frame_id >= self->im.frame_id)) {
+        if (!timeout_ms || self->lent.is_rendering) {
+            ECHO(condition_variable_wait(&self->im.frame_ready,
+                                         &self->im.lock));
+            continue;
+        }
+        const double remaining_ms = *timeout_ms - clock_toc_ms(&clock);
+        is_timed_out =
+          remaining_ms <= 0 ||
+          !condition_variable_timed_wait(&self->im.frame_ready,
+                                         &self->im.lock,
+                                         (uint32_t)ceil(remaining_ms));
     }
-    self->im.last_emitted_frame_id = self->im.frame_id;
-    if (!self->streamer.is_running) {
+    const int has_frame =
+      self->im.last_emitted_frame_id < self->im.frame_id;
+    const void* const lent = self->lent.data;
+    const int is_lent_frame = lent && self->lent.frame_id == self->im.frame_id;
+    // Keeps the streamer from rendering into `im` while it's copied into, or
+    // once it's been handed back.
+    self->lent.data = 0;
+    if (!self->streamer.is_running || !has_frame) {
+        *nbytes = 0;
         goto Shutdown;
     }
-
-    memcpy(im, self->im.data, bytes_of_image(&self->im.shape)); // NOLINT
-    info_out->shape = self->im.shape;
+    self->im.last_emitted_frame_id = self->im.frame_id;
+    info_out->shape = self->im.frame_shape;
     info_out->hardware_frame_id = self->im.frame_id;
     info_out->hardware_timestamp = self->hardware_timestamp;
+    const size_t bytes_of_frame = bytes_of_image(&info_out->shape);
+    if (is_lent_frame) {
+        if (im != lent)
+            memcpy(im, lent, bytes_of_frame); // NOLINT
+        goto Shutdown;
+    }
+
+    // Copy outside the lock so the streamer can render the next frame
+    // meanwhile.
+    const int slot = self->ring.newest;
+    if (slot < 0) // Only seen frames rendered into buffers lent since.
+        goto Shutdown;
+    self->ring.reading = slot;
+    ECHO(lock_release(&self->im.lock));
+    memcpy(im, self->ring.data[slot], bytes_of_frame); // NOLINT
+    ECHO(lock_acquire(&self->im.lock));
+    self->ring.reading = -1;
+    ECHO(condition_variable_notify_all(&self->im.frame_ready));
 Shutdown:
     ECHO(lock_release(&self->im.lock)); // only acquired in non-error path
     return Device_Ok;
@@ -484,6 +1225,98 @@ Error:
     return Device_Err;
 }
 
+static enum DeviceStatusCode
+simcam_get_frame(struct Camera* camera,
+                 void* im,
+                 size_t* nbytes,
+                 struct ImageInfo* info_out)
+{
+    return get_frame(containerof(camera, struct SimulatedCamera, camera),
+                     im,
+                     nbytes,
+                     info_out,
+                     0);
+}
+
+static enum DeviceStatusCode
+simcam_get_frame_timeout(struct Camera* camera,
+                         void* im,
+                         size_t* nbytes,
+                         struct ImageInfo* info_out,
+                         uint32_t timeout_ms)
+{
+    return get_frame(containerof(camera, struct SimulatedCamera, camera),
+                     im,
+                     nbytes,
+                     info_out,
+                     &timeout_ms);
+}
+
+static enum DeviceStatusCode
+simcam_lend_buffer(struct Camera* camera, void* im, size_t nbytes)
+{
+    struct SimulatedCamera* self =
+      containerof(camera, struct SimulatedCamera, camera);
+    ECHO(lock_acquire(&self->im.lock));
+    self->lent.data = im;
+    self->lent.nbytes = nbytes;
+    self->lent.frame_id = -1;
+    ECHO(lock_release(&self->im.lock));
+    return Device_Ok;
+}
+
+/// Replayed frames are all ready at once, so they're handed out up to
+/// `*count` at a time.  Otherwise this waits for one frame.
+static enum DeviceStatusCode
+simcam_get_frames(struct Camera* camera,
+                  void* im,
+                  size_t stride,
+                  size_t bytes_of_frame,
+                  uint32_t* count,
+                  struct ImageInfo* info)
+{
+    struct SimulatedCamera* self =
+      containerof(camera, struct SimulatedCamera, camera);
+    const size_t bytes_of_image_ = bytes_of_image(&self->im.shape);
+    CHECK(bytes_of_frame >= bytes_of_image_);
+    CHECK(*count == 1 || stride >= bytes_of_frame);
+    CHECK(self->streamer.is_running);
+
+    const uint32_t nreplay = self->replay.nframes;
+    if (!nreplay) {
+        size_t nbytes = bytes_of_frame;
+        CHECK(*count);
+        CHECK(simcam_lend_buffer(camera, im, bytes_of_frame) == Device_Ok);
+        CHECK(simcam_get_frame(camera, im, &nbytes, info) == Device_Ok);
+        *count = nbytes ? 1 : 0;
+        return Device_Ok;
+    }
+
+    const uint64_t timestamp = clock_tic(0);
+    for (uint32_t i = 0; i < *count; ++i) {
+        const int64_t id = ++self->replay.frame_id;
+        info[i].shape = self->im.shape;
+        info[i].hardware_frame_id = id;
+        info[i].hardware_timestamp = timestamp;
+        memcpy((uint8_t*)im + i * stride, // NOLINT
+               self->replay.data + (id % nreplay) * self->replay.stride,
+               bytes_of_image_);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+/// Replayed frames never have to be waited for.
+static enum DeviceStatusCode
+simcam_get_ready_frame_count(const struct Camera* camera, uint32_t* count)
+{
+    const struct SimulatedCamera* self =
+      containerof(camera, struct SimulatedCamera, camera);
+    *count = self->replay.nframes ? UINT32_MAX : 0;
+    return Device_Ok;
+}
+
 enum DeviceStatusCode
 simcam_close_camera(struct Camera* camera_)
 {
@@ -491,8 +1324,9 @@ simcam_close_camera(struct Camera* camera_)
       containerof(camera_, struct SimulatedCamera, camera);
     EXPECT(camera_, "Invalid NULL parameter");
     simcam_stop(&camera->camera);
-    if (camera->im.data)
-        free(camera->im.data);
+    free_ring(camera);
+    free_noise(camera);
+    free_replay(camera);
     free(camera);
     return Device_Ok;
 Error:
@@ -500,7 +1334,7 @@ Error:
 }
 
 struct Camera*
-simcam_make_camera(enum BasicDeviceKind kind)
+simcam_make_camera(enum BasicDeviceKind kind, struct simcam_bus* bus)
 {
     struct SimulatedCamera* self = malloc(sizeof(*self));
     EXPECT(self, "Allocation of %llu bytes failed.", sizeof(*self));
@@ -520,8 +1354,8 @@ simcam_make_camera(enum BasicDeviceKind kind)
     *self = (struct SimulatedCamera){
         .properties = properties,
         .kind=kind,
+        .bus=bus,
         .im={
-          .data=0,
           .shape = {
             .dims = {
               .channels = 1,
@@ -538,6 +1372,11 @@ simcam_make_camera(enum BasicDeviceKind kind)
             .type=properties.pixel_type
           },
         },
+        .ring={
+          .newest=-1,
+          .reading=-1,
+          .rendering=-1,
+        },
         .camera={
           .state = DeviceState_AwaitingConfiguration,
           .set=simcam_set,
@@ -547,9 +1386,14 @@ simcam_make_camera(enum BasicDeviceKind kind)
           .start=simcam_start,
           .stop=simcam_stop,
           .execute_trigger=simcam_execute_trigger,
-          .get_frame=simcam_get_frame
+          .get_frame=simcam_get_frame,
+          .lend_buffer=simcam_lend_buffer,
+          .get_frames=simcam_get_frames,
+          .get_frame_timeout=simcam_get_frame_timeout,
+          .get_ready_frame_count=simcam_get_ready_frame_count
         }
     };
+    rand_seed(&self->rng, clock_tic(0) ^ (uint64_t)(uintptr_t)self);
     thread_init(&self->streamer.thread);
     lock_init(&self->im.lock);
     condition_variable_init(&self->im.frame_ready);
@@ -9,7 +9,70 @@ extern "C"
 {
 #endif
 
-    struct Camera* simcam_make_camera(enum BasicDeviceKind kind);
+/// When set to a positive number, the random camera makes a pool of noise
+/// when it's configured and copies each frame from a random place in it,
+/// rather than making fresh noise for every frame. Read when the camera is
+/// configured.
+#define SIMCAM_NOISE_POOL_ENV "ACQUIRE_SIMCAM_NOISE_POOL"
+
+/// Frames per second. When set to a positive number, frames are due this far
+/// apart rather than an exposure time apart. Read, like the other pacing
+/// variables below, when the camera is configured.
+#define SIMCAM_FRAME_RATE_ENV "ACQUIRE_SIMCAM_FRAME_RATE"
+
+/// When set to a positive number, frames come in bursts of this many, back to
+/// back, with SIMCAM_BURST_IDLE_MS_ENV between the end of one burst and the
+/// start of the next.
+#define SIMCAM_BURST_FRAMES_ENV "ACQUIRE_SIMCAM_BURST_FRAMES"
+#define SIMCAM_BURST_IDLE_MS_ENV "ACQUIRE_SIMCAM_BURST_IDLE_MS"
+
+/// Moves each frame a random time up to this many microseconds either side
+/// of when it's due. The frames after it are still due on schedule.
+#define SIMCAM_JITTER_US_ENV "ACQUIRE_SIMCAM_JITTER_US"
+
+/// When set to a positive number, this many frames are made when streaming
+/// starts and are then handed out round-robin, as fast as they're asked for,
+/// with no pacing and no triggers. For measuring how fast the rest of the
+/// pipeline can go. Read when the camera is configured.
+#define SIMCAM_REPLAY_FRAMES_ENV "ACQUIRE_SIMCAM_REPLAY_FRAMES"
+
+/// Faults for seeing how the rest of the pipeline copes, read when the camera
+/// is configured. None apply to replayed frames.
+///
+/// When set to N, 2 or more, the id after every N frames is skipped, as
+/// though that frame had been dropped: ids N-1, 2N-1 and so on never come.
+#define SIMCAM_DROP_EVERY_ENV "ACQUIRE_SIMCAM_DROP_EVERY"
+
+/// Each frame has this chance, from 0 to 1, of being held back for
+/// SIMCAM_STALL_MS_ENV after it's made. The frames after it are due from
+/// when it ends.
+#define SIMCAM_STALL_PROBABILITY_ENV "ACQUIRE_SIMCAM_STALL_PROBABILITY"
+#define SIMCAM_STALL_MS_ENV "ACQUIRE_SIMCAM_STALL_MS"
+
+/// When set to N, a positive number, the frames switch every N frames between
+/// the configured shape and one with half its width and height. The camera
+/// keeps reporting the configured shape, which is the largest frame.
+#define SIMCAM_RESHAPE_EVERY_ENV "ACQUIRE_SIMCAM_RESHAPE_EVERY"
+
+/// When set to N, a positive number, the random, sin and empty cameras make
+/// frames on the ticks of a bus shared by every camera from the driver,
+/// rather than on a schedule of their own. The bus starts ticking once N
+/// cameras are streaming and stops when none are. Each tick, every camera
+/// on it makes a frame whose hardware frame id is the number of the tick,
+/// counting from 0, and whose timestamp is when the tick was, so frames of
+/// different streams can be matched up. Ticks are SIMCAM_FRAME_RATE_ENV
+/// apart, or else an exposure time of the first camera to start. Bursts and
+/// jitter don't apply, and SIMCAM_DROP_EVERY_ENV skips ticks instead. A
+/// camera that's still making a frame misses the ticks meanwhile. Read when
+/// the camera is configured.
+#define SIMCAM_SYNC_CAMERAS_ENV "ACQUIRE_SIMCAM_SYNC_CAMERAS"
+
+    struct simcam_bus;
+    struct simcam_bus* simcam_bus_create(void);
+    void simcam_bus_destroy(struct simcam_bus* bus);
+
+    struct Camera* simcam_make_camera(enum BasicDeviceKind kind,
+                                      struct simcam_bus* bus);
     enum DeviceStatusCode simcam_close_camera(struct Camera* camera);
 
 #ifdef __cplusplus
@@ -0,0 +1,207 @@
+#include "simulated.stage.h"
+
+#include "device/kit/experimental/stage.axis.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+struct SimulatedStage
+{
+    struct StageAxis axis;
+    struct lock lock;
+    struct StageAxisProperties properties;
+
+    /// Where the axis was, and when, as it started moving towards
+    /// `properties.target`.
+    float origin;
+    uint64_t departed;
+
+    /// clock_tic() of the last sample handed out, and the tics between
+    /// samples.
+    uint64_t last_sample;
+    uint64_t tics_per_sample;
+
+    uint8_t is_running;
+};
+
+/// Where the axis is at `t`, and how fast it's moving. Needs the lock.
+static struct stage_axis_properties_state_s
+state_at(const struct SimulatedStage* self, uint64_t t)
+{
+    if (!self->is_running)
+        return self->properties.immediate;
+    const float distance = self->properties.target.position - self->origin;
+    const float speed = fabsf(self->properties.target.velocity);
+    const double dt =
+      t > self->departed
+        ? 1e-9 * (double)clock_tics_to_ns((int64_t)(t - self->departed))
+        : 0.0;
+    const double travelled = speed * dt;
+    if (travelled >= fabsf(distance))
+        return (struct stage_axis_properties_state_s){
+            .position = self->properties.target.position,
+        };
+    const float direction = distance < 0 ? -1.0f : 1.0f;
+    return (struct stage_axis_properties_state_s){
+        .position = self->origin + direction * (float)travelled,
+        .velocity = direction * speed,
+    };
+}
+
+static enum DeviceStatusCode
+simstage_set(struct StageAxis* axis, struct StageAxisProperties* settings)
+{
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    lock_acquire(&self->lock);
+    if (self->is_running) {
+        // Heads for the new target from wherever the axis is now.
+        const uint64_t now = clock_tic(0);
+        self->origin = state_at(self, now).position;
+        self->departed = now;
+        self->properties.target = settings->target;
+        self->properties.feedback = settings->feedback;
+    } else {
+        self->properties = *settings;
+    }
+    lock_release(&self->lock);
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+simstage_get(const struct StageAxis* axis,
+             struct StageAxisProperties* settings)
+{
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    lock_acquire(&self->lock);
+    *settings = self->properties;
+    settings->immediate = state_at(self, clock_tic(0));
+    lock_release(&self->lock);
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+simstage_get_meta(const struct StageAxis* axis,
+                  struct StageAxisPropertyMetadata* meta)
+{
+    *meta = (struct StageAxisPropertyMetadata){
+        .position = { .writable = 1,
+                      .low = -1e9f,
+                      .high = 1e9f,
+                      .type = PropertyType_FloatingPrecision },
+        .velocity = { .writable = 1,
+                      .low = 0.0f,
+                      .high = 1e9f,
+                      .type = PropertyType_FloatingPrecision },
+    };
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+simstage_start(struct StageAxis* axis)
+{
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    lock_acquire(&self->lock);
+    const uint64_t now = clock_tic(0);
+    self->origin = self->properties.immediate.position;
+    self->departed = now;
+    self->last_sample = now;
+    self->is_running = 1;
+    lock_release(&self->lock);
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+simstage_stop(struct StageAxis* axis)
+{
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    lock_acquire(&self->lock);
+    // Stays where it got to.
+    self->properties.immediate = state_at(self, clock_tic(0));
+    self->properties.immediate.velocity = 0;
+    self->is_running = 0;
+    lock_release(&self->lock);
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+simstage_get_position_samples(struct StageAxis* axis,
+                              struct StageAxisPositionSample* samples,
+                              uint32_t* count)
+{
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    uint32_t n = 0;
+    lock_acquire(&self->lock);
+    const uint64_t now = clock_tic(0);
+    while (n < *count && self->last_sample + self->tics_per_sample <= now) {
+        const uint64_t t = self->last_sample + self->tics_per_sample;
+        const struct stage_axis_properties_state_s state = state_at(self, t);
+        samples[n++] = (struct StageAxisPositionSample){
+            .timestamp = t,
+            .position = state.position,
+            .velocity = state.velocity,
+        };
+        self->last_sample = t;
+    }
+    lock_release(&self->lock);
+    *count = n;
+    return Device_Ok;
+}
+
+enum DeviceStatusCode
+simstage_close_stage_axis(struct StageAxis* axis)
+{
+    EXPECT(axis, "Invalid NULL parameter");
+    struct SimulatedStage* self =
+      containerof(axis, struct SimulatedStage, axis);
+    free(self);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+struct StageAxis*
+simstage_make_stage_axis(void)
+{
+    struct SimulatedStage* self = malloc(sizeof(*self));
+    EXPECT(self, "Allocation of %llu bytes failed.", sizeof(*self));
+    // clock_tic() counts in units of the platform's clock.
+    const double tics_per_second =
+      1e18 / (double)clock_tics_to_ns(1000000000LL);
+    *self = (struct SimulatedStage){
+        .tics_per_sample =
+          (uint64_t)(tics_per_second / SIMSTAGE_SAMPLES_PER_SECOND),
+        .axis = {
+          .state = DeviceState_AwaitingConfiguration,
+          .set = simstage_set,
+          .get = simstage_get,
+          .get_meta = simstage_get_meta,
+          .start = simstage_start,
+          .stop = simstage_stop,
+          .get_position_samples = simstage_get_position_samples,
+        },
+    };
+    lock_init(&self->lock);
+    return &self->axis;
+Error:
+    return 0;
+}
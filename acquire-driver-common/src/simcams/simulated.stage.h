@@ -0,0 +1,23 @@
+#ifndef H_ACQUIRE_DRIVER_BASICS_SIMULATED_STAGE_V0
+#define H_ACQUIRE_DRIVER_BASICS_SIMULATED_STAGE_V0
+
+#include "device/kit/driver.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Rate the simulated stage axis samples its position at while running.
+#define SIMSTAGE_SAMPLES_PER_SECOND (1000)
+
+    /// A stage axis that, once started, moves from `immediate.position`
+    /// towards `target.position` at `target.velocity` and stays there.
+    struct StageAxis* simstage_make_stage_axis(void);
+    enum DeviceStatusCode simstage_close_stage_axis(struct StageAxis* axis);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_DRIVER_BASICS_SIMULATED_STAGE_V0
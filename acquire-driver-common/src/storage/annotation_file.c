@@ -0,0 +1,72 @@
+#include "annotation_file.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+int
+annotation_file_open(struct annotation_file* self, const char* path)
+{
+    char* annotation_path = 0;
+    const size_t n = strlen(path) + sizeof(".ann");
+    CHECK(!self->is_open);
+    CHECK(annotation_path = malloc(n));
+    snprintf(annotation_path, n, "%s.ann", path);
+    if (!file_create(&self->file, annotation_path, n)) {
+        LOGE("Failed to create \"%s\"", annotation_path);
+        goto Error;
+    }
+    free(annotation_path);
+    annotation_path = 0;
+    self->is_open = 1;
+
+    {
+        struct annotation_file_header header = {
+            .version = ANNOTATION_FILE_VERSION,
+            .bytes_of_header = sizeof(struct annotation_file_header),
+        };
+        memcpy(header.magic, ANNOTATION_FILE_MAGIC, sizeof(header.magic));
+        const uint8_t* beg = (const uint8_t*)&header;
+        // A file left by an earlier stream may be longer.
+        CHECK(file_truncate(&self->file, 0));
+        CHECK(file_write(&self->file, 0, beg, beg + sizeof(header)));
+        self->offset = sizeof(header);
+    }
+    return 1;
+Error:
+    free(annotation_path);
+    annotation_file_close(self);
+    return 0;
+}
+
+int
+annotation_file_append(struct annotation_file* self,
+                       const struct FrameAnnotation* annotations,
+                       size_t nbytes)
+{
+    CHECK(self->is_open);
+    const uint8_t* beg = (const uint8_t*)annotations;
+    CHECK(file_write(&self->file, self->offset, beg, beg + nbytes));
+    self->offset += nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+void
+annotation_file_close(struct annotation_file* self)
+{
+    if (self->is_open)
+        file_close(&self->file);
+    self->is_open = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef H_ACQUIRE_STORAGE_ANNOTATION_FILE_V0
+#define H_ACQUIRE_STORAGE_ANNOTATION_FILE_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    struct FrameAnnotation;
+
+    /// Keeps the records a client joined to the frames of a stream.
+    ///
+    /// The records of "out.raw" are in "out.raw.ann": an
+    /// `annotation_file_header` followed by the `FrameAnnotation`s as the
+    /// runtime handed them over, in the order they were pushed, all little
+    /// endian. Each starts on an 8 byte boundary and says how many bytes it
+    /// takes, so readers step by `bytes_of_annotation`. Its `frame_id` is
+    /// that of the frame it was stored with.
+
+#define ANNOTATION_FILE_MAGIC "acqann\0"
+#define ANNOTATION_FILE_VERSION (1)
+
+#pragma pack(push, 1)
+    struct annotation_file_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t bytes_of_header;
+    };
+#pragma pack(pop)
+
+    struct annotation_file
+    {
+        struct file file;
+        int is_open;
+        /// Where the next record goes in the file.
+        uint64_t offset;
+    };
+
+    /// @brief Creates the file of records for the data file `path`, and
+    /// writes its header.
+    /// @returns 1 on success, otherwise 0.
+    int annotation_file_open(struct annotation_file* self, const char* path);
+
+    /// @brief Writes the `nbytes` bytes of records at `annotations`.
+    /// @returns 1 on success, otherwise 0.
+    int annotation_file_append(struct annotation_file* self,
+                               const struct FrameAnnotation* annotations,
+                               size_t nbytes);
+
+    /// @brief Closes the file, if it's open.
+    void annotation_file_close(struct annotation_file* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_ANNOTATION_FILE_V0
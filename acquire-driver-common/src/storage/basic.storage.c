@@ -8,9 +8,8 @@
 
 #define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -58,6 +57,12 @@ trash_init();
 struct Storage*
 side_by_side_tiff_init();
 
+struct Storage*
+tcp_init();
+
+struct Storage*
+staged_tiff_init();
+
 //
 //                  GLOBALS
 //
@@ -85,11 +90,13 @@ basics_make_storage(enum BasicDeviceKind kind)
         const size_t nbytes =
           sizeof(globals.constructors[0]) * BasicDeviceKindCount;
         CHECK(globals.constructors = (struct Storage * (**)()) malloc(nbytes));
-        struct Storage* (*impls[])() = {
+        struct Storage* (*impls[BasicDeviceKindCount])() = {
             [BasicDevice_Storage_Raw] = raw_init,
             [BasicDevice_Storage_Tiff] = tiff_init,
             [BasicDevice_Storage_Trash] = trash_init,
             [BasicDevice_Storage_SideBySideTiffJson] = side_by_side_tiff_init,
+            [BasicDevice_Storage_Tcp] = tcp_init,
+            [BasicDevice_Storage_StagedTiff] = staged_tiff_init,
         };
         memcpy(
           globals.constructors, impls, nbytes); // cppcheck-suppress uninitvar
@@ -0,0 +1,82 @@
+#ifndef H_ACQUIRE_STORAGE_COMPACT_FRAMES_V0
+#define H_ACQUIRE_STORAGE_COMPACT_FRAMES_V0
+
+#include "device/props/components.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Layout of raw files written with `enable_compact_frame_headers`.
+    ///
+    /// The file starts with a `compact_file_header`, followed by records
+    /// back to back, all little endian. Each record starts with a
+    /// `compact_record` and is padded out to a multiple of 8 bytes:
+    /// - A shape record holds the `ImageShape` of the frames after it, up to
+    ///   the next shape record. One comes first, and another whenever the
+    ///   shape changes.
+    /// - A frame record is a `compact_frame_header` followed by the frame's
+    ///   pixels.
+    ///
+    /// A frame record's header takes 56 bytes where a `VideoFrame` takes
+    /// 128. Frames are written with their ids, timestamps, stage position
+    /// and checksum. The frame index, when there is one, points at frame
+    /// records.
+    ///
+    /// Version 1 frame headers end before `checksum`, taking 48 bytes.
+
+#define COMPACT_FRAMES_MAGIC "acqcfh\0"
+#define COMPACT_FRAMES_VERSION (2)
+#define COMPACT_FRAMES_V1_BYTES_OF_FRAME_HEADER (48)
+
+    enum CompactRecordKind
+    {
+        CompactRecord_Shape = 1,
+        CompactRecord_Frame = 2,
+    };
+
+#pragma pack(push, 1)
+    struct compact_file_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct compact_record
+    {
+        /// A `CompactRecordKind`. Space reserved but not written yet reads
+        /// as 0.
+        uint32_t kind;
+        /// Size of the record, padding included.
+        uint32_t bytes_of_record;
+    };
+
+    struct compact_shape_record
+    {
+        struct compact_record record;
+        struct ImageShape shape;
+    };
+
+    struct compact_frame_header
+    {
+        struct compact_record record;
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t hardware_timestamp;
+        uint64_t runtime_timestamp;
+        float stage_position;
+        uint32_t has_stage_position;
+        uint32_t checksum;
+        uint32_t has_checksum;
+    };
+#pragma pack(pop)
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_COMPACT_FRAMES_V0
@@ -0,0 +1,222 @@
+#include "compress.h"
+
+#include <cstring>
+#include <memory>
+
+#ifdef ACQUIRE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ACQUIRE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+/// Codes of TIFF's LZW variant, which is MSB first and widens codes one code
+/// early.
+constexpr uint32_t lzw_clear = 256;
+constexpr uint32_t lzw_eoi = 257;
+constexpr uint32_t lzw_first = 258;
+constexpr uint32_t lzw_min_bits = 9;
+constexpr uint32_t lzw_max_bits = 12;
+/// Where the table is reset, as libtiff does, leaving room for the codes the
+/// decoder adds a step behind.
+constexpr uint32_t lzw_full = (1u << lzw_max_bits) - 2;
+
+/// Maps a code followed by a byte to the code for the two together. Open
+/// addressing, twice as many slots as there can be codes.
+struct LzwTable
+{
+    static constexpr uint32_t nslots = 2u << lzw_max_bits;
+    int32_t keys[nslots];
+    uint16_t codes[nslots];
+
+    void clear() noexcept { memset(keys, 0xff, sizeof(keys)); }
+
+    /// @returns the slot for `key`, which holds it if `keys[slot] == key`
+    /// and is free otherwise.
+    uint32_t find(int32_t key) const noexcept
+    {
+        uint32_t slot =
+          ((uint32_t)key * 2654435761u) >> (32 - lzw_max_bits - 1);
+        while (keys[slot] >= 0 && keys[slot] != key)
+            slot = (slot + 1) & (nslots - 1);
+        return slot;
+    }
+};
+
+struct BitWriter
+{
+    uint8_t* out;
+    uint8_t* end;
+    uint64_t acc;
+    uint32_t nacc;
+
+    bool put(uint32_t code, uint32_t nbits) noexcept
+    {
+        acc = (acc << nbits) | code;
+        nacc += nbits;
+        while (nacc >= 8) {
+            if (out == end)
+                return false;
+            nacc -= 8;
+            *out++ = (uint8_t)(acc >> nacc);
+        }
+        return true;
+    }
+
+    bool flush() noexcept
+    {
+        if (nacc) {
+            if (out == end)
+                return false;
+            *out++ = (uint8_t)(acc << (8 - nacc));
+            nacc = 0;
+        }
+        return true;
+    }
+};
+
+/// Follows libtiff's encoder, so that its decoder, which expects codes to
+/// widen one code early, reads the output.
+size_t
+lzw_compress(uint8_t* dst, size_t bytes_of_dst, const uint8_t* src, size_t n)
+{
+    auto table = std::make_unique<LzwTable>();
+    BitWriter w = { dst, dst + bytes_of_dst, 0, 0 };
+    uint32_t nbits = lzw_min_bits;
+    uint32_t maxcode = (1u << nbits) - 1;
+    uint32_t next = lzw_first;
+
+    // Called after each new code is taken.
+    const auto grow = [&]() -> bool {
+        if (next == lzw_full) {
+            if (!w.put(lzw_clear, nbits))
+                return false;
+            table->clear();
+            next = lzw_first;
+            nbits = lzw_min_bits;
+            maxcode = (1u << nbits) - 1;
+        } else if (next > maxcode) {
+            ++nbits;
+            maxcode = (1u << nbits) - 1;
+        }
+        return true;
+    };
+
+    table->clear();
+    if (!w.put(lzw_clear, nbits))
+        return 0;
+    if (n) {
+        uint32_t ent = src[0];
+        for (size_t i = 1; i < n; ++i) {
+            const int32_t key = (int32_t)((ent << 8) | src[i]);
+            const uint32_t slot = table->find(key);
+            if (table->keys[slot] == key) {
+                ent = table->codes[slot];
+                continue;
+            }
+            if (!w.put(ent, nbits))
+                return 0;
+            table->keys[slot] = key;
+            table->codes[slot] = (uint16_t)next++;
+            ent = src[i];
+            if (!grow())
+                return 0;
+        }
+        if (!w.put(ent, nbits))
+            return 0;
+        ++next;
+        if (!grow())
+            return 0;
+    }
+    if (!w.put(lzw_eoi, nbits) || !w.flush())
+        return 0;
+    return w.out - dst;
+}
+
+} // namespace
+
+uint32_t
+compression_supported()
+{
+    uint32_t out = (1u << StorageCompression_None) |
+                   (1u << StorageCompression_Lzw);
+#ifdef ACQUIRE_HAVE_ZLIB
+    out |= 1u << StorageCompression_Deflate;
+#endif
+#ifdef ACQUIRE_HAVE_ZSTD
+    out |= 1u << StorageCompression_Zstd;
+#endif
+    return out;
+}
+
+size_t
+compress_bound(enum StorageCompression codec, size_t nbytes)
+{
+    switch (codec) {
+        case StorageCompression_Lzw:
+            // At worst a 12-bit code per byte, plus the clear codes.
+            return (nbytes + nbytes / (lzw_full - lzw_first) + 4) * 3 / 2 + 8;
+#ifdef ACQUIRE_HAVE_ZLIB
+        case StorageCompression_Deflate:
+            return compressBound((uLong)nbytes);
+#endif
+#ifdef ACQUIRE_HAVE_ZSTD
+        case StorageCompression_Zstd:
+            return ZSTD_compressBound(nbytes);
+#endif
+        default:
+            return nbytes;
+    }
+}
+
+size_t
+compress(enum StorageCompression codec,
+         uint8_t* dst,
+         size_t bytes_of_dst,
+         const uint8_t* src,
+         size_t nbytes)
+{
+    switch (codec) {
+        case StorageCompression_Lzw:
+            return lzw_compress(dst, bytes_of_dst, src, nbytes);
+#ifdef ACQUIRE_HAVE_ZLIB
+        case StorageCompression_Deflate: {
+            // The fastest level: these are written as they're acquired.
+            uLongf n = (uLongf)bytes_of_dst;
+            if (compress2(dst, &n, src, (uLong)nbytes, Z_BEST_SPEED) != Z_OK)
+                return 0;
+            return n;
+        }
+#endif
+#ifdef ACQUIRE_HAVE_ZSTD
+        case StorageCompression_Zstd: {
+            const size_t n = ZSTD_compress(dst, bytes_of_dst, src, nbytes, 1);
+            return ZSTD_isError(n) ? 0 : n;
+        }
+#endif
+        case StorageCompression_None:
+            if (nbytes > bytes_of_dst)
+                return 0;
+            memcpy(dst, src, nbytes);
+            return nbytes;
+        default:
+            return 0;
+    }
+}
+
+uint16_t
+compression_tiff_tag_value(enum StorageCompression codec)
+{
+    switch (codec) {
+        case StorageCompression_Lzw:
+            return 5;
+        case StorageCompression_Deflate:
+            return 8; // Adobe Deflate
+        case StorageCompression_Zstd:
+            return 50000; // as libtiff
+        default:
+            return 1;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef H_ACQUIRE_STORAGE_COMPRESS_V0
+#define H_ACQUIRE_STORAGE_COMPRESS_V0
+
+#include "device/props/storage.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @returns Bit `i` set for each `StorageCompression` `i` this build can
+///          compress with. `StorageCompression_None` is always set.
+uint32_t
+compression_supported();
+
+/// @returns The most bytes compress() writes for `nbytes` of input.
+size_t
+compress_bound(enum StorageCompression codec, size_t nbytes);
+
+/// @brief Compresses `nbytes` of `src` into `dst`, which holds
+/// compress_bound() bytes, as one TIFF strip.
+/// @details Safe to call from several threads at once.
+/// @returns The number of bytes written to `dst`, or 0 on failure.
+size_t
+compress(enum StorageCompression codec,
+         uint8_t* dst,
+         size_t bytes_of_dst,
+         const uint8_t* src,
+         size_t nbytes);
+
+/// @returns The value of the TIFF Compression tag for `codec`.
+uint16_t
+compression_tiff_tag_value(enum StorageCompression codec);
+
+#endif // H_ACQUIRE_STORAGE_COMPRESS_V0
@@ -0,0 +1,156 @@
+#include "downsample.h"
+
+#include <type_traits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template<typename T>
+T
+avg(T a, T b) noexcept
+{
+    if constexpr (std::is_floating_point_v<T>) {
+        return (a + b) * T(0.5);
+    } else {
+        // Wide enough that the sum doesn't overflow. The shift floors, so
+        // negative values round up too.
+        using W = std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>;
+        return (T)(((W)a + (W)b + 1) >> 1);
+    }
+}
+
+/// Averages the 2x2 block at column `2 * x` of rows `r0` and `r1`.
+template<typename T>
+T
+avg2x2(const T* r0, const T* r1, uint32_t x) noexcept
+{
+    return avg(avg(r0[2 * x], r1[2 * x]), avg(r0[2 * x + 1], r1[2 * x + 1]));
+}
+
+/// Averages `n` pairs of columns from rows `r0` and `r1` into `out`.
+template<typename T>
+void
+downsample_row(T* out, const T* r0, const T* r1, uint32_t n) noexcept
+{
+    for (uint32_t x = 0; x < n; ++x)
+        out[x] = avg2x2(r0, r1, x);
+}
+
+#ifdef __AVX2__
+/// Same as bin2 in the simulated cameras, but row by row into another
+/// buffer: rows are averaged, then neighbouring lanes, and the odd lanes are
+/// packed away. The permute undoes the pack's interleaving of 128-bit halves.
+constexpr int unpack_order = (3 << 6) | (1 << 4) | (2 << 2);
+
+template<>
+void
+downsample_row(uint8_t* out,
+               const uint8_t* r0,
+               const uint8_t* r1,
+               uint32_t n) noexcept
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    uint32_t x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i v[2];
+        for (int i = 0; i < 2; ++i) {
+            const auto* a = (const __m256i*)(r0 + 2 * x + 32 * i);
+            const auto* b = (const __m256i*)(r1 + 2 * x + 32 * i);
+            const __m256i rows =
+              _mm256_avg_epu8(_mm256_loadu_si256(a), _mm256_loadu_si256(b));
+            const __m256i cols =
+              _mm256_avg_epu8(rows, _mm256_srli_epi16(rows, 8));
+            v[i] = _mm256_and_si256(cols, mask);
+        }
+        const __m256i packed = _mm256_packus_epi16(v[0], v[1]);
+        _mm256_storeu_si256((__m256i*)(out + x),
+                            _mm256_permute4x64_epi64(packed, unpack_order));
+    }
+    for (; x < n; ++x)
+        out[x] = avg2x2(r0, r1, x);
+}
+
+template<>
+void
+downsample_row(uint16_t* out,
+               const uint16_t* r0,
+               const uint16_t* r1,
+               uint32_t n) noexcept
+{
+    const __m256i mask = _mm256_set1_epi32(0x0000ffff);
+    uint32_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i v[2];
+        for (int i = 0; i < 2; ++i) {
+            const auto* a = (const __m256i*)(r0 + 2 * x + 16 * i);
+            const auto* b = (const __m256i*)(r1 + 2 * x + 16 * i);
+            const __m256i rows =
+              _mm256_avg_epu16(_mm256_loadu_si256(a), _mm256_loadu_si256(b));
+            const __m256i cols =
+              _mm256_avg_epu16(rows, _mm256_srli_epi32(rows, 16));
+            v[i] = _mm256_and_si256(cols, mask);
+        }
+        const __m256i packed = _mm256_packus_epi32(v[0], v[1]);
+        _mm256_storeu_si256((__m256i*)(out + x),
+                            _mm256_permute4x64_epi64(packed, unpack_order));
+    }
+    for (; x < n; ++x)
+        out[x] = avg2x2(r0, r1, x);
+}
+#endif
+
+template<typename T>
+void
+downsample(const uint8_t* src,
+           size_t stride,
+           uint32_t width,
+           uint32_t height,
+           uint8_t* dst) noexcept
+{
+    const uint32_t w = width / 2;
+    for (uint32_t y = 0; y < height / 2; ++y) {
+        const auto* r0 = (const T*)(src + 2 * y * stride);
+        const auto* r1 = (const T*)(src + (2 * y + 1) * stride);
+        downsample_row((T*)dst + (size_t)y * w, r0, r1, w);
+    }
+}
+
+} // end namespace ::{anonymous}
+
+int
+downsample2(enum SampleType type,
+            const uint8_t* src,
+            size_t stride,
+            uint32_t width,
+            uint32_t height,
+            uint8_t* dst)
+{
+    switch (type) {
+        case SampleType_u8:
+            downsample<uint8_t>(src, stride, width, height, dst);
+            return 1;
+        case SampleType_i8:
+            downsample<int8_t>(src, stride, width, height, dst);
+            return 1;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            downsample<uint16_t>(src, stride, width, height, dst);
+            return 1;
+        case SampleType_i16:
+            downsample<int16_t>(src, stride, width, height, dst);
+            return 1;
+        case SampleType_u32:
+            downsample<uint32_t>(src, stride, width, height, dst);
+            return 1;
+        case SampleType_f32:
+            downsample<float>(src, stride, width, height, dst);
+            return 1;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef H_ACQUIRE_STORAGE_DOWNSAMPLE_V0
+#define H_ACQUIRE_STORAGE_DOWNSAMPLE_V0
+
+#include "device/props/components.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Averages each 2x2 block of the `width` by `height` image `src`,
+/// whose rows are `stride` bytes apart, into the `width/2` by `height/2`
+/// image `dst`, whose rows are packed.
+/// @details An odd last row or column is dropped. Integers are averaged in
+/// pairs, rounding up, as `_mm256_avg_epu8` does, rows first.
+/// @returns 0 if `type` isn't supported, otherwise 1.
+int
+downsample2(enum SampleType type,
+            const uint8_t* src,
+            size_t stride,
+            uint32_t width,
+            uint32_t height,
+            uint8_t* dst);
+
+#endif // H_ACQUIRE_STORAGE_DOWNSAMPLE_V0
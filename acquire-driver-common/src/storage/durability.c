@@ -0,0 +1,158 @@
+#include "durability.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+void
+durability_init(struct durability* self, int (*sync)(void* ctx), void* ctx)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->sync = sync;
+    self->ctx = ctx;
+    lock_init(&self->sync_lock);
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify);
+    thread_init(&self->thread);
+}
+
+int
+durability_set(struct durability* self,
+               const struct StorageProperties* properties)
+{
+    CHECK((unsigned)properties->durability < StorageDurabilityCount);
+    self->mode = properties->durability;
+    self->interval_ms = properties->durability_interval_ms;
+    self->interval_bytes = properties->durability_interval_bytes;
+    return 1;
+Error:
+    return 0;
+}
+
+void
+durability_get(const struct durability* self,
+               struct StorageProperties* properties)
+{
+    properties->durability = self->mode;
+    properties->durability_interval_ms = self->interval_ms;
+    properties->durability_interval_bytes = self->interval_bytes;
+}
+
+/// Runs on `thread`, syncing whenever what's been written since the last
+/// sync is due, till it's stopped.
+static void
+sync_periodically(void* ctx)
+{
+    struct durability* self = (struct durability*)ctx;
+    struct thread_attributes attributes = { .name = "storage-sync" };
+    thread_set_current_attributes(&attributes);
+
+    const uint32_t interval_ms =
+      self->interval_ms || self->interval_bytes
+        ? self->interval_ms
+        : DURABILITY_DEFAULT_INTERVAL_MS;
+    struct clock since_sync;
+    clock_init(&since_sync);
+
+    lock_acquire(&self->lock);
+    while (!self->is_stopping) {
+        const double elapsed_ms = clock_toc_ms(&since_sync);
+        const int is_due =
+          self->unsynced_bytes &&
+          ((interval_ms && elapsed_ms >= interval_ms) ||
+           (self->interval_bytes &&
+            self->unsynced_bytes >= self->interval_bytes));
+        if (!is_due) {
+            if (interval_ms)
+                condition_variable_timed_wait(
+                  &self->notify,
+                  &self->lock,
+                  elapsed_ms < interval_ms
+                    ? (uint32_t)(interval_ms - elapsed_ms) + 1
+                    : interval_ms);
+            else
+                condition_variable_wait(&self->notify, &self->lock);
+            continue;
+        }
+        self->unsynced_bytes = 0;
+        lock_release(&self->lock);
+
+        // Everything written before this point is covered, however many
+        // appends it took.
+        lock_acquire(&self->sync_lock);
+        const int is_ok = self->sync(self->ctx);
+        lock_release(&self->sync_lock);
+        clock_init(&since_sync);
+
+        lock_acquire(&self->lock);
+        ++self->syncs;
+        if (!is_ok && !self->has_failed) {
+            LOGE("Failed to sync written data to disk.");
+            self->has_failed = 1;
+        }
+    }
+    lock_release(&self->lock);
+}
+
+int
+durability_start(struct durability* self)
+{
+    CHECK(!self->is_running);
+    self->is_stopping = 0;
+    self->has_failed = 0;
+    self->unsynced_bytes = 0;
+    self->syncs = 0;
+    if (self->mode != StorageDurability_Periodic)
+        return 1;
+    CHECK(thread_create(&self->thread, sync_periodically, self));
+    self->is_running = 1;
+    return 1;
+Error:
+    return 0;
+}
+
+void
+durability_wrote(struct durability* self, uint64_t nbytes)
+{
+    if (!self->is_running || !nbytes)
+        return;
+    lock_acquire(&self->lock);
+    const uint64_t before = self->unsynced_bytes;
+    self->unsynced_bytes += nbytes;
+    // The first write after a sync may already be past the interval. Later
+    // ones only matter once they add up to a sync's worth of bytes.
+    if (!before || (self->interval_bytes && before < self->interval_bytes &&
+                    self->unsynced_bytes >= self->interval_bytes))
+        condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+}
+
+int
+durability_sync_file(const struct durability* self, const struct file* file)
+{
+    if (self->mode == StorageDurability_None)
+        return 1;
+    return file_sync(file);
+}
+
+int
+durability_stop(struct durability* self)
+{
+    if (!self->is_running)
+        return 1;
+    lock_acquire(&self->lock);
+    self->is_stopping = 1;
+    condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+    thread_join(&self->thread);
+    self->is_running = 0;
+    return !self->has_failed;
+}
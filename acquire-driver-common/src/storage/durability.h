@@ -0,0 +1,88 @@
+#ifndef H_ACQUIRE_STORAGE_DURABILITY_V0
+#define H_ACQUIRE_STORAGE_DURABILITY_V0
+
+#include "platform.h"
+#include "device/props/storage.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Interval between syncs with `StorageDurability_Periodic` when the
+/// properties give neither limit.
+#define DURABILITY_DEFAULT_INTERVAL_MS (1000)
+
+    /// Syncs what a storage device writes to the disk as its
+    /// `StorageDurability` asks.
+    ///
+    /// With `StorageDurability_Periodic`, a thread calls `sync` once enough
+    /// time has passed or enough bytes have been written since it last did,
+    /// so one sync covers every append in between and appends never wait on
+    /// the disk. The device calls durability_wrote() after each append, and
+    /// holds `sync_lock` while it closes or swaps the files `sync` touches.
+    /// Files are synced as they're closed with anything but
+    /// `StorageDurability_None`.
+    struct durability
+    {
+        enum StorageDurability mode;
+        uint32_t interval_ms;
+        uint64_t interval_bytes;
+
+        /// Syncs the files being written. Called on `thread` with
+        /// `sync_lock` held. Returns 1 on success, otherwise 0.
+        int (*sync)(void* ctx);
+        void* ctx;
+        struct lock sync_lock;
+
+        struct thread thread;
+        int is_running;
+
+        /// Guarded by `lock`.
+        struct lock lock;
+        struct condition_variable notify;
+        int is_stopping, has_failed;
+        uint64_t unsynced_bytes;
+        /// Syncs `thread` has made since it started.
+        uint64_t syncs;
+    };
+
+    void durability_init(struct durability* self,
+                         int (*sync)(void* ctx),
+                         void* ctx);
+
+    /// @brief Takes the durability settings from `properties`.
+    /// @returns 1 on success, or 0 if they're out of range.
+    int durability_set(struct durability* self,
+                       const struct StorageProperties* properties);
+
+    /// @brief Copies the durability settings into `properties`.
+    void durability_get(const struct durability* self,
+                        struct StorageProperties* properties);
+
+    /// @brief Starts the thread, with `StorageDurability_Periodic`.
+    /// @returns 1 on success, otherwise 0.
+    int durability_start(struct durability* self);
+
+    /// @brief Counts `nbytes` just written, waking the thread if they're due
+    /// to be synced.
+    void durability_wrote(struct durability* self, uint64_t nbytes);
+
+    /// @brief Syncs `file`, about to be closed, unless the mode is
+    /// `StorageDurability_None`.
+    /// @returns 1 on success, otherwise 0.
+    int durability_sync_file(const struct durability* self,
+                             const struct file* file);
+
+    /// @brief Stops the thread. Call before closing the files, which syncs
+    /// what it hadn't.
+    /// @returns 0 if any sync the thread made failed, otherwise 1.
+    int durability_stop(struct durability* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_DURABILITY_V0
@@ -0,0 +1,116 @@
+#include "frame_index.h"
+#include "device/props/components.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+int
+frame_index_open(struct frame_index* self, const char* path)
+{
+    char* index_path = 0;
+    const size_t n = strlen(path) + sizeof(".idx");
+    CHECK(!self->is_open);
+    CHECK(index_path = malloc(n));
+    snprintf(index_path, n, "%s.idx", path);
+    if (!file_create(&self->file, index_path, n)) {
+        LOGE("Failed to create \"%s\"", index_path);
+        goto Error;
+    }
+    free(index_path);
+    index_path = 0;
+    self->is_open = 1;
+    self->nrecords = 0;
+
+    {
+        struct frame_index_header header = {
+            .version = FRAME_INDEX_VERSION,
+            .bytes_of_record = sizeof(struct frame_index_record),
+        };
+        memcpy(header.magic, FRAME_INDEX_MAGIC, sizeof(header.magic));
+        const uint8_t* beg = (const uint8_t*)&header;
+        // An index left by an earlier stream may be longer.
+        CHECK(file_truncate(&self->file, 0));
+        CHECK(file_write(&self->file, 0, beg, beg + sizeof(header)));
+        self->offset = sizeof(header);
+    }
+    return 1;
+Error:
+    free(index_path);
+    if (self->is_open)
+        file_close(&self->file);
+    self->is_open = 0;
+    return 0;
+}
+
+int
+frame_index_add(struct frame_index* self,
+                const struct VideoFrame* frame,
+                uint64_t offset,
+                uint64_t nbytes)
+{
+    if (self->nrecords == self->capacity) {
+        const size_t capacity = self->capacity ? 2 * self->capacity : 64;
+        struct frame_index_record* records =
+          realloc(self->records, capacity * sizeof(*records));
+        CHECK(records);
+        self->records = records;
+        self->capacity = capacity;
+    }
+    self->records[self->nrecords++] = (struct frame_index_record){
+        .frame_id = frame->frame_id,
+        .offset = offset,
+        .nbytes = nbytes,
+        .hardware_timestamp = frame->timestamps.hardware,
+        .runtime_timestamp = frame->timestamps.acq_thread,
+        .hardware_frame_id = frame->hardware_frame_id,
+    };
+    return 1;
+Error:
+    return 0;
+}
+
+int
+frame_index_flush(struct frame_index* self)
+{
+    if (!self->is_open || !self->nrecords)
+        return 1;
+    const uint8_t* beg = (const uint8_t*)self->records;
+    const size_t nbytes = self->nrecords * sizeof(*self->records);
+    CHECK(file_write(&self->file, self->offset, beg, beg + nbytes));
+    self->offset += nbytes;
+    self->nrecords = 0;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+frame_index_close(struct frame_index* self)
+{
+    if (!self->is_open)
+        return 1;
+    const int is_ok = frame_index_flush(self);
+    file_close(&self->file);
+    self->is_open = 0;
+    self->nrecords = 0;
+    return is_ok;
+}
+
+void
+frame_index_destroy(struct frame_index* self)
+{
+    frame_index_close(self);
+    free(self->records);
+    memset(self, 0, sizeof(*self));
+}
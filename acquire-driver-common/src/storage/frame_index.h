@@ -0,0 +1,91 @@
+#ifndef H_ACQUIRE_STORAGE_FRAME_INDEX_V0
+#define H_ACQUIRE_STORAGE_FRAME_INDEX_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    struct VideoFrame;
+
+    /// Tells readers where each frame of a data file is without scanning it.
+    ///
+    /// The index of "out.tif" is "out.tif.idx": a `frame_index_header`
+    /// followed by one `frame_index_record` per frame, in the order the
+    /// frames were written, all little endian. The record for the `n`th frame
+    /// is at `sizeof(struct frame_index_header) + n * bytes_of_record`.
+    /// Fields are only ever added at the end of a record, so readers should
+    /// step by `bytes_of_record` and ignore what they don't know.
+    ///
+    /// Records are appended as frames are written. A record may be written
+    /// before its frame reaches the disk, but not before it's queued.
+
+#define FRAME_INDEX_MAGIC "acqidx\0"
+#define FRAME_INDEX_VERSION (1)
+
+#pragma pack(push, 1)
+    struct frame_index_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t bytes_of_record;
+    };
+
+    struct frame_index_record
+    {
+        uint64_t frame_id;
+        /// Where the frame starts in the data file, and its size there. For
+        /// raw files, the frame's header and pixels. For TIFF files, the
+        /// frame's ifd, image data and strings.
+        uint64_t offset;
+        uint64_t nbytes;
+        uint64_t hardware_timestamp;
+        uint64_t runtime_timestamp;
+        uint64_t hardware_frame_id;
+    };
+#pragma pack(pop)
+
+    struct frame_index
+    {
+        struct file file;
+        int is_open;
+        /// Where the next record goes in the file.
+        uint64_t offset;
+        /// Records not written yet.
+        struct frame_index_record* records;
+        size_t nrecords, capacity;
+    };
+
+    /// @brief Creates the index for the data file `path` and writes its
+    /// header.
+    /// @returns 1 on success, otherwise 0.
+    int frame_index_open(struct frame_index* self, const char* path);
+
+    /// @brief Queues a record of `frame`, written to the data file at
+    /// `offset` taking `nbytes`.
+    /// @returns 1 on success, otherwise 0.
+    int frame_index_add(struct frame_index* self,
+                        const struct VideoFrame* frame,
+                        uint64_t offset,
+                        uint64_t nbytes);
+
+    /// @brief Writes the queued records.
+    /// @returns 1 on success, otherwise 0.
+    int frame_index_flush(struct frame_index* self);
+
+    /// @brief Writes the queued records and closes the file.
+    /// @returns 1 on success, otherwise 0.
+    int frame_index_close(struct frame_index* self);
+
+    /// @brief Frees the memory held for queued records.
+    void frame_index_destroy(struct frame_index* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_FRAME_INDEX_V0
@@ -0,0 +1,251 @@
+#include "migration.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+static char*
+copy_path(const char* path)
+{
+    const size_t n = strlen(path) + 1;
+    char* out = malloc(n);
+    if (out)
+        memcpy(out, path, n); // NOLINT
+    return out;
+}
+
+static void
+free_job(struct migration_job* job)
+{
+    if (job) {
+        free(job->from);
+        free(job->to);
+        free(job);
+    }
+}
+
+static uint64_t
+rate_of(struct migration* self)
+{
+    lock_acquire(&self->lock);
+    const uint64_t out = self->bytes_per_second;
+    lock_release(&self->lock);
+    return out;
+}
+
+/// Copies `from` to `to` in `MIGRATION_CHUNK_BYTES` pieces, sleeping between
+/// them to stay under the rate.
+/// @returns The number of bytes copied, or -1 on failure.
+static int64_t
+copy_file(struct migration* self, const char* from, const char* to)
+{
+    FILE *in = 0, *out = 0;
+    uint8_t* buf = 0;
+    int64_t copied = 0;
+    CHECK(buf = malloc(MIGRATION_CHUNK_BYTES));
+    CHECK(in = fopen(from, "rb"));
+    CHECK(out = fopen(to, "wb"));
+    // The pieces are already large. Buffering them again only copies them.
+    setvbuf(in, 0, _IONBF, 0);
+    setvbuf(out, 0, _IONBF, 0);
+
+    const uint64_t started = clock_tic(0);
+    size_t n = 0;
+    while ((n = fread(buf, 1, MIGRATION_CHUNK_BYTES, in)) > 0) {
+        CHECK(fwrite(buf, 1, n, out) == n);
+        copied += (int64_t)n;
+
+        const uint64_t bytes_per_second = rate_of(self);
+        if (bytes_per_second) {
+            const double due_ms = 1e3 * (double)copied / bytes_per_second;
+            const double took_ms =
+              1e-6 * (double)clock_tics_to_ns(clock_tic(0) - started);
+            if (due_ms > took_ms)
+                clock_sleep_ms(0, (float)(due_ms - took_ms));
+        }
+    }
+    CHECK(!ferror(in));
+    fclose(in);
+    in = 0;
+    CHECK(fclose(out) == 0);
+    out = 0;
+    free(buf);
+    return copied;
+Error:
+    if (in)
+        fclose(in);
+    if (out)
+        fclose(out);
+    free(buf);
+    return -1;
+}
+
+/// @returns The number of bytes copied, or -1 if `job` failed.
+static int64_t
+move_file(struct migration* self, const struct migration_job* job)
+{
+    // Cheap when both are on the same volume.
+    if (rename(job->from, job->to) == 0)
+        return 0;
+
+    const size_t n = strlen(job->to) + sizeof(".part");
+    char* part = malloc(n);
+    int64_t copied = -1;
+    CHECK(part);
+    snprintf(part, n, "%s.part", job->to);
+    if ((copied = copy_file(self, job->from, part)) < 0) {
+        remove(part);
+        goto Error;
+    }
+    // Windows won't rename over a file.
+    remove(job->to);
+    if (rename(part, job->to)) {
+        remove(part);
+        copied = -1;
+        goto Error;
+    }
+    if (remove(job->from))
+        LOGE("Failed to remove \"%s\" once moved.", job->from);
+    free(part);
+    return copied;
+Error:
+    LOGE("Failed to move \"%s\" to \"%s\".", job->from, job->to);
+    free(part);
+    return -1;
+}
+
+/// Runs on `thread`, moving queued files till it's stopped and the queue is
+/// empty.
+static void
+move_queued(void* ctx)
+{
+    struct migration* self = (struct migration*)ctx;
+    struct thread_attributes attributes = { .name = "storage-migrate" };
+    thread_set_current_attributes(&attributes);
+
+    lock_acquire(&self->lock);
+    for (;;) {
+        while (!self->head && !self->is_stopping)
+            condition_variable_wait(&self->notify, &self->lock);
+        struct migration_job* job = self->head;
+        if (!job)
+            break;
+        self->head = job->next;
+        if (!self->head)
+            self->tail = 0;
+        self->is_moving = 1;
+        lock_release(&self->lock);
+
+        const int64_t copied = move_file(self, job);
+        free_job(job);
+
+        lock_acquire(&self->lock);
+        self->is_moving = 0;
+        if (copied < 0) {
+            ++self->failures;
+        } else {
+            ++self->files_moved;
+            self->bytes_copied += (uint64_t)copied;
+        }
+        condition_variable_notify_all(&self->notify);
+    }
+    lock_release(&self->lock);
+}
+
+void
+migration_init(struct migration* self)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify);
+    thread_init(&self->thread);
+}
+
+void
+migration_set_rate(struct migration* self, uint64_t bytes_per_second)
+{
+    lock_acquire(&self->lock);
+    self->bytes_per_second = bytes_per_second;
+    lock_release(&self->lock);
+}
+
+int
+migration_start(struct migration* self)
+{
+    if (self->is_running)
+        return 1;
+    lock_acquire(&self->lock);
+    self->is_stopping = 0;
+    self->files_moved = 0;
+    self->bytes_copied = 0;
+    self->failures = 0;
+    lock_release(&self->lock);
+    thread_init(&self->thread);
+    CHECK(thread_create(&self->thread, move_queued, self));
+    self->is_running = 1;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+migration_push(struct migration* self, const char* from, const char* to)
+{
+    struct migration_job* job = 0;
+    CHECK(self->is_running);
+    CHECK(job = calloc(1, sizeof(*job)));
+    CHECK(job->from = copy_path(from));
+    CHECK(job->to = copy_path(to));
+
+    lock_acquire(&self->lock);
+    if (self->tail)
+        self->tail->next = job;
+    else
+        self->head = job;
+    self->tail = job;
+    condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+    return 1;
+Error:
+    free_job(job);
+    return 0;
+}
+
+void
+migration_wait(struct migration* self)
+{
+    lock_acquire(&self->lock);
+    while (self->is_running && (self->head || self->is_moving))
+        condition_variable_wait(&self->notify, &self->lock);
+    lock_release(&self->lock);
+}
+
+int
+migration_stop(struct migration* self)
+{
+    if (!self->is_running)
+        return 1;
+    lock_acquire(&self->lock);
+    self->is_stopping = 1;
+    condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+    thread_join(&self->thread);
+    self->is_running = 0;
+    if (self->files_moved || self->failures)
+        LOG("Moved %llu staged files, copying %llu bytes. %llu failed.",
+            (unsigned long long)self->files_moved,
+            (unsigned long long)self->bytes_copied,
+            (unsigned long long)self->failures);
+    return self->failures == 0;
+}
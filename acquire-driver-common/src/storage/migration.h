@@ -0,0 +1,78 @@
+#ifndef H_ACQUIRE_STORAGE_MIGRATION_V0
+#define H_ACQUIRE_STORAGE_MIGRATION_V0
+
+#include "platform.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Size of the reads and writes files are copied with, large so the disk
+/// they're moved to sees long sequential runs.
+#define MIGRATION_CHUNK_BYTES (8ULL << 20)
+
+    struct migration_job
+    {
+        char *from, *to;
+        struct migration_job* next;
+    };
+
+    /// Moves finished files from a fast staging disk to where they're kept,
+    /// one at a time on a thread of its own, so writing them doesn't wait on
+    /// the slower disk.
+    ///
+    /// A file is renamed when it stays on the same volume. Otherwise it's
+    /// copied in `MIGRATION_CHUNK_BYTES` pieces to a ".part" file next to
+    /// where it goes, which is renamed once it's whole, so a file under its
+    /// final name is always complete. The staged file is removed after. A
+    /// file that fails to move is left where it was staged.
+    struct migration
+    {
+        struct thread thread;
+        int is_running;
+
+        /// Guarded by `lock`.
+        struct lock lock;
+        struct condition_variable notify;
+        /// Most bytes per second copies read and write. 0 for no limit.
+        uint64_t bytes_per_second;
+        struct migration_job *head, *tail;
+        int is_stopping, is_moving;
+        /// Files moved and bytes copied, and files that failed to move,
+        /// since the thread started.
+        uint64_t files_moved, bytes_copied, failures;
+    };
+
+    void migration_init(struct migration* self);
+
+    /// @brief Sets how many bytes per second copies may take, or 0 for no
+    /// limit. Takes effect from the next piece copied.
+    void migration_set_rate(struct migration* self, uint64_t bytes_per_second);
+
+    /// @brief Starts the thread, unless it's running.
+    /// @returns 1 on success, otherwise 0.
+    int migration_start(struct migration* self);
+
+    /// @brief Queues the finished file `from` to be moved to `to`, replacing
+    /// whatever is there.
+    /// @returns 1 on success, otherwise 0.
+    int migration_push(struct migration* self,
+                       const char* from,
+                       const char* to);
+
+    /// @brief Waits until every file queued has been moved, or failed to.
+    void migration_wait(struct migration* self);
+
+    /// @brief Moves what's queued, then stops the thread.
+    /// @returns 0 if any file failed to move since the thread started,
+    /// otherwise 1.
+    int migration_stop(struct migration* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_MIGRATION_V0
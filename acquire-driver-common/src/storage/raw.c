@@ -1,13 +1,19 @@
 #include "device/props/storage.h"
 #include "device/kit/storage.h"
+#include "annotation_file.h"
+#include "compact_frames.h"
+#include "durability.h"
+#include "frame_index.h"
+#include "rollover.h"
 #include "platform.h"
 #include "logger.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -23,18 +29,291 @@
 
 #define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
 
+/// raw_append() splits what it's given into writes of this size, and keeps up
+/// to RAW_MAX_WRITES_IN_FLIGHT of them in flight at once.
+#define RAW_BYTES_PER_WRITE (1ULL << 20)
+#define RAW_MAX_WRITES_IN_FLIGHT (8)
+
+/// Alignment reported for unbuffered files before one is opened. Covers
+/// devices with 512 byte and 4 KiB sectors.
+#define RAW_UNBUFFERED_ALIGNMENT_BYTES (4096)
+
+/// raw_append() reserves disk space ahead of the end of the file in chunks
+/// that double in size, from RAW_MIN_BYTES_PER_RESERVATION up to
+/// RAW_MAX_BYTES_PER_RESERVATION.
+#define RAW_MIN_BYTES_PER_RESERVATION (1ULL << 24)
+#define RAW_MAX_BYTES_PER_RESERVATION (1ULL << 30)
+
+/// Size of the window into the file that memory mapped appends copy into.
+#define RAW_BYTES_PER_MAPPING (1ULL << 26)
+
+/// Separates the paths of a URI that stripes frames over several files.
+#define RAW_STRIPE_SEPARATOR ';'
+
+/// Most packets raw_append_async() queues for the writer thread at once.
+#define RAW_MAX_QUEUED_APPENDS (64)
+
+/// A packet raw_append_async() handed to the writer thread.
+struct raw_queued_append
+{
+    const struct VideoFrame* frames;
+    size_t nbytes;
+    void (*done)(void* ctx, size_t n);
+    void* ctx;
+};
+
+/// One of the files a striped stream is spread over.
+struct raw_stripe
+{
+    char* path;
+    struct file file;
+    int is_open;
+    uint64_t offset;
+    /// The frames of the append being written that go to this file, and
+    /// their size, written back to back at `offset` by write_stripe().
+    struct file_iovec* iov;
+    size_t niov, capacity;
+    uint64_t pending;
+    int is_ok;
+    struct frame_index index;
+};
+
 struct Raw
 {
     struct Storage writer;
     struct StorageProperties properties;
     struct file file;
+    struct file_async async;
     size_t offset;
+
+    /// Set when `enable_memory_mapped_io` is. Appends are then copied into
+    /// `map`, whose window is flushed each time it moves.
+    int is_mapping;
+    struct file_map map;
+
+    /// Set when the file is unbuffered. Appends are then copied into
+    /// `staging`, which holds RAW_MAX_WRITES_IN_FLIGHT slots of
+    /// RAW_BYTES_PER_WRITE, and written out a full slot at a time.
+    int is_staging;
+    uint8_t* staging;
+    /// The slot being filled, and the number of bytes in it.
+    size_t slot, staged;
+
+    /// Set from begin_file() till finish_file().
+    int is_open;
+
+    /// Bytes from the start of the file that have been reserved on disk.
+    uint64_t reserved;
+    /// Cleared once the file system refuses a reservation.
+    int is_reserving;
+
+    /// Set when the properties ask for a new file every so many frames or
+    /// bytes. `frame_count` counts the frames in the current file.
+    int is_rolling_over;
+    struct rollover rollover;
+    uint64_t frame_count;
+
+    /// Written next to each file when `enable_frame_index` is set.
+    struct frame_index index;
+
+    /// Appends are rewritten into `compact` as shape and frame records
+    /// when `enable_compact_frame_headers` is set. `shape` is that of the
+    /// last frame record in the current file, once it has one.
+    struct
+    {
+        uint8_t* buf;
+        size_t capacity;
+        struct ImageShape shape;
+        int has_shape;
+    } compact;
+
+    /// Set when the URI lists several paths separated by
+    /// RAW_STRIPE_SEPARATOR. Frame `i` of the stream then goes to
+    /// `stripes[i % nstripes]`, and each append writes to all the files at
+    /// once, one task per file on `pool`.
+    struct raw_stripe* stripes;
+    uint32_t nstripes;
+    uint64_t frames_striped;
+    struct thread_pool pool;
+    int has_pool;
+
+    /// Packets from raw_append_async(), written in order on `queue.thread`,
+    /// which the first of them starts and raw_stop() stops. Guarded by
+    /// `queue_lock`.
+    struct
+    {
+        struct raw_queued_append packets[RAW_MAX_QUEUED_APPENDS];
+        size_t first, count;
+        struct thread thread;
+        int is_running, is_stopping, has_failed;
+    } queue;
+    struct lock queue_lock;
+    struct condition_variable notify_queue;
+
+    /// Syncs `file`, or the stripes, as `durability` in the properties asks.
+    /// Its thread only reads `file` and `is_open` with `sync_lock` held.
+    struct durability durability;
+
+    /// Records the runtime joined to the frames, in a file next to the first
+    /// one, opened with the first records handed over. See annotation_file.h.
+    struct annotation_file annotations;
 };
 
+static enum DeviceState
+raw_append_at(struct Storage* self_,
+              const struct VideoFrame* frames,
+              size_t nbytes,
+              uint64_t first_frame_index,
+              uint64_t offset);
+
+static int
+stop_queue(struct Raw* self);
+
+static uint8_t*
+current_slot(struct Raw* self)
+{
+    return self->staging + self->slot * RAW_BYTES_PER_WRITE;
+}
+
+/// Writes out the first `nbytes` of the current slot, which must be aligned,
+/// and moves on to the next slot.
+static int
+write_slot(struct Raw* self, size_t nbytes)
+{
+    const uint8_t* beg = current_slot(self);
+    CHECK(file_async_write(
+      &self->async, self->offset - self->staged, beg, beg + nbytes));
+    self->staged = 0;
+    self->slot = (self->slot + 1) % RAW_MAX_WRITES_IN_FLIGHT;
+    // Wrapping around reuses slots that may still be in flight.
+    if (self->slot == 0)
+        CHECK(file_async_wait(&self->async));
+    return 1;
+Error:
+    return 0;
+}
+
+/// Writes `[cur,end)` straight to the file, without staging it, and waits
+/// for it to land.
+static int
+write_direct(struct Raw* self, const uint8_t* cur, const uint8_t* end)
+{
+    while (cur < end) {
+        const size_t n = (size_t)(end - cur) < RAW_BYTES_PER_WRITE
+                           ? (size_t)(end - cur)
+                           : RAW_BYTES_PER_WRITE;
+        CHECK(file_async_write(&self->async, self->offset, cur, cur + n));
+        self->offset += n;
+        cur += n;
+    }
+    // The frames belong to the caller once this returns. Every slot is free
+    // again, too.
+    CHECK(file_async_wait(&self->async));
+    self->slot = 0;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+stage(struct Raw* self, const uint8_t* cur, const uint8_t* end)
+{
+    // Frames the runtime padded out to the file's alignment don't need to be
+    // copied.
+    const size_t alignment = file_alignment_bytes(&self->file);
+    if (!self->staged && (uintptr_t)cur % alignment == 0 &&
+        (size_t)(end - cur) % alignment == 0 && self->offset % alignment == 0)
+        return write_direct(self, cur, end);
+    while (cur < end) {
+        size_t n = RAW_BYTES_PER_WRITE - self->staged;
+        if ((size_t)(end - cur) < n)
+            n = end - cur;
+        memcpy(current_slot(self) + self->staged, cur, n); // NOLINT
+        self->staged += n;
+        self->offset += n;
+        cur += n;
+        if (self->staged == RAW_BYTES_PER_WRITE)
+            CHECK(write_slot(self, RAW_BYTES_PER_WRITE));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Writes out whatever is staged, padded to the file's alignment, then cuts
+/// the padding off the end of the file.
+static int
+flush_staging(struct Raw* self)
+{
+    int is_ok = 1;
+    if (self->staged) {
+        const size_t padded = file_align_up(&self->file, self->staged);
+        memset(current_slot(self) + self->staged, // NOLINT
+               0,
+               padded - self->staged);
+        is_ok = write_slot(self, padded);
+    }
+    is_ok &= file_async_wait(&self->async);
+    is_ok &= file_truncate(&self->file, self->offset);
+    return is_ok;
+}
+
+/// Makes sure disk space is reserved up to `end`, reserving the next chunk
+/// when it isn't.
+static void
+reserve(struct Raw* self, uint64_t end)
+{
+    if (!self->is_reserving || end <= self->reserved)
+        return;
+    uint64_t n = self->reserved;
+    if (n < RAW_MIN_BYTES_PER_RESERVATION)
+        n = RAW_MIN_BYTES_PER_RESERVATION;
+    if (n > RAW_MAX_BYTES_PER_RESERVATION)
+        n = RAW_MAX_BYTES_PER_RESERVATION;
+    if (n < end - self->reserved)
+        n = end - self->reserved;
+    if (file_preallocate(&self->file, self->reserved, n))
+        self->reserved += n;
+    else
+        self->is_reserving = 0;
+}
+
+/// @returns The number of paths in `uri`.
+static uint32_t
+count_paths(const char* uri)
+{
+    uint32_t n = 1;
+    for (const char* c = uri; *c; ++c)
+        n += *c == RAW_STRIPE_SEPARATOR;
+    return n;
+}
+
+/// @returns A copy of the `i`th path in `uri` without any "file://" prefix,
+/// for the caller to free, or NULL if it's out of memory.
+static char*
+copy_path(const char* uri, uint32_t i)
+{
+    const char* beg = uri;
+    for (; i; --i)
+        beg = strchr(beg, RAW_STRIPE_SEPARATOR) + 1;
+    const char* end = strchr(beg, RAW_STRIPE_SEPARATOR);
+    if (!end)
+        end = beg + strlen(beg);
+    if (end - beg >= 7 && strncmp(beg, "file://", 7) == 0)
+        beg += 7;
+    char* out = malloc(end - beg + 1);
+    if (out) {
+        memcpy(out, beg, end - beg); // NOLINT
+        out[end - beg] = '\0';
+    }
+    return out;
+}
+
 static enum DeviceState
 raw_set(struct Storage* self_, const struct StorageProperties* properties)
 {
     struct Raw* self = containerof(self_, struct Raw, writer);
+    char* path = 0;
     CHECK(properties->uri.str);
     CHECK(properties->uri.nbytes);
 
@@ -46,7 +325,29 @@ raw_set(struct Storage* self_, const struct StorageProperties* properties)
     const size_t nbytes = properties->uri.nbytes - offset;
 
     // Validate
-    CHECK(file_is_writable(filename, nbytes));
+    const uint32_t npaths = count_paths(filename);
+    if (npaths == 1) {
+        CHECK(file_is_writable(filename, nbytes));
+    } else {
+        if (properties->enable_unbuffered_io ||
+            properties->enable_memory_mapped_io ||
+            properties->max_frames_per_file ||
+            properties->max_bytes_per_file ||
+            properties->enable_compact_frame_headers) {
+            LOGE("RAW: Striped files can't be unbuffered, memory mapped, "
+                 "rolled over or have compact frame headers.");
+            goto Error;
+        }
+        for (uint32_t i = 0; i < npaths; ++i) {
+            CHECK(path = copy_path(filename, i));
+            CHECK(*path);
+            CHECK(file_is_writable(path, strlen(path) + 1));
+            free(path);
+            path = 0;
+        }
+    }
+
+    CHECK(durability_set(&self->durability, properties));
 
     // copy in the properties
     CHECK(storage_properties_copy(&self->properties, properties));
@@ -58,6 +359,7 @@ raw_set(struct Storage* self_, const struct StorageProperties* properties)
 
     return DeviceState_Armed;
 Error:
+    free(path);
     return DeviceState_AwaitingConfiguration;
 }
 
@@ -72,17 +374,307 @@ static void
 raw_get_meta(const struct Storage* self_, struct StoragePropertyMetadata* meta)
 {
     CHECK(meta);
-    *meta = (struct StoragePropertyMetadata){ 0 };
+    const struct Raw* self = containerof(self_, struct Raw, writer);
+    const struct StorageProperties* props = &self->properties;
+    const int is_unbuffered =
+      !props->enable_memory_mapped_io && props->enable_unbuffered_io;
+    *meta = (struct StoragePropertyMetadata){
+        .unbuffered_io_is_supported = 1,
+        .memory_mapped_io_is_supported = 1,
+        .rollover_is_supported = 1,
+        .frame_index_is_supported = 1,
+        .compact_frame_headers_are_supported = 1,
+        .durability_is_supported = 1,
+        // Compact headers have no room for the compressed size.
+        .compressed_frames_are_supported =
+          !props->enable_compact_frame_headers,
+        .io_alignment_bytes =
+          is_unbuffered ? RAW_UNBUFFERED_ALIGNMENT_BYTES : 0,
+        .preferred_append_bytes = RAW_BYTES_PER_WRITE,
+        .max_appends_in_flight = RAW_MAX_QUEUED_APPENDS,
+        // Matches when raw_start() allows appends at arbitrary offsets.
+        .concurrent_append_is_supported =
+          !is_unbuffered && !props->enable_memory_mapped_io &&
+          !props->max_frames_per_file && !props->max_bytes_per_file &&
+          !props->enable_frame_index && !props->enable_compact_frame_headers &&
+          (!props->uri.str || count_paths(props->uri.str) <= 1),
+    };
 Error:
     return;
 }
 
+static uint32_t
+file_create_flags(const struct Raw* self)
+{
+    return !self->properties.enable_memory_mapped_io &&
+               self->properties.enable_unbuffered_io
+             ? FileCreate_Unbuffered
+             : 0;
+}
+
+static int
+finish_file(struct Raw* self);
+
+/// Gets ready to write to `self->file`, just opened at `path` with `reserved`
+/// bytes reserved on disk. Closes it on failure.
+static int
+begin_file(struct Raw* self, const char* path, uint64_t reserved)
+{
+    const int is_mapping = self->properties.enable_memory_mapped_io;
+    if (!file_async_init(&self->async, &self->file, RAW_MAX_WRITES_IN_FLIGHT)) {
+        file_close(&self->file);
+        goto Error;
+    }
+    self->offset = 0;
+    self->slot = 0;
+    self->staged = 0;
+    self->reserved = reserved;
+    self->is_reserving = 1;
+    self->frame_count = 0;
+    self->compact.has_shape = 0;
+    self->is_staging = file_alignment_bytes(&self->file) > 1;
+    if (self->is_staging) {
+        CHECK(RAW_BYTES_PER_WRITE % file_alignment_bytes(&self->file) == 0);
+        if (!self->staging)
+            CHECK(self->staging =
+                    memory_alloc(RAW_MAX_WRITES_IN_FLIGHT * RAW_BYTES_PER_WRITE,
+                                 AllocatorHint_Default));
+    }
+    if (is_mapping) {
+        if (!file_map_init(&self->map, &self->file, RAW_BYTES_PER_MAPPING)) {
+            file_async_destroy(&self->async);
+            file_close(&self->file);
+            goto Error;
+        }
+        self->is_mapping = 1;
+    }
+    lock_acquire(&self->durability.sync_lock);
+    self->is_open = 1;
+    lock_release(&self->durability.sync_lock);
+    if (self->properties.enable_frame_index &&
+        !frame_index_open(&self->index, path)) {
+        finish_file(self);
+        return 0;
+    }
+    return 1;
+Error:
+    if (self->is_staging) {
+        self->is_staging = 0;
+        file_async_destroy(&self->async);
+        file_close(&self->file);
+    }
+    return 0;
+}
+
+/// Writes out what's left for the current file, and closes it.
+static int
+finish_file(struct Raw* self)
+{
+    if (!self->is_open)
+        return 1;
+    int is_ok = 1;
+    if (self->is_mapping) {
+        if (!file_map_destroy(&self->map, self->offset))
+            is_ok = 0;
+    } else if (self->is_staging) {
+        if (!flush_staging(self))
+            is_ok = 0;
+    } else if (self->reserved > self->offset) {
+        // Give back the space reserved past the last write.
+        if (!file_truncate(&self->file, self->offset))
+            is_ok = 0;
+    }
+    self->reserved = 0;
+    self->is_staging = 0;
+    self->is_mapping = 0;
+    file_async_destroy(&self->async);
+    lock_acquire(&self->durability.sync_lock);
+    if (!durability_sync_file(&self->durability, &self->file))
+        is_ok = 0;
+    file_close(&self->file);
+    self->is_open = 0;
+    lock_release(&self->durability.sync_lock);
+    // Records are only written once their frames are.
+    if (!frame_index_close(&self->index))
+        is_ok = 0;
+    return is_ok;
+}
+
+/// Writes out what's left for each file of a striped stream, and closes
+/// them.
+static int
+stop_stripes(struct Raw* self)
+{
+    int is_ok = 1;
+    if (self->has_pool)
+        thread_pool_stop(&self->pool);
+    self->has_pool = 0;
+    for (uint32_t i = 0; i < self->nstripes; ++i) {
+        struct raw_stripe* stripe = self->stripes + i;
+        if (stripe->is_open) {
+            // The file may be left over from a longer stream.
+            if (!file_truncate(&stripe->file, stripe->offset) ||
+                !durability_sync_file(&self->durability, &stripe->file))
+                is_ok = 0;
+            file_close(&stripe->file);
+        }
+        if (!frame_index_close(&stripe->index))
+            is_ok = 0;
+        frame_index_destroy(&stripe->index);
+        free(stripe->iov);
+        free(stripe->path);
+    }
+    free(self->stripes);
+    self->stripes = 0;
+    self->nstripes = 0;
+    return is_ok;
+}
+
+/// Appends `s` to `json` as a JSON string, escaping what needs it.
+/// @returns The end of what was written.
+static char*
+append_json_string(char* json, const char* s)
+{
+    *json++ = '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            *json++ = '\\';
+        *json++ = *s;
+    }
+    *json++ = '"';
+    return json;
+}
+
+/// Writes the layout of a striped stream next to its first file, as
+/// "out.raw.stripes.json" for "out.raw": the files in order, and how many
+/// frames go to each in turn.
+static int
+write_stripe_manifest(const struct Raw* self)
+{
+    static const char head[] = "{\"stripes\":[";
+    static const char tail[] = "],\"frames_per_stripe\":1}\n";
+    static const char suffix[] = ".stripes.json";
+    char *json = 0, *path = 0;
+    struct file file = { 0 };
+    int is_open = 0;
+
+    size_t nbytes = sizeof(head) + sizeof(tail);
+    for (uint32_t i = 0; i < self->nstripes; ++i)
+        nbytes += 2 * strlen(self->stripes[i].path) + 3;
+    CHECK(json = malloc(nbytes));
+    char* end = json;
+    memcpy(end, head, sizeof(head) - 1); // NOLINT
+    end += sizeof(head) - 1;
+    for (uint32_t i = 0; i < self->nstripes; ++i) {
+        if (i)
+            *end++ = ',';
+        end = append_json_string(end, self->stripes[i].path);
+    }
+    memcpy(end, tail, sizeof(tail) - 1); // NOLINT
+    end += sizeof(tail) - 1;
+
+    const size_t bytes_of_path = strlen(self->stripes[0].path) + sizeof(suffix);
+    CHECK(path = malloc(bytes_of_path));
+    snprintf(path, bytes_of_path, "%s%s", self->stripes[0].path, suffix);
+    CHECK(file_create(&file, path, bytes_of_path));
+    is_open = 1;
+    CHECK(file_truncate(&file, 0));
+    CHECK(file_write(&file, 0, (const uint8_t*)json, (const uint8_t*)end));
+    file_close(&file);
+    free(path);
+    free(json);
+    return 1;
+Error:
+    if (is_open)
+        file_close(&file);
+    free(path);
+    free(json);
+    return 0;
+}
+
+/// Opens the files of a striped stream, writes its manifest, and starts a
+/// thread for each file but one. The thread calling raw_append() writes too.
+static int
+start_stripes(struct Raw* self)
+{
+    const uint32_t n = count_paths(self->properties.uri.str);
+    CHECK(self->stripes = calloc(n, sizeof(*self->stripes)));
+    self->nstripes = n;
+    self->frames_striped = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        struct raw_stripe* stripe = self->stripes + i;
+        CHECK(stripe->path = copy_path(self->properties.uri.str, i));
+        if (!file_create(
+              &stripe->file, stripe->path, strlen(stripe->path) + 1)) {
+            LOGE("RAW: Failed to create \"%s\"", stripe->path);
+            goto Error;
+        }
+        stripe->is_open = 1;
+        if (self->properties.enable_frame_index)
+            CHECK(frame_index_open(&stripe->index, stripe->path));
+    }
+    CHECK(write_stripe_manifest(self));
+    {
+        struct thread_attributes attributes = { .name = "raw-stripe" };
+        CHECK(thread_pool_start(&self->pool, n - 1, &attributes));
+        self->has_pool = 1;
+    }
+    self->writer.append_at = 0;
+    LOG("RAW: Striping frames over %u files", n);
+    return 1;
+Error:
+    stop_stripes(self);
+    return 0;
+}
+
 static enum DeviceState
 raw_start(struct Storage* self_)
 {
     struct Raw* self = containerof(self_, struct Raw, writer);
-    CHECK(file_create(
-      &self->file, self->properties.uri.str, self->properties.uri.nbytes));
+    if (count_paths(self->properties.uri.str) > 1) {
+        CHECK(start_stripes(self));
+        if (!durability_start(&self->durability)) {
+            stop_stripes(self);
+            goto Error;
+        }
+        return DeviceState_Running;
+    }
+    CHECK(file_create_with_flags(&self->file,
+                                 self->properties.uri.str,
+                                 self->properties.uri.nbytes,
+                                 file_create_flags(self)));
+    CHECK(begin_file(self, self->properties.uri.str, 0));
+    self->is_rolling_over = self->properties.max_frames_per_file > 0 ||
+                            self->properties.max_bytes_per_file > 0;
+    if (self->is_rolling_over &&
+        !rollover_init(&self->rollover,
+                       self->properties.max_frames_per_file,
+                       self->properties.max_bytes_per_file,
+                       self->properties.uri.str,
+                       strlen(self->properties.uri.str),
+                       file_create_flags(self),
+                       RAW_MIN_BYTES_PER_RESERVATION)) {
+        self->is_rolling_over = 0;
+        finish_file(self);
+        goto Error;
+    }
+    if (!durability_start(&self->durability)) {
+        if (self->is_rolling_over)
+            rollover_destroy(&self->rollover);
+        self->is_rolling_over = 0;
+        finish_file(self);
+        goto Error;
+    }
+    // Packets written at arbitrary offsets can't be aligned, only one
+    // thread at a time may move the mapped window, offsets past a rollover
+    // would land in the wrong file, and the index and shape records are kept
+    // in order.
+    self->writer.append_at =
+      self->is_staging || self->is_mapping || self->is_rolling_over ||
+          self->properties.enable_frame_index ||
+          self->properties.enable_compact_frame_headers
+        ? 0
+        : raw_append_at;
     LOG("RAW: Frame header size %d bytes", (int)sizeof(struct VideoFrame));
     return DeviceState_Running;
 Error:
@@ -93,34 +685,462 @@ static enum DeviceState
 raw_stop(struct Storage* self_)
 {
     struct Raw* self = containerof(self_, struct Raw, writer);
-    file_close(&self->file);
+    if (!stop_queue(self))
+        LOGE("RAW: Failed to write \"%s\"", self->properties.uri.str);
+    if (!durability_stop(&self->durability))
+        LOGE("RAW: Failed to sync \"%s\"", self->properties.uri.str);
+    if (self->annotations.is_open &&
+        !durability_sync_file(&self->durability, &self->annotations.file))
+        LOGE("RAW: Failed to sync the annotations of \"%s\"",
+             self->properties.uri.str);
+    annotation_file_close(&self->annotations);
+    if (self->stripes) {
+        if (!stop_stripes(self))
+            LOGE("RAW: Failed to finish writing \"%s\"",
+                 self->properties.uri.str);
+        return DeviceState_Armed;
+    }
+    if (!finish_file(self))
+        LOGE("RAW: Failed to finish writing \"%s\"", self->properties.uri.str);
+    if (self->is_rolling_over)
+        rollover_destroy(&self->rollover);
+    self->is_rolling_over = 0;
     return DeviceState_Armed;
 }
 
+/// Closes the current file and moves on to the next one in the series.
+static int
+roll_over(struct Raw* self)
+{
+    if (!finish_file(self))
+        LOGE("RAW: Failed to finish writing \"%s\"", self->properties.uri.str);
+    uint64_t reserved = 0;
+    CHECK(rollover_next(&self->rollover, &self->file, &reserved));
+    CHECK(begin_file(self, rollover_current_path(&self->rollover), reserved));
+    return 1;
+Error:
+    return 0;
+}
+
+/// Writes `[beg,end)` at the end of the current file, then the index
+/// records queued for it.
+static int
+write_bytes(struct Raw* self, const uint8_t* beg, const uint8_t* end)
+{
+    const size_t nbytes = end - beg;
+    reserve(self, self->offset + nbytes);
+    if (self->is_mapping) {
+        uint8_t* dst = 0;
+        CHECK(dst = file_map_at(&self->map, self->offset, nbytes));
+        memcpy(dst, beg, nbytes); // NOLINT
+        self->offset += nbytes;
+        return frame_index_flush(&self->index);
+    }
+    if (self->is_staging)
+        return stage(self, beg, end) && frame_index_flush(&self->index);
+    CHECK(write_direct(self, beg, end));
+    return frame_index_flush(&self->index);
+Error:
+    return 0;
+}
+
+static size_t
+align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/// Rewrites `nbytes` of `frames` into `compact` as the records described in
+/// compact_frames.h, and writes them to the current file.
+static int
+append_compact(struct Raw* self,
+               const struct VideoFrame* frames,
+               size_t nbytes)
+{
+    // Records are never bigger than the frames they're made from, save for
+    // the file header and a shape record per frame.
+    const uint8_t* const end = ((const uint8_t*)frames) + nbytes;
+    size_t capacity = sizeof(struct compact_file_header) + nbytes;
+    for (const uint8_t* cur = (const uint8_t*)frames; cur < end;
+         cur += ((const struct VideoFrame*)cur)->bytes_of_frame)
+        capacity += sizeof(struct compact_shape_record);
+    if (self->compact.capacity < capacity) {
+        uint8_t* buf = realloc(self->compact.buf, capacity);
+        CHECK(buf);
+        self->compact.buf = buf;
+        self->compact.capacity = capacity;
+    }
+
+    uint8_t* out = self->compact.buf;
+    if (!self->offset) {
+        struct compact_file_header header = {
+            .version = COMPACT_FRAMES_VERSION,
+        };
+        memcpy(header.magic, COMPACT_FRAMES_MAGIC, sizeof(header.magic));
+        memcpy(out, &header, sizeof(header));         // NOLINT
+        out += sizeof(header);
+    }
+    for (const uint8_t* cur = (const uint8_t*)frames; cur < end;) {
+        const struct VideoFrame* frame = (const struct VideoFrame*)cur;
+        if (frame->compression != FrameCompression_None) {
+            LOGE("RAW: Can't write compressed frames with compact headers.");
+            goto Error;
+        }
+        if (!self->compact.has_shape ||
+            memcmp(&self->compact.shape, &frame->shape, sizeof(frame->shape))) {
+            struct compact_shape_record record = {
+                .record = { .kind = CompactRecord_Shape,
+                            .bytes_of_record = sizeof(record) },
+                .shape = frame->shape,
+            };
+            memcpy(out, &record, sizeof(record)); // NOLINT
+            out += sizeof(record);
+            self->compact.shape = frame->shape;
+            self->compact.has_shape = 1;
+        }
+        const size_t bytes_of_pixels = bytes_of_image(&frame->shape);
+        const size_t bytes_of_record =
+          align8(sizeof(struct compact_frame_header) + bytes_of_pixels);
+        const struct compact_frame_header header = {
+            .record = { .kind = CompactRecord_Frame,
+                        .bytes_of_record = (uint32_t)bytes_of_record },
+            .frame_id = frame->frame_id,
+            .hardware_frame_id = frame->hardware_frame_id,
+            .hardware_timestamp = frame->timestamps.hardware,
+            .runtime_timestamp = frame->timestamps.acq_thread,
+            .stage_position = frame->stage_position,
+            .has_stage_position = frame->has_stage_position,
+            .checksum = frame->checksum,
+            .has_checksum = frame->has_checksum,
+        };
+        if (self->properties.enable_frame_index)
+            CHECK(frame_index_add(&self->index,
+                                  frame,
+                                  self->offset + (out - self->compact.buf),
+                                  bytes_of_record));
+        uint8_t* const pixels = out + sizeof(header);
+        memcpy(out, &header, sizeof(header));         // NOLINT
+        memcpy(pixels, frame->data, bytes_of_pixels); // NOLINT
+        memset(pixels + bytes_of_pixels,              // NOLINT
+               0,
+               bytes_of_record - sizeof(header) - bytes_of_pixels);
+        out += bytes_of_record;
+        cur += frame->bytes_of_frame;
+    }
+    return write_bytes(self, self->compact.buf, out);
+Error:
+    return 0;
+}
+
+/// Writes `nbytes` of `frames` to the current file.
+static int
+append_to_file(struct Raw* self,
+               const struct VideoFrame* frames,
+               size_t nbytes)
+{
+    if (self->properties.enable_compact_frame_headers)
+        return append_compact(self, frames, nbytes);
+    const uint8_t* const end = ((const uint8_t*)frames) + nbytes;
+    if (self->properties.enable_frame_index) {
+        for (const uint8_t* cur = (const uint8_t*)frames; cur < end;) {
+            const struct VideoFrame* frame = (const struct VideoFrame*)cur;
+            CHECK(frame_index_add(&self->index,
+                                  frame,
+                                  self->offset + (cur - (const uint8_t*)frames),
+                                  frame->bytes_of_frame));
+            cur += frame->bytes_of_frame;
+        }
+    }
+    return write_bytes(self, (const uint8_t*)frames, end);
+Error:
+    return 0;
+}
+
+static void
+write_stripe(void* ctx)
+{
+    struct raw_stripe* stripe = ctx;
+    stripe->is_ok =
+      file_writev(&stripe->file, stripe->offset, stripe->iov, stripe->niov);
+    stripe->offset += stripe->pending;
+}
+
+/// Deals `nbytes` of `frames` out to the files of a striped stream, then
+/// writes each file's share at once.
+static int
+append_to_stripes(struct Raw* self,
+                  const struct VideoFrame* frames,
+                  size_t nbytes)
+{
+    const uint8_t* const end = ((const uint8_t*)frames) + nbytes;
+    for (const uint8_t* cur = (const uint8_t*)frames; cur < end;) {
+        const struct VideoFrame* frame = (const struct VideoFrame*)cur;
+        struct raw_stripe* stripe =
+          self->stripes + self->frames_striped++ % self->nstripes;
+        if (stripe->niov == stripe->capacity) {
+            const size_t capacity =
+              stripe->capacity ? 2 * stripe->capacity : 16;
+            struct file_iovec* iov =
+              realloc(stripe->iov, capacity * sizeof(*iov));
+            CHECK(iov);
+            stripe->iov = iov;
+            stripe->capacity = capacity;
+        }
+        stripe->iov[stripe->niov++] =
+          (struct file_iovec){ cur, cur + frame->bytes_of_frame };
+        if (self->properties.enable_frame_index)
+            CHECK(frame_index_add(&stripe->index,
+                                  frame,
+                                  stripe->offset + stripe->pending,
+                                  frame->bytes_of_frame));
+        stripe->pending += frame->bytes_of_frame;
+        cur += frame->bytes_of_frame;
+    }
+
+    struct latch latch;
+    latch_init(&latch, 0);
+    for (uint32_t i = 0; i < self->nstripes; ++i) {
+        struct raw_stripe* stripe = self->stripes + i;
+        stripe->is_ok = 1;
+        if (stripe->niov) {
+            latch_add(&latch, 1);
+            thread_pool_submit(&self->pool, write_stripe, stripe, &latch);
+        }
+    }
+    // The frames belong to the caller once this returns.
+    thread_pool_wait(&self->pool, &latch);
+
+    int is_ok = 1;
+    for (uint32_t i = 0; i < self->nstripes; ++i) {
+        struct raw_stripe* stripe = self->stripes + i;
+        if (!stripe->is_ok) {
+            LOGE("RAW: Failed to write \"%s\"", stripe->path);
+            is_ok = 0;
+        }
+        stripe->niov = 0;
+        stripe->pending = 0;
+        if (!frame_index_flush(&stripe->index))
+            is_ok = 0;
+    }
+    return is_ok;
+Error:
+    return 0;
+}
+
+/// Writes `nbytes` of `frames` to wherever they go: the stripes, the current
+/// file, or the files of a rollover series.
+static int
+append(struct Raw* self, const struct VideoFrame* frames, size_t nbytes)
+{
+    durability_wrote(&self->durability, nbytes);
+    if (self->stripes)
+        return append_to_stripes(self, frames, nbytes);
+    if (!self->is_rolling_over)
+        return append_to_file(self, frames, nbytes);
+    const uint8_t* cur = (const uint8_t*)frames;
+    const uint8_t* const end = cur + nbytes;
+    while (cur < end) {
+        uint64_t nframes = 0;
+        const size_t n = rollover_fit(&self->rollover,
+                                      (const struct VideoFrame*)cur,
+                                      end - cur,
+                                      self->frame_count,
+                                      self->offset,
+                                      &nframes);
+        if (!n) {
+            CHECK(roll_over(self));
+            continue;
+        }
+        CHECK(append_to_file(self, (const struct VideoFrame*)cur, n));
+        self->frame_count += nframes;
+        cur += n;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
 static enum DeviceState
 raw_append(struct Storage* self_,
            const struct VideoFrame* frames,
            size_t* nbytes)
 {
     struct Raw* self = containerof(self_, struct Raw, writer);
-    CHECK(file_write(&self->file,
-                     self->offset,
-                     (uint8_t*)frames,
-                     ((uint8_t*)frames) + *nbytes));
-    self->offset += *nbytes;
+    if (!append(self, frames, *nbytes)) {
+        *nbytes = 0;
+        return raw_stop(self_);
+    }
+    return DeviceState_Running;
+}
+
+/// Runs on `queue.thread`, writing packets in the order they were queued
+/// until it's stopped and none are left.
+static void
+write_queued_appends(void* ctx)
+{
+    struct Raw* self = (struct Raw*)ctx;
+    struct thread_attributes attributes = { .name = "raw-writer" };
+    thread_set_current_attributes(&attributes);
+
+    lock_acquire(&self->queue_lock);
+    while (1) {
+        while (!self->queue.is_stopping && !self->queue.count)
+            condition_variable_wait(&self->notify_queue, &self->queue_lock);
+        if (!self->queue.count)
+            break;
+        const struct raw_queued_append packet =
+          self->queue.packets[self->queue.first];
+        const int has_failed = self->queue.has_failed;
+        lock_release(&self->queue_lock);
 
+        // Once a packet fails to write, the rest are only reported done.
+        const int ok =
+          !has_failed && append(self, packet.frames, packet.nbytes);
+        packet.done(packet.ctx, packet.nbytes);
+
+        lock_acquire(&self->queue_lock);
+        if (!ok)
+            self->queue.has_failed = 1;
+        self->queue.first = (self->queue.first + 1) % RAW_MAX_QUEUED_APPENDS;
+        --self->queue.count;
+        condition_variable_notify_all(&self->notify_queue);
+    }
+    lock_release(&self->queue_lock);
+}
+
+static int
+start_queue(struct Raw* self)
+{
+    self->queue.first = 0;
+    self->queue.count = 0;
+    self->queue.is_stopping = 0;
+    self->queue.has_failed = 0;
+    CHECK(thread_create(&self->queue.thread, write_queued_appends, self));
+    self->queue.is_running = 1;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Waits for the writer thread to write every queued packet, then joins it.
+/// @returns 0 if any packet failed to write, otherwise 1.
+static int
+stop_queue(struct Raw* self)
+{
+    if (!self->queue.is_running)
+        return 1;
+    lock_acquire(&self->queue_lock);
+    self->queue.is_stopping = 1;
+    condition_variable_notify_all(&self->notify_queue);
+    lock_release(&self->queue_lock);
+    thread_join(&self->queue.thread);
+    self->queue.is_running = 0;
+    return !self->queue.has_failed;
+}
+
+/// Queues the packet for the writer thread, only waiting while the queue is
+/// full.
+static enum DeviceState
+raw_append_async(struct Storage* self_,
+                 const struct VideoFrame* frames,
+                 size_t nbytes,
+                 void (*done)(void* ctx, size_t n),
+                 void* ctx)
+{
+    struct Raw* self = containerof(self_, struct Raw, writer);
+    if (!self->queue.is_running)
+        CHECK(start_queue(self));
+
+    lock_acquire(&self->queue_lock);
+    while (self->queue.count == RAW_MAX_QUEUED_APPENDS)
+        condition_variable_wait(&self->notify_queue, &self->queue_lock);
+    const int has_failed = self->queue.has_failed;
+    if (!has_failed) {
+        self->queue.packets[(self->queue.first + self->queue.count) %
+                            RAW_MAX_QUEUED_APPENDS] =
+          (struct raw_queued_append){
+              .frames = frames, .nbytes = nbytes, .done = done, .ctx = ctx
+          };
+        ++self->queue.count;
+        condition_variable_notify_all(&self->notify_queue);
+    }
+    lock_release(&self->queue_lock);
+    CHECK(!has_failed);
     return DeviceState_Running;
 Error:
-    *nbytes = 0;
+    done(ctx, nbytes);
     return raw_stop(self_);
 }
 
+/// Frames land at the same place `raw_append` would put them, so packets
+/// can be written in any order.
+static enum DeviceState
+raw_append_at(struct Storage* self_,
+              const struct VideoFrame* frames,
+              size_t nbytes,
+              uint64_t first_frame_index,
+              uint64_t offset)
+{
+    struct Raw* self = containerof(self_, struct Raw, writer);
+    CHECK(file_write(&self->file,
+                     offset,
+                     (const uint8_t*)frames,
+                     ((const uint8_t*)frames) + nbytes));
+    durability_wrote(&self->durability, nbytes);
+    return DeviceState_Running;
+Error:
+    return DeviceState_AwaitingConfiguration;
+}
+
+/// Writes `annotations` to the file of records next to the first file,
+/// creating it on first use.
+static enum DeviceState
+raw_append_annotations(struct Storage* self_,
+                       const struct FrameAnnotation* annotations,
+                       size_t nbytes)
+{
+    struct Raw* self = containerof(self_, struct Raw, writer);
+    char* path = 0;
+    if (!self->annotations.is_open) {
+        CHECK(path = copy_path(self->properties.uri.str, 0));
+        CHECK(annotation_file_open(&self->annotations, path));
+        free(path);
+        path = 0;
+    }
+    CHECK(annotation_file_append(&self->annotations, annotations, nbytes));
+    return DeviceState_Running;
+Error:
+    free(path);
+    LOGE("RAW: Failed to write the annotations of \"%s\"",
+         self->properties.uri.str);
+    return DeviceState_AwaitingConfiguration;
+}
+
+/// Syncs what's been written to the files open so far, for `durability`.
+static int
+sync_files(void* ctx)
+{
+    const struct Raw* self = (const struct Raw*)ctx;
+    int is_ok = 1;
+    for (uint32_t i = 0; i < self->nstripes; ++i)
+        if (self->stripes[i].is_open &&
+            !file_datasync(&self->stripes[i].file))
+            is_ok = 0;
+    if (self->is_open && !file_datasync(&self->file))
+        is_ok = 0;
+    return is_ok;
+}
+
 static void
 raw_destroy(struct Storage* writer_)
 {
     struct Raw* self = containerof(writer_, struct Raw, writer);
     raw_stop(writer_);
+    frame_index_destroy(&self->index);
+    free(self->compact.buf);
     storage_properties_destroy(&self->properties);
+    if (self->staging)
+        memory_free(self->staging);
     free(self);
 }
 
@@ -154,7 +1174,14 @@ raw_init()
                         .append = raw_append,
                         .stop = raw_stop,
                         .destroy = raw_destroy,
-                        .reserve_image_shape = raw_reserve_image_shape };
+                        .reserve_image_shape = raw_reserve_image_shape,
+                        .append_at = raw_append_at,
+                        .append_async = raw_append_async,
+                        .append_annotations = raw_append_annotations };
+    lock_init(&self->queue_lock);
+    condition_variable_init(&self->notify_queue);
+    thread_init(&self->queue.thread);
+    durability_init(&self->durability, sync_files, self);
     return &self->writer;
 Error:
     return 0;
@@ -0,0 +1,305 @@
+#include "raw_reader.h"
+#include "compact_frames.h"
+#include "frame_index.h"
+#include "device/props/components.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+static int
+push_frame(struct raw_reader* self, uint64_t offset, uint64_t nbytes)
+{
+    if (self->nframes == self->capacity) {
+        const size_t capacity = self->capacity ? 2 * self->capacity : 256;
+        uint64_t* offsets =
+          realloc(self->offsets, capacity * sizeof(*offsets));
+        CHECK(offsets);
+        self->offsets = offsets;
+        if (self->is_compact) {
+            uint64_t* shapes =
+              realloc(self->shapes, capacity * sizeof(*shapes));
+            CHECK(shapes);
+            self->shapes = shapes;
+        }
+        self->capacity = capacity;
+    }
+    if (self->is_compact)
+        self->shapes[self->nframes] = self->shape;
+    self->offsets[self->nframes++] = offset;
+    self->end = offset + nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+/// @returns The size of the frame at `offset` if all of it is in the file,
+/// otherwise 0.
+static uint64_t
+frame_at(const struct raw_reader* self, uint64_t offset)
+{
+    const struct VideoFrame* frame = 0;
+    if (offset + sizeof(*frame) > self->view.nbytes)
+        return 0;
+    frame = (const struct VideoFrame*)(self->view.data + offset);
+    // Space a writer has reserved but not written yet reads as zeros.
+    const size_t bytes_of_data = frame->compression != FrameCompression_None
+                                   ? frame->bytes_of_data
+                                   : bytes_of_image(&frame->shape);
+    if (frame->bytes_of_frame < sizeof(*frame) ||
+        frame->bytes_of_frame > self->view.nbytes - offset ||
+        (unsigned)frame->shape.type >= SampleTypeCount ||
+        frame->bytes_of_frame - sizeof(*frame) < bytes_of_data)
+        return 0;
+    return frame->bytes_of_frame;
+}
+
+/// @returns The record at `offset` of a compact file if all of it is in the
+/// file, otherwise 0.
+static const struct compact_record*
+record_at(const struct raw_reader* self, uint64_t offset)
+{
+    const struct compact_record* record = 0;
+    if (offset + sizeof(*record) > self->view.nbytes)
+        return 0;
+    record = (const struct compact_record*)(self->view.data + offset);
+    if (record->bytes_of_record < sizeof(*record) ||
+        record->bytes_of_record > self->view.nbytes - offset)
+        return 0;
+    switch (record->kind) {
+        case CompactRecord_Shape:
+            return record->bytes_of_record >=
+                       sizeof(struct compact_shape_record)
+                     ? record
+                     : 0;
+        case CompactRecord_Frame: {
+            const struct compact_shape_record* shape =
+              (const struct compact_shape_record*)(self->view.data +
+                                                   self->shape);
+            // A frame needs a shape before it.
+            return self->shape && record->bytes_of_record >=
+                                    self->bytes_of_frame_header +
+                                      bytes_of_image(&shape->shape)
+                     ? record
+                     : 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+/// Finds the frames of a compact file past those found already.
+static int
+read_records(struct raw_reader* self)
+{
+    if (!self->end) {
+        const struct compact_file_header* header =
+          (const struct compact_file_header*)self->view.data;
+        if (self->view.nbytes < sizeof(*header))
+            return 1;
+        self->end = sizeof(*header);
+    }
+    for (const struct compact_record* record = 0;
+         (record = record_at(self, self->end));) {
+        if (record->kind == CompactRecord_Shape) {
+            self->shape = self->end;
+            self->end += record->bytes_of_record;
+        } else {
+            CHECK(push_frame(self, self->end, record->bytes_of_record));
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// @returns The bytes a frame header takes if `view` starts like a file with
+/// compact frame headers, otherwise 0.
+static size_t
+compact_frame_header_bytes(const struct file_view* view)
+{
+    const struct compact_file_header* header =
+      (const struct compact_file_header*)view->data;
+    if (view->nbytes < sizeof(*header) ||
+        memcmp(header->magic, COMPACT_FRAMES_MAGIC, sizeof(header->magic)))
+        return 0;
+    switch (header->version) {
+        case 1:
+            return COMPACT_FRAMES_V1_BYTES_OF_FRAME_HEADER;
+        case COMPACT_FRAMES_VERSION:
+            return sizeof(struct compact_frame_header);
+        default:
+            return 0;
+    }
+}
+
+/// Takes the frames listed in the index past those found already, as long as
+/// they're in the file, without touching the frames themselves.
+static int
+read_index(struct raw_reader* self)
+{
+    const uint64_t bytes_of_header = sizeof(struct frame_index_header);
+    CHECK(file_view_update(&self->index));
+    if (self->index.nbytes < bytes_of_header)
+        return 1;
+    const struct frame_index_header* header =
+      (const struct frame_index_header*)self->index.data;
+    if (memcmp(header->magic, FRAME_INDEX_MAGIC, sizeof(header->magic)) ||
+        header->version != FRAME_INDEX_VERSION ||
+        header->bytes_of_record < sizeof(struct frame_index_record)) {
+        // Not an index this reader understands. The frames can still be
+        // found without it.
+        self->has_index = 0;
+        file_view_close(&self->index);
+        return 1;
+    }
+    const uint64_t bytes_of_record = header->bytes_of_record;
+    while (bytes_of_header + (self->nrecords + 1) * bytes_of_record <=
+           self->index.nbytes) {
+        const struct frame_index_record* record =
+          (const struct frame_index_record*)(self->index.data +
+                                             bytes_of_header +
+                                             self->nrecords * bytes_of_record);
+        if (record->offset < self->end) {
+            // Found by walking the headers already.
+            ++self->nrecords;
+            continue;
+        }
+        if (record->offset > self->end ||
+            record->nbytes > self->view.nbytes - record->offset)
+            break;
+        CHECK(push_frame(self, record->offset, record->nbytes));
+        ++self->nrecords;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+int
+raw_reader_open(struct raw_reader* self, const char* path)
+{
+    char* index_path = 0;
+    memset(self, 0, sizeof(*self));
+    CHECK(file_view_open(&self->view, path, strlen(path) + 1));
+
+    const size_t n = strlen(path) + sizeof(".idx");
+    CHECK(index_path = malloc(n));
+    snprintf(index_path, n, "%s.idx", path);
+    if (file_exists(index_path, n) &&
+        file_view_open(&self->index, index_path, n))
+        self->has_index = 1;
+    free(index_path);
+    index_path = 0;
+
+    CHECK(raw_reader_refresh(self));
+    return 1;
+Error:
+    free(index_path);
+    raw_reader_close(self);
+    return 0;
+}
+
+int
+raw_reader_refresh(struct raw_reader* self)
+{
+    CHECK(file_view_update(&self->view));
+    if (!self->nframes && !self->end &&
+        (self->bytes_of_frame_header =
+           compact_frame_header_bytes(&self->view)))
+        self->is_compact = 1;
+    if (self->is_compact)
+        return read_records(self);
+    if (self->has_index)
+        CHECK(read_index(self));
+    // The index may lag behind the file.
+    for (uint64_t n = 0; (n = frame_at(self, self->end));)
+        CHECK(push_frame(self, self->end, n));
+    return 1;
+Error:
+    return 0;
+}
+
+size_t
+raw_reader_frame_count(const struct raw_reader* self)
+{
+    return self->nframes;
+}
+
+const struct VideoFrame*
+raw_reader_frame(const struct raw_reader* self, size_t i)
+{
+    if (i >= self->nframes || self->is_compact)
+        return 0;
+    return (const struct VideoFrame*)(self->view.data + self->offsets[i]);
+}
+
+int
+raw_reader_frame_header(const struct raw_reader* self,
+                        size_t i,
+                        struct VideoFrame* header,
+                        const uint8_t** data)
+{
+    if (i >= self->nframes)
+        return 0;
+    if (!self->is_compact) {
+        const struct VideoFrame* frame = raw_reader_frame(self, i);
+        *header = *frame;
+        *data = frame->data;
+        return 1;
+    }
+    const struct compact_frame_header* frame =
+      (const struct compact_frame_header*)(self->view.data + self->offsets[i]);
+    const struct compact_shape_record* shape =
+      (const struct compact_shape_record*)(self->view.data + self->shapes[i]);
+    *header = (struct VideoFrame){
+        .bytes_of_frame =
+          sizeof(struct VideoFrame) + bytes_of_image(&shape->shape),
+        .shape = shape->shape,
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamps = { .hardware = frame->hardware_timestamp,
+                        .acq_thread = frame->runtime_timestamp },
+        .stage_position = frame->stage_position,
+        .has_stage_position = frame->has_stage_position,
+    };
+    if (self->bytes_of_frame_header >= sizeof(*frame)) {
+        header->checksum = frame->checksum;
+        header->has_checksum = frame->has_checksum;
+    }
+    *data = (const uint8_t*)frame + self->bytes_of_frame_header;
+    return 1;
+}
+
+void
+raw_reader_prefetch(const struct raw_reader* self, size_t beg, size_t end)
+{
+    if (end > self->nframes)
+        end = self->nframes;
+    if (beg >= end)
+        return;
+    const uint64_t last = end == self->nframes ? self->end : self->offsets[end];
+    file_view_prefetch(
+      &self->view, self->offsets[beg], last - self->offsets[beg]);
+}
+
+void
+raw_reader_close(struct raw_reader* self)
+{
+    file_view_close(&self->view);
+    if (self->has_index)
+        file_view_close(&self->index);
+    free(self->offsets);
+    free(self->shapes);
+    memset(self, 0, sizeof(*self));
+}
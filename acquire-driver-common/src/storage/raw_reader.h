@@ -0,0 +1,101 @@
+#ifndef H_ACQUIRE_STORAGE_RAW_READER_V0
+#define H_ACQUIRE_STORAGE_RAW_READER_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    struct VideoFrame;
+
+    /// Reads files written by the raw storage device, which holds each
+    /// `VideoFrame`, header and pixels, back to back.
+    ///
+    /// The file is mapped into memory and frames are handed out as pointers
+    /// into the mapping, without copying them. Where frames start is taken
+    /// from the index next to the file, "out.raw.idx" for "out.raw", when
+    /// there is one, and otherwise found by walking the frame headers.
+    ///
+    /// Files can be read while they're written: raw_reader_refresh() picks up
+    /// frames written since the last look. A frame is only handed out once
+    /// all of it is in the file, and no frame after a gap a writer hasn't
+    /// filled yet is.
+    ///
+    /// Files written with compact frame headers, see compact_frames.h, are
+    /// read too. Their frames have no `VideoFrame` header to point at, so
+    /// they're only handed out by raw_reader_frame_header(). They're always
+    /// found by walking their records.
+    struct raw_reader
+    {
+        struct file_view view;
+        /// Where each frame found so far starts in the file.
+        uint64_t* offsets;
+        size_t nframes, capacity;
+        /// Where the next frame starts.
+        uint64_t end;
+
+        /// Set for files with compact frame headers. `shapes` holds where
+        /// the shape record of each frame found so far starts, and `shape`
+        /// where the last one found does. Frame headers take
+        /// `bytes_of_frame_header`, which depends on the file's version.
+        int is_compact;
+        uint64_t* shapes;
+        uint64_t shape;
+        size_t bytes_of_frame_header;
+
+        /// The index, if the file has one, and the number of its records
+        /// read so far.
+        int has_index;
+        struct file_view index;
+        uint64_t nrecords;
+    };
+
+    /// @brief Maps the raw file `path` and finds the frames in it.
+    /// @returns 1 on success, otherwise 0.
+    int raw_reader_open(struct raw_reader* self, const char* path);
+
+    /// @brief Finds the frames written since the file was last looked at.
+    /// @details Frames returned before may move in memory.
+    /// @returns 1 on success, otherwise 0.
+    int raw_reader_refresh(struct raw_reader* self);
+
+    /// @returns The number of frames found.
+    size_t raw_reader_frame_count(const struct raw_reader* self);
+
+    /// @returns The `i`th frame of the file, or NULL if it hasn't been found
+    /// or the file has compact frame headers. Valid until the next call to
+    /// raw_reader_refresh() or raw_reader_close().
+    const struct VideoFrame* raw_reader_frame(const struct raw_reader* self,
+                                              size_t i);
+
+    /// @brief Fills in `header` for the `i`th frame of the file, in either
+    /// layout, and points `data` at its pixels.
+    /// @details For compact files, `header` is what the frame's header was
+    /// when it was written, save for `hardware_frame_gap`, which is 0.
+    /// For frames compressed by the runtime, `data` points at what
+    /// frame_decompress() reads. It is valid for as long as
+    /// raw_reader_frame() would be.
+    /// @returns 1 on success, or 0 if the frame hasn't been found.
+    int raw_reader_frame_header(const struct raw_reader* self,
+                                size_t i,
+                                struct VideoFrame* header,
+                                const uint8_t** data);
+
+    /// @brief Hints that frames `beg` up to but not including `end` will be
+    /// read soon, so the system can start reading them from disk.
+    void raw_reader_prefetch(const struct raw_reader* self,
+                             size_t beg,
+                             size_t end);
+
+    /// @brief Unmaps the file and frees what the reader holds.
+    void raw_reader_close(struct raw_reader* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_RAW_READER_V0
@@ -0,0 +1,185 @@
+#include "rollover.h"
+#include "device/props/components.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// Room for the index and its dot in a file name.
+#define BYTES_OF_INDEX (12)
+
+/// Writes the name of file `index` of the series starting at `path` to
+/// `out`, which holds `bytes_of_path + BYTES_OF_INDEX` bytes.
+static void
+format_path(const struct rollover* self, uint32_t index, char* out)
+{
+    const char* path = self->path;
+    // The extension is whatever follows the last dot of the file name.
+    const char* ext = 0;
+    for (const char* c = path; *c; ++c) {
+        if (*c == '.')
+            ext = c;
+        else if (*c == '/' || *c == '\\')
+            ext = 0;
+    }
+    if (!ext)
+        ext = path + strlen(path);
+    snprintf(out,
+             self->bytes_of_path + BYTES_OF_INDEX,
+             "%.*s.%u%s",
+             (int)(ext - path),
+             path,
+             index,
+             ext);
+}
+
+static void
+prepare(void* ctx)
+{
+    struct rollover* self = ctx;
+    format_path(self, self->index, self->next_path);
+    if (!file_create_with_flags(&self->next,
+                                self->next_path,
+                                strlen(self->next_path) + 1,
+                                self->flags)) {
+        LOGE("Failed to create \"%s\"", self->next_path);
+        return;
+    }
+    self->reserved = 0;
+    if (self->bytes_to_reserve &&
+        file_preallocate(&self->next, 0, self->bytes_to_reserve))
+        self->reserved = self->bytes_to_reserve;
+    self->is_next_open = 1;
+}
+
+static int
+start_preparing(struct rollover* self)
+{
+    self->is_next_open = 0;
+    thread_init(&self->thread);
+    CHECK(thread_create(&self->thread, prepare, self));
+    self->is_preparing = 1;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Waits for the file being prepared.
+/// @returns 1 if it's open, otherwise 0.
+static int
+finish_preparing(struct rollover* self)
+{
+    if (self->is_preparing) {
+        thread_join(&self->thread);
+        self->is_preparing = 0;
+    }
+    return self->is_next_open;
+}
+
+int
+rollover_init(struct rollover* self,
+              uint64_t max_frames,
+              uint64_t max_bytes,
+              const char* path,
+              size_t bytes_of_path,
+              uint32_t flags,
+              uint64_t bytes_to_reserve)
+{
+    memset(self, 0, sizeof(*self));
+    self->max_frames = max_frames;
+    self->max_bytes = max_bytes;
+    self->flags = flags;
+    self->bytes_to_reserve = bytes_to_reserve;
+    if (self->max_bytes && self->bytes_to_reserve > self->max_bytes)
+        self->bytes_to_reserve = self->max_bytes;
+    self->bytes_of_path = bytes_of_path;
+    CHECK(self->path = malloc(bytes_of_path + 1));
+    memcpy(self->path, path, bytes_of_path); // NOLINT
+    self->path[bytes_of_path] = '\0';
+    CHECK(self->next_path = malloc(bytes_of_path + BYTES_OF_INDEX));
+    CHECK(self->current_path = malloc(bytes_of_path + BYTES_OF_INDEX));
+    strcpy(self->current_path, self->path); // NOLINT
+    self->index = 1;
+    CHECK(start_preparing(self));
+    return 1;
+Error:
+    free(self->path);
+    free(self->next_path);
+    free(self->current_path);
+    memset(self, 0, sizeof(*self));
+    return 0;
+}
+
+size_t
+rollover_fit(const struct rollover* self,
+             const struct VideoFrame* frames,
+             size_t nbytes,
+             uint64_t frames_in_file,
+             uint64_t bytes_in_file,
+             uint64_t* nframes)
+{
+    const uint8_t* const beg = (const uint8_t*)frames;
+    const uint8_t* cur = beg;
+    uint64_t n = 0;
+    while (cur < beg + nbytes) {
+        const size_t bytes_of_frame =
+          ((const struct VideoFrame*)cur)->bytes_of_frame;
+        const int is_full =
+          (self->max_frames && frames_in_file + n + 1 > self->max_frames) ||
+          (self->max_bytes &&
+           bytes_in_file + (cur - beg) + bytes_of_frame > self->max_bytes);
+        if (is_full && (frames_in_file || n))
+            break;
+        cur += bytes_of_frame;
+        ++n;
+    }
+    if (nframes)
+        *nframes = n;
+    return cur - beg;
+}
+
+int
+rollover_next(struct rollover* self, struct file* file, uint64_t* reserved)
+{
+    CHECK(finish_preparing(self));
+    *file = self->next;
+    *reserved = self->reserved;
+    strcpy(self->current_path, self->next_path); // NOLINT
+    self->is_next_open = 0;
+    ++self->index;
+    CHECK(start_preparing(self));
+    return 1;
+Error:
+    return 0;
+}
+
+const char*
+rollover_current_path(const struct rollover* self)
+{
+    return self->current_path;
+}
+
+void
+rollover_destroy(struct rollover* self)
+{
+    if (!self->path)
+        return;
+    if (finish_preparing(self)) {
+        file_close(&self->next);
+        remove(self->next_path);
+    }
+    free(self->path);
+    free(self->next_path);
+    free(self->current_path);
+    memset(self, 0, sizeof(*self));
+}
@@ -0,0 +1,89 @@
+#ifndef H_ACQUIRE_STORAGE_ROLLOVER_V0
+#define H_ACQUIRE_STORAGE_ROLLOVER_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    struct VideoFrame;
+
+    /// Splits a stream of frames over a series of files. Each file is created
+    /// and has disk space reserved on a thread of its own while the one before
+    /// it is written, so switching to it doesn't wait on the file system.
+    ///
+    /// Files after the first are named like the first with their index before
+    /// the extension: "out.tif", "out.1.tif", "out.2.tif" and so on.
+    struct rollover
+    {
+        uint64_t max_frames, max_bytes;
+        /// The first file's path, the prepared file's, and the path of the
+        /// file last handed out by rollover_next().
+        char *path, *next_path, *current_path;
+        size_t bytes_of_path;
+        uint32_t flags;
+        uint64_t bytes_to_reserve;
+
+        /// Index of the file being prepared.
+        uint32_t index;
+        struct thread thread;
+        int is_preparing;
+        /// Set by the thread once `next` is open, with `reserved` bytes of it
+        /// reserved on disk.
+        int is_next_open;
+        struct file next;
+        uint64_t reserved;
+    };
+
+    /// @brief Starts preparing the second file of the series whose first
+    /// file is `path`.
+    /// @param[in] max_frames Most frames in a file, or 0 for no limit.
+    /// @param[in] max_bytes Most bytes in a file, or 0 for no limit.
+    /// @param[in] flags `FileCreateFlags` to create each file with.
+    /// @param[in] bytes_to_reserve Disk space to reserve at the start of each
+    ///                             file. Capped at the file size limit.
+    /// @returns 1 on success, otherwise 0.
+    int rollover_init(struct rollover* self,
+                      uint64_t max_frames,
+                      uint64_t max_bytes,
+                      const char* path,
+                      size_t bytes_of_path,
+                      uint32_t flags,
+                      uint64_t bytes_to_reserve);
+
+    /// @brief Counts the frames at the start of `frames` that fit in a file
+    /// already holding `frames_in_file` frames and `bytes_in_file` bytes.
+    /// @details An empty file always fits at least one frame.
+    /// @param[out] nframes May be NULL. The number of frames that fit.
+    /// @returns The number of bytes of `frames` that fit.
+    size_t rollover_fit(const struct rollover* self,
+                        const struct VideoFrame* frames,
+                        size_t nbytes,
+                        uint64_t frames_in_file,
+                        uint64_t bytes_in_file,
+                        uint64_t* nframes);
+
+    /// @brief Waits for the next file to be ready, moves it into `file`, and
+    /// starts preparing the one after it.
+    /// @param[out] reserved Bytes reserved at the start of `file`.
+    /// @returns 1 on success, otherwise 0.
+    int rollover_next(struct rollover* self,
+                      struct file* file,
+                      uint64_t* reserved);
+
+    /// @returns The path of the file last handed out by rollover_next().
+    const char* rollover_current_path(const struct rollover* self);
+
+    /// @brief Stops preparing files and removes the one prepared but not
+    /// used.
+    void rollover_destroy(struct rollover* self);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_ROLLOVER_V0
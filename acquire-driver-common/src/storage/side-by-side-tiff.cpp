@@ -10,6 +10,12 @@
 //           metadata1.json
 //           stream1.tif
 //```
+//
+// Each frame's ids and timestamps are written in a description in its ifd,
+// unless `disable_frame_descriptions` is set. With `enable_frame_index`, they
+// are also written to "data.tif.idx", the frame index, in fixed size records
+// appended as frames are written, so readers can load them for every frame in
+// one sequential read instead of walking the chain of ifds.
 
 #include "device/kit/storage.h"
 #include "device/props/storage.h"
@@ -23,9 +29,8 @@
 
 namespace fs = std::filesystem;
 
-#define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -216,9 +221,14 @@ side_by_side_tiff_start(struct Storage* self_) noexcept
                 .is_ref = 1,
             };
             CHECK(self->tiff);
+            // The writer is driven here rather than through the device hal,
+            // so its state is kept here too. It only finishes its file when
+            // stopped while running.
             state = self->tiff->set(self->tiff, &props);
+            self->tiff->state = state;
             CHECK(state == DeviceState_Armed);
             state = self->tiff->start(self->tiff);
+            self->tiff->state = state;
             CHECK(state == DeviceState_Running);
         }
 
@@ -240,7 +250,8 @@ side_by_side_tiff_stop(struct Storage* self_) noexcept
         struct SideBySideTiff* self =
           containerof(self_, struct SideBySideTiff, storage);
         CHECK(self->tiff);
-        CHECK(self->tiff->stop(self->tiff) == DeviceState_Armed);
+        self->tiff->state = self->tiff->stop(self->tiff);
+        CHECK(self->tiff->state == DeviceState_Armed);
     } catch (const std::exception& e) {
         LOGE("Exception: %s\n", e.what());
         return DeviceState_AwaitingConfiguration;
@@ -0,0 +1,351 @@
+// A staged tiff writes a tiff, and the files it rolls over to, to a staging
+// directory on a fast disk, and moves each one to where `uri` says in the
+// background once it's finished. A burst faster than the disk `uri` is on
+// can take can then be acquired, so long as the staging disk keeps up and
+// has room for it.
+//
+// ## Example
+// With `uri` "/archive/run.tif", `staging_uri` "/scratch" and files rolling
+// over:
+//
+// ```
+// /scratch/run.tif      written, then moved to /archive/run.tif
+// /scratch/run.1.tif    written, then moved to /archive/run.1.tif
+// /scratch/run.2.tif    being written
+// ```
+//
+// The tiff writer only starts preparing file `i+2` of the series once it's
+// finished file `i`, so that's when file `i` is moved. The rest are moved
+// when the writer stops. Stopping doesn't wait for them: they're all moved
+// once the device is closed. Files from the last acquisition still waiting
+// to be moved are moved before one under the same name starts.
+
+#include "device/kit/storage.h"
+#include "device/props/storage.h"
+#include "migration.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            throw std::runtime_error("Expression was false: " #e);             \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+
+extern "C" struct Storage*
+tiff_init();
+
+namespace {
+
+struct StagedTiff
+{
+    struct Storage storage;
+    struct Storage* tiff;
+    StorageProperties props;
+    struct migration migration;
+
+    /// Where the first file of the series is written, and where it goes.
+    std::string staged, archived;
+    /// Index of the first file of the series not yet queued to be moved.
+    uint32_t next_to_move;
+    bool is_rolling_over;
+};
+
+/// @returns `str` without a "file://" prefix.
+fs::path
+as_path(const struct String& str)
+{
+    const size_t offset =
+      str.nbytes >= 7 && strncmp(str.str, "file://", 7) == 0 ? 7 : 0;
+    return { str.str + offset, str.str + strnlen(str.str, str.nbytes) };
+}
+
+/// @returns The name of file `index` of the series starting at `path`, named
+/// as the tiff writer rolls over: "out.tif", "out.1.tif" and so on.
+std::string
+series_path(const std::string& path, uint32_t index)
+{
+    if (!index)
+        return path;
+    // The extension is whatever follows the last dot of the file name.
+    const size_t name = path.find_last_of("/\\");
+    size_t ext = path.rfind('.');
+    if (ext == std::string::npos ||
+        (name != std::string::npos && ext < name))
+        ext = path.size();
+    return path.substr(0, ext) + "." + std::to_string(index) +
+           path.substr(ext);
+}
+
+bool
+exists(const std::string& path) noexcept
+{
+    std::error_code ec;
+    return fs::exists(path, ec);
+}
+
+void
+validate(const struct StorageProperties* props)
+{
+    CHECK(props->uri.str);
+    CHECK(props->uri.nbytes);
+    EXPECT(props->staging_uri.str && props->staging_uri.nbytes > 1,
+           "Expected a staging directory.");
+
+    const auto staging = as_path(props->staging_uri);
+    EXPECT(fs::is_directory(staging),
+           "Expected \"%s\" to be a directory.",
+           staging.string().c_str());
+    EXPECT(file_is_writable(staging.string().c_str(),
+                            staging.string().length() + 1),
+           "Expected \"%s\" to have write permissions.",
+           staging.string().c_str());
+
+    auto parent_path = as_path(props->uri).parent_path();
+    if (parent_path.empty())
+        parent_path = fs::path(".");
+    EXPECT(fs::is_directory(parent_path),
+           "Expected \"%s\" to be a directory.",
+           parent_path.string().c_str());
+}
+
+/// Queues the finished files of the series to be moved, or, with `all`, every
+/// file of it left in the staging directory.
+void
+move_finished(struct StagedTiff* self, bool all)
+{
+    for (;; ++self->next_to_move) {
+        const auto staged = series_path(self->staged, self->next_to_move);
+        if (all ? !exists(staged)
+                : !exists(series_path(self->staged, self->next_to_move + 2)))
+            break;
+        const auto archived = series_path(self->archived, self->next_to_move);
+        if (!migration_push(
+              &self->migration, staged.c_str(), archived.c_str())) {
+            LOGE("Failed to queue \"%s\" to be moved.", staged.c_str());
+            continue;
+        }
+        // The frame index is finished with its file.
+        if (exists(staged + ".idx"))
+            migration_push(&self->migration,
+                           (staged + ".idx").c_str(),
+                           (archived + ".idx").c_str());
+    }
+}
+
+enum DeviceState
+staged_tiff_set(struct Storage* self_,
+                const struct StorageProperties* props) noexcept
+{
+    try {
+        CHECK(self_);
+        struct StagedTiff* self =
+          containerof(self_, struct StagedTiff, storage);
+        validate(props);
+        CHECK(storage_properties_copy(&self->props, props));
+        migration_set_rate(&self->migration,
+                           props->migration_bytes_per_second);
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+        return DeviceState_AwaitingConfiguration;
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+        return DeviceState_AwaitingConfiguration;
+    }
+    return DeviceState_Armed;
+}
+
+void
+staged_tiff_get(const struct Storage* self_,
+                struct StorageProperties* props) noexcept
+{
+    struct StagedTiff* self = containerof(self_, struct StagedTiff, storage);
+    *props = self->props;
+}
+
+void
+staged_tiff_get_meta(const struct Storage* self_,
+                     struct StoragePropertyMetadata* meta) noexcept
+{
+    struct StagedTiff* self = containerof(self_, struct StagedTiff, storage);
+    try {
+        CHECK(self->tiff);
+        self->tiff->get_meta(self->tiff, meta);
+        meta->staging_is_supported = 1;
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+    }
+}
+
+enum DeviceState
+staged_tiff_start(struct Storage* self_) noexcept
+{
+    DeviceState state = DeviceState_AwaitingConfiguration;
+    try {
+        CHECK(self_);
+        struct StagedTiff* self =
+          containerof(self_, struct StagedTiff, storage);
+        const auto archived = as_path(self->props.uri);
+        self->archived = archived.string();
+        self->staged =
+          (as_path(self->props.staging_uri) / archived.filename()).string();
+        CHECK(migration_start(&self->migration));
+
+        // Files of the last acquisition under this name have to be out of
+        // the way before the writer opens them again. Whatever is left then
+        // failed to move, or was never finished.
+        if (exists(self->staged)) {
+            migration_wait(&self->migration);
+            for (uint32_t i = 0; exists(series_path(self->staged, i)); ++i) {
+                const auto stale = series_path(self->staged, i);
+                LOG("Removing \"%s\" left in the staging directory.",
+                    stale.c_str());
+                fs::remove(stale);
+                fs::remove(stale + ".idx");
+            }
+        }
+
+        StorageProperties props{};
+        CHECK(storage_properties_copy(&props, &self->props));
+        CHECK(storage_properties_set_uri(
+          &props, self->staged.c_str(), self->staged.length() + 1));
+        CHECK(self->tiff);
+        // As with the side-by-side tiff, the writer is driven here rather
+        // than through the device hal, so its state is kept here too.
+        state = self->tiff->set(self->tiff, &props);
+        storage_properties_destroy(&props);
+        self->tiff->state = state;
+        CHECK(state == DeviceState_Armed);
+        state = self->tiff->start(self->tiff);
+        self->tiff->state = state;
+        CHECK(state == DeviceState_Running);
+
+        self->next_to_move = 0;
+        self->is_rolling_over =
+          self->props.max_frames_per_file || self->props.max_bytes_per_file;
+        LOG("Staging \"%s\" in \"%s\"",
+            self->archived.c_str(),
+            self->staged.c_str());
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+        state = DeviceState_AwaitingConfiguration;
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+        state = DeviceState_AwaitingConfiguration;
+    }
+    return state;
+}
+
+enum DeviceState
+staged_tiff_stop(struct Storage* self_) noexcept
+{
+    try {
+        CHECK(self_);
+        struct StagedTiff* self =
+          containerof(self_, struct StagedTiff, storage);
+        CHECK(self->tiff);
+        if (self->tiff->state == DeviceState_Running) {
+            self->tiff->state = self->tiff->stop(self->tiff);
+            move_finished(self, true);
+        }
+        CHECK(self->tiff->state == DeviceState_Armed ||
+              self->tiff->state == DeviceState_AwaitingConfiguration);
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+        return DeviceState_AwaitingConfiguration;
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+        return DeviceState_AwaitingConfiguration;
+    }
+    return DeviceState_Armed;
+}
+
+void
+staged_tiff_destroy(struct Storage* self_) noexcept
+{
+    try {
+        CHECK(self_);
+        struct StagedTiff* self =
+          containerof(self_, struct StagedTiff, storage);
+        CHECK(self->tiff);
+        if (self_->stop)
+            self_->stop(self_);
+        if (!migration_stop(&self->migration))
+            LOGE("Some staged files weren't moved. They're left in \"%s\".",
+                 as_path(self->props.staging_uri).string().c_str());
+        self->tiff->destroy(self->tiff);
+        storage_properties_destroy(&self->props);
+        delete self;
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+    }
+}
+
+void
+staged_tiff_reserve_image_shape(struct Storage* self_,
+                                const struct ImageShape* shape) noexcept
+{ // no-op
+}
+
+enum DeviceState
+staged_tiff_append(struct Storage* self_,
+                   const struct VideoFrame* frame,
+                   size_t* nbytes) noexcept
+{
+    try {
+        CHECK(self_);
+        struct StagedTiff* self =
+          containerof(self_, struct StagedTiff, storage);
+        CHECK(self->tiff);
+        CHECK(self->tiff->append(self->tiff, frame, nbytes) ==
+              DeviceState_Running);
+        if (self->is_rolling_over)
+            move_finished(self, false);
+    } catch (const std::exception& e) {
+        LOGE("Exception: %s\n", e.what());
+        return staged_tiff_stop(self_);
+    } catch (...) {
+        LOGE("Exception: (unknown)");
+        return staged_tiff_stop(self_);
+    }
+    return DeviceState_Running;
+}
+
+} // end ::{anonymous} namespace
+
+extern "C" struct Storage*
+staged_tiff_init()
+{
+    struct StagedTiff* self = new StagedTiff{};
+    self->storage = {
+        .set = staged_tiff_set,
+        .get = staged_tiff_get,
+        .get_meta = staged_tiff_get_meta,
+        .start = staged_tiff_start,
+        .append = staged_tiff_append,
+        .stop = staged_tiff_stop,
+        .destroy = staged_tiff_destroy,
+        .reserve_image_shape = staged_tiff_reserve_image_shape,
+    };
+    self->tiff = tiff_init();
+    migration_init(&self->migration);
+    return &self->storage;
+}
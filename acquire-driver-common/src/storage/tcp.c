@@ -0,0 +1,330 @@
+#include "device/props/storage.h"
+#include "device/kit/storage.h"
+#include "device/props/components.h"
+#include "platform.h"
+#include "logger.h"
+#include "tcp_stream.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+
+/// Frames handed to the system in one send, at most.
+#define TCP_FRAMES_PER_SEND (32)
+
+/// How long an append waits for the receiver to make room before handing
+/// back the frames it hasn't sent.
+#define TCP_SEND_WAIT_MS (100.0f)
+
+/// Streams frames to a receiver over a TCP connection, in the format
+/// described in tcp_stream.h. The storage URI is the receiver's address, as
+/// "tcp://host:port" or "host:port". The connection is made at start and
+/// closed at stop.
+///
+/// Frames are sent straight from the memory they're appended from, each
+/// after a small record, with one vectored send for many of them. When the
+/// receiver falls behind, appends take only the frames that fit, which holds
+/// the rest of the pipeline back.
+struct Tcp
+{
+    struct Storage writer;
+    struct StorageProperties settings;
+
+    char host[256];
+    uint16_t port;
+    struct tcp_socket socket;
+    int is_connected;
+
+    /// Frames sent since start.
+    uint64_t iframe;
+    uint64_t bytes;
+    /// Times an append handed frames back because the receiver was behind.
+    uint64_t stalls;
+
+    /// Records for the frames in one send, and the pieces it sends.
+    struct tcp_record records[TCP_FRAMES_PER_SEND];
+    struct file_iovec iov[2 * TCP_FRAMES_PER_SEND];
+};
+
+/// Reads "host:port" from `uri`, after any "tcp://". IPv6 addresses are
+/// written in brackets, like "[::1]:port".
+static int
+parse_address(struct Tcp* self, const char* uri)
+{
+    const char *host = uri, *host_end = 0, *port = 0;
+    char* port_end = 0;
+    if (strncmp(host, "tcp://", 6) == 0)
+        host += 6;
+    if (*host == '[') {
+        ++host;
+        host_end = strchr(host, ']');
+        if (host_end && host_end[1] == ':')
+            port = host_end + 2;
+    } else {
+        host_end = strrchr(host, ':');
+        if (host_end)
+            port = host_end + 1;
+    }
+    if (!port || host_end == host ||
+        (size_t)(host_end - host) >= sizeof(self->host)) {
+        LOGE("TCP: Expected an address like \"tcp://host:port\". Got \"%s\".",
+             uri);
+        return 0;
+    }
+    const unsigned long p = strtoul(port, &port_end, 10);
+    if (port_end == port || *port_end || p == 0 || p > 65535) {
+        LOGE("TCP: Invalid port in \"%s\".", uri);
+        return 0;
+    }
+    memcpy(self->host, host, host_end - host); // NOLINT
+    self->host[host_end - host] = '\0';
+    self->port = (uint16_t)p;
+    return 1;
+}
+
+static size_t
+bytes_of_piece(const struct file_iovec* piece)
+{
+    return piece->end - piece->beg;
+}
+
+/// Sends all of the `n` pieces in `iov`, waiting as long as it takes. The
+/// pieces are changed to track what's left.
+static int
+send_all(struct Tcp* self, struct file_iovec* iov, size_t n)
+{
+    size_t i = 0;
+    while (i < n) {
+        size_t sent = 0;
+        CHECK(tcp_sendv(&self->socket, iov + i, n - i, &sent));
+        for (; i < n && sent >= bytes_of_piece(iov + i); ++i)
+            sent -= bytes_of_piece(iov + i);
+        if (i < n) {
+            iov[i].beg += sent;
+            tcp_wait_writable(&self->socket, TCP_SEND_WAIT_MS);
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+static void
+disconnect(struct Tcp* self)
+{
+    if (self->is_connected)
+        tcp_close(&self->socket);
+    self->is_connected = 0;
+}
+
+static enum DeviceState
+tcp_set(struct Storage* self_, const struct StorageProperties* settings)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    CHECK(settings->uri.str);
+    CHECK(parse_address(self, settings->uri.str));
+    CHECK(storage_properties_copy(&self->settings, settings));
+    return DeviceState_Armed;
+Error:
+    return DeviceState_AwaitingConfiguration;
+}
+
+static void
+tcp_get(const struct Storage* self_, struct StorageProperties* settings)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    *settings = self->settings;
+}
+
+static void
+tcp_get_meta(const struct Storage* self_, struct StoragePropertyMetadata* meta)
+{
+    CHECK(meta);
+    *meta = (struct StoragePropertyMetadata){
+        .compressed_frames_are_supported = 1,
+    };
+Error:
+    return;
+}
+
+static enum DeviceState
+tcp_start(struct Storage* self_)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    const struct String* metadata = &self->settings.external_metadata_json;
+    // The metadata's terminating null isn't sent.
+    const size_t bytes_of_metadata =
+      metadata->str && metadata->nbytes ? strlen(metadata->str) : 0;
+    struct tcp_stream_header header = {
+        .magic = TCP_STREAM_MAGIC,
+        .version = TCP_STREAM_VERSION,
+        .bytes_of_metadata = (uint32_t)bytes_of_metadata,
+    };
+    struct file_iovec iov[2] = {
+        { (const uint8_t*)&header, (const uint8_t*)(&header + 1) },
+        { (const uint8_t*)metadata->str,
+          (const uint8_t*)metadata->str + bytes_of_metadata },
+    };
+
+    disconnect(self);
+    self->iframe = self->bytes = self->stalls = 0;
+    if (!tcp_connect(&self->socket, self->host, self->port)) {
+        LOGE("TCP: Failed to connect to %s:%u.",
+             self->host,
+             (unsigned)self->port);
+        // Still configured, so starting again once the receiver is up works.
+        return DeviceState_Armed;
+    }
+    self->is_connected = 1;
+    CHECK(send_all(self, iov, 2));
+    LOG("TCP: Streaming to %s:%u.", self->host, (unsigned)self->port);
+    return DeviceState_Running;
+Error:
+    disconnect(self);
+    return DeviceState_Armed;
+}
+
+static enum DeviceState
+tcp_stop(struct Storage* self_)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    if (self->is_connected) {
+        struct tcp_record end = { .kind = TcpRecord_End,
+                                  .frame_index = self->iframe };
+        struct file_iovec iov = { (const uint8_t*)&end,
+                                  (const uint8_t*)(&end + 1) };
+        if (!send_all(self, &iov, 1))
+            LOGE("TCP: Failed to end the stream to %s:%u.",
+                 self->host,
+                 (unsigned)self->port);
+        LOG("TCP: Sent %llu frames, %llu bytes to %s:%u. The receiver held "
+            "appends back %llu times.",
+            (unsigned long long)self->iframe,
+            (unsigned long long)self->bytes,
+            self->host,
+            (unsigned)self->port,
+            (unsigned long long)self->stalls);
+    }
+    disconnect(self);
+    return DeviceState_Armed;
+}
+
+/// Sends as many of the frames in `[beg,end)` as the connection takes before
+/// `TCP_SEND_WAIT_MS` passes without room to send more. A frame that's partly
+/// sent is always finished.
+static enum DeviceState
+tcp_append(struct Storage* self_,
+           const struct VideoFrame* frames,
+           size_t* nbytes)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    const uint8_t* const beg = (const uint8_t*)frames;
+    const uint8_t* const end = beg + *nbytes;
+    const uint8_t* cur = beg; // first frame not sent
+    CHECK(self->is_connected);
+
+    while (cur < end) {
+        // Each frame goes after its record, straight from where it is.
+        size_t n = 0;
+        for (const uint8_t* next = cur; n < TCP_FRAMES_PER_SEND && next < end;
+             ++n) {
+            const size_t bytes_of_frame =
+              ((const struct VideoFrame*)next)->bytes_of_frame;
+            CHECK(bytes_of_frame >= sizeof(struct VideoFrame));
+            CHECK(bytes_of_frame <= (size_t)(end - next));
+            self->records[n] = (struct tcp_record){
+                .kind = TcpRecord_Frame,
+                .frame_index = self->iframe + n,
+                .bytes_of_record = bytes_of_frame,
+            };
+            self->iov[2 * n] =
+              (struct file_iovec){ (const uint8_t*)(self->records + n),
+                                   (const uint8_t*)(self->records + n + 1) };
+            self->iov[2 * n + 1] =
+              (struct file_iovec){ next, next + bytes_of_frame };
+            next += bytes_of_frame;
+        }
+
+        size_t sent = 0;
+        CHECK(tcp_sendv(&self->socket, self->iov, 2 * n, &sent));
+
+        // Count the frames that went completely, and finish the one that
+        // was cut off, so the next send starts on a record.
+        size_t i = 0;
+        for (; i < 2 * n && sent >= bytes_of_piece(self->iov + i); ++i)
+            sent -= bytes_of_piece(self->iov + i);
+        if (i < 2 * n && (sent || i % 2)) {
+            self->iov[i].beg += sent;
+            CHECK(send_all(self, self->iov + i, 2 - i % 2));
+            i += 2 - i % 2;
+        }
+        const size_t nframes = i / 2;
+        for (size_t j = 0; j < nframes; ++j)
+            cur += self->records[j].bytes_of_record;
+        self->iframe += nframes;
+
+        if (nframes < n &&
+            !tcp_wait_writable(&self->socket, TCP_SEND_WAIT_MS)) {
+            // The receiver is behind. Hand the rest back.
+            ++self->stalls;
+            break;
+        }
+    }
+    self->bytes += cur - beg;
+    *nbytes = cur - beg;
+    return DeviceState_Running;
+Error:
+    LOGE("TCP: Failed to send to %s:%u.", self->host, (unsigned)self->port);
+    *nbytes = 0;
+    disconnect(self);
+    return DeviceState_Armed;
+}
+
+static void
+tcp_destroy(struct Storage* self_)
+{
+    struct Tcp* self = containerof(self_, struct Tcp, writer);
+    disconnect(self);
+    storage_properties_destroy(&self->settings);
+    free(self);
+}
+
+static void
+tcp_reserve_image_shape(struct Storage* self_, const struct ImageShape* shape)
+{ // no-op
+}
+
+struct Storage*
+tcp_init()
+{
+    struct Tcp* self;
+    CHECK(self = malloc(sizeof(*self)));
+    memset(self, 0, sizeof(*self)); // NOLINT
+
+    self->writer =
+      (struct Storage){ .state = DeviceState_AwaitingConfiguration,
+                        .set = tcp_set,
+                        .get = tcp_get,
+                        .get_meta = tcp_get_meta,
+                        .start = tcp_start,
+                        .append = tcp_append,
+                        .stop = tcp_stop,
+                        .destroy = tcp_destroy,
+                        .reserve_image_shape = tcp_reserve_image_shape };
+    return &self->writer;
+Error:
+    return 0;
+}
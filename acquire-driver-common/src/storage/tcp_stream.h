@@ -0,0 +1,58 @@
+#ifndef H_ACQUIRE_STORAGE_TCP_STREAM_V0
+#define H_ACQUIRE_STORAGE_TCP_STREAM_V0
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// What the tcp storage device sends over its connection.
+    ///
+    /// The stream starts with a `tcp_stream_header`, followed by the
+    /// external metadata JSON, followed by records back to back, all little
+    /// endian. Each record starts with a `tcp_record`:
+    /// - A frame record is followed by one `VideoFrame`, header and pixels,
+    ///   exactly as the runtime handed it to storage. `bytes_of_record` is
+    ///   its `bytes_of_frame`, so compressed frames take what they need.
+    /// - An end record comes last, with nothing after it. Its
+    ///   `frame_index` is the number of frames sent.
+    ///
+    /// A stream that stops before its end record was cut short.
+
+#define TCP_STREAM_MAGIC "acqtcp\0"
+#define TCP_STREAM_VERSION (1)
+
+    enum TcpRecordKind
+    {
+        TcpRecord_Frame = 1,
+        TcpRecord_End = 2,
+    };
+
+#pragma pack(push, 1)
+    struct tcp_stream_header
+    {
+        char magic[8];
+        uint32_t version;
+        /// Size of the metadata JSON after this header.
+        uint32_t bytes_of_metadata;
+    };
+
+    struct tcp_record
+    {
+        /// A `TcpRecordKind`.
+        uint32_t kind;
+        uint32_t reserved;
+        /// Counts the frames sent before this record.
+        uint64_t frame_index;
+        /// Size of what follows this record, up to the next one.
+        uint64_t bytes_of_record;
+    };
+#pragma pack(pop)
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // H_ACQUIRE_STORAGE_TCP_STREAM_V0
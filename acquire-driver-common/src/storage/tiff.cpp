@@ -1,5 +1,10 @@
 #include "device/props/storage.h"
 #include "device/kit/storage.h"
+#include "compress.h"
+#include "downsample.h"
+#include "durability.h"
+#include "frame_index.h"
+#include "rollover.h"
 #include "logger.h"
 #include "platform.h"
 
@@ -8,12 +13,14 @@
 #include <exception>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 #include <algorithm>
 
 using namespace std;
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define EXPECT(e, ...)                                                         \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -43,34 +50,6 @@ struct StringSection final
     char* reserve(size_t nbytes) noexcept;
 };
 
-struct Tiff final : public Storage
-{
-    string filename_;
-    string external_metadata_;
-    struct PixelScale pixel_scale_um_;
-    struct file file_;
-    uint64_t last_offset_, last_ifd_next_offset_;
-    size_t frame_count_; // the number of frames written to the current file
-
-    // Context for constructing string storage during ifd assembly.
-    // This acquires memory. Kept in object context to reuse that memory.
-    StringSection ifd_strings_;
-
-    Tiff() noexcept;
-    ~Tiff() noexcept;
-
-    int set(const struct StorageProperties* settings) noexcept;
-    void get(struct StorageProperties* settings) const noexcept;
-    static void get_meta(struct StoragePropertyMetadata* meta) noexcept;
-    int start() noexcept;
-    int stop() noexcept;
-    int append(const struct VideoFrame* frames, size_t nbytes) noexcept;
-    void write_(uint64_t offset, void* buf, size_t nbytes) noexcept;
-
-  private:
-    void terminate_ifd_list() noexcept;
-};
-
 #pragma pack(push, 1)
 struct header_t
 {
@@ -115,6 +94,211 @@ struct ifd_t
 };
 #pragma pack(pop)
 
+using ifdN_t = ifd_t<16>;
+
+struct Tiff final : public Storage
+{
+    string filename_;
+    string external_metadata_;
+    struct PixelScale pixel_scale_um_;
+    struct file file_;
+    // Staged blocks are written through this so several can be in flight at
+    // once.
+    struct file_async async_;
+    uint64_t last_offset_, last_ifd_next_offset_;
+    size_t frame_count_; // the number of frames written to the current file
+
+    // When the file is unbuffered, each frame's ifd, image and strings are
+    // copied into one of `max_writes_in_flight` slots of `staging_` and
+    // written as one aligned block.
+    uint8_t enable_unbuffered_io_;
+    bool is_staging_;
+    uint8_t* staging_;
+    size_t bytes_of_slot_, slot_;
+    // The slot holding the last block written, and where it was written.
+    size_t last_slot_;
+    uint64_t last_block_offset_;
+
+    // Bytes from the start of the file that have been reserved on disk.
+    // Cleared `is_reserving_` once the file system refuses a reservation.
+    uint64_t reserved_;
+    bool is_reserving_;
+
+    // Set from begin_file_() till finish_file_().
+    bool has_file_;
+
+    // When set, a new file is started before a frame that would take the
+    // current one past either limit. 0 for no limit.
+    uint64_t max_frames_per_file_, max_bytes_per_file_;
+    bool is_rolling_over_;
+    struct rollover rollover_;
+
+    // Written next to each file when `enable_frame_index_` is set.
+    bool enable_frame_index_;
+    struct frame_index index_;
+
+    // When cleared, frames are written without the description of their ids
+    // and timestamps, apart from the first frame's external metadata.
+    bool enable_frame_descriptions_;
+
+    // Syncs `file_` as the properties' `durability` asks. Its thread only
+    // reads `file_` and `has_file_` with `sync_lock` held.
+    struct durability durability_;
+
+    // Context for constructing string storage during ifd assembly.
+    // This acquires memory. Kept in object context to reuse that memory.
+    StringSection ifd_strings_;
+
+    // The ifd and image description shared by frames of `template_shape_`.
+    // Each frame copies them and patches in its offsets, ids and timestamps,
+    // which are padded to a fixed width in the description.
+    ifdN_t ifd_template_;
+    struct ImageShape template_shape_;
+    bool has_template_;
+    string description_;
+    size_t description_fields_[5];
+
+    // Strips, or tiles, are compressed on `pool_`, one task per strip, and
+    // written in order once the whole append is compressed. Without
+    // compression or tiles each frame is written as a single strip straight
+    // from the frame.
+    enum StorageCompression compression_;
+    // Tile size in pixels, from the chunk sizes of the first two acquisition
+    // dimensions. Frames are written in strips when these are 0.
+    uint32_t tile_width_, tile_length_;
+    struct strip_t
+    {
+        enum StorageCompression codec;
+        const uint8_t* src;
+        size_t bytes_of_src;
+        // A tile is copied out of the frame, `rows` rows of `bytes_of_row`
+        // every `stride` bytes of `src`, into `tile` and padded with zeros
+        // to `bytes_of_src`. 0 `rows` for a strip, which is contiguous.
+        uint32_t rows;
+        size_t bytes_of_row, bytes_of_tile_row, stride;
+        std::vector<uint8_t> tile;
+        std::vector<uint8_t> out;
+        // Bytes of `out` used, or 0 if compression failed.
+        size_t nbytes;
+    };
+    std::vector<strip_t> strips_;
+    // Each frame's strip offsets then byte counts, when it has more than one
+    // strip.
+    std::vector<uint64_t> strip_table_;
+    struct thread_pool pool_;
+    bool has_pool_;
+    // Set while frames are being cut into strips or tiles on `pool_`.
+    bool is_cutting_strips_;
+
+    // When multiscale is enabled, each frame is halved on `pool_` until it
+    // fits `multiscale_min_px`, and the levels are written uncompressed
+    // after it as its SubIFDs.
+    bool enable_multiscale_;
+    struct level_t
+    {
+        uint32_t width, height;
+        std::vector<uint8_t> data;
+    };
+    struct pyramid_t
+    {
+        const struct VideoFrame* frame;
+        // Levels after the first are only resized, so their memory is
+        // reused from append to append.
+        std::vector<level_t> levels;
+        bool ok;
+    };
+    std::vector<pyramid_t> pyramids_;
+    // Each frame's level ifds, and where they are when it has several.
+    std::vector<ifdN_t> level_ifds_;
+    std::vector<uint64_t> level_table_;
+
+    // What one append writes when the file is buffered, gathered into a
+    // single vectored write. Kept in object context to reuse that memory.
+    struct piece_t
+    {
+        // Either a pointer into a frame, or 0 for `metadata_offset` bytes
+        // into `metadata_`, which may move as it grows.
+        const uint8_t* buf;
+        size_t metadata_offset;
+        size_t nbytes;
+    };
+    std::vector<uint8_t> metadata_;
+    std::vector<piece_t> pieces_;
+
+    // When the file is buffered, what each append writes is copied into one
+    // of two batches and written by `writer_` while the next is assembled,
+    // so the sink gets its frames back without waiting on the disk.
+    struct batch_t
+    {
+        uint64_t offset;
+        std::vector<uint8_t> data;
+    };
+    batch_t batches_[2];
+    struct ::thread writer_;
+    bool has_writer_;
+    // Guards the fields below.
+    struct lock writer_lock_;
+    struct condition_variable notify_writer_, notify_written_;
+    // Batches handed to the writer and not written yet, the oldest of which
+    // is `batch_to_write_`.
+    uint32_t batches_pending_, batch_to_write_;
+    bool writer_is_stopping_, writer_failed_;
+
+    Tiff() noexcept;
+    ~Tiff() noexcept;
+
+    int set(const struct StorageProperties* settings) noexcept;
+    void get(struct StorageProperties* settings) const noexcept;
+    static void get_meta(struct StoragePropertyMetadata* meta) noexcept;
+    int start() noexcept;
+    int stop() noexcept;
+    int append(const struct VideoFrame* frames, size_t nbytes) noexcept;
+    int append_to_file_(const struct VideoFrame* frames,
+                        size_t nbytes) noexcept;
+    void write_(uint64_t offset, void* buf, size_t nbytes) noexcept;
+    void write_batches_() noexcept;
+
+  private:
+    struct part_t
+    {
+        uint64_t offset;
+        const void* buf;
+        size_t nbytes;
+    };
+
+    struct layout_t
+    {
+        // Rows per strip, or per tile.
+        uint32_t rows;
+        // Columns per tile, and tiles per row of tiles. 0 for strips.
+        uint32_t cols, across;
+        uint32_t nstrips;
+    };
+    layout_t layout_(const struct ImageShape& shape) const noexcept;
+    void build_template_(const struct ImageShape& shape);
+    void format_description_(const struct VideoFrame* frame) noexcept;
+    void terminate_ifd_list() noexcept;
+    void reserve_(uint64_t end) noexcept;
+    uint64_t align_section(uint64_t offset) const noexcept;
+    std::vector<part_t> parts_;
+
+    int write_staged_(uint64_t offset,
+                      size_t nbytes,
+                      const part_t* parts,
+                      size_t nparts) noexcept;
+    int compress_strips_(const struct VideoFrame* frames, size_t nbytes);
+    void downsample_frames_(const struct VideoFrame* frames,
+                            size_t nbytes,
+                            struct latch* latch);
+    int begin_file_(const char* path, uint64_t reserved) noexcept;
+    int finish_file_() noexcept;
+    int roll_over_() noexcept;
+    int start_writer_() noexcept;
+    int stop_writer_() noexcept;
+    int write_behind_(uint64_t offset) noexcept;
+};
+
+
 tag_t
 tag_t::as_u64(uint16_t tag, uint64_t value) noexcept
 {
@@ -246,6 +430,7 @@ sample_format(SampleType type)
         case SampleType_u12:
         case SampleType_u14:
         case SampleType_u16:
+        case SampleType_u32:
             return tag_t::as_u16(339, 1); // unsigned
         case SampleType_i8:
         case SampleType_i16:
@@ -303,14 +488,14 @@ y_resolution(uint32_t num, uint32_t den)
 }
 
 header_t
-header()
+header(uint64_t first_ifd)
 {
     return header_t{
         .fmt = 0x4949,
         .ver = 0x002B,
         .sizeof_offset = 8,
         .zero = 0,
-        .first_ifd = sizeof(header_t),
+        .first_ifd = first_ifd,
     };
 }
 
@@ -340,6 +525,9 @@ tiff_destroy(struct Storage*);
 void
 tiff_reserve_image_shape(struct Storage*, const struct ImageShape* shape);
 
+int
+tiff_sync(void* ctx);
+
 StringSection::StringSection()
   : offset(0)
   , capacity(0)
@@ -393,15 +581,62 @@ Tiff::Tiff() noexcept
   }
   , pixel_scale_um_{.x=1.0,.y=1.0}
   , file_{}
+  , async_{}
   , last_offset_(0)
   , last_ifd_next_offset_(0)
   , frame_count_(0)
+  , enable_unbuffered_io_(0)
+  , is_staging_(false)
+  , staging_(0)
+  , bytes_of_slot_(0)
+  , slot_(0)
+  , last_slot_(0)
+  , last_block_offset_(0)
+  , reserved_(0)
+  , is_reserving_(false)
+  , has_file_(false)
+  , max_frames_per_file_(0)
+  , max_bytes_per_file_(0)
+  , is_rolling_over_(false)
+  , rollover_{}
+  , enable_frame_index_(false)
+  , index_{}
+  , enable_frame_descriptions_(true)
+  , durability_{}
+  , ifd_template_{}
+  , template_shape_{}
+  , has_template_(false)
+  , description_fields_{}
+  , compression_(StorageCompression_None)
+  , tile_width_(0)
+  , tile_length_(0)
+  , pool_{}
+  , has_pool_(false)
+  , is_cutting_strips_(false)
+  , enable_multiscale_(false)
+  , writer_{}
+  , has_writer_(false)
+  , writer_lock_{}
+  , notify_writer_{}
+  , notify_written_{}
+  , batches_pending_(0)
+  , batch_to_write_(0)
+  , writer_is_stopping_(false)
+  , writer_failed_(false)
 {
+    thread_init(&writer_);
+    lock_init(&writer_lock_);
+    condition_variable_init(&notify_writer_);
+    condition_variable_init(&notify_written_);
+    durability_init(&durability_, ::tiff_sync, this);
 }
 
 Tiff::~Tiff() noexcept
 {
     stop();
+    frame_index_destroy(&index_);
+    if (staging_)
+        memory_free(staging_);
 }
 
 bool
@@ -448,7 +683,35 @@ Tiff::set(const struct StorageProperties* settings) noexcept
             external_metadata_ = string(settings->external_metadata_json.str);
         }
     }
+    CHECK(durability_set(&durability_, settings));
+    EXPECT((unsigned)settings->compression < StorageCompressionCount &&
+             ((compression_supported() >> settings->compression) & 1),
+           "TIFF: Compression %d isn't supported by this build.",
+           (int)settings->compression);
+    {
+        uint32_t w = 0, h = 0;
+        if (settings->acquisition_dimensions.size >= 2) {
+            w = settings->acquisition_dimensions.data[0].chunk_size_px;
+            h = settings->acquisition_dimensions.data[1].chunk_size_px;
+        }
+        // TIFF requires tiles to be a multiple of 16 on a side.
+        EXPECT((w == 0 && h == 0) ||
+                 (w > 0 && h > 0 && w % 16 == 0 && h % 16 == 0),
+               "TIFF: Tiles must be a multiple of 16 pixels on a side. "
+               "Got %ux%u.",
+               w,
+               h);
+        tile_width_ = w;
+        tile_length_ = h;
+    }
     pixel_scale_um_ = settings->pixel_scale_um;
+    enable_unbuffered_io_ = settings->enable_unbuffered_io;
+    compression_ = settings->compression;
+    max_frames_per_file_ = settings->max_frames_per_file;
+    max_bytes_per_file_ = settings->max_bytes_per_file;
+    enable_frame_index_ = settings->enable_frame_index;
+    enable_frame_descriptions_ = !settings->disable_frame_descriptions;
+    enable_multiscale_ = settings->enable_multiscale;
     return 1;
 Error:
     return 0;
@@ -460,6 +723,14 @@ Tiff::get(struct StorageProperties* settings) const noexcept
     settings->uri.str = (char*)filename_.c_str();
     settings->uri.nbytes = filename_.size();
     settings->pixel_scale_um = pixel_scale_um_;
+    settings->enable_unbuffered_io = enable_unbuffered_io_;
+    settings->compression = compression_;
+    settings->max_frames_per_file = max_frames_per_file_;
+    settings->max_bytes_per_file = max_bytes_per_file_;
+    settings->enable_frame_index = enable_frame_index_;
+    settings->disable_frame_descriptions = !enable_frame_descriptions_;
+    settings->enable_multiscale = enable_multiscale_;
+    durability_get(&durability_, settings);
 }
 
 void
@@ -467,19 +738,149 @@ Tiff::get_meta(struct StoragePropertyMetadata* meta) noexcept
 {
     CHECK(meta);
     *meta = { 0 };
+    meta->chunking_is_supported = 1;
+    meta->unbuffered_io_is_supported = 1;
+    meta->supported_compression = compression_supported();
+    meta->rollover_is_supported = 1;
+    meta->frame_index_is_supported = 1;
+    meta->frame_descriptions_are_optional = 1;
+    meta->multiscale_is_supported = 1;
+    meta->durability_is_supported = 1;
 Error:
     return;
 }
 
+/// Most frames whose image data is being written at once.
+constexpr uint32_t max_writes_in_flight = 8;
+
+/// Disk space is reserved ahead of the end of the file in chunks that double
+/// in size, from `min_bytes_per_reservation` up to `max_bytes_per_reservation`.
+constexpr uint64_t min_bytes_per_reservation = 1ULL << 24;
+constexpr uint64_t max_bytes_per_reservation = 1ULL << 30;
+
+/// Gets ready to write to `file_`, just opened at `path` with `reserved`
+/// bytes reserved on disk, starting with the header. Closes it on failure.
 int
-Tiff::start() noexcept
+Tiff::begin_file_(const char* path, uint64_t reserved) noexcept
 {
     frame_count_ = 0;
-    CHECK(file_create(&file_, filename_.c_str(), filename_.length()));
+    reserved_ = reserved;
+    is_reserving_ = true;
+    is_staging_ = file_alignment_bytes(&file_) > 1;
+    if (is_staging_ &&
+        !file_async_init(&async_, &file_, max_writes_in_flight)) {
+        file_close(&file_);
+        goto Error;
+    }
+    slot_ = 0;
     {
-        const auto hdr = header();
-        write_(0, (void*)&hdr, sizeof(hdr));
-        last_offset_ = sizeof(hdr);
+        const auto hdr = header(align_section(sizeof(header_t)));
+        const uint8_t* beg = (const uint8_t*)&hdr;
+        const part_t part = { 0, &hdr, sizeof(hdr) };
+        if (is_staging_ ? !write_staged_(0, hdr.first_ifd, &part, 1)
+                        : !file_write(&file_, 0, beg, beg + sizeof(hdr))) {
+            file_async_destroy(&async_);
+            file_close(&file_);
+            goto Error;
+        }
+        last_offset_ = hdr.first_ifd;
+        // Until a frame is written, closing the list zeroes the header's.
+        last_ifd_next_offset_ = offsetof(header_t, first_ifd);
+    }
+    if (!is_staging_ && !start_writer_()) {
+        file_close(&file_);
+        goto Error;
+    }
+    lock_acquire(&durability_.sync_lock);
+    has_file_ = true;
+    lock_release(&durability_.sync_lock);
+    if (enable_frame_index_ && !frame_index_open(&index_, path)) {
+        finish_file_();
+        goto Error;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Writes out what's left for the current file, closes its list of ifds,
+/// and closes it.
+int
+Tiff::finish_file_() noexcept
+{
+    if (!has_file_)
+        return 1;
+    int is_ok = 1;
+    // Everything queued has to be on disk before the ifd list is closed.
+    if (has_writer_ && !stop_writer_())
+        is_ok = 0;
+    terminate_ifd_list();
+    file_async_destroy(&async_);
+    // Give back the space reserved past the last frame.
+    if (reserved_ > last_offset_ && !file_truncate(&file_, last_offset_))
+        is_ok = 0;
+    reserved_ = 0;
+    lock_acquire(&durability_.sync_lock);
+    if (!durability_sync_file(&durability_, &file_))
+        is_ok = 0;
+    file_close(&file_);
+    has_file_ = false;
+    lock_release(&durability_.sync_lock);
+    // Records are only written once their frames are queued.
+    if (!frame_index_close(&index_))
+        is_ok = 0;
+    frame_count_ = 0;
+    return is_ok;
+}
+
+int
+Tiff::start() noexcept
+{
+    has_template_ = false; // the pixel scale may have changed
+    CHECK(file_create_with_flags(&file_,
+                                 filename_.c_str(),
+                                 filename_.length(),
+                                 enable_unbuffered_io_ ? FileCreate_Unbuffered
+                                                       : 0));
+    CHECK(begin_file_(filename_.c_str(), 0));
+    is_cutting_strips_ = compression_ != StorageCompression_None || tile_width_;
+    if (is_cutting_strips_ || enable_multiscale_) {
+        // The sink thread compresses too, while it waits for the strips.
+        struct thread_attributes attributes = {};
+        snprintf(attributes.name, sizeof(attributes.name), "tiff-compress");
+        const unsigned nthreads = std::thread::hardware_concurrency();
+        if (!thread_pool_start(
+              &pool_, nthreads > 1 ? nthreads - 1 : 0, &attributes)) {
+            finish_file_();
+            goto Error;
+        }
+        has_pool_ = true;
+    }
+    is_rolling_over_ = max_frames_per_file_ || max_bytes_per_file_;
+    if (is_rolling_over_ &&
+        !rollover_init(&rollover_,
+                       max_frames_per_file_,
+                       max_bytes_per_file_,
+                       filename_.c_str(),
+                       filename_.length(),
+                       enable_unbuffered_io_ ? FileCreate_Unbuffered : 0,
+                       min_bytes_per_reservation)) {
+        is_rolling_over_ = false;
+        finish_file_();
+        if (has_pool_)
+            thread_pool_stop(&pool_);
+        has_pool_ = false;
+        goto Error;
+    }
+    if (!durability_start(&durability_)) {
+        if (is_rolling_over_)
+            rollover_destroy(&rollover_);
+        is_rolling_over_ = false;
+        finish_file_();
+        if (has_pool_)
+            thread_pool_stop(&pool_);
+        has_pool_ = false;
+        goto Error;
     }
     LOG("TIFF: Streaming to \"%s\"", filename_.c_str());
     return 1;
@@ -487,9 +888,40 @@ Error:
     return 0;
 }
 
+/// Closes the current file and moves on to the next one in the series.
+int
+Tiff::roll_over_() noexcept
+{
+    uint64_t reserved = 0;
+    if (!finish_file_())
+        LOGE("TIFF: Failed to finish writing \"%s\"", filename_.c_str());
+    CHECK(rollover_next(&rollover_, &file_, &reserved));
+    CHECK(begin_file_(rollover_current_path(&rollover_), reserved));
+    return 1;
+Error:
+    return 0;
+}
+
 void
 Tiff::terminate_ifd_list() noexcept
 {
+    if (is_staging_) {
+        if (!frame_count_)
+            return;
+        // The last frame's block is still in its slot. Zero the next offset
+        // there and rewrite the aligned piece of the block that holds it.
+        uint8_t* block = staging_ + last_slot_ * bytes_of_slot_;
+        const uint64_t at = last_ifd_next_offset_ - last_block_offset_;
+        const uint64_t beg = at - at % file_alignment_bytes(&file_);
+        const uint64_t end = file_align_up(&file_, at + sizeof(uint64_t));
+        if (!file_async_wait(&async_))
+            LOGE("TIFF: Failed to write \"%s\"", filename_.c_str());
+        memset(block + at, 0, sizeof(uint64_t));
+        if (!file_write(
+              &file_, last_block_offset_ + beg, block + beg, block + end))
+            LOGE("TIFF: Failed to write \"%s\"", filename_.c_str());
+        return;
+    }
     // zero out the last next offset.
     uint64_t data(0);
     write_(last_ifd_next_offset_, &data, sizeof(data));
@@ -499,10 +931,17 @@ int
 Tiff::stop() noexcept
 {
     if (state == DeviceState_Running) {
-        terminate_ifd_list();
-        file_close(&file_);
+        if (!durability_stop(&durability_))
+            LOGE("TIFF: Failed to sync \"%s\"", filename_.c_str());
+        if (!finish_file_())
+            LOGE("TIFF: Failed to finish writing \"%s\"", filename_.c_str());
+        if (is_rolling_over_)
+            rollover_destroy(&rollover_);
+        is_rolling_over_ = false;
+        if (has_pool_)
+            thread_pool_stop(&pool_);
+        has_pool_ = false;
         state = DeviceState_Armed;
-        frame_count_ = 0;
         LOG("TIFF: Writer stop");
     }
     return 1;
@@ -514,8 +953,468 @@ align8(uint64_t v)
     return (v + 7) >> 3 << 3;
 }
 
+/// Where the next section can start: 8 byte aligned, and aligned for the
+/// file when it's unbuffered.
+uint64_t
+Tiff::align_section(uint64_t offset) const noexcept
+{
+    return file_align_up(&file_, align8(offset));
+}
+
+/// Copies `parts` into the next slot at their offsets relative to `offset`,
+/// zeroing the gaps between them, then writes the `nbytes` of the slot out
+/// at `offset`. Both `offset` and `nbytes` must be aligned for the file.
+int
+Tiff::write_staged_(uint64_t offset,
+                    size_t nbytes,
+                    const part_t* parts,
+                    size_t nparts) noexcept
+{
+    if (nbytes > bytes_of_slot_) {
+        // Slots may still be in flight.
+        CHECK(file_async_wait(&async_));
+        if (staging_)
+            memory_free(staging_);
+        bytes_of_slot_ = 0;
+        slot_ = 0;
+        CHECK(staging_ = (uint8_t*)memory_alloc(max_writes_in_flight * nbytes,
+                                                AllocatorHint_Default));
+        bytes_of_slot_ = nbytes;
+    }
+    {
+        uint8_t* slot = staging_ + slot_ * bytes_of_slot_;
+        uint64_t cur = offset;
+        for (size_t i = 0; i < nparts; ++i) {
+            memset(slot + (cur - offset), 0, parts[i].offset - cur);
+            memcpy(slot + (parts[i].offset - offset),
+                   parts[i].buf,
+                   parts[i].nbytes);
+            cur = parts[i].offset + parts[i].nbytes;
+        }
+        memset(slot + (cur - offset), 0, offset + nbytes - cur);
+        CHECK(file_async_write(&async_, offset, slot, slot + nbytes));
+    }
+    last_slot_ = slot_;
+    last_block_offset_ = offset;
+    slot_ = (slot_ + 1) % max_writes_in_flight;
+    // Wrapping around reuses slots that may still be in flight.
+    if (slot_ == 0)
+        CHECK(file_async_wait(&async_));
+    return 1;
+Error:
+    return 0;
+}
+
+/// Makes sure disk space is reserved up to `end`, reserving the next chunk
+/// when it isn't.
+void
+Tiff::reserve_(uint64_t end) noexcept
+{
+    if (!is_reserving_ || end <= reserved_)
+        return;
+    const uint64_t n = std::max(
+      end - reserved_,
+      std::min(std::max(reserved_, min_bytes_per_reservation),
+               max_bytes_per_reservation));
+    if (file_preallocate(&file_, reserved_, n))
+        reserved_ += n;
+    else
+        is_reserving_ = false;
+}
+
+/// Indices of the tags in an ifd that change from frame to frame.
+constexpr size_t ifd_strip_offsets = 5;
+constexpr size_t ifd_strip_byte_counts = 7;
+constexpr size_t ifd_sub_ifds = 13;
+constexpr size_t ifd_image_description = 15;
+
+/// Frames are halved until neither side is longer than this.
+constexpr uint32_t multiscale_min_px = 256;
+
+/// @returns The number of times a `width` by `height` frame is halved.
+uint32_t
+count_levels(uint32_t width, uint32_t height) noexcept
+{
+    uint32_t n = 0;
+    while (std::max(width, height) > multiscale_min_px &&
+           std::min(width, height) >= 2) {
+        width /= 2;
+        height /= 2;
+        ++n;
+    }
+    return n;
+}
+
+/// @returns The ifd of a `width` by `height` level of a frame of `type`,
+/// halved `level` times, whose pixels are at `offset`.
+ifdN_t
+level_ifd(enum SampleType type,
+          uint32_t width,
+          uint32_t height,
+          uint32_t level,
+          uint64_t offset,
+          const struct PixelScale& pixel_scale_um)
+{
+    const size_t nbytes = (size_t)width * height * bytes_of_type(type);
+    const uint32_t scale = 1u << level;
+    return ifdN_t{
+        countof(ifdN_t{}.tags),
+        {
+          image_width(width),
+          image_length(height),
+          bits_per_sample((uint16_t)(8 * bytes_of_type(type))),
+          uncompressed(),
+          photometric_interpretation_black_is_zero(),
+          strip_offsets(offset),
+          rows_per_strip(height),
+          strip_byte_counts(nbytes),
+          x_resolution(10000 * 10000,
+                       10000 * (uint32_t)pixel_scale_um.x * scale),
+          y_resolution(10000 * 10000,
+                       10000 * (uint32_t)pixel_scale_um.y * scale),
+          resolution_unit_centimeter(),
+          orientation_top_left(),
+          sample_format(type),
+          samples_per_pixel_grayscale(),
+          tag_t::as_u32(254, 0x1), // reduced resolution
+          tag_t::as_u16(284, 1),   // chunky planar configuration
+        },
+        0
+    };
+}
+
+/// Width of each number in the image description. Fits any 64-bit value.
+constexpr size_t description_field_width = 20;
+
+/// The field of the image description holding the frame's checksum, which
+/// is null for frames without one.
+constexpr size_t description_checksum_field = 2;
+
+/// Compressed frames are cut into strips of about this many bytes, so
+/// large frames are compressed on several threads.
+constexpr size_t bytes_per_strip = 1 << 16;
+
+/// How a frame of `shape` is cut into tiles, or into strips when it's
+/// compressed, in the order they're written.
+Tiff::layout_t
+Tiff::layout_(const struct ImageShape& shape) const noexcept
+{
+    const uint32_t height = std::max<uint32_t>(1, shape.dims.height);
+    if (tile_width_) {
+        const uint32_t width = std::max<uint32_t>(1, shape.dims.width);
+        const uint32_t across = (width + tile_width_ - 1) / tile_width_;
+        const uint32_t down = (height + tile_length_ - 1) / tile_length_;
+        return { tile_length_, tile_width_, across, across * down };
+    }
+    if (compression_ == StorageCompression_None)
+        return { height, 0, 0, 1 };
+    const size_t bytes_of_row =
+      std::max<size_t>(1, shape.dims.width * bytes_of_type(shape.type));
+    const uint32_t rows = (uint32_t)std::clamp<size_t>(
+      bytes_per_strip / bytes_of_row, 1, height);
+    return { rows, 0, 0, (height + rows - 1) / rows };
+}
+
+void
+Tiff::build_template_(const struct ImageShape& shape)
+{
+    // The offsets and description are filled in per frame.
+    ifd_template_ = ifdN_t{
+        countof(ifd_template_.tags),
+        {
+          // required fields for grayscale images
+          image_width(shape.dims.width),
+          image_length(shape.dims.height),
+          bits_per_sample((uint16_t)(8 * bytes_of_type(shape.type))),
+          uncompressed(),
+          photometric_interpretation_black_is_zero(),
+          strip_offsets(0),
+          rows_per_strip(shape.dims.height),
+          strip_byte_counts(0),
+          x_resolution(10000 * 10000, 10000 * (uint32_t)pixel_scale_um_.x),
+          y_resolution(10000 * 10000, 10000 * (uint32_t)pixel_scale_um_.y),
+          resolution_unit_centimeter(),
+          orientation_top_left(),
+          sample_format(shape.type),
+          samples_per_pixel_grayscale(),
+          new_subfile_type_multipage(),
+          tag_t{},
+        },
+        0
+    };
+
+    // JSON allows the spaces the numbers are padded with.
+    static const char* const keys[] = {
+        "{\"frame_id\":",
+        ",\"hardware_frame_id\":",
+        ",\"crc32c\":",
+        ",\"timestamps\":{\"runtime\":",
+        ",\"hardware\":",
+    };
+    description_.clear();
+    if (!enable_frame_descriptions_) {
+        // Every slot has to hold a tag, so this one holds the default
+        // chunky planar configuration instead.
+        ifd_template_.tags[ifd_image_description] = tag_t::as_u16(284, 1);
+    } else {
+        for (size_t i = 0; i < countof(keys); ++i) {
+            description_ += keys[i];
+            description_fields_[i] = description_.size();
+            description_.append(description_field_width, ' ');
+        }
+        description_ += "}}";
+        ifd_template_.tags[ifd_image_description] = tag_t{
+            .tag = 270,
+            .type = 2,
+            .count = description_.size() + 1,
+            .value = {},
+        };
+    }
+
+    const layout_t layout = layout_(shape);
+    auto& tags = ifd_template_.tags;
+    tags[3] = tag_t::as_u16(259, compression_tiff_tag_value(compression_));
+    if (layout.cols) {
+        // Tiles take the place of strips, and the tile length that of the
+        // orientation, which defaults to top left anyway.
+        tags[ifd_strip_offsets] = tag_t::as_u64(324, 0);
+        tags[6] = tag_t::as_u32(322, layout.cols);
+        tags[ifd_strip_byte_counts] = tag_t::as_u64(325, 0);
+        tags[11] = tag_t::as_u32(323, layout.rows);
+    } else {
+        tags[6] = rows_per_strip(layout.rows);
+    }
+    tags[ifd_strip_offsets].count = layout.nstrips;
+    tags[ifd_strip_byte_counts].count = layout.nstrips;
+    if (enable_multiscale_) {
+        // The SubIFDs take the place of the samples per pixel, which
+        // defaults to 1 anyway. The offset is filled in per frame.
+        const uint32_t nlevels =
+          count_levels(shape.dims.width, shape.dims.height);
+        if (nlevels)
+            tags[ifd_sub_ifds] = tag_t{
+                .tag = 330, .type = 18, .count = nlevels, .value = {}
+            };
+    }
+
+    template_shape_ = shape;
+    has_template_ = true;
+}
+
+static void
+compress_strip(void* ctx)
+{
+    auto* strip = (Tiff::strip_t*)ctx;
+    const uint8_t* src = strip->src;
+    if (strip->rows) {
+        // Uncompressed tiles are copied straight to the output.
+        const bool is_raw = strip->codec == StorageCompression_None;
+        uint8_t* const tile = is_raw ? strip->out.data() : strip->tile.data();
+        uint8_t* dst = tile;
+        for (uint32_t i = 0; i < strip->rows; ++i) {
+            memcpy(dst, src + i * strip->stride, strip->bytes_of_row);
+            memset(dst + strip->bytes_of_row,
+                   0,
+                   strip->bytes_of_tile_row - strip->bytes_of_row);
+            dst += strip->bytes_of_tile_row;
+        }
+        memset(dst, 0, tile + strip->bytes_of_src - dst);
+        if (is_raw) {
+            strip->nbytes = strip->bytes_of_src;
+            return;
+        }
+        src = tile;
+    }
+    strip->nbytes = compress(strip->codec,
+                             strip->out.data(),
+                             strip->out.size(),
+                             src,
+                             strip->bytes_of_src);
+}
+
+static void
+downsample_frame(void* ctx)
+{
+    auto* pyramid = (Tiff::pyramid_t*)ctx;
+    const struct ImageShape& shape = pyramid->frame->shape;
+    const size_t bytes_of_pixel = bytes_of_type(shape.type);
+    const uint8_t* src = pyramid->frame->data;
+    uint32_t width = shape.dims.width, height = shape.dims.height;
+    size_t stride = (size_t)width * bytes_of_pixel;
+    pyramid->ok = true;
+    for (auto& level : pyramid->levels) {
+        level.width = width / 2;
+        level.height = height / 2;
+        level.data.resize((size_t)level.width * level.height *
+                          bytes_of_pixel);
+        if (!downsample2(
+              shape.type, src, stride, width, height, level.data.data())) {
+            pyramid->ok = false;
+            return;
+        }
+        src = level.data.data();
+        width = level.width;
+        height = level.height;
+        stride = (size_t)width * bytes_of_pixel;
+    }
+}
+
+/// Starts halving every frame in `frames` into `pyramids_` on the pool, one
+/// task per frame, each counting down `latch` when it's done.
+void
+Tiff::downsample_frames_(const struct VideoFrame* frames,
+                         size_t nbytes,
+                         struct latch* latch)
+{
+    const auto end = (const uint8_t*)frames + nbytes;
+    const auto next = [&](const struct VideoFrame* f) {
+        return (const struct VideoFrame*)((const uint8_t*)f +
+                                          f->bytes_of_frame);
+    };
+
+    size_t n = 0;
+    for (auto f = frames; (const uint8_t*)f < end; f = next(f))
+        ++n;
+    // Tasks hold pointers into `pyramids_`, so size it before submitting any.
+    pyramids_.resize(n);
+    latch_add(latch, n);
+    size_t i = 0;
+    for (auto f = frames; (const uint8_t*)f < end; f = next(f), ++i) {
+        pyramid_t& pyramid = pyramids_[i];
+        pyramid.frame = f;
+        pyramid.levels.resize(
+          count_levels(f->shape.dims.width, f->shape.dims.height));
+        pyramid.ok = false;
+        thread_pool_submit(&pool_, downsample_frame, &pyramid, latch);
+    }
+}
+
+/// Compresses every strip, or tile, of every frame in `frames` into
+/// `strips_`, in order, spreading them over the pool.
+int
+Tiff::compress_strips_(const struct VideoFrame* frames, size_t nbytes)
+{
+    const auto end = (const uint8_t*)frames + nbytes;
+    const auto next = [&](const struct VideoFrame* f) {
+        return (const struct VideoFrame*)((const uint8_t*)f +
+                                          f->bytes_of_frame);
+    };
+
+    size_t n = 0;
+    for (auto f = frames; (const uint8_t*)f < end; f = next(f))
+        n += layout_(f->shape).nstrips;
+    // Tasks hold pointers into `strips_`, so size it before submitting any.
+    strips_.resize(n);
+
+    struct latch latch;
+    latch_init(&latch, n);
+    size_t i = 0;
+    for (auto f = frames; (const uint8_t*)f < end; f = next(f)) {
+        const layout_t layout = layout_(f->shape);
+        const size_t bytes_of_pixel = bytes_of_type(f->shape.type);
+        const size_t bytes_of_row = f->shape.dims.width * bytes_of_pixel;
+        const size_t bytes_of_image = bytes_of_row * f->shape.dims.height;
+        for (uint32_t j = 0; j < layout.nstrips; ++j, ++i) {
+            strip_t& strip = strips_[i];
+            strip.codec = compression_;
+            strip.rows = 0;
+            if (layout.cols) {
+                const uint32_t x = (j % layout.across) * layout.cols;
+                const uint32_t y = (j / layout.across) * layout.rows;
+                strip.src = f->data + y * bytes_of_row + x * bytes_of_pixel;
+                strip.rows = std::min(layout.rows, f->shape.dims.height - y);
+                strip.bytes_of_row =
+                  std::min(layout.cols, f->shape.dims.width - x) *
+                  bytes_of_pixel;
+                strip.bytes_of_tile_row = layout.cols * bytes_of_pixel;
+                strip.stride = bytes_of_row;
+                strip.bytes_of_src = strip.bytes_of_tile_row * layout.rows;
+                if (compression_ != StorageCompression_None)
+                    strip.tile.resize(strip.bytes_of_src);
+            } else {
+                const size_t beg = (size_t)j * layout.rows * bytes_of_row;
+                strip.src = f->data + beg;
+                strip.bytes_of_src = std::min(
+                  bytes_of_image - beg, (size_t)layout.rows * bytes_of_row);
+            }
+            strip.out.resize(compress_bound(compression_, strip.bytes_of_src));
+            strip.nbytes = 0;
+            thread_pool_submit(&pool_, compress_strip, &strip, &latch);
+        }
+    }
+    thread_pool_wait(&pool_, &latch);
+
+    for (const auto& strip : strips_)
+        EXPECT(strip.nbytes, "TIFF: Failed to compress a strip.");
+    return 1;
+Error:
+    return 0;
+}
+
+/// Writes `frame`'s ids, checksum and timestamps into `description_`, right
+/// aligned in their fields.
+void
+Tiff::format_description_(const struct VideoFrame* frame) noexcept
+{
+    const uint64_t values[] = {
+        frame->frame_id,
+        frame->hardware_frame_id,
+        frame->checksum,
+        frame->timestamps.acq_thread,
+        frame->timestamps.hardware,
+    };
+    for (size_t i = 0; i < countof(values); ++i) {
+        char* const beg = description_.data() + description_fields_[i];
+        char* p = beg + description_field_width;
+        if (i == description_checksum_field && !frame->has_checksum) {
+            p -= 4;
+            memcpy(p, "null", 4); // NOLINT
+        } else {
+            uint64_t v = values[i];
+            do {
+                *--p = (char)('0' + v % 10);
+                v /= 10;
+            } while (v);
+        }
+        memset(beg, ' ', p - beg);
+    }
+}
+
 int
 Tiff::append(const struct VideoFrame* frames, size_t nbytes) noexcept
+{
+    durability_wrote(&durability_, nbytes);
+    if (!is_rolling_over_)
+        return append_to_file_(frames, nbytes);
+    const uint8_t* cur = (const uint8_t*)frames;
+    const uint8_t* const end = cur + nbytes;
+    while (cur < end) {
+        // Frames are counted uncompressed, so a file may come in under its
+        // limit.
+        const size_t n = rollover_fit(&rollover_,
+                                      (const struct VideoFrame*)cur,
+                                      end - cur,
+                                      frame_count_,
+                                      last_offset_,
+                                      nullptr);
+        if (!n) {
+            CHECK(roll_over_());
+            continue;
+        }
+        // Stops the device on failure.
+        if (!append_to_file_((const struct VideoFrame*)cur, n))
+            return 0;
+        cur += n;
+    }
+    return 1;
+Error:
+    stop();
+    return 0;
+}
+
+/// Writes `nbytes` of `frames` to the current file.
+int
+Tiff::append_to_file_(const struct VideoFrame* frames, size_t nbytes) noexcept
 {
     if (!nbytes)
         return 1;
@@ -528,73 +1427,230 @@ Tiff::append(const struct VideoFrame* frames, size_t nbytes) noexcept
         return (o < nbytes) ? (const struct VideoFrame*)p : nullptr;
     };
     try {
+        static const uint8_t zeros[8] = { 0 };
+        const auto gather = [&](const void* buf, size_t n) {
+            pieces_.push_back({ (const uint8_t*)buf, 0, n });
+        };
+        const auto gather_metadata = [&](const void* buf, size_t n) {
+            pieces_.push_back({ 0, metadata_.size(), n });
+            metadata_.insert(
+              metadata_.end(), (const uint8_t*)buf, (const uint8_t*)buf + n);
+        };
+        const uint64_t first_offset = align_section(last_offset_);
+        // Each frame's header makes up for some of the space taken by its
+        // ifd and strings.
+        reserve_(first_offset + nbytes);
+        metadata_.clear();
+        pieces_.clear();
+        struct latch downsampled;
+        latch_init(&downsampled, 0);
+        if (enable_multiscale_)
+            downsample_frames_(frames, nbytes, &downsampled);
+        // The pyramids are built while the strips are compressed, and have
+        // to be waited for even if compression fails.
+        const bool compressed =
+          !is_cutting_strips_ || compress_strips_(frames, nbytes);
+        if (enable_multiscale_) {
+            thread_pool_wait(&pool_, &downsampled);
+            for (const auto& pyramid : pyramids_)
+                EXPECT(pyramid.ok, "TIFF: Failed to downsample a frame.");
+        }
+        CHECK(compressed);
+
+        const strip_t* strip = strips_.data();
+        const pyramid_t* pyramid = pyramids_.data();
         for (cur = frames; cur; cur = next()) {
-            using ifdN_t = ifd_t<16>;
-            const auto bytes_of_image = cur->bytes_of_frame - sizeof(*cur);
+            // Without compression or tiles, the frame is one strip.
+            const strip_t* const strips = strip;
+            size_t nstrips = 1;
+            uint64_t bytes_of_image = cur->bytes_of_frame - sizeof(*cur);
+            if (is_cutting_strips_) {
+                nstrips = layout_(cur->shape).nstrips;
+                bytes_of_image = 0;
+                for (size_t i = 0; i < nstrips; ++i)
+                    bytes_of_image += strips[i].nbytes;
+                strip += nstrips;
+            }
+            const auto strip_data = [&](size_t i) -> const void* {
+                return is_cutting_strips_ ? (const void*)strips[i].out.data()
+                                          : (const void*)cur->data;
+            };
+            const auto strip_nbytes = [&](size_t i) -> uint64_t {
+                return is_cutting_strips_ ? strips[i].nbytes : bytes_of_image;
+            };
 
             // compute offsets
-            const auto section_ifd = align8(last_offset_);
+            const auto section_ifd = align_section(last_offset_);
             const auto section_data = align8(section_ifd + sizeof(ifdN_t));
             const auto section_strings = align8(section_data + bytes_of_image);
+            // Frames with several strips list their offsets and byte counts
+            // ahead of the description.
+            const uint64_t bytes_of_strip_table =
+              nstrips > 1 ? 2 * nstrips * sizeof(uint64_t) : 0;
+            const auto section_description =
+              section_strings + bytes_of_strip_table;
 
             // assemble ifd
-            ifd_strings_.reset(section_strings);
-            ifdN_t ifd{
-                countof(ifd.tags),
-                {
-                  // required fields for grayscale images
-                  image_width(cur->shape.dims.width),
-                  image_length(cur->shape.dims.height),
-                  bits_per_sample(
-                    (uint16_t)(8 * bytes_of_type(cur->shape.type))),
-                  uncompressed(),
-                  photometric_interpretation_black_is_zero(),
-                  strip_offsets(section_data),
-                  rows_per_strip(cur->shape.dims.height),
-                  strip_byte_counts(bytes_of_image),
-                  x_resolution(10000 * 10000,
-                               10000 * (uint32_t)pixel_scale_um_.x),
-                  y_resolution(10000 * 10000,
-                               10000 * (uint32_t)pixel_scale_um_.y),
-                  resolution_unit_centimeter(),
-                  orientation_top_left(),
-                  sample_format(cur->shape.type),
-                  samples_per_pixel_grayscale(),
-                  new_subfile_type_multipage(),
-
-                  (frame_count_ == 0) && (external_metadata_.length() > 0)
-                    ? image_description(
-                        ifd_strings_,
-                        "{\"frame_id\":%llu,\"hardware_frame_id\":%llu,"
-                        "\"timestamps\":{"
-                        "\"runtime\":%llu,\"hardware\":%llu},\"metadata\":%s}",
-                        cur->frame_id,
-                        cur->hardware_frame_id,
-                        cur->timestamps.acq_thread,
-                        cur->timestamps.hardware,
-                        external_metadata_.c_str())
-                    : image_description(ifd_strings_,
-                                        "{\"frame_id\":%llu,\"hardware_frame_"
-                                        "id\":%llu,\"timestamps\":{"
-                                        "\"runtime\":%llu,\"hardware\":%llu}}",
-                                        cur->frame_id,
-                                        cur->hardware_frame_id,
-                                        cur->timestamps.acq_thread,
-                                        cur->timestamps.hardware),
-                },
-                align8(ifd_strings_.offset)
-            };
+            EXPECT(cur->compression == FrameCompression_None,
+                   "TIFF: Can't write frames compressed by the runtime.");
+            EXPECT(sample_type_unpacked(cur->shape.type) == cur->shape.type,
+                   "TIFF: Can't write packed %s samples.",
+                   sample_type_as_string(cur->shape.type));
+            if (!has_template_ ||
+                cur->shape.dims.width != template_shape_.dims.width ||
+                cur->shape.dims.height != template_shape_.dims.height ||
+                cur->shape.type != template_shape_.type)
+                build_template_(cur->shape);
+            ifdN_t ifd = ifd_template_;
+            if (nstrips > 1) {
+                strip_table_.resize(2 * nstrips);
+                uint64_t offset = section_data;
+                for (size_t i = 0; i < nstrips; ++i) {
+                    strip_table_[i] = offset;
+                    strip_table_[nstrips + i] = strip_nbytes(i);
+                    offset += strip_nbytes(i);
+                }
+                ifd.tags[ifd_strip_offsets].value.u64 = section_strings;
+                ifd.tags[ifd_strip_byte_counts].value.u64 =
+                  section_strings + nstrips * sizeof(uint64_t);
+            } else {
+                ifd.tags[ifd_strip_offsets].value.u64 = section_data;
+                ifd.tags[ifd_strip_byte_counts].value.u64 = bytes_of_image;
+            }
+
+            const char* strings = 0;
+            size_t bytes_of_strings = 0;
+            if ((frame_count_ == 0) && (external_metadata_.length() > 0)) {
+                // Only the first frame carries the metadata, so it isn't
+                // worth a template.
+                ifd_strings_.reset(section_description);
+                char checksum[16] = "null";
+                if (cur->has_checksum)
+                    snprintf(checksum, sizeof(checksum), "%u", cur->checksum);
+                ifd.tags[ifd_image_description] = image_description(
+                  ifd_strings_,
+                  "{\"frame_id\":%llu,\"hardware_frame_id\":%llu,"
+                  "\"crc32c\":%s,\"timestamps\":{"
+                  "\"runtime\":%llu,\"hardware\":%llu},\"metadata\":%s}",
+                  cur->frame_id,
+                  cur->hardware_frame_id,
+                  checksum,
+                  cur->timestamps.acq_thread,
+                  cur->timestamps.hardware,
+                  external_metadata_.c_str());
+                strings = ifd_strings_.data;
+                bytes_of_strings = ifd_strings_.size;
+            } else if (enable_frame_descriptions_) {
+                format_description_(cur);
+                ifd.tags[ifd_image_description].value.u64 =
+                  section_description;
+                strings = description_.c_str();
+                bytes_of_strings = description_.size() + 1;
+            }
+            // Levels follow the strings, each ifd just ahead of its pixels.
+            // Frames with several levels list their ifds first.
+            const size_t nlevels =
+              enable_multiscale_ ? pyramid->levels.size() : 0;
+            const level_t* const levels =
+              nlevels ? pyramid->levels.data() : nullptr;
+            const auto section_levels =
+              align8(section_description + bytes_of_strings);
+            const uint64_t bytes_of_level_table =
+              nlevels > 1 ? nlevels * sizeof(uint64_t) : 0;
+            uint64_t end_of_frame = section_description + bytes_of_strings;
+            level_ifds_.clear();
+            level_table_.clear();
+            if (nlevels) {
+                end_of_frame = section_levels + bytes_of_level_table;
+                for (size_t i = 0; i < nlevels; ++i) {
+                    const level_t& level = levels[i];
+                    const uint64_t at = align8(end_of_frame);
+                    level_table_.push_back(at);
+                    level_ifds_.push_back(level_ifd(cur->shape.type,
+                                                    level.width,
+                                                    level.height,
+                                                    (uint32_t)i + 1,
+                                                    at + sizeof(ifdN_t),
+                                                    pixel_scale_um_));
+                    end_of_frame = at + sizeof(ifdN_t) + level.data.size();
+                }
+                ifd.tags[ifd_sub_ifds].value.u64 =
+                  nlevels > 1 ? section_levels : level_table_[0];
+            }
+            if (enable_multiscale_)
+                ++pyramid;
+            ifd.next = align_section(end_of_frame);
+            if (enable_frame_index_)
+                CHECK(frame_index_add(
+                  &index_, cur, section_ifd, ifd.next - section_ifd));
 
             // write
-            write_(section_ifd, &ifd, sizeof(ifd));
-            write_(section_data, (void*)cur->data, bytes_of_image);
-            write_(section_strings, ifd_strings_.data, ifd_strings_.size);
+            if (is_staging_) {
+                parts_.clear();
+                parts_.push_back({ section_ifd, &ifd, sizeof(ifd) });
+                uint64_t offset = section_data;
+                for (size_t i = 0; i < nstrips; ++i) {
+                    parts_.push_back(
+                      { offset, strip_data(i), strip_nbytes(i) });
+                    offset += strip_nbytes(i);
+                }
+                if (bytes_of_strip_table)
+                    parts_.push_back({ section_strings,
+                                       strip_table_.data(),
+                                       bytes_of_strip_table });
+                if (bytes_of_strings)
+                    parts_.push_back(
+                      { section_description, strings, bytes_of_strings });
+                if (bytes_of_level_table)
+                    parts_.push_back({ section_levels,
+                                       level_table_.data(),
+                                       bytes_of_level_table });
+                for (size_t i = 0; i < nlevels; ++i) {
+                    const auto& data = levels[i].data;
+                    parts_.push_back(
+                      { level_table_[i], &level_ifds_[i], sizeof(ifdN_t) });
+                    parts_.push_back({ level_table_[i] + sizeof(ifdN_t),
+                                       data.data(),
+                                       data.size() });
+                }
+                CHECK(write_staged_(section_ifd,
+                                    ifd.next - section_ifd,
+                                    parts_.data(),
+                                    parts_.size()));
+            } else {
+                // Sections are back to back, apart from padding up to the
+                // next multiple of 8 bytes.
+                gather_metadata(&ifd, sizeof(ifd));
+                for (size_t i = 0; i < nstrips; ++i)
+                    gather(strip_data(i), strip_nbytes(i));
+                gather(zeros,
+                       section_strings - (section_data + bytes_of_image));
+                gather_metadata(strip_table_.data(), bytes_of_strip_table);
+                gather_metadata(strings, bytes_of_strings);
+                uint64_t at = section_description + bytes_of_strings;
+                if (nlevels) {
+                    gather(zeros, section_levels - at);
+                    gather_metadata(level_table_.data(), bytes_of_level_table);
+                    at = section_levels + bytes_of_level_table;
+                }
+                for (size_t i = 0; i < nlevels; ++i) {
+                    const auto& data = levels[i].data;
+                    gather(zeros, level_table_[i] - at);
+                    gather_metadata(&level_ifds_[i], sizeof(ifdN_t));
+                    gather(data.data(), data.size());
+                    at = level_table_[i] + sizeof(ifdN_t) + data.size();
+                }
+                gather(zeros, ifd.next - at);
+            }
 
             // update markers
             last_ifd_next_offset_ = section_ifd + offsetof(ifdN_t, next);
             last_offset_ = ifd.next;
             ++frame_count_;
         }
+        if (!is_staging_)
+            CHECK(write_behind_(first_offset));
+        CHECK(frame_index_flush(&index_));
     } catch (const std::exception& e) {
         LOGE("Exception: %s", e.what());
         return 0;
@@ -603,6 +1659,117 @@ Tiff::append(const struct VideoFrame* frames, size_t nbytes) noexcept
         return 0;
     }
     return 1;
+Error:
+    file_async_wait(&async_);
+    stop();
+    return 0;
+}
+
+static void
+tiff_writer_main(void* ctx)
+{
+    ((Tiff*)ctx)->write_batches_();
+}
+
+int
+Tiff::start_writer_() noexcept
+{
+    batches_pending_ = 0;
+    batch_to_write_ = 0;
+    writer_is_stopping_ = false;
+    writer_failed_ = false;
+    CHECK(thread_create(&writer_, tiff_writer_main, this));
+    has_writer_ = true;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Waits for the writer to write every batch handed to it, then joins it.
+/// @returns 0 if any batch failed to write, otherwise 1.
+int
+Tiff::stop_writer_() noexcept
+{
+    lock_acquire(&writer_lock_);
+    writer_is_stopping_ = true;
+    condition_variable_notify_all(&notify_writer_);
+    lock_release(&writer_lock_);
+    thread_join(&writer_);
+    has_writer_ = false;
+    return !writer_failed_;
+}
+
+/// Runs on `writer_`, writing batches in the order they're handed over
+/// until it's stopped and none are left.
+void
+Tiff::write_batches_() noexcept
+{
+    struct thread_attributes attributes = {};
+    snprintf(attributes.name, sizeof(attributes.name), "tiff-writer");
+    thread_set_current_attributes(&attributes);
+
+    lock_acquire(&writer_lock_);
+    while (1) {
+        while (!writer_is_stopping_ && !batches_pending_)
+            condition_variable_wait(&notify_writer_, &writer_lock_);
+        if (!batches_pending_)
+            break;
+        const batch_t& batch = batches_[batch_to_write_];
+        lock_release(&writer_lock_);
+
+        const int ok = file_write(&file_,
+                                  batch.offset,
+                                  batch.data.data(),
+                                  batch.data.data() + batch.data.size());
+
+        lock_acquire(&writer_lock_);
+        if (!ok)
+            writer_failed_ = true;
+        batch_to_write_ ^= 1;
+        --batches_pending_;
+        condition_variable_notify_all(&notify_written_);
+    }
+    lock_release(&writer_lock_);
+}
+
+/// Copies `pieces_` into a free batch, waiting for one if both are queued,
+/// and hands it to the writer to write at `offset`.
+/// @returns 0 if an earlier batch failed to write, otherwise 1.
+int
+Tiff::write_behind_(uint64_t offset) noexcept
+{
+    lock_acquire(&writer_lock_);
+    while (batches_pending_ == countof(batches_) && !writer_failed_)
+        condition_variable_wait(&notify_written_, &writer_lock_);
+    const bool failed = writer_failed_;
+    const uint32_t i = (batch_to_write_ + batches_pending_) % countof(batches_);
+    lock_release(&writer_lock_);
+    EXPECT(!failed, "TIFF: Failed to write \"%s\"", filename_.c_str());
+
+    // The writer doesn't touch a batch until it's handed over.
+    {
+        batch_t& batch = batches_[i];
+        size_t nbytes = 0;
+        for (const auto& piece : pieces_)
+            nbytes += piece.nbytes;
+        batch.offset = offset;
+        batch.data.resize(nbytes);
+        uint8_t* dst = batch.data.data();
+        for (const auto& piece : pieces_) {
+            const uint8_t* src =
+              piece.buf ? piece.buf : metadata_.data() + piece.metadata_offset;
+            memcpy(dst, src, piece.nbytes);
+            dst += piece.nbytes;
+        }
+    }
+
+    lock_acquire(&writer_lock_);
+    ++batches_pending_;
+    condition_variable_notify_all(&notify_writer_);
+    lock_release(&writer_lock_);
+    return 1;
+Error:
+    return 0;
 }
 
 void
@@ -684,6 +1851,14 @@ tiff_reserve_image_shape(struct Storage* self_, const struct ImageShape* shape)
 { // no-op
 }
 
+/// Syncs what's been written to the current file so far, for `durability_`.
+int
+tiff_sync(void* ctx)
+{
+    const struct Tiff* self = (const struct Tiff*)ctx;
+    return !self->has_file_ || file_datasync(&self->file_);
+}
+
 } // end namespace ::{anonymous}
 
 extern "C" struct Storage*
@@ -9,8 +9,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Driver, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Driver, 1, __VA_ARGS__)
 #define CHECK(e)                                                               \
     do {                                                                       \
         if (!(e)) {                                                            \
@@ -21,13 +21,83 @@
 
 #define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
 
+/// Bucket `i` of a histogram counts values from 2^(i-1) up to but not
+/// including 2^i. Bucket 0 counts zeros.
+#define TRASH_HISTOGRAM_BUCKETS (65)
+
+/// Counts what reaches the device, so it can stand in for real storage to
+/// measure how fast the rest of the pipeline can go. Summarized in the log at
+/// stop.
+struct trash_stats
+{
+    uint64_t frames, bytes, appends;
+    /// Bytes handed to each append.
+    uint64_t append_bytes[TRASH_HISTOGRAM_BUCKETS];
+    /// Microseconds from each frame leaving the camera to reaching here.
+    uint64_t latency_us[TRASH_HISTOGRAM_BUCKETS];
+    uint64_t latency_us_sum, latency_us_max;
+    /// Started at start. When the last append came, in ms.
+    struct clock clock;
+    double last_append_ms;
+};
+
 struct Trash
 {
     struct Storage writer;
     struct StorageProperties settings;
     uint64_t iframe;
+    struct trash_stats stats;
 };
 
+static unsigned
+bucket_of(uint64_t v)
+{
+    unsigned i = 0;
+    while (v) {
+        v >>= 1;
+        ++i;
+    }
+    return i;
+}
+
+static void
+log_histogram(const char* name, const uint64_t* counts, const char* unit)
+{
+    for (unsigned i = 0; i < TRASH_HISTOGRAM_BUCKETS; ++i) {
+        if (!counts[i])
+            continue;
+        const unsigned long long lo = i ? 1ULL << (i - 1) : 0;
+        const unsigned long long hi = i < 64 ? 1ULL << i : ~0ULL;
+        LOG("Trash: %s [%llu, %llu) %s: %llu",
+            name,
+            lo,
+            hi,
+            unit,
+            (unsigned long long)counts[i]);
+    }
+}
+
+static void
+log_stats(const struct trash_stats* stats)
+{
+    const double seconds = stats->last_append_ms * 1e-3;
+    LOG("Trash: %llu frames, %llu bytes in %llu appends over %f s. "
+        "%f frames/s, %f MB/s.",
+        (unsigned long long)stats->frames,
+        (unsigned long long)stats->bytes,
+        (unsigned long long)stats->appends,
+        seconds,
+        seconds > 0 ? (double)stats->frames / seconds : 0.0,
+        seconds > 0 ? 1e-6 * (double)stats->bytes / seconds : 0.0);
+    if (!stats->frames)
+        return;
+    LOG("Trash: Latency from the camera: mean %f ms, max %f ms.",
+        1e-3 * (double)stats->latency_us_sum / (double)stats->frames,
+        1e-3 * (double)stats->latency_us_max);
+    log_histogram("Appends of", stats->append_bytes, "bytes");
+    log_histogram("Latency of", stats->latency_us, "us");
+}
+
 static enum DeviceState
 trash_set(struct Storage* self_, const struct StorageProperties* settings)
 {
@@ -50,7 +120,10 @@ trash_get_meta(const struct Storage* self_,
                struct StoragePropertyMetadata* meta)
 {
     CHECK(meta);
-    *meta = (struct StoragePropertyMetadata){ 0 };
+    *meta = (struct StoragePropertyMetadata){
+        .concurrent_append_is_supported = 1,
+        .compressed_frames_are_supported = 1,
+    };
 Error:
     return;
 }
@@ -60,12 +133,17 @@ trash_start(struct Storage* self_)
 {
     struct Trash* self = containerof(self_, struct Trash, writer);
     self->iframe = self->settings.first_frame_id;
+    memset(&self->stats, 0, sizeof(self->stats)); // NOLINT
+    clock_init(&self->stats.clock);
     return DeviceState_Running;
 }
 
 static enum DeviceState
 trash_stop(struct Storage* self_)
 {
+    struct Trash* self = containerof(self_, struct Trash, writer);
+    if (self_->state == DeviceState_Running)
+        log_stats(&self->stats);
     return DeviceState_Armed;
 }
 
@@ -75,6 +153,9 @@ trash_append(struct Storage* self_,
              size_t* nbytes)
 {
     struct Trash* self = containerof(self_, struct Trash, writer);
+    struct trash_stats* const stats = &self->stats;
+    // Frames handed over together arrive together.
+    const uint64_t now = clock_tic(0);
 
     {
         const uint8_t* const beg = (const uint8_t*)frames;
@@ -83,11 +164,43 @@ trash_append(struct Storage* self_,
         while (cur < end) {
             const struct VideoFrame* im = (const struct VideoFrame*)cur;
             const size_t delta = im->bytes_of_frame;
+            const uint64_t sent = im->timestamps.acq_thread;
+            const uint64_t latency_us =
+              now > sent ? (uint64_t)clock_tics_to_ns((int64_t)(now - sent)) /
+                             1000
+                         : 0;
+            ++stats->latency_us[bucket_of(latency_us)];
+            stats->latency_us_sum += latency_us;
+            if (latency_us > stats->latency_us_max)
+                stats->latency_us_max = latency_us;
+            ++stats->frames;
             ++self->iframe;
             cur += delta;
         }
     }
+    stats->bytes += *nbytes;
+    ++stats->appends;
+    ++stats->append_bytes[bucket_of(*nbytes)];
+    stats->last_append_ms = clock_toc_ms(&stats->clock);
+
+    return DeviceState_Running;
+}
 
+static enum DeviceState
+trash_append_at(struct Storage* self_,
+                const struct VideoFrame* frames,
+                size_t nbytes,
+                uint64_t first_frame_index,
+                uint64_t offset)
+{
+    return DeviceState_Running;
+}
+
+static enum DeviceState
+trash_append_annotations(struct Storage* self_,
+                         const struct FrameAnnotation* annotations,
+                         size_t nbytes)
+{
     return DeviceState_Running;
 }
 
@@ -119,7 +232,9 @@ trash_init()
                         .append = trash_append,
                         .stop = trash_stop,
                         .destroy = trash_destroy,
-                        .reserve_image_shape = trash_reserve_image_shape };
+                        .reserve_image_shape = trash_reserve_image_shape,
+                        .append_at = trash_append_at,
+                        .append_annotations = trash_append_annotations };
     return &self->writer;
 Error:
     return 0;
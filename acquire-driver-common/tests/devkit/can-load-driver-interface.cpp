@@ -1,6 +1,7 @@
 /// @file can-load-driver-interface.cpp
 /// Tests that the driver interface can be loaded.
 
+#include "device/kit/driver.h"
 #include "platform.h"
 #include "logger.h"
 
@@ -49,6 +50,13 @@ main()
     {
         auto init = (init_func_t)lib_load(&lib, "acquire_driver_init_v0");
         CHECK(init(reporter));
+
+        // So the runtime uses what the driver's devices have added since the
+        // kit was first versioned.
+        auto kit_version =
+          (uint32_t(*)())lib_load(&lib, "acquire_driver_kit_version_v0");
+        CHECK(kit_version);
+        CHECK(kit_version() == ACQUIRE_DEVICE_KIT_VERSION);
     }
     lib_close(&lib);
     return 0;
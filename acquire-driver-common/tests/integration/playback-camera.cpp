@@ -0,0 +1,169 @@
+/// @file playback-camera.cpp
+/// Test that the playback camera replays raw and TIFF recordings frame for
+/// frame, over and over, as fast as it can or as far apart as the frames
+/// were recorded.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+#include "simcam_stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 64, height = 48;
+constexpr uint64_t nframes = 20;
+
+/// Streams `max_frame_count` frames from `camera` to `filename` through
+/// `storage`.
+/// @returns How long the stream took, in ms.
+static double
+stream(const char* camera,
+       const char* storage,
+       const char* filename,
+       uint64_t max_frame_count)
+{
+    return stream_once(reporter,
+                       { .camera = camera,
+                         .storage = storage,
+                         .filename = filename,
+                         .pixel_type = SampleType_u8,
+                         .width = width,
+                         .height = height,
+                         .binning = 1,
+                         .exposure_time_us = 1e4f,
+                         .max_frame_count = max_frame_count });
+}
+
+/// Checks that frame `i` of `replay` has the pixels of frame `i % nframes`
+/// of `original`.
+static void
+check_replay(const char* original, const char* replay, uint64_t count)
+{
+    raw_reader a = {}, b = {};
+    CHECK(raw_reader_open(&a, original));
+    try {
+        CHECK(raw_reader_open(&b, replay));
+        try {
+            CHECK(raw_reader_frame_count(&a) == nframes);
+            EXPECT(raw_reader_frame_count(&b) == count,
+                   "Expected %llu frames. Got %llu.",
+                   (unsigned long long)count,
+                   (unsigned long long)raw_reader_frame_count(&b));
+            for (size_t i = 0; i < count; ++i) {
+                const VideoFrame* expected = raw_reader_frame(&a, i % nframes);
+                const VideoFrame* actual = raw_reader_frame(&b, i);
+                CHECK(actual->shape.dims.width == width);
+                CHECK(actual->shape.dims.height == height);
+                CHECK(actual->shape.type == SampleType_u8);
+                EXPECT(!memcmp(expected->data, actual->data, width * height),
+                       "Frame %llu doesn't match.",
+                       (unsigned long long)i);
+            }
+        } catch (...) {
+            raw_reader_close(&b);
+            throw;
+        }
+        raw_reader_close(&b);
+    } catch (...) {
+        raw_reader_close(&a);
+        throw;
+    }
+    raw_reader_close(&a);
+}
+
+/// @returns How long the raw recording `path` took, in ms.
+static double
+recorded_ms(const char* path)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, path));
+    const size_t n = raw_reader_frame_count(&reader);
+    CHECK(n);
+    const uint64_t first =
+      raw_reader_frame(&reader, 0)->timestamps.hardware;
+    const uint64_t last =
+      raw_reader_frame(&reader, n - 1)->timestamps.hardware;
+    raw_reader_close(&reader);
+    CHECK(last > first);
+    return (double)clock_tics_to_ns((int64_t)(last - first)) * 1e-6;
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        remove(TEST ".raw");
+        remove(TEST ".tif");
+        remove(TEST "-replay.raw");
+        stream("simulated.*random.*", "raw", TEST ".raw", nframes);
+
+        // Raw in, TIFF out, as fast as the frames can be read.
+        set_env("ACQUIRE_PLAYBACK_PATH", TEST ".raw");
+        set_env("ACQUIRE_PLAYBACK_MODE", "fast");
+        stream("simulated: playback", "tiff", TEST ".tif", nframes);
+
+        // TIFF in, raw out, twice over, as far apart as the frames were
+        // first recorded.
+        set_env("ACQUIRE_PLAYBACK_PATH", TEST ".tif");
+        set_env("ACQUIRE_PLAYBACK_MODE", "paced");
+        const double elapsed_ms = stream(
+          "simulated: playback", "raw", TEST "-replay.raw", 2 * nframes);
+        const double expected_ms = 2 * recorded_ms(TEST ".raw");
+        EXPECT(elapsed_ms >= 0.9 * expected_ms,
+               "Expected the replay to take about %f ms. Took %f ms.",
+               expected_ms,
+               elapsed_ms);
+
+        check_replay(TEST ".raw", TEST "-replay.raw", 2 * nframes);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
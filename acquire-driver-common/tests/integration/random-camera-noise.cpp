@@ -0,0 +1,132 @@
+/// @file random-camera-noise.cpp
+/// Test that the random simulated camera makes fresh, evenly spread noise
+/// for every frame, whether it generates it as it goes or copies it out of a
+/// pool made up front.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+#include "simcam_stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 256, height = 192;
+constexpr uint64_t nframes = 20;
+
+/// Streams from the random camera to `filename`.
+static void
+stream(const char* filename)
+{
+    stream_once(reporter,
+                { .camera = "simulated.*random.*",
+                  .storage = "raw",
+                  .filename = filename,
+                  .pixel_type = SampleType_u16,
+                  .width = width,
+                  .height = height,
+                  .binning = 1,
+                  .exposure_time_us = 1e3f,
+                  .max_frame_count = nframes });
+}
+
+static void
+check(const char* filename)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    try {
+        CHECK(raw_reader_frame_count(&reader) == nframes);
+        const size_t nbytes = 2 * width * height;
+        for (size_t i = 0; i < nframes; ++i) {
+            const VideoFrame* frame = raw_reader_frame(&reader, i);
+            CHECK(frame->shape.type == SampleType_u16);
+            // Uniform bytes average 127.5, give or take about 0.24 here.
+            uint64_t sum = 0;
+            for (size_t j = 0; j < nbytes; ++j)
+                sum += frame->data[j];
+            const double mean = (double)sum / (double)nbytes;
+            EXPECT(mean > 125.0 && mean < 130.0,
+                   "Frame %llu averages %f.",
+                   (unsigned long long)i,
+                   mean);
+            if (i)
+                EXPECT(memcmp(raw_reader_frame(&reader, i - 1)->data,
+                              frame->data,
+                              nbytes),
+                       "Frame %llu repeats the one before.",
+                       (unsigned long long)i);
+        }
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        remove(TEST ".raw");
+        remove(TEST "-pool.raw");
+
+        set_env("ACQUIRE_SIMCAM_NOISE_POOL", "0");
+        stream(TEST ".raw");
+        check(TEST ".raw");
+
+        set_env("ACQUIRE_SIMCAM_NOISE_POOL", "1");
+        stream(TEST "-pool.raw");
+        check(TEST "-pool.raw");
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
@@ -0,0 +1,159 @@
+/// @file raw-compact-frame-headers.cpp
+/// Test that the raw storage device writes frames with compact headers when
+/// asked to, and that the raw reader reads them back.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 100;
+
+static void
+acquire(AcquireRuntime* runtime, const char* filename, bool compact)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw"),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_compact_frame_headers(
+      &props.video[0].storage.settings, compact));
+
+    // A tiny ROI, where the header is most of what's written per frame.
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 8, .y = 4 };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+static uint64_t
+file_size(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    EXPECT(fp, "Failed to open %s", filename);
+    fseek(fp, 0, SEEK_END);
+    const long n = ftell(fp);
+    fclose(fp);
+    return (uint64_t)n;
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    try {
+        remove(TEST "-full.raw");
+        remove(TEST "-compact.raw");
+        acquire(runtime, TEST "-full.raw", false);
+        acquire(runtime, TEST "-compact.raw", true);
+
+        const uint64_t full = file_size(TEST "-full.raw");
+        const uint64_t compact = file_size(TEST "-compact.raw");
+        // 80 bytes a frame instead of 152.
+        EXPECT(5 * compact < 3 * full,
+               "Expected compact headers to save at least 40%% of the file. "
+               "Got %llu bytes, down from %llu.",
+               (unsigned long long)compact,
+               (unsigned long long)full);
+
+        raw_reader reader = {};
+        CHECK(raw_reader_open(&reader, TEST "-compact.raw"));
+        CHECK(raw_reader_frame_count(&reader) == nframes);
+        // There's no full header in the file to point at.
+        CHECK(raw_reader_frame(&reader, 0) == nullptr);
+        uint64_t last_timestamp = 0;
+        for (size_t i = 0; i < nframes; ++i) {
+            VideoFrame frame = {};
+            const uint8_t* data = nullptr;
+            CHECK(raw_reader_frame_header(&reader, i, &frame, &data));
+            EXPECT(frame.frame_id == i,
+                   "Expected frame %d. Got %d.",
+                   (int)i,
+                   (int)frame.frame_id);
+            CHECK(frame.shape.dims.width == 8);
+            CHECK(frame.shape.dims.height == 4);
+            CHECK(frame.shape.type == SampleType_u8);
+            CHECK(frame.bytes_of_frame == sizeof(VideoFrame) + 32);
+            CHECK(frame.timestamps.acq_thread >= last_timestamp);
+            CHECK(data);
+            last_timestamp = frame.timestamps.acq_thread;
+        }
+        CHECK(!raw_reader_frame_header(&reader, nframes, nullptr, nullptr));
+        raw_reader_close(&reader);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,205 @@
+/// @file side-by-side-tiff-frame-index.cpp
+/// Test that the side-by-side tiff/JSON writer can keep each frame's ids and
+/// timestamps in the frame index next to the TIFF file instead of in a
+/// description in each of its ifds.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// The layout of an index, as a reader outside the project would see it.
+#pragma pack(push, 1)
+struct frame_index_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bytes_of_record;
+};
+struct frame_index_record
+{
+    uint64_t frame_id;
+    uint64_t offset;
+    uint64_t nbytes;
+    uint64_t hardware_timestamp;
+    uint64_t runtime_timestamp;
+    uint64_t hardware_frame_id;
+};
+#pragma pack(pop)
+
+constexpr uint64_t nframes = 30;
+
+static std::vector<uint8_t>
+read_file(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    EXPECT(file, "Failed to open %s", path.string().c_str());
+    return { std::istreambuf_iterator<char>(file),
+             std::istreambuf_iterator<char>() };
+}
+
+template<typename T>
+static T
+read_at(const std::vector<uint8_t>& data, uint64_t offset)
+{
+    EXPECT(offset + sizeof(T) <= data.size(),
+           "Read of %d bytes at %llu is past the end of the file.",
+           (int)sizeof(T),
+           (unsigned long long)offset);
+    T out;
+    memcpy(&out, data.data() + offset, sizeof(T));
+    return out;
+}
+
+static void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff-json"),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  SIZED("{\"hello\":\"world\"}") + 1,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_frame_index(
+      &props.video[0].storage.settings, 1));
+    CHECK(storage_properties_set_disable_frame_descriptions(
+      &props.video[0].storage.settings, 1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].storage.frame_index_is_supported);
+    CHECK(metadata.video[0].storage.frame_descriptions_are_optional);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    try {
+        const fs::path path = TEST ".dir";
+        fs::remove_all(path);
+        acquire(runtime, TEST ".dir");
+
+        // Only the first ifd has a description, which carries the external
+        // metadata.
+        const auto data = read_file(path / "data.tif");
+        std::vector<uint64_t> ifds;
+        for (uint64_t ifd = read_at<uint64_t>(data, 8); ifd;
+             ifd = read_at<uint64_t>(
+               data, ifd + 8 + read_at<uint64_t>(data, ifd) * 20)) {
+            CHECK(ifds.size() < nframes);
+            ifds.push_back(ifd);
+            const uint64_t ntags = read_at<uint64_t>(data, ifd);
+            bool has_description = false;
+            for (uint64_t i = 0; i < ntags; ++i)
+                has_description |=
+                  read_at<uint16_t>(data, ifd + 8 + i * 20) == 270;
+            CHECK(has_description == (ifds.size() == 1));
+        }
+        CHECK(ifds.size() == nframes);
+
+        // The index has them instead, all in one read.
+        const auto index = read_file(path / "data.tif.idx");
+        const auto header = read_at<frame_index_header>(index, 0);
+        CHECK(header.bytes_of_record >= sizeof(frame_index_record));
+        CHECK(index.size() ==
+              sizeof(header) + nframes * header.bytes_of_record);
+        for (uint64_t i = 0; i < nframes; ++i) {
+            const auto record = read_at<frame_index_record>(
+              index, sizeof(header) + i * header.bytes_of_record);
+            CHECK(record.frame_id == i);
+            CHECK(record.offset == ifds[i]);
+            CHECK(record.hardware_timestamp);
+            CHECK(record.runtime_timestamp);
+            if (i) {
+                const auto last = read_at<frame_index_record>(
+                  index, sizeof(header) + (i - 1) * header.bytes_of_record);
+                // Ids skip any frames the camera dropped.
+                CHECK(record.hardware_frame_id > last.hardware_frame_id);
+                CHECK(record.runtime_timestamp >= last.runtime_timestamp);
+            }
+        }
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
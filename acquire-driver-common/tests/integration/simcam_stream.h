@@ -0,0 +1,135 @@
+/// @file simcam_stream.h
+/// Streams frames from a simulated camera to storage, for the integration
+/// tests that configure the simulated cameras through the environment.
+
+#ifndef H_ACQUIRE_TEST_SIMCAM_STREAM_V0
+#define H_ACQUIRE_TEST_SIMCAM_STREAM_V0
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#define SIMCAM_STREAM_CHECK(e)                                                 \
+    do {                                                                       \
+        if (!(e))                                                              \
+            throw std::runtime_error(std::string(__FILE__ "(") +              \
+                                     std::to_string(__LINE__) +                \
+                                     "): Expression evaluated as false: " #e); \
+    } while (0)
+
+/// What stream_once() streams.
+struct simcam_stream
+{
+    /// Patterns naming the camera and the storage device.
+    const char* camera;
+    const char* storage;
+    /// Where the storage device writes. Removed before the stream starts.
+    const char* filename;
+    enum SampleType pixel_type;
+    uint32_t width, height;
+    uint8_t binning;
+    float exposure_time_us;
+    uint64_t max_frame_count;
+};
+
+/// Sets the environment variable `name` to `value`.
+inline void
+set_env(const char* name, const char* value)
+{
+#ifdef _WIN32
+    SIMCAM_STREAM_CHECK(_putenv_s(name, value) == 0);
+#else
+    SIMCAM_STREAM_CHECK(setenv(name, value, 1) == 0);
+#endif
+}
+
+/// Streams frames as `config` says, in a runtime of its own.
+/// @details The driver reads the environment as it was when it was loaded,
+/// so each stream gets a runtime of its own.
+/// @param[out] metrics When not null, receives the stream's metrics.
+/// @returns How long the stream took, in ms.
+inline double
+stream_once(void (*reporter)(int is_error,
+                             const char* file,
+                             int line,
+                             const char* function,
+                             const char* msg),
+            const simcam_stream& config,
+            AcquireStreamMetrics* metrics = nullptr)
+{
+    remove(config.filename);
+    AcquireRuntime* runtime = acquire_init(reporter);
+    SIMCAM_STREAM_CHECK(runtime);
+    double elapsed_ms = 0;
+    try {
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        SIMCAM_STREAM_CHECK(dm);
+
+        AcquireProperties props = {};
+        SIMCAM_STREAM_CHECK(AcquireStatus_Ok ==
+                            acquire_get_configuration(runtime, &props));
+        SIMCAM_STREAM_CHECK(
+          Device_Ok ==
+          device_manager_select(dm,
+                                DeviceKind_Camera,
+                                config.camera,
+                                strlen(config.camera),
+                                &props.video[0].camera.identifier));
+        SIMCAM_STREAM_CHECK(
+          Device_Ok ==
+          device_manager_select(dm,
+                                DeviceKind_Storage,
+                                config.storage,
+                                strlen(config.storage),
+                                &props.video[0].storage.identifier));
+        SIMCAM_STREAM_CHECK(
+          storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  config.filename,
+                                  strlen(config.filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+        props.video[0].camera.settings.binning = config.binning;
+        props.video[0].camera.settings.pixel_type = config.pixel_type;
+        props.video[0].camera.settings.shape = { .x = config.width,
+                                                 .y = config.height };
+        props.video[0].camera.settings.exposure_time_us =
+          config.exposure_time_us;
+        props.video[0].max_frame_count = config.max_frame_count;
+
+        SIMCAM_STREAM_CHECK(AcquireStatus_Ok ==
+                            acquire_configure(runtime, &props));
+        storage_properties_destroy(&props.video[0].storage.settings);
+
+        struct clock clock;
+        clock_init(&clock);
+        SIMCAM_STREAM_CHECK(AcquireStatus_Ok == acquire_start(runtime));
+        SIMCAM_STREAM_CHECK(AcquireStatus_Ok == acquire_stop(runtime));
+        elapsed_ms = clock_toc_ms(&clock);
+
+        if (metrics) {
+            AcquireMetrics all = {};
+            SIMCAM_STREAM_CHECK(AcquireStatus_Ok ==
+                                acquire_get_metrics(runtime, &all));
+            *metrics = all.video[0];
+        }
+    } catch (...) {
+        acquire_shutdown(runtime);
+        throw;
+    }
+    acquire_shutdown(runtime);
+    return elapsed_ms;
+}
+
+#undef SIMCAM_STREAM_CHECK
+
+#endif // H_ACQUIRE_TEST_SIMCAM_STREAM_V0
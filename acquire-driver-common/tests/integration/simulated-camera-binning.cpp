@@ -0,0 +1,155 @@
+/// @file simulated-camera-binning.cpp
+/// Test that the random simulated camera streams binned and unbinned frames of
+/// 8- and 16-bit pixels, rendering each at full resolution while earlier ones
+/// are handed out.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 128, height = 96;
+constexpr uint64_t nframes = 100;
+
+static void
+stream(AcquireRuntime* runtime,
+       uint8_t binning,
+       SampleType type,
+       const char* filename)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw"),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = binning;
+    props.video[0].camera.settings.pixel_type = type;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+static void
+check(SampleType type, const char* filename)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    try {
+        EXPECT(raw_reader_frame_count(&reader) == nframes,
+               "Expected %llu frames. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)raw_reader_frame_count(&reader));
+        for (size_t i = 0; i < nframes; ++i) {
+            const VideoFrame* frame = raw_reader_frame(&reader, i);
+            CHECK(frame->shape.dims.width == width);
+            CHECK(frame->shape.dims.height == height);
+            CHECK(frame->shape.type == type);
+            // Ids skip any frames that were rendered over before being
+            // handed out.
+            if (i)
+                CHECK(frame->hardware_frame_id >
+                      raw_reader_frame(&reader, i - 1)->hardware_frame_id);
+        }
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+    try {
+        CHECK(runtime);
+        for (SampleType type : { SampleType_u8, SampleType_u16 }) {
+            for (uint8_t binning : { 1, 2, 4 }) {
+                char filename[64] = { 0 };
+                snprintf(filename,
+                         sizeof(filename),
+                         "%s-%s-bin%d.raw",
+                         TEST,
+                         sample_type_as_string(type),
+                         (int)binning);
+                remove(filename);
+                stream(runtime, binning, type, filename);
+                check(type, filename);
+            }
+        }
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,198 @@
+/// @file simulated-camera-faults.cpp
+/// Test that the simulated camera can drop frames, stall and change shape
+/// mid-stream, and that the runtime carries on through each.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+#include "simcam_stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 40;
+constexpr uint32_t width = 64, height = 48;
+
+struct sample
+{
+    uint64_t id;
+    uint64_t gap;
+    /// Hardware timestamp, in ms.
+    double ms;
+    uint32_t width, height;
+};
+
+struct result
+{
+    std::vector<sample> frames;
+    AcquireStreamMetrics metrics;
+};
+
+/// Streams `nframes` 2x binned frames from the random camera to `filename`,
+/// with the faults the environment asks for, and reads them back.
+static result
+stream(const char* filename)
+{
+    result out = {};
+    stream_once(reporter,
+                { .camera = "simulated.*random.*",
+                  .storage = "raw",
+                  .filename = filename,
+                  .pixel_type = SampleType_u8,
+                  .width = width,
+                  .height = height,
+                  .binning = 2,
+                  .exposure_time_us = 2e3f,
+                  .max_frame_count = nframes },
+                &out.metrics);
+    LOG("%s: %f frames per second in, %llu dropped",
+        filename,
+        out.metrics.fps_in,
+        (unsigned long long)out.metrics.dropped_frames);
+
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    for (size_t i = 0; i < raw_reader_frame_count(&reader); ++i) {
+        const VideoFrame* frame = raw_reader_frame(&reader, i);
+        out.frames.push_back(
+          { frame->hardware_frame_id,
+            frame->hardware_frame_gap,
+            1e-6 * (double)clock_tics_to_ns(
+                     (int64_t)frame->timestamps.hardware),
+            frame->shape.dims.width,
+            frame->shape.dims.height });
+    }
+    raw_reader_close(&reader);
+    CHECK(out.frames.size() == nframes);
+    return out;
+}
+
+/// Checks the runtime saw each gap in the frame ids, and counted them all.
+static void
+check_gaps(const result& r)
+{
+    uint64_t dropped = 0;
+    for (size_t i = 1; i < r.frames.size(); ++i) {
+        const auto &a = r.frames[i - 1], &b = r.frames[i];
+        CHECK(b.id > a.id);
+        EXPECT(b.gap == b.id - a.id - 1,
+               "Frame %llu has a gap of %llu after frame %llu.",
+               (unsigned long long)b.id,
+               (unsigned long long)b.gap,
+               (unsigned long long)a.id);
+        dropped += b.gap;
+    }
+    EXPECT(r.metrics.dropped_frames >= dropped,
+           "Expected at least %llu dropped frames. Counted %llu.",
+           (unsigned long long)dropped,
+           (unsigned long long)r.metrics.dropped_frames);
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        set_env("ACQUIRE_SIMCAM_STALL_PROBABILITY", "0");
+        set_env("ACQUIRE_SIMCAM_STALL_MS", "0");
+        set_env("ACQUIRE_SIMCAM_RESHAPE_EVERY", "0");
+
+        // Every 4th frame never comes.
+        set_env("ACQUIRE_SIMCAM_DROP_EVERY", "4");
+        {
+            const auto r = stream(TEST "-drop.raw");
+            check_gaps(r);
+            for (const auto& frame : r.frames)
+                EXPECT(frame.id % 4 != 3,
+                       "Frame %llu should have been dropped.",
+                       (unsigned long long)frame.id);
+            CHECK(r.metrics.dropped_frames >= nframes / 3 - 1);
+        }
+
+        // About half the frames are held back for 30 ms.
+        set_env("ACQUIRE_SIMCAM_DROP_EVERY", "0");
+        set_env("ACQUIRE_SIMCAM_STALL_PROBABILITY", "0.5");
+        set_env("ACQUIRE_SIMCAM_STALL_MS", "30");
+        {
+            const auto r = stream(TEST "-stall.raw");
+            check_gaps(r);
+            size_t nstalls = 0;
+            for (size_t i = 1; i < r.frames.size(); ++i)
+                nstalls += r.frames[i].ms - r.frames[i - 1].ms >= 29.0;
+            EXPECT(nstalls > 0 && nstalls < nframes - 1,
+                   "Expected some frames to stall. %d of %d did.",
+                   (int)nstalls,
+                   (int)nframes);
+        }
+
+        // Frames switch between full and half size every 5 frames.
+        set_env("ACQUIRE_SIMCAM_STALL_PROBABILITY", "0");
+        set_env("ACQUIRE_SIMCAM_STALL_MS", "0");
+        set_env("ACQUIRE_SIMCAM_RESHAPE_EVERY", "5");
+        {
+            const auto r = stream(TEST "-reshape.raw");
+            check_gaps(r);
+            size_t nhalf = 0;
+            for (const auto& frame : r.frames) {
+                const bool is_half = (frame.id / 5) % 2;
+                nhalf += is_half;
+                EXPECT(frame.width == (is_half ? width / 2 : width) &&
+                         frame.height == (is_half ? height / 2 : height),
+                       "Frame %llu is %ux%u.",
+                       (unsigned long long)frame.id,
+                       frame.width,
+                       frame.height);
+            }
+            CHECK(nhalf > 0 && nhalf < nframes);
+        }
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
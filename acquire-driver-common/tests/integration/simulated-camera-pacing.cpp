@@ -0,0 +1,174 @@
+/// @file simulated-camera-pacing.cpp
+/// Test that the simulated camera can be paced at a target frame rate, in
+/// bursts, and with jitter, independent of the exposure time.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+#include "simcam_stream.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 40;
+
+/// A frame's hardware frame id and timestamp, in ms.
+struct sample
+{
+    uint64_t id;
+    double ms;
+};
+
+/// Streams `nframes` frames from the empty camera to `filename`, paced by
+/// the environment, and reads back when each was made.
+static std::vector<sample>
+stream(const char* filename)
+{
+    // Pacing overrides the exposure time, which would otherwise space frames
+    // 100 ms apart.
+    stream_once(reporter,
+                { .camera = "simulated: empty",
+                  .storage = "raw",
+                  .filename = filename,
+                  .pixel_type = SampleType_u8,
+                  .width = 64,
+                  .height = 48,
+                  .binning = 1,
+                  .exposure_time_us = 1e5f,
+                  .max_frame_count = nframes });
+
+    std::vector<sample> out;
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    for (size_t i = 0; i < raw_reader_frame_count(&reader); ++i) {
+        const VideoFrame* frame = raw_reader_frame(&reader, i);
+        out.push_back({ frame->hardware_frame_id,
+                        1e-6 * (double)clock_tics_to_ns(
+                                 (int64_t)frame->timestamps.hardware) });
+    }
+    raw_reader_close(&reader);
+    CHECK(out.size() == nframes);
+    return out;
+}
+
+/// Checks frames were made `period_ms` apart on average, counting any the
+/// runtime skipped.
+static void
+check_mean_period(const std::vector<sample>& samples, double period_ms)
+{
+    const double elapsed_ms = samples.back().ms - samples.front().ms;
+    const double mean_ms =
+      elapsed_ms / (double)(samples.back().id - samples.front().id);
+    EXPECT(mean_ms > 0.95 * period_ms && mean_ms < 1.05 * period_ms,
+           "Expected frames %f ms apart. Got %f ms.",
+           period_ms,
+           mean_ms);
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        set_env("ACQUIRE_SIMCAM_BURST_FRAMES", "0");
+        set_env("ACQUIRE_SIMCAM_BURST_IDLE_MS", "0");
+
+        // 200 frames per second, on schedule.
+        set_env("ACQUIRE_SIMCAM_FRAME_RATE", "200");
+        set_env("ACQUIRE_SIMCAM_JITTER_US", "0");
+        check_mean_period(stream(TEST "-rate.raw"), 5.0);
+
+        // With up to 2 ms of jitter either way, which doesn't add up.
+        set_env("ACQUIRE_SIMCAM_JITTER_US", "2000");
+        {
+            const auto samples = stream(TEST "-jitter.raw");
+            check_mean_period(samples, 5.0);
+            std::vector<double> periods;
+            for (size_t i = 1; i < samples.size(); ++i) {
+                if (samples[i].id == samples[i - 1].id + 1)
+                    periods.push_back(samples[i].ms - samples[i - 1].ms);
+            }
+            CHECK(!periods.empty());
+            const auto [lo, hi] =
+              std::minmax_element(periods.begin(), periods.end());
+            EXPECT(*hi - *lo > 1.0,
+                   "Expected jittered periods. They ranged %f-%f ms.",
+                   *lo,
+                   *hi);
+        }
+
+        // Bursts of 5 frames back to back, 20 ms apart.
+        set_env("ACQUIRE_SIMCAM_FRAME_RATE", "0");
+        set_env("ACQUIRE_SIMCAM_JITTER_US", "0");
+        set_env("ACQUIRE_SIMCAM_BURST_FRAMES", "5");
+        set_env("ACQUIRE_SIMCAM_BURST_IDLE_MS", "20");
+        {
+            const auto samples = stream(TEST "-burst.raw");
+            for (size_t i = 1; i < samples.size(); ++i) {
+                const auto &a = samples[i - 1], &b = samples[i];
+                const double dt_ms = b.ms - a.ms;
+                if (a.id / 5 == b.id / 5)
+                    EXPECT(dt_ms < 10.0,
+                           "Frames %llu and %llu of a burst were %f ms apart.",
+                           (unsigned long long)a.id,
+                           (unsigned long long)b.id,
+                           dt_ms);
+                else
+                    EXPECT(dt_ms >= 19.0,
+                           "Bursts at frame %llu were only %f ms apart.",
+                           (unsigned long long)b.id,
+                           dt_ms);
+            }
+        }
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
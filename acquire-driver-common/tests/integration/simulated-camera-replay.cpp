@@ -0,0 +1,172 @@
+/// @file simulated-camera-replay.cpp
+/// Test that the simulated camera can make a few frames up front and hand
+/// them out round-robin, as fast as they're asked for, with frame ids in
+/// sequence.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 64, height = 48;
+constexpr uint64_t nreplay = 3, nframes = 60;
+
+static void
+set_env(const char* name, const char* value)
+{
+#ifdef _WIN32
+    CHECK(_putenv_s(name, value) == 0);
+#else
+    CHECK(setenv(name, value, 1) == 0);
+#endif
+}
+
+/// Streams `nframes` frames from the random camera to `filename`.
+/// @returns How long the stream took, in ms.
+static double
+stream(const char* filename)
+{
+    AcquireRuntime* runtime = acquire_init(reporter);
+    CHECK(runtime);
+    double elapsed_ms = 0;
+    try {
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*"),
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("raw"),
+                                    &props.video[0].storage.identifier));
+        CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                      0,
+                                      filename,
+                                      strlen(filename) + 1,
+                                      0,
+                                      0,
+                                      { 1, 1 },
+                                      0));
+
+        props.video[0].camera.settings.binning = 2;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = width, .y = height };
+        // Paced, this would take 6 s.
+        props.video[0].camera.settings.exposure_time_us = 1e5f;
+        props.video[0].max_frame_count = nframes;
+
+        OK(acquire_configure(runtime, &props));
+        storage_properties_destroy(&props.video[0].storage.settings);
+
+        struct clock clock;
+        clock_init(&clock);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        elapsed_ms = clock_toc_ms(&clock);
+    } catch (...) {
+        acquire_shutdown(runtime);
+        throw;
+    }
+    acquire_shutdown(runtime);
+    return elapsed_ms;
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        remove(TEST ".raw");
+        char n[16] = { 0 };
+        snprintf(n, sizeof(n), "%d", (int)nreplay);
+        set_env("ACQUIRE_SIMCAM_REPLAY_FRAMES", n);
+        const double elapsed_ms = stream(TEST ".raw");
+        EXPECT(elapsed_ms < 3000.0,
+               "Replaying %d frames took %f ms.",
+               (int)nframes,
+               elapsed_ms);
+
+        raw_reader reader = {};
+        CHECK(raw_reader_open(&reader, TEST ".raw"));
+        try {
+            CHECK(raw_reader_frame_count(&reader) == nframes);
+            for (size_t i = 0; i < nframes; ++i) {
+                const VideoFrame* frame = raw_reader_frame(&reader, i);
+                CHECK(frame->hardware_frame_id == i);
+                CHECK(frame->shape.dims.width == width);
+                CHECK(frame->shape.dims.height == height);
+                // Frames repeat every `nreplay`, and differ within that.
+                const VideoFrame* first =
+                  raw_reader_frame(&reader, i % nreplay);
+                const bool same =
+                  !memcmp(first->data, frame->data, width * height);
+                EXPECT(same,
+                       "Frame %d isn't a replay of frame %d.",
+                       (int)i,
+                       (int)(i % nreplay));
+                if (i && i < nreplay)
+                    CHECK(memcmp(raw_reader_frame(&reader, i - 1)->data,
+                                 frame->data,
+                                 width * height));
+            }
+        } catch (...) {
+            raw_reader_close(&reader);
+            throw;
+        }
+        raw_reader_close(&reader);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
@@ -0,0 +1,185 @@
+/// @file simulated-camera-sync.cpp
+/// Test that simulated cameras on a shared trigger bus make frames in
+/// lockstep, with matching hardware frame ids and timestamps.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 40;
+
+static void
+set_env(const char* name, const char* value)
+{
+#ifdef _WIN32
+    CHECK(_putenv_s(name, value) == 0);
+#else
+    CHECK(setenv(name, value, 1) == 0);
+#endif
+}
+
+/// Streams `nframes` frames from the random camera and the empty camera at
+/// once, each to a raw file of its own.
+static void
+stream(const char* filenames[2])
+{
+    AcquireRuntime* runtime = acquire_init(reporter);
+    CHECK(runtime);
+    try {
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*"),
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated: empty"),
+                                    &props.video[1].camera.identifier));
+        for (int i = 0; i < 2; ++i) {
+            remove(filenames[i]);
+            DEVOK(device_manager_select(dm,
+                                        DeviceKind_Storage,
+                                        SIZED("raw"),
+                                        &props.video[i].storage.identifier));
+            CHECK(storage_properties_init(&props.video[i].storage.settings,
+                                          0,
+                                          filenames[i],
+                                          strlen(filenames[i]) + 1,
+                                          0,
+                                          0,
+                                          { 1, 1 },
+                                          0));
+            props.video[i].camera.settings.binning = 1;
+            props.video[i].camera.settings.pixel_type = SampleType_u8;
+            props.video[i].camera.settings.shape = { .x = 64, .y = 48 };
+            // The bus's rate overrides the exposure time.
+            props.video[i].camera.settings.exposure_time_us = 1e5f;
+            props.video[i].max_frame_count = nframes;
+        }
+
+        OK(acquire_configure(runtime, &props));
+        for (int i = 0; i < 2; ++i)
+            storage_properties_destroy(&props.video[i].storage.settings);
+
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+    } catch (...) {
+        acquire_shutdown(runtime);
+        throw;
+    }
+    acquire_shutdown(runtime);
+}
+
+/// @returns The hardware timestamp of each frame in `filename`, by its
+/// hardware frame id.
+static std::map<uint64_t, uint64_t>
+read_timestamps(const char* filename)
+{
+    std::map<uint64_t, uint64_t> out;
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    for (size_t i = 0; i < raw_reader_frame_count(&reader); ++i) {
+        const VideoFrame* frame = raw_reader_frame(&reader, i);
+        CHECK(out.emplace(frame->hardware_frame_id, frame->timestamps.hardware)
+                .second);
+    }
+    raw_reader_close(&reader);
+    CHECK(out.size() == nframes);
+    return out;
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        // Both cameras on a bus ticking 200 times a second.
+        set_env("ACQUIRE_SIMCAM_SYNC_CAMERAS", "2");
+        set_env("ACQUIRE_SIMCAM_FRAME_RATE", "200");
+        const char* filenames[2] = { TEST "-0.raw", TEST "-1.raw" };
+        stream(filenames);
+
+        const auto a = read_timestamps(filenames[0]);
+        const auto b = read_timestamps(filenames[1]);
+        size_t nmatched = 0;
+        for (const auto& [id, timestamp] : a) {
+            const auto it = b.find(id);
+            if (it == b.end())
+                continue;
+            EXPECT(it->second == timestamp,
+                   "Frame %llu has different timestamps in each stream.",
+                   (unsigned long long)id);
+            ++nmatched;
+        }
+        EXPECT(nmatched >= nframes / 2,
+               "Only %d of %d frames were made on the same ticks.",
+               (int)nmatched,
+               (int)nframes);
+
+        // Ticks are spaced by the bus's rate.
+        const double elapsed_ms =
+          1e-6 * (double)clock_tics_to_ns(
+                   (int64_t)(a.rbegin()->second - a.begin()->second));
+        const double period_ms =
+          elapsed_ms / (double)(a.rbegin()->first - a.begin()->first);
+        EXPECT(period_ms > 4.75 && period_ms < 5.25,
+               "Expected ticks 5 ms apart. Got %f ms.",
+               period_ms);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
@@ -0,0 +1,145 @@
+/// @file stage-position-stream.cpp
+/// Test that frames streamed alongside a moving stage axis are tagged with
+/// where the axis was when they were acquired.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 20;
+
+/// Units per second the stage moves at. Far enough from its target that it
+/// never gets there during the stream.
+constexpr float velocity = 1000.0f;
+
+static void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw"),
+                                &props.video[0].storage.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_StageAxis,
+                                SIZED("simulated: stage"),
+                                &props.video[0].stage_axis.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e4f;
+    props.video[0].max_frame_count = nframes;
+    props.video[0].stage_axis.settings.immediate.position = 0.0f;
+    props.video[0].stage_axis.settings.target.position = 1e6f;
+    props.video[0].stage_axis.settings.target.velocity = velocity;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    try {
+        remove(TEST ".raw");
+        acquire(runtime, TEST ".raw");
+
+        raw_reader reader = {};
+        CHECK(raw_reader_open(&reader, TEST ".raw"));
+        CHECK(raw_reader_frame_count(&reader) == nframes);
+        const VideoFrame* first = raw_reader_frame(&reader, 0);
+        for (size_t i = 0; i < nframes; ++i) {
+            const VideoFrame* frame = raw_reader_frame(&reader, i);
+            EXPECT(frame->has_stage_position, "Frame %d is untagged.", (int)i);
+            // The stage moves at a constant speed, so how far it went
+            // between frames follows from when they were acquired.
+            const double dt =
+              1e-9 * (double)clock_tics_to_ns(
+                       (int64_t)(frame->timestamps.acq_thread -
+                                 first->timestamps.acq_thread));
+            const double expected = velocity * dt;
+            const double actual =
+              (double)frame->stage_position - first->stage_position;
+            EXPECT(fabs(actual - expected) < 1.0,
+                   "Frame %d: expected the stage to have moved %f. Got %f.",
+                   (int)i,
+                   expected,
+                   actual);
+        }
+        raw_reader_close(&reader);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,158 @@
+/// @file staged-tiff.cpp
+/// Test that the staged tiff writer writes to the staging directory and moves
+/// every file of the series, with its frame index, to where the uri says.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 100;
+constexpr uint64_t frames_per_file = 30;
+
+static void
+acquire(AcquireRuntime* runtime,
+        const fs::path& staging,
+        const fs::path& archived)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    const std::string uri = archived.string();
+    const std::string staging_uri = staging.string();
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff-staged"),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  uri.c_str(),
+                                  uri.length() + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_staging(&props.video[0].storage.settings,
+                                         staging_uri.c_str(),
+                                         staging_uri.length() + 1,
+                                         64ULL << 20));
+    CHECK(storage_properties_set_rollover(
+      &props.video[0].storage.settings, frames_per_file, 0));
+    CHECK(storage_properties_set_enable_frame_index(
+      &props.video[0].storage.settings, 1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].storage.staging_is_supported);
+
+    OK(acquire_get_configuration(runtime, &props));
+    const String* got = &props.video[0].storage.settings.staging_uri;
+    CHECK(got->str && staging_uri == got->str);
+    CHECK(props.video[0].storage.settings.migration_bytes_per_second ==
+          64ULL << 20);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    try {
+        const fs::path staging = TEST ".staging";
+        const fs::path archive = TEST ".archive";
+        for (const auto& dir : { staging, archive }) {
+            fs::remove_all(dir);
+            fs::create_directory(dir);
+        }
+        acquire(runtime, staging, archive / "run.tif");
+        // Files are moved in the background. They're all moved once the
+        // storage device is closed.
+        acquire_shutdown(runtime);
+        runtime = 0;
+
+        const char* names[] = { "run.tif", "run.1.tif", "run.2.tif",
+                                "run.3.tif" };
+        for (int i = 0; i < 4; ++i) {
+            const auto path = archive / names[i];
+            const uint64_t frames = i < 3 ? frames_per_file : 10;
+            EXPECT(fs::exists(path), "Expected %s.", path.string().c_str());
+            CHECK(fs::file_size(path) >= frames * 64 * 48);
+            CHECK(fs::exists(path.string() + ".idx"));
+        }
+        CHECK(!fs::exists(archive / "run.4.tif"));
+        EXPECT(fs::is_empty(staging),
+               "Expected %s to be empty.",
+               staging.string().c_str());
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    if (runtime)
+        acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,206 @@
+/// @file storage-durability.cpp
+/// Test that the raw and tiff storage devices write every frame with each
+/// durability policy, syncing periodically while files roll over.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 100;
+
+static void
+acquire(AcquireRuntime* runtime,
+        const char* storage,
+        const char* filename,
+        StorageDurability durability,
+        uint32_t interval_ms,
+        uint64_t interval_bytes,
+        uint64_t max_frames_per_file)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_durability(&props.video[0].storage.settings,
+                                            durability,
+                                            interval_ms,
+                                            interval_bytes));
+    CHECK(storage_properties_set_rollover(
+      &props.video[0].storage.settings, max_frames_per_file, 0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].storage.durability_is_supported);
+
+    OK(acquire_get_configuration(runtime, &props));
+    CHECK(props.video[0].storage.settings.durability == durability);
+    CHECK(props.video[0].storage.settings.durability_interval_ms ==
+          interval_ms);
+    CHECK(props.video[0].storage.settings.durability_interval_bytes ==
+          interval_bytes);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+static uint64_t
+file_size(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    EXPECT(fp, "Failed to open %s", filename);
+    fseek(fp, 0, SEEK_END);
+    const long n = ftell(fp);
+    fclose(fp);
+    return (uint64_t)n;
+}
+
+static void
+expect_raw_frames(const char* filename, uint64_t expected)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, filename));
+    const uint64_t n = raw_reader_frame_count(&reader);
+    raw_reader_close(&reader);
+    EXPECT(n == expected,
+           "Expected %llu frames in %s. Got %llu.",
+           (unsigned long long)expected,
+           filename,
+           (unsigned long long)n);
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    try {
+        acquire(runtime,
+                "raw",
+                TEST "-none.raw",
+                StorageDurability_None,
+                0,
+                0,
+                0);
+        expect_raw_frames(TEST "-none.raw", nframes);
+
+        acquire(runtime,
+                "raw",
+                TEST "-on-stop.raw",
+                StorageDurability_OnStop,
+                0,
+                0,
+                0);
+        expect_raw_frames(TEST "-on-stop.raw", nframes);
+
+        // Every few frames, by bytes, while the files roll over.
+        acquire(runtime,
+                "raw",
+                TEST "-periodic.raw",
+                StorageDurability_Periodic,
+                0,
+                4 * 64 * 48,
+                40);
+        expect_raw_frames(TEST "-periodic.raw", 40);
+        expect_raw_frames(TEST "-periodic.1.raw", 40);
+        expect_raw_frames(TEST "-periodic.2.raw", 20);
+
+        // Every few milliseconds.
+        acquire(runtime,
+                "tiff",
+                TEST "-periodic.tif",
+                StorageDurability_Periodic,
+                5,
+                0,
+                50);
+        CHECK(file_size(TEST "-periodic.tif") > nframes / 2 * 64 * 48);
+        CHECK(file_size(TEST "-periodic.1.tif") > nframes / 2 * 64 * 48);
+
+        // Out of range.
+        {
+            AcquireProperties props = {};
+            OK(acquire_get_configuration(runtime, &props));
+            props.video[0].storage.settings.durability = StorageDurabilityCount;
+            OK(acquire_configure(runtime, &props));
+            CHECK(acquire_get_state(runtime) ==
+                  DeviceState_AwaitingConfiguration);
+        }
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,236 @@
+/// @file stream-to-tcp.cpp
+/// Test that the tcp storage device streams frames to a receiver in the
+/// format described in tcp_stream.h, all of them, even when the receiver is
+/// slow to start reading, and that bad addresses and receivers that aren't
+/// there are reported.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "tcp_stream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// Big enough frames that the connection fills up while the receiver waits.
+constexpr uint32_t width = 1024, height = 1024;
+constexpr uint64_t nframes = 64;
+constexpr char metadata[] = R"({"hello": "world"})";
+
+/// What the receiver read off the connection.
+struct receiver
+{
+    struct tcp_socket listener;
+    float delay_ms;
+
+    int ok;
+    tcp_stream_header header;
+    std::string metadata;
+    std::vector<VideoFrame> frames;
+    tcp_record end;
+};
+
+static void
+receive(void* receiver_)
+{
+    auto* r = (struct receiver*)receiver_;
+    struct tcp_socket socket;
+    if (!tcp_accept(&r->listener, &socket))
+        return;
+    // Don't read anything for a while, so the sender is held back.
+    clock_sleep_ms(0, r->delay_ms);
+
+    std::vector<uint8_t> buf;
+    const auto read = [&](void* dst, size_t n) {
+        return tcp_recv(&socket, (uint8_t*)dst, (uint8_t*)dst + n);
+    };
+    if (!read(&r->header, sizeof(r->header)))
+        goto Done;
+    r->metadata.resize(r->header.bytes_of_metadata);
+    if (!read(r->metadata.data(), r->metadata.size()))
+        goto Done;
+    while (1) {
+        tcp_record record = {};
+        if (!read(&record, sizeof(record)))
+            goto Done;
+        if (record.kind == TcpRecord_End) {
+            r->end = record;
+            break;
+        }
+        if (record.kind != TcpRecord_Frame ||
+            record.frame_index != r->frames.size() ||
+            record.bytes_of_record < sizeof(VideoFrame))
+            goto Done;
+        // Only the headers are kept.
+        buf.resize(record.bytes_of_record);
+        if (!read(buf.data(), buf.size()))
+            goto Done;
+        r->frames.push_back(*(const VideoFrame*)buf.data());
+    }
+    // The sender hangs up after the end record.
+    {
+        uint8_t extra = 0;
+        r->ok = !read(&extra, 1);
+    }
+Done:
+    tcp_close(&socket);
+}
+
+static void
+configure(AcquireRuntime* runtime, const std::string& uri)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated: radial sin"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tcp"),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  uri.c_str(),
+                                  uri.size() + 1,
+                                  metadata,
+                                  sizeof(metadata),
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    acquire_configure(runtime, &props);
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+static std::string
+address(uint16_t port)
+{
+    return "tcp://127.0.0.1:" + std::to_string(port);
+}
+
+int
+main()
+{
+    int retval = 1;
+    auto runtime = acquire_init(reporter);
+    auto* r = new struct receiver();
+    struct thread thread;
+    thread_init(&thread);
+    int is_listening = 0, is_running = 0;
+    try {
+        uint16_t port = 0;
+        CHECK(tcp_listen(&r->listener, "127.0.0.1", &port));
+        is_listening = 1;
+        r->delay_ms = 500.0f;
+        CHECK(thread_create(&thread, receive, r));
+        is_running = 1;
+
+        configure(runtime, address(port));
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        thread_join(&thread);
+        is_running = 0;
+
+        CHECK(r->ok);
+        CHECK(0 == memcmp(r->header.magic,
+                          TCP_STREAM_MAGIC,
+                          sizeof(r->header.magic)));
+        CHECK(r->header.version == TCP_STREAM_VERSION);
+        CHECK(r->metadata == metadata);
+        EXPECT(r->frames.size() == nframes,
+               "Expected %llu frames. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)r->frames.size());
+        CHECK(r->end.frame_index == nframes);
+        for (size_t i = 0; i < r->frames.size(); ++i) {
+            const VideoFrame& frame = r->frames[i];
+            EXPECT(frame.frame_id == i,
+                   "Expected frame %d. Got %d.",
+                   (int)i,
+                   (int)frame.frame_id);
+            CHECK(frame.shape.dims.width == width);
+            CHECK(frame.shape.dims.height == height);
+            CHECK(frame.bytes_of_frame >=
+                  sizeof(frame) + (size_t)width * height * 2);
+        }
+
+        // Nothing listens here any more, so starting fails.
+        tcp_close(&r->listener);
+        is_listening = 0;
+        configure(runtime, address(port));
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        CHECK(acquire_start(runtime) != AcquireStatus_Ok);
+        acquire_abort(runtime);
+
+        // Addresses without a port are rejected.
+        for (const char* uri : { "tcp://127.0.0.1", "tcp://:1234", "[::1]" }) {
+            configure(runtime, uri);
+            CHECK(acquire_get_state(runtime) ==
+                  DeviceState_AwaitingConfiguration);
+        }
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    if (is_listening)
+        tcp_close(&r->listener);
+    if (is_running)
+        thread_join(&thread);
+    delete r;
+    acquire_shutdown(runtime);
+    return retval;
+}
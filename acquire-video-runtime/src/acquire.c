@@ -5,6 +5,8 @@
 #include "logger.h"
 #include "platform.h"
 #include "runtime/channel.h"
+#include "runtime/frame_iterator.h"
+#include "runtime/io_scheduler.h"
 #include "runtime/video.h"
 #include "runtime/vfslice.h"
 
@@ -19,8 +21,8 @@
 #define countof(e) (sizeof(e) / sizeof(*(e)))
 
 #define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
 
 // #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -54,17 +56,68 @@
         }                                                                      \
     } while (0)
 
+/// Used for each of a stream's channels unless configured otherwise.
+#define DEFAULT_CHANNEL_CAPACITY_BYTES (1ULL << 30)
+
+/// How often queued log messages are reported when logging asynchronously.
+#define LOG_DRAIN_INTERVAL_MS (10.0f)
+
+struct AcquireMonitorReader
+{
+    struct video_monitor_s monitor;
+    struct video_s* video;
+    /// The stream's queue to storage, or its preview's queue.
+    struct channel* channel;
+    struct AcquireMonitorReader* next;
+};
+
+struct AcquireReadHold
+{
+    /// Registered with `channel` to keep the held region from the writer.
+    struct channel_reader reader;
+    struct channel* channel;
+    struct video_s* video;
+};
+
 struct runtime
 {
     struct AcquireRuntime handle;
     enum DeviceState state;
     struct DeviceManager device_manager;
 
-    uint8_t valid_video_streams; /// i'th bit set iff i'th video stream is valid
+    /// i'th bit set iff i'th video stream is valid
+    uint32_t valid_video_streams;
 
-    struct video_s video[2];
+    /// See `AcquireProperties::memory_budget_bytes`. The i'th bit of
+    /// `budgeted_video_streams` is set iff the i'th stream's queues were
+    /// sized by the budget.
+    uint64_t memory_budget_bytes;
+    float memory_budget_fraction;
+    uint32_t budgeted_video_streams;
+
+    /// Orders the appends of streams whose `storage.io_is_scheduled` is set.
+    struct io_scheduler io_scheduler;
+
+    struct video_s video[ACQUIRE_MAX_VIDEO_STREAMS];
+
+    /// Where acquire_stop() writes the trace of the last acquisition, or
+    /// NULL when tracing is off. See acquire_set_trace().
+    char* trace_path;
+
+    /// Reports queued log messages while logging is asynchronous. See
+    /// acquire_set_async_logging().
+    struct thread log_thread;
+    uint32_t log_thread_is_stopping;
+    uint8_t is_logging_async;
+
+    /// Set while acquire_stop_within() left frames to be stored after it
+    /// returned. See finish_stop().
+    uint8_t is_stop_pending;
 };
 
+static void
+finish_stop(struct runtime* self);
+
 #define QUOTE(name) #name
 #define STR(macro) QUOTE(macro)
 
@@ -85,14 +138,14 @@ acquire_api_version_string()
     return version;
 }
 
-enum AcquireStatusCode
-acquire_map_read(const struct AcquireRuntime* self_,
-                 uint32_t istream,
-                 struct VideoFrame** beg,
-                 struct VideoFrame** end)
+static enum AcquireStatusCode
+map_read(const struct AcquireRuntime* self_,
+         uint32_t istream,
+         uint32_t timeout_ms,
+         struct VideoFrame** beg,
+         struct VideoFrame** end)
 {
     struct runtime* self = 0;
-    size_t nbytes = 0;
 
     EXPECT(self_, "Invalid parameter: `self` was NULL.");
     EXPECT(beg, "Invalid parameter: `beg` was NULL.");
@@ -103,8 +156,10 @@ acquire_map_read(const struct AcquireRuntime* self_,
     self = containerof(self_, struct runtime, handle);
     EXPECT(self->video[istream].monitor.reader.state == ChannelState_Unmapped,
            "Expected an unmapped reader. See acquire_unmap_read().");
-    struct vfslice_mut slice = make_vfslice_mut(channel_read_map(
-      &self->video[istream].sink.in, &self->video[istream].monitor.reader));
+    struct vfslice_mut slice = make_vfslice_mut(
+      video_monitor_map(&self->video[istream].monitor,
+                        &self->video[istream].sink.in,
+                        timeout_ms));
     CHECK(self->video[istream].monitor.reader.status == Channel_Ok);
     *beg = slice.beg;
     *end = slice.end;
@@ -113,6 +168,50 @@ Error:
     return AcquireStatus_Error;
 }
 
+enum AcquireStatusCode
+acquire_map_read(const struct AcquireRuntime* self_,
+                 uint32_t istream,
+                 struct VideoFrame** beg,
+                 struct VideoFrame** end)
+{
+    return map_read(self_, istream, 0, beg, end);
+}
+
+enum AcquireStatusCode
+acquire_map_read_wait(const struct AcquireRuntime* self_,
+                      uint32_t istream,
+                      uint32_t timeout_ms,
+                      struct VideoFrame** beg,
+                      struct VideoFrame** end)
+{
+    return map_read(self_, istream, timeout_ms, beg, end);
+}
+
+enum AcquireStatusCode
+acquire_map_latest(const struct AcquireRuntime* self_,
+                   uint32_t istream,
+                   struct VideoFrame** frame)
+{
+    struct runtime* self = 0;
+
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(frame, "Invalid parameter: `frame` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->monitor.reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read().");
+    const struct slice slice =
+      video_monitor_map_latest(&video->monitor, &video->sink.in);
+    CHECK(video->monitor.reader.status == Channel_Ok);
+    *frame = slice.beg < slice.end ? (struct VideoFrame*)slice.beg : 0;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 enum AcquireStatusCode
 acquire_unmap_read(const struct AcquireRuntime* self_,
                    uint32_t istream,
@@ -122,9 +221,146 @@ acquire_unmap_read(const struct AcquireRuntime* self_,
     CHECK(self_);
     CHECK(istream < countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    channel_read_unmap(&self->video[istream].sink.in,
-                       &self->video[istream].monitor.reader,
-                       consumed_bytes);
+    video_monitor_unmap(&self->video[istream].monitor,
+                        &self->video[istream].sink.in,
+                        consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+/// Keeps the region `reader` has mapped on `channel`, a queue of `video`,
+/// from the writer.
+/// @returns The hold, or NULL on failure.
+static struct AcquireReadHold*
+hold_read(struct video_s* video,
+          struct channel* channel,
+          const struct channel_reader* reader)
+{
+    struct AcquireReadHold* hold = 0;
+    EXPECT(hold = (struct AcquireReadHold*)malloc(sizeof(*hold)),
+           "Failed to allocate a read hold.");
+    memset(hold, 0, sizeof(*hold)); // NOLINT
+    hold->channel = channel;
+    hold->video = video;
+    CHECK(channel_read_hold(channel, reader, &hold->reader));
+    fetch_add_relaxed(&video->read_holds, 1);
+    return hold;
+Error:
+    free(hold);
+    return 0;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_and_hold(const struct AcquireRuntime* self_,
+                            uint32_t istream,
+                            size_t consumed_bytes,
+                            struct AcquireReadHold** hold)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(hold);
+    CHECK(istream < countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    struct AcquireReadHold* out = 0;
+    CHECK(out = hold_read(video, &video->sink.in, &video->monitor.reader));
+    video_monitor_unmap(&video->monitor, &video->sink.in, consumed_bytes);
+    *hold = out;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_release_read_hold(struct AcquireReadHold* hold)
+{
+    CHECK(hold);
+    channel_reader_detach(hold->channel, &hold->reader);
+    fetch_add_relaxed(&hold->video->read_holds, (uint32_t)-1);
+    free(hold);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_set_channel_allocator(struct AcquireRuntime* self_,
+                              uint32_t istream,
+                              const struct AcquireChannelAllocator* allocator)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    EXPECT(self->state != DeviceState_Running,
+           "Can't change how queues are allocated while running.");
+    const struct channel_allocator hooks =
+      allocator ? (struct channel_allocator){ .alloc = allocator->alloc,
+                                              .free = allocator->free,
+                                              .ctx = allocator->ctx }
+                : (struct channel_allocator){ 0 };
+    channel_set_allocator(&self->video[istream].sink.in, &hooks);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+struct AcquireFrameIterator
+acquire_frame_iterator_init(struct VideoFrame* beg, struct VideoFrame* end)
+{
+    return (struct AcquireFrameIterator){ .beg = (uint8_t*)beg,
+                                          .end = (uint8_t*)end };
+}
+
+struct VideoFrame*
+acquire_frame_iterator_next(struct AcquireFrameIterator* it)
+{
+    if (!it)
+        return 0;
+    struct frame_iterator inner =
+      frame_iterator_init(&(struct slice){ .beg = it->beg, .end = it->end });
+    struct VideoFrame* frame = frame_iterator_next(&inner);
+    it->beg = inner.remaining.beg;
+    it->end = inner.remaining.end;
+    return frame;
+}
+
+enum AcquireStatusCode
+acquire_list_frames(struct VideoFrame* beg,
+                    struct VideoFrame* end,
+                    struct AcquireFrameRef* frames,
+                    size_t capacity,
+                    size_t* count,
+                    size_t* nbytes)
+{
+    size_t n = 0;
+    uint8_t* cur = (uint8_t*)beg; // first frame not listed
+    CHECK(count);
+    *count = 0;
+    CHECK(frames || !capacity);
+    CHECK(beg <= end);
+
+    struct frame_iterator it =
+      frame_iterator_init(&(struct slice){ .beg = cur, .end = (uint8_t*)end });
+    struct VideoFrame* frame = 0;
+    while (n < capacity && (frame = frame_iterator_next(&it))) {
+        frames[n++] = (struct AcquireFrameRef){
+            .frame = frame,
+            .data = frame->data,
+            .bytes_of_data = frame->compression != FrameCompression_None
+                               ? frame->bytes_of_data
+                               : bytes_of_image(&frame->shape),
+            .shape = frame->shape,
+        };
+        cur += frame->bytes_of_frame;
+    }
+    *count = n;
+    if (nbytes)
+        *nbytes = cur - (uint8_t*)beg;
+    EXPECT(n == capacity || cur == (uint8_t*)end,
+           "Frame at byte %llu of the region doesn't fit in it.",
+           (unsigned long long)(cur - (uint8_t*)beg));
     return AcquireStatus_Ok;
 Error:
     return AcquireStatus_Error;
@@ -136,14 +372,29 @@ sig_sink_stop_source(const struct video_sink_s* sink)
     // This is a pretty hacky way of signaling a video stream to stop at
     // the source.
     struct video_s* self = containerof(sink, struct video_s, sink);
-    self->source.is_stopping = 1;
+    store_release(&self->source.is_stopping, 1);
+}
+
+static void
+sig_fanout_stop_source(const struct video_fanout_s* fanout)
+{
+    struct video_s* self = containerof(fanout, struct video_s, fanout);
+    store_release(&self->source.is_stopping, 1);
+}
+
+static void
+sig_tee_stop_source(const struct video_tee_s* tee)
+{
+    struct video_s* self = containerof(tee, struct video_s, tee);
+    store_release(&self->source.is_stopping, 1);
 }
 
 static void
 await_filter_reset(const struct video_source_s* source)
 {
     struct video_s* self = containerof(source, struct video_s, source);
-    self->filter.sig_accumulator_reset = 1;
+    store_release(&self->filter.sig_accumulator_reset, 1);
+    channel_wake_readers(&self->filter.in);
     event_wait(&self->filter.accumulator_reset_event);
 }
 
@@ -153,7 +404,8 @@ sig_source_stop_filter(const struct video_source_s* source)
     // This is a pretty hacky way of signaling a video stream to stop
     // the filter thread.
     struct video_s* self = containerof(source, struct video_s, source);
-    self->filter.is_stopping = 1;
+    store_release(&self->filter.is_stopping, 1);
+    channel_wake_readers(&self->filter.in);
 }
 
 static void
@@ -162,7 +414,13 @@ sig_source_stop_sink(const struct video_source_s* source)
     // This is a pretty hacky way of signaling a video stream to stop
     // the sink thread.
     struct video_s* self = containerof(source, struct video_s, source);
-    self->sink.is_stopping = 1;
+    // The filter is told to stop first. Its last frames are still on their
+    // way to the sink, which only drains what has arrived when it stops.
+    parked_thread_wait(&self->filter.thread);
+    store_release(&self->sink.is_stopping, 1);
+    store_release(&self->fanout.is_stopping, 1);
+    video_tee_sig_stop(&self->tee);
+    channel_wake_readers(&self->sink.in);
 }
 
 static int
@@ -171,8 +429,62 @@ reserve_image_shape(struct video_s* video)
     struct ImageShape image_shape = { 0 };
     CHECK(Device_Ok ==
           camera_get_image_shape(video->source.camera, &image_shape));
+    video->filter.bytes_of_image = bytes_of_image(&image_shape);
+    CHECK(
+      video_filter_output_shape(&video->filter, &image_shape, &image_shape));
     CHECK(Device_Ok ==
           storage_reserve_image_shape(video->sink.storage, &image_shape));
+    // Compressed frames come in all sizes.
+    video->sink.bytes_of_image = video_filter_is_compressing(&video->filter)
+                                   ? 0
+                                   : bytes_of_image(&image_shape);
+    CHECK(video_fanout_reserve_image_shape(
+      &video->fanout, &image_shape, video->sink.channel_capacity_bytes));
+    CHECK(video_tee_reserve_image_shape(&video->tee, &image_shape));
+    return 1;
+Error:
+    return 0;
+}
+
+/// A frame that doesn't fit in a channel would stall the source forever, so
+/// reject the configuration instead.
+static int
+check_channel_capacity(struct video_s* video)
+{
+    struct ImageShape shape = { 0 };
+    CHECK(Device_Ok == camera_get_image_shape(video->source.camera, &shape));
+    CHECK(video_filter_output_shape(&video->filter, &shape, &shape));
+    const size_t bytes_of_frame =
+      channel_bytes_of_frame(&video->sink.in, bytes_of_image(&shape));
+
+    EXPECT(bytes_of_frame < video->sink.channel_capacity_bytes,
+           "[stream %d] A %llu byte channel can't hold a %llu byte frame.",
+           video->stream_id,
+           (unsigned long long)video->sink.channel_capacity_bytes,
+           (unsigned long long)bytes_of_frame);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Devices that don't know about compressed frames would store them as if
+/// they were pixels.
+static int
+check_compressed_frames(struct video_s* video)
+{
+    EXPECT(!video_filter_is_compressing(&video->filter) ||
+             video->sink.meta.compressed_frames_are_supported,
+           "[stream %d] The storage device can't take compressed frames.",
+           video->stream_id);
+    EXPECT(!video_filter_is_compressing(&video->filter) ||
+             video_tee_takes_compressed_frames(&video->tee),
+           "[stream %d] A storage device in `tee_outputs` can't take "
+           "compressed frames.",
+           video->stream_id);
+    EXPECT(!video_filter_is_compressing(&video->filter) ||
+             !video_fanout_is_enabled(&video->fanout),
+           "[stream %d] Regions can't be cropped from compressed frames.",
+           video->stream_id);
     return 1;
 Error:
     return 0;
@@ -196,19 +508,25 @@ acquire_init(void (*reporter)(int is_error,
            sizeof(struct runtime));
     memset(self, 0, sizeof(*self)); // NOLINT
     CHECK(device_manager_init(&self->device_manager, reporter) == Device_Ok);
+    io_scheduler_init(&self->io_scheduler);
 
     for (uint8_t i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
         memset(video, 0, sizeof(*video)); // NOLINT
         video->stream_id = (uint8_t)i;
-
-        EXPECT(
-          video_sink_init(&video->sink, i, 1ULL << 30, sig_sink_stop_source) ==
-            Device_Ok,
-          "[stream %d] Failed to initialize video sink controller",
-          i);
-        EXPECT(video_filter_init(
-                 &video->filter, i, 1ULL << 30, &video->sink.in) == Device_Ok,
+        video->numa_node = -1;
+        lock_init(&video->readers_lock);
+
+        EXPECT(video_sink_init(&video->sink,
+                               i,
+                               DEFAULT_CHANNEL_CAPACITY_BYTES,
+                               sig_sink_stop_source) == Device_Ok,
+               "[stream %d] Failed to initialize video sink controller",
+               i);
+        EXPECT(video_filter_init(&video->filter,
+                                 i,
+                                 DEFAULT_CHANNEL_CAPACITY_BYTES,
+                                 &video->sink.in) == Device_Ok,
                "[stream %d] Failed to initialize video filter controller",
                i);
         EXPECT(video_source_init(&video->source,
@@ -221,8 +539,38 @@ acquire_init(void (*reporter)(int is_error,
                                  sig_source_stop_sink) == Device_Ok,
                "[stream %d] Failed to initialize video source controller",
                i);
+        EXPECT(video_fanout_init(&video->fanout,
+                                 i,
+                                 &video->sink.in,
+                                 sig_fanout_stop_source) == Device_Ok,
+               "[stream %d] Failed to initialize fan-out controller",
+               i);
+        EXPECT(video_tee_init(&video->tee,
+                              i,
+                              &video->sink.in,
+                              sig_tee_stop_source) == Device_Ok,
+               "[stream %d] Failed to initialize tee controller",
+               i);
+        EXPECT(video_stage_init(&video->stage, i) == Device_Ok,
+               "[stream %d] Failed to initialize stage axis controller",
+               i);
+        video->source.stage = &video->stage;
+        EXPECT(video_waveform_init(&video->waveform, i) == Device_Ok,
+               "[stream %d] Failed to initialize waveform controller",
+               i);
+        video_annotations_init(&video->annotations, i);
+        video->sink.annotations = &video->annotations;
+        EXPECT(video_intensity_init(&video->intensity, i, &video->sink.in) ==
+                 Device_Ok,
+               "[stream %d] Failed to initialize intensity controller",
+               i);
+        EXPECT(video_preview_init(&video->preview, i, &video->sink.in) ==
+                 Device_Ok,
+               "[stream %d] Failed to initialize preview controller",
+               i);
     }
 
+    thread_init(&self->log_thread);
     self->state = DeviceState_AwaitingConfiguration;
     return &self->handle;
 Error:
@@ -239,21 +587,129 @@ acquire_shutdown(struct AcquireRuntime* self_)
     self = containerof(self_, struct runtime, handle);
     for (size_t i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
+        while (video->readers) {
+            struct AcquireMonitorReader* const next = video->readers->next;
+            free(video->readers);
+            video->readers = next;
+        }
         video_source_destroy((&video->source));
         video_filter_destroy(&video->filter);
+        video_intensity_destroy(&video->intensity);
+        video_preview_destroy(&video->preview);
         video_sink_destroy(&video->sink);
+        video_fanout_destroy(&video->fanout);
+        video_tee_destroy(&video->tee);
+        video_stage_destroy(&video->stage);
+        video_waveform_destroy(&video->waveform);
+        video_annotations_destroy(&video->annotations);
     }
     device_manager_destroy(&self->device_manager);
+    acquire_set_async_logging(self_, 0);
+    free(self->trace_path);
     free(self);
     return AcquireStatus_Ok;
 Error:
     return AcquireStatus_Error;
 }
 
+/// Copies the client's settings for a stream thread, keeping its name. A
+/// thread without an affinity mask of its own runs on `node_mask`'s CPUs.
+static int
+set_thread_attributes(struct thread_attributes* attributes,
+                      uint64_t* affinity_mask,
+                      const struct AcquireThreadProperties* props,
+                      uint64_t node_mask)
+{
+    EXPECT(props->priority <= ThreadPriority_Realtime,
+           "Invalid thread priority: %d",
+           (int)props->priority);
+    *affinity_mask = props->affinity_mask;
+    attributes->affinity_mask =
+      props->affinity_mask ? props->affinity_mask : node_mask;
+    attributes->priority = (enum ThreadPriority)props->priority;
+    return 1;
+Error:
+    return 0;
+}
+
+static void
+get_thread_attributes(struct AcquireThreadProperties* props,
+                      uint64_t affinity_mask,
+                      const struct thread_attributes* attributes)
+{
+    props->affinity_mask = affinity_mask;
+    props->priority = (uint8_t)attributes->priority;
+}
+
+/// Places the stream's queues on the NUMA node the client asked for.
+/// @returns The CPUs of that node, for the stream's threads, or 0.
+static uint64_t
+set_numa_node(struct video_s* video, const struct aq_properties_video_s* props)
+{
+    video->numa_node = -1;
+    if (props->use_numa_node) {
+        if (props->numa_node < numa_node_count())
+            video->numa_node = props->numa_node;
+        else
+            LOGE("[stream %d]: There is no NUMA node %d. Leaving placement "
+                 "to the system.",
+                 (int)video->stream_id,
+                 (int)props->numa_node);
+    }
+    channel_set_numa_node(&video->sink.in, video->numa_node);
+    channel_set_numa_node(&video->filter.in, video->numa_node);
+    return video->numa_node < 0
+             ? 0
+             : numa_node_affinity_mask((uint32_t)video->numa_node);
+}
+
+static void
+filter_stage_params_from_client(struct filter_stage_params* params,
+                                const struct AcquireFilterStage* stage)
+{
+    *params = (struct filter_stage_params){
+        .kind = (enum FilterStageKind)stage->kind,
+        .frame_count = stage->frame_count,
+        .average_mode = (enum FilterAverageMode)stage->average_mode,
+        .average_output = (enum FilterAverageOutput)stage->average_output,
+        .projection = (enum FilterProjection)stage->projection,
+        .alpha = stage->alpha,
+        .roi = { .x = stage->roi.x,
+                 .y = stage->roi.y,
+                 .width = stage->roi.width,
+                 .height = stage->roi.height },
+        .binning = stage->binning,
+        .sample_type = stage->sample_type,
+        .compression = (enum FrameCompression)stage->compression,
+    };
+}
+
+static void
+filter_stage_params_to_client(struct AcquireFilterStage* stage,
+                              const struct filter_stage_params* params)
+{
+    *stage = (struct AcquireFilterStage){
+        .kind = (uint8_t)params->kind,
+        .frame_count = params->frame_count,
+        .average_mode = (uint8_t)params->average_mode,
+        .average_output = (uint8_t)params->average_output,
+        .projection = (uint8_t)params->projection,
+        .alpha = params->alpha,
+        .roi = { .x = params->roi.x,
+                 .y = params->roi.y,
+                 .width = params->roi.width,
+                 .height = params->roi.height },
+        .binning = params->binning,
+        .sample_type = params->sample_type,
+        .compression = (uint8_t)params->compression,
+    };
+}
+
 static enum AcquireStatusCode
 configure_video_stream(struct video_s* const video,
                        enum DeviceState state,
                        const struct DeviceManager* const device_manager,
+                       struct io_scheduler* const io_scheduler,
                        struct aq_properties_video_s* const pvideo
 
 )
@@ -268,27 +724,136 @@ configure_video_stream(struct video_s* const video,
                     device_manager, DeviceKind_Camera, &pcamera->identifier));
     }
 
-    is_ok &=
-      (video_source_configure(&video->source,
-                              device_manager,
-                              &pcamera->identifier,
-                              &pcamera->settings,
-                              pvideo->max_frame_count,
-                              pvideo->frame_average_count > 1) == Device_Ok);
-    is_ok &= (video_filter_configure(&video->filter,
-                                     pvideo->frame_average_count) == Device_Ok);
+    if (!pvideo->channel_capacity_bytes)
+        pvideo->channel_capacity_bytes = DEFAULT_CHANNEL_CAPACITY_BYTES;
+    {
+        struct filter_stage_params stages[ACQUIRE_MAX_FILTER_STAGES] = { 0 };
+        uint32_t nstages = 0;
+        while (nstages < countof(pvideo->filters) &&
+               pvideo->filters[nstages].kind != AcquireFilter_None) {
+            filter_stage_params_from_client(stages + nstages,
+                                            pvideo->filters + nstages);
+            ++nstages;
+        }
+        is_ok &= (video_filter_configure(&video->filter,
+                                         pvideo->frame_average_count,
+                                         stages,
+                                         nstages,
+                                         pvideo->frame_average_thread_count,
+                                         pvideo->channel_capacity_bytes) ==
+                  Device_Ok);
+    }
+    is_ok &= (video_source_configure(&video->source,
+                                     device_manager,
+                                     &pcamera->identifier,
+                                     &pcamera->settings,
+                                     pvideo->max_frame_count,
+                                     (uint8_t)video_filter_is_enabled(
+                                       &video->filter)) == Device_Ok);
 
     if (pstorage->identifier.kind == DeviceKind_None) {
         is_ok &= (Device_Ok ==
                   device_manager_select_default(
                     device_manager, DeviceKind_Storage, &pstorage->identifier));
     }
+    const struct video_sink_coalescing coalescing = {
+        .min_bytes = (size_t)pstorage->coalesce_bytes,
+        .max_age_ms = pstorage->coalesce_max_age_ms,
+    };
     is_ok &= (video_sink_configure(&video->sink,
                                    device_manager,
                                    &pstorage->identifier,
                                    &pstorage->settings,
-                                   pstorage->write_delay_ms) == Device_Ok);
+                                   pstorage->write_delay_ms,
+                                   pstorage->writer_count,
+                                   &coalescing,
+                                   pvideo->channel_capacity_bytes) ==
+              Device_Ok);
+    if (pstorage->io_share < 0.0f || pstorage->io_share > 1.0f) {
+        LOGE("[stream %d] `io_share` is a fraction of the bandwidth. Got %f.",
+             video->stream_id,
+             pstorage->io_share);
+        is_ok = 0;
+    }
+    video->sink.io.scheduler = pstorage->io_is_scheduled ? io_scheduler : 0;
+    video->sink.io.priority = pstorage->io_priority;
+    video->sink.io.share = pstorage->io_share;
+    for (uint32_t i = 0; i < countof(pvideo->roi_outputs); ++i) {
+        struct aq_properties_roi_output_s* const out = pvideo->roi_outputs + i;
+        const struct filter_stage_params roi = {
+            .kind = FilterStage_Crop,
+            .roi = { .x = out->roi.x,
+                     .y = out->roi.y,
+                     .width = out->roi.width,
+                     .height = out->roi.height },
+        };
+        is_ok &= (video_fanout_configure(&video->fanout,
+                                         i,
+                                         device_manager,
+                                         &roi,
+                                         &out->identifier,
+                                         &out->settings) == Device_Ok);
+    }
+    for (uint32_t i = 0; i < countof(pvideo->tee_outputs); ++i) {
+        struct aq_properties_tee_output_s* const out = pvideo->tee_outputs + i;
+        is_ok &= (video_tee_configure(&video->tee,
+                                      i,
+                                      device_manager,
+                                      &out->identifier,
+                                      &out->settings) == Device_Ok);
+    }
+    {
+        // Every device appends frames straight from the queue.
+        const size_t tee_alignment_bytes =
+          video_tee_frame_alignment_bytes(&video->tee);
+        const size_t alignment_bytes =
+          video->sink.meta.io_alignment_bytes > tee_alignment_bytes
+            ? video->sink.meta.io_alignment_bytes
+            : tee_alignment_bytes;
+        channel_set_frame_alignment(&video->sink.in, alignment_bytes);
+    }
+    is_ok &= (video_stage_configure(&video->stage,
+                                    device_manager,
+                                    &pvideo->stage_axis.identifier,
+                                    &pvideo->stage_axis.settings) ==
+              Device_Ok);
+    is_ok &= (video_waveform_configure(&video->waveform,
+                                       device_manager,
+                                       &pvideo->signals.identifier,
+                                       &pvideo->signals.settings,
+                                       pvideo->signals.samples_per_block) ==
+              Device_Ok);
     is_ok &= reserve_image_shape(video);
+    is_ok &= check_channel_capacity(video);
+    is_ok &= check_compressed_frames(video);
+    channel_reader_set_lossy(
+      &video->sink.in, &video->monitor.reader, pvideo->monitor_is_lossy);
+    video->monitor.decimation = (struct video_monitor_decimation){
+        .every_nth_frame = pvideo->monitor_every_nth_frame,
+        .min_interval_ms = pvideo->monitor_min_interval_ms,
+    };
+    pvideo->monitor_shared_name[sizeof(pvideo->monitor_shared_name) - 1] = 0;
+    is_ok &= channel_share(&video->sink.in, pvideo->monitor_shared_name);
+    video->source.enable_checksums = pvideo->enable_frame_checksums != 0;
+    video->intensity.is_enabled = pvideo->enable_intensity_stats != 0;
+    is_ok &= (video_preview_configure(&video->preview,
+                                      pvideo->preview_binning,
+                                      video->sink.channel_capacity_bytes) ==
+              Device_Ok);
+    video->preview.monitor.decimation = video->monitor.decimation;
+    const uint64_t node_mask = set_numa_node(video, pvideo);
+    is_ok &= set_thread_attributes(&video->source.thread_attributes,
+                                   video->affinity_masks + 0,
+                                   &pvideo->threads.source,
+                                   node_mask);
+    is_ok &= set_thread_attributes(&video->filter.thread_attributes,
+                                   video->affinity_masks + 1,
+                                   &pvideo->threads.filter,
+                                   node_mask);
+    is_ok &= set_thread_attributes(&video->sink.thread_attributes,
+                                   video->affinity_masks + 2,
+                                   &pvideo->threads.sink,
+                                   node_mask);
 
     EXPECT(is_ok, "Failed to configure video stream.");
 
@@ -297,7 +862,7 @@ Error:
     return AcquireStatus_Error;
 }
 
-/// Up to two video streams may be optionally configured.
+/// Up to `ACQUIRE_MAX_VIDEO_STREAMS` video streams may be configured.
 ///
 /// Performs a cursory check to detect a disabled stream in order to avoid
 /// deeper checks. This reduces log chatter.
@@ -311,6 +876,91 @@ video_stream_requirements_check(struct aq_properties_video_s* video_settings)
     return 1;
 }
 
+/// Bytes per second the stream's camera is set to deliver, judging by the
+/// frame shape and exposure time.
+static double
+stream_bytes_per_second(const struct aq_properties_video_s* pvideo)
+{
+    const struct CameraProperties* const camera = &pvideo->camera.settings;
+    const double bytes_of_frame = (double)camera->shape.x *
+                                  (double)camera->shape.y *
+                                  (double)bytes_of_type(camera->pixel_type);
+    const double exposure_s = (camera->exposure_time_us > 1.0f
+                                 ? (double)camera->exposure_time_us
+                                 : 1.0) *
+                              1e-6;
+    return (bytes_of_frame > 0.0 ? bytes_of_frame : 1.0) / exposure_s;
+}
+
+/// Queues of the stream sized by `channel_capacity_bytes`: the one to
+/// storage, and the one to the filter when it averages or filters frames.
+static uint32_t
+stream_channel_count(const struct aq_properties_video_s* pvideo)
+{
+    return 1 + (pvideo->frame_average_count > 1 ||
+                pvideo->filters[0].kind != AcquireFilter_None);
+}
+
+/// Sets `channel_capacity_bytes` for the streams the memory budget sizes.
+/// See `AcquireProperties::memory_budget_bytes`.
+static void
+apply_memory_budget(struct runtime* self, struct AcquireProperties* settings)
+{
+    self->memory_budget_bytes = settings->memory_budget_bytes;
+    self->memory_budget_fraction = settings->memory_budget_fraction;
+    uint64_t budget = settings->memory_budget_bytes;
+    if (!budget && settings->memory_budget_fraction > 0.0f)
+        budget = (uint64_t)((double)settings->memory_budget_fraction *
+                            (double)memory_physical_bytes());
+    const uint32_t was_budgeted = self->budgeted_video_streams;
+    self->budgeted_video_streams = 0;
+    if (!budget)
+        return;
+
+    double total_bytes_per_second = 0.0;
+    uint64_t reserved = 0;
+    for (uint32_t i = 0; i < countof(self->video); ++i) {
+        struct aq_properties_video_s* const pvideo = settings->video + i;
+        if (!video_stream_requirements_check(pvideo))
+            continue;
+        // A share reported by acquire_get_configuration() and configured
+        // again unchanged is the budget's to size again.
+        const int is_budgeted =
+          !pvideo->channel_capacity_bytes ||
+          (((was_budgeted >> i) & 1) &&
+           pvideo->channel_capacity_bytes ==
+             self->video[i].sink.channel_capacity_bytes);
+        if (is_budgeted) {
+            self->budgeted_video_streams |= 1u << i;
+            total_bytes_per_second += stream_bytes_per_second(pvideo);
+        } else {
+            reserved +=
+              pvideo->channel_capacity_bytes * stream_channel_count(pvideo);
+        }
+    }
+    const uint64_t remaining = budget > reserved ? budget - reserved : 0;
+    for (uint32_t i = 0; i < countof(self->video); ++i) {
+        if (((self->budgeted_video_streams >> i) & 1) == 0)
+            continue;
+        struct aq_properties_video_s* const pvideo = settings->video + i;
+        const double bytes_per_second = stream_bytes_per_second(pvideo);
+        const uint64_t share = (uint64_t)((double)remaining *
+                                          bytes_per_second /
+                                          total_bytes_per_second);
+        const uint64_t capacity = share / stream_channel_count(pvideo);
+        // Too small a share fails the stream's configuration, which says
+        // how much it needs.
+        pvideo->channel_capacity_bytes = capacity ? capacity : 1;
+        LOG("[stream %d] Memory budget: %llu of %llu bytes for %.1f MB/s, "
+            "%llu bytes per queue.",
+            (int)i,
+            (unsigned long long)share,
+            (unsigned long long)budget,
+            1e-6 * bytes_per_second,
+            (unsigned long long)pvideo->channel_capacity_bytes);
+    }
+}
+
 enum AcquireStatusCode
 acquire_configure(struct AcquireRuntime* self_,
                   struct AcquireProperties* settings)
@@ -321,6 +971,11 @@ acquire_configure(struct AcquireRuntime* self_,
            "Invalid parameter. Expected AcquireProperties* but got NULL.");
     self = containerof(self_, struct runtime, handle);
     EXPECT(self->state != DeviceState_Closed, "Device state is Closed.");
+    if (self->is_stop_pending)
+        finish_stop(self);
+    apply_memory_budget(self, settings);
+    io_scheduler_set_bandwidth(&self->io_scheduler,
+                               settings->io_bandwidth_bytes_per_second);
     self->valid_video_streams = 0;
     for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
         if (video_stream_requirements_check(settings->video + istream)) {
@@ -329,8 +984,9 @@ acquire_configure(struct AcquireRuntime* self_,
                 configure_video_stream(video,
                                        self->state,
                                        &self->device_manager,
+                                       &self->io_scheduler,
                                        settings->video + istream)) {
-                self->valid_video_streams |= (1 << istream);
+                self->valid_video_streams |= (1u << istream);
                 TRACE("Configured video stream %d.", istream);
             } else {
                 TRACE("Failed to configure video stream %d.", istream);
@@ -371,23 +1027,264 @@ acquire_get_configuration(const struct AcquireRuntime* self_,
         struct aq_properties_storage_s* const pstorage = &pvideo->storage;
 
         pvideo->frame_average_count = video->filter.filter_window_frames;
+        pvideo->frame_average_thread_count = video->filter.thread_count;
+        memset(pvideo->filters, 0, sizeof(pvideo->filters)); // NOLINT
+        for (uint32_t i = 0; i < video->filter.nrequested; ++i)
+            filter_stage_params_to_client(pvideo->filters + i,
+                                          video->filter.requested + i);
+        pvideo->channel_capacity_bytes = video->sink.channel_capacity_bytes;
+        pvideo->monitor_is_lossy = (uint8_t)video->monitor.reader.is_lossy;
+        pvideo->monitor_every_nth_frame =
+          video->monitor.decimation.every_nth_frame;
+        pvideo->monitor_min_interval_ms =
+          video->monitor.decimation.min_interval_ms;
+        memcpy(pvideo->monitor_shared_name, // NOLINT
+               video->sink.in.shared.name,
+               sizeof(pvideo->monitor_shared_name));
+        pvideo->enable_frame_checksums = video->source.enable_checksums;
+        pvideo->enable_intensity_stats = video->intensity.is_enabled;
+        pvideo->preview_binning = video->preview.binning;
+        get_thread_attributes(&pvideo->threads.source,
+                              video->affinity_masks[0],
+                              &video->source.thread_attributes);
+        get_thread_attributes(&pvideo->threads.filter,
+                              video->affinity_masks[1],
+                              &video->filter.thread_attributes);
+        get_thread_attributes(&pvideo->threads.sink,
+                              video->affinity_masks[2],
+                              &video->sink.thread_attributes);
+        pvideo->use_numa_node = video->numa_node >= 0;
+        pvideo->numa_node =
+          video->numa_node >= 0 ? (uint8_t)video->numa_node : 0;
 
         is_ok &= (video_source_get(&video->source,
                                    &pcamera->identifier,
                                    &pcamera->settings,
                                    &pvideo->max_frame_count) == Device_Ok);
 
+        struct video_sink_coalescing coalescing = { 0 };
         is_ok &= (video_sink_get(&video->sink,
                                  &pstorage->identifier,
                                  &pstorage->settings,
-                                 &pstorage->write_delay_ms) == Device_Ok);
+                                 &pstorage->write_delay_ms,
+                                 &pstorage->writer_count,
+                                 &coalescing) == Device_Ok);
+        pstorage->coalesce_bytes = coalescing.min_bytes;
+        pstorage->coalesce_max_age_ms = coalescing.max_age_ms;
+        pstorage->io_is_scheduled = video->sink.io.scheduler != 0;
+        pstorage->io_priority = video->sink.io.priority;
+        pstorage->io_share = video->sink.io.share;
+
+        for (uint32_t i = 0; i < countof(pvideo->roi_outputs); ++i) {
+            const struct video_fanout_output* const output =
+              video->fanout.outputs + i;
+            struct aq_properties_roi_output_s* const out =
+              pvideo->roi_outputs + i;
+            if (!output->is_enabled) {
+                out->roi.width = out->roi.height = 0;
+                out->identifier.kind = DeviceKind_None;
+                continue;
+            }
+            out->roi.x = output->crop.params.roi.x;
+            out->roi.y = output->crop.params.roi.y;
+            out->roi.width = output->crop.params.roi.width;
+            out->roi.height = output->crop.params.roi.height;
+            out->identifier = output->sink.identifier;
+            is_ok &= (storage_get(output->sink.storage, &out->settings) ==
+                      Device_Ok);
+        }
+        for (uint32_t i = 0; i < countof(pvideo->tee_outputs); ++i) {
+            const struct video_tee_output* const output =
+              video->tee.outputs + i;
+            struct aq_properties_tee_output_s* const out =
+              pvideo->tee_outputs + i;
+            if (!output->is_enabled) {
+                out->identifier.kind = DeviceKind_None;
+                continue;
+            }
+            out->identifier = output->sink.identifier;
+            is_ok &= (storage_get(output->sink.storage, &out->settings) ==
+                      Device_Ok);
+        }
+
+        is_ok &= (video_stage_get(&video->stage,
+                                  &pvideo->stage_axis.identifier,
+                                  &pvideo->stage_axis.settings) == Device_Ok);
+        is_ok &= (video_waveform_get(&video->waveform,
+                                     &pvideo->signals.identifier,
+                                     &pvideo->signals.settings,
+                                     &pvideo->signals.samples_per_block) ==
+                  Device_Ok);
     }
+    settings->memory_budget_bytes = self->memory_budget_bytes;
+    settings->memory_budget_fraction = self->memory_budget_fraction;
+    settings->io_bandwidth_bytes_per_second =
+      self->io_scheduler.bytes_per_second;
+
+    return is_ok ? AcquireStatus_Ok : AcquireStatus_Error;
+Error:
+    return AcquireStatus_Error;
+}
+
+/// Hands the `settings` of a running stream's camera to its source thread.
+static int
+update_video_stream(struct video_s* video, struct CameraProperties* settings)
+{
+    const struct CameraProperties* const applied =
+      &video->source.applied_settings;
+    const int is_reshaping = settings->offset.x != applied->offset.x ||
+                             settings->offset.y != applied->offset.y ||
+                             settings->shape.x != applied->shape.x ||
+                             settings->shape.y != applied->shape.y;
+    // Flat fields and regions are laid out for frames of the configured
+    // shape.
+    EXPECT(!is_reshaping || (!video_filter_is_enabled(&video->filter) &&
+                             !video_fanout_is_enabled(&video->fanout)),
+           "[stream %d] The region can't change while frames are filtered "
+           "or cropped into regions.",
+           video->stream_id);
+    CHECK(video_source_update(&video->source,
+                              settings,
+                              video->filter.bytes_of_image) == Device_Ok);
+    return 1;
+Error:
+    return 0;
+}
 
+enum AcquireStatusCode
+acquire_update_properties(struct AcquireRuntime* self_,
+                          struct AcquireProperties* settings)
+{
+    struct runtime* self = 0;
+    int is_ok = 1;
+    CHECK(self_);
+    CHECK(settings);
+    self = containerof(self_, struct runtime, handle);
+    EXPECT(self->state == DeviceState_Running,
+           "Properties can only be updated while running.");
+    for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
+        if (self->valid_video_streams & (1u << istream))
+            is_ok &= update_video_stream(
+              self->video + istream, &settings->video[istream].camera.settings);
+    }
     return is_ok ? AcquireStatus_Ok : AcquireStatus_Error;
 Error:
     return AcquireStatus_Error;
 }
 
+enum AcquireStatusCode
+acquire_set_flat_field(struct AcquireRuntime* self_,
+                       uint32_t istream,
+                       uint32_t channels,
+                       uint32_t width,
+                       uint32_t height,
+                       const float* dark,
+                       const float* gain)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    EXPECT(self->state != DeviceState_Running,
+           "Can't set the flat field while running.");
+    CHECK(video_filter_set_flat_field(&self->video[istream].filter,
+                                      channels,
+                                      width,
+                                      height,
+                                      dark,
+                                      gain) == Device_Ok);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_write_waveform(struct AcquireRuntime* self_,
+                       uint32_t istream,
+                       const void* data,
+                       size_t nbytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(data || !nbytes);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    CHECK(video_waveform_write(&self->video[istream].waveform,
+                               (const uint8_t*)data,
+                               nbytes) == Device_Ok);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_annotate_frame(struct AcquireRuntime* self_,
+                       uint32_t istream,
+                       enum FrameAnnotationJoin join,
+                       uint64_t key,
+                       uint32_t tag,
+                       const void* data,
+                       size_t nbytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    CHECK(video_annotations_push(&self->video[istream].annotations,
+                                 join,
+                                 key,
+                                 tag,
+                                 data,
+                                 nbytes) == Device_Ok);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unpack_frame(const struct VideoFrame* frame,
+                     uint16_t* dst,
+                     size_t nsamples)
+{
+    CHECK(frame);
+    CHECK(dst);
+    EXPECT(nsamples >= (size_t)frame->shape.strides.planes,
+           "Unpacking frame %llu takes room for %llu samples. Got %llu.",
+           (unsigned long long)frame->frame_id,
+           (unsigned long long)frame->shape.strides.planes,
+           (unsigned long long)nsamples);
+    EXPECT(frame->compression == FrameCompression_None,
+           "Frame %llu is compressed. Decompress it first.",
+           (unsigned long long)frame->frame_id);
+    EXPECT(video_filter_unpack_frame(frame, dst),
+           "Frame %llu holds %s samples, which aren't packed.",
+           (unsigned long long)frame->frame_id,
+           sample_type_as_string(frame->shape.type));
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_decompress_frame(const struct VideoFrame* frame,
+                         void* dst,
+                         size_t nbytes)
+{
+    CHECK(frame);
+    CHECK(dst);
+    EXPECT(nbytes >= bytes_of_image(&frame->shape),
+           "Decompressing frame %llu takes %llu bytes. Got %llu.",
+           (unsigned long long)frame->frame_id,
+           (unsigned long long)bytes_of_image(&frame->shape),
+           (unsigned long long)nbytes);
+    EXPECT(frame_decompress(frame, (uint8_t*)dst, nbytes),
+           "Frame %llu holds corrupt compressed data.",
+           (unsigned long long)frame->frame_id);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 enum AcquireStatusCode
 acquire_get_configuration_metadata(const struct AcquireRuntime* self_,
                                    struct AcquirePropertyMetadata* metadata)
@@ -397,18 +1294,27 @@ acquire_get_configuration_metadata(const struct AcquireRuntime* self_,
     CHECK(metadata);
     self = containerof(self_, struct runtime, handle);
     for (int i = 0; i < countof(metadata->video); ++i) {
-        if (self->video[i].source.camera)
-            camera_get_meta(self->video[i].source.camera,
-                            &metadata->video[i].camera);
-        if (self->video[i].sink.storage)
-            storage_get_meta(self->video[i].sink.storage,
-                             &metadata->video[i].storage);
+        // Both are cached, since asking a camera can be a slow round trip
+        // through its SDK.
+        video_source_get_meta(&self->video[i].source,
+                              &metadata->video[i].camera);
+        video_sink_get_meta(&self->video[i].sink, &metadata->video[i].storage);
         metadata->video[i].max_frame_count = (struct Property){
             .writable = 1,
             .low = 0.0f,
             .high = -1.0f, // NOTE: (nclack) Not sure what's right here.
             .type = PropertyType_FixedPrecision
         };
+        metadata->video[i].channel_capacity_bytes =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FixedPrecision };
+        metadata->video[i].monitor_is_lossy =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = 1.0f,
+                             .type = PropertyType_FixedPrecision };
         metadata->video[i].frame_average_count =
           (struct Property){ .writable = 1,
                              .low = 0.0f,
@@ -416,7 +1322,34 @@ acquire_get_configuration_metadata(const struct AcquireRuntime* self_,
                                -1.0f, // TODO: (nclack) Compute this. Depends on
                                       // the queue and frame size
                              .type = PropertyType_FixedPrecision };
+        metadata->video[i].frame_average_thread_count =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = (float)BAND_POOL_MAX_THREADS,
+                             .type = PropertyType_FixedPrecision };
+        metadata->video[i].storage_writer_count =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = (float)BAND_POOL_MAX_THREADS,
+                             .type = PropertyType_FixedPrecision };
+        metadata->video[i].numa_node =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = (float)(numa_node_count() - 1),
+                             .type = PropertyType_FixedPrecision };
     }
+    const uint64_t physical_bytes = memory_physical_bytes();
+    metadata->memory_budget_bytes = (struct Property){
+        .writable = 1,
+        .low = 0.0f,
+        .high = physical_bytes ? (float)physical_bytes : -1.0f,
+        .type = PropertyType_FixedPrecision,
+    };
+    metadata->memory_budget_fraction =
+      (struct Property){ .writable = 1,
+                         .low = 0.0f,
+                         .high = 1.0f,
+                         .type = PropertyType_FloatingPrecision };
 
     return AcquireStatus_Ok;
 Error:
@@ -437,6 +1370,453 @@ Error:
     return 0;
 }
 
+uint64_t
+acquire_get_monitor_skipped_frames(const struct AcquireRuntime* self_,
+                                   uint32_t istream)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    return self->video[istream].monitor.reader.skipped;
+Error:
+    return 0;
+}
+
+enum AcquireStatusCode
+acquire_open_monitor_reader(struct AcquireRuntime* self_,
+                            uint32_t istream,
+                            const struct AcquireMonitorReaderProperties* props,
+                            struct AcquireMonitorReader** reader)
+{
+    struct runtime* self = 0;
+    struct AcquireMonitorReader* out = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(reader, "Invalid parameter: `reader` was NULL.");
+    self = containerof(self_, struct runtime, handle);
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           istream);
+    const struct AcquireMonitorReaderProperties defaults = { 0 };
+    if (!props)
+        props = &defaults;
+
+    EXPECT(out = (struct AcquireMonitorReader*)malloc(sizeof(*out)),
+           "Failed to allocate a monitor reader.");
+    memset(out, 0, sizeof(*out)); // NOLINT
+    struct video_s* const video = self->video + istream;
+    out->video = video;
+    out->channel = props->is_preview ? &video->preview.out : &video->sink.in;
+    out->monitor.decimation = (struct video_monitor_decimation){
+        .every_nth_frame = props->every_nth_frame,
+        .min_interval_ms = props->min_interval_ms,
+    };
+    channel_reader_set_lossy(
+      out->channel, &out->monitor.reader, props->is_lossy);
+
+    lock_acquire(&video->readers_lock);
+    out->next = video->readers;
+    video->readers = out;
+    lock_release(&video->readers_lock);
+
+    *reader = out;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_close_monitor_reader(struct AcquireRuntime* self_,
+                             struct AcquireMonitorReader* reader)
+{
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(reader, "Invalid parameter: `reader` was NULL.");
+    struct runtime* const self = containerof(self_, struct runtime, handle);
+    // `reader` is only dereferenced once it's found among this runtime's
+    // open readers, since it may have been closed and freed already.
+    int found = 0;
+    for (uint32_t i = 0; i < countof(self->video) && !found; ++i) {
+        struct video_s* const video = self->video + i;
+        lock_acquire(&video->readers_lock);
+        for (struct AcquireMonitorReader** cur = &video->readers; *cur;
+             cur = &(*cur)->next) {
+            if (*cur == reader) {
+                *cur = reader->next;
+                found = 1;
+                break;
+            }
+        }
+        lock_release(&video->readers_lock);
+    }
+    EXPECT(found, "Monitor reader is not open.");
+
+    channel_reader_detach(reader->channel, &reader->monitor.reader);
+    free(reader);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_monitor_reader_map(struct AcquireMonitorReader* reader,
+                           uint32_t timeout_ms,
+                           struct VideoFrame** beg,
+                           struct VideoFrame** end)
+{
+    EXPECT(reader, "Invalid parameter: `reader` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    EXPECT(reader->monitor.reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_monitor_reader_unmap().");
+    struct vfslice_mut slice = make_vfslice_mut(video_monitor_map(
+      &reader->monitor, reader->channel, timeout_ms));
+    CHECK(reader->monitor.reader.status == Channel_Ok);
+    *beg = slice.beg;
+    *end = slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_monitor_reader_unmap(struct AcquireMonitorReader* reader,
+                             size_t consumed_bytes)
+{
+    CHECK(reader);
+    video_monitor_unmap(&reader->monitor, reader->channel, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_monitor_reader_unmap_and_hold(struct AcquireMonitorReader* reader,
+                                      size_t consumed_bytes,
+                                      struct AcquireReadHold** hold)
+{
+    CHECK(reader);
+    CHECK(hold);
+    struct AcquireReadHold* out = 0;
+    CHECK(out = hold_read(
+            reader->video, reader->channel, &reader->monitor.reader));
+    video_monitor_unmap(&reader->monitor, reader->channel, consumed_bytes);
+    *hold = out;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+uint64_t
+acquire_monitor_reader_skipped_frames(const struct AcquireMonitorReader* reader)
+{
+    return reader ? reader->monitor.reader.skipped : 0;
+}
+
+/// Calls `fn` on each reader opened on `video`, with the queue it reads.
+static void
+for_each_reader(struct video_s* video,
+                void (*fn)(struct channel*, struct video_monitor_s*))
+{
+    lock_acquire(&video->readers_lock);
+    for (struct AcquireMonitorReader* cur = video->readers; cur;
+         cur = cur->next)
+        fn(cur->channel, &cur->monitor);
+    lock_release(&video->readers_lock);
+}
+
+static void
+restart_reader(struct channel* channel, struct video_monitor_s* monitor)
+{
+    (void)channel;
+    monitor->reader.skipped = 0;
+    monitor->reader.bytes_read = 0;
+    video_monitor_reset(monitor);
+}
+
+static void
+detach_reader(struct channel* channel, struct video_monitor_s* monitor)
+{
+    channel_reader_detach(channel, &monitor->reader);
+    video_monitor_reset(monitor);
+}
+
+static struct AcquireChannelStats
+channel_stats_for_client(const struct channel* channel)
+{
+    struct channel_stats stats = { 0 };
+    channel_get_stats(channel, &stats);
+    return (struct AcquireChannelStats){
+        .capacity_bytes = stats.capacity_bytes,
+        .occupancy_bytes = stats.occupancy_bytes,
+        .high_water_bytes = stats.high_water_bytes,
+        .bytes_written = stats.bytes_written,
+        .wrap_count = stats.wrap_count,
+        .wasted_bytes = stats.wasted_bytes,
+        .writer_blocked_ms = 1e-3 * (double)stats.writer_blocked_us,
+        .writer_blocked_count = stats.writer_blocked_count,
+    };
+}
+
+static struct AcquireLatencyStats
+latency_for_client(const struct latency_histogram* histogram)
+{
+    return (struct AcquireLatencyStats){
+        .count = histogram->count,
+        .p50_ms = 1e-3 * (double)latency_histogram_percentile(histogram, 0.5),
+        .p99_ms = 1e-3 * (double)latency_histogram_percentile(histogram, 0.99),
+        .max_ms = 1e-3 * (double)histogram->max,
+    };
+}
+
+enum AcquireStatusCode
+acquire_get_stream_stats(const struct AcquireRuntime* self_,
+                         uint32_t istream,
+                         struct AcquireStreamStats* stats)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(stats);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    const struct video_s* video = self->video + istream;
+    *stats = (struct AcquireStreamStats){
+        .storage_queue = channel_stats_for_client(&video->sink.in),
+        .storage_bytes_read = video->sink.reader.bytes_read,
+        .monitor_bytes_read = video->monitor.reader.bytes_read,
+        .monitor_skipped_frames = video->monitor.reader.skipped,
+        .dropped_frames = video->source.counters.dropped_frames,
+        .aborted_frames = video->source.counters.aborted_writes,
+        .filter_queue = channel_stats_for_client(&video->filter.in),
+        .annotations_pushed = load_relaxed(&video->annotations.pushed),
+        .annotations_stored = load_relaxed(&video->annotations.stored),
+        .annotations_dropped = load_relaxed(&video->annotations.dropped),
+        .latency = {
+          .camera_to_channel =
+            latency_for_client(&video->source.camera_to_channel_us),
+          .channel_to_filter =
+            latency_for_client(&video->filter.channel_to_filter_us),
+          .channel_to_sink = latency_for_client(&video->sink.channel_to_sink_us),
+          .sink_to_storage =
+            latency_for_client(&video->sink.sink_to_storage_us),
+          .io_scheduler_wait = latency_for_client(&video->sink.io_wait_us),
+          .trigger_to_channel =
+            latency_for_client(&video->source.trigger_to_channel_us),
+        },
+    };
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_get_intensity_stats(const struct AcquireRuntime* self_,
+                            uint32_t istream,
+                            struct AcquireIntensityStats* stats)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(stats);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    struct video_intensity_s* const intensity = &self->video[istream].intensity;
+    EXPECT(intensity->is_enabled,
+           "[stream %d] Intensity statistics are off. See "
+           "`enable_intensity_stats`.",
+           (int)istream);
+
+    struct intensity_stats latest;
+    *stats = (struct AcquireIntensityStats){
+        .frames_measured = video_intensity_get(intensity, &latest),
+    };
+    if (!stats->frames_measured)
+        return AcquireStatus_Ok;
+    stats->frame_id = latest.frame_id;
+    stats->sample_type = latest.sample_type;
+    stats->sample_count = latest.sample_count;
+    stats->min = latest.min;
+    stats->max = latest.max;
+    stats->mean = latest.mean;
+    stats->stddev = latest.stddev;
+    stats->at_floor = latest.at_floor;
+    stats->at_ceiling = latest.at_ceiling;
+    stats->bin_lo = latest.bin_lo;
+    stats->bin_width = latest.bin_width;
+    memcpy(stats->bins, latest.bins, sizeof(stats->bins)); // NOLINT
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_get_clock_correlation(const struct AcquireRuntime* self_,
+                              uint32_t istream,
+                              struct AcquireClockCorrelation* correlation)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(correlation);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    struct clock_sync_model model;
+    EXPECT(clock_sync_get(&self->video[istream].source.clock_sync, &model),
+           "[stream %d] Not enough hardware timestamps to map onto the host "
+           "clock yet.",
+           (int)istream);
+    *correlation = (struct AcquireClockCorrelation){
+        .hardware_origin = model.hardware_origin,
+        .host_origin = model.host_origin,
+        .host_per_hardware = model.host_per_hardware,
+        .residual = model.residual,
+        .sample_count = model.sample_count,
+    };
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+uint64_t
+acquire_hardware_to_host_time(const struct AcquireClockCorrelation* correlation,
+                              uint64_t hardware)
+{
+    if (!correlation)
+        return 0;
+    const struct clock_sync_model model = {
+        .hardware_origin = correlation->hardware_origin,
+        .host_origin = correlation->host_origin,
+        .host_per_hardware = correlation->host_per_hardware,
+    };
+    return clock_sync_to_host(&model, hardware);
+}
+
+static double
+cpu_time_ms(struct parked_thread* thread)
+{
+    uint64_t us = 0;
+    return parked_thread_get_cpu_time_us(thread, &us) ? 1e-3 * (double)us
+                                                      : -1.0;
+}
+
+static void
+stream_metrics(struct video_s* video, struct AcquireStreamMetrics* metrics)
+{
+    const struct video_source_counters* const source = &video->source.counters;
+    const struct video_filter_counters* const filter = &video->filter.counters;
+    const uint64_t started = load_relaxed(&source->started);
+    const uint64_t stopped = load_relaxed(&source->stopped);
+    const uint64_t until = stopped ? stopped : clock_tic(0);
+    const double elapsed_ms =
+      started ? 1e-6 * (double)clock_tics_to_ns((int64_t)(until - started))
+              : 0.0;
+    const double elapsed_s = 1e-3 * elapsed_ms;
+    struct channel_stats storage_queue = { 0 }, filter_queue = { 0 };
+    channel_get_stats(&video->sink.in, &storage_queue);
+    channel_get_stats(&video->filter.in, &filter_queue);
+
+    *metrics = (struct AcquireStreamMetrics){
+        .is_valid = 1,
+        .elapsed_ms = elapsed_ms,
+        .frames_in = load_relaxed(&source->frames_written),
+        .frames_out = load_relaxed(&video->sink.frames_appended),
+        .bytes_out = load_relaxed(&video->sink.bytes_appended),
+        .storage_queue_occupancy_bytes = storage_queue.occupancy_bytes,
+        .storage_queue_capacity_bytes = storage_queue.capacity_bytes,
+        .filter_queue_occupancy_bytes = filter_queue.occupancy_bytes,
+        .dropped_frames = load_relaxed(&source->dropped_frames),
+        .aborted_frames = load_relaxed(&source->aborted_writes),
+        .monitor_skipped_frames = video->monitor.reader.skipped,
+        .discarded_frames = load_relaxed(&filter->frames_discarded) +
+                            load_relaxed(&video->sink.frames_discarded),
+        .filtered_frames = load_relaxed(&filter->frames_filtered),
+        .storage_append = latency_for_client(&video->sink.storage_append_us),
+        .source_cpu_ms = cpu_time_ms(&video->source.thread),
+        .filter_cpu_ms = cpu_time_ms(&video->filter.thread),
+        .sink_cpu_ms = cpu_time_ms(&video->sink.thread),
+    };
+    for (uint32_t i = 0; i < countof(metrics->roi_frames_out); ++i) {
+        const struct video_sink_s* const sink = &video->fanout.outputs[i].sink;
+        if (!video->fanout.outputs[i].is_enabled)
+            continue;
+        metrics->roi_frames_out[i] = load_relaxed(&sink->frames_appended);
+        metrics->roi_bytes_out[i] = load_relaxed(&sink->bytes_appended);
+    }
+    for (uint32_t i = 0; i < countof(metrics->tee_frames_out); ++i) {
+        const struct video_sink_s* const sink = &video->tee.outputs[i].sink;
+        if (!video->tee.outputs[i].is_enabled)
+            continue;
+        metrics->tee_frames_out[i] = load_relaxed(&sink->frames_appended);
+        metrics->tee_bytes_out[i] = load_relaxed(&sink->bytes_appended);
+    }
+    if (elapsed_s > 0.0) {
+        metrics->fps_in = (double)metrics->frames_in / elapsed_s;
+        metrics->fps_out = (double)metrics->frames_out / elapsed_s;
+        metrics->bytes_per_second_out = (double)metrics->bytes_out / elapsed_s;
+    }
+    if (metrics->filtered_frames) {
+        metrics->filter_ms_per_frame = 1e-3 *
+                                       (double)load_relaxed(&filter->busy_us) /
+                                       (double)metrics->filtered_frames;
+    }
+}
+
+enum AcquireStatusCode
+acquire_get_metrics(const struct AcquireRuntime* self_,
+                    struct AcquireMetrics* metrics)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(metrics);
+    self = containerof(self_, struct runtime, handle);
+    *metrics = (struct AcquireMetrics){ 0 };
+    for (uint32_t i = 0; i < countof(self->video); ++i) {
+        if ((self->valid_video_streams >> i) & 1)
+            stream_metrics(self->video + i, metrics->video + i);
+    }
+    metrics->dropped_log_messages = logger_async_dropped();
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+static void
+drain_log(struct runtime* self)
+{
+    struct clock clock;
+    clock_init(&clock);
+    while (!load_acquire(&self->log_thread_is_stopping)) {
+        logger_async_drain();
+        clock_sleep_ms(&clock, LOG_DRAIN_INTERVAL_MS);
+    }
+}
+
+enum AcquireStatusCode
+acquire_set_async_logging(struct AcquireRuntime* self_, uint8_t enable)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    if (!enable == !self->is_logging_async)
+        return AcquireStatus_Ok;
+
+    if (enable) {
+        store_release(&self->log_thread_is_stopping, 0);
+        logger_async_begin();
+        if (!thread_create(
+              &self->log_thread, (void (*)(void*))drain_log, self)) {
+            logger_async_end();
+            LOGE("Failed to start the logging thread.");
+            goto Error;
+        }
+    } else {
+        store_release(&self->log_thread_is_stopping, 1);
+        thread_join(&self->log_thread);
+        logger_async_end();
+    }
+    self->is_logging_async = !!enable;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 static uint32_t
 count_devices_by_kind(const struct runtime* self, enum DeviceKind target_kind)
 {
@@ -506,6 +1886,18 @@ acquire_start(struct AcquireRuntime* self_)
 
     EXPECT(self->valid_video_streams > 0,
            "At least one video stream must be marked valid");
+    if (self->is_stop_pending)
+        finish_stop(self);
+
+    // Starting empties the queues, and may allocate them again.
+    for (int i = 0; i < countof(self->video); ++i) {
+        if (load_relaxed(&self->video[i].read_holds)) {
+            LOGE("[stream %d] Release read holds before starting again. See "
+                 "acquire_release_read_hold().",
+                 i);
+            return AcquireStatus_Error;
+        }
+    }
 
     for (int i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
@@ -514,15 +1906,28 @@ acquire_start(struct AcquireRuntime* self_)
             continue;
         }
 
+        restart_reader(&video->sink.in, &video->monitor);
+        for_each_reader(video, restart_reader);
+        trace_ring_clear(&video->source.trace);
+        trace_ring_clear(&video->filter.trace);
+        trace_ring_clear(&video->sink.trace);
         CHECK(video_sink_start(&video->sink) == Device_Ok);
+        CHECK(video_fanout_start(&video->fanout) == Device_Ok);
+        CHECK(video_tee_start(&video->tee) == Device_Ok);
         CHECK(video_filter_start(&video->filter) == Device_Ok);
+        // Samples are already arriving when the first frame is tagged.
+        CHECK(video_stage_start(&video->stage) == Device_Ok);
+        CHECK(video_waveform_start(&video->waveform) == Device_Ok);
+        CHECK(video_intensity_start(&video->intensity) == Device_Ok);
+        CHECK(video_preview_start(&video->preview,
+                                  video->sink.bytes_of_image) == Device_Ok);
         CHECK(video_source_start(&video->source) == Device_Ok);
 
         TRACE("START[%2d] sink:%d processing:%d camera:%d",
               i,
-              video->sink.is_running,
-              video->filter.is_running,
-              video->source.is_running);
+              load_acquire(&video->sink.is_running),
+              load_acquire(&video->filter.is_running),
+              load_acquire(&video->source.is_running));
     }
     self->state = DeviceState_Running;
     return AcquireStatus_Ok;
@@ -534,22 +1939,91 @@ Error:
         }
         struct video_s* video = self->video + i;
         camera_stop(video->source.camera);
+        video_stage_stop(&video->stage);
+        video_waveform_stop(&video->waveform);
     }
     self->state = DeviceState_AwaitingConfiguration;
     return AcquireStatus_Error;
 }
 
-static size_t
-slice_size_bytes(const struct slice* slice)
+/// Writes what the threads of every valid stream recorded during the last
+/// acquisition to `trace_path`. Only call this once the threads are parked.
+static void
+write_trace(const struct runtime* self)
 {
-    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+    struct trace_thread threads[3 * ACQUIRE_MAX_VIDEO_STREAMS] = { 0 };
+    size_t n = 0;
+    for (size_t i = 0; i < countof(self->video); ++i) {
+        if (((self->valid_video_streams >> i) & 1) == 0)
+            continue;
+        const struct video_s* const video = self->video + i;
+        threads[n++] = (struct trace_thread){
+            .name = video->source.thread_attributes.name,
+            .ring = &video->source.trace,
+        };
+        threads[n++] = (struct trace_thread){
+            .name = video->filter.thread_attributes.name,
+            .ring = &video->filter.trace,
+        };
+        threads[n++] = (struct trace_thread){
+            .name = video->sink.thread_attributes.name,
+            .ring = &video->sink.trace,
+        };
+    }
+    if (!trace_write_chrome_json(self->trace_path, threads, n))
+        LOGE("Failed to write trace to \"%s\".", self->trace_path);
 }
 
 enum AcquireStatusCode
-acquire_stop(struct AcquireRuntime* self_)
+acquire_set_trace(struct AcquireRuntime* self_,
+                  const char* path,
+                  uint32_t events_per_thread)
 {
-    struct runtime* self = containerof(self_, struct runtime, handle);
+    struct runtime* self = 0;
+    CHECK(self_);
+    EXPECT(containerof(self_, struct runtime, handle)->state !=
+             DeviceState_Running,
+           "Tracing can't be changed while the runtime is running.");
+    EXPECT(!path || events_per_thread > 0,
+           "Expected room for at least one trace event per thread.");
+    // Past here, a failure turns tracing off.
+    self = containerof(self_, struct runtime, handle);
+
+    free(self->trace_path);
+    self->trace_path = 0;
+    if (path) {
+        const size_t nbytes = strlen(path) + 1;
+        CHECK(self->trace_path = malloc(nbytes));
+        memcpy(self->trace_path, path, nbytes); // NOLINT
+    } else {
+        events_per_thread = 0;
+    }
+    for (size_t i = 0; i < countof(self->video); ++i) {
+        struct video_s* const video = self->video + i;
+        CHECK(trace_ring_reserve(&video->source.trace, events_per_thread));
+        CHECK(trace_ring_reserve(&video->filter.trace, events_per_thread));
+        CHECK(trace_ring_reserve(&video->sink.trace, events_per_thread));
+    }
+    return AcquireStatus_Ok;
+Error:
+    if (self) {
+        free(self->trace_path);
+        self->trace_path = 0;
+        for (size_t i = 0; i < countof(self->video); ++i) {
+            struct video_s* const video = self->video + i;
+            trace_ring_reserve(&video->source.trace, 0);
+            trace_ring_reserve(&video->filter.trace, 0);
+            trace_ring_reserve(&video->sink.trace, 0);
+        }
+    }
+    return AcquireStatus_Error;
+}
 
+/// Waits for the threads of every valid stream to finish the acquisition, and
+/// readies the streams for the next one.
+static void
+finish_stop(struct runtime* self)
+{
     for (size_t i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
@@ -557,27 +2031,40 @@ acquire_stop(struct AcquireRuntime* self_)
             continue;
         }
 
-        ECHO(thread_join(&video->source.thread));
-        ECHO(thread_join(&video->filter.thread));
-        ECHO(thread_join(&video->sink.thread));
+        // The threads park once they're done and are woken again by the
+        // next acquire_start().
+        parked_thread_wait(&video->source.thread);
+        // No frames are left to tag.
+        video_stage_stop(&video->stage);
+        // The outputs run for as long as frames are being acquired.
+        video_waveform_stop(&video->waveform);
+        parked_thread_wait(&video->filter.thread);
+        parked_thread_wait(&video->sink.thread);
+        video_fanout_wait(&video->fanout);
+        video_tee_wait(&video->tee);
+        // Storage has every frame, so the last ones get measured now.
+        video_intensity_stop(&video->intensity);
+        video_preview_stop(&video->preview);
         channel_accept_writes(&video->sink.in, 1);
 
-        // If the monitor has been initialized and its read region hasn't
-        // already been released, flush it. This takes at most 2 iterations.
-        if (video->monitor.reader.id) {
-            size_t nbytes;
-            do {
-                struct slice slice =
-                  channel_read_map(&video->sink.in, &video->monitor.reader);
-                nbytes = slice_size_bytes(&slice);
-                channel_read_unmap(
-                  &video->sink.in, &video->monitor.reader, nbytes);
-                TRACE("[stream: %d] Monitor flushed %llu bytes", i, nbytes);
-            } while (nbytes);
-        }
+        // Detach the monitor, releasing any region it still has mapped, so a
+        // client that stops reading doesn't hold back the next acquisition.
+        // The next acquire_map_read() registers it again. The same goes for
+        // the other readers.
+        detach_reader(&video->sink.in, &video->monitor);
+        for_each_reader(video, detach_reader);
     }
+    if (self->trace_path)
+        write_trace(self);
     self->state = DeviceState_Armed;
+    self->is_stop_pending = 0;
+}
 
+enum AcquireStatusCode
+acquire_stop(struct AcquireRuntime* self_)
+{
+    struct runtime* self = containerof(self_, struct runtime, handle);
+    finish_stop(self);
     return AcquireStatus_Ok;
 }
 
@@ -593,25 +2080,129 @@ acquire_abort(struct AcquireRuntime* self_)
             continue;
         }
 
-        video->source.is_stopping = 1;
+        store_release(&video->source.is_stopping, 1);
         channel_accept_writes(&video->sink.in, 0);
-        // if the camera is waiting on a trigger, this will unblock it.
+        channel_accept_writes(&video->preview.out, 0);
+        video_fanout_abort(&video->fanout);
+        // The source notices the stop within a frame timeout. Cameras that
+        // can't time out may be waiting on a trigger, which this unblocks.
         camera_execute_trigger(video->source.camera);
     }
 
     return acquire_stop(self_);
 }
 
+/// Waits for `thread` until `timeout_ms` have passed on `clock`.
+/// @returns 1 if its run is over.
+static int
+wait_within(struct parked_thread* thread,
+            struct clock* clock,
+            uint32_t timeout_ms)
+{
+    const double remaining_ms = timeout_ms - clock_toc_ms(clock);
+    return parked_thread_timed_wait(
+      thread, remaining_ms > 0.0 ? (uint32_t)remaining_ms : 0);
+}
+
+/// Waits, until `timeout_ms` have passed on `clock`, for each of the stream's
+/// threads in the order acquire_stop() does.
+/// @returns 1 if they're all done.
+static int
+wait_for_stream_within(struct video_s* video,
+                       struct clock* clock,
+                       uint32_t timeout_ms)
+{
+    if (!wait_within(&video->source.thread, clock, timeout_ms))
+        return 0;
+    video_stage_stop(&video->stage);
+    video_waveform_stop(&video->waveform);
+    if (!wait_within(&video->filter.thread, clock, timeout_ms) ||
+        !wait_within(&video->sink.thread, clock, timeout_ms) ||
+        !wait_within(&video->fanout.thread, clock, timeout_ms))
+        return 0;
+    for (size_t i = 0; i < countof(video->fanout.outputs); ++i) {
+        if (!wait_within(
+              &video->fanout.outputs[i].sink.thread, clock, timeout_ms))
+            return 0;
+    }
+    for (size_t i = 0; i < countof(video->tee.outputs); ++i) {
+        if (!wait_within(&video->tee.outputs[i].sink.thread, clock, timeout_ms))
+            return 0;
+    }
+    return 1;
+}
+
+/// Drops what the stream has yet to store, so its threads finish promptly.
+static void
+discard_stream(struct video_s* video)
+{
+    // Nothing more reaches the queue to storage, or its readers.
+    channel_accept_writes(&video->sink.in, 0);
+    store_release(&video->filter.is_discarding, 1);
+    channel_wake_readers(&video->filter.in);
+    video_sink_discard(&video->sink);
+    video_fanout_discard(&video->fanout);
+    video_tee_discard(&video->tee);
+}
+
+enum AcquireStatusCode
+acquire_stop_within(struct AcquireRuntime* self_,
+                    uint32_t timeout_ms,
+                    enum AcquireUndrainedFrames undrained)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    EXPECT(undrained == AcquireUndrained_Persist ||
+             undrained == AcquireUndrained_Discard,
+           "Unknown way to handle undrained frames: %d.",
+           (int)undrained);
+    self = containerof(self_, struct runtime, handle);
+
+    struct clock clock;
+    clock_init(&clock);
+    for (size_t i = 0; i < countof(self->video); ++i) {
+        struct video_s* video = self->video + i;
+        if (((self->valid_video_streams >> i) & 1) == 0)
+            continue;
+        store_release(&video->source.is_stopping, 1);
+        // As in acquire_abort().
+        camera_execute_trigger(video->source.camera);
+    }
+
+    int is_drained = 1;
+    for (size_t i = 0; i < countof(self->video) && is_drained; ++i) {
+        if ((self->valid_video_streams >> i) & 1)
+            is_drained =
+              wait_for_stream_within(self->video + i, &clock, timeout_ms);
+    }
+    if (!is_drained) {
+        if (undrained == AcquireUndrained_Persist) {
+            LOG("Stop timed out after %u ms. Storing the rest in the "
+                "background.",
+                timeout_ms);
+            self->is_stop_pending = 1;
+            return AcquireStatus_Ok;
+        }
+        for (size_t i = 0; i < countof(self->video); ++i) {
+            if ((self->valid_video_streams >> i) & 1)
+                discard_stream(self->video + i);
+        }
+    }
+    finish_stop(self);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 enum AcquireStatusCode
 acquire_execute_trigger(struct AcquireRuntime* self_, uint32_t istream)
 {
-    const struct runtime* const self =
-      containerof(self_, struct runtime, handle);
-    const struct video_s* const video = self->video + istream;
+    struct runtime* const self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
     CHECK(self_);
     CHECK(istream < countof(self->video));
     CHECK(video->source.camera);
-    CHECK(camera_execute_trigger(video->source.camera) == Device_Ok);
+    CHECK(video_source_execute_trigger(&video->source) == Device_Ok);
     return AcquireStatus_Ok;
 Error:
     return AcquireStatus_Error;
@@ -628,7 +2219,7 @@ acquire_get_state(struct AcquireRuntime* self_)
         return self->state;
 
     // check that at least one pipeline has active threads
-    uint8_t is_running = 0;
+    uint32_t is_running = 0;
     for (int i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
@@ -639,16 +2230,18 @@ acquire_get_state(struct AcquireRuntime* self_)
         TRACE("source %s running, %s stopping\n"
               "filter %s running, %s stopping\n"
               "  sink %s running, %s stopping",
-              video->source.is_running ? "" : "not",
-              video->source.is_stopping ? "" : "not",
-              video->filter.is_running ? "" : "not",
-              video->filter.is_stopping ? "" : "not",
-              video->sink.is_running ? "" : "not",
-              video->sink.is_stopping ? "" : "not");
-
-        is_running |= video->source.is_running;
-        is_running |= video->filter.is_running;
-        is_running |= video->sink.is_running;
+              load_acquire(&video->source.is_running) ? "" : "not",
+              load_acquire(&video->source.is_stopping) ? "" : "not",
+              load_acquire(&video->filter.is_running) ? "" : "not",
+              load_acquire(&video->filter.is_stopping) ? "" : "not",
+              load_acquire(&video->sink.is_running) ? "" : "not",
+              load_acquire(&video->sink.is_stopping) ? "" : "not");
+
+        is_running |= load_acquire(&video->source.is_running);
+        is_running |= load_acquire(&video->filter.is_running);
+        is_running |= load_acquire(&video->sink.is_running);
+        is_running |= video_fanout_is_running(&video->fanout);
+        is_running |= video_tee_is_running(&video->tee);
 
         if (is_running)
             break;
@@ -4,6 +4,8 @@
 #include "device/props/device.h"
 #include "device/props/camera.h"
 #include "device/props/storage.h"
+#include "device/props/experimental/signals.h"
+#include "device/props/experimental/stage.axis.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -21,6 +23,130 @@ extern "C"
         void* impl;
     };
 
+    /// Where and how urgently one of a stream's threads runs.
+    struct AcquireThreadProperties
+    {
+        /// Bit `i` allows the thread to run on CPU `i`. 0 leaves it
+        /// unpinned. Not supported on macOS.
+        uint64_t affinity_mask;
+
+        /// 0 is the default priority, 1 is high and 2 is realtime. Realtime
+        /// usually needs elevated privileges. When a setting can't be applied
+        /// it is logged and the thread runs without it.
+        uint8_t priority;
+    };
+
+#define ACQUIRE_MAX_FILTER_STAGES (4)
+
+/// Number of video streams a runtime can drive. Streams without a camera
+/// and storage device are left unconfigured and cost no threads or queue
+/// memory.
+#define ACQUIRE_MAX_VIDEO_STREAMS (8)
+
+/// Number of regions a stream can store on their own. See `roi_outputs`.
+#define ACQUIRE_MAX_ROI_OUTPUTS (4)
+
+/// Number of storage devices a stream can store every frame to besides its
+/// own. See `tee_outputs`.
+#define ACQUIRE_MAX_TEE_OUTPUTS (3)
+
+/// Bins in the histogram of `AcquireIntensityStats`.
+#define ACQUIRE_INTENSITY_BINS (256)
+
+    enum AcquireFilterKind
+    {
+        AcquireFilter_None = 0,
+        AcquireFilter_Average,
+        AcquireFilter_Crop,
+        AcquireFilter_Bin,
+        AcquireFilter_FlatField,
+        AcquireFilter_Cast,
+        AcquireFilter_Project,
+        /// Packs u10, u12 and u14 samples into as many bits, as
+        /// `SampleType_u10p` and so on. Must be the last stage. See
+        /// `acquire_unpack_frame()`.
+        AcquireFilter_Pack,
+        /// Compresses frames losslessly on the filter's threads, so they
+        /// take less of the queue and of the disk. Must be the last stage.
+        /// Only storage devices that support compressed frames take them.
+        /// See `acquire_decompress_frame()`.
+        AcquireFilter_Compress,
+    };
+
+    enum AcquireProjection
+    {
+        AcquireProjection_Max = 0,
+        AcquireProjection_Min,
+        AcquireProjection_Sum,
+    };
+
+    enum AcquireAverageMode
+    {
+        /// One output frame for every `frame_count` input frames.
+        AcquireAverage_Block = 0,
+        /// One output frame per input: the mean of the last `frame_count`
+        /// frames. Keeps `frame_count` f32 copies of the frame.
+        AcquireAverage_Sliding,
+        /// One output frame per input: `out += alpha * (in - out)`.
+        AcquireAverage_Exponential,
+    };
+
+    enum AcquireAverageOutput
+    {
+        /// The mean as f32.
+        AcquireAverageOutput_Float = 0,
+        /// The mean in the camera's sample type, rounded to the nearest.
+        /// Integer samples are summed in 32 bits, so `frame_count` times
+        /// the largest sample must fit.
+        AcquireAverageOutput_Native,
+        /// The sum of unsigned integer samples as u32.
+        AcquireAverageOutput_Sum,
+    };
+
+    /// One step applied to a stream's frames before they are stored. Only
+    /// the fields for `kind` are used.
+    struct AcquireFilterStage
+    {
+        /// An `AcquireFilterKind`.
+        uint8_t kind;
+
+        /// Average and Project: number of frames combined into each output
+        /// frame.
+        uint32_t frame_count;
+
+        /// Average: an `AcquireAverageMode`.
+        uint8_t average_mode;
+
+        /// Average: an `AcquireAverageOutput`. Only block averages emit
+        /// anything but f32.
+        uint8_t average_output;
+
+        /// Average: weight of each new frame in an exponential average, in
+        /// (0,1].
+        float alpha;
+
+        /// Project: an `AcquireProjection`. Max and Min keep the camera's
+        /// sample type. Sum emits u32 for unsigned integer samples and f32
+        /// otherwise.
+        uint8_t projection;
+
+        /// Crop: region to keep, in pixels. Clipped to the frame.
+        struct
+        {
+            uint32_t x, y, width, height;
+        } roi;
+
+        /// Bin: width and height of the blocks of pixels averaged together.
+        uint32_t binning;
+
+        /// Cast: type the samples are converted to, rounding to the nearest
+        /// value and clamping to the range of the type.
+        enum SampleType sample_type;
+
+        /// Compress: a `FrameCompression`.
+        uint8_t compression;
+    };
+
     struct AcquireProperties
     {
         struct aq_properties_video_s
@@ -35,10 +161,200 @@ extern "C"
                 struct DeviceIdentifier identifier;
                 struct StorageProperties settings;
                 float write_delay_ms;
+
+                /// Number of threads appending frames to storage. 0 and 1
+                /// both append on the sink's thread. More are only used when
+                /// the storage device supports concurrent appends. At most 8.
+                uint32_t writer_count;
+
+                /// When nonzero, small writes are gathered until at least
+                /// this many bytes are waiting, so storage sees fewer, larger
+                /// appends. At most half of `channel_capacity_bytes`.
+                uint64_t coalesce_bytes;
+
+                /// When coalescing, frames are also written once the first
+                /// one held back has waited this long. 0 waits until
+                /// `coalesce_bytes` are ready or the stream stops.
+                float coalesce_max_age_ms;
+
+                /// When `io_is_scheduled` is set, the stream's appends take
+                /// turns with those of the other scheduled streams, for
+                /// streams writing to the same volume. A stream whose queue
+                /// is at least half full goes first, the fullest first, so
+                /// the stream closest to dropping frames is written first.
+                /// Otherwise, streams within their `io_share` go before those
+                /// that used theirs up, and then the higher `io_priority`.
+                /// `io_share` is the fraction of
+                /// `AcquireProperties::io_bandwidth_bytes_per_second` the
+                /// stream gets, as a token bucket holding 100 ms of it. 0
+                /// doesn't limit the stream. A stream that used up its share
+                /// still writes when no other is waiting.
+                uint8_t io_is_scheduled;
+                uint8_t io_priority;
+                float io_share;
             } storage;
             uint64_t max_frame_count;
             uint32_t frame_average_count;
-        } video[2];
+
+            /// Number of threads each frame is split across, in bands of rows,
+            /// while averaging. 0 and 1 both average on a single thread. At
+            /// most 8.
+            uint32_t frame_average_thread_count;
+
+            /// Size in bytes of the queues between this stream's camera,
+            /// frame averaging and storage. Each must hold at least one frame.
+            /// 0 selects the default (1 GiB). Memory is committed when the
+            /// stream is started, and the averaging queue only when
+            /// `frame_average_count` is greater than 1. Queues of frames that
+            /// all take the same room are rounded up to hold a whole number
+            /// of them, so none of a queue goes unused.
+            uint64_t channel_capacity_bytes;
+
+            /// When nonzero, `acquire_map_read()` never holds back the camera
+            /// or storage for longer than a region stays mapped. A client that
+            /// falls behind skips ahead to the newest frame instead. See
+            /// `acquire_get_monitor_skipped_frames()`.
+            uint8_t monitor_is_lossy;
+
+            /// Decimates the frames `acquire_map_read()` hands out, for
+            /// clients like displays that only need some of them. A frame is
+            /// only handed out when its id is at least
+            /// `monitor_every_nth_frame` past the last one the client
+            /// consumed, and it was acquired at least
+            /// `monitor_min_interval_ms` later. Other frames are released
+            /// without being mapped, so each region is a run of wanted
+            /// frames. 0 turns either test off.
+            uint32_t monitor_every_nth_frame;
+            float monitor_min_interval_ms;
+
+            /// When 2, 4 or 8, a thread of the stream averages each frame the
+            /// monitor would hand out over blocks of that many pixels on a
+            /// side, for monitor readers opened with `is_preview`. Displays
+            /// then read a fraction of the bytes. Frames it can't bin, like
+            /// compressed or packed ones, are left out. It never holds back
+            /// the camera for longer than a frame takes to bin, and skips
+            /// frames when it falls behind. 0 and 1 turn it off.
+            uint32_t preview_binning;
+
+            /// When not empty, the queue `acquire_map_read()` reads from is
+            /// placed in shared memory under this name when the stream
+            /// starts, so other processes can read the stream's frames
+            /// without copying them. See shared_monitor.h. Names are up to 30
+            /// letters, digits, '-' and '_'. The whole queue, see
+            /// `channel_capacity_bytes`, is shared memory then.
+            char monitor_shared_name[32];
+
+            /// When set, the source thread computes the CRC32C of each frame
+            /// as it comes from the camera, and stores it in the frame's
+            /// header, see `VideoFrame::checksum`. Frames the filter stages
+            /// or `roi_outputs` remake get the checksum of their own data.
+            /// The raw and tiff storage devices store it with each frame.
+            uint8_t enable_frame_checksums;
+
+            /// When set, a thread of the stream measures the frames headed
+            /// to storage, as `acquire_map_read()` sees them, for
+            /// `acquire_get_intensity_stats()`. It never holds back the
+            /// camera for longer than a frame takes to measure, and skips
+            /// frames when it falls behind.
+            uint8_t enable_intensity_stats;
+
+            /// Applied to the stream's threads when the stream is started.
+            struct
+            {
+                struct AcquireThreadProperties source, filter, sink;
+            } threads;
+
+            /// When `use_numa_node` is set, the stream's queues are allocated
+            /// on NUMA node `numa_node`, and its source, filter and sink
+            /// threads whose `affinity_mask` is 0 run on that node's CPUs.
+            /// Pick the node the frame grabber and the storage's disk hang
+            /// off, so frames don't cross between sockets. Nodes are numbered
+            /// up to `AcquirePropertyMetadata::video[].numa_node.high`.
+            uint8_t use_numa_node;
+            uint8_t numa_node;
+
+            /// Applied to each frame in order, up to the first
+            /// `AcquireFilter_None`. Flat-field stages use the images passed
+            /// to `acquire_set_flat_field()`. When `frame_average_count` is
+            /// more than 1 and no stage averages, averaging runs first.
+            struct AcquireFilterStage filters[ACQUIRE_MAX_FILTER_STAGES];
+
+            /// Regions of each frame stored on their own, each with a storage
+            /// device of its own, alongside the whole frames that go to
+            /// `storage`. Regions are cropped from what the filter stages
+            /// make, and clipped to it. Each region's queue holds as many
+            /// frames as the stream's, see `channel_capacity_bytes`. Outputs
+            /// with an empty region or a `DeviceKind_None` device are off.
+            /// To store only the regions, select "trash" for `storage`.
+            struct aq_properties_roi_output_s
+            {
+                struct
+                {
+                    uint32_t x, y, width, height;
+                } roi;
+                struct DeviceIdentifier identifier;
+                struct StorageProperties settings;
+            } roi_outputs[ACQUIRE_MAX_ROI_OUTPUTS];
+
+            /// More storage devices each frame is stored with, alongside
+            /// `storage`. They read frames from the same queue, without
+            /// copies, and a frame is only dropped from the queue once every
+            /// device has it, so the slowest holds back the camera. Each is
+            /// appended to by one thread, without write delay or coalescing.
+            /// Outputs with a `DeviceKind_None` device are off.
+            struct aq_properties_tee_output_s
+            {
+                struct DeviceIdentifier identifier;
+                struct StorageProperties settings;
+            } tee_outputs[ACQUIRE_MAX_TEE_OUTPUTS];
+
+            /// A stage axis whose position is streamed alongside the video
+            /// while the stream runs. Each frame is tagged with where the
+            /// axis was when the frame was acquired. See
+            /// `VideoFrame::stage_position`. `DeviceKind_None` for no axis.
+            struct aq_properties_stage_axis_s
+            {
+                struct DeviceIdentifier identifier;
+                struct StageAxisProperties settings;
+            } stage_axis;
+
+            /// A signal device whose outputs play the waveform passed to
+            /// `acquire_write_waveform()` while the stream runs, timed by the
+            /// device's clock. `DeviceKind_None` for no device.
+            struct aq_properties_signals_s
+            {
+                struct DeviceIdentifier identifier;
+                struct SignalProperties settings;
+
+                /// Samples per output line in each block of waveform. Two
+                /// blocks are kept queued on the device, so a block should
+                /// play for several milliseconds.
+                uint32_t samples_per_block;
+            } signals;
+        } video[ACQUIRE_MAX_VIDEO_STREAMS];
+
+        /// When nonzero, the bytes of memory split across the queues of the
+        /// streams being configured, in place of each stream's
+        /// `channel_capacity_bytes`. Streams that set their own
+        /// `channel_capacity_bytes` keep it, and it counts against the
+        /// budget. The rest share what's left in proportion to the bytes per
+        /// second their cameras are set to deliver, judging by the frame
+        /// shape and exposure time, and split their share between the queue
+        /// to storage and, when they average or filter frames, the queue to
+        /// the filter. `acquire_get_configuration()` reports each stream's
+        /// share, and configuring with it unchanged splits the budget again.
+        uint64_t memory_budget_bytes;
+
+        /// When `memory_budget_bytes` is 0, the budget is this fraction of
+        /// the host's physical memory. 0 for no budget, so each stream's
+        /// queues take 1 GiB unless sized otherwise.
+        float memory_budget_fraction;
+
+        /// Bytes per second the volume shared by streams whose
+        /// `storage.io_is_scheduled` is set sustains. Their `io_share`s are
+        /// fractions of it. 0 turns shares off, so only how full the queues
+        /// are and priorities order the appends.
+        uint64_t io_bandwidth_bytes_per_second;
     };
 
     struct AcquirePropertyMetadata
@@ -50,7 +366,16 @@ extern "C"
             //  description
             struct Property max_frame_count;
             struct Property frame_average_count;
-        } video[2];
+            struct Property channel_capacity_bytes;
+            struct Property monitor_is_lossy;
+            struct Property frame_average_thread_count;
+            struct Property storage_writer_count;
+            struct Property numa_node;
+        } video[ACQUIRE_MAX_VIDEO_STREAMS];
+
+        /// `high` is the host's physical memory, or -1 if it's unknown.
+        struct Property memory_budget_bytes;
+        struct Property memory_budget_fraction;
     };
 
     const char* acquire_api_version_string();
@@ -90,6 +415,89 @@ extern "C"
       const struct AcquireRuntime* self,
       struct AcquireProperties* properties);
 
+    /// @brief Changes the exposure time, line interval, offset and shape of
+    /// the cameras of running streams, without stopping them.
+    /// @details Only those camera properties may differ from the running
+    /// configuration. Everything else in `settings` is ignored. Each camera
+    /// takes its new settings between two frames, and frames after that
+    /// have the new shape. A camera that won't take them while it streams
+    /// is stopped, set and started again, while the rest of the stream keeps
+    /// running. Frames may not grow past the size the stream was started
+    /// with, and the region can't change while filter stages or
+    /// `roi_outputs` are in use. A camera that refuses its new settings
+    /// goes back to the ones it had. `settings` is updated with what the
+    /// cameras report.
+    enum AcquireStatusCode acquire_update_properties(
+      struct AcquireRuntime* self,
+      struct AcquireProperties* settings);
+
+    /// @brief Sets the images flat-field filter stages on the `istream`'th
+    /// stream correct frames with, computing `(in - dark) * gain`.
+    /// @details `dark` and `gain` each hold `channels * width * height`
+    /// values in frame order and are copied. Either may be NULL, meaning a
+    /// dark level of 0 or a gain of 1. Frames of a different size are
+    /// dropped by the stage. Can't be called while running.
+    enum AcquireStatusCode acquire_set_flat_field(struct AcquireRuntime* self,
+                                                  uint32_t istream,
+                                                  uint32_t channels,
+                                                  uint32_t width,
+                                                  uint32_t height,
+                                                  const float* dark,
+                                                  const float* gain);
+
+    /// @brief Queues waveform for the `istream`'th stream's signal device.
+    /// @details `data` holds whole blocks of `samples_per_block` samples for
+    /// each output line, interleaved in line order, and is copied. While
+    /// running, this waits for room. Otherwise, it fails once the queue is
+    /// full, so a stream can start with its first blocks ready. When the
+    /// queue runs dry the last block is played again, so a periodic waveform
+    /// only needs writing once.
+    enum AcquireStatusCode acquire_write_waveform(struct AcquireRuntime* self,
+                                                  uint32_t istream,
+                                                  const void* data,
+                                                  size_t nbytes);
+
+    /// @brief Pushes a record of `nbytes` bytes of `data` to be stored with
+    /// a frame of the `istream`'th stream, like the stimulus shown or where
+    /// the stage was.
+    /// @details The record is joined, as `join` says, to the frame whose id
+    /// is `key`, or to the first frame that reached the runtime at or after
+    /// `key`, in clock_tic() tics like `VideoFrame::timestamps.acq_thread`.
+    /// It's copied once, and handed to storage as a `FrameAnnotation` just
+    /// before its frame, for storage devices that take them. Records are
+    /// joined in the order they're pushed, so a record waiting for its frame
+    /// holds back those pushed after it, and one pushed after its frame was
+    /// stored goes with the next frame stored. Records carry at most 4 KiB.
+    /// Safe to call from any thread while the stream runs. Fails rather than
+    /// waits when too many records are waiting for their frames. See
+    /// `AcquireStreamStats::annotations_dropped`.
+    enum AcquireStatusCode acquire_annotate_frame(struct AcquireRuntime* self,
+                                                  uint32_t istream,
+                                                  enum FrameAnnotationJoin join,
+                                                  uint64_t key,
+                                                  uint32_t tag,
+                                                  const void* data,
+                                                  size_t nbytes);
+
+    /// @brief Unpacks the samples of `frame`, which has a packed sample type
+    /// as written by an `AcquireFilter_Pack` stage, into 16-bit samples.
+    /// @details `dst` holds `nsamples` samples, which must be at least
+    /// `frame->shape.strides.planes`. Uses the widest SIMD the CPU supports.
+    /// Fails for frames that aren't packed.
+    enum AcquireStatusCode acquire_unpack_frame(const struct VideoFrame* frame,
+                                                uint16_t* dst,
+                                                size_t nsamples);
+
+    /// @brief Writes the samples of `frame`, as compressed by an
+    /// `AcquireFilter_Compress` stage, to `dst`.
+    /// @details `dst` holds `nbytes`, which must be at least
+    /// `bytes_of_image(&frame->shape)`. Frames that weren't compressed are
+    /// copied. Fails if the compressed data is corrupt.
+    enum AcquireStatusCode acquire_decompress_frame(
+      const struct VideoFrame* frame,
+      void* dst,
+      size_t nbytes);
+
     enum AcquireStatusCode acquire_get_configuration_metadata(
       const struct AcquireRuntime* self,
       struct AcquirePropertyMetadata* metadata);
@@ -109,6 +517,34 @@ extern "C"
 
     enum AcquireStatusCode acquire_abort(struct AcquireRuntime* self);
 
+    /// What acquire_stop_within() does with frames that aren't stored by its
+    /// deadline.
+    enum AcquireUndrainedFrames
+    {
+        /// Keeps storing them after the call returns. The runtime stays
+        /// `DeviceState_Running` until they're stored, and acquire_stop(),
+        /// acquire_start() and acquire_configure() wait for them first.
+        AcquireUndrained_Persist = 0,
+
+        /// Drops them, and counts them in
+        /// `AcquireStreamMetrics::discarded_frames`.
+        AcquireUndrained_Discard,
+    };
+
+    /// @brief Stops acquiring, like acquire_abort(), and waits up to
+    /// `timeout_ms` for the frames already acquired to be stored.
+    /// @details Frames still queued at the deadline are kept or dropped as
+    /// `undrained` says. Appends storage is already working on are waited
+    /// for, so a discarding stop can overrun the deadline by about one
+    /// append. Waiting on a camera that doesn't return promptly can overrun
+    /// it too.
+    enum AcquireStatusCode acquire_stop_within(
+      struct AcquireRuntime* self,
+      uint32_t timeout_ms,
+      enum AcquireUndrainedFrames undrained);
+
+    /// @brief Fires the software trigger of the `istream`'th stream's camera.
+    /// @see AcquireStreamLatency::trigger_to_channel
     enum AcquireStatusCode acquire_execute_trigger(struct AcquireRuntime* self,
                                                    uint32_t istream);
 
@@ -135,12 +571,40 @@ extern "C"
     /// (`*beg==*end`) - this call does not wait for data.
     ///
     /// Holding on to a mapped region will prevent writers from making progress.
-    /// Call `acquire_unmap_read()` to release.
+    /// Call `acquire_unmap_read()` to release. Unless the stream's
+    /// `monitor_is_lossy` is set, so will falling behind.
     enum AcquireStatusCode acquire_map_read(const struct AcquireRuntime* self,
                                             uint32_t istream,
                                             struct VideoFrame** beg,
                                             struct VideoFrame** end);
 
+    /// @brief Like `acquire_map_read()`, but when no data is ready, blocks
+    /// until the stream produces a frame or `timeout_ms` elapses.
+    /// @details Returns an empty region on timeout, and also early when the
+    /// stream stops, so a client waiting for the last frames notices the end
+    /// of the acquisition without waiting out the timeout. A `timeout_ms` of
+    /// 0 does not block.
+    enum AcquireStatusCode acquire_map_read_wait(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      uint32_t timeout_ms,
+      struct VideoFrame** beg,
+      struct VideoFrame** end);
+
+    /// @brief Maps only the newest frame of the `istream`'th video stream,
+    /// skipping the frames before it that haven't been read.
+    /// @details For live displays, which want the frame just acquired rather
+    /// than the backlog. Takes the same time however far behind the client
+    /// is. The frames skipped count towards
+    /// `acquire_get_monitor_skipped_frames()`. Sets `*frame` to NULL when
+    /// the newest frame has already been read. Like `acquire_map_read()`,
+    /// the frame stays valid till it's released with `acquire_unmap_read()`,
+    /// passing its `bytes_of_frame`, and reading carries on after it.
+    /// @param[out] frame Must be non-NULL. Set to the newest frame, or NULL.
+    enum AcquireStatusCode acquire_map_latest(const struct AcquireRuntime* self,
+                                              uint32_t istream,
+                                              struct VideoFrame** frame);
+
     /// @brief Releases the read region reserved for the `istream`'th video
     /// stream.
     /// @see acquire_map_read()
@@ -152,10 +616,477 @@ extern "C"
                                               uint32_t istream,
                                               size_t consumed_bytes);
 
+    /// Keeps a region handed out by `acquire_map_read()` or
+    /// `acquire_monitor_reader_map()` intact after it's unmapped. See
+    /// `acquire_unmap_read_and_hold()`.
+    struct AcquireReadHold;
+
+    /// @brief Like `acquire_unmap_read()`, but the region stays intact till
+    /// `*hold` is released with `acquire_release_read_hold()`.
+    /// @details Lets a client start an async copy out of the region, like
+    /// cudaMemcpyAsync(), map the next region, and release this one once the
+    /// copy completes. Several holds may be kept, and released in any order.
+    /// Each holds back the camera like a mapped region does, even with
+    /// `monitor_is_lossy` set, so release them promptly. Fails when nothing
+    /// is mapped. Holds must be released before the runtime is started again
+    /// or shut down.
+    enum AcquireStatusCode acquire_unmap_read_and_hold(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      size_t consumed_bytes,
+      struct AcquireReadHold** hold);
+
+    /// @brief Lets the writer reuse the region kept by `hold`, and frees it.
+    enum AcquireStatusCode acquire_release_read_hold(
+      struct AcquireReadHold* hold);
+
+    /// Allocates a stream's queue in place of the runtime. See
+    /// `acquire_set_channel_allocator()`.
+    struct AcquireChannelAllocator
+    {
+        /// Returns `nbytes` bytes aligned to at least 4 KiB, or NULL.
+        void* (*alloc)(void* ctx, size_t nbytes);
+        /// Frees what `alloc` returned. May be NULL.
+        void (*free)(void* ctx, void* data, size_t nbytes);
+        void* ctx;
+    };
+
+    /// @brief Has `allocator` allocate the queue the `istream`'th stream's
+    /// monitors read from, or the runtime again when it's NULL.
+    /// @details With pinned memory, like from cudaHostAlloc(), or memory
+    /// registered with cudaHostRegister(), a GPU copies frames straight out
+    /// of mapped regions. Takes effect when the stream next starts. A queue
+    /// is freed with the allocator that allocated it, when the stream starts
+    /// with another allocator or size, or at `acquire_shutdown()`, so `ctx`
+    /// must stay valid till then. Ignored while `monitor_shared_name` is
+    /// set. Can't be called while running.
+    enum AcquireStatusCode acquire_set_channel_allocator(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const struct AcquireChannelAllocator* allocator);
+
     size_t acquire_bytes_waiting_to_be_written_to_disk(
       const struct AcquireRuntime* self,
       uint32_t istream);
 
+    /// @brief Number of frames `acquire_map_read()` skipped on the `istream`'th
+    /// stream since it was last started, because the client fell behind.
+    /// @details Only a lossy monitor skips frames, besides
+    /// `acquire_map_latest()`. See `monitor_is_lossy` in `AcquireProperties`.
+    uint64_t acquire_get_monitor_skipped_frames(
+      const struct AcquireRuntime* self,
+      uint32_t istream);
+
+    /// A reader of one video stream with its own position, for when several
+    /// clients consume the same stream. See `acquire_open_monitor_reader()`.
+    struct AcquireMonitorReader;
+
+    struct AcquireMonitorReaderProperties
+    {
+        /// Like `monitor_is_lossy`, for this reader only.
+        uint8_t is_lossy;
+
+        /// Like `monitor_every_nth_frame` and `monitor_min_interval_ms`, for
+        /// this reader only.
+        uint32_t every_nth_frame;
+        float min_interval_ms;
+
+        /// When set, the reader reads the stream's binned preview instead of
+        /// its frames. See `preview_binning`.
+        uint8_t is_preview;
+    };
+
+    /// @brief Opens a reader of the `istream`'th video stream.
+    /// @details Each reader sees every frame that goes to storage, unless it
+    /// is lossy or decimated, independently of `acquire_map_read()` and of
+    /// other readers. Like the built-in monitor, a reader starts holding
+    /// back the camera and storage the first time it maps, and is released
+    /// when the acquisition stops. Readers stay open across acquisitions
+    /// until `acquire_close_monitor_reader()`. They may be used from any
+    /// thread, but each one from only one thread at a time.
+    /// @param[in] props May be NULL, for a lossless reader that takes every
+    ///                  frame.
+    /// @param[out] reader Set to the new reader.
+    enum AcquireStatusCode acquire_open_monitor_reader(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const struct AcquireMonitorReaderProperties* props,
+      struct AcquireMonitorReader** reader);
+
+    /// @brief Releases whatever `reader` has mapped and frees it.
+    enum AcquireStatusCode acquire_close_monitor_reader(
+      struct AcquireRuntime* self,
+      struct AcquireMonitorReader* reader);
+
+    /// @brief Like `acquire_map_read_wait()`, for `reader`.
+    enum AcquireStatusCode acquire_monitor_reader_map(
+      struct AcquireMonitorReader* reader,
+      uint32_t timeout_ms,
+      struct VideoFrame** beg,
+      struct VideoFrame** end);
+
+    /// @brief Like `acquire_unmap_read()`, for `reader`.
+    enum AcquireStatusCode acquire_monitor_reader_unmap(
+      struct AcquireMonitorReader* reader,
+      size_t consumed_bytes);
+
+    /// @brief Like `acquire_get_monitor_skipped_frames()`, for `reader`.
+    /// @brief Like `acquire_monitor_reader_unmap()`, but the region stays
+    /// intact till `*hold` is released. See `acquire_unmap_read_and_hold()`.
+    enum AcquireStatusCode acquire_monitor_reader_unmap_and_hold(
+      struct AcquireMonitorReader* reader,
+      size_t consumed_bytes,
+      struct AcquireReadHold** hold);
+
+    uint64_t acquire_monitor_reader_skipped_frames(
+      const struct AcquireMonitorReader* reader);
+
+    /// Steps through the frames of a region mapped by `acquire_map_read()`
+    /// or a monitor reader. Frames vary in size, so each one is found from
+    /// the `bytes_of_frame` of the one before it.
+    ///
+    /// ~~~{.c}
+    ///     struct AcquireFrameIterator it =
+    ///       acquire_frame_iterator_init(beg, end);
+    ///     struct VideoFrame* frame = 0;
+    ///     while ((frame = acquire_frame_iterator_next(&it))) {...}
+    /// ~~~
+    struct AcquireFrameIterator
+    {
+        /// The part of the region not visited yet.
+        uint8_t *beg, *end;
+    };
+
+    /// @brief Starts iterating over the frames in `[beg,end)`.
+    struct AcquireFrameIterator acquire_frame_iterator_init(
+      struct VideoFrame* beg,
+      struct VideoFrame* end);
+
+    /// @returns The next frame, or NULL after the last one. Also stops at a
+    /// frame whose `bytes_of_frame` doesn't fit in what's left of the region.
+    struct VideoFrame* acquire_frame_iterator_next(
+      struct AcquireFrameIterator* it);
+
+    /// A frame of a mapped region, as listed by `acquire_list_frames()`.
+    struct AcquireFrameRef
+    {
+        struct VideoFrame* frame;
+        /// The frame's samples, or its compressed data when the frame's
+        /// `compression` is set.
+        uint8_t* data;
+        uint64_t bytes_of_data;
+        /// A copy of the frame's shape, so shapes can be read as one array.
+        struct ImageShape shape;
+    };
+
+    /// @brief Lists the frames in `[beg,end)`, up to `capacity` of them, in
+    /// one call.
+    /// @details Nothing is copied: each `AcquireFrameRef` points into the
+    /// region, and stays valid until the region is unmapped. When there are
+    /// more than `capacity` frames, list the rest starting from `beg`
+    /// advanced by `*nbytes`.
+    /// @param[out] count Set to the number of frames listed.
+    /// @param[out] nbytes May be NULL. Set to the bytes taken by the frames
+    ///                    listed, which is what to pass to
+    ///                    `acquire_unmap_read()` to release just those.
+    /// @returns AcquireStatus_Error if a frame doesn't fit in the region,
+    /// after listing the frames before it.
+    enum AcquireStatusCode acquire_list_frames(struct VideoFrame* beg,
+                                               struct VideoFrame* end,
+                                               struct AcquireFrameRef* frames,
+                                               size_t capacity,
+                                               size_t* count,
+                                               size_t* nbytes);
+
+    /// Usage of one of a video stream's queues.
+    struct AcquireChannelStats
+    {
+        uint64_t capacity_bytes;
+
+        /// Bytes waiting on the slowest reader that holds back the writer.
+        uint64_t occupancy_bytes;
+
+        /// Largest `occupancy_bytes` seen since the stream was started.
+        uint64_t high_water_bytes;
+
+        uint64_t bytes_written;
+
+        /// Number of times the writer wrapped around to the start of the
+        /// queue, and the bytes it left unused at the end when it did.
+        uint64_t wrap_count;
+        uint64_t wasted_bytes;
+
+        /// Time the writer spent blocked waiting for readers to free space,
+        /// and the number of times it was. For the storage queue, each time
+        /// is a backlog where storage or the monitor fell behind the camera.
+        double writer_blocked_ms;
+        uint64_t writer_blocked_count;
+    };
+
+    /// Distribution of the time frames spent in one stage of a stream.
+    struct AcquireLatencyStats
+    {
+        uint64_t count;
+        double p50_ms, p99_ms, max_ms;
+    };
+
+    struct AcquireStreamLatency
+    {
+        /// From the camera's timestamp until the frame was written to a queue.
+        /// Only meaningful for cameras that stamp frames with the runtime's
+        /// clock, like the simulated ones.
+        struct AcquireLatencyStats camera_to_channel;
+
+        /// Time frames waited in the filter queue.
+        struct AcquireLatencyStats channel_to_filter;
+
+        /// From a frame being written to a queue until the storage thread
+        /// picked it up. For averaged frames this counts from the first frame
+        /// in the average, so it includes the time spent averaging.
+        struct AcquireLatencyStats channel_to_sink;
+
+        /// From the storage thread picking a frame up until storage accepted
+        /// it.
+        struct AcquireLatencyStats sink_to_storage;
+
+        /// Time appends waited for their turn with the other streams, when
+        /// `storage.io_is_scheduled` is set.
+        struct AcquireLatencyStats io_scheduler_wait;
+
+        /// From `acquire_execute_trigger()` until the next frame was written
+        /// to a queue, where it's visible to `acquire_map_read()` unless it
+        /// goes through filter stages first. Only meaningful for cameras
+        /// that wait for the software trigger.
+        struct AcquireLatencyStats trigger_to_channel;
+    };
+
+    struct AcquireStreamStats
+    {
+        /// Frames headed to storage and the monitor.
+        struct AcquireChannelStats storage_queue;
+        uint64_t storage_bytes_read;
+        uint64_t monitor_bytes_read;
+        uint64_t monitor_skipped_frames;
+
+        /// Frames the camera dropped, judging by gaps in `hardware_frame_id`.
+        /// See also `VideoFrame::hardware_frame_gap`.
+        uint64_t dropped_frames;
+
+        /// Frame reservations given back because the camera returned no
+        /// data, for example when it timed out.
+        uint64_t aborted_frames;
+
+        /// Frames headed to the frame averaging filter. Only used when
+        /// `frame_average_count` is more than 1.
+        struct AcquireChannelStats filter_queue;
+
+        /// Records pushed with `acquire_annotate_frame()`, handed to storage,
+        /// and dropped, either because storage doesn't take them or because
+        /// no frame was stored for them.
+        uint64_t annotations_pushed;
+        uint64_t annotations_stored;
+        uint64_t annotations_dropped;
+
+        /// Percentiles are accurate to about 6%.
+        struct AcquireStreamLatency latency;
+    };
+
+    /// @brief Reports how full the `istream`'th stream's queues are, how
+    /// long the camera thread was stalled on them, and how many frames were
+    /// lost along the way.
+    /// @details Counters start over each time the stream is started. Safe to
+    /// call while the runtime is running, for example from the thread calling
+    /// `acquire_map_read()`.
+    enum AcquireStatusCode acquire_get_stream_stats(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireStreamStats* stats);
+
+    /// Intensity statistics of one frame. See `enable_intensity_stats`.
+    struct AcquireIntensityStats
+    {
+        /// The frame measured, and the number of frames measured since the
+        /// stream was started.
+        uint64_t frame_id;
+        uint64_t frames_measured;
+
+        /// Type of the samples measured. Packed samples are measured
+        /// unpacked.
+        enum SampleType sample_type;
+        uint64_t sample_count;
+
+        double min, max, mean, stddev;
+
+        /// Samples at the smallest and at the largest value the sample type
+        /// holds, as when the sensor clips. Unpacked 10, 12 and 14 bit
+        /// samples top out at `2^bits - 1`. Always 0 for f32.
+        uint64_t at_floor, at_ceiling;
+
+        /// `bins[i]` counts samples in `[bin_lo + i * bin_width, bin_lo +
+        /// (i + 1) * bin_width)`. Bins span the range of the sample type, or
+        /// `[min, max]` for f32, where the last bin includes `max`.
+        double bin_lo, bin_width;
+        uint32_t bins[ACQUIRE_INTENSITY_BINS];
+    };
+
+    /// @brief Copies the intensity statistics of the last frame of the
+    /// `istream`'th stream that was measured, without mapping any frames.
+    /// @details Safe to call from any thread while the runtime is running.
+    /// Compressed frames aren't measured. Before the first frame of an
+    /// acquisition is measured, `frames_measured` is 0 and nothing else is
+    /// set.
+    /// @returns AcquireStatus_Error if the stream doesn't have
+    /// `enable_intensity_stats` set.
+    enum AcquireStatusCode acquire_get_intensity_stats(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireIntensityStats* stats);
+
+    /// Maps the hardware timestamps of a stream's frames,
+    /// `VideoFrame::timestamps.hardware`, onto the host clock of
+    /// `timestamps.acq_thread`, which every stream shares. See
+    /// `acquire_hardware_to_host_time()`.
+    struct AcquireClockCorrelation
+    {
+        /// `host = host_origin + (hardware - hardware_origin) *
+        /// host_per_hardware`, where the line is fit through recent frames.
+        /// `host` is when the frame would have reached the runtime had it
+        /// been held up as little as the fastest of them.
+        uint64_t hardware_origin;
+        uint64_t host_origin;
+        double host_per_hardware;
+
+        /// Root mean square spread, in host clock tics, of the time recent
+        /// frames took to reach the runtime.
+        double residual;
+
+        /// Frames the line was fit through.
+        uint32_t sample_count;
+    };
+
+    /// @brief Copies the latest mapping of the `istream`'th stream's
+    /// hardware timestamps onto the host clock.
+    /// @details The mapping is fit again every few frames while the stream
+    /// runs, following the drift between the camera's clock and the host's,
+    /// once more when the camera stops, and is kept until the stream starts
+    /// again. Safe to call from any thread.
+    /// @returns AcquireStatus_Error if the stream's camera hasn't given enough
+    /// timestamps since it was started, or doesn't give any.
+    enum AcquireStatusCode acquire_get_clock_correlation(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireClockCorrelation* correlation);
+
+    /// @returns The host time, on the clock of `timestamps.acq_thread`, of
+    /// the hardware timestamp `hardware`, according to `correlation`.
+    uint64_t acquire_hardware_to_host_time(
+      const struct AcquireClockCorrelation* correlation,
+      uint64_t hardware);
+
+    /// Throughput and load of one video stream. Counts cover the stream's
+    /// last acquisition, and rates are averaged over `elapsed_ms`.
+    struct AcquireStreamMetrics
+    {
+        /// Set for streams that are configured. Other streams are all zero.
+        uint8_t is_valid;
+
+        /// Time since the stream was last started, or how long it ran if it
+        /// has stopped.
+        double elapsed_ms;
+
+        /// Frames the camera delivered and frames appended to storage.
+        uint64_t frames_in, frames_out;
+        double fps_in, fps_out;
+
+        uint64_t bytes_out;
+        double bytes_per_second_out;
+
+        /// How full the storage and filter queues are right now. See
+        /// `AcquireChannelStats::occupancy_bytes`.
+        uint64_t storage_queue_occupancy_bytes;
+        uint64_t storage_queue_capacity_bytes;
+        uint64_t filter_queue_occupancy_bytes;
+
+        uint64_t dropped_frames;
+        uint64_t aborted_frames;
+        uint64_t monitor_skipped_frames;
+
+        /// Frames acquired but dropped, rather than stored, when
+        /// acquire_stop_within() ran out of time. Crops and copies for
+        /// `roi_outputs` and `tee_outputs` aren't counted.
+        uint64_t discarded_frames;
+
+        /// Frames run through the filter stages and the average time each
+        /// took.
+        uint64_t filtered_frames;
+        double filter_ms_per_frame;
+
+        /// Time spent in each call appending to the storage device.
+        struct AcquireLatencyStats storage_append;
+
+        /// Frames and bytes appended to the storage of each of
+        /// `roi_outputs`.
+        uint64_t roi_frames_out[ACQUIRE_MAX_ROI_OUTPUTS];
+        uint64_t roi_bytes_out[ACQUIRE_MAX_ROI_OUTPUTS];
+
+        /// Frames and bytes appended to the storage of each of
+        /// `tee_outputs`.
+        uint64_t tee_frames_out[ACQUIRE_MAX_TEE_OUTPUTS];
+        uint64_t tee_bytes_out[ACQUIRE_MAX_TEE_OUTPUTS];
+
+        /// CPU time used by the stream's source, filter and sink threads
+        /// since they were created, or -1 where it can't be read. Threads
+        /// that help the filter or sink aren't included. The threads are
+        /// only created when the stream is first started.
+        double source_cpu_ms, filter_cpu_ms, sink_cpu_ms;
+    };
+
+    struct AcquireMetrics
+    {
+        struct AcquireStreamMetrics video[ACQUIRE_MAX_VIDEO_STREAMS];
+
+        /// Log messages dropped because the queue was full while logging
+        /// asynchronously. See acquire_set_async_logging().
+        uint64_t dropped_log_messages;
+    };
+
+    /// @brief Samples the counters of every video stream at once, for
+    /// exporting to a monitoring system.
+    /// @details Cheap enough to poll: the counters are kept by the stream
+    /// threads anyway and only read here. Safe to call while the runtime is
+    /// running. Each counter is read on its own, so they may not all describe
+    /// exactly the same moment.
+    enum AcquireStatusCode acquire_get_metrics(
+      const struct AcquireRuntime* self,
+      struct AcquireMetrics* metrics);
+
+    /// @brief Records a timeline of what each stream's threads spend their
+    /// time on, and writes it to `path` as a Chrome trace (JSON) at each
+    /// acquire_stop().
+    /// @details The trace can be opened with chrome://tracing or Perfetto.
+    /// It covers the camera, waits for room in a queue, the filter stages
+    /// and appends to storage. Each file holds the last acquisition only,
+    /// and each thread keeps its last `events_per_thread` events. Pass a
+    /// NULL `path` to stop tracing. Not allowed while the runtime is
+    /// running.
+    enum AcquireStatusCode acquire_set_trace(struct AcquireRuntime* self,
+                                             const char* path,
+                                             uint32_t events_per_thread);
+
+    /// @brief Reports log messages from a background thread instead of from
+    /// the thread that logs them.
+    /// @details While on, the stream threads only copy each message's format
+    /// and arguments into a lock-free queue. A background thread formats them
+    /// and calls the reporter every few milliseconds, so the reporter is no
+    /// longer called from the stream threads and messages arrive a little
+    /// late. Messages that find the queue full are dropped instead of
+    /// blocking, and counted in `AcquireMetrics::dropped_log_messages`.
+    /// Turning it off, or acquire_shutdown(), reports what's still queued.
+    /// Only one runtime at a time should log asynchronously.
+    enum AcquireStatusCode acquire_set_async_logging(
+      struct AcquireRuntime* self,
+      uint8_t enable);
+
 #ifdef __cplusplus
 }
 #endif
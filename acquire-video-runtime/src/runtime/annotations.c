@@ -0,0 +1,340 @@
+#include "annotations.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Size of the channel of records. Holds seconds of small records at kHz
+/// rates, so pushes only fail when storage stalls for longer.
+#define ANNOTATION_CHANNEL_CAPACITY_BYTES (1ULL << 20)
+
+static size_t
+align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+static const struct VideoFrame*
+next_frame(const struct VideoFrame* cur)
+{
+    return (const struct VideoFrame*)((const uint8_t*)cur +
+                                      cur->bytes_of_frame);
+}
+
+static uint64_t
+key_of_frame(const struct VideoFrame* frame, uint32_t join)
+{
+    return join == FrameAnnotationJoin_Timestamp ? frame->timestamps.acq_thread
+                                                 : frame->frame_id;
+}
+
+static uint64_t
+key_of_annotation(const struct FrameAnnotation* annotation)
+{
+    return annotation->join == FrameAnnotationJoin_Timestamp
+             ? annotation->timestamp
+             : annotation->frame_id;
+}
+
+void
+video_annotations_init(struct video_annotations_s* self, uint8_t stream_id)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->stream_id = stream_id;
+    lock_init(&self->lock);
+    channel_new(&self->records, 0);
+}
+
+void
+video_annotations_destroy(struct video_annotations_s* self)
+{
+    channel_release(&self->records);
+}
+
+enum DeviceStatusCode
+video_annotations_start(struct video_annotations_s* self)
+{
+    CHECK(channel_reserve(&self->records, ANNOTATION_CHANNEL_CAPACITY_BYTES));
+    // Registers the reader, so pushes can tell how much room is left.
+    channel_read_map(&self->records, &self->reader);
+    channel_read_unmap(&self->records, &self->reader, 0);
+    self->has_logged_unsupported = 0;
+    store_relaxed(&self->stored, 0);
+    store_relaxed(&self->dropped, 0);
+    lock_acquire(&self->lock);
+    store_relaxed(&self->pushed, 0);
+    self->is_accepting = 1;
+    lock_release(&self->lock);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_annotations_stop(struct video_annotations_s* self)
+{
+    lock_acquire(&self->lock);
+    self->is_accepting = 0;
+    lock_release(&self->lock);
+
+    uint64_t n = 0;
+    struct slice s = { 0 };
+    do {
+        s = channel_read_map(&self->records, &self->reader);
+        for (const uint8_t* cur = s.beg; cur < s.end;
+             cur += ((const struct FrameAnnotation*)cur)->bytes_of_annotation)
+            ++n;
+        channel_read_unmap(&self->records, &self->reader, s.end - s.beg);
+    } while (s.end > s.beg);
+    if (n) {
+        LOG("[stream %d] ANNOTATIONS: Dropped %llu records no frame was "
+            "stored for.",
+            (int)self->stream_id,
+            (unsigned long long)n);
+        store_relaxed(&self->dropped, self->dropped + n);
+    }
+}
+
+enum DeviceStatusCode
+video_annotations_push(struct video_annotations_s* self,
+                       enum FrameAnnotationJoin join,
+                       uint64_t key,
+                       uint32_t tag,
+                       const void* data,
+                       size_t nbytes)
+{
+    EXPECT((unsigned)join < FrameAnnotationJoinCount,
+           "[stream %d] ANNOTATIONS: Unknown join %d.",
+           (int)self->stream_id,
+           (int)join);
+    EXPECT(nbytes <= ANNOTATION_MAX_BYTES_OF_DATA,
+           "[stream %d] ANNOTATIONS: Records carry at most %d bytes. Got "
+           "%llu.",
+           (int)self->stream_id,
+           ANNOTATION_MAX_BYTES_OF_DATA,
+           (unsigned long long)nbytes);
+    CHECK(data || !nbytes);
+
+    const size_t bytes_of_annotation =
+      align8(sizeof(struct FrameAnnotation) + nbytes);
+    lock_acquire(&self->lock);
+    const uint8_t is_accepting = self->is_accepting;
+    // The writer may leave up to a record's worth unused at the end of the
+    // buffer when it wraps, so the record surely fits without waiting.
+    struct FrameAnnotation* annotation =
+      is_accepting && channel_bytes_unread(&self->records, &self->reader) +
+                          2 * bytes_of_annotation <=
+                        self->records.capacity
+        ? channel_write_map(&self->records, bytes_of_annotation)
+        : 0;
+    if (annotation) {
+        *annotation = (struct FrameAnnotation){
+            .bytes_of_annotation = (uint32_t)bytes_of_annotation,
+            .bytes_of_data = (uint32_t)nbytes,
+            .frame_id = join == FrameAnnotationJoin_FrameId ? key : 0,
+            .timestamp =
+              join == FrameAnnotationJoin_Timestamp ? key : clock_tic(0),
+            .tag = tag,
+            .join = join,
+        };
+        if (nbytes)
+            memcpy(annotation->data, data, nbytes); // NOLINT
+        channel_write_unmap(&self->records);
+        store_relaxed(&self->pushed, self->pushed + 1);
+    }
+    lock_release(&self->lock);
+    EXPECT(is_accepting,
+           "[stream %d] ANNOTATIONS: The stream isn't running.",
+           (int)self->stream_id);
+    EXPECT(annotation,
+           "[stream %d] ANNOTATIONS: No room for more records.",
+           (int)self->stream_id);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+video_annotations_join(struct video_annotations_s* self,
+                       const struct VideoFrame* beg,
+                       const struct VideoFrame* end,
+                       struct Storage* storage)
+{
+    if (beg >= end)
+        return 1;
+    const struct VideoFrame* last = beg;
+    for (const struct VideoFrame* cur = beg; cur < end; cur = next_frame(cur))
+        last = cur;
+
+    // The frame each kind of record was last joined to. Records come in the
+    // order they were pushed, so these only move forward.
+    const struct VideoFrame* joined[FrameAnnotationJoinCount] = { beg, beg };
+    for (;;) {
+        const struct slice s = channel_read_map(&self->records, &self->reader);
+        uint8_t* cur = s.beg;
+        uint64_t n = 0;
+        while (cur < s.end) {
+            struct FrameAnnotation* annotation = (struct FrameAnnotation*)cur;
+            const uint64_t key = key_of_annotation(annotation);
+            if (key_of_frame(last, annotation->join) < key)
+                break;
+            const struct VideoFrame** frame = joined + annotation->join;
+            while (key_of_frame(*frame, annotation->join) < key)
+                *frame = next_frame(*frame);
+            annotation->frame_id = (*frame)->frame_id;
+            cur += annotation->bytes_of_annotation;
+            ++n;
+        }
+
+        const size_t nbytes = cur - s.beg;
+        int is_ok = 1;
+        if (nbytes && storage_supports_annotations(storage)) {
+            is_ok = storage_append_annotations(
+                      storage,
+                      (const struct FrameAnnotation*)s.beg,
+                      nbytes) == Device_Ok;
+            store_relaxed(&self->stored, self->stored + n);
+        } else if (nbytes) {
+            if (!self->has_logged_unsupported) {
+                LOG("[stream %d] ANNOTATIONS: Storage doesn't take "
+                    "annotations. Dropping them.",
+                    (int)self->stream_id);
+                self->has_logged_unsupported = 1;
+            }
+            store_relaxed(&self->dropped, self->dropped + n);
+        }
+        channel_read_unmap(&self->records, &self->reader, nbytes);
+        EXPECT(is_ok,
+               "[stream %d] ANNOTATIONS: Storage failed to append %llu "
+               "records.",
+               (int)self->stream_id,
+               (unsigned long long)n);
+        // More may follow where the writer wrapped.
+        if (!nbytes || cur < s.end)
+            return 1;
+    }
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Collects what video_annotations_join() appends.
+struct annotation_sink
+{
+    struct Storage storage;
+    uint64_t frame_ids[8];
+    uint32_t tags[8];
+    size_t n;
+};
+
+static enum DeviceState
+annotation_sink_append(struct Storage* self_,
+                       const struct FrameAnnotation* annotations,
+                       size_t nbytes)
+{
+    struct annotation_sink* self = (struct annotation_sink*)self_;
+    const uint8_t* const end = (const uint8_t*)annotations + nbytes;
+    for (const uint8_t* cur = (const uint8_t*)annotations; cur < end;
+         cur += ((const struct FrameAnnotation*)cur)->bytes_of_annotation) {
+        const struct FrameAnnotation* a = (const struct FrameAnnotation*)cur;
+        if (self->n < 8) {
+            self->frame_ids[self->n] = a->frame_id;
+            self->tags[self->n] = a->tag;
+        }
+        ++self->n;
+    }
+    return DeviceState_Running;
+}
+
+/// Records are joined to the first frame at or after them, wait for their
+/// frame, and go with the next frame when theirs has already been stored.
+int
+unit_test__annotations_join_frames()
+{
+    static struct video_annotations_s annotations;
+    struct annotation_sink sink = {
+        .storage = { .state = DeviceState_Running,
+                     .append_annotations = annotation_sink_append },
+    };
+    struct VideoFrame frames[4] = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        frames[i].bytes_of_frame = sizeof(frames[i]);
+        frames[i].frame_id = 10 + i;
+        frames[i].timestamps.acq_thread = 1000 * (i + 1);
+    }
+    const char payload[] = "stimulus";
+    video_annotations_init(&annotations, 0);
+    CHECK(video_annotations_push(
+            &annotations, FrameAnnotationJoin_FrameId, 11, 0, 0, 0) ==
+          Device_Err);
+    CHECK(video_annotations_start(&annotations) == Device_Ok);
+
+    CHECK(video_annotations_push(&annotations,
+                                 FrameAnnotationJoin_FrameId,
+                                 11,
+                                 1,
+                                 payload,
+                                 sizeof(payload)) == Device_Ok);
+    CHECK(video_annotations_push(&annotations,
+                                 FrameAnnotationJoin_Timestamp,
+                                 1500,
+                                 2,
+                                 0,
+                                 0) == Device_Ok);
+    CHECK(video_annotations_push(&annotations,
+                                 FrameAnnotationJoin_Timestamp,
+                                 3500,
+                                 3,
+                                 0,
+                                 0) == Device_Ok);
+
+    // Frames 10 and 11 take the first two. The third waits for frame 13.
+    CHECK(video_annotations_join(
+      &annotations, frames, frames + 2, &sink.storage));
+    CHECK(sink.n == 2);
+    CHECK(sink.frame_ids[0] == 11 && sink.tags[0] == 1);
+    CHECK(sink.frame_ids[1] == 11 && sink.tags[1] == 2);
+
+    // Late for frame 11, so joined to the next one stored.
+    CHECK(video_annotations_push(
+            &annotations, FrameAnnotationJoin_FrameId, 11, 4, 0, 0) ==
+          Device_Ok);
+    CHECK(video_annotations_join(
+      &annotations, frames + 2, frames + 4, &sink.storage));
+    CHECK(sink.n == 4);
+    CHECK(sink.frame_ids[2] == 13 && sink.tags[2] == 3);
+    CHECK(sink.frame_ids[3] == 12 && sink.tags[3] == 4);
+
+    // Never stored, so dropped.
+    CHECK(video_annotations_push(
+            &annotations, FrameAnnotationJoin_FrameId, 99, 5, 0, 0) ==
+          Device_Ok);
+    CHECK(video_annotations_join(
+      &annotations, frames + 3, frames + 4, &sink.storage));
+    video_annotations_stop(&annotations);
+    CHECK(annotations.pushed == 5);
+    CHECK(annotations.stored == 4);
+    CHECK(annotations.dropped == 1);
+    CHECK(video_annotations_push(
+            &annotations, FrameAnnotationJoin_FrameId, 11, 0, 0, 0) ==
+          Device_Err);
+    video_annotations_destroy(&annotations);
+    return 1;
+Error:
+    video_annotations_destroy(&annotations);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,103 @@
+//! Client records stored with the frames they describe, like the stimulus
+//! shown or where the stage was, pushed at up to kHz rates.
+//!
+//! The client pushes each record, a `FrameAnnotation`, into a channel of its
+//! own. As the sink hands frames to storage, it joins the records that are
+//! due to them and hands storage the records straight from the channel, so
+//! a record is copied once, when it's pushed. Records are joined in the
+//! order they were pushed: one that isn't due yet holds back those after it.
+//!
+//! A record joined by frame id is due once a frame with that id or a later
+//! one is stored. A record joined by timestamp is due once a frame that
+//! reached the runtime at or after it is stored. Either goes with the first
+//! such frame, but never with a frame stored before it was pushed, nor with
+//! one before the frame the last record of its kind went with. Records no
+//! frame is stored for are dropped when the stream stops.
+
+#ifndef H_ACQUIRE_RUNTIME_ANNOTATIONS_V0
+#define H_ACQUIRE_RUNTIME_ANNOTATIONS_V0
+
+#include "channel.h"
+#include "platform.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+#include "device/hal/storage.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Most bytes of data a record may carry.
+#define ANNOTATION_MAX_BYTES_OF_DATA (4096)
+
+    struct video_annotations_s
+    {
+        uint8_t stream_id;
+
+        /// Serializes pushes, since the channel has a single writer, and
+        /// guards `is_accepting`.
+        struct lock lock;
+        uint8_t is_accepting;
+
+        /// Records, written by video_annotations_push() and read by the
+        /// sink thread, which fills in their `frame_id` as it joins them.
+        struct channel records;
+        struct channel_reader reader;
+
+        /// Set once dropping records for storage that doesn't take them has
+        /// been logged. Only touched by the sink thread.
+        uint8_t has_logged_unsupported;
+
+        /// Records pushed, handed to storage and dropped since the stream
+        /// was started. Written with relaxed stores: `pushed` under `lock`,
+        /// the others by the sink thread.
+        uint64_t pushed;
+        uint64_t stored;
+        uint64_t dropped;
+    };
+
+    void video_annotations_init(struct video_annotations_s* self,
+                                uint8_t stream_id);
+
+    void video_annotations_destroy(struct video_annotations_s* self);
+
+    /// @brief Empties the channel, resets the counters and starts accepting
+    /// records.
+    enum DeviceStatusCode video_annotations_start(
+      struct video_annotations_s* self);
+
+    /// @brief Stops accepting records, and drops those left in the channel.
+    /// Call once the sink has stored its last frame.
+    void video_annotations_stop(struct video_annotations_s* self);
+
+    /// @brief Queues a record of `nbytes` bytes of `data`, joined as `join`
+    /// says by `key`, a frame id or a timestamp.
+    /// @details Fails instead of waiting when the channel is too full, and
+    /// while the stream isn't running. Safe to call from any thread.
+    enum DeviceStatusCode video_annotations_push(
+      struct video_annotations_s* self,
+      enum FrameAnnotationJoin join,
+      uint64_t key,
+      uint32_t tag,
+      const void* data,
+      size_t nbytes);
+
+    /// @brief Joins the records due by the last of the frames in `[beg,end)`
+    /// to those frames, and appends them to `storage`.
+    /// @details Only call this from the sink thread, before appending the
+    /// frames. Records are dropped when `storage` doesn't take them.
+    /// @returns 1 on success, or 0 if storage failed to append them.
+    int video_annotations_join(struct video_annotations_s* self,
+                               const struct VideoFrame* beg,
+                               const struct VideoFrame* end,
+                               struct Storage* storage);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_RUNTIME_ANNOTATIONS_V0
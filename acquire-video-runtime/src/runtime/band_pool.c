@@ -0,0 +1,213 @@
+#include "band_pool.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+static void
+worker_main(struct band_pool_worker* self)
+{
+    struct band_pool* const pool = self->pool;
+    struct thread_attributes attributes = pool->attributes;
+    if (attributes.name[0]) {
+        // "acq-filter-0" becomes "acq-filter-0.1" for the first worker.
+        char name[sizeof(attributes.name) + 8] = { 0 };
+        snprintf(
+          name, sizeof(name), "%s.%u", pool->attributes.name, self->index + 1);
+        memcpy(attributes.name, name, sizeof(attributes.name) - 1);
+    }
+    thread_set_current_attributes(&attributes);
+
+    size_t generation = 0;
+    lock_acquire(&pool->lock);
+    while (1) {
+        while (!pool->is_stopping && pool->generation == generation)
+            condition_variable_wait(&pool->notify_work, &pool->lock);
+        if (pool->is_stopping)
+            break;
+        generation = pool->generation;
+        const band_pool_fn fn = pool->job.fn;
+        void* const ctx = pool->job.ctx;
+        const size_t beg = pool->job.bounds[self->index + 1];
+        const size_t end = pool->job.bounds[self->index + 2];
+        lock_release(&pool->lock);
+
+        if (beg < end)
+            fn(ctx, beg, end);
+
+        lock_acquire(&pool->lock);
+        if (--pool->remaining == 0)
+            condition_variable_notify_all(&pool->notify_done);
+    }
+    lock_release(&pool->lock);
+}
+
+void
+band_pool_start(struct band_pool* self,
+                unsigned nthreads,
+                const struct thread_attributes* attributes)
+{
+    memset(self, 0, sizeof(*self));
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify_work);
+    condition_variable_init(&self->notify_done);
+    if (attributes)
+        self->attributes = *attributes;
+
+    nthreads = min(nthreads, BAND_POOL_MAX_THREADS);
+    self->nthreads = nthreads;
+    self->is_started = 1;
+    for (unsigned i = 0; i + 1 < nthreads; ++i) {
+        struct band_pool_worker* const worker = self->workers + i;
+        *worker = (struct band_pool_worker){ .pool = self, .index = i };
+        thread_init(&worker->thread);
+        if (!thread_create(
+              &worker->thread, (void (*)(void*))worker_main, worker)) {
+            LOGE("Could only start %u of %u band workers.", i, nthreads - 1);
+            break;
+        }
+        ++self->nworkers;
+    }
+}
+
+void
+band_pool_ensure(struct band_pool* self,
+                 unsigned nthreads,
+                 const struct thread_attributes* attributes)
+{
+    nthreads = min(nthreads, BAND_POOL_MAX_THREADS);
+    if (self->is_started && self->nthreads == nthreads)
+        return;
+    band_pool_stop(self);
+    band_pool_start(self, nthreads, attributes);
+}
+
+void
+band_pool_stop(struct band_pool* self)
+{
+    if (!self->is_started)
+        return;
+    lock_acquire(&self->lock);
+    self->is_stopping = 1;
+    condition_variable_notify_all(&self->notify_work);
+    lock_release(&self->lock);
+    for (unsigned i = 0; i < self->nworkers; ++i)
+        thread_join(&self->workers[i].thread);
+    self->nworkers = 0;
+    self->is_started = 0;
+}
+
+void
+band_pool_run(struct band_pool* self,
+              band_pool_fn fn,
+              void* ctx,
+              size_t n,
+              size_t granule)
+{
+    granule = granule ? granule : 1;
+    const size_t ngranules = (n + granule - 1) / granule;
+    const size_t nbands = min(ngranules, (size_t)self->nworkers + 1);
+    if (nbands <= 1) {
+        if (n)
+            fn(ctx, 0, n);
+        return;
+    }
+
+    lock_acquire(&self->lock);
+    self->job.fn = fn;
+    self->job.ctx = ctx;
+    // Workers past the last band get an empty one.
+    for (size_t i = 0; i <= self->nworkers + 1; ++i) {
+        const size_t k = min(i, nbands);
+        self->job.bounds[i] = min(n, granule * ((ngranules * k) / nbands));
+    }
+    self->remaining = self->nworkers;
+    ++self->generation;
+    condition_variable_notify_all(&self->notify_work);
+    lock_release(&self->lock);
+
+    fn(ctx, self->job.bounds[0], self->job.bounds[1]);
+
+    lock_acquire(&self->lock);
+    while (self->remaining)
+        condition_variable_wait(&self->notify_done, &self->lock);
+    lock_release(&self->lock);
+}
+
+#ifndef NO_UNIT_TESTS
+
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+struct band_pool_test
+{
+    uint8_t hits[1000];
+    /// Set at the start of each band.
+    uint8_t starts[1000];
+};
+
+static void
+mark_band(struct band_pool_test* ctx, size_t beg, size_t end)
+{
+    ctx->starts[beg] = 1;
+    for (size_t i = beg; i < end; ++i)
+        ++ctx->hits[i];
+}
+
+/// Every item is visited exactly once, bands start on a granule boundary,
+/// and jobs smaller than one granule run on the caller.
+int
+unit_test__band_pool_covers_every_item_once()
+{
+    static struct band_pool pool;
+    static struct band_pool_test test;
+    const size_t sizes[] = { 0, 1, 6, 7, 8, 50, 999, 1000 };
+    const unsigned nthreads[] = { 1, 3, BAND_POOL_MAX_THREADS + 1 };
+
+    for (size_t t = 0; t < sizeof(nthreads) / sizeof(nthreads[0]); ++t) {
+        band_pool_start(&pool, nthreads[t], 0);
+        CHECK(pool.nworkers == min(nthreads[t], BAND_POOL_MAX_THREADS) - 1);
+        for (int repeat = 0; repeat < 20; ++repeat) {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+                const size_t n = sizes[s];
+                memset(&test, 0, sizeof(test));
+                band_pool_run(&pool, (band_pool_fn)mark_band, &test, n, 7);
+                for (size_t i = 0; i < n; ++i) {
+                    CHECK(test.hits[i] == 1);
+                    CHECK(!test.starts[i] || i % 7 == 0);
+                }
+                for (size_t i = n; i < sizeof(test.hits); ++i)
+                    CHECK(test.hits[i] == 0);
+            }
+        }
+        band_pool_stop(&pool);
+    }
+
+    // Keeping a pool across runs only restarts it when the count changes.
+    band_pool_ensure(&pool, 3, 0);
+    CHECK(pool.is_started && pool.nworkers == 2);
+    memset(&test, 0, sizeof(test));
+    band_pool_run(&pool, (band_pool_fn)mark_band, &test, 1000, 7);
+    CHECK(pool.generation == 1);
+    band_pool_ensure(&pool, 3, 0);
+    CHECK(pool.generation == 1);
+    band_pool_ensure(&pool, 2, 0);
+    CHECK(pool.nworkers == 1 && pool.generation == 0);
+    band_pool_stop(&pool);
+    CHECK(!pool.is_started);
+    band_pool_stop(&pool);
+    return 1;
+Error:
+    band_pool_stop(&pool);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,115 @@
+//! A small pool of threads that split a loop over rows of pixels into bands.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     struct band_pool pool;
+//!     band_pool_start(&pool, 4, &attributes);
+//!     band_pool_run(&pool, scale_rows, &job, width * height, width);
+//!     band_pool_stop(&pool);
+//! ~~~
+//!
+//! The thread calling band_pool_run() works on the first band itself and
+//! returns once every band is done, so whatever the job wrote is visible to
+//! it afterwards.  Only one thread may call band_pool_run() at a time.
+
+#ifndef H_ACQUIRE_BAND_POOL_V0
+#define H_ACQUIRE_BAND_POOL_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Most threads a pool can split work across, counting the caller.
+#define BAND_POOL_MAX_THREADS (8)
+
+    /// Processes items `[beg,end)` of a job.
+    typedef void (*band_pool_fn)(void* ctx, size_t beg, size_t end);
+
+    struct band_pool;
+
+    struct band_pool_worker
+    {
+        struct band_pool* pool;
+        struct thread thread;
+        unsigned index;
+    };
+
+    struct band_pool
+    {
+        struct lock lock;
+        struct condition_variable notify_work;
+        struct condition_variable notify_done;
+
+        /// Threads besides the caller.
+        struct band_pool_worker workers[BAND_POOL_MAX_THREADS - 1];
+        unsigned nworkers;
+
+        /// Applied by each worker when it starts, with its index appended to
+        /// the name.
+        struct thread_attributes attributes;
+
+        /// Incremented for each job so workers can tell a new one arrived.
+        size_t generation;
+        /// Number of workers still working on the current job.
+        unsigned remaining;
+        uint8_t is_stopping;
+
+        /// Set by band_pool_start() and cleared by band_pool_stop().
+        uint8_t is_started;
+        /// Threads asked for by band_pool_start(), after capping.
+        unsigned nthreads;
+
+        struct
+        {
+            band_pool_fn fn;
+            void* ctx;
+            /// Start of each band. Band `i` ends where band `i + 1` starts.
+            size_t bounds[BAND_POOL_MAX_THREADS + 1];
+        } job;
+    };
+
+    /// @brief Starts `nthreads - 1` workers, so jobs are split across
+    /// `nthreads` threads including the caller of band_pool_run().
+    /// @details A pool with `nthreads` of 0 or 1 runs every job on the
+    /// caller. `nthreads` is capped at BAND_POOL_MAX_THREADS.  If a worker
+    /// can't be started the pool makes do with the ones that did.
+    /// @param[in] attributes May be NULL.
+    void band_pool_start(struct band_pool* self,
+                         unsigned nthreads,
+                         const struct thread_attributes* attributes);
+
+    /// @brief Starts the pool unless it's already running with `nthreads`
+    /// threads, restarting it if it has a different number.
+    /// @details Lets a pool be kept across runs of the thread that owns it.
+    void band_pool_ensure(struct band_pool* self,
+                          unsigned nthreads,
+                          const struct thread_attributes* attributes);
+
+    /// @brief Stops and joins the workers.
+    /// @details Does nothing if the pool isn't started, including a pool
+    /// that was only zeroed.
+    void band_pool_stop(struct band_pool* self);
+
+    /// @brief Calls `fn` on bands of `[0,n)` across the pool and waits for
+    /// all of them to finish.
+    /// @details Band boundaries are multiples of `granule`, for example the
+    /// number of pixels in a row, so each band is a run of whole rows. There
+    /// are never more bands than granules.
+    void band_pool_run(struct band_pool* self,
+                       band_pool_fn fn,
+                       void* ctx,
+                       size_t n,
+                       size_t granule);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_BAND_POOL_V0
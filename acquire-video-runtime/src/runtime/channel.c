@@ -1,13 +1,86 @@
 #include "channel.h"
+#include "logger.h"
+#include "device/props/components.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
 #define countof(e) (sizeof(e) / sizeof((e)[0]))
-#define MAX_READERS countof(((struct channel*)0)->holds.pos) //(1 << 3)
+#define CURSORS_PER_BLOCK countof(((struct channel_cursors*)0)->cursors)
 
 #ifndef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
 #endif
 
+/// How often the writer looks at readers in other processes while it waits
+/// for space. They can't wake it.
+#define SHARED_WRITER_POLL_MS (1)
+
+//
+//  Writer state and reader cursors
+//
+
+struct writer_state
+{
+    size_t head, high, cycle, last, writes, cycle_writes;
+};
+
+/// Set on the cursor of a lossy reader that isn't holding a mapped region.
+/// reader_min() skips these, so the writer is free to overrun them.
+#define CURSOR_IGNORED (1ULL << 63)
+
+/// Marks a slot left behind by a detached reader. It's ignored like a lossy
+/// reader's cursor until it's handed to a new reader.
+#define CURSOR_FREE (~0ULL)
+
+/// Readers' cursors are packed into a single word so the writer always sees a
+/// consistent (cycle, pos) pair. Positions range over [0, capacity], so
+/// comparing packed cursors is the same as comparing (cycle, pos)
+/// lexicographically.
+static uint64_t
+cursor_pack(const struct channel* self, size_t pos, size_t cycle)
+{
+    return (uint64_t)cycle * (self->capacity + 1) + pos;
+}
+
+static void
+cursor_unpack(const struct channel* self,
+              uint64_t cursor,
+              size_t* pos,
+              size_t* cycle)
+{
+    cursor &= ~CURSOR_IGNORED;
+    *cycle = (size_t)(cursor / (self->capacity + 1));
+    *pos = (size_t)(cursor % (self->capacity + 1));
+}
+
+/// A reader sitting at the high-water mark of the previous cycle has consumed
+/// everything in that cycle, which is the same as sitting at the start of the
+/// writer's current cycle.
+///
+/// This replaces having the writer rewrite every reader's cursor when it
+/// wraps, so only readers ever store to their cursors.
+static void
+cursor_normalize(const struct writer_state* w, size_t* pos, size_t* cycle)
+{
+    if (*cycle + 1 == w->cycle && *pos == w->high) {
+        *pos = 0;
+        *cycle = w->cycle;
+    }
+}
+
 static int
 cursor_cmp(size_t cycle_a, size_t pos_a, size_t cycle_b, size_t pos_b)
 {
@@ -22,53 +95,198 @@ cursor_cmp(size_t cycle_a, size_t pos_a, size_t cycle_b, size_t pos_b)
     return 0;
 }
 
-static uint32_t
-reader_min(const size_t* tails, const size_t* cycles, uint32_t n)
-{
-    struct
-    {
-        size_t tail, cycle;
-    } mn = {
-        .tail = tails[0],
-        .cycle = cycles[0],
+/// Readers take a consistent snapshot of the writer's state. They retry if the
+/// writer was updating it at the same time.
+static struct writer_state
+writer_snapshot(const struct channel* self)
+{
+    struct writer_state out;
+    size_t s0, s1;
+    do {
+        while ((s0 = load_acquire(&self->seq)) & 1)
+            cpu_relax();
+        out.head = load_relaxed(&self->head);
+        out.high = load_relaxed(&self->high);
+        out.cycle = load_relaxed(&self->cycle);
+        out.last = load_relaxed(&self->last);
+        out.writes = load_relaxed(&self->writes);
+        out.cycle_writes = load_relaxed(&self->cycle_writes);
+        fence_acquire();
+        s1 = load_relaxed(&self->seq);
+    } while (s0 != s1);
+    return out;
+}
+
+/// Only called by the writer, which can read its own state without the
+/// sequence counter.
+static struct writer_state
+writer_current(const struct channel* self)
+{
+    return (struct writer_state){
+        .head = self->head,
+        .high = self->high,
+        .cycle = self->cycle,
+        .last = self->last,
+        .writes = self->writes,
+        .cycle_writes = self->cycle_writes,
     };
-    uint32_t argmin = 0;
-    for (uint32_t i = 1; i < n; ++i) {
-        if (cursor_cmp(mn.cycle, mn.tail, cycles[i], tails[i]) == 1) {
-            mn.tail = tails[i];
-            mn.cycle = cycles[i];
-            argmin = i;
-        }
+}
+
+/// Mirrors the writer's state for readers in other processes, the same way
+/// writer_publish() does for readers in this one.
+static void
+shared_writer_publish(struct shared_channel* shared,
+                      const struct writer_state* w)
+{
+    const uint64_t s = shared->writer.seq;
+    store_relaxed(&shared->writer.seq, s + 1);
+    fence_release();
+    store_relaxed(&shared->writer.head, (uint64_t)w->head);
+    store_relaxed(&shared->writer.high, (uint64_t)w->high);
+    store_relaxed(&shared->writer.cycle, (uint64_t)w->cycle);
+    store_relaxed(&shared->writer.last, (uint64_t)w->last);
+    store_relaxed(&shared->writer.writes, (uint64_t)w->writes);
+    store_relaxed(&shared->writer.cycle_writes, (uint64_t)w->cycle_writes);
+    store_release(&shared->writer.seq, s + 2);
+}
+
+/// Only called by the writer.
+static void
+writer_publish(struct channel* self, const struct writer_state* w)
+{
+    const size_t s = self->seq;
+    store_relaxed(&self->seq, s + 1);
+    fence_release();
+    store_relaxed(&self->head, w->head);
+    store_relaxed(&self->high, w->high);
+    store_relaxed(&self->cycle, w->cycle);
+    store_relaxed(&self->last, w->last);
+    store_relaxed(&self->writes, w->writes);
+    store_relaxed(&self->cycle_writes, w->cycle_writes);
+    store_release(&self->seq, s + 2);
+    if (self->shared.header)
+        shared_writer_publish(self->shared.header, w);
+}
+
+/// Keeps the writer out of channel_write_map()'s fast path, and out of its slow
+/// path by holding the lock, until writer_resume().
+static void
+writer_pause(struct channel* self)
+{
+    lock_acquire(&self->lock);
+    store_relaxed(&self->is_pausing_writer, 1);
+    // Pairs with the fence in channel_write_map(): either the writer sees
+    // this, or this waits for the writer to finish choosing a region.
+    fence_seq_cst();
+    while (load_relaxed(&self->is_writer_busy))
+        cpu_relax();
+}
+
+static void
+writer_resume(struct channel* self)
+{
+    store_release(&self->is_pausing_writer, 0);
+    lock_release(&self->lock);
+}
+
+/// Moves (`tail`, `tail_cycle`) back to `cursor` when it's older, or to it
+/// when it's the first of `*count` cursors seen.
+static void
+tail_update(const struct channel* self,
+            const struct writer_state* w,
+            uint64_t cursor,
+            unsigned* count,
+            size_t* tail,
+            size_t* tail_cycle)
+{
+    size_t pos, cycle;
+    cursor_unpack(self, cursor, &pos, &cycle);
+    cursor_normalize(w, &pos, &cycle);
+    if (!(*count)++ || cursor_cmp(cycle, pos, *tail_cycle, *tail) < 0) {
+        *tail = pos;
+        *tail_cycle = cycle;
     }
-    return argmin;
+}
+
+/// Finds the oldest cursor the writer has to wait for, including those of
+/// active readers in other processes.
+/// @returns The number of readers holding the writer back. When 0, `tail` and
+///          `tail_cycle` are left untouched.
+static unsigned
+reader_min(const struct channel* self,
+           const struct writer_state* w,
+           unsigned n,
+           size_t* tail,
+           size_t* tail_cycle)
+{
+    unsigned count = 0;
+    const struct channel_cursors* block = self->holds.blocks;
+    for (unsigned i = 0; i < n; ++i) {
+        if (i && i % CURSORS_PER_BLOCK == 0)
+            block = block->next;
+        const uint64_t cursor =
+          load_acquire(&block->cursors[i % CURSORS_PER_BLOCK].value);
+        if (cursor & CURSOR_IGNORED)
+            continue;
+        tail_update(self, w, cursor, &count, tail, tail_cycle);
+    }
+
+    const struct shared_channel* shared = self->shared.header;
+    for (unsigned i = 0; shared && i < SHARED_CHANNEL_MAX_READERS; ++i) {
+        const struct shared_channel_reader* r = shared->readers + i;
+        if ((load_acquire(&r->state) & SHARED_READER_STATE_MASK) !=
+            SharedReader_Active)
+            continue;
+        tail_update(
+          self, w, load_acquire(&r->cursor), &count, tail, tail_cycle);
+    }
+    return count;
+}
+
+/// Bytes written after the cursor (pos, cycle) that haven't been overwritten.
+static size_t
+bytes_after(const struct writer_state* w, size_t pos, size_t cycle)
+{
+    if (cycle == w->cycle && pos <= w->head)
+        return w->head - pos;
+    if (cycle + 1 == w->cycle && pos <= w->high)
+        return (w->high - pos) + w->head;
+    return 0;
+}
+
+/// Bytes the writer can't reuse until the readers holding it back move on.
+static size_t
+occupancy(const struct channel* self, const struct writer_state* w)
+{
+    size_t tail = 0, tail_cycle = 0;
+    const unsigned n = load_acquire(&self->holds.n);
+    if (!reader_min(self, w, n, &tail, &tail_cycle))
+        return 0;
+    return bytes_after(w, tail, tail_cycle);
 }
 
 static uint32_t
 next_write(const struct channel* self,
+           const struct writer_state* w,
+           size_t tail,
+           size_t tail_cycle,
            size_t nbytes,
-           size_t* beg,
-           uint8_t* should_wrap)
+           size_t* beg)
 {
-    *should_wrap = 0;
-
-    if (!self->is_accepting_writes)
+    if (!load_acquire(&self->is_accepting_writes))
         return 0;
 
-    const uint32_t argmin =
-      reader_min(self->holds.pos, self->holds.cycles, self->holds.n);
-    const size_t tail = self->holds.pos[argmin];
-
-    if (self->head < tail) {
-        *beg = self->head;
-        return nbytes <= (tail - self->head);
+    if (w->head < tail) {
+        *beg = w->head;
+        return nbytes <= (tail - w->head);
     }
 
-    if (tail == self->head && (self->cycle == self->holds.cycles[argmin] + 1)) {
+    if (tail == w->head && (w->cycle == tail_cycle + 1)) {
         return 0;
     }
 
-    if (nbytes <= (self->capacity - self->head)) {
-        *beg = self->head;
+    if (nbytes <= (self->capacity - w->head)) {
+        *beg = w->head;
         return 1;
     }
 
@@ -77,26 +295,278 @@ next_write(const struct channel* self,
         return 1;
     }
 
-    if (tail == self->head) {
+    if (tail == w->head) {
         *beg = 0;
-        *should_wrap = 1;
         return nbytes < self->capacity;
     }
 
     return 0;
 }
 
+/// Finds where the next `nbytes` should go.
+/// The writer calls this either while `is_writer_busy` is set or while holding
+/// the lock, so the set of readers can't change underneath it.
+static int
+reserve(const struct channel* self, size_t nbytes, size_t* beg)
+{
+    const struct writer_state w = writer_current(self);
+    size_t tail = 0, tail_cycle = 0;
+    const unsigned n = load_acquire(&self->holds.n);
+    if (!reader_min(self, &w, n, &tail, &tail_cycle)) {
+        *beg = (w.head + nbytes > self->capacity) ? 0 : w.head;
+        return 1;
+    }
+    return next_write(self, &w, tail, tail_cycle, nbytes, beg);
+}
+
+static void*
+commit_reservation(struct channel* self, size_t beg, size_t nbytes)
+{
+    if (beg != self->head) {
+        struct writer_state w = writer_current(self);
+        store_relaxed(&self->stats.wasted_bytes,
+                      self->stats.wasted_bytes + (self->capacity - w.head));
+        w.high = w.head;
+        w.head = beg;
+        ++w.cycle;
+        w.cycle_writes = w.writes;
+        writer_publish(self, &w);
+    }
+    store_relaxed(&self->mapped, beg + nbytes);
+    return self->data + beg;
+}
+
+/// Starts readers in other processes that asked to join at the writer's head.
+/// Only called by the writer, before it chooses where its next write goes.
+static void
+shared_readers_admit(struct channel* self)
+{
+    struct shared_channel* shared = self->shared.header;
+    for (unsigned i = 0; i < SHARED_CHANNEL_MAX_READERS; ++i) {
+        struct shared_channel_reader* r = shared->readers + i;
+        uint64_t state = load_acquire(&r->state);
+        if ((state & SHARED_READER_STATE_MASK) != SharedReader_Joining)
+            continue;
+        store_relaxed(&r->cursor, cursor_pack(self, self->head, self->cycle));
+        store_relaxed(&r->writes, (uint64_t)self->writes);
+        // Fails when the reader left in the meantime, which is fine.
+        compare_exchange_acq_rel(
+          &r->state,
+          &state,
+          shared_reader_next_state(state, SharedReader_Active));
+    }
+}
+
+/// Frees the slots of readers in other processes that exited, or that haven't
+/// mapped for `SHARED_CHANNEL_READER_TIMEOUT_MS`, so they stop holding back
+/// the writer. Only called by the writer while it waits for space.
+static void
+shared_readers_reap(struct channel* self)
+{
+    struct shared_channel* shared = self->shared.header;
+    const uint64_t now = clock_tic(0);
+    for (unsigned i = 0; i < SHARED_CHANNEL_MAX_READERS; ++i) {
+        struct shared_channel_reader* r = shared->readers + i;
+        uint64_t state = load_acquire(&r->state);
+        if ((state & SHARED_READER_STATE_MASK) != SharedReader_Active)
+            continue;
+        const uint64_t pid = load_relaxed(&r->pid);
+        const int64_t idle_ns =
+          clock_tics_to_ns((int64_t)(now - load_relaxed(&r->heartbeat)));
+        const int is_alive = process_is_alive(pid);
+        if (is_alive && idle_ns < SHARED_CHANNEL_READER_TIMEOUT_MS * 1000000LL)
+            continue;
+        if (compare_exchange_acq_rel(
+              &r->state,
+              &state,
+              shared_reader_next_state(state, SharedReader_Free))) {
+            LOG("Dropped a reader in process %llu that %s.",
+                (unsigned long long)pid,
+                is_alive ? "stopped mapping" : "exited");
+        }
+    }
+}
+
+static uint64_t
+cursor_flags(const struct channel_reader* reader)
+{
+    return reader->is_lossy ? CURSOR_IGNORED : 0;
+}
+
+/// Allocates a zeroed block of cursors starting on a cache line boundary, so
+/// each padded cursor has a line to itself.
+static struct channel_cursors*
+cursor_block_alloc()
+{
+    const size_t align = CHANNEL_CACHE_LINE_BYTES;
+    uint8_t* allocation = 0;
+    EXPECT(allocation = malloc(sizeof(struct channel_cursors) + align - 1),
+           "Failed to allocate %llu bytes for reader cursors.",
+           (unsigned long long)sizeof(struct channel_cursors));
+    struct channel_cursors* block =
+      (struct channel_cursors*)(((uintptr_t)allocation + align - 1) &
+                                ~(uintptr_t)(align - 1));
+    *block = (struct channel_cursors){ .allocation = allocation };
+    return block;
+Error:
+    return 0;
+}
+
+/// Registers `reader` with the channel the first time it's used.
+///
+/// New readers start at the beginning of the writer's current cycle, so they
+/// see everything that's been written since the last wrap. That region is only
+/// safe to hand out if the writer can't be choosing a new region at the same
+/// time, so the writer is paused while the reader is added.
+///
+/// A slot left by a detached reader is reused if there is one. Otherwise a slot
+/// is added, growing `holds` by a block when the last one is full. Blocks are
+/// linked before `holds.n` is published, so the writer only follows links it
+/// can see.
 static int
 reader_initialize(struct channel* self, struct channel_reader* reader)
 {
     if (reader->id > 0)
         return 1;
-    reader->id = ++self->holds.n;
-    self->holds.cycles[reader->id - 1] = self->cycle;
-    self->holds.pos[reader->id - 1] = 0;
-    if (self->holds.n >= MAX_READERS)
-        return 0;
+
+    writer_pause(self);
+    const unsigned n = self->holds.n;
+    struct channel_cursors** link = &self->holds.blocks;
+    uint64_t* cursor = 0;
+    unsigned i = 0;
+    for (; i < n && !cursor; ++i) {
+        if (i && i % CURSORS_PER_BLOCK == 0)
+            link = &(*link)->next;
+        uint64_t* slot = &(*link)->cursors[i % CURSORS_PER_BLOCK].value;
+        if (load_relaxed(slot) == CURSOR_FREE)
+            cursor = slot;
+    }
+    if (!cursor) {
+        if (n % CURSORS_PER_BLOCK == 0) {
+            if (n)
+                link = &(*link)->next;
+            CHECK(*link = cursor_block_alloc());
+        }
+        cursor = &(*link)->cursors[n % CURSORS_PER_BLOCK].value;
+        i = n + 1;
+    }
+
+    const struct writer_state w = writer_snapshot(self);
+    store_relaxed(cursor,
+                  cursor_pack(self, 0, w.cycle) | cursor_flags(reader));
+    if (i > n)
+        store_release(&self->holds.n, i);
+    reader->cursor = cursor;
+    reader->id = i;
+    reader->writes = w.cycle_writes;
+    writer_resume(self);
     return 1;
+Error:
+    writer_resume(self);
+    return 0;
+}
+
+/// Only called by the reader that owns the cursor.
+/// A lossy reader's cursor is flagged so the writer ignores it.
+static void
+cursor_store(struct channel* self,
+             const struct channel_reader* reader,
+             size_t pos,
+             size_t cycle)
+{
+    store_release(reader->cursor,
+                  cursor_pack(self, pos, cycle) | cursor_flags(reader));
+}
+
+/// Wakes the writer if it's waiting for space.
+/// @param[in] is_locked Whether the caller already holds `lock`.
+static void
+writer_wake_if_waiting(struct channel* self, int is_locked)
+{
+    if (is_locked) {
+        // The writer only starts waiting while holding the lock.
+        if (load_relaxed(&self->is_writer_waiting))
+            condition_variable_notify_all(&self->notify_space_available);
+        return;
+    }
+
+    // Pairs with the fence in channel_write_map(): either the writer sees the
+    // new cursor, or this sees that the writer is waiting.
+    fence_seq_cst();
+    if (load_relaxed(&self->is_writer_waiting)) {
+        lock_acquire(&self->lock);
+        condition_variable_notify_all(&self->notify_space_available);
+        lock_release(&self->lock);
+    }
+}
+
+/// Stores the cursor and wakes the writer if it's waiting for space.
+static void
+cursor_publish(struct channel* self,
+               const struct channel_reader* reader,
+               size_t pos,
+               size_t cycle,
+               int is_locked)
+{
+    cursor_store(self, reader, pos, cycle);
+    writer_wake_if_waiting(self, is_locked);
+}
+
+/// Moves the reader at (`*pos`, `*cycle`) to the start of the newest write
+/// that's still intact, or to the writer's head if there is none, and counts
+/// the writes it passes over. A reader already there or past it stays put.
+///
+/// Only called while the writer is paused.
+static void
+reader_skip_to_newest(struct channel* self,
+                      struct channel_reader* reader,
+                      const struct writer_state* w,
+                      size_t* pos,
+                      size_t* cycle)
+{
+    // The writer may be filling [0, mapped) of its current cycle.
+    const size_t mapped = load_relaxed(&self->mapped);
+    size_t writes = w->writes, newest = w->head, newest_cycle = w->cycle;
+    if (w->writes > w->cycle_writes) {
+        // The newest write ends at the head.
+        newest = w->last;
+        writes = w->writes - 1;
+    } else if (w->cycle && mapped <= w->last) {
+        // The newest write ended the previous cycle.
+        newest = w->last;
+        newest_cycle = w->cycle - 1;
+        writes = w->cycle_writes - 1;
+    }
+    if (cursor_cmp(newest_cycle, newest, *cycle, *pos) <= 0)
+        return;
+    *pos = newest;
+    *cycle = newest_cycle;
+    reader->skipped += writes - reader->writes;
+    reader->writes = writes;
+    cursor_store(self, reader, *pos, *cycle);
+}
+
+/// The writer doesn't wait for lossy readers that aren't holding a mapped
+/// region, so by the time one comes back the data at its cursor may have been
+/// overwritten. When it has, this moves the reader to the newest write that's
+/// still intact, or to the writer's head if there is none, and counts the
+/// writes it missed.
+///
+/// Only called while the writer is paused.
+static void
+lossy_reader_catch_up(struct channel* self,
+                      struct channel_reader* reader,
+                      const struct writer_state* w,
+                      size_t* pos,
+                      size_t* cycle)
+{
+    // The writer may be filling [0, mapped) of its current cycle.
+    const size_t mapped = load_relaxed(&self->mapped);
+    if (*cycle == w->cycle && *pos <= w->head)
+        return;
+    if (*cycle + 1 == w->cycle && mapped <= *pos && *pos <= w->high)
+        return;
+    reader_skip_to_newest(self, reader, w, pos, cycle);
 }
 
 static size_t
@@ -112,28 +582,220 @@ get_available_byte_count(const struct channel_reader* const reader,
     return reader->pos - pos;
 }
 
+/// Allocates `capacity` bytes for the buffer, in shared memory when the
+/// channel is shared.
+static int
+buffer_alloc(struct channel* self, size_t capacity)
+{
+    if (!self->shared.name[0] && self->allocator.next.alloc) {
+        const struct channel_allocator* a = &self->allocator.next;
+        uint8_t* data = a->alloc(a->ctx, capacity);
+        EXPECT(data,
+               "The client failed to allocate %llu bytes for channel.",
+               (unsigned long long)capacity);
+        // Frames are only aligned in the channel if the buffer is.
+        if ((uintptr_t)data % self->frame_alignment_bytes) {
+            if (a->free)
+                a->free(a->ctx, data, capacity);
+            EXPECT(0,
+                   "Expected the client's buffer aligned to %llu bytes.",
+                   (unsigned long long)self->frame_alignment_bytes);
+        }
+        self->data = data;
+        self->allocator.owner = *a;
+        return 1;
+    }
+    if (!self->shared.name[0]) {
+        EXPECT(self->data = memory_alloc_on_node(
+                 capacity, AllocatorHint_LargePage, self->numa.node),
+               "Failed to allocate %llu bytes for channel.",
+               (unsigned long long)capacity);
+        return 1;
+    }
+
+    const uint64_t nbytes = SHARED_CHANNEL_DATA_OFFSET + (uint64_t)capacity;
+    CHECK(
+      shared_memory_create(&self->shared.memory, self->shared.name, nbytes));
+    // The memory starts zeroed, so every reader slot starts out free.
+    struct shared_channel* shared =
+      (struct shared_channel*)self->shared.memory.data;
+    shared->version = SHARED_CHANNEL_VERSION;
+    shared->capacity = capacity;
+    shared_writer_publish(shared,
+                          &(struct writer_state){
+                            .writes = self->writes,
+                            .cycle_writes = self->writes,
+                          });
+    // Readers check the magic last, so they see the rest of the header.
+    store_release(&shared->magic, SHARED_CHANNEL_MAGIC);
+    self->shared.header = shared;
+    self->data = self->shared.memory.data + SHARED_CHANNEL_DATA_OFFSET;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Frees the buffer. A shared buffer is marked retired first, so readers in
+/// other processes let go of it.
+static void
+buffer_free(struct channel* self)
+{
+    if (self->shared.header) {
+        store_release(&self->shared.header->is_retired, 1);
+        shared_memory_close(&self->shared.memory);
+        self->shared.header = 0;
+    } else if (self->data && self->allocator.owner.alloc) {
+        const struct channel_allocator* a = &self->allocator.owner;
+        if (a->free)
+            a->free(a->ctx, self->data, self->capacity);
+    } else if (self->data) {
+        memory_free(self->data);
+    }
+    self->allocator.owner = (struct channel_allocator){ 0 };
+    self->data = 0;
+}
+
 void
 channel_new(struct channel* self, size_t capacity)
 {
-    *self = (struct channel){
-        .data = memory_alloc(capacity, AllocatorHint_LargePage),
-        .capacity = capacity,
-    };
+    *self = (struct channel){ 0 };
 
     lock_init(&self->lock);
     condition_variable_init(&self->notify_space_available);
-    memset(self->data, 0, capacity); // NOLINT
+    condition_variable_init(&self->notify_data_available);
     self->is_accepting_writes = 1;
+    self->frame_alignment_bytes = 8;
+    self->numa.node = -1;
+    if (capacity)
+        channel_reserve(self, capacity);
+}
+
+void
+channel_set_numa_node(struct channel* self, int32_t node)
+{
+    node = node < 0 ? -1 : node;
+    if (node != self->numa.node) {
+        self->numa.node = node;
+        self->numa.is_outdated = 1;
+    }
+}
+
+void
+channel_set_allocator(struct channel* self,
+                      const struct channel_allocator* allocator)
+{
+    const struct channel_allocator next =
+      allocator && allocator->alloc ? *allocator
+                                    : (struct channel_allocator){ 0 };
+    if (memcmp(&next, &self->allocator.next, sizeof(next)) != 0) {
+        self->allocator.next = next;
+        self->allocator.is_outdated = 1;
+    }
+}
+
+void
+channel_set_frame_alignment(struct channel* self, size_t alignment_bytes)
+{
+    self->frame_alignment_bytes = alignment_bytes > 8 ? alignment_bytes : 8;
+}
+
+int
+channel_share(struct channel* self, const char* name)
+{
+    name = name ? name : "";
+    EXPECT(strlen(name) < sizeof(self->shared.name),
+           "Expected a name of at most %d characters for shared memory. Got "
+           "\"%s\".",
+           (int)sizeof(self->shared.name) - 1,
+           name);
+    if (strcmp(name, self->shared.name) != 0) {
+        snprintf(self->shared.name, sizeof(self->shared.name), "%s", name);
+        self->shared.is_outdated = 1;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+size_t
+channel_bytes_of_frame(const struct channel* self, size_t bytes_of_image)
+{
+    const size_t a =
+      self->frame_alignment_bytes > 8 ? self->frame_alignment_bytes : 8;
+    return a * ((sizeof(struct VideoFrame) + bytes_of_image + a - 1) / a);
+}
+
+size_t
+channel_capacity_of_whole_frames(const struct channel* self,
+                                 size_t capacity,
+                                 size_t bytes_of_image)
+{
+    if (!bytes_of_image)
+        return capacity;
+    const size_t bytes_of_frame = channel_bytes_of_frame(self, bytes_of_image);
+    return bytes_of_frame * ((capacity + bytes_of_frame - 1) / bytes_of_frame);
+}
+
+int
+channel_reserve(struct channel* self, size_t capacity)
+{
+    // The write count carries on so lossy readers keep counting skips.
+    writer_publish(self,
+                   &(struct writer_state){ .writes = self->writes,
+                                           .cycle_writes = self->writes });
+    self->mapped = 0;
+    self->stats = (struct channel_counters){ 0 };
+    struct channel_cursors* block = self->holds.blocks;
+    for (unsigned i = 0; i < self->holds.n; ++i) {
+        if (i && i % CURSORS_PER_BLOCK == 0)
+            block = block->next;
+        uint64_t* cursor = &block->cursors[i % CURSORS_PER_BLOCK].value;
+        if (*cursor != CURSOR_FREE)
+            *cursor &= CURSOR_IGNORED;
+    }
+    // Readers in other processes can't be moved while they might be storing
+    // their cursors, so they're admitted again at the start instead.
+    for (unsigned i = 0; self->shared.header && i < SHARED_CHANNEL_MAX_READERS;
+         ++i) {
+        struct shared_channel_reader* r = self->shared.header->readers + i;
+        uint64_t state = load_acquire(&r->state);
+        if ((state & SHARED_READER_STATE_MASK) == SharedReader_Active)
+            compare_exchange_acq_rel(
+              &r->state,
+              &state,
+              shared_reader_next_state(state, SharedReader_Joining));
+    }
+
+    if (self->capacity == capacity && !self->shared.is_outdated &&
+        !self->numa.is_outdated && !self->allocator.is_outdated)
+        return 1;
+
+    buffer_free(self);
+    self->capacity = 0;
+    self->shared.is_outdated = 0;
+    self->numa.is_outdated = 0;
+    self->allocator.is_outdated = 0;
+    if (capacity)
+        CHECK(buffer_alloc(self, capacity));
+    self->capacity = capacity;
+    return 1;
+Error:
+    return 0;
 }
 
 void
 channel_release(struct channel* self)
 {
     self->holds.n = 0;
+    while (self->holds.blocks) {
+        struct channel_cursors* next = self->holds.blocks->next;
+        free(self->holds.blocks->allocation);
+        self->holds.blocks = next;
+    }
     condition_variable_notify_all(&self->notify_space_available);
 
     lock_acquire(&self->lock);
-    memory_free(self->data);
+    buffer_free(self);
     self->capacity = 0;
     self->head = 0;
     lock_release(&self->lock);
@@ -142,80 +804,225 @@ channel_release(struct channel* self)
 void
 channel_accept_writes(struct channel* self, uint32_t tf)
 {
-    self->is_accepting_writes = tf;
+    lock_acquire(&self->lock);
+    store_release(&self->is_accepting_writes, tf);
     condition_variable_notify_all(&self->notify_space_available);
+    lock_release(&self->lock);
 }
 
 void
 channel_abort_write(struct channel* self)
 {
-    lock_acquire(&self->lock);
-    if (self->is_accepting_writes) {
-        self->mapped = self->head;
+    store_relaxed(&self->mapped, self->head);
+}
+
+void
+channel_reader_set_lossy(struct channel* self,
+                         struct channel_reader* reader,
+                         uint32_t is_lossy)
+{
+    if (!reader->is_lossy == !is_lossy)
+        return;
+    if (!reader->id) {
+        reader->is_lossy = is_lossy;
+        return;
     }
-    lock_release(&self->lock);
+
+    writer_pause(self);
+    const struct writer_state w = writer_snapshot(self);
+    reader->is_lossy = is_lossy;
+    reader->state = ChannelState_Unmapped;
+    reader->writes = w.writes;
+    cursor_publish(self, reader, w.head, w.cycle, 1);
+    writer_resume(self);
 }
 
-struct slice
-channel_read_map(struct channel* self, struct channel_reader* reader)
+void
+channel_reader_detach(struct channel* self, struct channel_reader* reader)
 {
-    size_t nbytes = 0;
-    lock_acquire(&self->lock);
+    if (!reader->id)
+        return;
+    store_release(reader->cursor, CURSOR_FREE);
+    writer_wake_if_waiting(self, 0);
+    reader->id = 0;
+    reader->cursor = 0;
+    reader->pos = 0;
+    reader->cycle = 0;
+    reader->status = Channel_Ok;
+    reader->state = ChannelState_Unmapped;
+}
 
-    reader_initialize(self, reader);
+static struct slice
+read_map(struct channel* self,
+         struct channel_reader* reader,
+         int is_writer_paused)
+{
+    size_t nbytes = 0;
 
-    size_t* const cycle = self->holds.cycles + reader->id - 1;
-    size_t* const pos = self->holds.pos + reader->id - 1;
-    uint8_t* out = self->data + *pos;
+    const struct writer_state w = writer_snapshot(self);
+    size_t pos, cycle;
+    cursor_unpack(self,
+                  load_relaxed(reader->cursor),
+                  &pos,
+                  &cycle);
+    cursor_normalize(&w, &pos, &cycle);
+    if (is_writer_paused && reader->state == ChannelState_Unmapped)
+        lossy_reader_catch_up(self, reader, &w, &pos, &cycle);
+    uint8_t* out = self->data + pos;
 
     if (reader->state == ChannelState_Mapped) {
         reader->status = Channel_Expected_Unmapped_Reader;
         goto AdvanceToWriterHead;
     }
 
-    if (*pos == self->head && *cycle == self->cycle) {
+    if (pos == w.head && cycle == w.cycle) {
         goto Finalize;
     }
 
-    if (*pos < self->head) {
-        if (*cycle != self->cycle)
+    if (pos < w.head) {
+        if (cycle != w.cycle)
             goto Overflow;
-        nbytes = self->head - *pos; // this will never be 0
-        reader->pos = self->head;
-        reader->cycle = self->cycle;
+        nbytes = w.head - pos; // this will never be 0
+        reader->pos = w.head;
+        reader->cycle = w.cycle;
+        reader->writes = w.writes;
     } else {
-        if (self->cycle != *cycle + 1)
+        if (w.cycle != cycle + 1 || pos > w.high)
             goto Overflow;
-        nbytes = self->high - *pos;
+        nbytes = w.high - pos; // normalization means this is never 0
         reader->pos = 0;
-        reader->cycle = *cycle + 1;
-    }
-
-    // Even if nothing is available on the channel, we still need to advance
-    // this reader's position & cycle bookmarks to the position & cycle of the
-    // writer's head. Normally this would happen in channel_read_unmap(), but
-    // because no data is available, we do not set the reader's state to Mapped
-    // here. A call to channel_read_unmap() would return early and not advance
-    // the reader's bookmarks in that case, so we need to do it here.
-    if (!nbytes) {
-        goto AdvanceToWriterHead;
+        reader->cycle = cycle + 1;
+        reader->writes = w.cycle_writes;
     }
 
+    // Remember the normalized start so channel_read_unmap() measures the
+    // mapped region from the same place.
+    store_release(reader->cursor, cursor_pack(self, pos, cycle));
     reader->state = ChannelState_Mapped;
 
 Finalize:
-    lock_release(&self->lock);
     return (struct slice){ .beg = out, .end = out + nbytes };
 Overflow:
     reader->status = Channel_Error;
 AdvanceToWriterHead:
     out = 0;
     nbytes = 0;
-    *pos = self->head;
-    *cycle = self->cycle;
+    cursor_publish(self, reader, w.head, w.cycle, is_writer_paused);
     goto Finalize;
 }
 
+struct slice
+channel_read_map(struct channel* self, struct channel_reader* reader)
+{
+    if (!reader_initialize(self, reader)) {
+        reader->status = Channel_Error;
+        return (struct slice){ 0 };
+    }
+    if (!reader->is_lossy)
+        return read_map(self, reader, 0);
+
+    // The writer may be overrunning a lossy reader's cursor, so it's kept
+    // still while the reader checks what's left and takes its hold.
+    writer_pause(self);
+    const struct slice out = read_map(self, reader, 1);
+    writer_resume(self);
+    return out;
+}
+
+struct slice
+channel_read_map_latest(struct channel* self, struct channel_reader* reader)
+{
+    if (!reader_initialize(self, reader)) {
+        reader->status = Channel_Error;
+        return (struct slice){ 0 };
+    }
+    // Kept still so the newest write can't be overwritten, or followed by
+    // another, between finding it and mapping it.
+    writer_pause(self);
+    if (reader->state == ChannelState_Unmapped) {
+        const struct writer_state w = writer_snapshot(self);
+        size_t pos, cycle;
+        cursor_unpack(self, load_relaxed(reader->cursor), &pos, &cycle);
+        cursor_normalize(&w, &pos, &cycle);
+        reader_skip_to_newest(self, reader, &w, &pos, &cycle);
+        // A lossless reader may have been what the writer was waiting on.
+        writer_wake_if_waiting(self, 1);
+    }
+    const struct slice out = read_map(self, reader, 1);
+    writer_resume(self);
+    return out;
+}
+
+struct slice
+channel_read_map_wait(struct channel* self,
+                      struct channel_reader* reader,
+                      uint32_t timeout_ms)
+{
+    struct slice out = channel_read_map(self, reader);
+    if (out.end > out.beg || !timeout_ms || !reader->id ||
+        reader->status != Channel_Ok)
+        return out;
+
+    lock_acquire(&self->lock);
+    store_relaxed(&self->readers_waiting, self->readers_waiting + 1);
+    // Pairs with the fence in channel_write_unmap(): either the writer sees
+    // this reader waiting, or this sees the writer's new head.
+    fence_seq_cst();
+    if (reader->wakeups != self->wakeups) {
+        reader->wakeups = self->wakeups;
+    } else if (!channel_bytes_unread(self, reader)) {
+        condition_variable_timed_wait(
+          &self->notify_data_available, &self->lock, timeout_ms);
+        reader->wakeups = self->wakeups;
+    }
+    store_relaxed(&self->readers_waiting, self->readers_waiting - 1);
+    lock_release(&self->lock);
+
+    return channel_read_map(self, reader);
+}
+
+struct slice
+channel_read_map_wait_past(struct channel* self,
+                           struct channel_reader* reader,
+                           size_t nbytes_seen,
+                           uint32_t timeout_ms)
+{
+    struct slice out = channel_read_map(self, reader);
+    if ((size_t)(out.end - out.beg) > nbytes_seen || !timeout_ms ||
+        !reader->id || reader->status != Channel_Ok)
+        return out;
+    // What's left may be past the end of the buffer, out of reach until the
+    // bytes seen are consumed, so this waits for any change.
+    const size_t unread = channel_bytes_unread(self, reader);
+    channel_read_unmap(self, reader, 0);
+
+    lock_acquire(&self->lock);
+    store_relaxed(&self->readers_waiting, self->readers_waiting + 1);
+    // Pairs with the fence in channel_write_unmap(), as in
+    // channel_read_map_wait().
+    fence_seq_cst();
+    if (reader->wakeups != self->wakeups) {
+        reader->wakeups = self->wakeups;
+    } else if (channel_bytes_unread(self, reader) == unread) {
+        condition_variable_timed_wait(
+          &self->notify_data_available, &self->lock, timeout_ms);
+        reader->wakeups = self->wakeups;
+    }
+    store_relaxed(&self->readers_waiting, self->readers_waiting - 1);
+    lock_release(&self->lock);
+
+    return channel_read_map(self, reader);
+}
+
+void
+channel_wake_readers(struct channel* self)
+{
+    lock_acquire(&self->lock);
+    ++self->wakeups;
+    condition_variable_notify_all(&self->notify_data_available);
+    lock_release(&self->lock);
+}
+
 void
 channel_read_unmap(struct channel* self,
                    struct channel_reader* reader,
@@ -223,82 +1030,868 @@ channel_read_unmap(struct channel* self,
 {
     if (reader->state != ChannelState_Mapped)
         return;
-    lock_acquire(&self->lock);
 
-    size_t* const cycle = self->holds.cycles + reader->id - 1;
-    size_t* const pos = self->holds.pos + reader->id - 1;
+    const struct writer_state w = writer_snapshot(self);
+    size_t pos, cycle;
+    cursor_unpack(self,
+                  load_relaxed(reader->cursor),
+                  &pos,
+                  &cycle);
 
-    size_t length = get_available_byte_count(reader, *pos, *cycle, self->high);
+    size_t length = get_available_byte_count(reader, pos, cycle, w.high);
     consumed_bytes = min(length, consumed_bytes);
     if (consumed_bytes >= length) {
-        *cycle = reader->cycle;
-        *pos = reader->pos;
+        cycle = reader->cycle;
+        pos = reader->pos;
     } else {
-        *pos += consumed_bytes;
-    }
-    if (self->head < *pos && *pos == self->high) {
-        *pos = 0;
-        *cycle += 1;
+        pos += consumed_bytes;
     }
     reader->state = ChannelState_Unmapped;
-    lock_release(&self->lock);
-    condition_variable_notify_all(&self->notify_space_available);
+    reader->bytes_read += consumed_bytes;
+    cursor_publish(self, reader, pos, cycle, 0);
+}
+
+int
+channel_read_hold(struct channel* self,
+                  const struct channel_reader* reader,
+                  struct channel_reader* hold)
+{
+    CHECK(reader->state == ChannelState_Mapped);
+    CHECK(!hold->id);
+    hold->is_lossy = 0;
+    CHECK(reader_initialize(self, hold));
+    // While mapped, the reader's cursor marks the start of its region, and
+    // keeps the writer off it till the hold takes over.
+    store_release(hold->cursor, load_relaxed(reader->cursor));
+    return 1;
+Error:
+    return 0;
+}
+
+size_t
+channel_bytes_unread(const struct channel* self,
+                     const struct channel_reader* reader)
+{
+    if (reader->id == 0)
+        return 0;
+
+    const struct writer_state w = writer_snapshot(self);
+    size_t pos, cycle;
+    cursor_unpack(self,
+                  load_acquire(reader->cursor),
+                  &pos,
+                  &cycle);
+    cursor_normalize(&w, &pos, &cycle);
+    return bytes_after(&w, pos, cycle);
+}
+
+void
+channel_get_stats(const struct channel* self, struct channel_stats* stats)
+{
+    const struct writer_state w = writer_snapshot(self);
+    *stats = (struct channel_stats){
+        .capacity_bytes = self->capacity,
+        .occupancy_bytes = occupancy(self, &w),
+        .high_water_bytes = load_relaxed(&self->stats.high_water_bytes),
+        .bytes_written = load_relaxed(&self->stats.bytes_written),
+        .wrap_count = w.cycle,
+        .wasted_bytes = load_relaxed(&self->stats.wasted_bytes),
+        .writer_blocked_us = load_relaxed(&self->stats.writer_blocked_us),
+        .writer_blocked_count =
+          load_relaxed(&self->stats.writer_blocked_count),
+    };
 }
 
 void*
 channel_write_map(struct channel* self, size_t nbytes)
 {
     void* out = 0;
+    size_t beg = 0;
     if (nbytes >= self->capacity)
         return 0;
-    lock_acquire(&self->lock);
-
-    size_t beg, end;
-    if (!self->holds.n) {
-        beg = self->head;
-        end = self->head + nbytes;
-        if (end >= self->capacity) {
-            self->high = self->head;
-            ++self->cycle;
-            self->head = beg = 0;
-            end = nbytes;
-        }
-    } else {
-        uint8_t should_wrap = 0;
+    if (self->shared.header)
+        shared_readers_admit(self);
 
-        while (self->is_accepting_writes &&
-               !next_write(self, nbytes, &beg, &should_wrap)) {
+    // Fast path. Pairs with the fence in writer_pause(): either a reader
+    // pausing the writer waits for this to finish, or this sees the pause
+    // and falls through to the slow path.
+    store_relaxed(&self->is_writer_busy, 1);
+    fence_seq_cst();
+    if (!load_relaxed(&self->is_pausing_writer) &&
+        reserve(self, nbytes, &beg)) {
+        out = commit_reservation(self, beg, nbytes);
+    }
+    store_release(&self->is_writer_busy, 0);
+    self->mapped_stride = nbytes;
+    if (out)
+        return out;
 
-            condition_variable_wait(&self->notify_space_available, &self->lock);
-        }
-        if (!self->is_accepting_writes)
-            goto Finalize;
-        end = beg + nbytes;
-        if (beg != self->head) {
-            self->high = self->head;
-            self->head = beg;
-            ++self->cycle;
-        }
-        if (should_wrap) {
-            for (uint32_t i = 0; i < self->holds.n; ++i) {
-                self->holds.pos[i] = 0;
-                self->holds.cycles[i] = self->cycle;
+    // Slow path. Wait under the lock for a reader to make space.
+    lock_acquire(&self->lock);
+    store_relaxed(&self->is_writer_waiting, 1);
+    fence_seq_cst();
+    int ok = reserve(self, nbytes, &beg);
+    if (!ok && load_acquire(&self->is_accepting_writes)) {
+        struct clock clock;
+        clock_init(&clock);
+        do {
+            if (self->shared.header) {
+                condition_variable_timed_wait(&self->notify_space_available,
+                                              &self->lock,
+                                              SHARED_WRITER_POLL_MS);
+                shared_readers_admit(self);
+                shared_readers_reap(self);
+            } else {
+                condition_variable_wait(&self->notify_space_available,
+                                        &self->lock);
             }
-        }
+        } while (!(ok = reserve(self, nbytes, &beg)) &&
+                 load_acquire(&self->is_accepting_writes));
+        store_relaxed(&self->stats.writer_blocked_us,
+                      self->stats.writer_blocked_us +
+                        (size_t)(1e3 * clock_toc_ms(&clock)));
+        store_relaxed(&self->stats.writer_blocked_count,
+                      self->stats.writer_blocked_count + 1);
     }
-    out = self->data + beg;
-    self->mapped = end;
-Finalize:
+    store_relaxed(&self->is_writer_waiting, 0);
+    if (ok)
+        out = commit_reservation(self, beg, nbytes);
     lock_release(&self->lock);
     return out;
 }
 
+void*
+channel_write_map_batch(struct channel* self, size_t nbytes, size_t* count)
+{
+    void* out = 0;
+    if (nbytes && nbytes < self->capacity) {
+        // A batch as big as the channel could only be placed once every
+        // reader had drained it.
+        const size_t most = max(1, (self->capacity / 2) / nbytes);
+        *count = min(*count, most);
+        if (*count && (out = channel_write_map(self, *count * nbytes)))
+            self->mapped_stride = nbytes;
+    }
+    if (!out)
+        *count = 0;
+    return out;
+}
+
 void
 channel_write_unmap(struct channel* self)
 {
-    lock_acquire(&self->lock);
-    if (self->is_accepting_writes) {
-        self->head = self->mapped;
+    channel_write_unmap_batch(self, 1);
+}
+
+void
+channel_write_unmap_batch(struct channel* self, size_t count)
+{
+    const size_t stride = self->mapped_stride;
+    count = stride ? min(count, (self->mapped - self->head) / stride) : 0;
+    if (!count) {
+        store_relaxed(&self->mapped, self->head);
+    } else if (load_acquire(&self->is_accepting_writes)) {
+        struct writer_state w = writer_current(self);
+        w.last = w.head + (count - 1) * stride;
+        w.head += count * stride;
+        w.writes += count;
+        store_relaxed(&self->mapped, w.head);
+        writer_publish(self, &w);
+
+        const size_t used = occupancy(self, &w);
+        if (used > self->stats.high_water_bytes)
+            store_relaxed(&self->stats.high_water_bytes, used);
+        store_relaxed(&self->stats.bytes_written,
+                      self->stats.bytes_written + count * stride);
+
+        // Pairs with the fence in channel_read_map_wait().
+        fence_seq_cst();
+        if (load_relaxed(&self->readers_waiting)) {
+            lock_acquire(&self->lock);
+            condition_variable_notify_all(&self->notify_data_available);
+            lock_release(&self->lock);
+        }
     }
-    lock_release(&self->lock);
 }
+
+void
+channel_write_unmap_bytes(struct channel* self, size_t nbytes)
+{
+    if (nbytes && nbytes < self->mapped_stride)
+        self->mapped_stride = nbytes;
+    channel_write_unmap_batch(self, 1);
+}
+
+#ifndef NO_UNIT_TESTS
+
+struct channel_test_ctx
+{
+    struct channel channel;
+    uint64_t nframes;
+    size_t bytes_of_frame;
+    int ok[2];
+    struct channel_reader readers[2];
+};
+
+static void
+channel_test_writer(void* ctx_)
+{
+    struct channel_test_ctx* ctx = ctx_;
+    for (uint64_t i = 0; i < ctx->nframes; ++i) {
+        uint64_t* p = channel_write_map(&ctx->channel, ctx->bytes_of_frame);
+        if (!p)
+            return;
+        for (size_t k = 0; k < ctx->bytes_of_frame / sizeof(*p); ++k)
+            p[k] = i;
+        channel_write_unmap(&ctx->channel);
+    }
+}
+
+static void
+channel_test_reader(struct channel_test_ctx* ctx, int ireader)
+{
+    struct channel_reader* reader = ctx->readers + ireader;
+    uint64_t nseen = 0;
+    while (nseen + reader->skipped < ctx->nframes &&
+           load_acquire(&ctx->channel.is_accepting_writes)) {
+        struct slice s = channel_read_map_wait(&ctx->channel, reader, 100);
+        CHECK(reader->status == Channel_Ok);
+        CHECK((s.end - s.beg) % ctx->bytes_of_frame == 0);
+        // Only a lossy reader ever skips frames.
+        uint64_t expect = nseen + reader->skipped;
+        for (const uint8_t* cur = s.beg; cur < s.end;
+             cur += ctx->bytes_of_frame) {
+            const uint64_t* p = (const uint64_t*)cur;
+            for (size_t k = 0; k < ctx->bytes_of_frame / sizeof(*p); ++k)
+                CHECK(p[k] == expect);
+            ++expect;
+            ++nseen;
+        }
+        channel_read_unmap(&ctx->channel, reader, s.end - s.beg);
+        if (reader->is_lossy)
+            clock_sleep_ms(0, 1.0f);
+    }
+    ctx->ok[ireader] = 1;
+    return;
+Error:
+    // Unblocks the writer, which in turn stops the other reader.
+    channel_accept_writes(&ctx->channel, 0);
+}
+
+static void
+channel_test_reader0(void* ctx)
+{
+    channel_test_reader(ctx, 0);
+}
+
+static void
+channel_test_reader1(void* ctx)
+{
+    channel_test_reader(ctx, 1);
+}
+
+/// Streams frames through a small channel that wraps many times while two
+/// readers check that every frame arrives, in order and intact.
+int
+unit_test__channel_lockfree_readers_see_every_frame()
+{
+    struct channel_test_ctx ctx = {
+        .nframes = 1 << 15,
+        .bytes_of_frame = 48,
+    };
+    struct thread writer, readers[2];
+    channel_new(&ctx.channel, 1000);
+
+    // Register readers up front so the writer can't lap them.
+    channel_read_map(&ctx.channel, ctx.readers + 0);
+    channel_read_map(&ctx.channel, ctx.readers + 1);
+
+    thread_init(&writer);
+    thread_init(readers + 0);
+    thread_init(readers + 1);
+    CHECK(thread_create(readers + 0, channel_test_reader0, &ctx));
+    CHECK(thread_create(readers + 1, channel_test_reader1, &ctx));
+    CHECK(thread_create(&writer, channel_test_writer, &ctx));
+    thread_join(&writer);
+    thread_join(readers + 0);
+    thread_join(readers + 1);
+
+    CHECK(ctx.ok[0] && ctx.ok[1]);
+    CHECK(channel_bytes_unread(&ctx.channel, ctx.readers + 0) == 0);
+    channel_release(&ctx.channel);
+    return 1;
+Error:
+    channel_accept_writes(&ctx.channel, 0);
+    thread_join(&writer);
+    thread_join(readers + 0);
+    thread_join(readers + 1);
+    channel_release(&ctx.channel);
+    return 0;
+}
+
+/// Paces the writer with one reader while a slow lossy reader checks that the
+/// frames it does see arrive intact and that the ones it misses are counted.
+int
+unit_test__channel_lossy_reader_does_not_stall_writer()
+{
+    struct channel_test_ctx ctx = {
+        .nframes = 1 << 13,
+        .bytes_of_frame = 48,
+    };
+    struct thread writer, readers[2];
+    channel_new(&ctx.channel, 1000);
+    channel_reader_set_lossy(&ctx.channel, ctx.readers + 1, 1);
+    channel_read_map(&ctx.channel, ctx.readers + 0);
+    channel_read_map(&ctx.channel, ctx.readers + 1);
+
+    thread_init(&writer);
+    thread_init(readers + 0);
+    thread_init(readers + 1);
+    CHECK(thread_create(readers + 0, channel_test_reader0, &ctx));
+    CHECK(thread_create(readers + 1, channel_test_reader1, &ctx));
+    CHECK(thread_create(&writer, channel_test_writer, &ctx));
+    thread_join(&writer);
+    thread_join(readers + 0);
+    thread_join(readers + 1);
+
+    CHECK(ctx.ok[0] && ctx.ok[1]);
+    CHECK(ctx.readers[0].skipped == 0);
+    channel_release(&ctx.channel);
+    return 1;
+Error:
+    channel_accept_writes(&ctx.channel, 0);
+    thread_join(&writer);
+    thread_join(readers + 0);
+    thread_join(readers + 1);
+    channel_release(&ctx.channel);
+    return 0;
+}
+
+static int
+channel_test_write_frames(struct channel* channel,
+                          size_t bytes_of_frame,
+                          uint64_t beg,
+                          uint64_t end)
+{
+    for (uint64_t i = beg; i < end; ++i) {
+        uint64_t* p = channel_write_map(channel, bytes_of_frame);
+        CHECK(p);
+        *p = i;
+        channel_write_unmap(channel);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// A lossy reader that falls behind doesn't hold back the writer, and its next
+/// map returns the newest frame.
+int
+unit_test__channel_lossy_reader_resumes_at_newest_write()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1000);
+    channel_reader_set_lossy(&channel, &reader, 1);
+    struct slice s = channel_read_map(&channel, &reader);
+    CHECK(s.beg == s.end);
+
+    // Laps the reader several times.
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 100));
+    s = channel_read_map(&channel, &reader);
+    CHECK(reader.status == Channel_Ok);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 99);
+    CHECK(reader.skipped == 99);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    // Once it's caught up, nothing more is skipped.
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 100, 102));
+    s = channel_read_map(&channel, &reader);
+    CHECK(s.end - s.beg == 2 * bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 100);
+    CHECK(reader.skipped == 99);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Mapping the latest write skips straight to the newest frame, including
+/// after the writer wraps, and reading carries on after it.
+int
+unit_test__channel_read_map_latest_skips_backlog()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1000);
+    struct slice s = channel_read_map_latest(&channel, &reader);
+    CHECK(s.beg == s.end);
+    channel_read_unmap(&channel, &reader, 0);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 10));
+    s = channel_read_map_latest(&channel, &reader);
+    CHECK(reader.status == Channel_Ok);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 9);
+    CHECK(reader.skipped == 9);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    // Nothing new.
+    s = channel_read_map_latest(&channel, &reader);
+    CHECK(s.beg == s.end);
+    CHECK(reader.skipped == 9);
+    channel_read_unmap(&channel, &reader, 0);
+
+    // Only the last frame of a batch.
+    size_t count = 3;
+    uint8_t* p = channel_write_map_batch(&channel, bytes_of_frame, &count);
+    CHECK(p && count == 3);
+    for (uint64_t i = 0; i < 3; ++i)
+        *(uint64_t*)(p + i * bytes_of_frame) = 10 + i;
+    channel_write_unmap_batch(&channel, 3);
+    s = channel_read_map_latest(&channel, &reader);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 12);
+    CHECK(reader.skipped == 11);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 13, 15));
+    s = channel_read_map(&channel, &reader);
+    CHECK(s.end - s.beg == 2 * bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 13);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    // Past the end of the buffer and around to the start.
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 15, 26));
+    CHECK(channel.cycle == 1);
+    s = channel_read_map_latest(&channel, &reader);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    CHECK(*(uint64_t*)s.beg == 25);
+    CHECK(reader.skipped == 21);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// More readers than fit in one block of cursors all see the data, and a
+/// reader that stopped reading no longer holds back the writer once it's
+/// detached.
+int
+unit_test__channel_detached_reader_stops_holding_writer()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader readers[12] = { 0 };
+    channel_new(&channel, 1000);
+    for (int i = 0; i < countof(readers); ++i) {
+        struct slice s = channel_read_map(&channel, readers + i);
+        CHECK(readers[i].id == i + 1);
+        CHECK(s.beg == s.end);
+    }
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 15));
+    for (int i = 1; i < countof(readers); ++i) {
+        struct slice s = channel_read_map(&channel, readers + i);
+        CHECK(s.end - s.beg == 15 * bytes_of_frame);
+        channel_read_unmap(&channel, readers + i, s.end - s.beg);
+    }
+
+    // readers[0] hasn't consumed anything, so this would block if it were
+    // still attached.
+    channel_reader_detach(&channel, readers + 0);
+    CHECK(readers[0].id == 0);
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 15, 25));
+
+    // A new reader takes over the free slot.
+    struct channel_reader reader = { 0 };
+    channel_read_map(&channel, &reader);
+    CHECK(reader.id == 1);
+    CHECK(channel.holds.n == countof(readers));
+    channel_read_unmap(&channel, &reader, 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Stats follow the writer and readers through a wrap, and start over when the
+/// channel is emptied.
+int
+unit_test__channel_stats_track_occupancy_and_wraps()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct channel_stats stats = { 0 };
+    channel_new(&channel, 1000);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 15));
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.capacity_bytes == 1000);
+    CHECK(stats.occupancy_bytes == 15 * bytes_of_frame);
+    CHECK(stats.high_water_bytes == 15 * bytes_of_frame);
+    CHECK(stats.bytes_written == 15 * bytes_of_frame);
+    CHECK(stats.wrap_count == 0);
+
+    struct slice s = channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+    CHECK(reader.bytes_read == 15 * bytes_of_frame);
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == 0);
+
+    // Five more frames fit before the end. The sixth wraps, leaving 40 bytes
+    // unused.
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 15, 25));
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == 10 * bytes_of_frame);
+    CHECK(stats.high_water_bytes == 15 * bytes_of_frame);
+    CHECK(stats.bytes_written == 25 * bytes_of_frame);
+    CHECK(stats.wrap_count == 1);
+    CHECK(stats.wasted_bytes == 1000 - 20 * bytes_of_frame);
+    CHECK(stats.writer_blocked_us == 0);
+    CHECK(stats.writer_blocked_count == 0);
+
+    CHECK(channel_reserve(&channel, 1000));
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == 0);
+    CHECK(stats.high_water_bytes == 0);
+    CHECK(stats.bytes_written == 0);
+    CHECK(stats.wrap_count == 0);
+    CHECK(stats.wasted_bytes == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+/// A channel sized to whole frames is filled to its end before the writer
+/// wraps, with or without a reader holding it back.
+int
+unit_test__channel_whole_frames_fill_to_the_end()
+{
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct channel_stats stats = { 0 };
+    channel_new(&channel, 0);
+    const size_t bytes_of_frame = channel_bytes_of_frame(&channel, 100);
+    CHECK(channel_capacity_of_whole_frames(&channel, 1000, 0) == 1000);
+    CHECK(channel_capacity_of_whole_frames(&channel, 1000, 100) ==
+          bytes_of_frame * ((1000 + bytes_of_frame - 1) / bytes_of_frame));
+    CHECK(channel_capacity_of_whole_frames(
+            &channel, 3 * bytes_of_frame, 100) == 3 * bytes_of_frame);
+    CHECK(channel_reserve(&channel, 4 * bytes_of_frame));
+
+    // Nothing holds the writer back yet.
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 8));
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.wrap_count == 1);
+    CHECK(stats.wasted_bytes == 0);
+
+    CHECK(channel_reserve(&channel, 4 * bytes_of_frame));
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    for (uint64_t i = 0; i < 8; ++i) {
+        CHECK(channel_test_write_frames(&channel, bytes_of_frame, i, i + 1));
+        struct slice s = channel_read_map(&channel, &reader);
+        CHECK(s.end - s.beg == bytes_of_frame);
+        CHECK(*(uint64_t*)s.beg == i);
+        channel_read_unmap(&channel, &reader, s.end - s.beg);
+    }
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.wrap_count == 1);
+    CHECK(stats.wasted_bytes == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// A batch is capped at half the channel, and committing only part of it
+/// releases the rest for the next write.
+int
+unit_test__channel_batched_writes_commit_together()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1000);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+
+    size_t count = 20;
+    uint8_t* p = channel_write_map_batch(&channel, bytes_of_frame, &count);
+    CHECK(p);
+    CHECK(count == 10);
+    for (uint64_t i = 0; i < 6; ++i)
+        *(uint64_t*)(p + i * bytes_of_frame) = i;
+
+    // Nothing is visible until the batch is committed.
+    struct slice s = channel_read_map(&channel, &reader);
+    CHECK(s.beg == s.end);
+    channel_read_unmap(&channel, &reader, 0);
+
+    channel_write_unmap_batch(&channel, 6);
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 6, 7));
+
+    s = channel_read_map(&channel, &reader);
+    CHECK(s.end - s.beg == 7 * bytes_of_frame);
+    for (uint64_t i = 0; i < 7; ++i)
+        CHECK(*(uint64_t*)(s.beg + i * bytes_of_frame) == i);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+    CHECK(channel.writes == 7);
+
+    // Too big to ever fit.
+    count = 1;
+    CHECK(!channel_write_map_batch(&channel, 1000, &count));
+    CHECK(count == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// A reader holding on to what it has mapped only waits for more than that,
+/// and is woken by channel_wake_readers().
+int
+unit_test__channel_reader_waits_past_bytes_seen()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1000);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 2));
+
+    // More than was seen is there already.
+    struct slice s =
+      channel_read_map_wait_past(&channel, &reader, bytes_of_frame, 1000);
+    CHECK(s.end - s.beg == 2 * bytes_of_frame);
+    channel_read_unmap(&channel, &reader, bytes_of_frame);
+
+    // Nothing new, so this times out with what was there.
+    struct clock clock;
+    clock_init(&clock);
+    s = channel_read_map_wait_past(&channel, &reader, bytes_of_frame, 20);
+    CHECK(clock_toc_ms(&clock) >= 10.0);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    channel_read_unmap(&channel, &reader, 0);
+
+    // A wake up doesn't wait out the timeout.
+    channel_wake_readers(&channel);
+    clock_init(&clock);
+    s = channel_read_map_wait_past(&channel, &reader, bytes_of_frame, 10000);
+    CHECK(clock_toc_ms(&clock) < 5000.0);
+    CHECK(s.end - s.beg == bytes_of_frame);
+    channel_read_unmap(&channel, &reader, 0);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 2, 3));
+    s = channel_read_map_wait_past(&channel, &reader, bytes_of_frame, 1000);
+    CHECK(s.end - s.beg == 2 * bytes_of_frame);
+    CHECK(*(uint64_t*)(s.beg + bytes_of_frame) == 2);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Frames are padded out to the alignment asked for, so ones written back to
+/// back each start on an aligned address.
+int
+unit_test__channel_pads_frames_to_alignment()
+{
+    const size_t header = sizeof(struct VideoFrame);
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1 << 16);
+    CHECK(channel_bytes_of_frame(&channel, 1) == 8 * ((header + 8) / 8));
+
+    // Too small an alignment is raised to the default.
+    channel_set_frame_alignment(&channel, 2);
+    CHECK(channel_bytes_of_frame(&channel, 1) == 8 * ((header + 8) / 8));
+
+    channel_set_frame_alignment(&channel, 4096);
+    CHECK(channel_bytes_of_frame(&channel, 0) == 4096);
+    CHECK(channel_bytes_of_frame(&channel, 4096 - header) == 4096);
+    CHECK(channel_bytes_of_frame(&channel, 4096) == 8192);
+
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    const size_t bytes_of_frame = channel_bytes_of_frame(&channel, 100);
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 3));
+    struct slice s = channel_read_map(&channel, &reader);
+    CHECK(s.end - s.beg == 3 * bytes_of_frame);
+    for (uint8_t* cur = s.beg; cur < s.end; cur += bytes_of_frame)
+        CHECK((uintptr_t)cur % 4096 == 0);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// A write that shrinks once it's been mapped only takes what it commits,
+/// and the next write follows straight after it.
+int
+unit_test__channel_write_unmap_bytes_commits_less()
+{
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 1000);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+
+    uint64_t* p = channel_write_map(&channel, 400);
+    CHECK(p);
+    *p = 0;
+    channel_write_unmap_bytes(&channel, 48);
+    CHECK(channel_test_write_frames(&channel, 48, 1, 2));
+
+    // Asking for more than was mapped commits what was mapped.
+    CHECK(p = channel_write_map(&channel, 48));
+    *p = 2;
+    channel_write_unmap_bytes(&channel, 400);
+
+    struct slice s = channel_read_map(&channel, &reader);
+    CHECK(s.end - s.beg == 3 * 48);
+    for (uint64_t i = 0; i < 3; ++i)
+        CHECK(*(uint64_t*)(s.beg + i * 48) == i);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+struct channel_test_allocator
+{
+    size_t allocs, frees, nbytes;
+};
+
+static void*
+channel_test_alloc(void* ctx, size_t nbytes)
+{
+    struct channel_test_allocator* counts = ctx;
+    ++counts->allocs;
+    counts->nbytes = nbytes;
+    return malloc(nbytes);
+}
+
+static void
+channel_test_free(void* ctx, void* data, size_t nbytes)
+{
+    struct channel_test_allocator* counts = ctx;
+    counts->frees += nbytes == counts->nbytes;
+    free(data);
+}
+
+/// The client's allocator allocates the buffer, which it frees once another
+/// allocator takes over.
+int
+unit_test__channel_uses_client_allocator()
+{
+    struct channel channel;
+    struct channel_test_allocator counts = { 0 };
+    const struct channel_allocator allocator = {
+        .alloc = channel_test_alloc,
+        .free = channel_test_free,
+        .ctx = &counts,
+    };
+    channel_new(&channel, 0);
+    channel_set_allocator(&channel, &allocator);
+    CHECK(channel_reserve(&channel, 1000));
+    CHECK(counts.allocs == 1 && counts.nbytes == 1000);
+    CHECK(channel_test_write_frames(&channel, 48, 0, 3));
+
+    // The same size and allocator keep the buffer.
+    CHECK(channel_reserve(&channel, 1000));
+    CHECK(counts.allocs == 1 && counts.frees == 0);
+
+    channel_set_allocator(&channel, 0);
+    CHECK(channel_reserve(&channel, 1000));
+    CHECK(counts.allocs == 1 && counts.frees == 1);
+
+    channel_set_allocator(&channel, &allocator);
+    CHECK(channel_reserve(&channel, 2000));
+    CHECK(counts.allocs == 2 && counts.nbytes == 2000);
+    channel_release(&channel);
+    CHECK(counts.frees == 2);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Held regions stay out of the writer's reach after the reader moves on,
+/// even when it's lossy, till their holds are detached.
+int
+unit_test__channel_holds_keep_regions_from_writer()
+{
+    const size_t bytes_of_frame = 48;
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct channel_reader holds[2] = { 0 };
+    struct channel_stats stats = { 0 };
+    channel_new(&channel, 1000);
+    channel_reader_set_lossy(&channel, &reader, 1);
+    channel_read_map(&channel, &reader);
+    CHECK(!channel_read_hold(&channel, &reader, holds + 0));
+    channel_read_unmap(&channel, &reader, 0);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 0, 2));
+    const struct slice a = channel_read_map(&channel, &reader);
+    CHECK(a.end - a.beg == 2 * bytes_of_frame);
+    CHECK(channel_read_hold(&channel, &reader, holds + 0));
+    CHECK(!channel_read_hold(&channel, &reader, holds + 0));
+    channel_read_unmap(&channel, &reader, a.end - a.beg);
+
+    CHECK(channel_test_write_frames(&channel, bytes_of_frame, 2, 3));
+    const struct slice b = channel_read_map(&channel, &reader);
+    CHECK(b.end - b.beg == bytes_of_frame);
+    CHECK(*(uint64_t*)b.beg == 2);
+    CHECK(channel_read_hold(&channel, &reader, holds + 1));
+    channel_read_unmap(&channel, &reader, b.end - b.beg);
+
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == 3 * bytes_of_frame);
+    CHECK(*(uint64_t*)a.beg == 0);
+    channel_reader_detach(&channel, holds + 0);
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == bytes_of_frame);
+    channel_reader_detach(&channel, holds + 1);
+    channel_get_stats(&channel, &stats);
+    CHECK(stats.occupancy_bytes == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
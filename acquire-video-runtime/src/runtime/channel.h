@@ -2,21 +2,83 @@
 #define H_ACQUIRE_CHANNEL_V0
 
 #include "platform.h"
+#include "shared_channel.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif //__cplusplus
 
+#define CHANNEL_CACHE_LINE_BYTES (64)
+
+    /// A reader's cursor, padded out to a cache line so readers publishing
+    /// their positions from different threads don't false-share.
+    struct channel_cursor
+    {
+        /// The reader's cycle and position packed into one word so it can be
+        /// published atomically. See `cursor_pack()` in channel.c.
+        uint64_t value;
+        uint8_t padding[CHANNEL_CACHE_LINE_BYTES - sizeof(uint64_t)];
+    };
+
+    /// Allocates and frees a channel's buffer in place of memory_alloc(), so
+    /// the host can hand the channel memory a device reads directly, like
+    /// pinned or registered memory. See channel_set_allocator().
+    struct channel_allocator
+    {
+        void* (*alloc)(void* ctx, size_t nbytes);
+        void (*free)(void* ctx, void* data, size_t nbytes);
+        void* ctx;
+    };
+
+    /// A block of reader cursors. Blocks are chained as readers are added and
+    /// never move, so each reader keeps a pointer to its own cursor. Each
+    /// block starts on a cache line boundary.
+    struct channel_cursors
+    {
+        struct channel_cursor cursors[8];
+        struct channel_cursors* next;
+        /// What to pass to free(). Blocks are aligned within it.
+        void* allocation;
+    };
+
+    /// Counters kept by the writer. Reset by channel_reserve().
+    struct channel_counters
+    {
+        size_t high_water_bytes;
+        size_t bytes_written;
+        size_t wasted_bytes;
+        size_t writer_blocked_us;
+        size_t writer_blocked_count;
+    };
+
     /// @brief A bipartite circular queue for zero-copy streaming to multiple
     /// consumers.
     ///
     /// Inspired by
     /// https://www.codeproject.com/Articles/3479/The-Bip-Buffer-The-Circular-Buffer-with-a-Twist
+    ///
+    /// There is a single writer and any number of readers. The writer publishes
+    /// its head and readers publish their cursors with atomic operations, so
+    /// neither mapping nor unmapping takes `lock` in the common case. The lock
+    /// is only taken on slow paths: when the writer has to wait for space or a
+    /// reader has to wait for data, when either has to wake the other, when a
+    /// reader registers itself on first use, and when a lossy reader maps.
+    ///
+    /// By default the writer waits for every reader. A lossy reader (see
+    /// channel_reader_set_lossy()) only holds the writer back while it has a
+    /// region mapped. Otherwise the writer is free to overrun it, and its next
+    /// map resumes at the newest write.
+    ///
+    /// The buffer may be placed in named shared memory (see channel_share()),
+    /// so readers in other processes can map it too. They can't take `lock`,
+    /// so the writer polls for them while it waits for space. See
+    /// shared_channel.h.
     struct channel
     {
         struct lock lock;
         struct condition_variable notify_space_available;
+        struct condition_variable notify_data_available;
 
         /// Pointer to the start of the channel's buffer.
         uint8_t* data;
@@ -35,21 +97,98 @@ extern "C"
         /// start.
         size_t cycle;
 
+        /// Position where the most recently committed write starts.
+        size_t last;
+
+        /// Number of committed writes.
+        size_t writes;
+
+        /// Value of `writes` when the current cycle started.
+        size_t cycle_writes;
+
+        /// Sequence counter guarding `head`, `high`, `cycle`, `last`, `writes`
+        /// and `cycle_writes`. Odd while the writer is updating them. Readers
+        /// retry their snapshot when it changes underneath them.
+        size_t seq;
+
         /// Pointer to the end position of the reserved region of a mapped
-        /// write.
+        /// write. Only touched by the writer.
         size_t mapped;
 
+        /// Size of each write in the mapped region. See
+        /// channel_write_map_batch(). Only touched by the writer.
+        size_t mapped_stride;
+
+        /// Frames written to the channel are padded out to a multiple of
+        /// this many bytes. See channel_bytes_of_frame().
+        size_t frame_alignment_bytes;
+
         /// Whether or not the channel is accepting writes.
-        unsigned char is_accepting_writes;
+        uint32_t is_accepting_writes;
+
+        /// Set while the writer is choosing where the next write goes without
+        /// holding the lock.
+        uint32_t is_writer_busy;
+
+        /// Set while the writer is blocked waiting for space.
+        uint32_t is_writer_waiting;
+
+        /// Set while a reader needs the writer to stay out of
+        /// channel_write_map(): while a reader is registered, and while a lossy
+        /// reader maps.
+        uint32_t is_pausing_writer;
 
-        /// Current positions and cycles of readers on this channel.
+        /// Number of readers blocked in channel_read_map_wait().
+        uint32_t readers_waiting;
+
+        /// Incremented by channel_wake_readers().
+        size_t wakeups;
+
+        /// See channel_get_stats().
+        struct channel_counters stats;
+
+        /// Current positions of readers on this channel.
         struct
         {
-            size_t pos[8];
-            size_t cycles[8];
-            unsigned
-              n; /// Number of readers currently reading from the channel.
+            struct channel_cursors* blocks;
+            /// Number of cursors handed out, including ones freed by
+            /// channel_reader_detach() that are waiting to be reused.
+            unsigned n;
         } holds;
+
+        /// Set up by channel_share().
+        struct
+        {
+            /// Name to share the buffer as. Empty when it isn't shared.
+            char name[32];
+            /// Set when `name` changed after the buffer was allocated.
+            uint8_t is_outdated;
+            struct shared_memory memory;
+            /// Header at the start of `memory`, or 0 while the buffer isn't
+            /// shared.
+            struct shared_channel* header;
+        } shared;
+
+        /// Set up by channel_set_numa_node().
+        struct
+        {
+            /// Node to allocate the buffer on, or -1 to leave it to the
+            /// system.
+            int32_t node;
+            /// Set when `node` changed after the buffer was allocated.
+            uint8_t is_outdated;
+        } numa;
+
+        /// Set up by channel_set_allocator().
+        struct
+        {
+            /// Allocates the next buffer. Unset to use memory_alloc().
+            struct channel_allocator next;
+            /// Allocated the current buffer, and frees it.
+            struct channel_allocator owner;
+            /// Set when `next` changed after the buffer was allocated.
+            uint8_t is_outdated;
+        } allocator;
     };
 
     struct slice
@@ -72,31 +211,240 @@ extern "C"
 
     struct channel_reader
     {
+        /// Nonzero once the reader is registered with a channel.
         unsigned id;
+        /// This reader's slot in the channel's `holds`.
+        uint64_t* cursor;
         size_t pos, cycle;
         enum ChannelStatus status;
         enum ChannelState state;
+        /// The channel's `wakeups` count last seen by this reader.
+        size_t wakeups;
+        /// Set with channel_reader_set_lossy().
+        uint32_t is_lossy;
+        /// The channel's `writes` count at the end of the last region mapped
+        /// by this reader.
+        size_t writes;
+        /// Number of writes a lossy reader missed because the writer overran
+        /// it. Writes that were mapped count as seen, even if they were only
+        /// partly consumed.
+        uint64_t skipped;
+        /// Total bytes released by channel_read_unmap().
+        uint64_t bytes_read;
+    };
+
+    /// A snapshot of a channel's usage. Counters start over when the channel
+    /// is emptied by channel_reserve().
+    struct channel_stats
+    {
+        size_t capacity_bytes;
+
+        /// Bytes the writer can't reuse until the slowest reader holding it
+        /// back consumes them. Lossy readers that aren't mapped don't count.
+        size_t occupancy_bytes;
+
+        /// Largest `occupancy_bytes` seen by the writer after a write.
+        size_t high_water_bytes;
+
+        uint64_t bytes_written;
+
+        /// Number of times the writer wrapped around to the start.
+        uint64_t wrap_count;
+
+        /// Bytes left unused at the end of the buffer when the writer wrapped.
+        uint64_t wasted_bytes;
+
+        /// Time the writer spent waiting for readers in channel_write_map(),
+        /// and the number of writes that had to wait.
+        uint64_t writer_blocked_us;
+        uint64_t writer_blocked_count;
     };
 
+    /// @brief Initializes the channel.
+    /// @param[in] capacity Size of the channel's buffer in bytes. May be 0, in
+    ///                     which case no memory is allocated until
+    ///                     channel_reserve() is called.
     void channel_new(struct channel* self, size_t capacity);
 
+    /// @brief Empties the channel and makes sure its buffer holds exactly
+    /// `capacity` bytes, reallocating it if the size differs.
+    /// @details Every reader is moved back to the start. Only call this while
+    /// there are no active writers or readers.
+    /// Memory is allocated but not touched, so pages are committed as the
+    /// writer first reaches them.
+    /// @returns 1 on success, otherwise 0.
+    int channel_reserve(struct channel* self, size_t capacity);
+
+    /// @brief Places the channel's buffer in shared memory named `name`, so
+    /// readers in other processes can map it. See shared_monitor.h.
+    /// @details Takes effect at the next channel_reserve(), which allocates
+    /// the buffer again when the name changed. An empty or null `name` stops
+    /// sharing. Only call this while there are no active writers or readers.
+    /// @returns 1 on success, or 0 if `name` is too long.
+    int channel_share(struct channel* self, const char* name);
+
+    /// @brief Allocates the channel's buffer on NUMA node `node`, or where
+    /// the system likes when `node` is negative. See memory_alloc_on_node().
+    /// @details Takes effect at the next channel_reserve(), which allocates
+    /// the buffer again when the node changed. Buffers in shared memory are
+    /// left to the system. Only call this while there are no active writers
+    /// or readers.
+    void channel_set_numa_node(struct channel* self, int32_t node);
+
+    /// @brief Allocates the channel's buffer with `allocator`, or with
+    /// memory_alloc() when it's NULL or has no `alloc`.
+    /// @details Takes effect at the next channel_reserve(), which allocates
+    /// the buffer again when the allocator changed. A buffer is freed with
+    /// the allocator that allocated it, so its `ctx` must stay valid till
+    /// then. Buffers in shared memory are left to the system. Only call this
+    /// while there are no active writers or readers.
+    void channel_set_allocator(struct channel* self,
+                               const struct channel_allocator* allocator);
+
+    /// @brief Pads frames written to the channel out to a multiple of
+    /// `alignment_bytes`, so with a buffer aligned as well, every frame
+    /// starts on a boundary the reader can hand on without copying.
+    /// @details Values below 8, the default, are raised to 8. Only call this
+    /// while there are no active writers.
+    void channel_set_frame_alignment(struct channel* self,
+                                     size_t alignment_bytes);
+
+    /// @returns The bytes a frame holding `bytes_of_image` bytes of pixels
+    /// takes up in the channel, header and padding included.
+    size_t channel_bytes_of_frame(const struct channel* self,
+                                  size_t bytes_of_image);
+
+    /// @returns `capacity` rounded up to a whole number of frames holding
+    /// `bytes_of_image` bytes of pixels each, or `capacity` when
+    /// `bytes_of_image` is 0.
+    /// @details Otherwise, frames of that size stop short of the end of the
+    /// buffer, and the writer wraps early, every time round, leaving the
+    /// bytes in between unused.
+    size_t channel_capacity_of_whole_frames(const struct channel* self,
+                                            size_t capacity,
+                                            size_t bytes_of_image);
+
+    /// @brief Frees the channel's buffer and reader cursors.
+    /// @details Readers registered with the channel must not be used with it
+    /// afterwards.
     void channel_release(struct channel* self);
 
     void* channel_write_map(struct channel* self, size_t nbytes);
 
     void channel_write_unmap(struct channel* self);
 
+    /// @brief Maps room for up to `*count` writes of `nbytes` each, laid out
+    /// back to back, so a burst can be committed at once with
+    /// channel_write_unmap_batch().
+    /// @details `*count` is reduced so the batch takes at most half the
+    /// channel. On return it holds the number of writes mapped, or 0 if
+    /// nothing was mapped.
+    void* channel_write_map_batch(struct channel* self,
+                                  size_t nbytes,
+                                  size_t* count);
+
+    /// @brief Commits the first `count` writes of the region mapped by
+    /// channel_write_map_batch() and releases the rest.
+    /// @details Readers see the committed writes all at once.
+    /// channel_write_unmap() is the same as committing one write.
+    void channel_write_unmap_batch(struct channel* self, size_t count);
+
+    /// @brief Commits a write mapped by channel_write_map() that only
+    /// needed its first `nbytes`, and releases the rest.
+    /// @details `nbytes` should come from channel_bytes_of_frame(), so the
+    /// next frame stays aligned.
+    void channel_write_unmap_bytes(struct channel* self, size_t nbytes);
+
     void channel_abort_write(struct channel* self);
 
     void channel_accept_writes(struct channel* self, uint32_t tf);
 
+    /// @brief Chooses whether the writer may overrun `reader`.
+    /// @details A lossy reader never stalls the writer for longer than it holds
+    /// a mapped region. When it falls behind, its next map skips ahead to the
+    /// newest write and the writes it missed are added to `reader->skipped`.
+    /// Changing the policy of a registered reader moves it to the writer's
+    /// head. Don't call this while `reader` has a region mapped.
+    void channel_reader_set_lossy(struct channel* self,
+                                  struct channel_reader* reader,
+                                  uint32_t is_lossy);
+
+    /// @brief Removes `reader` from the channel, releasing any region it has
+    /// mapped, so it stops holding back the writer.
+    /// @details The reader's slot is reused by the next reader to register.
+    /// Using `reader` again registers it anew, starting at the beginning of the
+    /// writer's current cycle.
+    void channel_reader_detach(struct channel* self,
+                               struct channel_reader* reader);
+
     struct slice channel_read_map(struct channel* self,
                                   struct channel_reader* reader);
 
+    /// @brief Like channel_read_map(), but maps only the newest write,
+    /// skipping whatever the reader hadn't read before it.
+    /// @details The writes passed over are added to `reader->skipped`. Maps
+    /// nothing when the reader has already read the newest write. Takes the
+    /// same time however far behind the reader is.
+    struct slice channel_read_map_latest(struct channel* self,
+                                         struct channel_reader* reader);
+
+    /// @brief Like channel_read_map() but, when nothing is available, blocks
+    /// until the writer commits more data, channel_wake_readers() is called,
+    /// or `timeout_ms` elapses.
+    /// @details Returns an empty slice on timeout or wake up. A call to
+    /// channel_wake_readers() made while the reader wasn't waiting makes the
+    /// reader's next wait return immediately, so a stop request isn't missed.
+    /// A `timeout_ms` of 0 does not block.
+    struct slice channel_read_map_wait(struct channel* self,
+                                       struct channel_reader* reader,
+                                       uint32_t timeout_ms);
+
+    /// @brief Like channel_read_map_wait(), for a reader that holds on to the
+    /// first `nbytes_seen` bytes it maps across unmaps: blocks unless more
+    /// than that are mapped.
+    /// @details Waits until the writer commits more data,
+    /// channel_wake_readers() is called, or `timeout_ms` elapses, then maps
+    /// again. Returns straight away when the writer committed more since the
+    /// first map.
+    struct slice channel_read_map_wait_past(struct channel* self,
+                                            struct channel_reader* reader,
+                                            size_t nbytes_seen,
+                                            uint32_t timeout_ms);
+
+    /// @brief Wakes readers blocked in channel_read_map_wait(), for example
+    /// so they notice a request to stop.
+    void channel_wake_readers(struct channel* self);
+
     void channel_read_unmap(struct channel* self,
                             struct channel_reader* reader,
                             size_t consumed_bytes);
 
+    /// @brief Keeps the writer off the region `reader` has mapped until
+    /// `hold` is detached with channel_reader_detach(), so the region stays
+    /// intact after `reader` unmaps it and moves on.
+    /// @details Call before channel_read_unmap(). `hold` registers with the
+    /// channel like a reader that never maps, and holds back the writer even
+    /// when `reader` is lossy. Several holds may be kept at once, and
+    /// detached in any order.
+    /// @returns 1 on success, or 0 if `reader` has nothing mapped or `hold`
+    /// is already registered.
+    int channel_read_hold(struct channel* self,
+                          const struct channel_reader* reader,
+                          struct channel_reader* hold);
+
+    /// @brief Number of bytes written to the channel that `reader` has not
+    /// consumed yet.
+    /// @details Safe to call from any thread. The result is a snapshot and
+    /// may be stale by the time it is returned.
+    size_t channel_bytes_unread(const struct channel* self,
+                                const struct channel_reader* reader);
+
+    /// @brief Takes a snapshot of the channel's usage.
+    /// @details Safe to call from any thread. The fields are read one at a
+    /// time, so they may not all describe exactly the same moment.
+    void channel_get_stats(const struct channel* self,
+                           struct channel_stats* stats);
+
 #ifdef __cplusplus
 } // end extern "C"
 #endif //__cplusplus
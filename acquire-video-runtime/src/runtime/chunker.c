@@ -0,0 +1,282 @@
+#include "chunker.h"
+#include "logger.h"
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+int
+chunker_init(struct chunker* self,
+             const struct StorageDimension* dims,
+             size_t ndims,
+             const struct ImageShape* shape)
+{
+    *self = (struct chunker){ .shape = *shape };
+    EXPECT(ndims >= 3,
+           "CHUNKER: Expected at least 3 acquisition dimensions. Got %d.",
+           (int)ndims);
+    EXPECT(shape->dims.channels == 1 && shape->dims.planes == 1,
+           "CHUNKER: Expected frames with one channel and one plane.");
+    EXPECT(dims[0].array_size_px == shape->dims.width &&
+             dims[1].array_size_px == shape->dims.height,
+           "CHUNKER: The first two acquisition dimensions (%ux%u) must match "
+           "the frame (%ux%u).",
+           dims[0].array_size_px,
+           dims[1].array_size_px,
+           shape->dims.width,
+           shape->dims.height);
+
+    self->ndims = (uint32_t)ndims;
+    CHECK(self->dims = calloc(ndims, sizeof(*self->dims)));
+    self->bytes_per_px = bytes_of_type(shape->type);
+    self->bytes_of_chunk = self->bytes_per_px;
+    self->frames_per_layer = 1;
+    self->chunks_per_layer = 1;
+    for (size_t i = 0; i < ndims; ++i) {
+        const int is_append = i == ndims - 1;
+        EXPECT(dims[i].chunk_size_px > 0,
+               "CHUNKER: Dimension %d has no chunk size.",
+               (int)i);
+        EXPECT(is_append || dims[i].array_size_px > 0,
+               "CHUNKER: Dimension %d has no size.",
+               (int)i);
+        struct chunker_dimension* d = self->dims + i;
+        d->array_size_px = dims[i].array_size_px;
+        d->chunk_size_px = dims[i].chunk_size_px;
+        if (!is_append) {
+            d->chunk_count = (d->array_size_px + d->chunk_size_px - 1) /
+                             d->chunk_size_px;
+            self->chunks_per_layer *= d->chunk_count;
+        }
+        self->bytes_of_chunk *= d->chunk_size_px;
+        if (i >= 2)
+            self->frames_per_layer *=
+              is_append ? d->chunk_size_px : d->array_size_px;
+    }
+
+    const size_t bytes_of_layer = self->chunks_per_layer * self->bytes_of_chunk;
+    EXPECT(self->data = memory_alloc(bytes_of_layer, AllocatorHint_Default),
+           "CHUNKER: Failed to allocate %llu bytes for a layer of chunks.",
+           (unsigned long long)bytes_of_layer);
+    memset(self->data, 0, bytes_of_layer); // NOLINT
+    CHECK(self->lattice_positions = calloc(self->chunks_per_layer * ndims,
+                                           sizeof(*self->lattice_positions)));
+    CHECK(self->chunks =
+            calloc(self->chunks_per_layer, sizeof(*self->chunks)));
+    for (uint64_t c = 0; c < self->chunks_per_layer; ++c) {
+        self->chunks[c] = (struct StorageChunk){
+            .lattice_position = self->lattice_positions + c * ndims,
+            .data = self->data + c * self->bytes_of_chunk,
+            .bytes_of_data = self->bytes_of_chunk,
+        };
+    }
+    return 1;
+Error:
+    chunker_destroy(self);
+    return 0;
+}
+
+void
+chunker_destroy(struct chunker* self)
+{
+    free(self->dims);
+    memory_free(self->data);
+    free(self->lattice_positions);
+    free(self->chunks);
+    *self = (struct chunker){ 0 };
+}
+
+/// Hands the current layer to `emit` and starts the next one.
+static int
+emit_layer(struct chunker* self, chunker_emit_t emit, void* ctx)
+{
+    for (uint64_t c = 0; c < self->chunks_per_layer; ++c) {
+        uint32_t* pos = self->lattice_positions + c * self->ndims;
+        uint64_t rest = c;
+        for (uint32_t i = 0; i + 1 < self->ndims; ++i) {
+            pos[i] = (uint32_t)(rest % self->dims[i].chunk_count);
+            rest /= self->dims[i].chunk_count;
+        }
+        pos[self->ndims - 1] = self->layer;
+    }
+    CHECK(emit(ctx, self->chunks, self->chunks_per_layer));
+    memset(self->data, 0, self->chunks_per_layer * self->bytes_of_chunk);
+    self->frames_in_layer = 0;
+    ++self->layer;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+chunker_push(struct chunker* self,
+             const struct VideoFrame* frame,
+             chunker_emit_t emit,
+             void* ctx)
+{
+    const struct ImageShape* shape = &frame->shape;
+    EXPECT(shape->dims.width == self->shape.dims.width &&
+             shape->dims.height == self->shape.dims.height &&
+             shape->type == self->shape.type,
+           "CHUNKER: Frame %llu doesn't match the shape chunks are assembled "
+           "from.",
+           (unsigned long long)frame->frame_id);
+
+    // Where the frame falls along the dimensions past the first two, as the
+    // first chunk it's in and the plane of that chunk it fills.
+    const struct chunker_dimension* dims = self->dims;
+    uint64_t chunk = 0, plane = 0;
+    {
+        uint64_t rest = self->frames_in_layer;
+        uint64_t chunk_stride =
+          (uint64_t)dims[0].chunk_count * dims[1].chunk_count;
+        uint64_t plane_stride = 1;
+        for (uint32_t i = 2; i < self->ndims; ++i) {
+            const int is_append = i == self->ndims - 1;
+            const uint32_t extent =
+              is_append ? dims[i].chunk_size_px : dims[i].array_size_px;
+            const uint64_t k = rest % extent;
+            rest /= extent;
+            chunk += (k / dims[i].chunk_size_px) * chunk_stride;
+            plane += (k % dims[i].chunk_size_px) * plane_stride;
+            chunk_stride *= dims[i].chunk_count;
+            plane_stride *= dims[i].chunk_size_px;
+        }
+    }
+
+    // Rows of each chunk the frame covers are copied in whole. The first
+    // dimension varies fastest in both, so no pixels are reordered.
+    const size_t bpp = self->bytes_per_px;
+    const uint32_t cw = dims[0].chunk_size_px, ch = dims[1].chunk_size_px;
+    const size_t bytes_of_chunk_row = cw * bpp;
+    const size_t bytes_of_frame_row = shape->strides.height * bpp;
+    const uint8_t* const src = frame->data;
+    uint8_t* dst_plane = self->data + chunk * self->bytes_of_chunk +
+                         plane * cw * ch * bpp;
+    for (uint32_t cy = 0; cy < dims[1].chunk_count; ++cy) {
+        const uint32_t y0 = cy * ch;
+        const uint32_t h = min(ch, shape->dims.height - y0);
+        for (uint32_t cx = 0; cx < dims[0].chunk_count; ++cx) {
+            const uint32_t x0 = cx * cw;
+            const size_t nbytes = min(cw, shape->dims.width - x0) * bpp;
+            uint8_t* dst = dst_plane;
+            const uint8_t* row = src + y0 * bytes_of_frame_row + x0 * bpp;
+            for (uint32_t y = 0; y < h; ++y) {
+                memcpy(dst, row, nbytes); // NOLINT
+                dst += bytes_of_chunk_row;
+                row += bytes_of_frame_row;
+            }
+            dst_plane += self->bytes_of_chunk;
+        }
+    }
+
+    if (++self->frames_in_layer == self->frames_per_layer)
+        CHECK(emit_layer(self, emit, ctx));
+    return 1;
+Error:
+    return 0;
+}
+
+int
+chunker_flush(struct chunker* self, chunker_emit_t emit, void* ctx)
+{
+    if (!self->frames_in_layer)
+        return 1;
+    return emit_layer(self, emit, ctx);
+}
+
+#ifndef NO_UNIT_TESTS
+
+struct chunk_sink
+{
+    int nlayers;
+    uint8_t data[2][8][8];
+    uint32_t positions[2][8][3];
+};
+
+static int
+record_layer(void* ctx, const struct StorageChunk* chunks, size_t count)
+{
+    struct chunk_sink* sink = ctx;
+    if (sink->nlayers >= 2 || count != 4)
+        return 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (chunks[i].bytes_of_data != 8)
+            return 0;
+        memcpy(sink->data[sink->nlayers][i], chunks[i].data, 8); // NOLINT
+        memcpy(sink->positions[sink->nlayers][i], // NOLINT
+               chunks[i].lattice_position,
+               sizeof(sink->positions[0][0]));
+    }
+    ++sink->nlayers;
+    return 1;
+}
+
+/// 3x3 frames cut into 2x2x2 chunks come out a layer of 4 chunks per 2
+/// frames, each chunk contiguous, with the edges padded with zeros.
+int
+unit_test__chunker_assembles_layers_of_chunks()
+{
+    struct chunker chunker = { 0 };
+    struct chunk_sink sink = { 0 };
+    const struct StorageDimension dims[] = {
+        { .array_size_px = 3, .chunk_size_px = 2 },
+        { .array_size_px = 3, .chunk_size_px = 2 },
+        { .array_size_px = 0, .chunk_size_px = 2 },
+    };
+    const struct ImageShape shape = {
+        .dims = { .channels = 1, .width = 3, .height = 3, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = 3, .planes = 9 },
+        .type = SampleType_u8,
+    };
+    uint64_t buf[3][(sizeof(struct VideoFrame) + 16) / 8];
+    struct VideoFrame* frames[3];
+    for (int i = 0; i < 3; ++i) {
+        frames[i] = (struct VideoFrame*)buf[i];
+        *frames[i] = (struct VideoFrame){ .shape = shape, .frame_id = i };
+        for (int p = 0; p < 9; ++p)
+            frames[i]->data[p] = (uint8_t)(10 * (i + 1) + p);
+    }
+    CHECK(chunker_init(&chunker, dims, 3, &shape));
+    CHECK(chunker.chunks_per_layer == 4 && chunker.frames_per_layer == 2);
+    for (int i = 0; i < 3; ++i)
+        CHECK(chunker_push(&chunker, frames[i], record_layer, &sink));
+    CHECK(sink.nlayers == 1);
+    CHECK(chunker_flush(&chunker, record_layer, &sink));
+    CHECK(sink.nlayers == 2);
+
+    {
+        // Chunk (1,0,0) holds column 2 of rows 0-1 of frames 0 and 1.
+        const uint8_t expected[] = { 12, 0, 15, 0, 22, 0, 25, 0 };
+        CHECK(memcmp(sink.data[0][1], expected, 8) == 0);
+        CHECK(sink.positions[0][1][0] == 1 && sink.positions[0][1][1] == 0 &&
+              sink.positions[0][1][2] == 0);
+    }
+    {
+        // Chunk (1,1,1) holds the corner pixel of frame 2, and zeros.
+        const uint8_t expected[] = { 38, 0, 0, 0, 0, 0, 0, 0 };
+        CHECK(memcmp(sink.data[1][3], expected, 8) == 0);
+        CHECK(sink.positions[1][3][0] == 1 && sink.positions[1][3][1] == 1 &&
+              sink.positions[1][3][2] == 1);
+    }
+    chunker_destroy(&chunker);
+    return 1;
+Error:
+    chunker_destroy(&chunker);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
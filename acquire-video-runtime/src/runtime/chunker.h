@@ -0,0 +1,81 @@
+#ifndef H_ACQUIRE_RUNTIME_CHUNKER_V0
+#define H_ACQUIRE_RUNTIME_CHUNKER_V0
+
+#include "device/props/components.h"
+#include "device/props/storage.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Assembles frames into the chunks of the array described by a storage
+    /// device's `acquisition_dimensions`, so chunked storage gets each chunk
+    /// contiguous instead of cutting up frames itself.
+    /// @details The first two dimensions span a frame and the last is the
+    /// append dimension. Frames step through the ones in between, the first
+    /// fastest. Chunks are assembled a layer at a time: every chunk touched
+    /// by the frames up to the next chunk boundary along the append
+    /// dimension.
+    struct chunker
+    {
+        uint32_t ndims;
+
+        /// One per dimension. The append dimension's `chunk_count` is 0.
+        struct chunker_dimension
+        {
+            uint32_t array_size_px, chunk_size_px, chunk_count;
+        }* dims;
+
+        /// Every frame has this shape.
+        struct ImageShape shape;
+        size_t bytes_per_px;
+        size_t bytes_of_chunk;
+
+        uint64_t frames_per_layer;
+        uint64_t chunks_per_layer;
+
+        /// Frames added to the current layer, and the index of that layer
+        /// along the append dimension.
+        uint64_t frames_in_layer;
+        uint32_t layer;
+
+        /// `chunks_per_layer` chunks back to back, with `ndims` lattice
+        /// positions for each.
+        uint8_t* data;
+        uint32_t* lattice_positions;
+        struct StorageChunk* chunks;
+    };
+
+    /// Called with each layer of chunks once it's assembled.
+    /// @returns 1 on success, otherwise 0.
+    typedef int (*chunker_emit_t)(void* ctx,
+                                  const struct StorageChunk* chunks,
+                                  size_t count);
+
+    /// @brief Prepares to assemble frames of `shape` into the chunks
+    /// described by `dims[0,ndims)`.
+    /// @returns 1 on success, otherwise 0.
+    int chunker_init(struct chunker* self,
+                     const struct StorageDimension* dims,
+                     size_t ndims,
+                     const struct ImageShape* shape);
+
+    void chunker_destroy(struct chunker* self);
+
+    /// @brief Copies `frame` into the chunks it falls in, and passes the
+    /// layer to `emit` once the frame completes it.
+    int chunker_push(struct chunker* self,
+                     const struct VideoFrame* frame,
+                     chunker_emit_t emit,
+                     void* ctx);
+
+    /// @brief Passes a partly filled layer to `emit`, padded with zeros.
+    /// Does nothing when no frames were added since the last layer.
+    int chunker_flush(struct chunker* self, chunker_emit_t emit, void* ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_RUNTIME_CHUNKER_V0
@@ -0,0 +1,209 @@
+#include "clock_sync.h"
+#include "logger.h"
+
+#include <math.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+void
+clock_sync_init(struct clock_sync* self)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    lock_init(&self->lock);
+}
+
+void
+clock_sync_reset(struct clock_sync* self)
+{
+    self->count = 0;
+    self->next = 0;
+    self->since_fit = 0;
+    lock_acquire(&self->lock);
+    self->has_model = 0;
+    lock_release(&self->lock);
+}
+
+/// Fits the line through the pairs recorded, relative to the newest one so
+/// the differences stay small enough for doubles to hold exactly.
+static void
+fit(struct clock_sync* self)
+{
+    const uint32_t newest =
+      (self->next + CLOCK_SYNC_SAMPLES - 1) % CLOCK_SYNC_SAMPLES;
+    const uint64_t hardware0 = self->hardware[newest];
+    const uint64_t host0 = self->host[newest];
+    const uint32_t n = self->count;
+    const uint32_t first = (self->next + CLOCK_SYNC_SAMPLES - n) %
+                           CLOCK_SYNC_SAMPLES;
+
+    double mx = 0.0, my = 0.0;
+    for (uint32_t k = 0; k < n; ++k) {
+        const uint32_t i = (first + k) % CLOCK_SYNC_SAMPLES;
+        mx += (double)(int64_t)(self->hardware[i] - hardware0);
+        my += (double)(int64_t)(self->host[i] - host0);
+    }
+    mx /= n;
+    my /= n;
+    double sxx = 0.0, sxy = 0.0;
+    for (uint32_t k = 0; k < n; ++k) {
+        const uint32_t i = (first + k) % CLOCK_SYNC_SAMPLES;
+        const double dx =
+          (double)(int64_t)(self->hardware[i] - hardware0) - mx;
+        const double dy = (double)(int64_t)(self->host[i] - host0) - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    if (sxx <= 0.0)
+        return; // Every pair has the same hardware timestamp.
+    const double slope = sxy / sxx;
+
+    // The line is lowered onto the pair that arrived fastest.
+    double floor = 0.0, sse = 0.0;
+    for (uint32_t k = 0; k < n; ++k) {
+        const uint32_t i = (first + k) % CLOCK_SYNC_SAMPLES;
+        const double x = (double)(int64_t)(self->hardware[i] - hardware0);
+        const double y = (double)(int64_t)(self->host[i] - host0);
+        const double above = y - slope * x;
+        if (above < floor)
+            floor = above;
+        const double r = y - (my + slope * (x - mx));
+        sse += r * r;
+    }
+
+    const struct clock_sync_model model = {
+        .hardware_origin = hardware0,
+        .host_origin = host0 + (uint64_t)(int64_t)floor,
+        .host_per_hardware = slope,
+        .residual = sqrt(sse / n),
+        .sample_count = n,
+    };
+    lock_acquire(&self->lock);
+    self->model = model;
+    self->has_model = 1;
+    lock_release(&self->lock);
+}
+
+void
+clock_sync_record(struct clock_sync* self, uint64_t hardware, uint64_t host)
+{
+    if (!hardware)
+        return;
+    if (self->count) {
+        const uint32_t newest =
+          (self->next + CLOCK_SYNC_SAMPLES - 1) % CLOCK_SYNC_SAMPLES;
+        if (hardware <= self->hardware[newest]) {
+            if (hardware == self->hardware[newest])
+                return; // Nothing new about the camera's clock.
+            LOG("Hardware timestamps went back from %llu to %llu. Starting "
+                "over.",
+                (unsigned long long)self->hardware[newest],
+                (unsigned long long)hardware);
+            self->count = 0;
+            self->next = 0;
+            self->since_fit = 0;
+        }
+    }
+    self->hardware[self->next] = hardware;
+    self->host[self->next] = host;
+    self->next = (self->next + 1) % CLOCK_SYNC_SAMPLES;
+    if (self->count < CLOCK_SYNC_SAMPLES)
+        ++self->count;
+    // Fit as soon as there are enough pairs, then every so often.
+    if (self->count >= CLOCK_SYNC_MIN_SAMPLES &&
+        (self->count == CLOCK_SYNC_MIN_SAMPLES ||
+         ++self->since_fit >= CLOCK_SYNC_FIT_EVERY)) {
+        self->since_fit = 0;
+        fit(self);
+    }
+}
+
+void
+clock_sync_flush(struct clock_sync* self)
+{
+    if (self->count >= CLOCK_SYNC_MIN_SAMPLES && self->since_fit) {
+        self->since_fit = 0;
+        fit(self);
+    }
+}
+
+int
+clock_sync_get(struct clock_sync* self, struct clock_sync_model* out)
+{
+    lock_acquire(&self->lock);
+    const int has_model = self->has_model;
+    if (has_model)
+        *out = self->model;
+    lock_release(&self->lock);
+    return has_model;
+}
+
+uint64_t
+clock_sync_to_host(const struct clock_sync_model* model, uint64_t hardware)
+{
+    const double dx = (double)(int64_t)(hardware - model->hardware_origin);
+    return model->host_origin +
+           (uint64_t)(int64_t)llround(dx * model->host_per_hardware);
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// A camera clock ticking every 10 ns, 50 ppm fast, whose frames arrive
+/// 5 us late plus up to 20 us more.
+int
+unit_test__clock_sync_fits_drift_and_latency()
+{
+    static struct clock_sync sync;
+    struct clock_sync_model model = { 0 };
+    clock_sync_init(&sync);
+
+    uint32_t seed = 1;
+    const uint64_t host_start = 1ULL << 40;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        const uint64_t t = host_start + i * 1000000; // 1 ms apart
+        const uint64_t hardware =
+          12345 + (uint64_t)((double)(t - host_start) * 1.00005 / 10.0);
+        seed = seed * 1664525u + 1013904223u;
+        const uint64_t late = 5000 + (i % 16 ? (seed >> 8) % 20000 : 0);
+        clock_sync_record(&sync, hardware, t + late);
+        CHECK(clock_sync_get(&sync, &model) ==
+              (i + 1 >= CLOCK_SYNC_MIN_SAMPLES));
+    }
+    CHECK(model.sample_count == CLOCK_SYNC_SAMPLES);
+    EXPECT(fabs(model.host_per_hardware * 1.00005 - 10.0) < 1e-4,
+           "Got %f host tics per hardware tic.",
+           model.host_per_hardware);
+    CHECK(model.residual > 1000.0 && model.residual < 20000.0);
+    {
+        // Maps onto when the frame would have arrived with the least delay.
+        const uint64_t t = host_start + 999 * 1000000;
+        const uint64_t hardware =
+          12345 + (uint64_t)((double)(t - host_start) * 1.00005 / 10.0);
+        const int64_t err =
+          (int64_t)(clock_sync_to_host(&model, hardware) - (t + 5000));
+        // Within 1 us, where the frames arrive up to 20 us later than that.
+        EXPECT(err > -1000 && err < 1000, "Off by %lld tics.", (long long)err);
+    }
+
+    // A clock that goes back starts over, and 0 is ignored.
+    clock_sync_record(&sync, 1, host_start);
+    clock_sync_record(&sync, 0, host_start);
+    CHECK(sync.count == 1);
+    clock_sync_reset(&sync);
+    CHECK(!clock_sync_get(&sync, &model));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
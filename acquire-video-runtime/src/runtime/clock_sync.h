@@ -0,0 +1,104 @@
+//! Maps a camera's hardware timestamps onto the host clock, so frames from
+//! several cameras can be lined up on one timeline.
+//!
+//! Each frame pairs the camera's timestamp with the clock_tic_fast() read
+//! when it reached the source thread, which is later by however long the
+//! frame took to arrive. The last `CLOCK_SYNC_SAMPLES` pairs are kept, and
+//! every `CLOCK_SYNC_FIT_EVERY` frames a line is fit through them:
+//! least-squares for the slope, which follows the drift between the two
+//! clocks, and the lowest pair for the offset, since the frames that arrived
+//! fastest were held up least. The line maps a hardware timestamp to when
+//! the frame would have arrived without any delay.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     struct clock_sync_model model;
+//!     if (clock_sync_get(&sync, &model))
+//!         host = clock_sync_to_host(&model, frame->timestamps.hardware);
+//! ~~~
+//!
+//! Pairs are recorded by a single thread. The model may be read from any.
+
+#ifndef H_ACQUIRE_CLOCK_SYNC_V0
+#define H_ACQUIRE_CLOCK_SYNC_V0
+
+#include "platform.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Pairs of timestamps the line is fit through.
+#define CLOCK_SYNC_SAMPLES (256)
+/// Pairs recorded between fits.
+#define CLOCK_SYNC_FIT_EVERY (32)
+/// Pairs needed before the first fit.
+#define CLOCK_SYNC_MIN_SAMPLES (8)
+
+    /// `host = host_origin + (hardware - hardware_origin) * host_per_hardware`,
+    /// with `host` in clock_tic() tics.
+    struct clock_sync_model
+    {
+        uint64_t hardware_origin;
+        uint64_t host_origin;
+        double host_per_hardware;
+
+        /// Root mean square distance of the pairs from the least-squares
+        /// line, in host tics: how much the time frames take to arrive
+        /// varies.
+        double residual;
+
+        /// Pairs the line was fit through.
+        uint32_t sample_count;
+    };
+
+    struct clock_sync
+    {
+        /// Only touched by the thread recording pairs. `hardware` increases
+        /// from one pair to the next; a camera whose clock goes back starts
+        /// over.
+        uint64_t hardware[CLOCK_SYNC_SAMPLES];
+        uint64_t host[CLOCK_SYNC_SAMPLES];
+        uint32_t count, next, since_fit;
+
+        /// The last fit. Guarded by `lock`.
+        struct lock lock;
+        struct clock_sync_model model;
+        uint8_t has_model;
+    };
+
+    void clock_sync_init(struct clock_sync* self);
+
+    /// @brief Forgets every pair and the model, as when the camera restarts
+    /// and its clock may have too.
+    void clock_sync_reset(struct clock_sync* self);
+
+    /// @brief Records the hardware timestamp of a frame and the host time it
+    /// arrived at, and fits the line again when it's due. Timestamps of 0,
+    /// from cameras that don't have a clock, are ignored.
+    void clock_sync_record(struct clock_sync* self,
+                           uint64_t hardware,
+                           uint64_t host);
+
+    /// @brief Fits the line through any pairs recorded since the last fit, as
+    /// when the camera stops.
+    void clock_sync_flush(struct clock_sync* self);
+
+    /// @brief Copies the last fit.
+    /// @returns 1 on success, or 0 if there hasn't been one yet.
+    int clock_sync_get(struct clock_sync* self, struct clock_sync_model* out);
+
+    /// @returns The host time, in clock_tic() tics, of the hardware timestamp
+    /// `hardware`.
+    uint64_t clock_sync_to_host(const struct clock_sync_model* model,
+                                uint64_t hardware);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_CLOCK_SYNC_V0
@@ -0,0 +1,347 @@
+#include "fanout.h"
+#include "crc32c.h"
+#include "frame_iterator.h"
+#include "logger.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+// The fan-out thread is woken as soon as frames arrive or it's asked to
+// stop. This bounds how long it sleeps otherwise.
+#define FANOUT_WAIT_TIMEOUT_MS (100)
+
+static void
+sig_output_stop_source(const struct video_sink_s* sink)
+{
+    struct video_fanout_output* const output =
+      containerof(sink, struct video_fanout_output, sink);
+    // Nothing reads the output's queue anymore, so the fan-out thread
+    // mustn't wait for room in it.
+    channel_accept_writes(&output->sink.in, 0);
+    output->fanout->sig_stop_source(output->fanout);
+}
+
+/// @returns 1 if frames of shape `in` can be cropped by `output`, and sets
+/// `out` to the shape of the crops.
+static int
+output_shape(const struct video_fanout_output* output,
+             const struct ImageShape* in,
+             struct ImageShape* out)
+{
+    // Crops copy whole samples, so packed samples would be split.
+    return sample_type_unpacked(in->type) == in->type &&
+           output->crop.ops->shape(&output->crop, in, out);
+}
+
+/// Writes the region of `in` to the output's queue. Frames that can't be
+/// cropped are dropped.
+static void
+write_crop(struct video_fanout_s* self,
+           struct video_fanout_output* output,
+           const struct VideoFrame* in)
+{
+    struct ImageShape shape = { 0 };
+    if (in->compression != FrameCompression_None ||
+        !output_shape(output, &in->shape, &shape)) {
+        if (!output->has_logged_rejection)
+            LOGE("[stream %d] FANOUT: Can't crop %ux%u %s frames to "
+                 "(%u,%u) %ux%u. Dropping them.",
+                 self->stream_id,
+                 in->shape.dims.width,
+                 in->shape.dims.height,
+                 sample_type_as_string(in->shape.type),
+                 output->crop.params.roi.x,
+                 output->crop.params.roi.y,
+                 output->crop.params.roi.width,
+                 output->crop.params.roi.height);
+        output->has_logged_rejection = 1;
+        return;
+    }
+
+    const size_t nbytes =
+      channel_bytes_of_frame(&output->sink.in, bytes_of_image(&shape));
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&output->sink.in, nbytes);
+    if (!out) // aborted
+        return;
+    *out = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .shape = shape,
+        .frame_id = in->frame_id,
+        .hardware_frame_id = in->hardware_frame_id,
+        .hardware_frame_gap = in->hardware_frame_gap,
+        .timestamps = in->timestamps,
+        .stage_position = in->stage_position,
+        .has_stage_position = in->has_stage_position,
+    };
+    output->crop.ops->process(&output->crop, in, out, 1);
+    if (in->has_checksum) {
+        out->checksum = crc32c_of_frame(out);
+        out->has_checksum = 1;
+    }
+    channel_write_unmap(&output->sink.in);
+}
+
+static int
+video_fanout_thread(struct video_fanout_s* self)
+{
+    thread_set_current_attributes(&self->thread_attributes);
+    LOG("[stream %d] FANOUT: Entering thread", self->stream_id);
+    for (;;) {
+        // Checked before mapping, so once the stream's sink is stopping, an
+        // empty map means every frame has been read.
+        const int is_stopping = load_acquire(&self->is_stopping);
+        struct slice slice = channel_read_map_wait(
+          self->in, &self->reader, FANOUT_WAIT_TIMEOUT_MS);
+        CHECK(self->reader.status == Channel_Ok);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* in = 0;
+        while ((in = frame_iterator_next(&it))) {
+            for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+                if (self->outputs[i].is_enabled)
+                    write_crop(self, self->outputs + i, in);
+            }
+        }
+        channel_read_unmap(self->in, &self->reader, slice.end - slice.beg);
+        if (is_stopping && slice.end == slice.beg)
+            break;
+    }
+    LOG("[stream %d] FANOUT: Exiting thread", self->stream_id);
+Finalize:
+    // The outputs' sinks drain what they were given and stop.
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_sink_s* const sink = &self->outputs[i].sink;
+        if (self->outputs[i].is_enabled) {
+            store_release(&sink->is_stopping, 1);
+            channel_wake_readers(&sink->in);
+        }
+    }
+    store_release(&self->is_running, 0);
+    store_release(&self->is_stopping, 0);
+    return 0;
+Error:
+    LOGE("[stream %d] FANOUT: Exiting thread (Error)", self->stream_id);
+    // So the stream isn't held back by a reader that's gone.
+    channel_reader_detach(self->in, &self->reader);
+    self->sig_stop_source(self);
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_fanout_init(struct video_fanout_s* self,
+                  uint8_t stream_id,
+                  struct channel* in,
+                  void (*sig_stop_source)(const struct video_fanout_s*))
+{
+    CHECK(in);
+    *self = (struct video_fanout_s){ .stream_id = stream_id,
+                                     .in = in,
+                                     .sig_stop_source = sig_stop_source };
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-fanout-%d",
+             (int)stream_id);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_fanout_output* const output = self->outputs + i;
+        output->fanout = self;
+        output->crop.ops = &filter_stage_crop;
+        output->crop.params.kind = FilterStage_Crop;
+        CHECK(video_sink_init(&output->sink,
+                              stream_id,
+                              0,
+                              sig_output_stop_source) == Device_Ok);
+        snprintf(output->sink.thread_attributes.name,
+                 sizeof(output->sink.thread_attributes.name),
+                 "acq-roi-%d.%u",
+                 (int)stream_id,
+                 i);
+    }
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_fanout_thread, self);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_fanout_destroy(struct video_fanout_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        video_sink_destroy(&self->outputs[i].sink);
+}
+
+enum DeviceStatusCode
+video_fanout_configure(struct video_fanout_s* self,
+                       uint32_t i,
+                       const struct DeviceManager* device_manager,
+                       const struct filter_stage_params* roi,
+                       struct DeviceIdentifier* identifier,
+                       struct StorageProperties* settings)
+{
+    CHECK(i < countof(self->outputs));
+    struct video_fanout_output* const output = self->outputs + i;
+    output->is_enabled = 0;
+    output->has_logged_rejection = 0;
+    if (identifier->kind == DeviceKind_None || !roi->roi.width ||
+        !roi->roi.height) {
+        if (output->sink.storage) {
+            storage_close(output->sink.storage);
+            output->sink.storage = 0;
+            output->sink.has_applied_settings = 0;
+        }
+        return Device_Ok;
+    }
+
+    output->crop.params.roi = roi->roi;
+    const struct video_sink_coalescing coalescing = { 0 };
+    // The queue is sized once the shape of the frames is known.
+    EXPECT(video_sink_configure(&output->sink,
+                                device_manager,
+                                identifier,
+                                settings,
+                                0.0f,
+                                1,
+                                &coalescing,
+                                output->sink.channel_capacity_bytes) ==
+             Device_Ok,
+           "[stream %d] FANOUT: Failed to configure the storage of region %u.",
+           self->stream_id,
+           i);
+    output->is_enabled = 1;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+video_fanout_reserve_image_shape(struct video_fanout_s* self,
+                                 const struct ImageShape* in,
+                                 size_t capacity_bytes)
+{
+    const size_t bytes_of_frame =
+      channel_bytes_of_frame(self->in, bytes_of_image(in));
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_fanout_output* const output = self->outputs + i;
+        if (!output->is_enabled)
+            continue;
+        struct ImageShape shape = { 0 };
+        EXPECT(output_shape(output, in, &shape),
+               "[stream %d] FANOUT: Can't crop %ux%u %s frames to (%u,%u) "
+               "%ux%u.",
+               self->stream_id,
+               in->dims.width,
+               in->dims.height,
+               sample_type_as_string(in->type),
+               output->crop.params.roi.x,
+               output->crop.params.roi.y,
+               output->crop.params.roi.width,
+               output->crop.params.roi.height);
+        CHECK(Device_Ok ==
+              storage_reserve_image_shape(output->sink.storage, &shape));
+        // Holds a frame more than the stream's queue, so a crop always fits.
+        output->sink.channel_capacity_bytes =
+          (capacity_bytes / bytes_of_frame + 1) *
+          channel_bytes_of_frame(&output->sink.in, bytes_of_image(&shape));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+int
+video_fanout_is_enabled(const struct video_fanout_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        if (self->outputs[i].is_enabled)
+            return 1;
+    }
+    return 0;
+}
+
+int
+video_fanout_is_running(const struct video_fanout_s* self)
+{
+    int is_running = load_acquire(&self->is_running);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        is_running |= load_acquire(&self->outputs[i].sink.is_running);
+    return is_running;
+}
+
+enum DeviceStatusCode
+video_fanout_start(struct video_fanout_s* self)
+{
+    if (!video_fanout_is_enabled(self)) {
+        // Otherwise, the reader left over from an earlier acquisition would
+        // hold the stream back.
+        channel_reader_detach(self->in, &self->reader);
+        return Device_Ok;
+    }
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        if (self->outputs[i].is_enabled)
+            CHECK(video_sink_start(&self->outputs[i].sink) == Device_Ok);
+    }
+    self->reader.bytes_read = 0;
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    CHECK(parked_thread_run(&self->thread));
+    return Device_Ok;
+Error:
+    // Sinks that did start would wait for frames forever.
+    store_release(&self->is_running, 0);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_sink_s* const sink = &self->outputs[i].sink;
+        if (load_acquire(&sink->is_running)) {
+            store_release(&sink->is_stopping, 1);
+            channel_wake_readers(&sink->in);
+        }
+    }
+    return Device_Err;
+}
+
+void
+video_fanout_abort(struct video_fanout_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        if (self->outputs[i].is_enabled)
+            channel_accept_writes(&self->outputs[i].sink.in, 0);
+    }
+}
+
+void
+video_fanout_discard(struct video_fanout_s* self)
+{
+    video_fanout_abort(self);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        video_sink_discard(&self->outputs[i].sink);
+    if (load_acquire(&self->is_running)) {
+        store_release(&self->is_stopping, 1);
+        channel_wake_readers(self->in);
+    }
+}
+
+void
+video_fanout_wait(struct video_fanout_s* self)
+{
+    parked_thread_wait(&self->thread);
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_sink_s* const sink = &self->outputs[i].sink;
+        parked_thread_wait(&sink->thread);
+        channel_accept_writes(&sink->in, 1);
+    }
+}
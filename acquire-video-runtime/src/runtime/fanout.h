@@ -0,0 +1,138 @@
+//! Stores regions of a stream's frames on their own.
+//!
+//! The fan-out thread reads each frame the stream hands to storage, from the
+//! same queue, and crops it into one queue per region. Each of those has a
+//! sink of its own, with its own storage device, so a region is stored
+//! without the rest of the frame ever reaching a disk.
+//!
+//! The thread reads the stream's queue without losing frames, like the
+//! stream's own sink, so a region that's slow to store holds back the
+//! camera. Crops reuse the filter's crop stage, which copies each row of the
+//! region with one memcpy().
+
+#ifndef H_ACQUIRE_FANOUT_V0
+#define H_ACQUIRE_FANOUT_V0
+
+#include "channel.h"
+#include "parked_thread.h"
+#include "sink.h"
+#include "stages.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Most regions one stream can store on their own.
+#define FANOUT_MAX_OUTPUTS (4)
+
+    struct video_fanout_s;
+
+    /// One region, and the sink storing it.
+    struct video_fanout_output
+    {
+        /// Set when the output has a region and a storage device.
+        uint8_t is_enabled;
+
+        /// Crops frames to the region. See `filter_stage_crop`.
+        struct filter_stage crop;
+
+        /// Its `in` channel takes the cropped frames.
+        struct video_sink_s sink;
+
+        struct video_fanout_s* fanout;
+
+        /// Set once a frame that couldn't be cropped has been logged.
+        uint8_t has_logged_rejection;
+    };
+
+    /// Context for the fan-out thread of a stream.
+    struct video_fanout_s
+    {
+        /// Used by external threads to signal the fan-out thread to stop,
+        /// once the stream's sink has been told to. Other threads may write,
+        /// with store_release().
+        uint32_t is_stopping;
+
+        /// When true, the fan-out thread has yet to finish its work.
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
+
+        uint8_t stream_id;
+
+        /// The stream's queue to storage. Not owned.
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Runs the fan-out once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
+
+        struct video_fanout_output outputs[FANOUT_MAX_OUTPUTS];
+
+        /// Called when an output's sink fails, so the stream stops.
+        void (*sig_stop_source)(const struct video_fanout_s*);
+    };
+
+    enum DeviceStatusCode video_fanout_init(
+      struct video_fanout_s* self,
+      uint8_t stream_id,
+      struct channel* in,
+      void (*sig_stop_source)(const struct video_fanout_s*));
+
+    void video_fanout_destroy(struct video_fanout_s* self);
+
+    /// @brief Sets the `i`th output to store `roi` of each frame with the
+    /// storage device `identifier`.
+    /// @details An empty `roi` or a `DeviceKind_None` device turns the output
+    /// off, and closes its storage device. Only call this while the fan-out
+    /// isn't running.
+    enum DeviceStatusCode video_fanout_configure(
+      struct video_fanout_s* self,
+      uint32_t i,
+      const struct DeviceManager* device_manager,
+      const struct filter_stage_params* roi,
+      struct DeviceIdentifier* identifier,
+      struct StorageProperties* settings);
+
+    /// @brief Tells each output's storage the shape of the frames it gets
+    /// from frames of shape `in`, and sizes its queue to hold as many of
+    /// them as `capacity_bytes` holds frames of shape `in`.
+    /// @returns 1 on success, or 0 after logging which output can't store
+    /// regions of `in`.
+    int video_fanout_reserve_image_shape(struct video_fanout_s* self,
+                                         const struct ImageShape* in,
+                                         size_t capacity_bytes);
+
+    /// @returns 1 if any output is enabled.
+    int video_fanout_is_enabled(const struct video_fanout_s* self);
+
+    /// @returns 1 while the fan-out thread or any output's sink is still
+    /// working on the acquisition.
+    int video_fanout_is_running(const struct video_fanout_s* self);
+
+    /// @brief Starts the outputs' sinks and the fan-out thread. Does nothing
+    /// when no output is enabled.
+    /// @details Call this after the stream's sink was started, so its queue
+    /// is empty, and before anything is written to it.
+    enum DeviceStatusCode video_fanout_start(struct video_fanout_s* self);
+
+    /// @brief Stops accepting cropped frames, so the fan-out thread doesn't
+    /// wait on outputs that are aborted.
+    void video_fanout_abort(struct video_fanout_s* self);
+
+    /// @brief Stops the fan-out and drops the crops the outputs' sinks
+    /// haven't stored yet. See video_sink_discard().
+    /// @details The fan-out thread skims what's left in the stream's queue
+    /// without cropping it. The caller stops writes to that queue.
+    void video_fanout_discard(struct video_fanout_s* self);
+
+    /// @brief Waits for the fan-out thread, and then for the outputs' sinks,
+    /// to finish the acquisition.
+    void video_fanout_wait(struct video_fanout_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_FANOUT_V0
@@ -0,0 +1,236 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled for AVX2 regardless of the flags used for the rest of the file.
+// Only called when the CPU supports it. See select_kernels() in filter.c.
+// Each loop handles 8 pixels at a time and leaves the rest to the plain
+// kernels.
+
+FILTER_TARGET("avx2")
+static inline void
+add_epi32_avx2(float* x, __m256i v)
+{
+    const __m256 y = _mm256_cvtepi32_ps(v);
+    _mm256_storeu_ps(x, _mm256_add_ps(_mm256_loadu_ps(x), y));
+}
+
+FILTER_TARGET("avx2")
+static void
+accumulate_u8_avx2(float* x, const uint8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadl_epi64((const __m128i*)(y + i));
+        add_epi32_avx2(x + i, _mm256_cvtepu8_epi32(v));
+    }
+    accumulate_u8_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+accumulate_u16_avx2(float* x, const uint16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(y + i));
+        add_epi32_avx2(x + i, _mm256_cvtepu16_epi32(v));
+    }
+    accumulate_u16_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+accumulate_i8_avx2(float* x, const int8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadl_epi64((const __m128i*)(y + i));
+        add_epi32_avx2(x + i, _mm256_cvtepi8_epi32(v));
+    }
+    accumulate_i8_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+accumulate_i16_avx2(float* x, const int16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(y + i));
+        add_epi32_avx2(x + i, _mm256_cvtepi16_epi32(v));
+    }
+    accumulate_i16_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+accumulate_f32_avx2(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), v));
+    }
+    accumulate_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+subtract_f32_avx2(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(x + i, _mm256_sub_ps(_mm256_loadu_ps(x + i), v));
+    }
+    subtract_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+blend_f32_avx2(float* x, const float* y, float a, size_t n)
+{
+    const __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 vx = _mm256_loadu_ps(x + i);
+        const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(y + i), vx);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(vx, _mm256_mul_ps(va, d)));
+    }
+    blend_f32_plain(x + i, y + i, a, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+scale_avx2(float* x, float s, size_t n)
+{
+    const __m256 v = _mm256_set1_ps(s);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), v));
+    scale_plain(x + i, s, n - i);
+}
+
+// Keeps the larger (or smaller) of `x` and `y` in `x`, 32 bytes at a time.
+#define EXTREMUM_AVX2(name, T, op)                                             \
+    FILTER_TARGET("avx2")                                                      \
+    static void name##_avx2(T* x, const T* y, size_t n)                        \
+    {                                                                          \
+        const size_t w = 32 / sizeof(T);                                       \
+        size_t i = 0;                                                          \
+        for (; i + w <= n; i += w) {                                           \
+            const __m256i a = _mm256_loadu_si256((const __m256i*)(x + i));     \
+            const __m256i b = _mm256_loadu_si256((const __m256i*)(y + i));     \
+            _mm256_storeu_si256((__m256i*)(x + i), op(a, b));                  \
+        }                                                                      \
+        name##_plain(x + i, y + i, n - i);                                     \
+    }
+
+EXTREMUM_AVX2(max_u8, uint8_t, _mm256_max_epu8)
+EXTREMUM_AVX2(max_u16, uint16_t, _mm256_max_epu16)
+EXTREMUM_AVX2(max_i8, int8_t, _mm256_max_epi8)
+EXTREMUM_AVX2(max_i16, int16_t, _mm256_max_epi16)
+EXTREMUM_AVX2(min_u8, uint8_t, _mm256_min_epu8)
+EXTREMUM_AVX2(min_u16, uint16_t, _mm256_min_epu16)
+EXTREMUM_AVX2(min_i8, int8_t, _mm256_min_epi8)
+EXTREMUM_AVX2(min_i16, int16_t, _mm256_min_epi16)
+
+#undef EXTREMUM_AVX2
+
+FILTER_TARGET("avx2")
+static void
+max_f32_avx2(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 a = _mm256_loadu_ps(x + i);
+        _mm256_storeu_ps(x + i, _mm256_max_ps(a, _mm256_loadu_ps(y + i)));
+    }
+    max_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx2")
+static void
+min_f32_avx2(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 a = _mm256_loadu_ps(x + i);
+        _mm256_storeu_ps(x + i, _mm256_min_ps(a, _mm256_loadu_ps(y + i)));
+    }
+    min_f32_plain(x + i, y + i, n - i);
+}
+
+/// Packs 16 samples at a time. Pairs of samples are joined into 32 bits with
+/// a multiply-add, pairs of pairs into 64 bits, and the bytes that hold them
+/// are gathered at the bottom of each 128-bit lane. Each store spills past
+/// the packed bytes into those of the next 16 samples, so the loop leaves
+/// the last of them to the plain kernel.
+FILTER_TARGET("avx2")
+static void
+pack_avx2(uint8_t* dst, const uint16_t* src, unsigned bits, size_t n)
+{
+    const size_t half = bits / 2;
+    uint8_t order[16];
+    for (size_t j = 0; j < 16; ++j)
+        order[j] = (uint8_t)(j < half       ? j
+                             : j < 2 * half ? 8 + j - half
+                                            : 0x80);
+    const __m256i gather =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)order));
+    const __m256i mask = _mm256_set1_epi16((short)((1 << bits) - 1));
+    const __m256i weights = _mm256_set1_epi32((int)((1u << (16 + bits)) | 1));
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffff);
+    const __m128i shift = _mm_cvtsi32_si128((int)(2 * bits));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 16, dst += 2 * bits) {
+        const __m256i v = _mm256_and_si256(
+          _mm256_loadu_si256((const __m256i*)(src + i)), mask);
+        const __m256i pairs = _mm256_madd_epi16(v, weights);
+        const __m256i high = _mm256_srli_epi64(pairs, 32);
+        const __m256i quads = _mm256_or_si256(_mm256_and_si256(pairs, low32),
+                                              _mm256_sll_epi64(high, shift));
+        const __m256i packed = _mm256_shuffle_epi8(quads, gather);
+        _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i*)(dst + bits),
+                         _mm256_extracti128_si256(packed, 1));
+    }
+    pack_plain(dst, src + i, bits, n - i);
+}
+
+/// Unpacks 8 samples at a time. Each 32-bit lane is given the 3 bytes
+/// holding one sample, which is then shifted into place and masked. Loads
+/// read a few bytes past the 8 samples, so the last of them are left to the
+/// plain kernel.
+FILTER_TARGET("avx2")
+static void
+unpack_avx2(uint16_t* dst, const uint8_t* src, unsigned bits, size_t n)
+{
+    const size_t half = bits / 2;
+    uint8_t order[16];
+    uint32_t shifts[8];
+    for (size_t k = 0; k < 4; ++k) {
+        for (size_t j = 0; j < 4; ++j)
+            order[4 * k + j] =
+              (uint8_t)(j < 3 ? k * bits / 8 + j : 0x80);
+        shifts[k] = shifts[k + 4] = (uint32_t)(k * bits % 8);
+    }
+    const __m256i gather =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)order));
+    const __m256i shift = _mm256_loadu_si256((const __m256i*)shifts);
+    const __m256i mask = _mm256_set1_epi32((1 << bits) - 1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 8, src += bits) {
+        const __m256i bytes = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)src)),
+          _mm_loadl_epi64((const __m128i*)(src + half)),
+          1);
+        const __m256i v = _mm256_and_si256(
+          _mm256_srlv_epi32(_mm256_shuffle_epi8(bytes, gather), shift), mask);
+        const __m256i words = _mm256_permute4x64_epi64(
+          _mm256_packus_epi32(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(words));
+    }
+    unpack_plain(dst + i, src, bits, n - i);
+}
@@ -0,0 +1,140 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled for AVX-512F regardless of the flags used for the rest of the file.
+// Only called when the CPU supports it. See select_kernels() in filter.c.
+// Each loop handles 16 pixels at a time and leaves the rest to the plain
+// kernels.
+
+FILTER_TARGET("avx512f")
+static inline void
+add_epi32_avx512(float* x, __m512i v)
+{
+    const __m512 y = _mm512_cvtepi32_ps(v);
+    _mm512_storeu_ps(x, _mm512_add_ps(_mm512_loadu_ps(x), y));
+}
+
+FILTER_TARGET("avx512f")
+static void
+accumulate_u8_avx512(float* x, const uint8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(y + i));
+        add_epi32_avx512(x + i, _mm512_cvtepu8_epi32(v));
+    }
+    accumulate_u8_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+accumulate_u16_avx512(float* x, const uint16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(y + i));
+        add_epi32_avx512(x + i, _mm512_cvtepu16_epi32(v));
+    }
+    accumulate_u16_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+accumulate_i8_avx512(float* x, const int8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(y + i));
+        add_epi32_avx512(x + i, _mm512_cvtepi8_epi32(v));
+    }
+    accumulate_i8_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+accumulate_i16_avx512(float* x, const int16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(y + i));
+        add_epi32_avx512(x + i, _mm512_cvtepi16_epi32(v));
+    }
+    accumulate_i16_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+accumulate_f32_avx512(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = _mm512_loadu_ps(y + i);
+        _mm512_storeu_ps(x + i, _mm512_add_ps(_mm512_loadu_ps(x + i), v));
+    }
+    accumulate_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+subtract_f32_avx512(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 v = _mm512_loadu_ps(y + i);
+        _mm512_storeu_ps(x + i, _mm512_sub_ps(_mm512_loadu_ps(x + i), v));
+    }
+    subtract_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+blend_f32_avx512(float* x, const float* y, float a, size_t n)
+{
+    const __m512 va = _mm512_set1_ps(a);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 vx = _mm512_loadu_ps(x + i);
+        const __m512 d = _mm512_sub_ps(_mm512_loadu_ps(y + i), vx);
+        _mm512_storeu_ps(x + i, _mm512_add_ps(vx, _mm512_mul_ps(va, d)));
+    }
+    blend_f32_plain(x + i, y + i, a, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+scale_avx512(float* x, float s, size_t n)
+{
+    const __m512 v = _mm512_set1_ps(s);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), v));
+    scale_plain(x + i, s, n - i);
+}
+
+// AVX-512F has no byte or word comparisons, so integer projections use the
+// AVX2 kernels.
+
+FILTER_TARGET("avx512f")
+static void
+max_f32_avx512(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 a = _mm512_loadu_ps(x + i);
+        _mm512_storeu_ps(x + i, _mm512_max_ps(a, _mm512_loadu_ps(y + i)));
+    }
+    max_f32_plain(x + i, y + i, n - i);
+}
+
+FILTER_TARGET("avx512f")
+static void
+min_f32_avx512(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 a = _mm512_loadu_ps(x + i);
+        _mm512_storeu_ps(x + i, _mm512_min_ps(a, _mm512_loadu_ps(y + i)));
+    }
+    min_f32_plain(x + i, y + i, n - i);
+}
@@ -1,14 +1,17 @@
 #include "filter.h"
+#include "crc32c.h"
 #include "frame_iterator.h"
 #include "platform.h"
 #include "logger.h"
 #include "vfslice.h"
-#include "throttler.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
 
 // #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -25,6 +28,232 @@
     } while (0)
 #define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
 
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+// The filter thread is woken as soon as frames arrive, when it's asked to stop
+// and when the accumulator needs resetting. This bounds how long it sleeps
+// otherwise.
+#define FILTER_WAIT_TIMEOUT_MS (100)
+
+// Smallest run of pixels worth handing to another thread.
+#define FILTER_MIN_BAND_PIXELS (1 << 16)
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FILTER_HAS_X86_KERNELS
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define FILTER_HAS_NEON_KERNELS
+#endif
+
+// Lets a function use instructions the rest of the file isn't compiled for.
+// MSVC makes every intrinsic available without it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define FILTER_TARGET(isa)
+#else
+#define FILTER_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#include "filter.plain.c"
+#ifdef FILTER_HAS_X86_KERNELS
+#include "filter.avx2.c"
+#include "filter.avx512.c"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+#ifdef FILTER_HAS_NEON_KERNELS
+#include "filter.neon.c"
+#endif
+
+/// Per-pixel loops used to average frames, one set per instruction set.
+struct filter_kernels
+{
+    const char* name;
+    void (*accumulate_u8)(float* x, const uint8_t* y, size_t n);
+    void (*accumulate_u16)(float* x, const uint16_t* y, size_t n);
+    void (*accumulate_i8)(float* x, const int8_t* y, size_t n);
+    void (*accumulate_i16)(float* x, const int16_t* y, size_t n);
+    void (*accumulate_f32)(float* x, const float* y, size_t n);
+    /// `x -= y`
+    void (*subtract_f32)(float* x, const float* y, size_t n);
+    /// `x += a * (y - x)`
+    void (*blend_f32)(float* x, const float* y, float a, size_t n);
+    void (*scale)(float* x, float s, size_t n);
+    /// `x = max(x, y)` and `x = min(x, y)` in the samples' own type.
+    void (*max_u8)(uint8_t* x, const uint8_t* y, size_t n);
+    void (*max_u16)(uint16_t* x, const uint16_t* y, size_t n);
+    void (*max_i8)(int8_t* x, const int8_t* y, size_t n);
+    void (*max_i16)(int16_t* x, const int16_t* y, size_t n);
+    void (*max_f32)(float* x, const float* y, size_t n);
+    void (*min_u8)(uint8_t* x, const uint8_t* y, size_t n);
+    void (*min_u16)(uint16_t* x, const uint16_t* y, size_t n);
+    void (*min_i8)(int8_t* x, const int8_t* y, size_t n);
+    void (*min_i16)(int16_t* x, const int16_t* y, size_t n);
+    void (*min_f32)(float* x, const float* y, size_t n);
+    /// Packs and unpacks samples of `bits` bits. See pack_samples().
+    void (*pack)(uint8_t* dst, const uint16_t* src, unsigned bits, size_t n);
+    void (*unpack)(uint16_t* dst, const uint8_t* src, unsigned bits, size_t n);
+};
+
+static const struct filter_kernels kernels_plain = {
+    .name = "plain",
+    .accumulate_u8 = accumulate_u8_plain,
+    .accumulate_u16 = accumulate_u16_plain,
+    .accumulate_i8 = accumulate_i8_plain,
+    .accumulate_i16 = accumulate_i16_plain,
+    .accumulate_f32 = accumulate_f32_plain,
+    .subtract_f32 = subtract_f32_plain,
+    .blend_f32 = blend_f32_plain,
+    .scale = scale_plain,
+    .max_u8 = max_u8_plain,
+    .max_u16 = max_u16_plain,
+    .max_i8 = max_i8_plain,
+    .max_i16 = max_i16_plain,
+    .max_f32 = max_f32_plain,
+    .min_u8 = min_u8_plain,
+    .min_u16 = min_u16_plain,
+    .min_i8 = min_i8_plain,
+    .min_i16 = min_i16_plain,
+    .min_f32 = min_f32_plain,
+    .pack = pack_plain,
+    .unpack = unpack_plain,
+};
+
+#ifdef FILTER_HAS_X86_KERNELS
+static const struct filter_kernels kernels_avx2 = {
+    .name = "avx2",
+    .accumulate_u8 = accumulate_u8_avx2,
+    .accumulate_u16 = accumulate_u16_avx2,
+    .accumulate_i8 = accumulate_i8_avx2,
+    .accumulate_i16 = accumulate_i16_avx2,
+    .accumulate_f32 = accumulate_f32_avx2,
+    .subtract_f32 = subtract_f32_avx2,
+    .blend_f32 = blend_f32_avx2,
+    .scale = scale_avx2,
+    .max_u8 = max_u8_avx2,
+    .max_u16 = max_u16_avx2,
+    .max_i8 = max_i8_avx2,
+    .max_i16 = max_i16_avx2,
+    .max_f32 = max_f32_avx2,
+    .min_u8 = min_u8_avx2,
+    .min_u16 = min_u16_avx2,
+    .min_i8 = min_i8_avx2,
+    .min_i16 = min_i16_avx2,
+    .min_f32 = min_f32_avx2,
+    .pack = pack_avx2,
+    .unpack = unpack_avx2,
+};
+
+static const struct filter_kernels kernels_avx512 = {
+    .name = "avx512",
+    .accumulate_u8 = accumulate_u8_avx512,
+    .accumulate_u16 = accumulate_u16_avx512,
+    .accumulate_i8 = accumulate_i8_avx512,
+    .accumulate_i16 = accumulate_i16_avx512,
+    .accumulate_f32 = accumulate_f32_avx512,
+    .subtract_f32 = subtract_f32_avx512,
+    .blend_f32 = blend_f32_avx512,
+    .scale = scale_avx512,
+    .max_u8 = max_u8_avx2,
+    .max_u16 = max_u16_avx2,
+    .max_i8 = max_i8_avx2,
+    .max_i16 = max_i16_avx2,
+    .max_f32 = max_f32_avx512,
+    .min_u8 = min_u8_avx2,
+    .min_u16 = min_u16_avx2,
+    .min_i8 = min_i8_avx2,
+    .min_i16 = min_i16_avx2,
+    .min_f32 = min_f32_avx512,
+    .pack = pack_avx2,
+    .unpack = unpack_avx2,
+};
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static int
+cpu_supports(int cpuid7_ebx_bit, unsigned long long xcr0_mask)
+{
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) // OSXSAVE
+        return 0;
+    if ((_xgetbv(0) & xcr0_mask) != xcr0_mask)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> cpuid7_ebx_bit) & 1;
+}
+#define CPU_SUPPORTS_AVX2 cpu_supports(5, 0x6)
+#define CPU_SUPPORTS_AVX512F cpu_supports(16, 0xe6)
+#else
+#define CPU_SUPPORTS_AVX2 __builtin_cpu_supports("avx2")
+#define CPU_SUPPORTS_AVX512F __builtin_cpu_supports("avx512f")
+#endif
+#endif // FILTER_HAS_X86_KERNELS
+
+#ifdef FILTER_HAS_NEON_KERNELS
+static const struct filter_kernels kernels_neon = {
+    .name = "neon",
+    .accumulate_u8 = accumulate_u8_neon,
+    .accumulate_u16 = accumulate_u16_neon,
+    .accumulate_i8 = accumulate_i8_neon,
+    .accumulate_i16 = accumulate_i16_neon,
+    .accumulate_f32 = accumulate_f32_neon,
+    .subtract_f32 = subtract_f32_neon,
+    .blend_f32 = blend_f32_neon,
+    .scale = scale_neon,
+    .max_u8 = max_u8_neon,
+    .max_u16 = max_u16_neon,
+    .max_i8 = max_i8_neon,
+    .max_i16 = max_i16_neon,
+    .max_f32 = max_f32_neon,
+    .min_u8 = min_u8_neon,
+    .min_u16 = min_u16_neon,
+    .min_i8 = min_i8_neon,
+    .min_i16 = min_i16_neon,
+    .min_f32 = min_f32_neon,
+    .pack = pack_plain,
+    .unpack = unpack_plain,
+};
+#endif
+
+/// Picks the widest kernels this CPU supports.
+static const struct filter_kernels*
+select_kernels(void)
+{
+#ifdef FILTER_HAS_X86_KERNELS
+    if (CPU_SUPPORTS_AVX512F)
+        return &kernels_avx512;
+    if (CPU_SUPPORTS_AVX2)
+        return &kernels_avx2;
+#endif
+#ifdef FILTER_HAS_NEON_KERNELS
+    return &kernels_neon;
+#else
+    return &kernels_plain;
+#endif
+}
+
+/// Lists the kernels this CPU can run, the plain ones first.
+/// @returns How many were written to `out`, which has room for 4.
+static size_t
+available_kernels(const struct filter_kernels** out)
+{
+    size_t n = 0;
+    out[n++] = &kernels_plain;
+#ifdef FILTER_HAS_X86_KERNELS
+    if (CPU_SUPPORTS_AVX2)
+        out[n++] = &kernels_avx2;
+    if (CPU_SUPPORTS_AVX512F)
+        out[n++] = &kernels_avx512;
+#endif
+#ifdef FILTER_HAS_NEON_KERNELS
+    out[n++] = &kernels_neon;
+#endif
+    return n;
+}
+
 static size_t
 slice_size_bytes(const struct slice* slice)
 {
@@ -32,166 +261,1039 @@ slice_size_bytes(const struct slice* slice)
 }
 
 static int
-assert_consistent_shape(const struct VideoFrame* acc,
-                        const struct VideoFrame* in)
+is_same_shape(const struct ImageShape* a, const struct ImageShape* b)
 {
-    int res0 =
-      memcmp(&acc->shape.dims, &in->shape.dims, sizeof(acc->shape.dims));
-    int res1 = memcmp(
-      &acc->shape.strides, &in->shape.strides, sizeof(acc->shape.strides));
-    return (res0 == 0) && (res1 == 0);
+    return memcmp(&a->dims, &b->dims, sizeof(a->dims)) == 0 &&
+           memcmp(&a->strides, &b->strides, sizeof(a->strides)) == 0 &&
+           a->type == b->type;
 }
 
-static int
-accumulate(struct VideoFrame* acc, const struct VideoFrame* in)
+/// Arguments for the band functions below, which the pool calls on ranges
+/// of pixels.
+struct band_job
 {
-    size_t npx = acc->shape.strides.planes; // assumes planes is outer dim
-    if (acc->shape.type != SampleType_f32)
-        return 0;
+    const struct filter_kernels* kernels;
+    float* x;
+    const uint8_t* y;
+    enum SampleType type;
+    float scale;
+
+    /// Running averages: the running sum or mean, and for sliding windows
+    /// the ring entry the newest frame replaces.
+    float* sum;
+    float* slot;
+    float alpha;
+    /// Set once the ring is full, or the exponential average has a frame.
+    /// For integer sums, set once `acc` holds a frame.
+    int is_primed;
+
+    /// Integer block averages: the 32-bit sum, and where to write the mean.
+    void* acc;
+    uint8_t* dst;
+    double inverse_count;
 
-    float* x = (float*)acc->data;
-    switch (in->shape.type) {
-        case SampleType_u8: {
-            const uint8_t* y = in->data;
-            for (size_t i = 0; i < npx; ++i)
-                x[i] += y[i];
+    enum FilterProjection projection;
+
+    /// Pack: bits per packed sample.
+    unsigned bits;
+
+    /// Compress: the codec, the bytes of samples in the frame, and what
+    /// each block compressed to, or 0 if it didn't shrink. Block `i` is
+    /// compressed into `dst + 2*i*FRAME_COMPRESSION_BLOCK_BYTES`, and
+    /// shuffled in the block's worth of bytes after that.
+    enum FrameCompression compression;
+    size_t nbytes;
+    uint32_t* bytes_of_block;
+};
+
+static void
+zero_band(const struct band_job* job, size_t beg, size_t end)
+{
+    memset(job->x + beg, 0, (end - beg) * sizeof(float));
+}
+
+static void
+accumulate_band(const struct band_job* job, size_t beg, size_t end)
+{
+    const struct filter_kernels* const k = job->kernels;
+    float* const x = job->x + beg;
+    const size_t n = end - beg;
+    switch (job->type) {
+        case SampleType_u8:
+            k->accumulate_u8(x, (const uint8_t*)job->y + beg, n);
             break;
-        }
         case SampleType_u10:
         case SampleType_u12:
         case SampleType_u14:
-        case SampleType_u16: {
-            const uint16_t* y = (uint16_t*)in->data;
-            for (size_t i = 0; i < npx; ++i)
-                x[i] += y[i];
+        case SampleType_u16:
+            k->accumulate_u16(x, (const uint16_t*)job->y + beg, n);
             break;
-        }
-        case SampleType_i8: {
-            const int8_t* y = (int8_t*)in->data;
-            for (size_t i = 0; i < npx; ++i)
-                x[i] += y[i];
+        case SampleType_i8:
+            k->accumulate_i8(x, (const int8_t*)job->y + beg, n);
             break;
-        }
-        case SampleType_i16: {
-            const int16_t* y = (int16_t*)in->data;
-            for (size_t i = 0; i < npx; ++i)
-                x[i] += y[i];
+        case SampleType_i16:
+            k->accumulate_i16(x, (const int16_t*)job->y + beg, n);
+            break;
+        case SampleType_f32:
+            k->accumulate_f32(x, (const float*)job->y + beg, n);
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+scale_band(const struct band_job* job, size_t beg, size_t end)
+{
+    job->kernels->scale(job->x + beg, job->scale, end - beg);
+}
+
+#define ACCUMULATE_INT(ACC, T)                                                 \
+    do {                                                                       \
+        ACC* const acc = (ACC*)job->acc;                                       \
+        const T* const y = (const T*)job->y;                                   \
+        if (job->is_primed)                                                    \
+            for (size_t i = beg; i < end; ++i)                                 \
+                acc[i] += (ACC)y[i];                                           \
+        else                                                                   \
+            for (size_t i = beg; i < end; ++i)                                 \
+                acc[i] = (ACC)y[i];                                            \
+    } while (0)
+
+/// Adds `y` to a 32-bit integer sum. The first frame overwrites it. These
+/// loops are simple enough for the compiler to vectorize.
+static void
+accumulate_int_band(const struct band_job* job, size_t beg, size_t end)
+{
+    switch (job->type) {
+        case SampleType_u8:
+            ACCUMULATE_INT(uint32_t, uint8_t);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            ACCUMULATE_INT(uint32_t, uint16_t);
+            break;
+        case SampleType_i8:
+            ACCUMULATE_INT(int32_t, int8_t);
+            break;
+        case SampleType_i16:
+            ACCUMULATE_INT(int32_t, int16_t);
+            break;
+        default:
+            break;
+    }
+}
+
+#undef ACCUMULATE_INT
+
+#define MEAN_INT(ACC, T)                                                       \
+    do {                                                                       \
+        const ACC* const acc = (const ACC*)job->acc;                           \
+        T* const dst = (T*)job->dst;                                           \
+        for (size_t i = beg; i < end; ++i)                                     \
+            dst[i] = (T)floor((double)acc[i] * job->inverse_count + 0.5);      \
+    } while (0)
+
+/// Writes the mean of a 32-bit integer sum to `dst` in the input's type.
+static void
+mean_int_band(const struct band_job* job, size_t beg, size_t end)
+{
+    switch (job->type) {
+        case SampleType_u8:
+            MEAN_INT(uint32_t, uint8_t);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            MEAN_INT(uint32_t, uint16_t);
+            break;
+        case SampleType_i8:
+            MEAN_INT(int32_t, int8_t);
+            break;
+        case SampleType_i16:
+            MEAN_INT(int32_t, int16_t);
+            break;
+        default:
+            break;
+    }
+}
+
+#undef MEAN_INT
+
+/// Keeps the larger or smaller of each sample of `dst` and `y`. The first
+/// frame is copied.
+static void
+extremum_band(const struct band_job* job, size_t beg, size_t end)
+{
+    const struct filter_kernels* const k = job->kernels;
+    const size_t bps = bytes_of_type(job->type);
+    const size_t n = end - beg;
+    uint8_t* const x = job->dst + beg * bps;
+    const uint8_t* const y = job->y + beg * bps;
+    if (!job->is_primed) {
+        memcpy(x, y, n * bps); // NOLINT
+        return;
+    }
+    const int is_max = job->projection == FilterProjection_Max;
+    switch (job->type) {
+        case SampleType_u8:
+            (is_max ? k->max_u8 : k->min_u8)(x, y, n);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            (is_max ? k->max_u16 : k->min_u16)(
+              (uint16_t*)x, (const uint16_t*)y, n);
+            break;
+        case SampleType_i8:
+            (is_max ? k->max_i8 : k->min_i8)((int8_t*)x, (const int8_t*)y, n);
+            break;
+        case SampleType_i16:
+            (is_max ? k->max_i16 : k->min_i16)(
+              (int16_t*)x, (const int16_t*)y, n);
+            break;
+        case SampleType_f32:
+            (is_max ? k->max_f32 : k->min_f32)((float*)x, (const float*)y, n);
+            break;
+        default:
+            break;
+    }
+}
+
+/// Replaces the oldest frame in a sliding window with `y` and writes the
+/// window's mean to `x`.
+static void
+slide_band(const struct band_job* job, size_t beg, size_t end)
+{
+    const struct filter_kernels* const k = job->kernels;
+    const size_t n = end - beg;
+    float* const sum = job->sum + beg;
+    float* const slot = job->slot + beg;
+    if (job->is_primed)
+        k->subtract_f32(sum, slot, n);
+
+    struct band_job newest = *job;
+    newest.x = job->slot;
+    zero_band(&newest, beg, end);
+    accumulate_band(&newest, beg, end);
+    k->accumulate_f32(sum, slot, n);
+
+    memcpy(job->x + beg, sum, n * sizeof(float)); // NOLINT
+    k->scale(job->x + beg, job->scale, n);
+}
+
+/// Blends `y` into an exponential average and writes the average to `x`.
+static void
+blend_band(const struct band_job* job, size_t beg, size_t end)
+{
+    const size_t n = end - beg;
+    float* const x = job->x + beg;
+    float* const sum = job->sum + beg;
+    zero_band(job, beg, end);
+    accumulate_band(job, beg, end);
+    if (job->is_primed) {
+        job->kernels->blend_f32(sum, x, job->alpha, n);
+        memcpy(x, sum, n * sizeof(float)); // NOLINT
+    } else {
+        memcpy(sum, x, n * sizeof(float)); // NOLINT
+    }
+}
+
+/// Bands are whole rows of at least FILTER_MIN_BAND_PIXELS, so small frames
+/// stay on the filter thread where handing them off would cost more than it
+/// saves.
+static size_t
+band_granule(const struct ImageShape* shape)
+{
+    const size_t row = shape->strides.height ? shape->strides.height : 1;
+    return row * ((FILTER_MIN_BAND_PIXELS + row - 1) / row);
+}
+
+static void
+run_bands(const struct filter_stage* stage,
+          band_pool_fn fn,
+          struct band_job* job,
+          const struct ImageShape* shape)
+{
+    job->kernels = stage->ctx->kernels;
+    band_pool_run(stage->ctx->pool,
+                  fn,
+                  job,
+                  shape->strides.planes, // assumes planes is outer dim
+                  band_granule(shape));
+}
+
+//
+//      AVERAGE STAGE
+//
+
+/// Largest magnitude of an integer sample type, or 0 for other types.
+static uint32_t
+max_abs_sample(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u8:
+            return 255;
+        case SampleType_u10:
+            return 1023;
+        case SampleType_u12:
+            return 4095;
+        case SampleType_u14:
+            return 16383;
+        case SampleType_u16:
+            return 65535;
+        case SampleType_i8:
+            return 128;
+        case SampleType_i16:
+            return 32768;
+        default:
+            return 0;
+    }
+}
+
+static int
+is_signed_sample(enum SampleType type)
+{
+    return type == SampleType_i8 || type == SampleType_i16;
+}
+
+/// Integer samples are summed in 32 bits unless the stage emits f32.
+static int
+is_integer_average(const struct filter_stage* self, enum SampleType type)
+{
+    return self->params.average_output != FilterAverageOutput_Float &&
+           max_abs_sample(type) > 0;
+}
+
+static int
+average_shape(const struct filter_stage* self,
+              const struct ImageShape* in,
+              struct ImageShape* out)
+{
+    switch (in->type) {
+        case SampleType_u8:
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+        case SampleType_i8:
+        case SampleType_i16:
+        case SampleType_f32:
             break;
-        }
         default:
-            LOGE("Unsupported pixel type");
             return 0;
     }
+    *out = *in;
+    switch (self->params.average_output) {
+        case FilterAverageOutput_Float:
+            out->type = SampleType_f32;
+            return 1;
+        case FilterAverageOutput_Sum:
+            if (!max_abs_sample(in->type) || is_signed_sample(in->type))
+                return 0;
+            out->type = SampleType_u32;
+            break;
+        default:
+            break;
+    }
+    if (is_integer_average(self, in->type)) {
+        // The sum of a full window must fit in 32 bits.
+        const uint64_t limit = is_signed_sample(in->type) ? INT32_MAX
+                                                          : UINT32_MAX;
+        if ((uint64_t)self->params.frame_count * max_abs_sample(in->type) >
+            limit)
+            return 0;
+    }
+    return 1;
+}
+
+static enum FilterStageResult
+average_block(struct filter_stage* self,
+              const struct VideoFrame* in,
+              struct VideoFrame* out,
+              int is_first)
+{
+    struct band_job job = {
+        .x = (float*)out->data,
+        .y = in->data,
+        .type = in->shape.type,
+    };
+    if (is_first) {
+        self->count = 0;
+        run_bands(self, (band_pool_fn)zero_band, &job, &out->shape);
+    } else {
+        out->hardware_frame_gap += in->hardware_frame_gap;
+    }
+    run_bands(self, (band_pool_fn)accumulate_band, &job, &out->shape);
+    if (++self->count < self->params.frame_count)
+        return FilterStage_Pending;
+    if (self->count > 1) {
+        job.scale = 1.0f / (float)self->count;
+        run_bands(self, (band_pool_fn)scale_band, &job, &out->shape);
+    }
+    return FilterStage_Emit;
+}
+
+/// Sums integer samples in 32 bits. Sums are written straight into `out`.
+/// Means are kept in `state` and written to `out` in the input's type.
+static enum FilterStageResult
+average_block_int(struct filter_stage* self,
+                  const struct VideoFrame* in,
+                  struct VideoFrame* out,
+                  int is_first)
+{
+    const size_t npx = out->shape.strides.planes;
+    const int is_sum = self->params.average_output == FilterAverageOutput_Sum;
+    if (!is_sum && self->bytes_of_state < npx * sizeof(uint32_t)) {
+        const size_t nbytes = npx * sizeof(uint32_t);
+        memory_free(self->state);
+        self->bytes_of_state = 0;
+        self->state = memory_alloc(nbytes, AllocatorHint_Default);
+        EXPECT(self->state,
+               "Failed to allocate %llu bytes for an integer average.",
+               (unsigned long long)nbytes);
+        self->bytes_of_state = nbytes;
+    }
+
+    struct band_job job = {
+        .y = in->data,
+        .type = in->shape.type,
+        .acc = is_sum ? (void*)out->data : self->state,
+        .dst = out->data,
+        .is_primed = !is_first,
+    };
+    if (is_first)
+        self->count = 0;
+    else
+        out->hardware_frame_gap += in->hardware_frame_gap;
+    run_bands(self, (band_pool_fn)accumulate_int_band, &job, &out->shape);
+    if (++self->count < self->params.frame_count)
+        return FilterStage_Pending;
+    if (!is_sum) {
+        job.inverse_count = 1.0 / (double)self->count;
+        run_bands(self, (band_pool_fn)mean_int_band, &job, &out->shape);
+    }
+    return FilterStage_Emit;
+Error:
+    return FilterStage_Error;
+}
+
+/// Running averages emit a frame for every input. Each input costs a fixed
+/// number of passes over its pixels, however long the window is.
+///
+/// A sliding window keeps its last `frame_count` inputs as f32 in `state`,
+/// after their running sum. Sums of integer samples stay exact while they
+/// fit in the 24 bits of a float's significand.
+static enum FilterStageResult
+average_running(struct filter_stage* self,
+                const struct VideoFrame* in,
+                struct VideoFrame* out)
+{
+    const size_t npx = out->shape.strides.planes;
+    const int is_sliding = self->params.average_mode == FilterAverage_Sliding;
+    const uint32_t window = self->params.frame_count;
+    if (!self->state) {
+        const size_t nbytes =
+          sizeof(float) * npx * (is_sliding ? 1 + (size_t)window : 1);
+        self->state = memory_alloc(nbytes, AllocatorHint_Default);
+        EXPECT(self->state,
+               "Failed to allocate %llu bytes for a running average.",
+               (unsigned long long)nbytes);
+        self->bytes_of_state = nbytes;
+        self->count = 0;
+    }
+
+    struct band_job job = {
+        .x = (float*)out->data,
+        .y = in->data,
+        .type = in->shape.type,
+        .sum = (float*)self->state,
+        .alpha = self->params.alpha,
+        .is_primed = self->count > 0,
+    };
+    if (is_sliding) {
+        job.slot = job.sum + npx * (1 + self->count % window);
+        job.is_primed = self->count >= window;
+        // Stays in [window, 2*window) once the ring is full so the slot
+        // index doesn't jump when `count` would overflow.
+        self->count = (self->count + 1 < 2 * window) ? self->count + 1 : window;
+        job.scale = 1.0f / (float)min(self->count, window);
+        run_bands(self, (band_pool_fn)slide_band, &job, &out->shape);
+    } else {
+        self->count = 1;
+        run_bands(self, (band_pool_fn)blend_band, &job, &out->shape);
+    }
+    return FilterStage_Emit;
+Error:
+    return FilterStage_Error;
+}
+
+static enum FilterStageResult
+average_process(struct filter_stage* self,
+                const struct VideoFrame* in,
+                struct VideoFrame* out,
+                int is_first)
+{
+    if (self->params.average_mode != FilterAverage_Block)
+        return average_running(self, in, out);
+    if (is_integer_average(self, in->shape.type))
+        return average_block_int(self, in, out, is_first);
+    return average_block(self, in, out, is_first);
+}
+
+static void
+average_reset(struct filter_stage* self)
+{
+    memory_free(self->state);
+    self->state = 0;
+    self->bytes_of_state = 0;
+    self->count = 0;
+}
+
+static const struct filter_stage_ops filter_stage_average = {
+    .name = "average",
+    .shape = average_shape,
+    .process = average_process,
+    .reset = average_reset,
+};
+
+//
+//      PROJECT STAGE
+//
+
+static int
+is_unsigned_sum(const struct filter_stage* self, enum SampleType type)
+{
+    return self->params.projection == FilterProjection_Sum &&
+           max_abs_sample(type) > 0 && !is_signed_sample(type);
+}
+
+static int
+project_shape(const struct filter_stage* self,
+              const struct ImageShape* in,
+              struct ImageShape* out)
+{
+    if (!max_abs_sample(in->type) && in->type != SampleType_f32)
+        return 0;
+    *out = *in;
+    if (self->params.projection != FilterProjection_Sum)
+        return 1;
+    if (!is_unsigned_sum(self, in->type)) {
+        out->type = SampleType_f32;
+        return 1;
+    }
+    // The sum of a full window must fit in 32 bits.
+    out->type = SampleType_u32;
+    return (uint64_t)self->params.frame_count * max_abs_sample(in->type) <=
+           UINT32_MAX;
+}
+
+static enum FilterStageResult
+project_process(struct filter_stage* self,
+                const struct VideoFrame* in,
+                struct VideoFrame* out,
+                int is_first)
+{
+    struct band_job job = {
+        .x = (float*)out->data,
+        .y = in->data,
+        .type = in->shape.type,
+        .acc = out->data,
+        .dst = out->data,
+        .is_primed = !is_first,
+        .projection = self->params.projection,
+    };
+    if (is_first)
+        self->count = 0;
+    else
+        out->hardware_frame_gap += in->hardware_frame_gap;
+
+    if (self->params.projection != FilterProjection_Sum) {
+        run_bands(self, (band_pool_fn)extremum_band, &job, &out->shape);
+    } else if (is_unsigned_sum(self, in->shape.type)) {
+        run_bands(self, (band_pool_fn)accumulate_int_band, &job, &out->shape);
+    } else {
+        if (is_first)
+            run_bands(self, (band_pool_fn)zero_band, &job, &out->shape);
+        run_bands(self, (band_pool_fn)accumulate_band, &job, &out->shape);
+    }
+    return (++self->count < self->params.frame_count) ? FilterStage_Pending
+                                                      : FilterStage_Emit;
+}
+
+static const struct filter_stage_ops filter_stage_project = {
+    .name = "project",
+    .shape = project_shape,
+    .process = project_process,
+};
+
+//
+//      PACK STAGE
+//
+
+static enum SampleType
+packed_type(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u10:
+            return SampleType_u10p;
+        case SampleType_u12:
+            return SampleType_u12p;
+        case SampleType_u14:
+            return SampleType_u14p;
+        default:
+            return SampleType_Unknown;
+    }
+}
+
+/// Bands start on a multiple of 4 samples, which always starts a byte.
+static void
+pack_band(const struct band_job* job, size_t beg, size_t end)
+{
+    job->kernels->pack(job->dst + beg / 4 * (job->bits / 2),
+                       (const uint16_t*)job->y + beg,
+                       job->bits,
+                       end - beg);
+}
+
+static int
+pack_shape(const struct filter_stage* self,
+           const struct ImageShape* in,
+           struct ImageShape* out)
+{
+    (void)self;
+    if (packed_type(in->type) == SampleType_Unknown ||
+        in->strides.channels != 1 ||
+        in->strides.width != in->dims.channels ||
+        in->strides.height != (int64_t)in->dims.channels * in->dims.width)
+        return 0;
+    filter_stage_make_shape(out,
+                            packed_type(in->type),
+                            in->dims.channels,
+                            in->dims.width,
+                            in->dims.height,
+                            in->dims.planes);
+    return 1;
+}
+
+static enum FilterStageResult
+pack_process(struct filter_stage* self,
+             const struct VideoFrame* in,
+             struct VideoFrame* out,
+             int is_first)
+{
+    (void)is_first;
+    struct band_job job = {
+        .y = in->data,
+        .dst = out->data,
+        .bits = bits_of_type(out->shape.type),
+    };
+    job.kernels = self->ctx->kernels;
+    band_pool_run(self->ctx->pool,
+                  (band_pool_fn)pack_band,
+                  &job,
+                  out->shape.strides.planes,
+                  4 * ((band_granule(&out->shape) + 3) / 4));
+    return FilterStage_Emit;
+}
+
+static const struct filter_stage_ops filter_stage_pack = {
+    .name = "pack",
+    .shape = pack_shape,
+    .process = pack_process,
+};
+
+//
+//      COMPRESS STAGE
+//
+//  Frames are split into blocks compressed on the pool's threads, then
+//  gathered into the output after a `frame_compression_header`. Frames that
+//  don't shrink are written uncompressed.
+//
+
+static void
+compress_band(const struct band_job* job, size_t beg, size_t end)
+{
+    const size_t bpb = FRAME_COMPRESSION_BLOCK_BYTES;
+    for (size_t i = beg; i < end; ++i) {
+        uint8_t* const dst = job->dst + 2 * i * bpb;
+        job->bytes_of_block[i] =
+          (uint32_t)frame_compress_block(job->compression,
+                                         job->type,
+                                         dst,
+                                         job->y + i * bpb,
+                                         min(bpb, job->nbytes - i * bpb),
+                                         dst + bpb);
+    }
+}
+
+static int
+compress_shape(const struct filter_stage* self,
+               const struct ImageShape* in,
+               struct ImageShape* out)
+{
+    (void)self;
+    *out = *in;
     return 1;
 }
 
+static enum FilterStageResult
+compress_process(struct filter_stage* self,
+                 const struct VideoFrame* in,
+                 struct VideoFrame* out,
+                 int is_first)
+{
+    (void)is_first;
+    const size_t bpb = FRAME_COMPRESSION_BLOCK_BYTES;
+    const size_t nbytes = bytes_of_image(&in->shape);
+    const size_t nblocks = (nbytes + bpb - 1) / bpb;
+    const size_t bytes_of_state = nblocks * (2 * bpb + sizeof(uint32_t));
+    if (self->bytes_of_state < bytes_of_state) {
+        memory_free(self->state);
+        self->bytes_of_state = 0;
+        self->state = memory_alloc(bytes_of_state, AllocatorHint_Default);
+        EXPECT(self->state,
+               "Failed to allocate %llu bytes for compression.",
+               (unsigned long long)bytes_of_state);
+        self->bytes_of_state = bytes_of_state;
+    }
+
+    uint8_t* const blocks = (uint8_t*)self->state;
+    struct band_job job = {
+        .y = in->data,
+        .type = in->shape.type,
+        .dst = blocks,
+        .compression = self->params.compression,
+        .nbytes = nbytes,
+        .bytes_of_block = (uint32_t*)(blocks + nblocks * 2 * bpb),
+    };
+    job.kernels = self->ctx->kernels;
+    band_pool_run(
+      self->ctx->pool, (band_pool_fn)compress_band, &job, nblocks, 1);
+
+    struct frame_compression_header* const header =
+      (struct frame_compression_header*)out->data;
+    size_t total = sizeof(*header) + nblocks * sizeof(uint32_t);
+    for (size_t i = 0; i < nblocks; ++i) {
+        const uint32_t m = job.bytes_of_block[i];
+        total += m ? m : min(bpb, nbytes - i * bpb);
+    }
+    if (total >= nbytes) {
+        memcpy(out->data, in->data, nbytes); // NOLINT
+        return FilterStage_Emit;
+    }
+
+    header->nblocks = (uint32_t)nblocks;
+    header->bytes_per_block = (uint32_t)bpb;
+    uint8_t* cur = (uint8_t*)(header->bytes_of_block + nblocks);
+    for (size_t i = 0; i < nblocks; ++i) {
+        const size_t n = min(bpb, nbytes - i * bpb);
+        const uint32_t m = job.bytes_of_block[i];
+        memcpy(cur, // NOLINT
+               m ? job.dst + 2 * i * bpb : in->data + i * bpb,
+               m ? m : n);
+        header->bytes_of_block[i] = m ? m : (uint32_t)n;
+        cur += header->bytes_of_block[i];
+    }
+    out->compression = self->params.compression;
+    out->bytes_of_data = (uint32_t)total;
+    return FilterStage_Emit;
+Error:
+    return FilterStage_Error;
+}
+
 static void
-normalize(struct VideoFrame* acc, float inverse_norm)
+compress_reset(struct filter_stage* self)
+{
+    memory_free(self->state);
+    self->state = 0;
+    self->bytes_of_state = 0;
+}
+
+static const struct filter_stage_ops filter_stage_compress = {
+    .name = "compress",
+    .shape = compress_shape,
+    .process = compress_process,
+    .reset = compress_reset,
+};
+
+static const struct filter_stage_ops*
+stage_ops(enum FilterStageKind kind)
 {
-    float* const x = (float*)acc->data;
-    const size_t npx = acc->shape.strides.planes;
-    for (size_t i = 0; i < npx; ++i)
-        x[i] *= inverse_norm;
+    switch (kind) {
+        case FilterStage_Average:
+            return &filter_stage_average;
+        case FilterStage_Crop:
+            return &filter_stage_crop;
+        case FilterStage_Bin:
+            return &filter_stage_bin;
+        case FilterStage_FlatField:
+            return &filter_stage_flat_field;
+        case FilterStage_Cast:
+            return &filter_stage_cast;
+        case FilterStage_Project:
+            return &filter_stage_project;
+        case FilterStage_Pack:
+            return &filter_stage_pack;
+        case FilterStage_Compress:
+            return &filter_stage_compress;
+        default:
+            return 0;
+    }
 }
 
+/// Packed samples can't be addressed one at a time, so no stage but
+/// compression reads them. Only the last stage of a chain can pack, or be
+/// followed by compression.
 static int
-process_data(struct video_filter_s* self,
-             struct VideoFrame** accumulator,
-             uint64_t* frame_count)
+stage_shape(const struct filter_stage* stage,
+            const struct ImageShape* in,
+            struct ImageShape* out)
+{
+    return (sample_type_unpacked(in->type) == in->type ||
+            stage->params.kind == FilterStage_Compress) &&
+           stage->ops->shape(stage, in, out);
+}
+
+//
+//      CHAIN
+//
+
+static int
+is_last_stage(const struct video_filter_s* self, uint32_t i)
+{
+    return i + 1 == self->nstages;
+}
+
+/// Drops whatever stage `i` is writing and whatever it kept from earlier
+/// frames.
+static void
+restart_stage(struct video_filter_s* self, uint32_t i)
+{
+    struct filter_stage* const stage = self->stages + i;
+    if (self->outputs[i].frame && is_last_stage(self, i))
+        channel_abort_write(self->out);
+    self->outputs[i].frame = 0;
+    if (stage->ops && stage->ops->reset)
+        stage->ops->reset(stage);
+}
+
+static void
+restart_stages(struct video_filter_s* self)
+{
+    for (uint32_t i = 0; i < self->nstages; ++i)
+        restart_stage(self, i);
+}
+
+/// Picks up a chain changed by video_filter_configure().
+static void
+update_stages(struct video_filter_s* self)
+{
+    lock_acquire(&self->lock);
+    if (self->stages_generation != self->chain_generation) {
+        restart_stages(self);
+        for (uint32_t i = 0; i < self->nchain; ++i) {
+            self->stages[i] = (struct filter_stage){
+                .ops = stage_ops(self->chain[i].kind),
+                .params = self->chain[i],
+                .ctx = &self->stage_context,
+            };
+            self->outputs[i].has_logged_rejection = 0;
+        }
+        self->nstages = self->nchain;
+        self->stages_generation = self->chain_generation;
+    }
+    lock_release(&self->lock);
+}
+
+/// Gives stage `i` a new frame of `shape` to write, with its header filled
+/// in from `in`.
+static struct VideoFrame*
+begin_output(struct video_filter_s* self,
+             uint32_t i,
+             const struct VideoFrame* in,
+             const struct ImageShape* shape)
+{
+    struct filter_output* const output = self->outputs + i;
+    const size_t nbytes =
+      is_last_stage(self, i)
+        ? channel_bytes_of_frame(self->out, bytes_of_image(shape))
+        : 8 * ((bytes_of_image(shape) + sizeof(struct VideoFrame) + 7) / 8);
+    struct VideoFrame* frame = 0;
+    if (is_last_stage(self, i)) {
+        frame = (struct VideoFrame*)channel_write_map(self->out, nbytes);
+    } else {
+        if (output->bytes_of_scratch < nbytes) {
+            memory_free(output->scratch);
+            output->bytes_of_scratch = 0;
+            output->scratch = memory_alloc(nbytes, AllocatorHint_Default);
+            EXPECT(output->scratch,
+                   "[stream %d] PROCESSING: Failed to allocate %llu bytes for "
+                   "the %s stage.",
+                   self->stream_id,
+                   (unsigned long long)nbytes,
+                   self->stages[i].ops->name);
+            output->bytes_of_scratch = nbytes;
+        }
+        frame = (struct VideoFrame*)output->scratch;
+    }
+    if (frame) {
+        *frame = (struct VideoFrame){
+            .bytes_of_frame = nbytes,
+            .shape = *shape,
+            .frame_id = in->frame_id,
+            .hardware_frame_id = in->hardware_frame_id,
+            .hardware_frame_gap = in->hardware_frame_gap,
+            .timestamps = in->timestamps,
+            .stage_position = in->stage_position,
+            .has_stage_position = in->has_stage_position,
+        };
+        output->in_shape = in->shape;
+    }
+    output->frame = frame;
+    return frame;
+Error:
+    return 0;
+}
+
+/// Passes `in` down the chain until a stage needs more input or the last
+/// stage commits its frame to `out`.
+static void
+run_stages(struct video_filter_s* self, const struct VideoFrame* in)
+{
+    const struct VideoFrame* cur = in;
+    for (uint32_t i = 0; i < self->nstages; ++i) {
+        struct filter_stage* const stage = self->stages + i;
+        struct filter_output* const output = self->outputs + i;
+        if ((output->frame || stage->state) &&
+            !is_same_shape(&output->in_shape, &cur->shape)) {
+            LOG("[stream %d] PROCESSING: Restarting the %s stage -- shape "
+                "inconsistent",
+                self->stream_id,
+                stage->ops->name);
+            restart_stage(self, i);
+        }
+
+        const int is_first = !output->frame;
+        if (is_first) {
+            struct ImageShape shape = { 0 };
+            if (!stage_shape(stage, &cur->shape, &shape)) {
+                if (!output->has_logged_rejection)
+                    LOGE("[stream %d] PROCESSING: The %s stage can't process "
+                         "%ux%u %s frames. Dropping them.",
+                         self->stream_id,
+                         stage->ops->name,
+                         cur->shape.dims.width,
+                         cur->shape.dims.height,
+                         sample_type_as_string(cur->shape.type));
+                output->has_logged_rejection = 1;
+                return;
+            }
+            if (!begin_output(self, i, cur, &shape))
+                return;
+        }
+
+        switch (stage->ops->process(stage, cur, output->frame, is_first)) {
+            case FilterStage_Pending:
+                return;
+            case FilterStage_Emit: {
+                struct VideoFrame* const frame = output->frame;
+                output->frame = 0;
+                cur = frame;
+                if (is_last_stage(self, i)) {
+                    // Compressed frames give back what they didn't use.
+                    if (frame->compression != FrameCompression_None)
+                        frame->bytes_of_frame = channel_bytes_of_frame(
+                          self->out, frame->bytes_of_data);
+                    // The checksum is of what's stored, not of what came in.
+                    if (in->has_checksum) {
+                        frame->checksum = crc32c_of_frame(frame);
+                        frame->has_checksum = 1;
+                    }
+                    channel_write_unmap_bytes(self->out,
+                                              frame->bytes_of_frame);
+                }
+                break;
+            }
+            default:
+                LOGE("[stream %d] PROCESSING: The %s stage failed on frame "
+                     "%llu.",
+                     self->stream_id,
+                     stage->ops->name,
+                     (unsigned long long)in->frame_id);
+                restart_stage(self, i);
+                return;
+        }
+    }
+}
+
+static void
+process_data(struct video_filter_s* self, uint32_t timeout_ms)
 {
-    struct VideoFrame* in = 0;
+    update_stages(self);
     {
-        struct slice slice = channel_read_map(&self->in, &self->reader);
+        struct slice slice =
+          channel_read_map_wait(&self->in, &self->reader, timeout_ms);
+        const uint64_t now = clock_tic(0);
         struct frame_iterator it = frame_iterator_init(&slice);
+        struct VideoFrame* in = 0;
+        uint64_t nframes = 0, ndiscarded = 0;
         while ((in = frame_iterator_next(&it))) {
-            if (!*accumulator) {
-                struct ImageShape shape = in->shape;
-                shape.type = SampleType_f32;
-
-                const size_t nbytes =
-                  bytes_of_image(&shape) + sizeof(struct VideoFrame);
-                const size_t bytes_of_accumulator = 8*((nbytes+7)/8);
-
-                *accumulator = (struct VideoFrame*)channel_write_map(
-                  self->out, bytes_of_accumulator);
-                if (*accumulator) {
-                    *accumulator[0] = (struct VideoFrame){
-                        .bytes_of_frame = bytes_of_accumulator,
-                        .frame_id = in->frame_id,
-                        .shape = shape,
-                        .timestamps = in->timestamps,
-                    };
-                    CHECK(accumulate(*accumulator, in));
-                    *frame_count = 1;
-                }
-            } else {
-                if (assert_consistent_shape(*accumulator, in)) {
-                    CHECK(accumulate(*accumulator, in));
-                    ++*frame_count;
-                    if (*frame_count >= self->filter_window_frames) {
-                        normalize(*accumulator,
-                                  *frame_count ? 1.0f / (*frame_count) : 1.0f);
-                        *frame_count = 0;
-                        *accumulator = 0;
-                        channel_write_unmap(self->out);
-                    }
-                } else {
-                    LOG("FILTER: emitting early -- shape inconsistent");
-                    *frame_count = 0;
-                    *accumulator = 0;
-                    channel_abort_write(self->out);
-                }
+            if (load_acquire(&self->is_discarding)) {
+                ++ndiscarded;
+                continue;
             }
+            latency_histogram_record_tics(
+              &self->channel_to_filter_us, in->timestamps.acq_thread, now);
+            run_stages(self, in);
+            ++nframes;
         }
         channel_read_unmap(&self->in, &self->reader, slice_size_bytes(&slice));
+        if (ndiscarded)
+            store_relaxed(&self->counters.frames_discarded,
+                          self->counters.frames_discarded + ndiscarded);
+        if (nframes) {
+            struct video_filter_counters* const counters = &self->counters;
+            const uint64_t done = clock_tic(0);
+            const int64_t ns = clock_tics_to_ns((int64_t)(done - now));
+            trace_ring_record(&self->trace, "process_data", now, done);
+            store_relaxed(&counters->frames_filtered,
+                          counters->frames_filtered + nframes);
+            store_relaxed(&counters->busy_us,
+                          counters->busy_us + (uint64_t)(ns / 1000));
+        }
     };
 
-    if (self->sig_accumulator_reset) {
-        LOG("FILTER: accumulator reset (%d)", *frame_count);
-        if (*accumulator) {
-            *accumulator = 0;
-            *frame_count = 0;
-            channel_abort_write(self->out);
-        }
-        self->sig_accumulator_reset = 0;
+    if (exchange_acq_rel(&self->sig_accumulator_reset, 0)) {
+        LOG("FILTER: accumulator reset");
+        restart_stages(self);
         event_notify_all(&self->accumulator_reset_event);
     }
-    return 1;
-Error:
-    channel_read_unmap(&self->in, &self->reader, 0);
-    // reset state
-    *frame_count = 0;
-    *accumulator = 0;
-    channel_write_unmap(self->out);
-    return 0;
 }
 
 static int
 video_filter_thread(struct video_filter_s* self)
 {
-    int ecode = 0;
-    uint64_t frame_count = 0;
-    struct VideoFrame* accumulator = 0;
+    thread_set_current_attributes(&self->thread_attributes);
+    // Kept across acquisitions. Only restarted when the thread count changes.
+    band_pool_ensure(&self->pool, self->thread_count, &self->thread_attributes);
     LOG("[stream %d] PROCESSING: Entering frame processing thread",
         self->stream_id);
-    struct throttler throttler = throttler_init(10e-3f);
-    while (!self->is_stopping) {
-        CHECK(process_data(self, &accumulator, &frame_count));
-        throttler_wait(&throttler);
-    }
+    while (!load_acquire(&self->is_stopping))
+        process_data(self, FILTER_WAIT_TIMEOUT_MS);
     LOG("[stream: %d] PROCESSING: Flush", self->stream_id);
-    CHECK(process_data(self, &accumulator, &frame_count));
-Finalize:
-    if (accumulator)
-        channel_write_unmap(self->out);
+    process_data(self, 0);
+    // A partial average would be missing frames, so it's dropped.
+    restart_stages(self);
     LOG("[stream: %d] PROCESSING: Exiting frame processing thread",
         self->stream_id);
-    self->is_running = 0;
-    self->is_stopping = 0;
-    return ecode;
-Error:
-    ecode = 1;
-    goto Finalize;
+    store_release(&self->is_running, 0);
+    store_release(&self->is_stopping, 0);
+    return 0;
 }
 
 enum DeviceStatusCode
@@ -201,9 +1303,24 @@ video_filter_init(struct video_filter_s* self,
                   struct channel* out)
 {
     CHECK(out);
-    *self = (struct video_filter_s){ .stream_id = stream_id, .out = out };
-    channel_new(&self->in, channel_size_bytes);
-    thread_init(&self->thread);
+    *self = (struct video_filter_s){ .stream_id = stream_id,
+                                     .channel_capacity_bytes =
+                                       channel_size_bytes,
+                                     .out = out,
+                                     .kernels = select_kernels() };
+    self->stage_context = (struct filter_stage_context){
+        .kernels = self->kernels,
+        .pool = &self->pool,
+        .flat_field = &self->flat_field,
+    };
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-filter-%d",
+             (int)stream_id);
+    lock_init(&self->lock);
+    channel_new(&self->in, 0);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_filter_thread, self);
     event_init(&self->accumulator_reset_event);
     return Device_Ok;
 Error:
@@ -213,27 +1330,749 @@ Error:
 void
 video_filter_destroy(struct video_filter_s* self)
 {
-    thread_join(&self->thread);
+    parked_thread_destroy(&self->thread);
+    band_pool_stop(&self->pool);
+    trace_ring_reserve(&self->trace, 0);
     event_destroy(&self->accumulator_reset_event);
     channel_release(&self->in);
+    restart_stages(self);
+    for (uint32_t i = 0; i < FILTER_MAX_STAGES + 1; ++i) {
+        memory_free(self->outputs[i].scratch);
+        self->outputs[i] = (struct filter_output){ 0 };
+    }
+    free(self->flat_field.dark);
+    free(self->flat_field.gain);
+    self->flat_field = (struct flat_field){ 0 };
 }
 
 enum DeviceStatusCode
 video_filter_configure(struct video_filter_s* self,
-                       uint32_t frame_average_count)
+                       uint32_t frame_average_count,
+                       const struct filter_stage_params* stages,
+                       uint32_t nstages,
+                       uint32_t thread_count,
+                       size_t channel_capacity_bytes)
 {
+    EXPECT(thread_count <= BAND_POOL_MAX_THREADS,
+           "[stream %d] PROCESSING: Can't average on %u threads. At most %d "
+           "are supported.",
+           self->stream_id,
+           thread_count,
+           BAND_POOL_MAX_THREADS);
+    EXPECT(nstages <= FILTER_MAX_STAGES,
+           "[stream %d] PROCESSING: Got %u filter stages. At most %d are "
+           "supported.",
+           self->stream_id,
+           nstages,
+           FILTER_MAX_STAGES);
+    int has_average = 0;
+    for (uint32_t i = 0; i < nstages; ++i) {
+        EXPECT(filter_stage_params_check(stages + i),
+               "[stream %d] PROCESSING: Invalid filter stage %u.",
+               self->stream_id,
+               i);
+        EXPECT(stages[i].kind != FilterStage_Compress || i + 1 == nstages,
+               "[stream %d] PROCESSING: Only the last filter stage can "
+               "compress. Stage %u of %u does.",
+               self->stream_id,
+               i,
+               nstages);
+        has_average |= stages[i].kind == FilterStage_Average;
+    }
+
     self->filter_window_frames = frame_average_count;
+    self->thread_count = thread_count;
+    self->channel_capacity_bytes = channel_capacity_bytes;
+    memset(self->requested, 0, sizeof(self->requested)); // NOLINT
+    memcpy(self->requested, stages, nstages * sizeof(*stages)); // NOLINT
+    self->nrequested = nstages;
+
+    struct filter_stage_params chain[FILTER_MAX_STAGES + 1] = { 0 };
+    uint32_t nchain = 0;
+    if (frame_average_count > 1 && !has_average) {
+        chain[nchain++] = (struct filter_stage_params){
+            .kind = FilterStage_Average,
+            .frame_count = frame_average_count,
+        };
+    }
+    for (uint32_t i = 0; i < nstages; ++i)
+        chain[nchain++] = stages[i];
+
+    lock_acquire(&self->lock);
+    if (nchain != self->nchain ||
+        memcmp(chain, self->chain, sizeof(chain))) { // NOLINT
+        memcpy(self->chain, chain, sizeof(chain));   // NOLINT
+        self->nchain = nchain;
+        ++self->chain_generation;
+    }
+    lock_release(&self->lock);
     return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+video_filter_is_enabled(const struct video_filter_s* self)
+{
+    return self->nchain > 0;
+}
+
+int
+video_filter_is_compressing(const struct video_filter_s* self)
+{
+    return self->nchain > 0 &&
+           self->chain[self->nchain - 1].kind == FilterStage_Compress;
+}
+
+int
+video_filter_output_shape(const struct video_filter_s* self,
+                          const struct ImageShape* in,
+                          struct ImageShape* out)
+{
+    struct ImageShape shape = *in;
+    for (uint32_t i = 0; i < self->nchain; ++i) {
+        const struct filter_stage stage = {
+            .ops = stage_ops(self->chain[i].kind),
+            .params = self->chain[i],
+            .ctx = &self->stage_context,
+        };
+        struct ImageShape next = { 0 };
+        EXPECT(stage_shape(&stage, &shape, &next),
+               "[stream %d] PROCESSING: The %s stage can't process %ux%u %s "
+               "frames.",
+               self->stream_id,
+               stage.ops->name,
+               shape.dims.width,
+               shape.dims.height,
+               sample_type_as_string(shape.type));
+        shape = next;
+    }
+    *out = shape;
+    return 1;
+Error:
+    return 0;
+}
+
+int
+video_filter_unpack_frame(const struct VideoFrame* frame, uint16_t* dst)
+{
+    const enum SampleType type = frame->shape.type;
+    if (sample_type_unpacked(type) == type)
+        return 0;
+    select_kernels()->unpack(dst,
+                             frame->data,
+                             bits_of_type(type),
+                             (size_t)frame->shape.strides.planes);
+    return 1;
+}
+
+enum DeviceStatusCode
+video_filter_set_flat_field(struct video_filter_s* self,
+                            uint32_t channels,
+                            uint32_t width,
+                            uint32_t height,
+                            const float* dark,
+                            const float* gain)
+{
+    const size_t nbytes = sizeof(float) * channels * width * height;
+    struct flat_field ff = { .channels = channels,
+                             .width = width,
+                             .height = height };
+    if (dark) {
+        CHECK(ff.dark = (float*)malloc(nbytes));
+        memcpy(ff.dark, dark, nbytes); // NOLINT
+    }
+    if (gain) {
+        CHECK(ff.gain = (float*)malloc(nbytes));
+        memcpy(ff.gain, gain, nbytes); // NOLINT
+    }
+    free(self->flat_field.dark);
+    free(self->flat_field.gain);
+    self->flat_field = ff;
+    return Device_Ok;
+Error:
+    free(ff.dark);
+    return Device_Err;
 }
 
 enum DeviceStatusCode
 video_filter_start(struct video_filter_s* self)
 {
-    self->is_stopping = 0;
-    self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_filter_thread, self));
+    // The source only writes to the filter when there are stages to run.
+    if (video_filter_is_enabled(self)) {
+        const size_t capacity = channel_capacity_of_whole_frames(
+          &self->in, self->channel_capacity_bytes, self->bytes_of_image);
+        if (self->in.capacity != capacity) {
+            LOG("[stream %d] PROCESSING: Allocating %llu bytes for the queue.",
+                self->stream_id,
+                (unsigned long long)capacity);
+            LOG("[stream %d] PROCESSING: Averaging with %s kernels.",
+                self->stream_id,
+                self->kernels->name);
+        }
+        CHECK(channel_reserve(&self->in, capacity));
+        self->reader.bytes_read = 0;
+    }
+    latency_histogram_reset(&self->channel_to_filter_us);
+    self->counters = (struct video_filter_counters){ 0 };
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_discarding, 0);
+    store_release(&self->is_running, 1);
+    CHECK(parked_thread_run(&self->thread));
     return Device_Ok;
 Error:
     return Device_Err;
 }
+
+//
+//  KERNEL TIMING
+//
+
+// Calls kernel `op`, which takes `x` of type `X` and `y` of type `Y`.
+#define KERNEL_RUNNER(op, X, Y)                                                \
+    static void run_##op(                                                      \
+      const struct filter_kernels* k, void* x, const void* y, size_t n)        \
+    {                                                                          \
+        k->op((X*)x, (const Y*)y, n);                                          \
+    }
+
+KERNEL_RUNNER(accumulate_u8, float, uint8_t)
+KERNEL_RUNNER(accumulate_u16, float, uint16_t)
+KERNEL_RUNNER(accumulate_i8, float, int8_t)
+KERNEL_RUNNER(accumulate_i16, float, int16_t)
+KERNEL_RUNNER(accumulate_f32, float, float)
+KERNEL_RUNNER(subtract_f32, float, float)
+KERNEL_RUNNER(max_u8, uint8_t, uint8_t)
+KERNEL_RUNNER(max_u16, uint16_t, uint16_t)
+KERNEL_RUNNER(max_i8, int8_t, int8_t)
+KERNEL_RUNNER(max_i16, int16_t, int16_t)
+KERNEL_RUNNER(max_f32, float, float)
+KERNEL_RUNNER(min_u8, uint8_t, uint8_t)
+KERNEL_RUNNER(min_u16, uint16_t, uint16_t)
+KERNEL_RUNNER(min_i8, int8_t, int8_t)
+KERNEL_RUNNER(min_i16, int16_t, int16_t)
+KERNEL_RUNNER(min_f32, float, float)
+
+#undef KERNEL_RUNNER
+
+static void
+run_blend_f32(const struct filter_kernels* k, void* x, const void* y, size_t n)
+{
+    k->blend_f32((float*)x, (const float*)y, 0.5f, n);
+}
+
+static void
+run_scale(const struct filter_kernels* k, void* x, const void* y, size_t n)
+{
+    (void)y;
+    // Scaling by 1 keeps repeated runs away from denormals.
+    k->scale((float*)x, 1.0f, n);
+}
+
+static void
+run_pack_u12(const struct filter_kernels* k, void* x, const void* y, size_t n)
+{
+    k->pack((uint8_t*)x, (const uint16_t*)y, 12, n);
+}
+
+static void
+run_unpack_u12(const struct filter_kernels* k, void* x, const void* y, size_t n)
+{
+    k->unpack((uint16_t*)x, (const uint8_t*)y, 12, n);
+}
+
+/// Every kernel, with the bytes it reads and writes per sample.
+static const struct
+{
+    const char* name;
+    double bytes_per_sample;
+    void (*run)(const struct filter_kernels*, void*, const void*, size_t);
+} kernel_runners[] = {
+#define XXX(op, bytes) { #op, bytes, run_##op }
+    XXX(accumulate_u8, 9),
+    XXX(accumulate_u16, 10),
+    XXX(accumulate_i8, 9),
+    XXX(accumulate_i16, 10),
+    XXX(accumulate_f32, 12),
+    XXX(subtract_f32, 12),
+    XXX(blend_f32, 12),
+    XXX(scale, 8),
+    XXX(max_u8, 3),
+    XXX(max_u16, 6),
+    XXX(max_i8, 3),
+    XXX(max_i16, 6),
+    XXX(max_f32, 12),
+    XXX(min_u8, 3),
+    XXX(min_u16, 6),
+    XXX(min_i8, 3),
+    XXX(min_i16, 6),
+    XXX(min_f32, 12),
+    XXX(pack_u12, 3.5),
+    XXX(unpack_u12, 3.5),
+#undef XXX
+};
+
+int
+video_filter_time_kernels(
+  size_t nsamples,
+  double min_ms,
+  void (*report)(void* ctx, const struct video_filter_kernel_timing* t),
+  void* ctx)
+{
+    const struct filter_kernels* all[4] = { 0 };
+    const size_t nkernels = available_kernels(all);
+    // Room for a float per sample in each, which every kernel fits in.
+    float* x = (float*)malloc(sizeof(float) * nsamples);
+    float* y = (float*)malloc(sizeof(float) * nsamples);
+    CHECK(x && y);
+    for (size_t i = 0; i < nsamples; ++i)
+        y[i] = (float)(i % 1000) / 1000.0f;
+
+    for (size_t k = 0; k < nkernels; ++k) {
+        for (size_t r = 0; r < sizeof(kernel_runners) / sizeof(*kernel_runners);
+             ++r) {
+            memset(x, 0, sizeof(float) * nsamples); // NOLINT
+            // Once untimed, so the buffers are in cache if they fit.
+            kernel_runners[r].run(all[k], x, y, nsamples);
+            struct clock clock = { 0 };
+            clock_init(&clock);
+            uint64_t runs = 0;
+            double elapsed_ms = 0.0;
+            do {
+                kernel_runners[r].run(all[k], x, y, nsamples);
+                ++runs;
+            } while ((elapsed_ms = clock_toc_ms(&clock)) < min_ms);
+            const struct video_filter_kernel_timing t = {
+                .isa = all[k]->name,
+                .kernel = kernel_runners[r].name,
+                .nsamples = nsamples,
+                .bytes_per_second = 1e3 * kernel_runners[r].bytes_per_sample *
+                                    (double)nsamples * (double)runs /
+                                    elapsed_ms,
+            };
+            report(ctx, &t);
+        }
+    }
+    free(x);
+    free(y);
+    return 1;
+Error:
+    free(x);
+    free(y);
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Runs one `accumulate_*` kernel on a copy of `x` and checks it against the
+/// plain one.
+#define EXPECT_SAME_ACCUMULATE(kernels, T, y, x, n)                            \
+    do {                                                                       \
+        float expected[sizeof(x) / sizeof(x[0])];                              \
+        float actual[sizeof(x) / sizeof(x[0])];                                \
+        memcpy(expected, x, sizeof(expected));                                 \
+        memcpy(actual, x, sizeof(actual));                                     \
+        accumulate_##T##_plain(expected, y, n);                                \
+        (kernels)->accumulate_##T(actual, y, n);                               \
+        EXPECT(memcmp(expected, actual, sizeof(expected)) == 0,                \
+               "%s accumulate_" #T " differs for %d pixels",                   \
+               (kernels)->name,                                                \
+               (int)n);                                                        \
+    } while (0)
+
+/// Runs one `max_*` or `min_*` kernel on a copy of `x` and checks it
+/// against the plain one.
+#define EXPECT_SAME_EXTREMUM(kernels, op, T, C, x, y, n)                       \
+    do {                                                                       \
+        C expected[sizeof(x) / sizeof(x[0])];                                  \
+        C actual[sizeof(x) / sizeof(x[0])];                                    \
+        memcpy(expected, x, sizeof(expected));                                 \
+        memcpy(actual, x, sizeof(actual));                                     \
+        op##_##T##_plain(expected, y, n);                                      \
+        (kernels)->op##_##T(actual, y, n);                                     \
+        EXPECT(memcmp(expected, actual, sizeof(expected)) == 0,                \
+               "%s " #op "_" #T " differs for %d pixels",                      \
+               (kernels)->name,                                                \
+               (int)n);                                                        \
+    } while (0)
+
+int
+unit_test__filter_kernels_match_plain()
+{
+    const struct filter_kernels* all[4] = { 0 };
+    const size_t nkernels = available_kernels(all);
+    // Sizes around each vector width exercise the tails.
+    const size_t sizes[] = { 0, 1, 7, 8, 9, 15, 16, 17, 31, 33, 100 };
+
+    uint8_t u8[100];
+    uint16_t u16[100];
+    int8_t i8[100];
+    int16_t i16[100];
+    float f32[100];
+    float x[100];
+    // Reversed copies to compare against.
+    uint8_t u8r[100];
+    uint16_t u16r[100];
+    int8_t i8r[100];
+    int16_t i16r[100];
+    for (int i = 0; i < 100; ++i) {
+        u8[i] = (uint8_t)(i * 37 + 255);
+        u16[i] = (uint16_t)(i * 2953 + 65535);
+        i8[i] = (int8_t)(i * 37 - 128);
+        i16[i] = (int16_t)(i * 2953 - 32768);
+        f32[i] = 0.5f * (float)i - 7.25f;
+        x[i] = (float)(i * 3) - 100.0f;
+    }
+    for (int i = 0; i < 100; ++i) {
+        u8r[i] = u8[99 - i];
+        u16r[i] = u16[99 - i];
+        i8r[i] = i8[99 - i];
+        i16r[i] = i16[99 - i];
+    }
+
+    for (size_t k = 0; k < nkernels; ++k) {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+            const size_t n = sizes[j];
+            EXPECT_SAME_ACCUMULATE(all[k], u8, u8, x, n);
+            EXPECT_SAME_ACCUMULATE(all[k], u16, u16, x, n);
+            EXPECT_SAME_ACCUMULATE(all[k], i8, i8, x, n);
+            EXPECT_SAME_ACCUMULATE(all[k], i16, i16, x, n);
+            EXPECT_SAME_ACCUMULATE(all[k], f32, f32, x, n);
+            EXPECT_SAME_EXTREMUM(all[k], max, u8, uint8_t, u8, u8r, n);
+            EXPECT_SAME_EXTREMUM(all[k], max, u16, uint16_t, u16, u16r, n);
+            EXPECT_SAME_EXTREMUM(all[k], max, i8, int8_t, i8, i8r, n);
+            EXPECT_SAME_EXTREMUM(all[k], max, i16, int16_t, i16, i16r, n);
+            EXPECT_SAME_EXTREMUM(all[k], max, f32, float, f32, x, n);
+            EXPECT_SAME_EXTREMUM(all[k], min, u8, uint8_t, u8, u8r, n);
+            EXPECT_SAME_EXTREMUM(all[k], min, u16, uint16_t, u16, u16r, n);
+            EXPECT_SAME_EXTREMUM(all[k], min, i8, int8_t, i8, i8r, n);
+            EXPECT_SAME_EXTREMUM(all[k], min, i16, int16_t, i16, i16r, n);
+            EXPECT_SAME_EXTREMUM(all[k], min, f32, float, f32, x, n);
+
+            float expected[100], actual[100];
+            memcpy(expected, x, sizeof(x));
+            memcpy(actual, x, sizeof(x));
+            subtract_f32_plain(expected, f32, n);
+            all[k]->subtract_f32(actual, f32, n);
+            EXPECT(memcmp(expected, actual, sizeof(x)) == 0,
+                   "%s subtract_f32 differs for %d pixels",
+                   all[k]->name,
+                   (int)n);
+
+            // Blends may be fused into one multiply-add, so allow rounding.
+            memcpy(expected, x, sizeof(x));
+            memcpy(actual, x, sizeof(x));
+            blend_f32_plain(expected, f32, 0.3f, n);
+            all[k]->blend_f32(actual, f32, 0.3f, n);
+            for (size_t i = 0; i < n; ++i)
+                EXPECT(fabsf(expected[i] - actual[i]) < 1e-4f,
+                       "%s blend_f32 differs at %d of %d pixels",
+                       all[k]->name,
+                       (int)i,
+                       (int)n);
+
+            memcpy(expected, x, sizeof(x));
+            memcpy(actual, x, sizeof(x));
+            scale_plain(expected, 0.25f, n);
+            all[k]->scale(actual, 0.25f, n);
+            EXPECT(memcmp(expected, actual, sizeof(x)) == 0,
+                   "%s scale differs for %d pixels",
+                   all[k]->name,
+                   (int)n);
+
+            for (unsigned bits = 10; bits <= 14; bits += 2) {
+                const size_t nbytes = (n * bits + 7) / 8;
+                uint8_t want[176], got[176];
+                uint16_t back[100];
+                pack_samples(want, u16, SampleType_u10p + (bits - 10) / 2, n);
+                all[k]->pack(got, u16, bits, n);
+                EXPECT(memcmp(want, got, nbytes) == 0,
+                       "%s pack of %u bits differs for %d pixels",
+                       all[k]->name,
+                       bits,
+                       (int)n);
+                all[k]->unpack(back, got, bits, n);
+                for (size_t i = 0; i < n; ++i)
+                    EXPECT(back[i] == (u16[i] & ((1u << bits) - 1)),
+                           "%s unpack of %u bits differs at %d of %d pixels",
+                           all[k]->name,
+                           bits,
+                           (int)i,
+                           (int)n);
+            }
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#undef EXPECT_SAME_ACCUMULATE
+#undef EXPECT_SAME_EXTREMUM
+
+/// Feeds `n` constant u8 frames with values 0, 1, 2 ... to `stage` and checks
+/// each output against `expected`.
+static int
+check_running_average(struct filter_stage* stage,
+                      const float* expected,
+                      int n)
+{
+    struct
+    {
+        struct VideoFrame frame;
+        uint8_t data[6];
+    } in = { 0 };
+    struct
+    {
+        struct VideoFrame frame;
+        float data[6];
+    } out = { 0 };
+    filter_stage_make_shape(&in.frame.shape, SampleType_u8, 1, 3, 2, 1);
+    CHECK(stage->ops->shape(stage, &in.frame.shape, &out.frame.shape));
+    for (int i = 0; i < n; ++i) {
+        memset(in.data, i, sizeof(in.data));
+        CHECK(stage->ops->process(stage, &in.frame, &out.frame, 1) ==
+              FilterStage_Emit);
+        for (int j = 0; j < 6; ++j)
+            EXPECT(fabsf(out.data[j] - expected[i]) < 1e-5f,
+                   "%s: frame %d pixel %d is %f. Expected %f.",
+                   stage->ops->name,
+                   i,
+                   j,
+                   (double)out.data[j],
+                   (double)expected[i]);
+    }
+    stage->ops->reset(stage);
+    CHECK(!stage->state);
+    return 1;
+Error:
+    stage->ops->reset(stage);
+    return 0;
+}
+
+int
+unit_test__filter_running_averages()
+{
+    struct band_pool pool = { 0 };
+    const struct filter_stage_context ctx = { .kernels = select_kernels(),
+                                              .pool = &pool };
+    {
+        // Mean of the last 3 of 0, 1, 2, 3, 4, 5.
+        const float expected[] = { 0.0f, 0.5f, 1.0f, 2.0f, 3.0f, 4.0f };
+        struct filter_stage stage = {
+            .ops = &filter_stage_average,
+            .params = { .kind = FilterStage_Average,
+                        .frame_count = 3,
+                        .average_mode = FilterAverage_Sliding },
+            .ctx = &ctx,
+        };
+        CHECK(check_running_average(&stage, expected, 6));
+    }
+    {
+        const float expected[] = { 0.0f, 0.5f, 1.25f, 2.125f };
+        struct filter_stage stage = {
+            .ops = &filter_stage_average,
+            .params = { .kind = FilterStage_Average,
+                        .average_mode = FilterAverage_Exponential,
+                        .alpha = 0.5f },
+            .ctx = &ctx,
+        };
+        CHECK(check_running_average(&stage, expected, 4));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Averages 3 constant frames of `type` with values `v` into `out`.
+static int
+run_integer_average(struct filter_stage* stage,
+                    enum SampleType type,
+                    const int v[3],
+                    void* out_data,
+                    size_t bytes_of_out)
+{
+    struct
+    {
+        struct VideoFrame frame;
+        int16_t data[4];
+    } in = { 0 };
+    struct
+    {
+        struct VideoFrame frame;
+        uint32_t data[4];
+    } out = { 0 };
+    filter_stage_make_shape(&in.frame.shape, type, 1, 2, 2, 1);
+    CHECK(stage->ops->shape(stage, &in.frame.shape, &out.frame.shape));
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j)
+            in.data[j] = (int16_t)v[i];
+        CHECK(stage->ops->process(stage, &in.frame, &out.frame, i == 0) ==
+              (i == 2 ? FilterStage_Emit : FilterStage_Pending));
+    }
+    memcpy(out_data, out.data, bytes_of_out);
+    stage->ops->reset(stage);
+    return 1;
+Error:
+    stage->ops->reset(stage);
+    return 0;
+}
+
+int
+unit_test__filter_integer_averages()
+{
+    struct band_pool pool = { 0 };
+    const struct filter_stage_context ctx = { .kernels = select_kernels(),
+                                              .pool = &pool };
+    struct filter_stage stage = {
+        .ops = &filter_stage_average,
+        .params = { .kind = FilterStage_Average,
+                    .frame_count = 3,
+                    .average_output = FilterAverageOutput_Native },
+        .ctx = &ctx,
+    };
+    struct ImageShape in = { 0 }, out = { 0 };
+
+    {
+        const int v[] = { 1, 2, 4 };
+        uint16_t mean[4] = { 0 };
+        CHECK(run_integer_average(
+          &stage, SampleType_u12, v, mean, sizeof(mean)));
+        for (int j = 0; j < 4; ++j)
+            EXPECT(mean[j] == 2, "Expected 2. Got %d.", (int)mean[j]);
+    }
+    {
+        const int v[] = { -1, -2, -4 };
+        int16_t mean[4] = { 0 };
+        CHECK(run_integer_average(
+          &stage, SampleType_i16, v, mean, sizeof(mean)));
+        for (int j = 0; j < 4; ++j)
+            EXPECT(mean[j] == -2, "Expected -2. Got %d.", (int)mean[j]);
+    }
+
+    stage.params.average_output = FilterAverageOutput_Sum;
+    {
+        const int v[] = { 1000, 2000, 30000 };
+        uint32_t sum[4] = { 0 };
+        CHECK(run_integer_average(
+          &stage, SampleType_u16, v, sum, sizeof(sum)));
+        for (int j = 0; j < 4; ++j)
+            EXPECT(sum[j] == 33000, "Expected 33000. Got %u.", sum[j]);
+    }
+
+    // Sums must fit in 32 bits, and signed samples can't be summed as u32.
+    filter_stage_make_shape(&in, SampleType_i16, 1, 2, 2, 1);
+    CHECK(!stage.ops->shape(&stage, &in, &out));
+    filter_stage_make_shape(&in, SampleType_u16, 1, 2, 2, 1);
+    stage.params.frame_count = 70000;
+    CHECK(!stage.ops->shape(&stage, &in, &out));
+    return 1;
+Error:
+    return 0;
+}
+
+int
+unit_test__filter_projections()
+{
+    struct band_pool pool = { 0 };
+    const struct filter_stage_context ctx = { .kernels = select_kernels(),
+                                              .pool = &pool };
+    const uint8_t frames[3][4] = { { 1, 9, 5, 250 },
+                                   { 7, 2, 5, 200 },
+                                   { 3, 4, 6, 255 } };
+    const uint32_t expected[3][4] = { { 7, 9, 6, 255 },
+                                      { 1, 2, 5, 200 },
+                                      { 11, 15, 16, 705 } };
+    for (int p = 0; p < FilterProjectionCount; ++p) {
+        struct filter_stage stage = {
+            .ops = &filter_stage_project,
+            .params = { .kind = FilterStage_Project,
+                        .frame_count = 3,
+                        .projection = (enum FilterProjection)p },
+            .ctx = &ctx,
+        };
+        struct
+        {
+            struct VideoFrame frame;
+            uint8_t data[4];
+        } in = { 0 };
+        struct
+        {
+            struct VideoFrame frame;
+            uint32_t data[4];
+        } out = { 0 };
+        filter_stage_make_shape(&in.frame.shape, SampleType_u8, 1, 4, 1, 1);
+        CHECK(stage.ops->shape(&stage, &in.frame.shape, &out.frame.shape));
+        CHECK(out.frame.shape.type ==
+              (p == FilterProjection_Sum ? SampleType_u32 : SampleType_u8));
+        for (int i = 0; i < 3; ++i) {
+            memcpy(in.data, frames[i], sizeof(in.data));
+            CHECK(stage.ops->process(&stage, &in.frame, &out.frame, i == 0) ==
+                  (i == 2 ? FilterStage_Emit : FilterStage_Pending));
+        }
+        for (int j = 0; j < 4; ++j) {
+            const uint32_t actual = (p == FilterProjection_Sum)
+                                      ? out.data[j]
+                                      : ((const uint8_t*)out.data)[j];
+            EXPECT(actual == expected[p][j],
+                   "Projection %d pixel %d: expected %u. Got %u.",
+                   p,
+                   j,
+                   expected[p][j],
+                   actual);
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Packing keeps the shape but shrinks the frame, the samples unpack to
+/// what went in, and no stage reads the packed frame.
+int
+unit_test__filter_pack_stage_round_trips()
+{
+    struct band_pool pool = { 0 };
+    const struct filter_stage_context ctx = { .kernels = select_kernels(),
+                                              .pool = &pool };
+    struct filter_stage stage = { .ops = &filter_stage_pack,
+                                  .params = { .kind = FilterStage_Pack },
+                                  .ctx = &ctx };
+    static struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[13 * 3];
+    } in, out;
+    uint16_t back[13 * 3];
+    filter_stage_make_shape(&in.frame.shape, SampleType_u12, 1, 13, 3, 1);
+    for (int i = 0; i < 13 * 3; ++i)
+        in.data[i] = (uint16_t)(i * 105);
+    CHECK(stage_shape(&stage, &in.frame.shape, &out.frame.shape));
+    CHECK(out.frame.shape.type == SampleType_u12p);
+    CHECK(out.frame.shape.dims.width == 13);
+    // 39 samples of 12 bits take 58.5 bytes.
+    CHECK(bytes_of_image(&out.frame.shape) == 59);
+    CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+          FilterStage_Emit);
+    CHECK(video_filter_unpack_frame(&out.frame, back));
+    CHECK(memcmp(back, in.data, sizeof(back)) == 0);
+    CHECK(!video_filter_unpack_frame(&in.frame, back));
+
+    // Nothing takes packed input, packing included.
+    struct ImageShape next;
+    CHECK(!stage_shape(&stage, &out.frame.shape, &next));
+    stage.ops = &filter_stage_crop;
+    stage.params =
+      (struct filter_stage_params){ .kind = FilterStage_Crop,
+                                    .roi = { .width = 4, .height = 1 } };
+    CHECK(!stage_shape(&stage, &out.frame.shape, &next));
+
+    // Only u10, u12 and u14 pack.
+    stage.ops = &filter_stage_pack;
+    filter_stage_make_shape(&in.frame.shape, SampleType_u16, 1, 13, 3, 1);
+    CHECK(!stage_shape(&stage, &in.frame.shape, &next));
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
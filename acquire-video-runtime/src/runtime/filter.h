@@ -2,7 +2,12 @@
 #define H_ACQUIRE_FILTER_V0
 
 #include <stdint.h>
+#include "band_pool.h"
 #include "channel.h"
+#include "histogram.h"
+#include "parked_thread.h"
+#include "trace.h"
+#include "stages.h"
 #include "device/props/device.h"
 
 #ifdef __cplusplus
@@ -10,26 +15,123 @@ extern "C"
 {
 #endif
 
+/// Most stages that can be passed to video_filter_configure().
+#define FILTER_MAX_STAGES (4)
+
+    struct filter_kernels;
+
+    /// A stage's frame in progress.
+    struct filter_output
+    {
+        /// What the stage is writing into, or 0. The last stage writes into
+        /// the `out` channel and the others into `scratch`.
+        struct VideoFrame* frame;
+
+        /// Shape of the input `frame` was started from. Later inputs must
+        /// match.
+        struct ImageShape in_shape;
+
+        void* scratch;
+        size_t bytes_of_scratch;
+
+        /// Set once a frame the stage rejected has been logged.
+        uint8_t has_logged_rejection;
+    };
+
     /// Context for video filter threads
     struct video_filter_s
     {
         uint32_t filter_window_frames;
+
+        /// Stages as passed to video_filter_configure().
+        struct filter_stage_params requested[FILTER_MAX_STAGES];
+        uint32_t nrequested;
+
+        /// The chain made from `requested` and `filter_window_frames`.
+        /// Guarded by `lock`. The filter thread copies it into `stages` when
+        /// `chain_generation` changes.
+        struct filter_stage_params chain[FILTER_MAX_STAGES + 1];
+        uint32_t nchain;
+        uint32_t chain_generation;
+        struct lock lock;
+
+        /// Only touched by the filter thread.
+        struct filter_stage stages[FILTER_MAX_STAGES + 1];
+        struct filter_output outputs[FILTER_MAX_STAGES + 1];
+        uint32_t nstages;
+        uint32_t stages_generation;
+
+        struct filter_stage_context stage_context;
+
+        /// See video_filter_set_flat_field().
+        struct flat_field flat_field;
+
+        /// Threads each frame is averaged across, counting the filter
+        /// thread. 0 and 1 both mean the filter thread alone.
+        uint32_t thread_count;
+
+        /// Size of the `in` channel. Memory is only committed when the filter
+        /// is started with any stages.
+        size_t channel_capacity_bytes;
+
+        /// Bytes of pixels in each frame the source writes, so the `in`
+        /// channel holds a whole number of them. 0 when unknown. See
+        /// channel_capacity_of_whole_frames().
+        size_t bytes_of_image;
+
         struct channel in;
         struct channel* out;
         struct channel_reader reader;
-        int sig_accumulator_reset;
+        /// Set by other threads, with store_release(), to ask the filter
+        /// thread to restart its stages.
+        uint32_t sig_accumulator_reset;
 
         /// Used by external threads to signal the controller thread to stop
-        /// Other threads may write.
-        uint8_t is_stopping;
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
+
+        /// Set by other threads, with store_release(), so frames still in
+        /// `in` are dropped instead of processed. Cleared when the filter is
+        /// started.
+        uint32_t is_discarding;
 
         /// When true, the controller thread has completed it's work.
-        /// Other threads should only read.
-        uint8_t is_running;
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
 
         struct event accumulator_reset_event;
-        struct thread thread;
+        /// Runs the filter once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
         uint8_t stream_id;
+
+        /// Microseconds frames waited in `in`. Reset when the filter is
+        /// started.
+        struct latency_histogram channel_to_filter_us;
+
+        /// Written by the filter thread with relaxed stores, so other threads
+        /// can sample them. Reset when the filter is started.
+        struct video_filter_counters
+        {
+            /// Frames read from `in`, and the time spent running the stages
+            /// on them.
+            uint64_t frames_filtered;
+            uint64_t busy_us;
+            /// Frames read from `in` and dropped, unprocessed, while
+            /// `is_discarding` was set.
+            uint64_t frames_discarded;
+        } counters;
+
+        /// Time spent processing frames. Only recorded when tracing is on.
+        struct trace_ring trace;
+
+        /// The widest SIMD implementation of the averaging loops the CPU
+        /// supports. Chosen by video_filter_init().
+        const struct filter_kernels* kernels;
+
+        /// Workers that process bands of rows alongside the filter thread.
+        /// Kept across acquisitions. See band_pool_ensure().
+        struct band_pool pool;
     };
 
     enum DeviceStatusCode video_filter_init(struct video_filter_s* self,
@@ -39,11 +141,77 @@ extern "C"
 
     void video_filter_destroy(struct video_filter_s* self);
 
-    enum DeviceStatusCode video_filter_configure(struct video_filter_s* self,
-                                                 uint32_t frame_average_count);
+    /// @brief Sets the stages applied to each frame, in order.
+    /// @details When `frame_average_count` is more than 1 and `stages` has no
+    /// averaging stage, one is put at the front. May be called while the
+    /// filter is running. Frames in progress are dropped when the chain
+    /// changes.
+    enum DeviceStatusCode video_filter_configure(
+      struct video_filter_s* self,
+      uint32_t frame_average_count,
+      const struct filter_stage_params* stages,
+      uint32_t nstages,
+      uint32_t thread_count,
+      size_t channel_capacity_bytes);
+
+    /// @returns 1 if frames should be written to the filter's `in` channel
+    /// rather than straight to storage.
+    int video_filter_is_enabled(const struct video_filter_s* self);
+
+    /// @returns 1 if the configured stages end by compressing frames.
+    int video_filter_is_compressing(const struct video_filter_s* self);
+
+    /// @brief Computes the shape of the frames the configured stages make
+    /// from frames of shape `in`.
+    /// @returns 1 on success, or 0 after logging which stage can't process
+    /// `in`.
+    int video_filter_output_shape(const struct video_filter_s* self,
+                                  const struct ImageShape* in,
+                                  struct ImageShape* out);
+
+    /// @brief Copies the images used by flat-field stages.
+    /// @details `dark` and `gain` hold `channels * width * height` values
+    /// each, and either may be NULL. Only call this while the filter isn't
+    /// running.
+    enum DeviceStatusCode video_filter_set_flat_field(
+      struct video_filter_s* self,
+      uint32_t channels,
+      uint32_t width,
+      uint32_t height,
+      const float* dark,
+      const float* gain);
 
     enum DeviceStatusCode video_filter_start(struct video_filter_s* self);
 
+    /// @brief Unpacks the samples of `frame` into `dst`, which holds
+    /// `frame->shape.strides.planes` samples.
+    /// @returns 1 on success, or 0 if `frame` doesn't hold packed samples.
+    int video_filter_unpack_frame(const struct VideoFrame* frame,
+                                  uint16_t* dst);
+
+    /// Throughput of one filter kernel. See video_filter_time_kernels().
+    struct video_filter_kernel_timing
+    {
+        /// Instruction set the kernel was built for, like "avx2".
+        const char* isa;
+        const char* kernel;
+        size_t nsamples;
+        /// Bytes the kernel read and wrote, per second.
+        double bytes_per_second;
+    };
+
+    /// @brief Times every filter kernel built for every instruction set this
+    /// CPU supports on `nsamples` samples, and passes each result to
+    /// `report`.
+    /// @details Each kernel runs over and over for at least `min_ms`. Meant
+    /// for benchmarks, so regressions in any one instruction set show.
+    /// @returns 1 on success, or 0 if the buffers couldn't be allocated.
+    int video_filter_time_kernels(
+      size_t nsamples,
+      double min_ms,
+      void (*report)(void* ctx, const struct video_filter_kernel_timing* t),
+      void* ctx);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
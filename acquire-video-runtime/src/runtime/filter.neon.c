@@ -0,0 +1,132 @@
+#include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NEON is always available on 64-bit ARM, so these need no runtime check.
+// Each loop handles 8 pixels at a time and leaves the rest to the plain
+// kernels.
+
+static inline void
+add_u32_neon(float* x, uint32x4_t v)
+{
+    vst1q_f32(x, vaddq_f32(vld1q_f32(x), vcvtq_f32_u32(v)));
+}
+
+static inline void
+add_s32_neon(float* x, int32x4_t v)
+{
+    vst1q_f32(x, vaddq_f32(vld1q_f32(x), vcvtq_f32_s32(v)));
+}
+
+static void
+accumulate_u8_neon(float* x, const uint8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint16x8_t v = vmovl_u8(vld1_u8(y + i));
+        add_u32_neon(x + i, vmovl_u16(vget_low_u16(v)));
+        add_u32_neon(x + i + 4, vmovl_u16(vget_high_u16(v)));
+    }
+    accumulate_u8_plain(x + i, y + i, n - i);
+}
+
+static void
+accumulate_u16_neon(float* x, const uint16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint16x8_t v = vld1q_u16(y + i);
+        add_u32_neon(x + i, vmovl_u16(vget_low_u16(v)));
+        add_u32_neon(x + i + 4, vmovl_u16(vget_high_u16(v)));
+    }
+    accumulate_u16_plain(x + i, y + i, n - i);
+}
+
+static void
+accumulate_i8_neon(float* x, const int8_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vmovl_s8(vld1_s8(y + i));
+        add_s32_neon(x + i, vmovl_s16(vget_low_s16(v)));
+        add_s32_neon(x + i + 4, vmovl_s16(vget_high_s16(v)));
+    }
+    accumulate_i8_plain(x + i, y + i, n - i);
+}
+
+static void
+accumulate_i16_neon(float* x, const int16_t* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(y + i);
+        add_s32_neon(x + i, vmovl_s16(vget_low_s16(v)));
+        add_s32_neon(x + i + 4, vmovl_s16(vget_high_s16(v)));
+    }
+    accumulate_i16_plain(x + i, y + i, n - i);
+}
+
+static void
+accumulate_f32_neon(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(x + i, vaddq_f32(vld1q_f32(x + i), vld1q_f32(y + i)));
+    accumulate_f32_plain(x + i, y + i, n - i);
+}
+
+static void
+subtract_f32_neon(float* x, const float* y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(x + i, vsubq_f32(vld1q_f32(x + i), vld1q_f32(y + i)));
+    subtract_f32_plain(x + i, y + i, n - i);
+}
+
+static void
+blend_f32_neon(float* x, const float* y, float a, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t vx = vld1q_f32(x + i);
+        const float32x4_t d = vsubq_f32(vld1q_f32(y + i), vx);
+        vst1q_f32(x + i, vaddq_f32(vx, vmulq_n_f32(d, a)));
+    }
+    blend_f32_plain(x + i, y + i, a, n - i);
+}
+
+static void
+scale_neon(float* x, float s, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(x + i, vmulq_n_f32(vld1q_f32(x + i), s));
+    scale_plain(x + i, s, n - i);
+}
+
+// Keeps the larger (or smaller) of `x` and `y` in `x`, 16 bytes at a time.
+#define EXTREMUM_NEON(name, T, V, ld, st, op)                                  \
+    static void name##_neon(T* x, const T* y, size_t n)                        \
+    {                                                                          \
+        const size_t w = 16 / sizeof(T);                                       \
+        size_t i = 0;                                                          \
+        for (; i + w <= n; i += w) {                                           \
+            const V a = ld(x + i);                                             \
+            st(x + i, op(a, ld(y + i)));                                       \
+        }                                                                      \
+        name##_plain(x + i, y + i, n - i);                                     \
+    }
+
+EXTREMUM_NEON(max_u8, uint8_t, uint8x16_t, vld1q_u8, vst1q_u8, vmaxq_u8)
+EXTREMUM_NEON(max_u16, uint16_t, uint16x8_t, vld1q_u16, vst1q_u16, vmaxq_u16)
+EXTREMUM_NEON(max_i8, int8_t, int8x16_t, vld1q_s8, vst1q_s8, vmaxq_s8)
+EXTREMUM_NEON(max_i16, int16_t, int16x8_t, vld1q_s16, vst1q_s16, vmaxq_s16)
+EXTREMUM_NEON(max_f32, float, float32x4_t, vld1q_f32, vst1q_f32, vmaxq_f32)
+EXTREMUM_NEON(min_u8, uint8_t, uint8x16_t, vld1q_u8, vst1q_u8, vminq_u8)
+EXTREMUM_NEON(min_u16, uint16_t, uint16x8_t, vld1q_u16, vst1q_u16, vminq_u16)
+EXTREMUM_NEON(min_i8, int8_t, int8x16_t, vld1q_s8, vst1q_s8, vminq_s8)
+EXTREMUM_NEON(min_i16, int16_t, int16x8_t, vld1q_s16, vst1q_s16, vminq_s16)
+EXTREMUM_NEON(min_f32, float, float32x4_t, vld1q_f32, vst1q_f32, vminq_f32)
+
+#undef EXTREMUM_NEON
@@ -0,0 +1,109 @@
+#include <stddef.h>
+#include <stdint.h>
+
+static void
+accumulate_u8_plain(float* x, const uint8_t* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += y[i];
+}
+
+static void
+accumulate_u16_plain(float* x, const uint16_t* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += y[i];
+}
+
+static void
+accumulate_i8_plain(float* x, const int8_t* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += y[i];
+}
+
+static void
+accumulate_i16_plain(float* x, const int16_t* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += y[i];
+}
+
+static void
+accumulate_f32_plain(float* x, const float* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += y[i];
+}
+
+static void
+subtract_f32_plain(float* x, const float* y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] -= y[i];
+}
+
+static void
+blend_f32_plain(float* x, const float* y, float a, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] += a * (y[i] - x[i]);
+}
+
+static void
+scale_plain(float* x, float s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] *= s;
+}
+
+/// Keeps the larger (or smaller) of `x` and `y` in `x`.
+#define EXTREMUM_PLAIN(name, T, cmp)                                           \
+    static void name(T* x, const T* y, size_t n)                               \
+    {                                                                          \
+        for (size_t i = 0; i < n; ++i)                                         \
+            x[i] = (x[i] cmp y[i]) ? x[i] : y[i];                              \
+    }
+
+EXTREMUM_PLAIN(max_u8_plain, uint8_t, >)
+EXTREMUM_PLAIN(max_u16_plain, uint16_t, >)
+EXTREMUM_PLAIN(max_i8_plain, int8_t, >)
+EXTREMUM_PLAIN(max_i16_plain, int16_t, >)
+EXTREMUM_PLAIN(max_f32_plain, float, >)
+EXTREMUM_PLAIN(min_u8_plain, uint8_t, <)
+EXTREMUM_PLAIN(min_u16_plain, uint16_t, <)
+EXTREMUM_PLAIN(min_i8_plain, int8_t, <)
+EXTREMUM_PLAIN(min_i16_plain, int16_t, <)
+EXTREMUM_PLAIN(min_f32_plain, float, <)
+
+#undef EXTREMUM_PLAIN
+
+/// Packs `n` samples of `bits` bits, as pack_samples() does. Four samples of
+/// any packed type fill a whole number of bytes, `bits / 2`.
+static void
+pack_plain(uint8_t* dst, const uint16_t* src, unsigned bits, size_t n)
+{
+    const uint64_t mask = (1ULL << bits) - 1;
+    for (size_t i = 0; i < n; i += 4, dst += bits / 2) {
+        const size_t m = (n - i < 4) ? n - i : 4;
+        uint64_t v = 0;
+        for (size_t k = 0; k < m; ++k)
+            v |= (src[i + k] & mask) << (k * bits);
+        for (size_t j = 0; j < (m * bits + 7) / 8; ++j)
+            dst[j] = (uint8_t)(v >> (8 * j));
+    }
+}
+
+static void
+unpack_plain(uint16_t* dst, const uint8_t* src, unsigned bits, size_t n)
+{
+    const uint64_t mask = (1ULL << bits) - 1;
+    for (size_t i = 0; i < n; i += 4, src += bits / 2) {
+        const size_t m = (n - i < 4) ? n - i : 4;
+        uint64_t v = 0;
+        for (size_t j = 0; j < (m * bits + 7) / 8; ++j)
+            v |= (uint64_t)src[j] << (8 * j);
+        for (size_t k = 0; k < m; ++k)
+            dst[i + k] = (uint16_t)((v >> (k * bits)) & mask);
+    }
+}
@@ -10,11 +10,17 @@ frame_iterator_init(struct slice* slice)
 struct VideoFrame*
 frame_iterator_next(struct frame_iterator* it)
 {
-    if (it->remaining.beg == 0 || it->remaining.beg >= it->remaining.end) {
+    uint8_t *beg = it->remaining.beg, *end = it->remaining.end;
+    struct VideoFrame* cur = (struct VideoFrame*)beg;
+    // Stops at a frame that doesn't fit, rather than stepping past the end,
+    // or staying in place forever.
+    if (beg == 0 || beg >= end ||
+        (size_t)(end - beg) < sizeof(struct VideoFrame) ||
+        cur->bytes_of_frame < sizeof(struct VideoFrame) ||
+        cur->bytes_of_frame > (size_t)(end - beg)) {
         it->remaining = (struct slice){ 0 };
         return 0;
     }
-    struct VideoFrame* cur = (struct VideoFrame*)it->remaining.beg;
     it->remaining.beg += cur->bytes_of_frame;
     return cur;
 }
@@ -7,7 +7,10 @@
 //! range is represented by a `slice` (also see `vfslice`).
 //!
 //! The `frame_iterator` helps address each successive `VideoFrame` in a
-//! contiguous series of `VideoFrame`s.
+//! contiguous series of `VideoFrame`s. It stops early at a frame whose
+//! `bytes_of_frame` doesn't fit in what's left of the slice.
+//!
+//! Clients get the same iterator through `acquire_frame_iterator_init()`.
 //!
 //! Example:
 //!
@@ -0,0 +1,129 @@
+#include "histogram.h"
+#include "platform.h"
+
+#include <string.h>
+
+#define B (LATENCY_HISTOGRAM_PRECISION_BITS)
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+static unsigned
+floor_log2(uint64_t v)
+{
+    unsigned e = 0;
+    for (unsigned s = 32; s; s >>= 1) {
+        if (v >> s) {
+            v >>= s;
+            e += s;
+        }
+    }
+    return e;
+}
+
+/// Values below 2^B get a bucket each. Above that, each power of two is split
+/// into 2^B buckets.
+static unsigned
+bucket_of(uint64_t v)
+{
+    if (v < (1ULL << B))
+        return (unsigned)v;
+    const unsigned e = floor_log2(v);
+    return ((e - B + 1) << B) + (unsigned)((v >> (e - B)) - (1ULL << B));
+}
+
+/// Largest value that falls in bucket `i`.
+static uint64_t
+bucket_max(unsigned i)
+{
+    if (i < (1U << B))
+        return i;
+    const unsigned e = (i >> B) + B - 1;
+    const uint64_t lo = ((uint64_t)(i & ((1U << B) - 1)) + (1ULL << B))
+                        << (e - B);
+    return lo + ((1ULL << (e - B)) - 1);
+}
+
+void
+latency_histogram_reset(struct latency_histogram* self)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+}
+
+void
+latency_histogram_record(struct latency_histogram* self, uint64_t value)
+{
+    ++self->counts[bucket_of(value)];
+    ++self->count;
+    if (value > self->max)
+        self->max = value;
+}
+
+void
+latency_histogram_record_tics(struct latency_histogram* self,
+                              uint64_t beg,
+                              uint64_t end)
+{
+    if (beg <= end)
+        latency_histogram_record(
+          self, (uint64_t)clock_tics_to_ns((int64_t)(end - beg)) / 1000);
+}
+
+uint64_t
+latency_histogram_percentile(const struct latency_histogram* self, double p)
+{
+    const uint64_t count = self->count;
+    if (!count)
+        return 0;
+    uint64_t rank = (uint64_t)(p * (double)count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        seen += self->counts[i];
+        if (seen >= rank)
+            return min(bucket_max(i), self->max);
+    }
+    return self->max;
+}
+
+#ifndef NO_UNIT_TESTS
+#include "logger.h"
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// Every value lands in a bucket that contains it, and percentiles of a
+/// uniform spread are within the bucket width of the exact answer.
+int
+unit_test__latency_histogram_percentiles_are_close()
+{
+    static struct latency_histogram h;
+    for (uint64_t v = 1; v && v < (1ULL << 62); v = 3 * v + 1) {
+        const unsigned i = bucket_of(v);
+        CHECK(i < LATENCY_HISTOGRAM_BUCKETS);
+        CHECK(bucket_max(i) >= v);
+        CHECK(i == 0 || bucket_max(i - 1) < v);
+    }
+    CHECK(bucket_of(~0ULL) == LATENCY_HISTOGRAM_BUCKETS - 1);
+
+    latency_histogram_reset(&h);
+    CHECK(latency_histogram_percentile(&h, 0.5) == 0);
+    for (uint64_t v = 1; v <= 10000; ++v)
+        latency_histogram_record(&h, v);
+    CHECK(h.count == 10000);
+    CHECK(h.max == 10000);
+    const uint64_t p50 = latency_histogram_percentile(&h, 0.5);
+    const uint64_t p99 = latency_histogram_percentile(&h, 0.99);
+    CHECK(p50 >= 5000 && p50 <= 5000 + 5000 / (1 << B));
+    CHECK(p99 >= 9900 && p99 <= 10000);
+    CHECK(latency_histogram_percentile(&h, 1.0) == 10000);
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
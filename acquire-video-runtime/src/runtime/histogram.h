@@ -0,0 +1,61 @@
+//! Latency histogram with buckets whose width grows with the value, in the
+//! style of HdrHistogram, so percentiles have a bounded relative error (about
+//! 6%) over any range of values while recording stays a few instructions.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     struct latency_histogram h;
+//!     latency_histogram_reset(&h);
+//!     latency_histogram_record_tics(&h, queued, clock_tic(0));
+//!     uint64_t p99 = latency_histogram_percentile(&h, 0.99);
+//! ~~~
+//!
+//! A histogram has a single writer. It may be read from other threads while
+//! it is being written, in which case the result is approximate.
+
+#ifndef H_ACQUIRE_HISTOGRAM_V0
+#define H_ACQUIRE_HISTOGRAM_V0
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Sub-buckets per power of two are 2^this.
+#define LATENCY_HISTOGRAM_PRECISION_BITS (4)
+#define LATENCY_HISTOGRAM_BUCKETS                                              \
+    ((65 - LATENCY_HISTOGRAM_PRECISION_BITS)                                   \
+     << LATENCY_HISTOGRAM_PRECISION_BITS)
+
+    struct latency_histogram
+    {
+        uint64_t counts[LATENCY_HISTOGRAM_BUCKETS];
+        uint64_t count;
+        uint64_t max;
+    };
+
+    void latency_histogram_reset(struct latency_histogram* self);
+
+    void latency_histogram_record(struct latency_histogram* self,
+                                  uint64_t value);
+
+    /// @brief Records the microseconds between two values returned by
+    /// clock_tic().  Ignored if `end` comes before `beg`.
+    void latency_histogram_record_tics(struct latency_histogram* self,
+                                       uint64_t beg,
+                                       uint64_t end);
+
+    /// @brief Smallest value at least a fraction `p` of the samples are less
+    /// than or equal to, to within the bucket width.
+    /// @returns 0 if nothing was recorded.
+    uint64_t latency_histogram_percentile(const struct latency_histogram* self,
+                                          double p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_HISTOGRAM_V0
@@ -0,0 +1,571 @@
+#include "intensity.h"
+#include "frame_iterator.h"
+#include "logger.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+// The thread is woken as soon as frames arrive and when it's asked to stop.
+// This bounds how long it sleeps otherwise.
+#define INTENSITY_WAIT_TIMEOUT_MS (100)
+
+// Entries in each table of counts: one per value of a 16-bit sample.
+#define INTENSITY_MAX_VALUES (1 << 16)
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                               \
+  (defined(__GNUC__) || defined(__clang__))
+#define INTENSITY_HAS_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+/// Counts each sample's value into one of four tables in turn, so runs of
+/// equal samples don't wait on each other's increments, then adds the tables
+/// into the first. Signed samples are offset by `bias` to count from 0.
+#define COUNT(name, T, U, nvalues, bias)                                       \
+    static void name(uint32_t* counts, const T* x, size_t n)                   \
+    {                                                                          \
+        uint32_t* const c0 = counts;                                           \
+        uint32_t* const c1 = counts + (nvalues);                               \
+        uint32_t* const c2 = counts + 2 * (nvalues);                           \
+        uint32_t* const c3 = counts + 3 * (nvalues);                           \
+        size_t i = 0;                                                          \
+        if (n < (nvalues)) {                                                   \
+            /* Clearing the other tables would cost more than they save. */   \
+            memset(c0, 0, sizeof(uint32_t) * (nvalues)); /* NOLINT */          \
+        } else {                                                               \
+            memset(c0, 0, 4 * sizeof(uint32_t) * (nvalues)); /* NOLINT */      \
+            for (; i + 4 <= n; i += 4) {                                       \
+                ++c0[(U)x[i] ^ (bias)];                                        \
+                ++c1[(U)x[i + 1] ^ (bias)];                                    \
+                ++c2[(U)x[i + 2] ^ (bias)];                                    \
+                ++c3[(U)x[i + 3] ^ (bias)];                                    \
+            }                                                                  \
+            for (size_t v = 0; v < (nvalues); ++v)                             \
+                c0[v] += c1[v] + c2[v] + c3[v];                                \
+        }                                                                      \
+        for (; i < n; ++i)                                                     \
+            ++c0[(U)x[i] ^ (bias)];                                            \
+    }
+
+COUNT(count_u8, uint8_t, uint8_t, 1 << 8, 0)
+COUNT(count_i8, int8_t, uint8_t, 1 << 8, 0x80)
+COUNT(count_u16, uint16_t, uint16_t, 1 << 16, 0)
+COUNT(count_i16, int16_t, uint16_t, 1 << 16, 0x8000)
+
+#undef COUNT
+
+/// Bits of the values a sample of `type` can take. Unpacked 10, 12 and 14 bit
+/// samples take 2 bytes.
+static unsigned
+bits_of_values(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u10:
+            return 10;
+        case SampleType_u12:
+            return 12;
+        case SampleType_u14:
+            return 14;
+        default:
+            return bits_of_type(type);
+    }
+}
+
+/// Fills in `out` from `counts`, which has an entry for each of `nvalues`
+/// values, the first being `lo`. `bits` is as from bits_of_values(). Values
+/// past `2^bits - 1` are only possible in unpacked samples of fewer than 16
+/// bits. They go in the last bin.
+static void
+summarize_counts(struct intensity_stats* out,
+                 const uint32_t* counts,
+                 size_t nvalues,
+                 double lo,
+                 unsigned bits)
+{
+    const size_t range = (size_t)1 << bits;
+    const size_t values_per_bin =
+      range > INTENSITY_BINS ? range / INTENSITY_BINS : 1;
+    size_t first = nvalues, last = 0;
+    double sum = 0.0;
+    for (size_t v = 0; v < nvalues; ++v) {
+        if (!counts[v])
+            continue;
+        if (first == nvalues)
+            first = v;
+        last = v;
+        sum += (double)counts[v] * (double)v;
+        const size_t bin = v / values_per_bin;
+        out->bins[bin < INTENSITY_BINS ? bin : INTENSITY_BINS - 1] +=
+          counts[v];
+    }
+    out->bin_lo = lo;
+    out->bin_width = (double)values_per_bin;
+    if (first == nvalues)
+        return;
+
+    const double n = (double)out->sample_count;
+    const double mean = sum / n;
+    double ss = 0.0;
+    for (size_t v = first; v <= last; ++v) {
+        const double d = (double)v - mean;
+        ss += (double)counts[v] * d * d;
+    }
+    out->min = lo + (double)first;
+    out->max = lo + (double)last;
+    out->mean = lo + mean;
+    out->stddev = sqrt(ss / n);
+    out->at_floor = counts[0];
+    out->at_ceiling = counts[range - 1];
+}
+
+/// Widens the min and max in `mn` and `mx` to those of `x`, and adds its
+/// samples to `sum`. NaN samples don't count towards the min and max.
+static void
+extrema_and_sum_f32_plain(const float* x,
+                          size_t n,
+                          float* mn,
+                          float* mx,
+                          double* sum)
+{
+    float a = *mn, b = *mx;
+    double s = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        a = (x[i] < a) ? x[i] : a;
+        b = (x[i] > b) ? x[i] : b;
+        s += x[i];
+    }
+    *mn = a;
+    *mx = b;
+    *sum += s;
+}
+
+#ifdef INTENSITY_HAS_AVX2_KERNELS
+// Compiled for AVX2 regardless of the flags used for the rest of the file,
+// and only called when the CPU supports it. Handles 8 samples at a time and
+// leaves the rest to the plain kernel.
+__attribute__((target("avx2"))) static void
+extrema_and_sum_f32_avx2(const float* x,
+                         size_t n,
+                         float* mn,
+                         float* mx,
+                         double* sum)
+{
+    __m256 a = _mm256_set1_ps(*mn), b = _mm256_set1_ps(*mx);
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(x + i);
+        // Each returns its second operand when the first is NaN.
+        a = _mm256_min_ps(v, a);
+        b = _mm256_max_ps(v, b);
+        s0 = _mm256_add_pd(s0, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        s1 = _mm256_add_pd(s1, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    float as[8], bs[8];
+    double ss[4];
+    _mm256_storeu_ps(as, a);
+    _mm256_storeu_ps(bs, b);
+    _mm256_storeu_pd(ss, _mm256_add_pd(s0, s1));
+    for (int k = 0; k < 8; ++k) {
+        *mn = (as[k] < *mn) ? as[k] : *mn;
+        *mx = (bs[k] > *mx) ? bs[k] : *mx;
+    }
+    *sum += (ss[0] + ss[1]) + (ss[2] + ss[3]);
+    extrema_and_sum_f32_plain(x + i, n - i, mn, mx, sum);
+}
+#endif
+
+typedef void (*extrema_and_sum_f32_fn)(const float*,
+                                       size_t,
+                                       float*,
+                                       float*,
+                                       double*);
+
+static extrema_and_sum_f32_fn
+select_f32_kernel(void)
+{
+#ifdef INTENSITY_HAS_AVX2_KERNELS
+    if (__builtin_cpu_supports("avx2"))
+        return extrema_and_sum_f32_avx2;
+#endif
+    return extrema_and_sum_f32_plain;
+}
+
+const char*
+intensity_kernels_name(void)
+{
+    return select_f32_kernel() == extrema_and_sum_f32_plain ? "plain" : "avx2";
+}
+
+/// f32 samples are binned over `[min, max]` in a second pass, which also sums
+/// the squared deviations.
+static void
+measure_f32(struct intensity_stats* out, const float* x, size_t n)
+{
+    float mn = INFINITY, mx = -INFINITY;
+    double sum = 0.0;
+    select_f32_kernel()(x, n, &mn, &mx, &sum);
+    if (mn > mx)
+        return;
+
+    const double mean = sum / (double)n;
+    double width = ((double)mx - (double)mn) / INTENSITY_BINS;
+    if (!(width > 0.0) || !isfinite(width))
+        width = 1.0;
+    const double scale = 1.0 / width;
+    double ss = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!(x[i] >= mn && x[i] <= mx))
+            continue;
+        const double d = x[i] - mean;
+        ss += d * d;
+        const double bin = ((double)x[i] - mn) * scale;
+        ++out->bins[bin < INTENSITY_BINS - 1 ? (size_t)bin
+                                             : INTENSITY_BINS - 1];
+    }
+    out->min = mn;
+    out->max = mx;
+    out->mean = mean;
+    out->stddev = sqrt(ss / (double)n);
+    out->bin_lo = mn;
+    out->bin_width = width;
+}
+
+/// u32 samples are binned over their whole range, 2^24 values to a bin.
+static void
+measure_u32(struct intensity_stats* out, const uint32_t* x, size_t n)
+{
+    uint32_t mn = UINT32_MAX, mx = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        mn = (x[i] < mn) ? x[i] : mn;
+        mx = (x[i] > mx) ? x[i] : mx;
+        sum += x[i];
+    }
+    const double mean = sum / (double)n;
+    double ss = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const double d = x[i] - mean;
+        ss += d * d;
+        ++out->bins[x[i] >> 24];
+        out->at_floor += (x[i] == 0);
+        out->at_ceiling += (x[i] == UINT32_MAX);
+    }
+    out->min = mn;
+    out->max = mx;
+    out->mean = mean;
+    out->stddev = sqrt(ss / (double)n);
+    out->bin_lo = 0.0;
+    out->bin_width = (double)(1 << 24);
+}
+
+int
+intensity_measure(struct intensity_scratch* scratch,
+                  const struct VideoFrame* frame,
+                  struct intensity_stats* out)
+{
+    if (frame->compression != FrameCompression_None)
+        return 0;
+    const size_t n = (size_t)frame->shape.strides.planes;
+    const enum SampleType type = sample_type_unpacked(frame->shape.type);
+    const void* data = frame->data;
+    if (type != frame->shape.type) {
+        if (scratch->samples_of_unpacked < n) {
+            uint16_t* const unpacked =
+              (uint16_t*)realloc(scratch->unpacked, sizeof(uint16_t) * n);
+            CHECK(unpacked);
+            scratch->unpacked = unpacked;
+            scratch->samples_of_unpacked = n;
+        }
+        unpack_samples(scratch->unpacked, frame->data, frame->shape.type, n);
+        data = scratch->unpacked;
+    }
+    if (!scratch->counts) {
+        CHECK(scratch->counts = (uint32_t*)malloc(4 * sizeof(uint32_t) *
+                                                  INTENSITY_MAX_VALUES));
+    }
+
+    memset(out, 0, sizeof(*out)); // NOLINT
+    out->frame_id = frame->frame_id;
+    out->sample_type = type;
+    out->sample_count = n;
+    if (!n)
+        return 1;
+    switch (type) {
+        case SampleType_u8:
+            count_u8(scratch->counts, (const uint8_t*)data, n);
+            summarize_counts(out, scratch->counts, 1 << 8, 0.0, 8);
+            break;
+        case SampleType_i8:
+            count_i8(scratch->counts, (const int8_t*)data, n);
+            summarize_counts(out, scratch->counts, 1 << 8, -128.0, 8);
+            break;
+        case SampleType_u16:
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+            count_u16(scratch->counts, (const uint16_t*)data, n);
+            summarize_counts(
+              out, scratch->counts, 1 << 16, 0.0, bits_of_values(type));
+            break;
+        case SampleType_i16:
+            count_i16(scratch->counts, (const int16_t*)data, n);
+            summarize_counts(out, scratch->counts, 1 << 16, -32768.0, 16);
+            break;
+        case SampleType_f32:
+            measure_f32(out, (const float*)data, n);
+            break;
+        case SampleType_u32:
+            measure_u32(out, (const uint32_t*)data, n);
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+void
+intensity_scratch_free(struct intensity_scratch* self)
+{
+    free(self->counts);
+    free(self->unpacked);
+    memset(self, 0, sizeof(*self)); // NOLINT
+}
+
+/// Measures the first frame of what the reader has mapped.
+/// @returns The bytes of the frame, or 0 if nothing is mapped.
+static size_t
+measure_next(struct video_intensity_s* self, struct slice* region)
+{
+    struct frame_iterator it = frame_iterator_init(region);
+    const struct VideoFrame* const frame = frame_iterator_next(&it);
+    if (!frame)
+        return (size_t)(region->end - region->beg);
+
+    struct intensity_stats stats;
+    if (intensity_measure(&self->scratch, frame, &stats)) {
+        lock_acquire(&self->lock);
+        self->latest = stats;
+        ++self->frames_measured;
+        lock_release(&self->lock);
+    }
+    return frame->bytes_of_frame;
+}
+
+static int
+video_intensity_thread(struct video_intensity_s* const self)
+{
+    thread_set_current_attributes(&self->thread_attributes);
+    while (1) {
+        // One frame at a time, so the reader only ever holds back the writer
+        // for as long as a frame takes to measure.
+        struct slice region = channel_read_map_wait(
+          self->in, &self->reader, INTENSITY_WAIT_TIMEOUT_MS);
+        const size_t nbytes = measure_next(self, &region);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+        if (!nbytes && load_acquire(&self->is_stopping))
+            break;
+    }
+    LOG("[stream %d] INTENSITY: Exiting thread. Skipped %llu frames.",
+        (int)self->stream_id,
+        (unsigned long long)self->reader.skipped);
+    store_release(&self->is_running, 0);
+    return 0;
+}
+
+enum DeviceStatusCode
+video_intensity_init(struct video_intensity_s* self,
+                     uint8_t stream_id,
+                     struct channel* in)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->stream_id = stream_id;
+    self->in = in;
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-intensity-%d",
+             (int)stream_id);
+    lock_init(&self->lock);
+    channel_reader_set_lossy(in, &self->reader, 1);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_intensity_thread, self);
+    return Device_Ok;
+}
+
+void
+video_intensity_destroy(struct video_intensity_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    intensity_scratch_free(&self->scratch);
+}
+
+enum DeviceStatusCode
+video_intensity_start(struct video_intensity_s* self)
+{
+    lock_acquire(&self->lock);
+    self->frames_measured = 0;
+    lock_release(&self->lock);
+    if (!self->is_enabled)
+        return Device_Ok;
+    self->reader.skipped = 0;
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    if (!parked_thread_run(&self->thread)) {
+        store_release(&self->is_running, 0);
+        LOGE("[stream %d] INTENSITY: Failed to start thread.",
+             (int)self->stream_id);
+        return Device_Err;
+    }
+    return Device_Ok;
+}
+
+void
+video_intensity_stop(struct video_intensity_s* self)
+{
+    store_release(&self->is_stopping, 1);
+    channel_wake_readers(self->in);
+    parked_thread_wait(&self->thread);
+    channel_reader_detach(self->in, &self->reader);
+}
+
+uint64_t
+video_intensity_get(struct video_intensity_s* self,
+                    struct intensity_stats* out)
+{
+    lock_acquire(&self->lock);
+    const uint64_t n = self->frames_measured;
+    if (n)
+        *out = self->latest;
+    lock_release(&self->lock);
+    return n;
+}
+
+#ifndef NO_UNIT_TESTS
+
+static uint64_t
+sum_of_bins(const struct intensity_stats* stats)
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < INTENSITY_BINS; ++i)
+        n += stats->bins[i];
+    return n;
+}
+
+static void
+make_shape(struct ImageShape* shape, enum SampleType type, uint32_t n)
+{
+    *shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = n, .height = 1, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = n, .planes = n },
+        .type = type,
+    };
+}
+
+/// Statistics agree with the samples for each kind of sample type, and with
+/// either table layout.
+int
+unit_test__intensity_stats_match_samples()
+{
+    struct intensity_scratch scratch = { 0 };
+    struct intensity_stats stats;
+    static struct
+    {
+        struct VideoFrame frame;
+        uint8_t data[4 * 1024];
+    } f;
+
+    // Few enough samples for one table.
+    make_shape(&f.frame.shape, SampleType_u8, 16);
+    for (int i = 0; i < 16; ++i)
+        f.data[i] = (uint8_t)(17 * i);
+    CHECK(intensity_measure(&scratch, &f.frame, &stats));
+    CHECK(stats.sample_count == 16);
+    CHECK(stats.min == 0.0 && stats.max == 255.0 && stats.mean == 127.5);
+    CHECK(stats.at_floor == 1 && stats.at_ceiling == 1);
+    CHECK(stats.bin_width == 1.0 && stats.bins[17] == 1);
+    CHECK(sum_of_bins(&stats) == 16);
+
+    // Enough for four, with signed samples.
+    make_shape(&f.frame.shape, SampleType_i8, 1024);
+    for (int i = 0; i < 1024; ++i)
+        f.data[i] = (uint8_t)(int8_t)(i % 2 ? -128 : 127);
+    CHECK(intensity_measure(&scratch, &f.frame, &stats));
+    CHECK(stats.min == -128.0 && stats.max == 127.0 && stats.mean == -0.5);
+    CHECK(stats.stddev == 127.5);
+    CHECK(stats.at_floor == 512 && stats.at_ceiling == 512);
+    CHECK(stats.bin_lo == -128.0 && stats.bins[0] == 512);
+    CHECK(stats.bins[255] == 512);
+
+    // 12-bit samples top out at 4095, 16 values to a bin.
+    {
+        uint16_t* const x = (uint16_t*)f.data;
+        const uint16_t v[] = { 0, 4095, 100, 100 };
+        make_shape(&f.frame.shape, SampleType_u12, 4);
+        memcpy(x, v, sizeof(v)); // NOLINT
+        CHECK(intensity_measure(&scratch, &f.frame, &stats));
+        CHECK(stats.sample_type == SampleType_u12);
+        CHECK(stats.max == 4095.0 && stats.at_ceiling == 1);
+        CHECK(stats.bin_width == 16.0 && stats.bins[6] == 2);
+        CHECK(stats.bins[255] == 1 && sum_of_bins(&stats) == 4);
+
+        // Packed samples are measured unpacked.
+        pack_samples(f.data + 64, v, SampleType_u12p, 4);
+        memmove(f.data, f.data + 64, 6); // NOLINT
+        make_shape(&f.frame.shape, SampleType_u12p, 4);
+        CHECK(intensity_measure(&scratch, &f.frame, &stats));
+        CHECK(stats.sample_type == SampleType_u12);
+        CHECK(stats.max == 4095.0 && stats.bins[6] == 2);
+    }
+
+    {
+        int16_t* const x = (int16_t*)f.data;
+        const int16_t v[] = { -32768, 0, 32767, 2 };
+        make_shape(&f.frame.shape, SampleType_i16, 4);
+        memcpy(x, v, sizeof(v)); // NOLINT
+        CHECK(intensity_measure(&scratch, &f.frame, &stats));
+        CHECK(stats.min == -32768.0 && stats.max == 32767.0);
+        CHECK(stats.mean == 0.25);
+        CHECK(stats.at_floor == 1 && stats.at_ceiling == 1);
+        CHECK(stats.bin_lo == -32768.0 && stats.bins[128] == 2);
+    }
+
+    // Enough f32 samples for the vector loop and its tail.
+    {
+        float* const x = (float*)f.data;
+        make_shape(&f.frame.shape, SampleType_f32, 21);
+        for (int i = 0; i < 21; ++i)
+            x[i] = (float)i;
+        CHECK(intensity_measure(&scratch, &f.frame, &stats));
+        CHECK(stats.min == 0.0 && stats.max == 20.0 && stats.mean == 10.0);
+        CHECK(fabs(stats.stddev - sqrt(440.0 / 12.0)) < 1e-9);
+        CHECK(stats.at_floor == 0 && stats.at_ceiling == 0);
+        CHECK(stats.bins[0] == 1 && stats.bins[255] == 1);
+        CHECK(sum_of_bins(&stats) == 21);
+    }
+
+    f.frame.compression = FrameCompression_Lz4;
+    CHECK(!intensity_measure(&scratch, &f.frame, &stats));
+    intensity_scratch_free(&scratch);
+    return 1;
+Error:
+    intensity_scratch_free(&scratch);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,139 @@
+//! Intensity statistics of a stream's frames, for auto-contrast and exposure
+//! displays that would otherwise map every frame to compute them.
+//!
+//! A thread reads the stream's queue to storage, where the monitor reads,
+//! with a lossy reader. For each frame it computes the min, max, mean and
+//! standard deviation of the samples, how many sit at either end of the
+//! sample type's range, and a histogram. Only the latest frame's statistics
+//! are kept. When frames arrive faster than they can be measured, the reader
+//! skips ahead to the newest, so the camera and storage are never held back
+//! for longer than one frame takes to measure.
+//!
+//! Integer samples of up to 16 bits are counted into a table with an entry
+//! per value, from which everything else is read. Wider samples take two
+//! passes over the frame.
+
+#ifndef H_ACQUIRE_INTENSITY_V0
+#define H_ACQUIRE_INTENSITY_V0
+
+#include "channel.h"
+#include "parked_thread.h"
+#include "platform.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Bins in the histogram of each frame.
+#define INTENSITY_BINS (256)
+
+    struct intensity_stats
+    {
+        uint64_t frame_id;
+
+        /// Type of the samples measured. Packed samples are measured
+        /// unpacked.
+        enum SampleType sample_type;
+        uint64_t sample_count;
+
+        double min, max, mean, stddev;
+
+        /// Samples at the smallest and at the largest value the sample type
+        /// holds, as when the sensor clips. Unpacked 10, 12 and 14 bit
+        /// samples top out at `2^bits - 1`. Always 0 for f32.
+        uint64_t at_floor, at_ceiling;
+
+        /// `bins[i]` counts samples in `[bin_lo + i * bin_width, bin_lo +
+        /// (i + 1) * bin_width)`. Bins span the range of the sample type, or
+        /// `[min, max]` for f32, where the last bin includes `max`.
+        double bin_lo, bin_width;
+        uint32_t bins[INTENSITY_BINS];
+    };
+
+    /// Buffers reused from one frame to the next.
+    struct intensity_scratch
+    {
+        /// Four tables of counts, one entry per value.
+        uint32_t* counts;
+        /// Packed samples are unpacked into this.
+        uint16_t* unpacked;
+        size_t samples_of_unpacked;
+    };
+
+    /// @brief Measures the samples of `frame`.
+    /// @returns 1 on success, or 0 for compressed frames and sample types
+    /// that can't be measured.
+    int intensity_measure(struct intensity_scratch* scratch,
+                          const struct VideoFrame* frame,
+                          struct intensity_stats* out);
+
+    void intensity_scratch_free(struct intensity_scratch* self);
+
+    /// @returns The name of the kernels used for f32 samples on this CPU:
+    /// "avx2" or "plain".
+    const char* intensity_kernels_name(void);
+
+    struct video_intensity_s
+    {
+        /// Set by the client. Nothing is measured otherwise.
+        uint8_t is_enabled;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
+
+        uint8_t stream_id;
+
+        /// The stream's queue to storage. Not owned.
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Runs the controller once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
+
+        /// Only touched by the controller.
+        struct intensity_scratch scratch;
+
+        /// The statistics of the last frame measured, and the number of
+        /// frames measured since the stream was started. Guarded by `lock`.
+        struct lock lock;
+        struct intensity_stats latest;
+        uint64_t frames_measured;
+    };
+
+    enum DeviceStatusCode video_intensity_init(struct video_intensity_s* self,
+                                               uint8_t stream_id,
+                                               struct channel* in);
+
+    /// @brief Call before `in` is released.
+    void video_intensity_destroy(struct video_intensity_s* self);
+
+    /// @brief Starts measuring frames. Does nothing unless `is_enabled`.
+    enum DeviceStatusCode video_intensity_start(struct video_intensity_s* self);
+
+    /// @brief Measures what's left in the queue, then stops the thread and
+    /// releases its place in the queue. Call once the sink is done.
+    void video_intensity_stop(struct video_intensity_s* self);
+
+    /// @brief Copies the statistics of the last frame measured.
+    /// @returns The number of frames measured since the stream was started.
+    /// `out` is only filled in when that isn't 0.
+    uint64_t video_intensity_get(struct video_intensity_s* self,
+                                 struct intensity_stats* out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_INTENSITY_V0
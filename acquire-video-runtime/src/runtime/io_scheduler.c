@@ -0,0 +1,291 @@
+#include "io_scheduler.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Where a waiting sink stands, for picking the next one to admit.
+struct rank
+{
+    int is_urgent;
+    int has_tokens;
+    uint8_t priority;
+    double fullness;
+};
+
+static int
+has_bucket(const struct io_scheduler* self,
+           const struct io_scheduler_client* client)
+{
+    return self->bytes_per_second && client->share > 0.0f;
+}
+
+static double
+bytes_per_second_of(const struct io_scheduler* self,
+                    const struct io_scheduler_client* client)
+{
+    return (double)client->share * (double)self->bytes_per_second;
+}
+
+static void
+refill(const struct io_scheduler* self,
+       struct io_scheduler_client* client,
+       uint64_t now)
+{
+    if (!has_bucket(self, client) || now <= client->refilled)
+        return;
+    const double rate = bytes_per_second_of(self, client);
+    const double capacity = 1e-3 * IO_SCHEDULER_BURST_MS * rate;
+    const double seconds =
+      1e-9 * (double)clock_tics_to_ns((int64_t)(now - client->refilled));
+    client->tokens += seconds * rate;
+    if (client->tokens > capacity)
+        client->tokens = capacity;
+    client->refilled = now;
+}
+
+/// @returns The fraction of its queue the sink has yet to read.
+static double
+fullness(const struct io_scheduler_client* client)
+{
+    const size_t capacity = client->queue->capacity;
+    return capacity ? (double)channel_bytes_unread(client->queue,
+                                                    client->reader) /
+                        (double)capacity
+                    : 0.0;
+}
+
+/// @returns 1 if a sink ranked `a` goes before one ranked `b`.
+static int
+goes_before(const struct rank* a, const struct rank* b)
+{
+    if (a->is_urgent || b->is_urgent) {
+        if (a->is_urgent != b->is_urgent)
+            return a->is_urgent;
+        return a->fullness > b->fullness;
+    }
+    if (a->has_tokens != b->has_tokens)
+        return a->has_tokens;
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return a->fullness > b->fullness;
+}
+
+/// @returns The slot of the waiting sink to admit next, or -1 if none is
+/// waiting. Call with `lock` held.
+static int
+next_client(struct io_scheduler* self, uint64_t now)
+{
+    int best = -1;
+    struct rank best_rank = { 0 };
+    for (int i = 0; i < IO_SCHEDULER_MAX_CLIENTS; ++i) {
+        struct io_scheduler_client* client = self->clients + i;
+        if (!client->is_joined || !client->is_waiting)
+            continue;
+        refill(self, client, now);
+        const double f = fullness(client);
+        const struct rank rank = {
+            .is_urgent = f >= IO_SCHEDULER_URGENT_FRACTION,
+            .has_tokens = !has_bucket(self, client) || client->tokens > 0.0,
+            .priority = client->priority,
+            .fullness = f,
+        };
+        if (best < 0 || goes_before(&rank, &best_rank)) {
+            best = i;
+            best_rank = rank;
+        }
+    }
+    return best;
+}
+
+void
+io_scheduler_init(struct io_scheduler* self)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    lock_init(&self->lock);
+    condition_variable_init(&self->turn);
+}
+
+void
+io_scheduler_set_bandwidth(struct io_scheduler* self,
+                           uint64_t bytes_per_second)
+{
+    lock_acquire(&self->lock);
+    self->bytes_per_second = bytes_per_second;
+    lock_release(&self->lock);
+}
+
+int
+io_scheduler_join(struct io_scheduler* self,
+                  uint32_t id,
+                  const struct channel* queue,
+                  const struct channel_reader* reader,
+                  uint8_t priority,
+                  float share)
+{
+    CHECK(id < IO_SCHEDULER_MAX_CLIENTS);
+    CHECK(queue);
+    CHECK(reader);
+    EXPECT(share >= 0.0f && share <= 1.0f,
+           "I/O shares are fractions of the bandwidth. Got %f.",
+           share);
+    lock_acquire(&self->lock);
+    struct io_scheduler_client* client = self->clients + id;
+    *client = (struct io_scheduler_client){
+        .is_joined = 1,
+        .priority = priority,
+        .share = share,
+        .refilled = clock_tic(0),
+        .queue = queue,
+        .reader = reader,
+    };
+    client->tokens = 1e-3 * IO_SCHEDULER_BURST_MS *
+                     (has_bucket(self, client)
+                        ? bytes_per_second_of(self, client)
+                        : 0.0);
+    lock_release(&self->lock);
+    return 1;
+Error:
+    return 0;
+}
+
+void
+io_scheduler_leave(struct io_scheduler* self, uint32_t id)
+{
+    if (id >= IO_SCHEDULER_MAX_CLIENTS)
+        return;
+    lock_acquire(&self->lock);
+    self->clients[id].is_joined = 0;
+    self->clients[id].is_waiting = 0;
+    // Whoever this sink was ahead of may go now.
+    condition_variable_notify_all(&self->turn);
+    lock_release(&self->lock);
+}
+
+void
+io_scheduler_admit(struct io_scheduler* self, uint32_t id, size_t nbytes)
+{
+    if (id >= IO_SCHEDULER_MAX_CLIENTS)
+        return;
+    lock_acquire(&self->lock);
+    struct io_scheduler_client* client = self->clients + id;
+    if (!client->is_joined) {
+        lock_release(&self->lock);
+        return;
+    }
+    client->is_waiting = 1;
+    while (self->is_busy || next_client(self, clock_tic(0)) != (int)id) {
+        // The sink that goes next may be asleep.
+        if (!self->is_busy)
+            condition_variable_notify_all(&self->turn);
+        condition_variable_timed_wait(
+          &self->turn, &self->lock, IO_SCHEDULER_POLL_MS);
+    }
+    client->is_waiting = 0;
+    self->is_busy = 1;
+    if (has_bucket(self, client))
+        client->tokens -= (double)nbytes;
+    lock_release(&self->lock);
+}
+
+void
+io_scheduler_done(struct io_scheduler* self, uint32_t id)
+{
+    if (id >= IO_SCHEDULER_MAX_CLIENTS)
+        return;
+    lock_acquire(&self->lock);
+    if (self->clients[id].is_joined) {
+        self->is_busy = 0;
+        condition_variable_notify_all(&self->turn);
+    }
+    lock_release(&self->lock);
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Fills `queue` to `fraction` of its capacity, or drains it when 0.
+static void
+fill(struct channel* queue, struct channel_reader* reader, double fraction)
+{
+    struct slice s = { 0 };
+    do {
+        s = channel_read_map(queue, reader);
+        channel_read_unmap(queue, reader, s.end - s.beg);
+    } while (s.end > s.beg);
+    const size_t nbytes = (size_t)(fraction * (double)queue->capacity);
+    if (nbytes && channel_write_map(queue, nbytes))
+        channel_write_unmap(queue);
+}
+
+/// Priorities order the sinks, unless a queue is filling up or a sink has
+/// spent its share.
+int
+unit_test__io_scheduler_orders_batches()
+{
+    static struct io_scheduler scheduler;
+    static struct channel queues[2];
+    struct channel_reader readers[2] = { 0 };
+    io_scheduler_init(&scheduler);
+    for (int i = 0; i < 2; ++i) {
+        channel_new(queues + i, 0);
+        CHECK(channel_reserve(queues + i, 1 << 16));
+        fill(queues + i, readers + i, 0.0);
+    }
+    CHECK(!io_scheduler_join(
+      &scheduler, IO_SCHEDULER_MAX_CLIENTS, queues, readers, 0, 0.5f));
+    CHECK(!io_scheduler_join(&scheduler, 0, queues, readers, 0, 2.0f));
+
+    io_scheduler_set_bandwidth(&scheduler, 1000000);
+    CHECK(io_scheduler_join(&scheduler, 0, queues, readers, 1, 0.5f));
+    CHECK(io_scheduler_join(&scheduler, 1, queues + 1, readers + 1, 0, 0.5f));
+    scheduler.clients[1].is_waiting = 1;
+    CHECK(next_client(&scheduler, clock_tic(0)) == 1);
+
+    // The higher priority goes first, even into debt.
+    io_scheduler_admit(&scheduler, 0, 100000);
+    CHECK(scheduler.is_busy);
+    CHECK(scheduler.clients[1].is_waiting);
+    io_scheduler_done(&scheduler, 0);
+    CHECK(!scheduler.is_busy);
+
+    // Till it's paid that off, the other goes first.
+    scheduler.clients[0].is_waiting = 1;
+    const uint64_t now = scheduler.clients[0].refilled;
+    CHECK(next_client(&scheduler, now) == 1);
+
+    // Unless its queue is filling up, fuller than the other's.
+    fill(queues, readers, 0.6);
+    CHECK(next_client(&scheduler, now) == 0);
+    fill(queues + 1, readers + 1, 0.7);
+    CHECK(next_client(&scheduler, now) == 1);
+
+    // Bandwidth isn't left unused when no one else is waiting.
+    fill(queues + 1, readers + 1, 0.0);
+    scheduler.clients[1].is_waiting = 0;
+    fill(queues, readers, 0.0);
+    CHECK(next_client(&scheduler, now) == 0);
+
+    io_scheduler_leave(&scheduler, 0);
+    CHECK(next_client(&scheduler, now) == -1);
+    io_scheduler_leave(&scheduler, 1);
+    for (int i = 0; i < 2; ++i)
+        channel_release(queues + i);
+    return 1;
+Error:
+    for (int i = 0; i < 2; ++i)
+        channel_release(queues + i);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,114 @@
+//! Takes turns between the sinks of streams writing to the same volume, so
+//! one stream's backlog can't starve the others.
+//!
+//! Each scheduled sink asks to be admitted before it hands a batch of frames
+//! to storage, and says when storage is done with it. One batch is admitted
+//! at a time. When several sinks are waiting, the one whose queue is fullest
+//! goes first once any queue is at least `IO_SCHEDULER_URGENT_FRACTION`
+//! full, since that stream is closest to dropping frames. Otherwise, sinks
+//! with bandwidth left in their share go before those without, and then the
+//! higher priority, and then the fuller queue, goes first.
+//!
+//! Shares are token buckets: a sink's bucket fills at its share of the
+//! bandwidth, up to `IO_SCHEDULER_BURST_MS` worth, and each batch admitted
+//! takes its bytes out, going into debt when it's larger than what's left.
+//! A sink out of tokens still goes when no one else is waiting, so the
+//! volume is never left idle.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     io_scheduler_admit(scheduler, stream_id, nbytes);
+//!     storage_append(storage, beg, end);
+//!     io_scheduler_done(scheduler, stream_id);
+//! ~~~
+
+#ifndef H_ACQUIRE_RUNTIME_IO_SCHEDULER_V0
+#define H_ACQUIRE_RUNTIME_IO_SCHEDULER_V0
+
+#include "channel.h"
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Sinks that can take turns, one for each stream.
+#define IO_SCHEDULER_MAX_CLIENTS (8)
+/// A queue at least this full puts its sink ahead of priorities and shares.
+#define IO_SCHEDULER_URGENT_FRACTION (0.5)
+/// Bandwidth a token bucket holds at most, in milliseconds of its share.
+#define IO_SCHEDULER_BURST_MS (100.0)
+/// Longest a waiting sink goes without looking at the queues again, since
+/// they fill and buckets refill without waking it.
+#define IO_SCHEDULER_POLL_MS (10)
+
+    struct io_scheduler_client
+    {
+        uint8_t is_joined, is_waiting;
+        uint8_t priority;
+        /// Fraction of `bytes_per_second` this sink's bucket fills at. 0
+        /// leaves the sink without a bucket, so it always has bandwidth
+        /// left.
+        float share;
+        /// Bytes in the bucket, negative when in debt, as of clock_tic()
+        /// `refilled`.
+        double tokens;
+        uint64_t refilled;
+        /// The queue the sink reads from, to tell how close it is to
+        /// overflowing. Not owned.
+        const struct channel* queue;
+        const struct channel_reader* reader;
+    };
+
+    struct io_scheduler
+    {
+        /// Guards everything below.
+        struct lock lock;
+        struct condition_variable turn;
+        /// What the shared volume sustains. 0 leaves every sink without a
+        /// bucket, so only queues and priorities order the batches.
+        uint64_t bytes_per_second;
+        /// Set while a batch is being handed to storage.
+        uint8_t is_busy;
+        struct io_scheduler_client clients[IO_SCHEDULER_MAX_CLIENTS];
+    };
+
+    void io_scheduler_init(struct io_scheduler* self);
+
+    /// @brief Sets the bandwidth the sinks' shares are fractions of.
+    void io_scheduler_set_bandwidth(struct io_scheduler* self,
+                                    uint64_t bytes_per_second);
+
+    /// @brief Has the sink in slot `id`, which reads `reader` of `queue`,
+    /// take turns with the others, starting with a full bucket.
+    /// @returns 1 on success, or 0 if `id` is out of range or the share
+    /// isn't between 0 and 1.
+    int io_scheduler_join(struct io_scheduler* self,
+                          uint32_t id,
+                          const struct channel* queue,
+                          const struct channel_reader* reader,
+                          uint8_t priority,
+                          float share);
+
+    /// @brief Stops the sink in slot `id` from taking turns.
+    void io_scheduler_leave(struct io_scheduler* self, uint32_t id);
+
+    /// @brief Waits for the turn of the sink in slot `id` to hand `nbytes`
+    /// to storage.
+    void io_scheduler_admit(struct io_scheduler* self,
+                            uint32_t id,
+                            size_t nbytes);
+
+    /// @brief Ends the turn io_scheduler_admit() gave slot `id`.
+    void io_scheduler_done(struct io_scheduler* self, uint32_t id);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_RUNTIME_IO_SCHEDULER_V0
@@ -0,0 +1,261 @@
+#include "monitor.h"
+#include "logger.h"
+#include "platform.h"
+#include "device/props/components.h"
+
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+static const struct VideoFrame*
+next_frame(const struct VideoFrame* cur)
+{
+    return (const struct VideoFrame*)((const uint8_t*)cur +
+                                      cur->bytes_of_frame);
+}
+
+static int
+is_decimating(const struct video_monitor_decimation* decimation)
+{
+    return decimation->every_nth_frame > 1 ||
+           decimation->min_interval_ms > 0.0f;
+}
+
+/// Whether `frame` is far enough past `self->last` to be handed out.
+static int
+is_wanted(const struct video_monitor_s* self, const struct VideoFrame* frame)
+{
+    if (!self->last.is_set)
+        return 1;
+    const struct video_monitor_decimation* d = &self->decimation;
+    if (d->every_nth_frame > 1 &&
+        frame->frame_id < self->last.frame_id + d->every_nth_frame)
+        return 0;
+    if (d->min_interval_ms > 0.0f) {
+        const int64_t dt = (int64_t)(frame->timestamps.acq_thread -
+                                     self->last.acq_thread);
+        if (1e-6 * (double)clock_tics_to_ns(dt) < d->min_interval_ms)
+            return 0;
+    }
+    return 1;
+}
+
+static void
+take(struct video_monitor_s* self, const struct VideoFrame* frame)
+{
+    self->last.is_set = 1;
+    self->last.frame_id = frame->frame_id;
+    self->last.acq_thread = frame->timestamps.acq_thread;
+}
+
+void
+video_monitor_reset(struct video_monitor_s* self)
+{
+    self->handed_out = 0;
+    self->skipped_bytes = 0;
+    memset(&self->last, 0, sizeof(self->last)); // NOLINT
+}
+
+struct slice
+video_monitor_map(struct video_monitor_s* self,
+                  struct channel* channel,
+                  uint32_t timeout_ms)
+{
+    self->handed_out = 0;
+    self->skipped_bytes = 0;
+    if (!is_decimating(&self->decimation))
+        return channel_read_map_wait(channel, &self->reader, timeout_ms);
+
+    struct clock deadline = { 0 };
+    clock_init(&deadline);
+    clock_shift_ms(&deadline, timeout_ms);
+    while (1) {
+        const struct slice slice =
+          channel_read_map_wait(channel, &self->reader, timeout_ms);
+        if (slice.beg == slice.end)
+            return slice;
+
+        const struct VideoFrame* const end =
+          (const struct VideoFrame*)slice.end;
+        const struct VideoFrame* cur = (const struct VideoFrame*)slice.beg;
+        while (cur < end && !is_wanted(self, cur))
+            cur = next_frame(cur);
+        const uint8_t* const run = (const uint8_t*)cur;
+
+        // Decide as if the client consumes the whole run, but only commit
+        // to it in video_monitor_unmap().
+        const struct video_monitor_frame last = self->last;
+        while (cur < end && is_wanted(self, cur)) {
+            take(self, cur);
+            cur = next_frame(cur);
+        }
+        self->last = last;
+
+        if (run < slice.end) {
+            self->handed_out = run;
+            self->skipped_bytes = run - slice.beg;
+            return (struct slice){ .beg = (uint8_t*)run, .end = (uint8_t*)cur };
+        }
+
+        // Nothing wanted. Drop it all and look again.
+        channel_read_unmap(channel, &self->reader, slice.end - slice.beg);
+        const double remaining_ms = -clock_toc_ms(&deadline);
+        timeout_ms = remaining_ms > 0.0 ? (uint32_t)remaining_ms : 0;
+    }
+}
+
+struct slice
+video_monitor_map_latest(struct video_monitor_s* self, struct channel* channel)
+{
+    const struct slice slice = channel_read_map_latest(channel, &self->reader);
+    // Remembered as consumed so decimation carries on from it.
+    self->handed_out =
+      slice.beg < slice.end && is_decimating(&self->decimation) ? slice.beg : 0;
+    self->skipped_bytes = 0;
+    return slice;
+}
+
+void
+video_monitor_unmap(struct video_monitor_s* self,
+                    struct channel* channel,
+                    size_t consumed_bytes)
+{
+    if (self->handed_out) {
+        // Remember the last frame the client consumed whole.
+        const uint8_t* const run = self->handed_out;
+        const struct VideoFrame* cur = (const struct VideoFrame*)run;
+        while ((const uint8_t*)cur + sizeof(*cur) <= run + consumed_bytes &&
+               (const uint8_t*)cur + cur->bytes_of_frame <=
+                 run + consumed_bytes) {
+            take(self, cur);
+            cur = next_frame(cur);
+        }
+    }
+    channel_read_unmap(
+      channel, &self->reader, self->skipped_bytes + consumed_bytes);
+    self->handed_out = 0;
+    self->skipped_bytes = 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// Writes frames `[beg,end)`, `ms_apart` apart by acquisition time.
+static int
+write_test_frames(struct channel* channel,
+                  uint64_t beg,
+                  uint64_t end,
+                  double ms_apart)
+{
+    // Measured over many tics so a coarse clock still converts exactly.
+    const double tics_per_ms = 1e9 / (double)clock_tics_to_ns(1000);
+    for (uint64_t i = beg; i < end; ++i) {
+        struct VideoFrame* frame = (struct VideoFrame*)channel_write_map(
+          channel, sizeof(struct VideoFrame));
+        CHECK(frame);
+        memset(frame, 0, sizeof(*frame)); // NOLINT
+        frame->bytes_of_frame = sizeof(*frame);
+        frame->frame_id = i;
+        frame->timestamps.acq_thread =
+          (uint64_t)(1e9 + (double)i * ms_apart * tics_per_ms);
+        channel_write_unmap(channel);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Reads everything available, appending the ids of the frames handed out
+/// to `ids`. Consumes at most one frame of each region when `one_at_a_time`
+/// is set. Returns the number of ids.
+static size_t
+read_test_frames(struct video_monitor_s* monitor,
+                 struct channel* channel,
+                 uint64_t* ids,
+                 size_t capacity,
+                 int one_at_a_time)
+{
+    size_t n = 0;
+    while (1) {
+        const struct slice s = video_monitor_map(monitor, channel, 0);
+        if (s.beg == s.end) {
+            video_monitor_unmap(monitor, channel, 0);
+            return n;
+        }
+        const struct VideoFrame* cur = (const struct VideoFrame*)s.beg;
+        const struct VideoFrame* const end = (const struct VideoFrame*)s.end;
+        for (; cur < end && n < capacity; cur = next_frame(cur)) {
+            ids[n++] = cur->frame_id;
+            if (one_at_a_time) {
+                cur = next_frame(cur);
+                break;
+            }
+        }
+        video_monitor_unmap(monitor, channel, (uint8_t*)cur - s.beg);
+    }
+}
+
+/// Decimated monitors only hand out the frames they want, whether the
+/// client consumes whole regions or one frame at a time.
+int
+unit_test__monitor_decimation()
+{
+    struct channel channel;
+    static struct video_monitor_s monitor;
+    uint64_t ids[64];
+    channel_new(&channel, 64 * 1024);
+    memset(&monitor, 0, sizeof(monitor)); // NOLINT
+
+    // Every frame.
+    CHECK(read_test_frames(&monitor, &channel, ids, 64, 0) == 0);
+    CHECK(write_test_frames(&channel, 0, 10, 1.0));
+    CHECK(read_test_frames(&monitor, &channel, ids, 64, 0) == 10);
+    for (uint64_t i = 0; i < 10; ++i)
+        CHECK(ids[i] == i);
+
+    // Every third frame, starting with the first one read after turning
+    // decimation on and carrying on across writes.
+    monitor.decimation.every_nth_frame = 3;
+    CHECK(write_test_frames(&channel, 10, 20, 1.0));
+    CHECK(read_test_frames(&monitor, &channel, ids, 64, 0) == 4);
+    CHECK(ids[0] == 10 && ids[1] == 13 && ids[2] == 16 && ids[3] == 19);
+    CHECK(write_test_frames(&channel, 20, 30, 1.0));
+    CHECK(read_test_frames(&monitor, &channel, ids, 64, 1) == 3);
+    CHECK(ids[0] == 22 && ids[1] == 25 && ids[2] == 28);
+
+    // At least 10 ms apart, with frames 4 ms apart.
+    video_monitor_reset(&monitor);
+    monitor.decimation.every_nth_frame = 0;
+    monitor.decimation.min_interval_ms = 10.0f;
+    CHECK(write_test_frames(&channel, 0, 12, 4.0));
+    CHECK(read_test_frames(&monitor, &channel, ids, 64, 0) == 4);
+    CHECK(ids[0] == 0 && ids[1] == 3 && ids[2] == 6 && ids[3] == 9);
+
+    // Frames the client didn't consume are handed out again.
+    video_monitor_reset(&monitor);
+    monitor.decimation.min_interval_ms = 0.5f;
+    CHECK(write_test_frames(&channel, 0, 4, 1.0));
+    {
+        struct slice s = video_monitor_map(&monitor, &channel, 0);
+        CHECK(s.end - s.beg == 4 * sizeof(struct VideoFrame));
+        video_monitor_unmap(&monitor, &channel, sizeof(struct VideoFrame));
+        s = video_monitor_map(&monitor, &channel, 0);
+        CHECK(s.end - s.beg == 3 * sizeof(struct VideoFrame));
+        CHECK(((const struct VideoFrame*)s.beg)->frame_id == 1);
+        video_monitor_unmap(&monitor, &channel, s.end - s.beg);
+    }
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,82 @@
+//! The reader behind `acquire_map_read()`.
+//!
+//! A monitor can be decimated so a client that only needs some of the frames,
+//! like a display, doesn't see the rest. Frames that aren't wanted are
+//! released without being handed out. Each region handed out is a run of
+//! consecutive wanted frames, so it stays zero-copy.
+
+#ifndef H_ACQUIRE_MONITOR_V0
+#define H_ACQUIRE_MONITOR_V0
+
+#include "channel.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Which frames a monitor hands out. A frame is wanted when it passes
+    /// both tests, compared to the last frame the client consumed.
+    struct video_monitor_decimation
+    {
+        /// Frame ids must be at least this far apart. 0 and 1 take every
+        /// frame.
+        uint32_t every_nth_frame;
+
+        /// Frames must be acquired at least this far apart, by
+        /// `timestamps.acq_thread`. 0 or less takes every frame.
+        float min_interval_ms;
+    };
+
+    struct video_monitor_s
+    {
+        struct channel_reader reader;
+        struct video_monitor_decimation decimation;
+
+        /// Start of the region handed out by video_monitor_map(), and the
+        /// bytes before it in the mapped region. Those hold frames no one
+        /// wants and are released with the region.
+        const uint8_t* handed_out;
+        size_t skipped_bytes;
+
+        /// The last frame the client consumed.
+        struct video_monitor_frame
+        {
+            uint8_t is_set;
+            uint64_t frame_id;
+            uint64_t acq_thread;
+        } last;
+    };
+
+    /// @brief Forgets the frames consumed so far, as when a new acquisition
+    /// starts.
+    void video_monitor_reset(struct video_monitor_s* self);
+
+    /// @brief Like channel_read_map_wait(), but only returns wanted frames.
+    /// @details When a region holds no wanted frames it is released and the
+    /// monitor waits for more, until `timeout_ms` elapses. Only one region
+    /// is mapped at a time.
+    struct slice video_monitor_map(struct video_monitor_s* self,
+                                   struct channel* channel,
+                                   uint32_t timeout_ms);
+
+    /// @brief Like channel_read_map_latest(), mapping only the newest frame.
+    /// @details The newest frame is handed out whether decimation wants it or
+    /// not. Released with video_monitor_unmap().
+    struct slice video_monitor_map_latest(struct video_monitor_s* self,
+                                          struct channel* channel);
+
+    /// @brief Releases `consumed_bytes` of the region returned by
+    /// video_monitor_map(), along with the unwanted frames before it.
+    void video_monitor_unmap(struct video_monitor_s* self,
+                             struct channel* channel,
+                             size_t consumed_bytes);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_MONITOR_V0
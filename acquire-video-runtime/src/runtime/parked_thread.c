@@ -0,0 +1,186 @@
+#include "parked_thread.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+static void
+parked_thread_main(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    while (1) {
+        while (!self->is_exiting && self->runs_done == self->runs_requested)
+            condition_variable_wait(&self->notify_run, &self->lock);
+        if (self->runs_done == self->runs_requested)
+            break;
+        lock_release(&self->lock);
+
+        self->fn(self->ctx);
+
+        lock_acquire(&self->lock);
+        ++self->runs_done;
+        condition_variable_notify_all(&self->notify_done);
+    }
+    lock_release(&self->lock);
+}
+
+void
+parked_thread_init(struct parked_thread* self, void (*fn)(void*), void* ctx)
+{
+    memset(self, 0, sizeof(*self));
+    self->fn = fn;
+    self->ctx = ctx;
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify_run);
+    condition_variable_init(&self->notify_done);
+    thread_init(&self->thread);
+}
+
+int
+parked_thread_run(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    if (!self->is_started) {
+        if (!thread_create(
+              &self->thread, (void (*)(void*))parked_thread_main, self)) {
+            lock_release(&self->lock);
+            LOGE("Failed to start thread.");
+            return 0;
+        }
+        self->is_started = 1;
+    }
+    ++self->runs_requested;
+    condition_variable_notify_all(&self->notify_run);
+    lock_release(&self->lock);
+    return 1;
+}
+
+void
+parked_thread_wait(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    while (self->runs_done != self->runs_requested)
+        condition_variable_wait(&self->notify_done, &self->lock);
+    lock_release(&self->lock);
+}
+
+int
+parked_thread_timed_wait(struct parked_thread* self, uint32_t timeout_ms)
+{
+    struct clock clock;
+    clock_init(&clock);
+    lock_acquire(&self->lock);
+    while (self->runs_done != self->runs_requested) {
+        const double remaining_ms = timeout_ms - clock_toc_ms(&clock);
+        if (remaining_ms <= 0.0)
+            break;
+        condition_variable_timed_wait(
+          &self->notify_done, &self->lock, (uint32_t)remaining_ms + 1);
+    }
+    const int is_done = self->runs_done == self->runs_requested;
+    lock_release(&self->lock);
+    return is_done;
+}
+
+int
+parked_thread_get_cpu_time_us(struct parked_thread* self, uint64_t* us)
+{
+    return self->is_started && thread_get_cpu_time_us(&self->thread, us);
+}
+
+void
+parked_thread_destroy(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    self->is_exiting = 1;
+    condition_variable_notify_all(&self->notify_run);
+    lock_release(&self->lock);
+    if (self->is_started)
+        thread_join(&self->thread);
+    self->is_started = 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+struct parked_thread_test
+{
+    int runs;
+};
+
+static void
+count_run(struct parked_thread_test* ctx)
+{
+    ++ctx->runs;
+}
+
+/// Each run calls the function exactly once and waiting returns only after
+/// it has. Waiting on a thread that never ran returns straight away.
+int
+unit_test__parked_thread_runs_once_per_request()
+{
+    static struct parked_thread thread;
+    static struct parked_thread_test test;
+    memset(&test, 0, sizeof(test));
+
+    parked_thread_init(&thread, (void (*)(void*))count_run, &test);
+    parked_thread_wait(&thread);
+    CHECK(!thread.is_started);
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(parked_thread_run(&thread));
+        parked_thread_wait(&thread);
+        CHECK(test.runs == i + 1);
+    }
+    CHECK(thread.runs_done == 1000);
+    // A run asked for just before destruction still happens.
+    CHECK(parked_thread_run(&thread));
+    parked_thread_destroy(&thread);
+    CHECK(test.runs == 1001);
+
+    // Destroying a thread that never started.
+    parked_thread_init(&thread, (void (*)(void*))count_run, &test);
+    parked_thread_destroy(&thread);
+    CHECK(test.runs == 1001);
+    return 1;
+Error:
+    parked_thread_destroy(&thread);
+    return 0;
+}
+
+static void
+sleep_run(struct parked_thread_test* ctx)
+{
+    clock_sleep_ms(0, 200.0f);
+    ++ctx->runs;
+}
+
+/// A timed wait gives up on a run that takes longer, and returns once the
+/// run is over.
+int
+unit_test__parked_thread_timed_wait_gives_up()
+{
+    static struct parked_thread thread;
+    static struct parked_thread_test test;
+    memset(&test, 0, sizeof(test));
+
+    parked_thread_init(&thread, (void (*)(void*))sleep_run, &test);
+    CHECK(parked_thread_timed_wait(&thread, 0));
+    CHECK(parked_thread_run(&thread));
+    CHECK(!parked_thread_timed_wait(&thread, 10));
+    CHECK(parked_thread_timed_wait(&thread, 10000));
+    CHECK(test.runs == 1);
+    parked_thread_destroy(&thread);
+    return 1;
+Error:
+    parked_thread_destroy(&thread);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,87 @@
+//! A thread that runs the same function once per request and sleeps in
+//! between, so a stream's pipeline threads are created once and reused by
+//! every acquisition.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     struct parked_thread thread;
+//!     parked_thread_init(&thread, (void (*)(void*))work, &ctx);
+//!     parked_thread_run(&thread);   // starts the thread and runs work(&ctx)
+//!     parked_thread_wait(&thread);  // returns once work(&ctx) has returned
+//!     parked_thread_run(&thread);   // wakes the same thread
+//!     parked_thread_wait(&thread);
+//!     parked_thread_destroy(&thread);
+//! ~~~
+//!
+//! Only one run is in flight at a time: call parked_thread_wait() before
+//! asking for the next one.
+
+#ifndef H_ACQUIRE_PARKED_THREAD_V0
+#define H_ACQUIRE_PARKED_THREAD_V0
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct parked_thread
+    {
+        struct lock lock;
+        struct condition_variable notify_run;
+        struct condition_variable notify_done;
+        struct thread thread;
+
+        void (*fn)(void*);
+        void* ctx;
+
+        /// Number of runs asked for by parked_thread_run(), and the number
+        /// that have returned.  They're equal while the thread is parked.
+        size_t runs_requested;
+        size_t runs_done;
+
+        /// Set once the thread has been created.
+        uint8_t is_started;
+        uint8_t is_exiting;
+    };
+
+    /// @brief Prepares `self` to call `fn(ctx)` on each run.
+    /// @details No thread is created until the first run.
+    void parked_thread_init(struct parked_thread* self,
+                            void (*fn)(void*),
+                            void* ctx);
+
+    /// @brief Wakes the thread to call `fn(ctx)` once, creating the thread
+    /// the first time.
+    /// @returns 1 on success, or 0 if the thread couldn't be created.
+    int parked_thread_run(struct parked_thread* self);
+
+    /// @brief Blocks until the last run has returned.
+    /// @details Returns straight away if nothing is running.
+    void parked_thread_wait(struct parked_thread* self);
+
+    /// @brief Like parked_thread_wait(), but gives up after `timeout_ms`.
+    /// @returns 1 once the last run has returned, or 0 if it's still running.
+    int parked_thread_timed_wait(struct parked_thread* self,
+                                 uint32_t timeout_ms);
+
+    /// @brief Reads the CPU time the thread has used since it was created,
+    /// across every run.
+    /// @returns 1 on success, or 0 if the thread hasn't started or the time
+    /// can't be read.
+    int parked_thread_get_cpu_time_us(struct parked_thread* self,
+                                      uint64_t* us);
+
+    /// @brief Waits for the last run, then ends and joins the thread.
+    void parked_thread_destroy(struct parked_thread* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_PARKED_THREAD_V0
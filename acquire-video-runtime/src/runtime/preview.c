@@ -0,0 +1,320 @@
+#include "preview.h"
+#include "bin2.h"
+#include "crc32c.h"
+#include "frame_iterator.h"
+#include "logger.h"
+#include "stages.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+// The thread is woken as soon as frames arrive or it's asked to stop. This
+// bounds how long it sleeps otherwise.
+#define PREVIEW_WAIT_TIMEOUT_MS (100)
+
+int
+video_preview_shape(const struct video_preview_s* self,
+                    const struct ImageShape* in,
+                    struct ImageShape* out)
+{
+    const uint32_t b = self->binning;
+    // bin2() takes pixels whose samples sit next to each other, and doesn't
+    // take u32 or packed samples.
+    if (!b || sample_type_unpacked(in->type) != in->type ||
+        in->type == SampleType_u32 || in->strides.channels != 1 ||
+        in->strides.width != in->dims.channels || in->dims.width < b ||
+        in->dims.height < b)
+        return 0;
+    filter_stage_make_shape(out,
+                            in->type,
+                            in->dims.channels,
+                            in->dims.width / b,
+                            in->dims.height / b,
+                            in->dims.planes);
+    return 1;
+}
+
+/// Makes room in `scratch` for the first halving of frames of shape `in`.
+static int
+reserve_scratch(struct video_preview_s* self, const struct ImageShape* in)
+{
+    const size_t nbytes = bytes_of_type(in->type) * in->dims.channels *
+                          (in->dims.width / 2) * (in->dims.height / 2);
+    if (nbytes <= self->bytes_of_scratch)
+        return 1;
+    void* const scratch = realloc(self->scratch, nbytes);
+    CHECK(scratch);
+    self->scratch = scratch;
+    self->bytes_of_scratch = nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Halves each plane of `in` into `out` until it's binned `self->binning`
+/// times over. Every halving but the last goes to `scratch`, the ones after
+/// the first in place.
+static void
+bin_planes(struct video_preview_s* self,
+           const struct VideoFrame* in,
+           struct VideoFrame* out)
+{
+    const enum SampleType type = in->shape.type;
+    const uint32_t channels = in->shape.dims.channels;
+    const size_t bytes_per_sample = bytes_of_type(type);
+    for (uint32_t p = 0; p < in->shape.dims.planes; ++p) {
+        const uint8_t* src =
+          in->data + bytes_per_sample * p * in->shape.strides.planes;
+        int64_t src_row_stride = in->shape.strides.height;
+        uint32_t width = in->shape.dims.width, height = in->shape.dims.height;
+        for (uint32_t b = self->binning; b > 1; b /= 2) {
+            width /= 2;
+            height /= 2;
+            uint8_t* dst = (uint8_t*)self->scratch;
+            int64_t dst_row_stride = (int64_t)width * channels;
+            if (b == 2) {
+                dst = out->data + bytes_per_sample * p *
+                                    out->shape.strides.planes;
+                dst_row_stride = out->shape.strides.height;
+            }
+            bin2(type,
+                 dst,
+                 dst_row_stride,
+                 src,
+                 src_row_stride,
+                 width,
+                 height,
+                 channels);
+            src = dst;
+            src_row_stride = dst_row_stride;
+        }
+    }
+}
+
+/// Writes the preview of `in` to `out`. Frames that can't be binned are
+/// dropped.
+static void
+write_preview(struct video_preview_s* self, const struct VideoFrame* in)
+{
+    struct ImageShape shape = { 0 };
+    if (in->compression != FrameCompression_None ||
+        !video_preview_shape(self, &in->shape, &shape) ||
+        !reserve_scratch(self, &in->shape)) {
+        if (!self->has_logged_rejection)
+            LOGE("[stream %d] PREVIEW: Can't bin %ux%u %s frames %ux. "
+                 "Dropping them.",
+                 self->stream_id,
+                 in->shape.dims.width,
+                 in->shape.dims.height,
+                 sample_type_as_string(in->shape.type),
+                 self->binning);
+        self->has_logged_rejection = 1;
+        return;
+    }
+
+    const size_t nbytes =
+      channel_bytes_of_frame(&self->out, bytes_of_image(&shape));
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!out) // aborted
+        return;
+    *out = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .shape = shape,
+        .frame_id = in->frame_id,
+        .hardware_frame_id = in->hardware_frame_id,
+        .hardware_frame_gap = in->hardware_frame_gap,
+        .timestamps = in->timestamps,
+        .stage_position = in->stage_position,
+        .has_stage_position = in->has_stage_position,
+    };
+    bin_planes(self, in, out);
+    if (in->has_checksum) {
+        out->checksum = crc32c_of_frame(out);
+        out->has_checksum = 1;
+    }
+    channel_write_unmap(&self->out);
+    store_relaxed(&self->frames_written, self->frames_written + 1);
+}
+
+static int
+video_preview_thread(struct video_preview_s* const self)
+{
+    thread_set_current_attributes(&self->thread_attributes);
+    for (;;) {
+        // Checked before mapping, so once the stream's sink is done, an empty
+        // map means every frame has been read.
+        const int is_stopping = load_acquire(&self->is_stopping);
+        // One frame at a time, so the monitor only ever holds back the
+        // stream for as long as a frame takes to bin.
+        struct slice slice = video_monitor_map(
+          &self->monitor, self->in, PREVIEW_WAIT_TIMEOUT_MS);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* const in = frame_iterator_next(&it);
+        if (in)
+            write_preview(self, in);
+        video_monitor_unmap(&self->monitor,
+                            self->in,
+                            in ? in->bytes_of_frame
+                               : (size_t)(slice.end - slice.beg));
+        if (is_stopping && slice.end == slice.beg)
+            break;
+    }
+    LOG("[stream %d] PREVIEW: Exiting thread. Skipped %llu frames.",
+        (int)self->stream_id,
+        (unsigned long long)self->monitor.reader.skipped);
+    // Readers waiting on the preview notice the end of the acquisition.
+    channel_wake_readers(&self->out);
+    store_release(&self->is_running, 0);
+    return 0;
+}
+
+enum DeviceStatusCode
+video_preview_init(struct video_preview_s* self,
+                   uint8_t stream_id,
+                   struct channel* in)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->stream_id = stream_id;
+    self->in = in;
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-preview-%d",
+             (int)stream_id);
+    channel_new(&self->out, 0);
+    channel_reader_set_lossy(in, &self->monitor.reader, 1);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_preview_thread, self);
+    return Device_Ok;
+}
+
+void
+video_preview_destroy(struct video_preview_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    channel_release(&self->out);
+    free(self->scratch);
+    self->scratch = 0;
+    self->bytes_of_scratch = 0;
+}
+
+enum DeviceStatusCode
+video_preview_configure(struct video_preview_s* self,
+                        uint32_t binning,
+                        size_t channel_capacity_bytes)
+{
+    EXPECT(binning <= 1 || binning == 2 || binning == 4 || binning == 8,
+           "[stream %d] PREVIEW: Expected binning of 2, 4 or 8. Got %u.",
+           (int)self->stream_id,
+           binning);
+    self->binning = binning > 1 ? binning : 0;
+    self->channel_capacity_bytes = channel_capacity_bytes;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_preview_start(struct video_preview_s* self, size_t bytes_of_image)
+{
+    store_relaxed(&self->frames_written, 0);
+    if (!self->binning)
+        return Device_Ok;
+
+    const size_t pixels_per_block = (size_t)self->binning * self->binning;
+    const size_t bytes_of_frame =
+      channel_bytes_of_frame(&self->out, bytes_of_image / pixels_per_block);
+    size_t capacity = self->channel_capacity_bytes / pixels_per_block;
+    if (capacity < 2 * bytes_of_frame)
+        capacity = 2 * bytes_of_frame;
+    CHECK(channel_reserve(&self->out, capacity));
+    channel_accept_writes(&self->out, 1);
+
+    video_monitor_reset(&self->monitor);
+    self->monitor.reader.skipped = 0;
+    self->has_logged_rejection = 0;
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    if (!parked_thread_run(&self->thread)) {
+        store_release(&self->is_running, 0);
+        LOGE("[stream %d] PREVIEW: Failed to start thread.",
+             (int)self->stream_id);
+        goto Error;
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_preview_stop(struct video_preview_s* self)
+{
+    store_release(&self->is_stopping, 1);
+    channel_wake_readers(self->in);
+    parked_thread_wait(&self->thread);
+    channel_reader_detach(self->in, &self->monitor.reader);
+    video_monitor_reset(&self->monitor);
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Binning 4x halves twice, the second time in place, and keeps each plane
+/// apart.
+int
+unit_test__preview_bins_by_halving()
+{
+    struct video_preview_s preview;
+    struct channel in;
+    static struct
+    {
+        struct VideoFrame frame;
+        uint8_t data[8 * 4 * 2];
+    } src, dst;
+    channel_new(&in, 0);
+    video_preview_init(&preview, 0, &in);
+    CHECK(video_preview_configure(&preview, 4, 0) == Device_Ok);
+
+    filter_stage_make_shape(&src.frame.shape, SampleType_u8, 1, 8, 4, 2);
+    for (int i = 0; i < 8 * 4 * 2; ++i)
+        src.data[i] = (uint8_t)(i < 32 ? 4 * (i % 8) : 200);
+    CHECK(video_preview_shape(&preview, &src.frame.shape, &dst.frame.shape));
+    CHECK(dst.frame.shape.dims.width == 2 && dst.frame.shape.dims.height == 1);
+    CHECK(dst.frame.shape.dims.planes == 2);
+    CHECK(reserve_scratch(&preview, &src.frame.shape));
+    bin_planes(&preview, &src.frame, &dst.frame);
+    // Columns 0-3 average 6, columns 4-7 average 22.
+    CHECK(dst.data[0] == 6 && dst.data[1] == 22);
+    CHECK(dst.data[2] == 200 && dst.data[3] == 200);
+
+    // Packed and u32 samples aren't binned, nor frames smaller than a block.
+    filter_stage_make_shape(&src.frame.shape, SampleType_u12p, 1, 8, 4, 1);
+    CHECK(!video_preview_shape(&preview, &src.frame.shape, &dst.frame.shape));
+    filter_stage_make_shape(&src.frame.shape, SampleType_u32, 1, 8, 4, 1);
+    CHECK(!video_preview_shape(&preview, &src.frame.shape, &dst.frame.shape));
+    filter_stage_make_shape(&src.frame.shape, SampleType_u8, 1, 8, 3, 1);
+    CHECK(!video_preview_shape(&preview, &src.frame.shape, &dst.frame.shape));
+    CHECK(video_preview_configure(&preview, 3, 0) == Device_Err);
+
+    video_preview_destroy(&preview);
+    channel_release(&in);
+    return 1;
+Error:
+    video_preview_destroy(&preview);
+    channel_release(&in);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
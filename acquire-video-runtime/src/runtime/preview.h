@@ -0,0 +1,109 @@
+//! A binned copy of a stream's frames for viewers, so a display reads a
+//! fraction of the bytes storage does.
+//!
+//! A thread reads the stream's queue to storage with a lossy monitor,
+//! decimated like the stream's own, and writes each frame it takes, binned
+//! 2x, 4x or 8x, to a queue of its own. Monitor readers opened on the preview
+//! read that queue. Binning halves the frame with bin2() as many times as it
+//! takes, so larger factors round at each halving. When the thread falls
+//! behind, it skips ahead to the newest frame rather than holding back the
+//! camera or storage. Readers of the preview only hold back the thread.
+
+#ifndef H_ACQUIRE_PREVIEW_V0
+#define H_ACQUIRE_PREVIEW_V0
+
+#include "channel.h"
+#include "monitor.h"
+#include "parked_thread.h"
+#include "platform.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct video_preview_s
+    {
+        /// Width and height of the blocks of pixels averaged together: 2, 4
+        /// or 8. 0 when there's no preview.
+        uint32_t binning;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
+
+        uint8_t stream_id;
+
+        /// The stream's queue to storage. Not owned. Read through `monitor`,
+        /// whose decimation is set with the stream's.
+        struct channel* in;
+        struct video_monitor_s monitor;
+
+        /// Binned frames, for monitor readers of the preview. Holds
+        /// `channel_capacity_bytes` divided by the number of pixels in a
+        /// block, and at least two binned frames.
+        struct channel out;
+        size_t channel_capacity_bytes;
+
+        /// Runs the controller once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
+
+        /// Holds the halvings before the last one. Only touched by the
+        /// controller.
+        void* scratch;
+        size_t bytes_of_scratch;
+
+        /// Set once a frame that can't be binned has been logged.
+        uint8_t has_logged_rejection;
+
+        /// Written by the controller with relaxed stores. Reset when the
+        /// preview is started.
+        uint64_t frames_written;
+    };
+
+    enum DeviceStatusCode video_preview_init(struct video_preview_s* self,
+                                             uint8_t stream_id,
+                                             struct channel* in);
+
+    /// @brief Call before `in` is released.
+    void video_preview_destroy(struct video_preview_s* self);
+
+    /// @brief Sets the binning, 0 to turn the preview off, and the size of
+    /// the stream's queue to storage.
+    enum DeviceStatusCode video_preview_configure(
+      struct video_preview_s* self,
+      uint32_t binning,
+      size_t channel_capacity_bytes);
+
+    /// @brief Computes the shape of the preview of frames of shape `in`.
+    /// @returns 1 on success, or 0 if they can't be binned.
+    int video_preview_shape(const struct video_preview_s* self,
+                            const struct ImageShape* in,
+                            struct ImageShape* out);
+
+    /// @brief Starts binning frames. Does nothing without a preview.
+    /// @param[in] bytes_of_image Bytes of pixels in each frame of the
+    ///                           stream, to size the queue by, or 0 when
+    ///                           unknown.
+    enum DeviceStatusCode video_preview_start(struct video_preview_s* self,
+                                              size_t bytes_of_image);
+
+    /// @brief Bins what's left in the stream's queue, then stops the thread
+    /// and releases its place in the queue. Call once the sink is done.
+    void video_preview_stop(struct video_preview_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_PREVIEW_V0
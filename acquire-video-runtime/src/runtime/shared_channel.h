@@ -0,0 +1,109 @@
+#ifndef H_ACQUIRE_SHARED_CHANNEL_V0
+#define H_ACQUIRE_SHARED_CHANNEL_V0
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Layout of a channel placed in named shared memory by channel_share(),
+    /// known to the writer's process and to processes reading through
+    /// shared_monitor.h.
+    ///
+    /// The memory starts with a `shared_channel` header. The channel's buffer
+    /// follows at `SHARED_CHANNEL_DATA_OFFSET`, so it starts on a page
+    /// boundary.
+    ///
+    /// The writer mirrors its state into `writer` under a sequence counter,
+    /// like the one in `struct channel`. Readers in other processes each take
+    /// one of the `readers` slots:
+    /// - A reader claims a free slot by swapping its `state` to joining, then
+    ///   fills in its `owner`, `pid` and `heartbeat`.
+    /// - Before its next write, the writer admits joining readers: it places
+    ///   their cursor at its head and marks them active. Only active readers
+    ///   hold the writer back.
+    /// - An active reader publishes its cursor, packed as in channel.c, and
+    ///   refreshes its heartbeat each time it maps.
+    /// - While it waits for space, the writer frees the slots of readers whose
+    ///   process has exited, and of readers that haven't mapped for
+    ///   `SHARED_CHANNEL_READER_TIMEOUT_MS`.
+    /// - When the channel is emptied for a new acquisition, active readers go
+    ///   back to joining and are admitted again at the start.
+    ///
+    /// Every change to a slot's `state` also counts up its upper bits, so a
+    /// reader notices it's been moved or freed by comparing `state` with what
+    /// it saw last.
+    ///
+    /// When the writer frees or resizes the buffer it sets `is_retired`, and
+    /// readers map the name again.
+
+#define SHARED_CHANNEL_MAGIC (0x6c6e6e6168637161ULL) // "aqchannl"
+#define SHARED_CHANNEL_VERSION (1)
+#define SHARED_CHANNEL_MAX_READERS (8)
+#define SHARED_CHANNEL_DATA_OFFSET (4096)
+#define SHARED_CHANNEL_READER_TIMEOUT_MS (10000)
+
+    enum SharedReaderState
+    {
+        SharedReader_Free = 0,
+        SharedReader_Joining,
+        SharedReader_Active,
+    };
+
+    /// Selects the `SharedReaderState` in a slot's `state`. The rest counts
+    /// changes in steps of `SHARED_READER_STATE_STEP`.
+#define SHARED_READER_STATE_MASK (3ULL)
+#define SHARED_READER_STATE_STEP (4ULL)
+
+    /// @returns A slot's `state` moved from `state` to `kind`.
+    static inline uint64_t
+    shared_reader_next_state(uint64_t state, enum SharedReaderState kind)
+    {
+        return (state & ~SHARED_READER_STATE_MASK) + SHARED_READER_STATE_STEP +
+               (uint64_t)kind;
+    }
+
+    /// A reader's slot, on a cache line of its own.
+    struct shared_channel_reader
+    {
+        uint64_t state;
+        /// The reader's cycle and position, packed like a `channel_cursor`.
+        uint64_t cursor;
+        /// See process_id().
+        uint64_t pid;
+        /// clock_tic() when the reader last mapped.
+        uint64_t heartbeat;
+        /// The writer's `writes` when the reader was last admitted.
+        uint64_t writes;
+        /// Picked by the reader that claimed the slot, so it can tell the slot
+        /// was freed and claimed by another.
+        uint64_t owner;
+        uint8_t padding[16];
+    };
+
+    struct shared_channel
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t is_retired;
+        /// Size of the buffer after the header.
+        uint64_t capacity;
+        uint8_t padding[40];
+
+        /// Mirrors the fields of `struct channel` with the same names.
+        struct
+        {
+            uint64_t seq, head, high, cycle, last, writes, cycle_writes;
+            uint8_t padding[8];
+        } writer;
+
+        struct shared_channel_reader readers[SHARED_CHANNEL_MAX_READERS];
+    };
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
+
+#endif // H_ACQUIRE_SHARED_CHANNEL_V0
@@ -0,0 +1,327 @@
+#include "shared_monitor.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// The part of the writer's state readers need. See `struct channel`.
+struct writer_state
+{
+    uint64_t head, high, cycle, writes, cycle_writes;
+};
+
+/// Cursors are packed as in channel.c.
+static uint64_t
+cursor_pack(const struct shared_monitor* self, uint64_t pos, uint64_t cycle)
+{
+    return cycle * (self->capacity + 1) + pos;
+}
+
+static void
+cursor_unpack(const struct shared_monitor* self,
+              uint64_t cursor,
+              uint64_t* pos,
+              uint64_t* cycle)
+{
+    *cycle = cursor / (self->capacity + 1);
+    *pos = cursor % (self->capacity + 1);
+}
+
+/// Takes a consistent snapshot of the state the writer mirrors, retrying
+/// while the writer is updating it.
+static struct writer_state
+writer_snapshot(const struct shared_channel* shared)
+{
+    struct writer_state out;
+    uint64_t s0, s1;
+    do {
+        while ((s0 = load_acquire(&shared->writer.seq)) & 1)
+            cpu_relax();
+        out.head = load_relaxed(&shared->writer.head);
+        out.high = load_relaxed(&shared->writer.high);
+        out.cycle = load_relaxed(&shared->writer.cycle);
+        out.writes = load_relaxed(&shared->writer.writes);
+        out.cycle_writes = load_relaxed(&shared->writer.cycle_writes);
+        fence_acquire();
+        s1 = load_relaxed(&shared->writer.seq);
+    } while (s0 != s1);
+    return out;
+}
+
+/// Whether the slot is still this reader's.
+static int
+is_owner(const struct shared_monitor* self)
+{
+    return self->slot && load_relaxed(&self->slot->owner) == self->owner &&
+           (load_acquire(&self->slot->state) & SHARED_READER_STATE_MASK) !=
+             SharedReader_Free;
+}
+
+/// Claims a free slot. The writer admits the reader before its next write.
+static int
+join(struct shared_monitor* self)
+{
+    struct shared_channel* shared = self->header;
+    for (unsigned i = 0; i < SHARED_CHANNEL_MAX_READERS; ++i) {
+        struct shared_channel_reader* r = shared->readers + i;
+        uint64_t state = load_acquire(&r->state);
+        const uint64_t next =
+          shared_reader_next_state(state, SharedReader_Joining);
+        if ((state & SHARED_READER_STATE_MASK) != SharedReader_Free ||
+            !compare_exchange_acq_rel(&r->state, &state, next))
+            continue;
+        store_relaxed(&r->owner, self->owner);
+        store_relaxed(&r->pid, process_id());
+        store_release(&r->heartbeat, clock_tic(0));
+        self->slot = r;
+        self->state = next;
+        return 1;
+    }
+    LOGE("All %d reader slots of \"%s\" are taken.",
+         SHARED_CHANNEL_MAX_READERS,
+         self->name);
+    return 0;
+}
+
+/// Frees the reader's slot, if it still has it.
+static void
+leave(struct shared_monitor* self)
+{
+    if (is_owner(self)) {
+        uint64_t state = load_acquire(&self->slot->state);
+        while ((state & SHARED_READER_STATE_MASK) != SharedReader_Free &&
+               !compare_exchange_acq_rel(
+                 &self->slot->state,
+                 &state,
+                 shared_reader_next_state(state, SharedReader_Free)))
+            ;
+    }
+    self->slot = 0;
+    self->is_mapped = 0;
+}
+
+/// Cursors are only stored by the reader, but the writer moves readers back
+/// to joining for a new acquisition, and places their cursor when it admits
+/// them again. A cursor stored at the same time may have undone that, so when
+/// the state moved underneath the reader, it asks to be admitted again.
+/// @returns 1 when the reader's cursor is still its own to move.
+static int
+is_still_admitted(struct shared_monitor* self)
+{
+    fence_seq_cst();
+    uint64_t state = load_acquire(&self->slot->state);
+    if (state == self->state)
+        return 1;
+    if ((state & SHARED_READER_STATE_MASK) == SharedReader_Active &&
+        compare_exchange_acq_rel(
+          &self->slot->state,
+          &state,
+          shared_reader_next_state(state, SharedReader_Joining)))
+        self->state = shared_reader_next_state(state, SharedReader_Joining);
+    self->is_mapped = 0;
+    return 0;
+}
+
+static void
+detach(struct shared_monitor* self)
+{
+    if (self->header)
+        leave(self);
+    shared_memory_close(&self->memory);
+    self->header = 0;
+    self->data = 0;
+    self->capacity = 0;
+}
+
+/// Maps the queue and claims a slot on it.
+static int
+attach(struct shared_monitor* self)
+{
+    if (!shared_memory_open(&self->memory, self->name))
+        return 0;
+    struct shared_channel* shared = (struct shared_channel*)self->memory.data;
+    EXPECT(self->memory.nbytes >= SHARED_CHANNEL_DATA_OFFSET &&
+             load_acquire(&shared->magic) == SHARED_CHANNEL_MAGIC &&
+             shared->version == SHARED_CHANNEL_VERSION &&
+             SHARED_CHANNEL_DATA_OFFSET + shared->capacity <=
+               self->memory.nbytes,
+           "\"%s\" isn't a video stream's queue.",
+           self->name);
+    // What's left of a queue the writer let go of until every reader does.
+    if (load_acquire(&shared->is_retired))
+        goto Error;
+    self->header = shared;
+    self->data = self->memory.data + SHARED_CHANNEL_DATA_OFFSET;
+    self->capacity = shared->capacity;
+    CHECK(join(self));
+    return 1;
+Error:
+    detach(self);
+    return 0;
+}
+
+/// Maps what's there without waiting. Sets `*nbytes` to 0 when there's
+/// nothing to map yet.
+/// @returns 0 when the reader was overrun, otherwise 1.
+static int
+try_map(struct shared_monitor* self, uint64_t* nbytes)
+{
+    *nbytes = 0;
+    if (self->header && load_acquire(&self->header->is_retired))
+        detach(self);
+    if (!self->header && !attach(self))
+        return 1;
+    if (!is_owner(self)) {
+        // The writer dropped this reader. It starts over.
+        self->slot = 0;
+        join(self);
+        return 1;
+    }
+
+    struct shared_channel_reader* r = self->slot;
+    store_relaxed(&r->heartbeat, clock_tic(0));
+    const uint64_t state = load_acquire(&r->state);
+    if ((state & SHARED_READER_STATE_MASK) != SharedReader_Active)
+        return 1;
+    if (state != self->state) {
+        // Admitted at the writer's head. Writes before that were missed,
+        // unless this is the first time.
+        const uint64_t writes = load_relaxed(&r->writes);
+        if (self->has_writes && writes > self->writes)
+            self->skipped += writes - self->writes;
+        self->writes = writes;
+        self->has_writes = 1;
+        self->state = state;
+    }
+
+    const struct writer_state w = writer_snapshot(self->header);
+    uint64_t pos, cycle, n, writes;
+    cursor_unpack(self, load_relaxed(&r->cursor), &pos, &cycle);
+    if (cycle + 1 == w.cycle && pos == w.high) {
+        pos = 0;
+        cycle = w.cycle;
+    }
+    if (pos == w.head && cycle == w.cycle)
+        return 1;
+    if (pos < w.head) {
+        if (cycle != w.cycle)
+            goto Overflow;
+        n = w.head - pos;
+        self->end_pos = w.head;
+        self->end_cycle = w.cycle;
+        writes = w.writes;
+    } else {
+        if (w.cycle != cycle + 1 || pos > w.high)
+            goto Overflow;
+        n = w.high - pos;
+        self->end_pos = 0;
+        self->end_cycle = cycle + 1;
+        writes = w.cycle_writes;
+    }
+
+    // Remember the normalized start, so unmapping measures from there.
+    store_release(&r->cursor, cursor_pack(self, pos, cycle));
+    if (!is_still_admitted(self))
+        return 1;
+    self->nbytes = n;
+    self->pos = pos;
+    self->cycle = cycle;
+    self->writes = writes;
+    self->is_mapped = 1;
+    *nbytes = n;
+    return 1;
+Overflow:
+    LOGE("The reader of \"%s\" was overrun.", self->name);
+    self->state = 0;
+    is_still_admitted(self);
+    return 0;
+}
+
+int
+shared_monitor_open(struct shared_monitor* self, const char* name)
+{
+    *self = (struct shared_monitor){ 0 };
+    EXPECT(name && strlen(name) < sizeof(self->name),
+           "Expected a name of at most %d characters.",
+           (int)sizeof(self->name) - 1);
+    snprintf(self->name, sizeof(self->name), "%s", name);
+    self->throttler = throttler_init(SHARED_MONITOR_MAX_POLL_MS);
+    // Tells this reader apart from others, in this process and others, that
+    // take the same slot later.
+    self->owner =
+      clock_tic(0) ^ (process_id() << 40) ^ (uint64_t)(uintptr_t)self;
+    EXPECT(attach(self), "Failed to open the video stream queue \"%s\".", name);
+    return 1;
+Error:
+    return 0;
+}
+
+void
+shared_monitor_close(struct shared_monitor* self)
+{
+    detach(self);
+}
+
+int
+shared_monitor_map(struct shared_monitor* self,
+                   uint32_t timeout_ms,
+                   const struct VideoFrame** beg,
+                   const struct VideoFrame** end)
+{
+    *beg = *end = 0;
+    EXPECT(!self->is_mapped,
+           "Expected an unmapped reader. See shared_monitor_unmap().");
+
+    struct clock clock;
+    clock_init(&clock);
+    uint64_t nbytes = 0;
+    CHECK(try_map(self, &nbytes));
+    // The writer can't wake readers in other processes, so this polls.
+    while (!nbytes && clock_toc_ms(&clock) < (double)timeout_ms) {
+        throttler_wait(&self->throttler, 0);
+        CHECK(try_map(self, &nbytes));
+    }
+    throttler_wait(&self->throttler, (size_t)nbytes);
+    if (nbytes) {
+        *beg = (const struct VideoFrame*)(self->data + self->pos);
+        *end = (const struct VideoFrame*)(self->data + self->pos + nbytes);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+float
+shared_monitor_duty_cycle(const struct shared_monitor* self)
+{
+    return throttler_duty_cycle(&self->throttler);
+}
+
+void
+shared_monitor_unmap(struct shared_monitor* self, size_t consumed_bytes)
+{
+    if (!self->is_mapped)
+        return;
+    self->is_mapped = 0;
+    if (!is_owner(self))
+        return;
+
+    uint64_t pos = self->end_pos, cycle = self->end_cycle;
+    if (consumed_bytes < self->nbytes) {
+        pos = self->pos + consumed_bytes;
+        cycle = self->cycle;
+    }
+    store_release(&self->slot->cursor, cursor_pack(self, pos, cycle));
+    store_relaxed(&self->slot->heartbeat, clock_tic(0));
+    is_still_admitted(self);
+}
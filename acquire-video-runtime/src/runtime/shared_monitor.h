@@ -0,0 +1,109 @@
+#ifndef H_ACQUIRE_SHARED_MONITOR_V0
+#define H_ACQUIRE_SHARED_MONITOR_V0
+
+#include "platform.h"
+#include "shared_channel.h"
+#include "throttler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    struct VideoFrame;
+
+/// Longest shared_monitor_map() sleeps between looks for frames.
+#define SHARED_MONITOR_MAX_POLL_MS (2.0f)
+
+    /// Reads a video stream's frames from another process, straight out of
+    /// the stream's queue. The stream shares its queue when its
+    /// `monitor_shared_name` is set. See `AcquireProperties`.
+    ///
+    /// Like `acquire_map_read()`, frames are handed out as pointers into the
+    /// queue, without copying them, and a reader holds back the camera and
+    /// storage until it consumes what it maps. A reader starts with the next
+    /// frame written after it opens, and with the first frame of each new
+    /// acquisition.
+    ///
+    /// The stream stops waiting for a reader whose process exits, or that
+    /// doesn't map for `SHARED_CHANNEL_READER_TIMEOUT_MS` while the stream
+    /// waits for it. Such a reader joins again at the newest frame the next
+    /// time it maps, and counts the frames it missed in `skipped`. So does a
+    /// reader of a queue that the stream reallocated, or that was gone for a
+    /// while.
+    ///
+    /// A stream takes up to `SHARED_CHANNEL_MAX_READERS` readers from other
+    /// processes. Each reader may only be used from one thread at a time.
+    struct shared_monitor
+    {
+        char name[32];
+        struct shared_memory memory;
+        /// The header at the start of `memory`, and the queue after it. 0
+        /// while the queue isn't mapped.
+        struct shared_channel* header;
+        uint8_t* data;
+        uint64_t capacity;
+
+        /// This reader's slot, and its `state` when this last looked.
+        struct shared_channel_reader* slot;
+        uint64_t state;
+        uint64_t owner;
+
+        /// Set while a region of `nbytes` is mapped, which starts at (`pos`,
+        /// `cycle`) and ends at (`end_pos`, `end_cycle`).
+        int is_mapped;
+        uint64_t nbytes, pos, cycle, end_pos, end_cycle;
+
+        /// The stream's write count at the end of the last region mapped.
+        uint64_t writes;
+        /// Set once the reader has been admitted by the stream.
+        int has_writes;
+
+        /// Frames missed while the reader wasn't holding the stream back.
+        uint64_t skipped;
+
+        /// Paces shared_monitor_map() while it waits for frames.
+        struct throttler throttler;
+    };
+
+    /// @brief Maps the queue shared as `name` and takes a reader's slot on
+    /// it.
+    /// @returns 1 on success, otherwise 0.
+    int shared_monitor_open(struct shared_monitor* self, const char* name);
+
+    /// @brief Releases the reader's slot, and whatever it has mapped, and
+    /// unmaps the queue.
+    void shared_monitor_close(struct shared_monitor* self);
+
+    /// @brief Maps the frames written since the last region consumed.
+    /// @details When there are none, waits up to `timeout_ms` for some, and
+    /// otherwise sets `*beg == *end`. The stream can't wake readers in other
+    /// processes, so this polls: flat out for a little while after frames
+    /// were found, and then less and less often, down to every
+    /// `SHARED_MONITOR_MAX_POLL_MS`. Frames stay valid until
+    /// shared_monitor_unmap(). When the stream has released its queue, this
+    /// maps it again by name once it's back.
+    /// @returns 1 on success, or 0 when a region is already mapped or the
+    /// queue is broken.
+    int shared_monitor_map(struct shared_monitor* self,
+                           uint32_t timeout_ms,
+                           const struct VideoFrame** beg,
+                           const struct VideoFrame** end);
+
+    /// @returns The fraction of the time since the reader opened that
+    /// shared_monitor_map() wasn't asleep waiting for frames. See
+    /// throttler_duty_cycle().
+    float shared_monitor_duty_cycle(const struct shared_monitor* self);
+
+    /// @brief Releases the first `consumed_bytes` of the mapped region, so
+    /// the stream can reuse them. The rest is mapped again next time.
+    void shared_monitor_unmap(struct shared_monitor* self,
+                              size_t consumed_bytes);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
+
+#endif // H_ACQUIRE_SHARED_MONITOR_V0
@@ -2,13 +2,14 @@
 #include "vfslice.h"
 #include "platform.h"
 #include "logger.h"
-#include "throttler.h"
 #include "device/hal/storage.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define L (aq_logger)
-#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
 
 // #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -22,6 +23,11 @@
     } while (0)
 #define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
 
+// The sink thread is woken as soon as frames arrive or it's asked to stop.
+// This bounds how long it sleeps otherwise before re-checking the storage
+// device's state.
+#define SINK_WAIT_TIMEOUT_MS (100)
+
 static int
 is_equal(const struct DeviceIdentifier* const a,
          const struct DeviceIdentifier* const b)
@@ -29,6 +35,60 @@ is_equal(const struct DeviceIdentifier* const a,
     return (a->driver_id == b->driver_id) && (a->device_id == b->device_id);
 }
 
+static int
+is_equal_string(const struct String* const a, const struct String* const b)
+{
+    // Null and empty strings are the same.
+    const size_t na = (a->str && a->nbytes) ? strnlen(a->str, a->nbytes) : 0;
+    const size_t nb = (b->str && b->nbytes) ? strnlen(b->str, b->nbytes) : 0;
+    return na == nb && (na == 0 || memcmp(a->str, b->str, na) == 0);
+}
+
+static int
+is_equal_storage_properties(const struct StorageProperties* const a,
+                            const struct StorageProperties* const b)
+{
+    if (!is_equal_string(&a->uri, &b->uri) ||
+        !is_equal_string(&a->external_metadata_json,
+                         &b->external_metadata_json) ||
+        !is_equal_string(&a->access_key_id, &b->access_key_id) ||
+        !is_equal_string(&a->secret_access_key, &b->secret_access_key) ||
+        a->first_frame_id != b->first_frame_id ||
+        a->pixel_scale_um.x != b->pixel_scale_um.x ||
+        a->pixel_scale_um.y != b->pixel_scale_um.y ||
+        a->enable_multiscale != b->enable_multiscale ||
+        a->enable_unbuffered_io != b->enable_unbuffered_io ||
+        a->enable_memory_mapped_io != b->enable_memory_mapped_io ||
+        a->compression != b->compression ||
+        a->max_frames_per_file != b->max_frames_per_file ||
+        a->max_bytes_per_file != b->max_bytes_per_file ||
+        a->enable_frame_index != b->enable_frame_index ||
+        a->disable_frame_descriptions != b->disable_frame_descriptions ||
+        a->enable_compact_frame_headers != b->enable_compact_frame_headers ||
+        a->durability != b->durability ||
+        a->durability_interval_ms != b->durability_interval_ms ||
+        a->durability_interval_bytes != b->durability_interval_bytes ||
+        !is_equal_string(&a->staging_uri, &b->staging_uri) ||
+        a->migration_bytes_per_second != b->migration_bytes_per_second ||
+        a->acquisition_dimensions.size != b->acquisition_dimensions.size)
+        return 0;
+    for (size_t i = 0; i < a->acquisition_dimensions.size; ++i) {
+        const struct StorageDimension* const da =
+          a->acquisition_dimensions.data + i;
+        const struct StorageDimension* const db =
+          b->acquisition_dimensions.data + i;
+        if (!is_equal_string(&da->name, &db->name) || da->kind != db->kind ||
+            da->array_size_px != db->array_size_px ||
+            da->chunk_size_px != db->chunk_size_px ||
+            da->shard_size_chunks != db->shard_size_chunks)
+            return 0;
+    }
+    return 1;
+}
+
+static int
+video_sink_thread(struct video_sink_s* const self);
+
 enum DeviceStatusCode
 video_sink_init(struct video_sink_s* self,
                 uint8_t stream_id,
@@ -38,59 +98,563 @@ video_sink_init(struct video_sink_s* self,
     memset(self, 0, sizeof(*self));
     self->stream_id = stream_id;
     self->sig_stop_source = sig_stop_source;
+    self->channel_capacity_bytes = channel_capacity_bytes;
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-sink-%d",
+             (int)stream_id);
+    channel_new(&self->in, 0);
+    self->queue = &self->in;
 
-    LOG("Video[%2d]: Allocating %llu bytes for the queue.",
-        stream_id,
-        channel_capacity_bytes);
-    channel_new(&self->in, channel_capacity_bytes);
-
-    thread_init(&self->thread);
+    parked_thread_init(&self->thread, (void (*)(void*))video_sink_thread, self);
     return Device_Ok;
 }
 
+static const struct VideoFrame*
+next_frame(const struct VideoFrame* cur)
+{
+    return (const struct VideoFrame*)((const uint8_t*)cur +
+                                      cur->bytes_of_frame);
+}
+
+/// Appends frames `[beg,end)` of `self->frames` as one packet. Runs on one of
+/// the `writers`.
+static void
+append_band(void* ctx, size_t beg, size_t end)
+{
+    struct video_sink_s* const self = (struct video_sink_s*)ctx;
+    const uint8_t* const first = (const uint8_t*)self->frames[0];
+    const struct VideoFrame* const packet = self->frames[beg];
+    if (storage_append_at(self->storage,
+                          packet,
+                          self->frames[end],
+                          self->frames_appended + beg,
+                          self->bytes_appended +
+                            ((const uint8_t*)packet - first)) != Device_Ok) {
+        self->append_failed = 1;
+    }
+}
+
+/// Splits `[beg,end)` between the writers and sets `nframes` to the number
+/// of frames in it.
+static int
+append_concurrently(struct video_sink_s* self,
+                    const struct VideoFrame* beg,
+                    const struct VideoFrame* end,
+                    size_t* nframes)
+{
+    size_t n = 0;
+    for (const struct VideoFrame* cur = beg; cur < end; cur = next_frame(cur)) {
+        if (n + 1 >= self->frames_capacity) {
+            const size_t capacity =
+              self->frames_capacity ? 2 * self->frames_capacity : 64;
+            const struct VideoFrame** frames = (const struct VideoFrame**)
+              realloc((void*)self->frames, capacity * sizeof(*frames));
+            CHECK(frames);
+            self->frames = frames;
+            self->frames_capacity = capacity;
+        }
+        self->frames[n++] = cur;
+    }
+    // Marks where the last packet ends.
+    self->frames[n] = end;
+
+    self->append_failed = 0;
+    band_pool_run(&self->writers, append_band, self, n, 1);
+    EXPECT(!self->append_failed,
+           "[stream %d]: SINK: Failed to append to storage.",
+           self->stream_id);
+    *nframes = n;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Called by storage as it finishes with bytes appended asynchronously.
+static void
+on_appended(void* ctx, size_t n)
+{
+    struct video_sink_s* const self = (struct video_sink_s*)ctx;
+    store_release(&self->async.completed, self->async.completed + n);
+    // The sink may be waiting to consume them.
+    channel_wake_readers(self->queue);
+}
+
+/// Frames of `slice`, mapped from `in`, that haven't been handed to storage.
+static struct vfslice
+unsubmitted(const struct video_sink_s* self, const struct vfslice* slice)
+{
+    const uint8_t* const beg = (const uint8_t*)slice->beg;
+    const size_t nbytes = (const uint8_t*)slice->end - beg;
+    const size_t inflight = self->async.submitted - self->async.released;
+    if (inflight >= nbytes)
+        return (struct vfslice){ .beg = slice->end, .end = slice->end };
+    return (struct vfslice){ .beg = (const struct VideoFrame*)(beg + inflight),
+                             .end = slice->end };
+}
+
+/// Frames at the start of `fresh` that storage may take without going over
+/// `async.max_inflight_bytes`. One frame always fits once nothing is in
+/// flight, so frames larger than the limit still get through.
+static struct vfslice
+within_inflight_limit(const struct video_sink_s* self,
+                      const struct vfslice* fresh)
+{
+    const uint64_t limit = self->async.max_inflight_bytes;
+    if (!limit)
+        return *fresh;
+    const uint64_t inflight =
+      self->async.submitted - load_acquire(&self->async.completed);
+    const struct VideoFrame* cur = fresh->beg;
+    uint64_t nbytes = inflight;
+    while (cur < fresh->end && nbytes + cur->bytes_of_frame <= limit) {
+        nbytes += cur->bytes_of_frame;
+        cur = next_frame(cur);
+    }
+    if (cur == fresh->beg && !inflight && cur < fresh->end)
+        cur = next_frame(cur);
+    return (struct vfslice){ .beg = fresh->beg, .end = cur };
+}
+
+/// Unmaps `in`, consuming the bytes storage is done with. `slice` was mapped
+/// and `limited` is what of it `within_inflight_limit()` let through.
+static void
+release_appended(struct video_sink_s* self,
+                 const struct vfslice* slice,
+                 const struct vfslice* limited)
+{
+    const size_t n =
+      load_acquire(&self->async.completed) - self->async.released;
+    channel_read_unmap(self->queue, &self->reader, n);
+    self->async.released += n;
+    // Held back frames aren't new, so the sink waits for storage to finish
+    // something, or for more frames, before looking at them again.
+    self->async.nbytes_seen =
+      limited->end < slice->end
+        ? (size_t)((const uint8_t*)slice->end - (const uint8_t*)slice->beg) - n
+        : (size_t)(self->async.submitted - self->async.released);
+}
+
+/// Hands `[beg,end)` to storage in packets of whole frames, each about as
+/// large as it prefers, and sets `nframes` to the number of frames in it.
+static int
+append_async(struct video_sink_s* self,
+             const struct VideoFrame* beg,
+             const struct VideoFrame* end,
+             size_t* nframes)
+{
+    const uint64_t preferred = self->meta.preferred_append_bytes;
+    size_t n = 0;
+    while (beg < end) {
+        const struct VideoFrame* cur = beg;
+        size_t nbytes = 0;
+        do {
+            nbytes += cur->bytes_of_frame;
+            cur = next_frame(cur);
+            ++n;
+        } while (cur < end &&
+                 (!preferred || nbytes + cur->bytes_of_frame <= preferred));
+        CHECK(storage_append_async(
+                self->storage, beg, cur, on_appended, self) == Device_Ok);
+        self->async.submitted += nbytes;
+        beg = cur;
+    }
+    *nframes = n;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+append_chunks(void* ctx, const struct StorageChunk* chunks, size_t count)
+{
+    struct video_sink_s* const self = (struct video_sink_s*)ctx;
+    return storage_append_chunks(self->storage, chunks, count) == Device_Ok;
+}
+
+/// Copies `[beg,end)` into chunks, handing storage each layer of them once
+/// it's assembled, and sets `nframes` to the number of frames in it.
+static int
+assemble_chunks(struct video_sink_s* self,
+                const struct VideoFrame* beg,
+                const struct VideoFrame* end,
+                size_t* nframes)
+{
+    size_t n = 0;
+    for (const struct VideoFrame* cur = beg; cur < end;
+         cur = next_frame(cur)) {
+        EXPECT(cur->compression == FrameCompression_None,
+               "[stream %d]: SINK: Can't assemble compressed frames into "
+               "chunks.",
+               self->stream_id);
+        if (!self->chunks.is_ready) {
+            const struct storage_properties_dimensions_s* dims =
+              &self->applied_settings.acquisition_dimensions;
+            EXPECT(chunker_init(&self->chunks.chunker,
+                                dims->data,
+                                dims->size,
+                                &cur->shape),
+                   "[stream %d]: SINK: Can't assemble frames into the "
+                   "chunks storage asked for.",
+                   self->stream_id);
+            self->chunks.is_ready = 1;
+        }
+        CHECK(chunker_push(&self->chunks.chunker, cur, append_chunks, self));
+        ++n;
+    }
+    *nframes = n;
+    return 1;
+Error:
+    return 0;
+}
+
+/// Hands `[beg,end)` to storage however the sink was set up to, counting
+/// the frames into `nframes`.
+static int
+hand_to_storage(struct video_sink_s* self,
+                const struct VideoFrame* beg,
+                const struct VideoFrame* end,
+                size_t* nframes)
+{
+    if (self->chunks.is_enabled) {
+        CHECK(assemble_chunks(self, beg, end, nframes));
+    } else if (self->async.is_enabled) {
+        CHECK(append_async(self, beg, end, nframes));
+    } else if (self->writers.nworkers) {
+        CHECK(append_concurrently(self, beg, end, nframes));
+    } else {
+        CHECK(storage_append(self->storage, beg, end) == Device_Ok);
+        for (const struct VideoFrame* cur = beg; cur < end;
+             cur = next_frame(cur))
+            ++*nframes;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Appends `[beg,end)`, the first frame of which the sink picked up at
+/// `picked`, to storage and records how long each frame took to get there.
+static int
+append_frames(struct video_sink_s* self,
+              const struct VideoFrame* beg,
+              const struct VideoFrame* end,
+              uint64_t picked)
+{
+    if (beg == end)
+        return 1;
+    size_t nframes = 0;
+    struct io_scheduler* const scheduler = self->io.scheduler;
+    if (scheduler) {
+        const uint64_t asked = clock_tic(0);
+        io_scheduler_admit(scheduler,
+                           self->stream_id,
+                           (const uint8_t*)end - (const uint8_t*)beg);
+        latency_histogram_record_tics(&self->io_wait_us, asked, clock_tic(0));
+    }
+    const uint64_t start = clock_tic(0);
+    const int is_ok = hand_to_storage(self, beg, end, &nframes);
+    if (scheduler)
+        io_scheduler_done(scheduler, self->stream_id);
+    CHECK(is_ok);
+    const uint64_t done = clock_tic(0);
+    latency_histogram_record_tics(&self->storage_append_us, start, done);
+    trace_ring_record(&self->trace, "storage_append", start, done);
+    for (size_t i = 0; i < nframes; ++i)
+        latency_histogram_record_tics(&self->sink_to_storage_us, picked, done);
+    store_relaxed(&self->frames_appended, self->frames_appended + nframes);
+    store_relaxed(&self->bytes_appended,
+                  self->bytes_appended +
+                    ((const uint8_t*)end - (const uint8_t*)beg));
+    return 1;
+Error:
+    return 0;
+}
+
+static double
+ms_between(uint64_t earlier, uint64_t later)
+{
+    return 1e-6 * (double)clock_tics_to_ns((int64_t)(later - earlier));
+}
+
+/// Appends the frames gathered in `batch`.
+static int
+flush_batch(struct video_sink_s* self)
+{
+    const uint8_t* const data = self->batch.data;
+    const size_t nbytes = self->batch.nbytes;
+    self->batch.nbytes = 0;
+    return append_frames(self,
+                         (const struct VideoFrame*)data,
+                         (const struct VideoFrame*)(data + nbytes),
+                         self->batch.picked);
+}
+
+/// Hands `[beg,end)`, which the sink picked up at `picked`, to storage.
+/// @details With coalescing on, small writes are copied into `batch` and
+/// appended together once it holds `coalescing.min_bytes`. Writes at least
+/// that large go straight to storage once the batch is flushed. Everything
+/// reaches storage in the order it was read.
+static int
+write_frames(struct video_sink_s* self,
+             const struct VideoFrame* beg,
+             const struct VideoFrame* end,
+             uint64_t picked)
+{
+    for (const struct VideoFrame* cur = beg; cur < end; cur = next_frame(cur))
+        latency_histogram_record_tics(
+          &self->channel_to_sink_us, cur->timestamps.acq_thread, picked);
+    if (self->annotations)
+        CHECK(
+          video_annotations_join(self->annotations, beg, end, self->storage));
+
+    const size_t min_bytes = self->coalescing.min_bytes;
+    if (!min_bytes)
+        return append_frames(self, beg, end, picked);
+
+    while (beg < end) {
+        const size_t nbytes = (const uint8_t*)end - (const uint8_t*)beg;
+        if (!self->batch.nbytes && nbytes >= min_bytes)
+            return append_frames(self, beg, end, picked);
+
+        // Take as many whole frames as fit.
+        const struct VideoFrame* cur = beg;
+        size_t ntaken = 0;
+        while (cur < end && self->batch.nbytes + ntaken + cur->bytes_of_frame <=
+                              self->batch.capacity) {
+            ntaken += cur->bytes_of_frame;
+            cur = next_frame(cur);
+        }
+
+        if (!ntaken) {
+            if (self->batch.nbytes) {
+                CHECK(flush_batch(self));
+            } else {
+                // Larger than the batch can hold.
+                cur = next_frame(beg);
+                CHECK(append_frames(self, beg, cur, picked));
+                beg = cur;
+            }
+            continue;
+        }
+
+        if (!self->batch.nbytes)
+            self->batch.picked = picked;
+        memcpy(self->batch.data + self->batch.nbytes, beg, ntaken); // NOLINT
+        self->batch.nbytes += ntaken;
+        beg = cur;
+        if (self->batch.nbytes >= min_bytes)
+            CHECK(flush_batch(self));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Hands storage what's left in `in` once the sink is stopping, without
+/// waiting for it to be written.
+static int
+drain_async(struct video_sink_s* self)
+{
+    for (;;) {
+        if (load_acquire(&self->is_discarding))
+            return 1;
+        const size_t inflight = self->async.submitted - self->async.released;
+        if (channel_bytes_unread(self->queue, &self->reader) <= inflight)
+            return 1;
+        const struct vfslice slice = make_vfslice(
+          channel_read_map_wait_past(self->queue,
+                                     &self->reader,
+                                     self->async.nbytes_seen,
+                                     SINK_WAIT_TIMEOUT_MS));
+        const struct vfslice fresh = unsubmitted(self, &slice);
+        const struct vfslice limited = within_inflight_limit(self, &fresh);
+        if (!write_frames(self, limited.beg, limited.end, clock_tic(0))) {
+            channel_read_unmap(self->queue, &self->reader, 0);
+            return 0;
+        }
+        release_appended(self, &slice, &limited);
+        CHECK(storage_get_state(self->storage) == DeviceState_Running);
+    }
+Error:
+    return 0;
+}
+
+/// Releases what's left in the queue without appending it, counting the
+/// frames. Only call this once storage has stopped, so none of it is still
+/// being written.
+static void
+discard_unread(struct video_sink_s* self)
+{
+    struct vfslice slice = { .beg = 0, .end = 0 };
+    do {
+        slice = make_vfslice(channel_read_map(self->queue, &self->reader));
+        uint64_t nframes = 0;
+        for (const struct VideoFrame* cur = slice.beg; cur < slice.end;
+             cur = next_frame(cur))
+            ++nframes;
+        channel_read_unmap(self->queue,
+                           &self->reader,
+                           (uint8_t*)slice.end - (uint8_t*)slice.beg);
+        store_relaxed(&self->frames_discarded,
+                      self->frames_discarded + nframes);
+    } while (slice.end > slice.beg);
+}
+
+/// Milliseconds the sink may wait for more frames before a held-back batch
+/// has to be flushed, capped at SINK_WAIT_TIMEOUT_MS.
+static uint32_t
+wait_timeout_ms(const struct video_sink_s* self, uint64_t now)
+{
+    const float max_age_ms = self->coalescing.max_age_ms;
+    if (!self->batch.nbytes || max_age_ms <= 0.0f)
+        return SINK_WAIT_TIMEOUT_MS;
+    const double wait_ms = max_age_ms - ms_between(self->batch.picked, now);
+    if (wait_ms <= 0.0)
+        return 0;
+    return wait_ms < SINK_WAIT_TIMEOUT_MS ? (uint32_t)wait_ms + 1
+                                          : SINK_WAIT_TIMEOUT_MS;
+}
+
+/// Milliseconds until the oldest frame in `remaining`, which is still inside
+/// the write delay at `now`, may be written. At most SINK_WAIT_TIMEOUT_MS so
+/// a request to stop isn't missed for long.
+static float
+ms_until_due(const struct video_sink_s* self,
+             const struct vfslice* remaining,
+             uint64_t now)
+{
+    if (remaining->beg >= remaining->end)
+        return 0.0f;
+    const double age_ms =
+      ms_between(remaining->beg->timestamps.acq_thread, now);
+    const double wait_ms = self->write_delay_ms - age_ms;
+    return (float)(wait_ms < SINK_WAIT_TIMEOUT_MS ? wait_ms
+                                                  : SINK_WAIT_TIMEOUT_MS);
+}
+
 static int
 video_sink_thread(struct video_sink_s* const self)
 {
     TRACE("[stream %d]: SINK: Entering thread", self->stream_id);
-    struct throttler throttler = throttler_init(10e-3f);
     struct vfslice slice = { .beg = 0, .end = 0 };
+    thread_set_current_attributes(&self->thread_attributes);
+    uint32_t writer_count = self->writer_count;
+    // Chunks are assembled in order on this thread.
+    self->chunks.is_enabled = storage_supports_chunk_assembly(self->storage);
+    if (self->chunks.is_ready) {
+        chunker_destroy(&self->chunks.chunker);
+        self->chunks.is_ready = 0;
+    }
+    if (self->chunks.is_enabled)
+        writer_count = 1;
+    if (writer_count > 1 &&
+        !storage_supports_concurrent_append(self->storage)) {
+        LOG("[stream %d]: SINK: Storage can't be appended to from several "
+            "threads. Using one writer.",
+            self->stream_id);
+        writer_count = 1;
+    }
+    // Kept across acquisitions. Only restarted when the writer count
+    // changes.
+    band_pool_ensure(&self->writers, writer_count, &self->thread_attributes);
+    self->async.is_enabled = writer_count <= 1 && !self->coalescing.min_bytes &&
+                             !self->chunks.is_enabled &&
+                             storage_supports_async_append(self->storage);
+    self->async.submitted = 0;
+    self->async.completed = 0;
+    self->async.released = 0;
+    self->async.nbytes_seen = 0;
+    self->async.max_inflight_bytes =
+      self->async.is_enabled
+        ? self->meta.preferred_append_bytes * self->meta.max_appends_in_flight
+        : 0;
 
     // Write to storage.
     // Enforce write delay.
-    while (!self->is_stopping && self->storage &&
+    struct clock now = { 0 };
+    clock_init(&now);
+    while (!load_acquire(&self->is_stopping) && self->storage &&
            storage_get_state(self->storage) == DeviceState_Running) {
-        do {
-            slice = make_vfslice(channel_read_map(&self->in, &self->reader));
-            struct vfslice remaining =
-              vfslice_split_at_delay_ms(&slice, self->write_delay_ms);
-            CHECK(storage_append(self->storage, slice.beg, remaining.beg) ==
-                  Device_Ok);
-            channel_read_unmap(&self->in,
+        // Bytes storage is still writing stay mapped, and aren't new.
+        slice = make_vfslice(
+          channel_read_map_wait_past(self->queue,
+                                     &self->reader,
+                                     self->async.nbytes_seen,
+                                     wait_timeout_ms(self, clock_tic(0))));
+        const uint64_t picked = clock_tic(&now);
+        const struct vfslice fresh = unsubmitted(self, &slice);
+        const struct vfslice limited = within_inflight_limit(self, &fresh);
+        struct vfslice remaining =
+          vfslice_split_at_delay_ms_since(&limited, self->write_delay_ms, &now);
+        CHECK(write_frames(self, limited.beg, remaining.beg, picked));
+        if (self->batch.nbytes && self->coalescing.max_age_ms > 0.0f &&
+            ms_between(self->batch.picked, picked) >=
+              self->coalescing.max_age_ms) {
+            CHECK(flush_batch(self));
+        }
+        const float wait_ms = ms_until_due(self, &remaining, picked);
+        if (self->async.is_enabled)
+            release_appended(self, &slice, &limited);
+        else
+            channel_read_unmap(self->queue,
                                &self->reader,
                                (uint8_t*)remaining.beg - (uint8_t*)slice.beg);
-        } while (slice.end > slice.beg);
-        throttler_wait(&throttler);
+        // The frames left are still readable, so waiting on the channel
+        // would return straight away.
+        if (wait_ms > 0.0f)
+            clock_sleep_ms(0, wait_ms);
     }
     TRACE("[stream %d]: SINK: Flushing", self->stream_id);
-    do {
-        slice = make_vfslice(channel_read_map(&self->in, &self->reader));
-        CHECK(storage_append(self->storage, slice.beg, slice.end) == Device_Ok);
-        channel_read_unmap(
-          &self->in, &self->reader, (uint8_t*)slice.end - (uint8_t*)slice.beg);
-    } while (slice.end > slice.beg);
+    if (self->async.is_enabled) {
+        CHECK(drain_async(self));
+    } else {
+        do {
+            if (load_acquire(&self->is_discarding))
+                break;
+            slice = make_vfslice(channel_read_map(self->queue, &self->reader));
+            CHECK(write_frames(self, slice.beg, slice.end, clock_tic(0)));
+            channel_read_unmap(self->queue,
+                               &self->reader,
+                               (uint8_t*)slice.end - (uint8_t*)slice.beg);
+        } while (slice.end > slice.beg);
+    }
+    CHECK(flush_batch(self));
+    if (self->chunks.is_ready)
+        CHECK(chunker_flush(&self->chunks.chunker, append_chunks, self));
+    if (self->annotations)
+        video_annotations_stop(self->annotations);
 
     CHECK(storage_stop(self->storage) == Device_Ok);
+    if (self->async.is_enabled) {
+        // Storage is done with everything once it has stopped.
+        slice = make_vfslice(channel_read_map(self->queue, &self->reader));
+        release_appended(self, &slice, &slice);
+    }
+    if (load_acquire(&self->is_discarding)) {
+        discard_unread(self);
+        LOG("[stream %d]: SINK: Discarded %llu frames",
+            self->stream_id,
+            (unsigned long long)self->frames_discarded);
+    }
     LOG("[stream %d]: SINK: Exiting thread", self->stream_id);
-    self->is_running = 0;
-    self->is_stopping = 0;
+    if (self->io.scheduler)
+        io_scheduler_leave(self->io.scheduler, self->stream_id);
+    store_release(&self->is_running, 0);
+    store_release(&self->is_stopping, 0);
     return 0;
 Error:
     LOGE("[stream %d]: SINK: Exiting thread (Error)", self->stream_id);
     self->sig_stop_source(self);
-    channel_read_unmap(&self->in, &self->reader, 0);
+    channel_read_unmap(self->queue, &self->reader, 0);
+    self->batch.nbytes = 0;
+    if (self->annotations)
+        video_annotations_stop(self->annotations);
     storage_stop(self->storage);
-    self->is_running = 0;
-    self->is_stopping = 0;
+    if (self->io.scheduler)
+        io_scheduler_leave(self->io.scheduler, self->stream_id);
+    store_release(&self->is_running, 0);
+    store_release(&self->is_stopping, 0);
     return 1;
 }
 
@@ -111,11 +675,59 @@ video_sink_start(struct video_sink_s* self)
            self->stream_id,
            device_state_as_string(storage_get_state(self->storage)));
 
-    channel_accept_writes(&self->in, 1);
-    self->is_stopping = 0;
-    self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_sink_thread, self));
+    // A sink reading another sink's queue leaves it to that sink.
+    if (self->queue == &self->in) {
+        const size_t capacity = channel_capacity_of_whole_frames(
+          &self->in, self->channel_capacity_bytes, self->bytes_of_image);
+        if (self->in.capacity != capacity) {
+            LOG("Video[%2d]: Allocating %llu bytes for the queue.",
+                self->stream_id,
+                (unsigned long long)capacity);
+        }
+        CHECK(channel_reserve(&self->in, capacity));
+    }
+    self->reader.bytes_read = 0;
+    self->frames_appended = 0;
+    self->frames_discarded = 0;
+    store_release(&self->is_discarding, 0);
+    self->bytes_appended = 0;
+    self->batch.nbytes = 0;
+    {
+        // Room for a full batch plus one more write.
+        const size_t capacity = 2 * self->coalescing.min_bytes;
+        if (self->batch.capacity != capacity) {
+            memory_free(self->batch.data);
+            self->batch.data = 0;
+            self->batch.capacity = 0;
+            if (capacity) {
+                EXPECT(self->batch.data =
+                         memory_alloc(capacity, AllocatorHint_Default),
+                       "[stream %d]: SINK: Failed to allocate %llu bytes for "
+                       "coalescing writes.",
+                       self->stream_id,
+                       (unsigned long long)capacity);
+                self->batch.capacity = capacity;
+            }
+        }
+    }
+    latency_histogram_reset(&self->channel_to_sink_us);
+    latency_histogram_reset(&self->sink_to_storage_us);
+    latency_histogram_reset(&self->storage_append_us);
+    latency_histogram_reset(&self->io_wait_us);
+    if (self->annotations)
+        CHECK(video_annotations_start(self->annotations) == Device_Ok);
+    if (self->io.scheduler)
+        CHECK(io_scheduler_join(self->io.scheduler,
+                                self->stream_id,
+                                self->queue,
+                                &self->reader,
+                                self->io.priority,
+                                self->io.share));
+    if (self->queue == &self->in)
+        channel_accept_writes(&self->in, 1);
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    CHECK(parked_thread_run(&self->thread));
 
     return Device_Ok;
 Error:
@@ -126,38 +738,75 @@ enum DeviceStatusCode
 video_sink_get(const struct video_sink_s* const self,
                struct DeviceIdentifier* const identifier,
                struct StorageProperties* const settings,
-               float* const write_delay_ms)
+               float* const write_delay_ms,
+               uint32_t* const writer_count,
+               struct video_sink_coalescing* const coalescing)
 {
     *identifier = self->identifier;
     *write_delay_ms = self->write_delay_ms;
+    *writer_count = self->writer_count;
+    *coalescing = self->coalescing;
 
     return self->storage ? storage_get(self->storage, settings) : Device_Ok;
 }
 
+enum DeviceStatusCode
+video_sink_get_meta(const struct video_sink_s* self,
+                    struct StoragePropertyMetadata* meta)
+{
+    if (!self->storage)
+        return Device_Ok;
+    if (self->has_applied_settings) {
+        *meta = self->meta;
+        return Device_Ok;
+    }
+    return storage_get_meta(self->storage, meta);
+}
+
 void
 video_sink_destroy(struct video_sink_s* self)
 {
-    thread_join(&self->thread);
+    parked_thread_destroy(&self->thread);
+    band_pool_stop(&self->writers);
     if (self->storage) {
         storage_close(self->storage);
     }
+    storage_properties_destroy(&self->applied_settings);
+    self->has_applied_settings = 0;
+    trace_ring_reserve(&self->trace, 0);
     channel_release(&self->in);
+    free((void*)self->frames);
+    self->frames = 0;
+    self->frames_capacity = 0;
+    memory_free(self->batch.data);
+    self->batch.data = 0;
+    self->batch.capacity = 0;
+    if (self->chunks.is_ready)
+        chunker_destroy(&self->chunks.chunker);
+    self->chunks.is_ready = 0;
+}
+
+void
+video_sink_read_from(struct video_sink_s* self, struct channel* queue)
+{
+    channel_reader_detach(self->queue, &self->reader);
+    self->queue = queue ? queue : &self->in;
 }
 
 size_t
 video_sink_bytes_waiting(const struct video_sink_s* self)
 {
-    if (self->reader.id > 0) {
-        size_t pos = self->in.holds.pos[self->reader.id - 1];
-        size_t head = self->in.head;
-        size_t high = self->in.high;
-        if (pos > head) {
-            return (high - pos) + head;
-        } else {
-            return head - pos;
-        }
-    }
-    return 0;
+    return channel_bytes_unread(self->queue, &self->reader);
+}
+
+void
+video_sink_discard(struct video_sink_s* self)
+{
+    if (!load_acquire(&self->is_running))
+        return;
+    store_release(&self->is_discarding, 1);
+    store_release(&self->is_stopping, 1);
+    channel_wake_readers(self->queue);
 }
 
 enum DeviceStatusCode
@@ -165,18 +814,52 @@ video_sink_configure(struct video_sink_s* self,
                      const struct DeviceManager* device_manager,
                      struct DeviceIdentifier* identifier,
                      struct StorageProperties* settings,
-                     float write_delay_ms)
+                     float write_delay_ms,
+                     uint32_t writer_count,
+                     const struct video_sink_coalescing* coalescing,
+                     size_t channel_capacity_bytes)
 {
+    EXPECT(coalescing->min_bytes <= channel_capacity_bytes / 2,
+           "[stream %d]: SINK: Can't coalesce writes into batches of %llu "
+           "bytes. At most half the queue (%llu bytes) is allowed.",
+           self->stream_id,
+           (unsigned long long)coalescing->min_bytes,
+           (unsigned long long)(channel_capacity_bytes / 2));
+    EXPECT(writer_count <= BAND_POOL_MAX_THREADS,
+           "[stream %d]: SINK: Can't append from %u threads. At most %d are "
+           "supported.",
+           self->stream_id,
+           writer_count,
+           BAND_POOL_MAX_THREADS);
     self->write_delay_ms = write_delay_ms;
+    self->writer_count = writer_count;
+    self->coalescing = *coalescing;
+    self->channel_capacity_bytes = channel_capacity_bytes;
     if (self->storage && !is_equal(&self->identifier, identifier)) {
         storage_close(self->storage);
         self->storage = NULL;
+        self->has_applied_settings = 0;
     }
     if (!self->storage) {
         CHECK(self->storage = storage_open(device_manager, identifier));
         self->identifier = *identifier;
     }
+    // Setting a device can be slow, so it's skipped when nothing changed
+    // and the device is still armed with the last settings.
+    if (self->has_applied_settings &&
+        storage_get_state(self->storage) == DeviceState_Armed &&
+        is_equal_storage_properties(&self->applied_settings, settings)) {
+        TRACE("[stream %d]: SINK: Storage settings unchanged.",
+              self->stream_id);
+        return Device_Ok;
+    }
+    self->has_applied_settings = 0;
     CHECK(Device_Ok == storage_set(self->storage, settings));
+    self->has_applied_settings =
+      (uint8_t)storage_properties_copy(&self->applied_settings, settings);
+    self->meta = (struct StoragePropertyMetadata){ 0 };
+    CHECK(Device_Ok == storage_get_meta(self->storage, &self->meta));
+    channel_set_frame_alignment(&self->in, self->meta.io_alignment_bytes);
     return Device_Ok;
 Error:
     return Device_Err;
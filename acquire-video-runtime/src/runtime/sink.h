@@ -2,7 +2,14 @@
 #define H_ACQUIRE_SINK_V0
 
 #include "platform.h"
+#include "annotations.h"
+#include "band_pool.h"
 #include "channel.h"
+#include "chunker.h"
+#include "histogram.h"
+#include "io_scheduler.h"
+#include "parked_thread.h"
+#include "trace.h"
 #include "device/props/device.h"
 #include "device/props/storage.h"
 #include "device/hal/storage.h"
@@ -12,25 +19,171 @@ extern "C"
 {
 #endif
 
+    /// Gathers small writes into larger ones before they reach storage.
+    struct video_sink_coalescing
+    {
+        /// Frames are held back until at least this many bytes are waiting.
+        /// 0 turns coalescing off.
+        size_t min_bytes;
+
+        /// Frames are also written once the first one held back was picked
+        /// up this long ago. 0 or less only writes them once `min_bytes` are
+        /// waiting or the stream stops.
+        float max_age_ms;
+    };
+
     /// Context for video sink threads
     struct video_sink_s
     {
         /// Used by external threads to signal the controller thread to stop
-        /// Other threads may write.
-        uint8_t is_stopping;
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
 
         /// When true, the controller thread has completed it's work.
-        /// Other threads should only read.
-        uint8_t is_running;
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
 
         uint8_t stream_id;
         float write_delay_ms;
+
+        /// Size of the `in` channel. Memory is only committed when the sink is
+        /// started.
+        size_t channel_capacity_bytes;
+
+        /// Bytes of pixels in each frame, when every frame has as many, so
+        /// the `in` channel is sized to hold a whole number of them. 0
+        /// otherwise. See channel_capacity_of_whole_frames().
+        size_t bytes_of_image;
+
         void (*sig_stop_source)(const struct video_sink_s*);
         struct Storage* storage;
         struct channel in;
-        struct thread thread;
+
+        /// The queue frames are read from. `in`, unless the sink reads
+        /// another sink's queue alongside it. See video_sink_read_from().
+        struct channel* queue;
+
+        /// Runs the sink once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
         struct DeviceIdentifier identifier;
         struct channel_reader reader;
+
+        /// Deep copy of the settings last applied to `storage`, so
+        /// configuring it again with the same ones can skip storage_set().
+        /// Only valid while `has_applied_settings` is set.
+        struct StorageProperties applied_settings;
+        uint8_t has_applied_settings;
+
+        /// Microseconds from a frame being written to its first channel until
+        /// the sink picked it up, and from then until storage accepted it.
+        /// Reset when the sink is started.
+        struct latency_histogram channel_to_sink_us;
+        struct latency_histogram sink_to_storage_us;
+
+        /// Microseconds spent in each call appending to storage. Reset when
+        /// the sink is started.
+        struct latency_histogram storage_append_us;
+
+        /// When `scheduler` isn't NULL, the sink takes turns with the sinks
+        /// of other streams, in slot `stream_id`, before each append. Not
+        /// owned. See io_scheduler.h.
+        struct
+        {
+            struct io_scheduler* scheduler;
+            uint8_t priority;
+            float share;
+        } io;
+
+        /// Microseconds appends waited for their turn with `io.scheduler`.
+        /// Reset when the sink is started.
+        struct latency_histogram io_wait_us;
+
+        /// Time spent appending to storage. Only recorded when tracing is
+        /// on.
+        struct trace_ring trace;
+
+        /// Number of threads appending to storage. More than one is only used
+        /// when the storage device supports concurrent appends. Each region
+        /// mapped from `in` is split between them and released once every
+        /// writer is done with it, so frames are still consumed in order.
+        uint32_t writer_count;
+        struct band_pool writers;
+
+        /// Frames and bytes appended since the sink was started. Written by
+        /// the sink thread with relaxed stores, so other threads can sample
+        /// them.
+        uint64_t frames_appended;
+        uint64_t bytes_appended;
+
+        /// Set by video_sink_discard(), so the sink drops the frames it has
+        /// yet to append instead of storing them. Cleared when the sink is
+        /// started.
+        uint32_t is_discarding;
+
+        /// Frames dropped while `is_discarding` was set. Written by the sink
+        /// thread with relaxed stores.
+        uint64_t frames_discarded;
+
+        /// Frames of the region being appended by `writers`.
+        const struct VideoFrame** frames;
+        size_t frames_capacity;
+
+        /// Set by a writer when storage rejects a packet.
+        uint8_t append_failed;
+
+        struct video_sink_coalescing coalescing;
+
+        /// Set for an acquisition when storage can finish appends after they
+        /// return, and neither several writers nor coalescing are asked for.
+        /// Bytes mapped from `in` are then only consumed once storage is done
+        /// with them. Counted since the sink was started: bytes handed to
+        /// storage, bytes it reported done, and bytes consumed from `in`.
+        /// `completed` is written by storage's threads, with store_release().
+        /// Appends are split into packets of about `preferred_append_bytes`
+        /// of storage's metadata, and no more than `max_inflight_bytes` are
+        /// left with storage at once. 0 leaves that unlimited.
+        /// `nbytes_seen` are mapped from `in` and already looked at: in
+        /// flight, or held back by the limit.
+        struct
+        {
+            uint8_t is_enabled;
+            uint64_t submitted, completed, released;
+            uint64_t max_inflight_bytes;
+            size_t nbytes_seen;
+        } async;
+
+        /// Client records joined to frames as they're handed to storage, or
+        /// NULL when the sink takes none, like those of tee outputs. Not
+        /// owned. Started with the sink, and stopped once it has handed
+        /// storage its last frame.
+        struct video_annotations_s* annotations;
+
+        /// What storage reported about itself when it was last configured.
+        /// Frames written to `in` are padded out to its `io_alignment_bytes`.
+        struct StoragePropertyMetadata meta;
+
+        /// Set for an acquisition when storage takes chunks instead of frames.
+        /// Frames are assembled by `chunker`, which is set up from the first
+        /// frame's shape and the acquisition dimensions applied to storage,
+        /// and handed over a layer of chunks at a time.
+        struct
+        {
+            uint8_t is_enabled;
+            uint8_t is_ready;
+            struct chunker chunker;
+        } chunks;
+
+        /// Frames copied out of `in` while a batch is gathered. Holds twice
+        /// `coalescing.min_bytes`. Allocated when the sink is started.
+        struct
+        {
+            uint8_t* data;
+            size_t capacity;
+            size_t nbytes;
+            /// When the first frame in `data` was picked up.
+            uint64_t picked;
+        } batch;
     };
 
     enum DeviceStatusCode video_sink_init(
@@ -49,21 +202,52 @@ extern "C"
     /// device.
     /// @param [out] settings The current `StorageProperties`.
     /// @param [out] write_delay_ms The current write delay.
+    /// @param [out] writer_count The number of threads appending to storage.
+    /// @param [out] coalescing How small writes are gathered.
     /// @return Device_Ok on success, otherwise Device_Err
-    enum DeviceStatusCode video_sink_get(const struct video_sink_s* self,
-                                         struct DeviceIdentifier* identifier,
-                                         struct StorageProperties* settings,
-                                         float* write_delay_ms);
+    enum DeviceStatusCode video_sink_get(
+      const struct video_sink_s* self,
+      struct DeviceIdentifier* identifier,
+      struct StorageProperties* settings,
+      float* write_delay_ms,
+      uint32_t* writer_count,
+      struct video_sink_coalescing* coalescing);
+
+    /// @brief Gets storage's property metadata, as reported when it was last
+    /// configured, or from storage when it hasn't been.
+    /// @param[out] meta Only updated if a device is open.
+    enum DeviceStatusCode video_sink_get_meta(
+      const struct video_sink_s* self,
+      struct StoragePropertyMetadata* meta);
 
     enum DeviceStatusCode video_sink_configure(
       struct video_sink_s* self,
       const struct DeviceManager* device_manager,
       struct DeviceIdentifier* identifier,
       struct StorageProperties* settings,
-      float write_delay_ms);
+      float write_delay_ms,
+      uint32_t writer_count,
+      const struct video_sink_coalescing* coalescing,
+      size_t channel_capacity_bytes);
+
+    /// @brief Has the sink read frames from `queue`, another sink's `in`,
+    /// instead of its own, or from its own again when `queue` is NULL.
+    /// @details The sink is then one more reader of `queue`, so the frames
+    /// it holds aren't reused until it has appended them. It neither sizes
+    /// nor opens `queue` for writes; the sink owning it does. Only call
+    /// this while the sink isn't running.
+    void video_sink_read_from(struct video_sink_s* self,
+                              struct channel* queue);
 
     size_t video_sink_bytes_waiting(const struct video_sink_s* self);
 
+    /// @brief Tells the sink to stop, and to drop the frames it hasn't
+    /// handed to storage yet rather than append them.
+    /// @details Appends already in progress finish, as does a partial
+    /// batch of coalesced frames. The caller stops writes to the queue, so
+    /// nothing more arrives.
+    void video_sink_discard(struct video_sink_s* self);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -3,10 +3,16 @@
 #include "device/hal/camera.h"
 #include "logger.h"
 #include "platform.h"
+#include "crc32c.h"
 #include "runtime/channel.h"
+#include "runtime/stage.h"
 
-#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
 
 // #define TRACE(...) LOG(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define TRACE(...)
@@ -24,8 +30,19 @@
     } while (0)
 #define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
 
-static int
-check_frame_id(uint8_t stream_id,
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+
+/// Most frames read from the camera in one call.
+#define MAX_FRAMES_PER_BATCH (64)
+
+/// Longest wait for a frame before checking whether the stream is stopping.
+#define FRAME_TIMEOUT_MS (100)
+
+/// Returns the number of frames dropped right before this one and counts
+/// them.
+static uint64_t
+check_frame_id(struct video_source_s* self,
                uint64_t iframe,
                uint64_t last_hardware_frame_id,
                const struct ImageInfo* info)
@@ -33,17 +50,201 @@ check_frame_id(uint8_t stream_id,
     TRACE(
       "iframe: %d, hardware_frame_id: %llu", iframe, info->hardware_frame_id);
 
-    EXPECT(iframe == 0 || info->hardware_frame_id <= last_hardware_frame_id + 1,
-           "[stream %d] Dropped %llu frames (last: %llu; latest: %llu)",
-           stream_id,
-           info->hardware_frame_id - last_hardware_frame_id - 1,
-           last_hardware_frame_id,
-           info->hardware_frame_id);
+    if (iframe == 0 || info->hardware_frame_id <= last_hardware_frame_id + 1)
+        return 0;
+
+    const uint64_t gap = info->hardware_frame_id - last_hardware_frame_id - 1;
+    struct video_source_counters* counters = &self->counters;
+    store_relaxed(&counters->dropped_frames, counters->dropped_frames + gap);
+    ++counters->drop_events;
+    // Only log every time the number of drops doubles so a camera that keeps
+    // dropping doesn't slow the loop down further.
+    if ((counters->drop_events & (counters->drop_events - 1)) == 0) {
+        LOGE("[stream %d] Dropped %llu frames (last: %llu; latest: %llu). "
+             "%llu dropped in total.",
+             self->stream_id,
+             (unsigned long long)gap,
+             (unsigned long long)last_hardware_frame_id,
+             (unsigned long long)info->hardware_frame_id,
+             (unsigned long long)counters->dropped_frames);
+    }
+    return gap;
+}
+
+static void
+finish_frame(struct video_source_s* self,
+             struct VideoFrame* im,
+             const struct ImageInfo* info,
+             size_t nbytes,
+             uint64_t iframe,
+             uint64_t* last_hardware_frame_id)
+{
+    const uint64_t gap =
+      check_frame_id(self, iframe, *last_hardware_frame_id, info);
+    const uint64_t now = clock_tic_fast();
+    if (info->hardware_timestamp)
+        latency_histogram_record_tics(
+          &self->camera_to_channel_us, info->hardware_timestamp, now);
+    clock_sync_record(&self->clock_sync, info->hardware_timestamp, now);
+    *last_hardware_frame_id = info->hardware_frame_id;
+    store_relaxed(&self->counters.frames_written, iframe + 1);
+    *im = (struct VideoFrame){ .shape = info->shape,
+                               .bytes_of_frame = nbytes,
+                               .frame_id = iframe,
+                               .hardware_frame_id = info->hardware_frame_id,
+                               .hardware_frame_gap = gap,
+                               .timestamps.hardware = info->hardware_timestamp,
+                               .timestamps.acq_thread = now };
+    if (self->stage)
+        video_stage_tag_frame(self->stage, im);
+    if (self->enable_checksums) {
+        im->checksum = crc32c_of_frame(im);
+        im->has_checksum = 1;
+    }
+}
+
+/// Records the time since the pending trigger, if any, for a frame about to
+/// be written. Recorded first, since the client may look at the stats or
+/// fire the next trigger as soon as it sees the frame.
+static void
+record_trigger_latency(struct video_source_s* self)
+{
+    const uint64_t tic = exchange_acq_rel(&self->trigger_tic, 0);
+    if (tic)
+        latency_histogram_record_tics(
+          &self->trigger_to_channel_us, tic, clock_tic_fast());
+}
+
+/// Reads up to `nready` frames from the camera, with one call, straight into
+/// one batch so they're published to the channel's readers together.
+static int
+write_frame_batch(struct video_source_s* self,
+                  struct channel* channel,
+                  size_t nbytes,
+                  uint32_t nready,
+                  uint64_t* iframe,
+                  uint64_t* last_hardware_frame_id)
+{
+    struct ImageInfo info[MAX_FRAMES_PER_BATCH];
+    size_t count = min(min(nready, MAX_FRAMES_PER_BATCH),
+                       self->max_frame_count - *iframe);
+    uint64_t begin = clock_tic_fast();
+    uint8_t* beg = channel_write_map_batch(channel, nbytes, &count);
+    trace_ring_record(
+      &self->trace, "channel_write_map", begin, clock_tic_fast());
+    uint32_t n = (uint32_t)count;
+    if (n) {
+        begin = clock_tic_fast();
+        CHECK(camera_get_frames(self->camera,
+                                ((struct VideoFrame*)beg)->data,
+                                nbytes,
+                                nbytes - sizeof(struct VideoFrame),
+                                &n,
+                                info) == Device_Ok);
+        trace_ring_record(
+          &self->trace, "camera_get_frames", begin, clock_tic_fast());
+        if (!n)
+            store_relaxed(&self->counters.aborted_writes,
+                          self->counters.aborted_writes + 1);
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        finish_frame(self,
+                     (struct VideoFrame*)(beg + i * nbytes),
+                     info + i,
+                     nbytes,
+                     *iframe,
+                     last_hardware_frame_id);
+        ++*iframe;
+    }
+    if (n)
+        record_trigger_latency(self);
+    channel_write_unmap_batch(channel, n);
+    TRACE("[stream %d] SOURCE: wrote %d frames", (int)self->stream_id, (int)n);
     return 1;
 Error:
+    channel_write_unmap_batch(channel, 0);
     return 0;
 }
 
+/// Sets the camera while it streams, or, when it won't take `settings` that
+/// way, while it's stopped, and leaves it streaming.
+static enum DeviceStatusCode
+set_streaming_camera(struct video_source_s* self,
+                     const struct CameraProperties* settings)
+{
+    struct CameraProperties s = *settings;
+    if (camera_set(self->camera, &s) != Device_Ok) {
+        // camera_set() stopped the camera.
+        LOG("[stream %d] SOURCE: Restarting the camera to apply its new "
+            "settings.",
+            (int)self->stream_id);
+        s = *settings;
+        CHECK(camera_set(self->camera, &s) == Device_Ok);
+    }
+    if (camera_get_state(self->camera) != DeviceState_Running)
+        CHECK(camera_start(self->camera) == Device_Ok);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+/// Applies the settings video_source_update() handed over, and wakes it.
+/// @returns 1 if the camera is streaming afterwards, otherwise 0.
+static int
+apply_update(struct video_source_s* self)
+{
+    lock_acquire(&self->update.lock);
+    struct CameraProperties settings = self->update.settings;
+    const size_t max_bytes_of_image = self->update.max_bytes_of_image;
+    lock_release(&self->update.lock);
+
+    enum DeviceStatusCode status = set_streaming_camera(self, &settings);
+    struct ImageShape shape = { 0 };
+    if (status == Device_Ok &&
+        (camera_get_image_shape(self->camera, &shape) != Device_Ok ||
+         bytes_of_image(&shape) > max_bytes_of_image)) {
+        LOGE("[stream %d] SOURCE: Frames would grow past the %llu bytes the "
+             "stream was configured for.",
+             (int)self->stream_id,
+             (unsigned long long)max_bytes_of_image);
+        status = Device_Err;
+    }
+    if (status == Device_Ok) {
+        camera_get(self->camera, &settings);
+        self->applied_settings = settings;
+        self->requested_settings = settings;
+    } else {
+        LOGE("[stream %d] SOURCE: The camera refused its new settings.",
+             (int)self->stream_id);
+        settings = self->applied_settings;
+        if (set_streaming_camera(self, &settings) != Device_Ok)
+            LOGE("[stream %d] SOURCE: Failed to restore the camera's "
+                 "settings.",
+                 (int)self->stream_id);
+    }
+
+    lock_acquire(&self->update.lock);
+    self->update.settings = settings;
+    self->update.status = status;
+    store_release(&self->update.is_pending, 0);
+    condition_variable_notify_all(&self->update.done);
+    lock_release(&self->update.lock);
+    return camera_get_state(self->camera) == DeviceState_Running;
+}
+
+/// Fails an update the controller thread won't get to.
+static void
+cancel_update(struct video_source_s* self)
+{
+    lock_acquire(&self->update.lock);
+    if (self->update.is_pending) {
+        self->update.status = Device_Err;
+        store_release(&self->update.is_pending, 0);
+        condition_variable_notify_all(&self->update.done);
+    }
+    lock_release(&self->update.lock);
+}
+
 static int
 video_source_thread(struct video_source_s* self)
 {
@@ -53,15 +254,30 @@ video_source_thread(struct video_source_s* self)
     uint64_t iframe = 0;
     uint64_t last_hardware_frame_id = 0;
     struct channel* last_stream = 0;
-    while (!self->is_stopping && iframe < self->max_frame_count) {
-        EXPECT(camera_get_image_shape(self->camera, &info.shape) == Device_Ok,
-               "[stream %d] SOURCE: Failed to query image shape",
-               (int)self->stream_id);
 
-        size_t sz = bytes_of_image(&info.shape);
-        size_t nbytes = sizeof(struct VideoFrame) + sz;
-        // padding to 8-byte aligned size
-        const size_t nbytes_aligned = 8*((nbytes+7)/8);
+    // The shape is only queried again when the camera says it may have
+    // changed, or every time when it can't say.
+    struct ImageShape shape = { 0 };
+    uint32_t shape_generation = camera_get_shape_generation(self->camera);
+    size_t bytes_of_image_ = 0;
+    int is_shape_known = 0;
+    thread_set_current_attributes(&self->thread_attributes);
+    while (!load_acquire(&self->is_stopping) &&
+           iframe < self->max_frame_count) {
+        if (load_acquire(&self->update.is_pending))
+            EXPECT(apply_update(self),
+                   "[stream %d] SOURCE: The camera stopped streaming.",
+                   (int)self->stream_id);
+        const uint32_t generation = camera_get_shape_generation(self->camera);
+        if (!is_shape_known || !generation || generation != shape_generation) {
+            EXPECT(camera_get_image_shape(self->camera, &shape) == Device_Ok,
+                   "[stream %d] SOURCE: Failed to query image shape",
+                   (int)self->stream_id);
+            shape_generation = generation;
+            is_shape_known = 1;
+            bytes_of_image_ = bytes_of_image(&shape);
+        }
+        size_t sz = bytes_of_image_;
 
         struct channel* channel =
           (self->enable_filter) ? self->to_filter : self->to_sink;
@@ -70,28 +286,61 @@ video_source_thread(struct video_source_s* self)
             self->await_filter_reset(self);
         }
         last_stream = channel;
+        // Padded as the channel's reader asks.
+        const size_t nbytes_aligned =
+          channel_bytes_of_frame(channel, bytes_of_image_);
+
+        uint32_t nready = 0;
+        CHECK(camera_get_ready_frame_count(self->camera, &nready) ==
+              Device_Ok);
+        if (nready > 1) {
+            CHECK(write_frame_batch(self,
+                                    channel,
+                                    nbytes_aligned,
+                                    nready,
+                                    &iframe,
+                                    &last_hardware_frame_id));
+            continue;
+        }
 
+        uint64_t begin = clock_tic_fast();
         struct VideoFrame* im =
           (struct VideoFrame*)channel_write_map(channel, nbytes_aligned);
+        trace_ring_record(
+          &self->trace, "channel_write_map", begin, clock_tic_fast());
         if (im) {
-            CHECK(camera_get_frame(self->camera, im->data, &sz, &info) ==
+            // Lets cameras that can, capture straight into the channel.
+            CHECK(camera_lend_buffer(self->camera,
+                                     im->data,
+                                     nbytes_aligned - sizeof(*im)) ==
                   Device_Ok);
+            begin = clock_tic_fast();
+            CHECK(camera_get_frame_timeout(self->camera,
+                                           im->data,
+                                           &sz,
+                                           &info,
+                                           FRAME_TIMEOUT_MS) == Device_Ok);
+            const uint64_t end = clock_tic_fast();
+            trace_ring_record(&self->trace, "camera_get_frame", begin, end);
             if (!sz) {
+                // Running out of time isn't an aborted write. It just lets
+                // the loop notice a stop.
+                if (clock_tics_to_ns((int64_t)(end - begin)) <
+                    FRAME_TIMEOUT_MS * 1000000LL)
+                    store_relaxed(&self->counters.aborted_writes,
+                                  self->counters.aborted_writes + 1);
                 channel_abort_write(channel);
             } else {
-                check_frame_id(
-                  self->stream_id, iframe, last_hardware_frame_id, &info);
-                last_hardware_frame_id = info.hardware_frame_id;
-                *im = (struct VideoFrame){
-                    .shape = info.shape,
-                    .bytes_of_frame = nbytes_aligned,
-                    .frame_id = iframe,
-                    .hardware_frame_id = info.hardware_frame_id,
-                    .timestamps.hardware = info.hardware_timestamp,
-                    .timestamps.acq_thread = clock_tic(0)
-                };
+                finish_frame(self,
+                             im,
+                             &info,
+                             nbytes_aligned,
+                             iframe,
+                             &last_hardware_frame_id);
                 ++iframe;
             }
+            if (sz)
+                record_trigger_latency(self);
             channel_write_unmap(channel);
             LOG("[stream %d] SOURCE: wrote frame %d",
                 (int)self->stream_id,
@@ -102,13 +351,16 @@ Finalize:
     LOG("[stream %d] SOURCE: Stopping on frame %d",
         (int)self->stream_id,
         (int)iframe);
+    cancel_update(self);
     self->sig_stop_filter(self);
     self->sig_stop_sink(self);
 
     ECHO(camera_stop(self->camera));
+    clock_sync_flush(&self->clock_sync);
 
-    self->is_stopping = 0;
-    self->is_running = 0;
+    store_relaxed(&self->counters.stopped, clock_tic(0));
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 0);
     return ecode;
 Error:
     ecode = 1;
@@ -135,14 +387,24 @@ video_source_init(struct video_source_s* self,
         .sig_stop_filter = sig_stop_filter,
         .sig_stop_sink = sig_stop_sink,
     };
-    thread_init(&self->thread);
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-source-%d",
+             (int)stream_id);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_source_thread, self);
+    clock_sync_init(&self->clock_sync);
+    lock_init(&self->update.lock);
+    condition_variable_init(&self->update.done);
+    lock_init(&self->meta.lock);
     return Device_Ok;
 }
 
 void
 video_source_destroy(struct video_source_s* self)
 {
-    thread_join(&self->thread);
+    parked_thread_destroy(&self->thread);
+    trace_ring_reserve(&self->trace, 0);
     if (self->camera)
         camera_close(self->camera);
 }
@@ -174,15 +436,46 @@ video_source_start(struct video_source_s* self)
            self->stream_id,
            device_state_as_string(camera_get_state(self->camera)));
 
-    self->is_stopping = 0;
-    self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_source_thread, self));
+    self->counters = (struct video_source_counters){ .started = clock_tic(0) };
+    latency_histogram_reset(&self->camera_to_channel_us);
+    latency_histogram_reset(&self->trigger_to_channel_us);
+    store_relaxed(&self->trigger_tic, 0);
+    // The camera's clock may have started over with it.
+    clock_sync_reset(&self->clock_sync);
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    CHECK(parked_thread_run(&self->thread));
     return Device_Ok;
 Error:
     return Device_Err;
 }
 
+enum DeviceStatusCode
+video_source_get_meta(struct video_source_s* self,
+                      struct CameraPropertyMetadata* meta)
+{
+    if (!self->camera)
+        return Device_Ok;
+    enum DeviceStatusCode ecode = Device_Ok;
+    lock_acquire(&self->meta.lock);
+    if (!self->meta.is_valid) {
+        ecode = camera_get_meta(self->camera, &self->meta.meta);
+        self->meta.is_valid = (ecode == Device_Ok);
+    }
+    if (self->meta.is_valid)
+        *meta = self->meta.meta;
+    lock_release(&self->meta.lock);
+    return ecode;
+}
+
+static void
+forget_meta(struct video_source_s* self)
+{
+    lock_acquire(&self->meta.lock);
+    self->meta.is_valid = 0;
+    lock_release(&self->meta.lock);
+}
+
 static int
 is_equal(const struct DeviceIdentifier* const a,
          const struct DeviceIdentifier* const b)
@@ -190,6 +483,52 @@ is_equal(const struct DeviceIdentifier* const a,
     return (a->driver_id == b->driver_id) && (a->device_id == b->device_id);
 }
 
+static int
+is_equal_trigger(const struct Trigger* const a, const struct Trigger* const b)
+{
+    return a->enable == b->enable && a->line == b->line &&
+           a->kind == b->kind && a->edge == b->edge;
+}
+
+static int
+is_equal_camera_properties(const struct CameraProperties* const a,
+                           const struct CameraProperties* const b)
+{
+    return a->exposure_time_us == b->exposure_time_us &&
+           a->line_interval_us == b->line_interval_us &&
+           a->readout_direction == b->readout_direction &&
+           a->binning == b->binning && a->pixel_type == b->pixel_type &&
+           a->offset.x == b->offset.x && a->offset.y == b->offset.y &&
+           a->shape.x == b->shape.x && a->shape.y == b->shape.y &&
+           is_equal_trigger(&a->input_triggers.acquisition_start,
+                            &b->input_triggers.acquisition_start) &&
+           is_equal_trigger(&a->input_triggers.frame_start,
+                            &b->input_triggers.frame_start) &&
+           is_equal_trigger(&a->input_triggers.exposure,
+                            &b->input_triggers.exposure) &&
+           is_equal_trigger(&a->output_triggers.exposure,
+                            &b->output_triggers.exposure) &&
+           is_equal_trigger(&a->output_triggers.frame_start,
+                            &b->output_triggers.frame_start) &&
+           is_equal_trigger(&a->output_triggers.trigger_wait,
+                            &b->output_triggers.trigger_wait);
+}
+
+/// @returns 1 if the camera's limits are the same under `a` as under `b`,
+/// otherwise 0.
+static int
+is_equal_capabilities(const struct CameraProperties* const a,
+                      const struct CameraProperties* const b)
+{
+    return a->binning == b->binning && a->pixel_type == b->pixel_type &&
+           is_equal_trigger(&a->input_triggers.acquisition_start,
+                            &b->input_triggers.acquisition_start) &&
+           is_equal_trigger(&a->input_triggers.frame_start,
+                            &b->input_triggers.frame_start) &&
+           is_equal_trigger(&a->input_triggers.exposure,
+                            &b->input_triggers.exposure);
+}
+
 static unsigned
 try_camera_set(struct video_source_s* const self,
                struct CameraProperties* settings)
@@ -223,13 +562,627 @@ video_source_configure(struct video_source_s* self,
     if (self->camera && !is_equal(&self->last_camera_id, identifier)) {
         camera_close(self->camera);
         self->camera = 0;
+        self->has_applied_settings = 0;
+        forget_meta(self);
     }
     if (!self->camera) {
         CHECK(self->camera = camera_open(device_manager, identifier));
         self->last_camera_id = *identifier;
     }
+    // Setting a camera can take a while, so it's skipped when nothing
+    // changed and the camera is still armed with the last settings.
+    if (self->has_applied_settings &&
+        camera_get_state(self->camera) == DeviceState_Armed &&
+        (is_equal_camera_properties(settings, &self->requested_settings) ||
+         is_equal_camera_properties(settings, &self->applied_settings))) {
+        TRACE("[stream %d] SOURCE: Camera settings unchanged.",
+              (int)self->stream_id);
+        *settings = self->applied_settings;
+        return Device_Ok;
+    }
+    if (!self->has_applied_settings ||
+        !is_equal_capabilities(settings, &self->applied_settings))
+        forget_meta(self);
+    self->has_applied_settings = 0;
+    self->requested_settings = *settings;
     CHECK(try_camera_set(self, settings));
+    self->applied_settings = *settings;
+    self->has_applied_settings = 1;
     return Device_Ok;
 Error:
     return Device_Err;
 }
+
+/// @returns 1 if `a` and `b` only differ in what video_source_update() may
+/// change, otherwise 0.
+static int
+is_live_change(const struct CameraProperties* const a,
+               const struct CameraProperties* const b)
+{
+    struct CameraProperties c = *b;
+    c.exposure_time_us = a->exposure_time_us;
+    c.line_interval_us = a->line_interval_us;
+    c.offset = a->offset;
+    c.shape = a->shape;
+    return is_equal_camera_properties(a, &c);
+}
+
+enum DeviceStatusCode
+video_source_execute_trigger(struct video_source_s* self)
+{
+    // Only the oldest trigger a frame wasn't written for yet is timed.
+    uint64_t expected = 0;
+    compare_exchange_acq_rel(&self->trigger_tic, &expected, clock_tic_fast());
+    return camera_execute_trigger(self->camera);
+}
+
+enum DeviceStatusCode
+video_source_update(struct video_source_s* self,
+                    struct CameraProperties* settings,
+                    size_t max_bytes_of_image)
+{
+    EXPECT(load_acquire(&self->is_running),
+           "[stream %d] SOURCE: Expected a running stream to update.",
+           (int)self->stream_id);
+    EXPECT(is_live_change(settings, &self->applied_settings),
+           "[stream %d] SOURCE: Only the exposure time, line interval, "
+           "offset and shape can change while running.",
+           (int)self->stream_id);
+    if (is_equal_camera_properties(settings, &self->applied_settings))
+        return Device_Ok;
+
+    lock_acquire(&self->update.lock);
+    self->update.settings = *settings;
+    self->update.max_bytes_of_image = max_bytes_of_image;
+    store_release(&self->update.is_pending, 1);
+    // The controller thread may be waiting on the camera or on room in a
+    // channel, and could stop before it gets to the settings.
+    while (self->update.is_pending && load_acquire(&self->is_running))
+        condition_variable_timed_wait(
+          &self->update.done, &self->update.lock, FRAME_TIMEOUT_MS);
+    const int is_applied = !self->update.is_pending;
+    store_release(&self->update.is_pending, 0);
+    const enum DeviceStatusCode status =
+      is_applied ? self->update.status : Device_Err;
+    if (is_applied)
+        *settings = self->update.settings;
+    lock_release(&self->update.lock);
+    EXPECT(status == Device_Ok,
+           "[stream %d] SOURCE: Failed to update the camera.",
+           (int)self->stream_id);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+#ifndef NO_UNIT_TESTS
+
+#define containerof(P, T, F) ((T*)(((char*)(P)) - offsetof(T, F)))
+
+/// Delivers frames in bursts, as a camera draining a hardware FIFO would.
+struct source_test_camera
+{
+    struct Camera camera;
+    uint64_t next_frame_id;
+    uint32_t burst;
+    void* lent;
+    uint32_t nshape_queries;
+    uint32_t nmeta_queries;
+    /// Frames that were written to the buffer passed to get_frame() without
+    /// it having been lent first.
+    uint64_t nunlent;
+    /// When `nskip` is set, that many frames are dropped before the frame
+    /// `skip_at`.
+    uint64_t skip_at, nskip;
+    /// When set, the call to get_frame() with this (1-based) index returns no
+    /// data.
+    uint64_t empty_at;
+    uint64_t ncalls;
+    /// What set() last stored, and the number of calls to it.
+    struct CameraProperties settings;
+    uint32_t nsets;
+    /// Calls to get_frames(), and the most frames any of them returned.
+    uint32_t nbatches, largest_batch;
+    /// Calls to get_frame_timeout(), which never has a frame. The stream is
+    /// stopped through `is_stopping` after `stop_after` of them.
+    uint32_t ntimeouts, stop_after;
+    uint32_t* is_stopping;
+};
+
+static const struct ImageShape source_test_shape = {
+    .dims = { .channels = 1, .width = 8, .height = 4, .planes = 1 },
+    .strides = { .channels = 1, .width = 1, .height = 8, .planes = 32 },
+    .type = SampleType_u8,
+};
+
+static enum DeviceStatusCode
+source_test_camera_get_shape(const struct Camera* camera,
+                             struct ImageShape* shape)
+{
+    ++containerof(camera, struct source_test_camera, camera)->nshape_queries;
+    *shape = source_test_shape;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+source_test_camera_stop(struct Camera* camera)
+{
+    return Device_Ok;
+}
+
+/// Exposures are rounded down to a multiple of 10 us, as a camera with a
+/// coarse clock would.
+static enum DeviceStatusCode
+source_test_camera_set(struct Camera* camera, struct CameraProperties* settings)
+{
+    struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    ++self->nsets;
+    self->settings = *settings;
+    self->settings.exposure_time_us =
+      10.0f * (float)(int)(settings->exposure_time_us / 10.0f);
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+source_test_camera_get(const struct Camera* camera,
+                       struct CameraProperties* settings)
+{
+    const struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    *settings = self->settings;
+    return Device_Ok;
+}
+
+/// Reports the binning the camera was last set with as the most it takes.
+static enum DeviceStatusCode
+source_test_camera_get_meta(const struct Camera* camera,
+                            struct CameraPropertyMetadata* meta)
+{
+    struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    ++self->nmeta_queries;
+    *meta = (struct CameraPropertyMetadata){ 0 };
+    meta->binning.high = (float)self->settings.binning;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+source_test_camera_get_frame(struct Camera* camera,
+                             void* im,
+                             size_t* nbytes,
+                             struct ImageInfo* info)
+{
+    struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    self->nunlent += (im != self->lent);
+    self->lent = 0;
+    if (++self->ncalls == self->empty_at) {
+        *nbytes = 0;
+        return Device_Ok;
+    }
+    if (self->nskip && self->next_frame_id == self->skip_at)
+        self->next_frame_id += self->nskip;
+    info->shape = source_test_shape;
+    info->hardware_frame_id = self->next_frame_id++;
+    memset(im, (int)info->hardware_frame_id, *nbytes);
+    return Device_Ok;
+}
+
+/// Returns the whole burst in one call.
+static enum DeviceStatusCode
+source_test_camera_get_frames(struct Camera* camera,
+                              void* im,
+                              size_t stride,
+                              size_t bytes_of_frame,
+                              uint32_t* count,
+                              struct ImageInfo* info)
+{
+    struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    uint32_t n = min(*count, self->burst);
+    for (uint32_t i = 0; i < n; ++i) {
+        info[i].shape = source_test_shape;
+        info[i].hardware_frame_id = self->next_frame_id++;
+        memset((uint8_t*)im + i * stride,
+               (int)info[i].hardware_frame_id,
+               bytes_of_frame);
+    }
+    ++self->nbatches;
+    self->largest_batch = max(self->largest_batch, n);
+    *count = n;
+    return Device_Ok;
+}
+
+/// Times out without a frame, as a camera waiting on a trigger would.
+static enum DeviceStatusCode
+source_test_camera_get_frame_timeout(struct Camera* camera,
+                                     void* im,
+                                     size_t* nbytes,
+                                     struct ImageInfo* info,
+                                     uint32_t timeout_ms)
+{
+    struct source_test_camera* self =
+      containerof(camera, struct source_test_camera, camera);
+    self->lent = 0;
+    clock_sleep_ms(0, (float)timeout_ms);
+    if (++self->ntimeouts == self->stop_after)
+        store_release(self->is_stopping, 1);
+    *nbytes = 0;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+source_test_camera_lend_buffer(struct Camera* camera, void* im, size_t nbytes)
+{
+    containerof(camera, struct source_test_camera, camera)->lent = im;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+source_test_camera_get_ready_frame_count(const struct Camera* camera,
+                                         uint32_t* count)
+{
+    *count = containerof(camera, struct source_test_camera, camera)->burst;
+    return Device_Ok;
+}
+
+static void
+source_test_noop(const struct video_source_s* self)
+{
+}
+
+/// Frames from a camera reporting bursts arrive intact and in order, each is
+/// captured into a buffer lent from the channel, and a finite acquisition
+/// doesn't read past its last frame.  The shape is only queried once since it
+/// never changes.
+int
+unit_test__video_source_writes_bursts_in_batches()
+{
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_Running,
+                    .get_shape = source_test_camera_get_shape,
+                    .stop = source_test_camera_stop,
+                    .get_frame = source_test_camera_get_frame,
+                    .get_ready_frame_count =
+                      source_test_camera_get_ready_frame_count,
+                    .lend_buffer = source_test_camera_lend_buffer,
+                    .shape_generation = 1 },
+        .burst = 4,
+    };
+    channel_new(&channel, 1 << 16);
+    channel_accept_writes(&channel, 1);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+    source.camera = &camera.camera;
+
+    CHECK(video_source_thread(&source) == 0);
+    CHECK(camera.next_frame_id == 10);
+    CHECK(camera.nunlent == 0);
+    CHECK(camera.nshape_queries == 1);
+
+    struct slice s = channel_read_map(&channel, &reader);
+    uint64_t iframe = 0;
+    for (const uint8_t* cur = s.beg; cur < s.end;) {
+        const struct VideoFrame* im = (const struct VideoFrame*)cur;
+        CHECK(im->frame_id == iframe);
+        CHECK(im->hardware_frame_id == iframe);
+        CHECK(im->data[31] == (uint8_t)iframe);
+        cur += im->bytes_of_frame;
+        ++iframe;
+    }
+    CHECK(iframe == 10);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// A camera that can return a burst of frames with one call is asked for the
+/// whole burst at once, straight into the channel.
+int
+unit_test__video_source_uses_get_frames()
+{
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_Running,
+                    .get_shape = source_test_camera_get_shape,
+                    .stop = source_test_camera_stop,
+                    .get_frame = source_test_camera_get_frame,
+                    .get_frames = source_test_camera_get_frames,
+                    .get_ready_frame_count =
+                      source_test_camera_get_ready_frame_count },
+        .burst = 4,
+    };
+    channel_new(&channel, 1 << 16);
+    channel_accept_writes(&channel, 1);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+    source.camera = &camera.camera;
+
+    CHECK(video_source_thread(&source) == 0);
+    CHECK(camera.ncalls == 0);
+    CHECK(camera.nbatches == 3);
+    CHECK(camera.largest_batch == 4);
+
+    struct slice s = channel_read_map(&channel, &reader);
+    uint64_t iframe = 0;
+    for (const uint8_t* cur = s.beg; cur < s.end;) {
+        const struct VideoFrame* im = (const struct VideoFrame*)cur;
+        CHECK(im->frame_id == iframe);
+        CHECK(im->hardware_frame_id == iframe);
+        CHECK(im->data[31] == (uint8_t)iframe);
+        cur += im->bytes_of_frame;
+        ++iframe;
+    }
+    CHECK(iframe == 10);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// A stream whose camera has no frames still stops, once its wait for the
+/// next frame times out, and the timeouts aren't counted as aborted writes.
+int
+unit_test__video_source_stops_while_waiting_for_frames()
+{
+    struct channel channel;
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_Running,
+                    .get_shape = source_test_camera_get_shape,
+                    .stop = source_test_camera_stop,
+                    .get_frame = source_test_camera_get_frame,
+                    .get_frame_timeout =
+                      source_test_camera_get_frame_timeout },
+        .stop_after = 2,
+    };
+    channel_new(&channel, 1 << 16);
+    channel_accept_writes(&channel, 1);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+    source.camera = &camera.camera;
+    camera.is_stopping = &source.is_stopping;
+
+    CHECK(video_source_thread(&source) == 0);
+    CHECK(camera.ntimeouts == 2);
+    CHECK(camera.ncalls == 0);
+    CHECK(source.counters.aborted_writes == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Gaps in the camera's frame ids and empty frames are counted, and each frame
+/// records the gap before it.
+int
+unit_test__video_source_counts_dropped_frames()
+{
+    struct channel channel;
+    struct channel_reader reader = { 0 };
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_Running,
+                    .get_shape = source_test_camera_get_shape,
+                    .stop = source_test_camera_stop,
+                    .get_frame = source_test_camera_get_frame },
+        .skip_at = 5,
+        .nskip = 3,
+        .empty_at = 3,
+    };
+    channel_new(&channel, 1 << 16);
+    channel_accept_writes(&channel, 1);
+    channel_read_map(&channel, &reader);
+    channel_read_unmap(&channel, &reader, 0);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+    source.camera = &camera.camera;
+
+    CHECK(video_source_thread(&source) == 0);
+    CHECK(camera.ncalls == 11);
+    CHECK(source.counters.aborted_writes == 1);
+    CHECK(source.counters.dropped_frames == 3);
+    CHECK(source.counters.drop_events == 1);
+
+    struct slice s = channel_read_map(&channel, &reader);
+    uint64_t iframe = 0;
+    for (const uint8_t* cur = s.beg; cur < s.end;) {
+        const struct VideoFrame* im = (const struct VideoFrame*)cur;
+        CHECK(im->frame_id == iframe);
+        CHECK(im->hardware_frame_id == iframe + (iframe < 5 ? 0 : 3));
+        CHECK(im->hardware_frame_gap == (iframe == 5 ? 3 : 0));
+        cur += im->bytes_of_frame;
+        ++iframe;
+    }
+    CHECK(iframe == 10);
+    channel_read_unmap(&channel, &reader, s.end - s.beg);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// Configuring a camera again with the settings it was last given, or with
+/// the ones it reported back, doesn't set it again unless it needs to be
+/// re-armed.
+int
+unit_test__video_source_skips_unchanged_camera_settings()
+{
+    struct channel channel;
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_AwaitingConfiguration,
+                    .set = source_test_camera_set,
+                    .get = source_test_camera_get,
+                    .stop = source_test_camera_stop },
+    };
+    struct DeviceIdentifier identifier = { 0 };
+    struct CameraProperties settings = { .exposure_time_us = 1234.0f,
+                                         .binning = 1 };
+    channel_new(&channel, 0);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+    source.camera = &camera.camera;
+    source.last_camera_id = identifier;
+
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 1);
+    CHECK(settings.exposure_time_us == 1230.0f);
+
+    // What the camera reported back.
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 1);
+
+    // What was asked for the first time.
+    settings.exposure_time_us = 1234.0f;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 20, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 1);
+    CHECK(settings.exposure_time_us == 1230.0f);
+    CHECK(source.max_frame_count == 20);
+
+    settings.input_triggers.frame_start.enable = 1;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 20, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 2);
+    CHECK(camera.settings.input_triggers.frame_start.enable == 1);
+
+    // A camera that lost its configuration is set again.
+    camera.camera.state = DeviceState_AwaitingConfiguration;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 20, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 3);
+    CHECK(camera.camera.state == DeviceState_Armed);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+/// The camera's metadata is only asked for again once a setting it depends on
+/// changes.
+int
+unit_test__video_source_caches_camera_meta()
+{
+    struct channel channel;
+    struct video_source_s source;
+    struct source_test_camera camera = {
+        .camera = { .state = DeviceState_AwaitingConfiguration,
+                    .set = source_test_camera_set,
+                    .get = source_test_camera_get,
+                    .get_meta = source_test_camera_get_meta,
+                    .stop = source_test_camera_stop },
+    };
+    struct DeviceIdentifier identifier = { 0 };
+    struct CameraProperties settings = { .exposure_time_us = 1000.0f,
+                                         .binning = 1 };
+    struct CameraPropertyMetadata meta = { 0 };
+    channel_new(&channel, 0);
+    video_source_init(&source,
+                      0,
+                      10,
+                      &channel,
+                      &channel,
+                      source_test_noop,
+                      source_test_noop,
+                      source_test_noop);
+
+    // Nothing to ask without a camera.
+    CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+    CHECK(meta.binning.high == 0.0f);
+
+    source.camera = &camera.camera;
+    source.last_camera_id = identifier;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+        CHECK(meta.binning.high == 1.0f);
+    }
+    CHECK(camera.nmeta_queries == 1);
+
+    // The exposure doesn't move the camera's limits.
+    settings.exposure_time_us = 2000.0f;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    CHECK(camera.nsets == 2);
+    CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+    CHECK(camera.nmeta_queries == 1);
+
+    settings.binning = 2;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+    CHECK(meta.binning.high == 2.0f);
+    CHECK(camera.nmeta_queries == 2);
+
+    settings.input_triggers.frame_start.enable = 1;
+    CHECK(video_source_configure(&source, 0, &identifier, &settings, 10, 0) ==
+          Device_Ok);
+    CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+    CHECK(video_source_get_meta(&source, &meta) == Device_Ok);
+    CHECK(camera.nmeta_queries == 3);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
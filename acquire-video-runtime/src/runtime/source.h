@@ -6,39 +6,123 @@
 #include "device/hal/device.manager.h"
 #include "platform.h"
 #include "runtime/channel.h"
+#include "runtime/clock_sync.h"
+#include "runtime/histogram.h"
+#include "runtime/parked_thread.h"
+#include "runtime/trace.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    struct video_stage_s;
+
     /// Context for video source threads
     struct video_source_s
     {
         struct Camera* camera;
         struct DeviceIdentifier last_camera_id;
+
+        /// The settings last passed to camera_set() and what the camera
+        /// reported back, so configuring it again with either can skip
+        /// setting the camera. Only valid while `has_applied_settings` is set.
+        struct CameraProperties requested_settings;
+        struct CameraProperties applied_settings;
+        uint8_t has_applied_settings;
         uint64_t max_frame_count;
 
+        /// What camera_get_meta() last reported. The camera's limits only
+        /// move with its binning, pixel type and input triggers, so this is
+        /// kept till one of those changes or the camera is closed. Guarded
+        /// by `lock`. See video_source_get_meta().
+        struct video_source_meta
+        {
+            struct lock lock;
+            struct CameraPropertyMetadata meta;
+            uint8_t is_valid;
+        } meta;
+
         /// Used by external threads to signal the controller thread to stop
-        /// Other threads may write.
-        uint8_t is_stopping;
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
 
         /// When true, the controller thread has completed it's work.
-        /// Other threads should only read.
-        uint8_t is_running;
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
 
         uint8_t stream_id;
-        struct thread thread;
+        /// Runs the controller once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
         struct channel* to_sink;
         struct channel* to_filter;
         uint8_t enable_filter;
 
+        /// When set, each frame's `checksum` is computed as it's written.
+        uint8_t enable_checksums;
+
+        /// Written by the controller thread with relaxed stores, so other
+        /// threads can sample them. Reset when the source is started.
+        struct video_source_counters
+        {
+            /// Frames written to a channel.
+            uint64_t frames_written;
+            /// Frames the camera dropped, judging by gaps in
+            /// `hardware_frame_id`.
+            uint64_t dropped_frames;
+            /// Number of gaps in `hardware_frame_id`.
+            uint64_t drop_events;
+            /// Writes abandoned because the camera returned no frame.
+            uint64_t aborted_writes;
+            /// clock_tic() when the source was started and when the
+            /// controller thread finished. `stopped` is 0 while running.
+            uint64_t started, stopped;
+        } counters;
+
+        /// Microseconds from the camera's timestamp to the frame being
+        /// written to a channel.
+        struct latency_histogram camera_to_channel_us;
+
+        /// clock_tic_fast() of the oldest software trigger no frame has been
+        /// written for since, or 0. Set by video_source_execute_trigger().
+        uint64_t trigger_tic;
+        /// Microseconds from a software trigger to the next frame being
+        /// written to a channel.
+        struct latency_histogram trigger_to_channel_us;
+
+        /// Maps the camera's timestamps onto the host clock. Recorded by the
+        /// controller thread.
+        struct clock_sync clock_sync;
+
+        /// Time spent waiting on the camera and the channel. Only recorded
+        /// when tracing is on.
+        struct trace_ring trace;
+
         /// Signals stream filters to reset any internal state and blocks until
         /// the reset is completed.
         void (*await_filter_reset)(const struct video_source_s*);
 
         void (*sig_stop_filter)(const struct video_source_s*);
         void (*sig_stop_sink)(const struct video_source_s*);
+
+        /// Tags each frame with the stage position streamed alongside it.
+        /// May be NULL.
+        struct video_stage_s* stage;
+
+        /// Camera settings handed over by video_source_update(), for the
+        /// controller thread to apply between frames. Guarded by `lock`.
+        struct video_source_update
+        {
+            struct lock lock;
+            struct condition_variable done;
+            struct CameraProperties settings;
+            size_t max_bytes_of_image;
+            /// Set till the controller thread has applied `settings`, which
+            /// it then overwrites with what the camera reports.
+            uint32_t is_pending;
+            enum DeviceStatusCode status;
+        } update;
     };
 
     /// @brief Initializes the video source controller.
@@ -80,6 +164,14 @@ extern "C"
       struct CameraProperties* settings,
       uint64_t* max_frame_count);
 
+    /// @brief Gets the camera's property metadata, asking the camera only the
+    /// first time since it was opened or its binning, pixel type or input
+    /// triggers last changed.
+    /// @param[out] meta Only updated if a device is open.
+    enum DeviceStatusCode video_source_get_meta(
+      struct video_source_s* self,
+      struct CameraPropertyMetadata* meta);
+
     enum DeviceStatusCode video_source_configure(
       struct video_source_s* self,
       const struct DeviceManager* device_manager,
@@ -90,6 +182,29 @@ extern "C"
 
     enum DeviceStatusCode video_source_start(struct video_source_s* self);
 
+    /// @brief Fires the camera's software trigger, timing how long it takes
+    /// till the next frame is written to a channel.
+    enum DeviceStatusCode video_source_execute_trigger(
+      struct video_source_s* self);
+
+    /// @brief Has the controller thread apply `settings` to the streaming
+    /// camera between frames, and waits till it has.
+    /// @details Only the exposure time, line interval, offset and shape may
+    /// differ from the settings the camera has. A camera that won't take
+    /// them while streaming is stopped, set and started again, without
+    /// stopping the rest of the stream. When that fails too, the camera goes
+    /// back to the settings it had. `settings` is updated to what the camera
+    /// reports.
+    /// @param[in] max_bytes_of_image The camera goes back to its settings
+    /// too when its frames would hold more bytes of pixels than this, which
+    /// the stream's queues were sized for.
+    /// @returns `Device_Ok` on success, or `Device_Err` if the settings were
+    /// refused, or the stream stopped first.
+    enum DeviceStatusCode video_source_update(
+      struct video_source_s* self,
+      struct CameraProperties* settings,
+      size_t max_bytes_of_image);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
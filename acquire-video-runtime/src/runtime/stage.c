@@ -0,0 +1,237 @@
+#include "stage.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+/// How long the controller sleeps once it has collected every sample the
+/// axis had.
+#define STAGE_POLL_INTERVAL_MS (2.0f)
+
+/// Most samples collected from the axis at once.
+#define STAGE_SAMPLES_PER_POLL (256)
+
+/// Size of the channel of samples. Holds seconds of samples at kHz rates,
+/// so the source only misses samples when it stalls for longer.
+#define STAGE_CHANNEL_CAPACITY_BYTES (1ULL << 20)
+
+static int
+is_equal(const struct DeviceIdentifier* const a,
+         const struct DeviceIdentifier* const b)
+{
+    return (a->driver_id == b->driver_id) && (a->device_id == b->device_id);
+}
+
+/// Writes `samples[0,n)` to the channel.
+static void
+publish(struct video_stage_s* self,
+        const struct StageAxisPositionSample* samples,
+        size_t n)
+{
+    while (n) {
+        size_t count = n;
+        uint8_t* const beg =
+          channel_write_map_batch(&self->samples, sizeof(*samples), &count);
+        if (!beg)
+            return;
+        memcpy(beg, samples, count * sizeof(*samples)); // NOLINT
+        channel_write_unmap_batch(&self->samples, count);
+        store_relaxed(&self->samples_written, self->samples_written + count);
+        samples += count;
+        n -= count;
+    }
+}
+
+static int
+video_stage_thread(struct video_stage_s* const self)
+{
+    struct StageAxisPositionSample samples[STAGE_SAMPLES_PER_POLL];
+    thread_set_current_attributes(&self->thread_attributes);
+    while (!load_acquire(&self->is_stopping)) {
+        uint32_t n = countof(samples);
+        EXPECT(stage_axis_get_position_samples(self->axis, samples, &n) ==
+                 Device_Ok,
+               "[stream %d] STAGE: Failed to collect position samples.",
+               (int)self->stream_id);
+        publish(self, samples, n);
+        // More may be waiting when the buffer came back full.
+        if (n < countof(samples))
+            clock_sleep_ms(0, STAGE_POLL_INTERVAL_MS);
+    }
+    LOG("[stream %d] STAGE: Exiting thread", (int)self->stream_id);
+    store_release(&self->is_running, 0);
+    return 0;
+Error:
+    LOGE("[stream %d] STAGE: Exiting thread (Error)", (int)self->stream_id);
+    store_release(&self->is_running, 0);
+    return 1;
+}
+
+enum DeviceStatusCode
+video_stage_init(struct video_stage_s* self, uint8_t stream_id)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->stream_id = stream_id;
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-stage-%d",
+             (int)stream_id);
+    channel_new(&self->samples, 0);
+    channel_reader_set_lossy(&self->samples, &self->reader, 1);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_stage_thread, self);
+    return Device_Ok;
+}
+
+void
+video_stage_destroy(struct video_stage_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->axis)
+        stage_axis_close(self->axis);
+    self->axis = 0;
+    channel_release(&self->samples);
+}
+
+enum DeviceStatusCode
+video_stage_configure(struct video_stage_s* self,
+                      const struct DeviceManager* device_manager,
+                      const struct DeviceIdentifier* identifier,
+                      struct StageAxisProperties* settings)
+{
+    if (self->axis && (identifier->kind == DeviceKind_None ||
+                       !is_equal(&self->identifier, identifier))) {
+        stage_axis_close(self->axis);
+        self->axis = 0;
+    }
+    self->identifier = *identifier;
+    if (identifier->kind == DeviceKind_None)
+        return Device_Ok;
+    if (!self->axis) {
+        EXPECT(self->axis = stage_axis_open(device_manager, identifier),
+               "[stream %d] STAGE: Failed to open \"%s\".",
+               (int)self->stream_id,
+               identifier->name);
+    }
+    CHECK(stage_axis_set(self->axis, settings) == Device_Ok);
+    CHECK(stage_axis_get(self->axis, settings) == Device_Ok);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_stage_get(const struct video_stage_s* self,
+                struct DeviceIdentifier* identifier,
+                struct StageAxisProperties* settings)
+{
+    *identifier = self->identifier;
+    return self->axis ? stage_axis_get(self->axis, settings) : Device_Ok;
+}
+
+enum DeviceStatusCode
+video_stage_start(struct video_stage_s* self)
+{
+    if (!self->axis)
+        return Device_Ok;
+    CHECK(channel_reserve(&self->samples, STAGE_CHANNEL_CAPACITY_BYTES));
+    self->samples_written = 0;
+    CHECK(stage_axis_start(self->axis) == Device_Ok);
+    {
+        // Frames may arrive before the first sample does. They're tagged
+        // from where the axis was as it started.
+        struct StageAxisProperties settings = { 0 };
+        self->has_last = stage_axis_get(self->axis, &settings) == Device_Ok;
+        self->last = (struct StageAxisPositionSample){
+            .timestamp = clock_tic(0),
+            .position = settings.immediate.position,
+            .velocity = settings.immediate.velocity,
+        };
+    }
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    if (!parked_thread_run(&self->thread)) {
+        store_release(&self->is_running, 0);
+        stage_axis_stop(self->axis);
+        goto Error;
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_stage_stop(struct video_stage_s* self)
+{
+    if (!self->axis)
+        return;
+    store_release(&self->is_stopping, 1);
+    parked_thread_wait(&self->thread);
+    stage_axis_stop(self->axis);
+}
+
+static double
+seconds_between(uint64_t earlier, uint64_t later)
+{
+    return 1e-9 * (double)clock_tics_to_ns((int64_t)(later - earlier));
+}
+
+void
+video_stage_tag_frame(struct video_stage_s* self, struct VideoFrame* frame)
+{
+    if (!self->axis)
+        return;
+    const uint64_t t = frame->timestamps.acq_thread;
+    const struct slice s = channel_read_map(&self->samples, &self->reader);
+    const struct StageAxisPositionSample* const beg =
+      (const struct StageAxisPositionSample*)s.beg;
+    const struct StageAxisPositionSample* const end =
+      (const struct StageAxisPositionSample*)s.end;
+    const struct StageAxisPositionSample* cur = beg;
+    while (cur < end && cur->timestamp <= t) {
+        self->last = *cur;
+        self->has_last = 1;
+        ++cur;
+    }
+    // Only samples past the frame are kept for the next one. The rest may
+    // be overwritten once they're released.
+    const int has_next = cur < end;
+    const struct StageAxisPositionSample next =
+      has_next ? *cur : (struct StageAxisPositionSample){ 0 };
+    channel_read_unmap(
+      &self->samples, &self->reader, (const uint8_t*)cur - s.beg);
+
+    if (self->has_last && has_next) {
+        const double w = seconds_between(self->last.timestamp, t) /
+                         seconds_between(self->last.timestamp, next.timestamp);
+        frame->stage_position =
+          (float)(self->last.position +
+                  w * (double)(next.position - self->last.position));
+    } else if (self->has_last || has_next) {
+        // Carried on from the nearest sample at its velocity.
+        const struct StageAxisPositionSample* const nearest =
+          self->has_last ? &self->last : &next;
+        const double dt = (t >= nearest->timestamp)
+                            ? seconds_between(nearest->timestamp, t)
+                            : -seconds_between(t, nearest->timestamp);
+        frame->stage_position =
+          (float)(nearest->position + dt * (double)nearest->velocity);
+    } else {
+        return;
+    }
+    frame->has_stage_position = 1;
+}
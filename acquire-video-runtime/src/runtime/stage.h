@@ -0,0 +1,93 @@
+#ifndef H_ACQUIRE_RUNTIME_VIDEO_STAGE_V0
+#define H_ACQUIRE_RUNTIME_VIDEO_STAGE_V0
+
+#include "device/props/device.h"
+#include "device/props/components.h"
+#include "device/hal/device.manager.h"
+#include "device/hal/experimental/stage.axis.h"
+#include "platform.h"
+#include "runtime/channel.h"
+#include "runtime/parked_thread.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Streams the position samples of a stage axis into a channel of their
+    /// own while a video stream runs, so the source can tag each frame with
+    /// where the stage was when it was acquired.
+    struct video_stage_s
+    {
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
+
+        uint8_t stream_id;
+
+        /// NULL when the stream has no stage axis.
+        struct StageAxis* axis;
+        struct DeviceIdentifier identifier;
+
+        /// Runs the controller once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
+
+        /// One `StageAxisPositionSample` per write. Its reader is lossy, so
+        /// the axis never waits on frames.
+        struct channel samples;
+
+        /// Only touched by the thread tagging frames. `last` is the newest
+        /// sample read that's no later than the last frame tagged.
+        struct channel_reader reader;
+        struct StageAxisPositionSample last;
+        uint8_t has_last;
+
+        /// Samples written to `samples` since the stage was started. Written
+        /// by the controller thread with relaxed stores.
+        uint64_t samples_written;
+    };
+
+    enum DeviceStatusCode video_stage_init(struct video_stage_s* self,
+                                           uint8_t stream_id);
+
+    void video_stage_destroy(struct video_stage_s* self);
+
+    /// @brief Opens the stage axis named by `identifier` and applies
+    /// `settings` to it.
+    /// @details An identifier of kind `DeviceKind_None` closes any axis that
+    /// was open, so the stream has none.
+    enum DeviceStatusCode video_stage_configure(
+      struct video_stage_s* self,
+      const struct DeviceManager* device_manager,
+      const struct DeviceIdentifier* identifier,
+      struct StageAxisProperties* settings);
+
+    /// @brief Query the stage's device and its settings. Settings are only
+    /// updated while an axis is open.
+    enum DeviceStatusCode video_stage_get(const struct video_stage_s* self,
+                                          struct DeviceIdentifier* identifier,
+                                          struct StageAxisProperties* settings);
+
+    /// @brief Starts the axis and the thread collecting its samples. Does
+    /// nothing when the stream has no axis.
+    enum DeviceStatusCode video_stage_start(struct video_stage_s* self);
+
+    /// @brief Stops collecting samples and stops the axis.
+    void video_stage_stop(struct video_stage_s* self);
+
+    /// @brief Sets `frame`'s stage position from the samples collected so far.
+    /// @details Frames must be passed in the order they were acquired. Only
+    /// call this from the thread writing frames.
+    void video_stage_tag_frame(struct video_stage_s* self,
+                               struct VideoFrame* frame);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_RUNTIME_VIDEO_STAGE_V0
@@ -0,0 +1,551 @@
+#include "stages.h"
+#include "bin2.h"
+#include "convert.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+// Samples are converted through a float buffer this long.
+#define CHUNK_SAMPLES (1024)
+
+// Frames are treated as a single plane of `strides.planes` samples, as in the
+// rest of the runtime.
+static size_t
+samples_of(const struct ImageShape* shape)
+{
+    return (size_t)shape->strides.planes;
+}
+
+/// Pixels are stored with their channels next to each other, and rows of
+/// pixels are packed, though rows may be padded.
+static int
+is_packed(const struct ImageShape* shape)
+{
+    return shape->strides.channels == 1 &&
+           shape->strides.width == shape->dims.channels;
+}
+
+void
+filter_stage_make_shape(struct ImageShape* shape,
+                        enum SampleType type,
+                        uint32_t channels,
+                        uint32_t width,
+                        uint32_t height,
+                        uint32_t planes)
+{
+    *shape = (struct ImageShape){
+        .dims = {
+          .channels = channels,
+          .width = width,
+          .height = height,
+          .planes = planes,
+        },
+        .strides = {
+          .channels = 1,
+          .width = channels,
+          .height = (int64_t)channels * width,
+          .planes = (int64_t)channels * width * height,
+        },
+        .type = type,
+    };
+}
+
+int
+filter_stage_params_check(const struct filter_stage_params* params)
+{
+    switch (params->kind) {
+        case FilterStage_Average:
+            EXPECT(params->frame_count > 0 ||
+                     params->average_mode == FilterAverage_Exponential,
+                   "Averaging needs a frame count of at least 1.");
+            EXPECT(params->average_mode < FilterAverageModeCount,
+                   "Unknown averaging mode %d.",
+                   (int)params->average_mode);
+            EXPECT(params->average_output < FilterAverageOutputCount,
+                   "Unknown averaging output %d.",
+                   (int)params->average_output);
+            EXPECT(params->average_mode == FilterAverage_Block ||
+                     params->average_output == FilterAverageOutput_Float,
+                   "Running averages only emit f32. Add a cast stage to "
+                   "convert them.");
+            EXPECT(params->average_mode != FilterAverage_Exponential ||
+                     (params->alpha > 0.0f && params->alpha <= 1.0f),
+                   "An exponential average needs an alpha in (0,1]. Got %f.",
+                   (double)params->alpha);
+            break;
+        case FilterStage_Project:
+            EXPECT(params->frame_count > 0,
+                   "Projections need a frame count of at least 1.");
+            EXPECT(params->projection < FilterProjectionCount,
+                   "Unknown projection %d.",
+                   (int)params->projection);
+            break;
+        case FilterStage_Crop:
+            EXPECT(params->roi.width > 0 && params->roi.height > 0,
+                   "Can't crop to an empty region (%ux%u).",
+                   params->roi.width,
+                   params->roi.height);
+            break;
+        case FilterStage_Bin:
+            EXPECT(params->binning > 0, "Binning must be at least 1.");
+            break;
+        case FilterStage_FlatField:
+        case FilterStage_Pack:
+            break;
+        case FilterStage_Compress:
+            EXPECT(params->compression > FrameCompression_None &&
+                     params->compression < FrameCompressionCount,
+                   "Unknown frame compression %d.",
+                   (int)params->compression);
+            break;
+        case FilterStage_Cast:
+            EXPECT(params->sample_type < SampleTypeCount &&
+                     sample_type_unpacked(params->sample_type) ==
+                       params->sample_type,
+                   "Can't cast to sample type %d.",
+                   (int)params->sample_type);
+            break;
+        default:
+            EXPECT(0, "Unknown filter stage %d.", (int)params->kind);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+//
+//      CROP
+//
+
+static void
+crop_bounds(const struct filter_stage* self,
+            const struct ImageShape* in,
+            uint32_t* x0,
+            uint32_t* y0,
+            uint32_t* x1,
+            uint32_t* y1)
+{
+    const uint32_t w = in->dims.width, h = in->dims.height;
+    *x0 = min(self->params.roi.x, w);
+    *y0 = min(self->params.roi.y, h);
+    *x1 = *x0 + min(self->params.roi.width, w - *x0);
+    *y1 = *y0 + min(self->params.roi.height, h - *y0);
+}
+
+static int
+crop_shape(const struct filter_stage* self,
+           const struct ImageShape* in,
+           struct ImageShape* out)
+{
+    uint32_t x0, y0, x1, y1;
+    crop_bounds(self, in, &x0, &y0, &x1, &y1);
+    if (!is_packed(in) || x1 == x0 || y1 == y0)
+        return 0;
+    filter_stage_make_shape(out,
+                            in->type,
+                            in->dims.channels,
+                            x1 - x0,
+                            y1 - y0,
+                            in->dims.planes);
+    return 1;
+}
+
+static enum FilterStageResult
+crop_process(struct filter_stage* self,
+             const struct VideoFrame* in,
+             struct VideoFrame* out,
+             int is_first)
+{
+    (void)is_first;
+    uint32_t x0, y0, x1, y1;
+    crop_bounds(self, &in->shape, &x0, &y0, &x1, &y1);
+    const size_t bps = bytes_of_type(in->shape.type);
+    const size_t bytes_of_row =
+      (size_t)out->shape.strides.height * bytes_of_type(out->shape.type);
+    for (uint32_t y = y0; y < y1; ++y) {
+        const uint8_t* src =
+          in->data + bps * (y * in->shape.strides.height +
+                            x0 * in->shape.strides.width);
+        memcpy(out->data + (y - y0) * bytes_of_row, src, bytes_of_row);
+    }
+    return FilterStage_Emit;
+}
+
+const struct filter_stage_ops filter_stage_crop = {
+    .name = "crop",
+    .shape = crop_shape,
+    .process = crop_process,
+};
+
+//
+//      BIN
+//
+
+static int
+bin_shape(const struct filter_stage* self,
+          const struct ImageShape* in,
+          struct ImageShape* out)
+{
+    const uint32_t b = self->params.binning;
+    if (!is_packed(in) || !b || in->dims.width < b || in->dims.height < b)
+        return 0;
+    filter_stage_make_shape(out,
+                            in->type,
+                            in->dims.channels,
+                            in->dims.width / b,
+                            in->dims.height / b,
+                            in->dims.planes);
+    return 1;
+}
+
+/// Rounds half away from zero.
+static int64_t
+div_round(int64_t sum, int64_t n)
+{
+    return sum >= 0 ? (sum + n / 2) / n : -((-sum + n / 2) / n);
+}
+
+/// Averages each `b` by `b` block of pixels in `in` into a pixel of `out`,
+/// accumulating with type `ACC`. Leftover rows and columns are dropped.
+#define BIN(T, ACC, AVERAGE)                                                   \
+    do {                                                                       \
+        const T* src = (const T*)in->data;                                     \
+        T* dst = (T*)out->data;                                                \
+        for (uint32_t y = 0; y < out->shape.dims.height; ++y) {                \
+            for (uint32_t x = 0; x < out->shape.dims.width; ++x) {             \
+                for (uint32_t c = 0; c < channels; ++c) {                      \
+                    ACC sum = 0;                                               \
+                    for (uint32_t dy = 0; dy < b; ++dy) {                      \
+                        const T* row = src + (y * b + dy) * sy +               \
+                                       (int64_t)x * b * sx + c;                \
+                        for (uint32_t dx = 0; dx < b; ++dx)                    \
+                            sum += row[dx * sx];                               \
+                    }                                                          \
+                    dst[y * out->shape.strides.height +                        \
+                        x * out->shape.strides.width + c] =                    \
+                      (T)(AVERAGE);                                            \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+static enum FilterStageResult
+bin_process(struct filter_stage* self,
+            const struct VideoFrame* in,
+            struct VideoFrame* out,
+            int is_first)
+{
+    (void)is_first;
+    const uint32_t b = self->params.binning;
+    const uint32_t channels = in->shape.dims.channels;
+    const int64_t sx = in->shape.strides.width, sy = in->shape.strides.height;
+    const int64_t n = (int64_t)b * b;
+    // The shared 2x2 kernels are vectorized, and round the same way.
+    if (b == 2 && bin2(in->shape.type,
+                       out->data,
+                       out->shape.strides.height,
+                       in->data,
+                       sy,
+                       out->shape.dims.width,
+                       out->shape.dims.height,
+                       channels))
+        return FilterStage_Emit;
+    switch (in->shape.type) {
+        case SampleType_u8:
+            BIN(uint8_t, int64_t, div_round(sum, n));
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            BIN(uint16_t, int64_t, div_round(sum, n));
+            break;
+        case SampleType_i8:
+            BIN(int8_t, int64_t, div_round(sum, n));
+            break;
+        case SampleType_i16:
+            BIN(int16_t, int64_t, div_round(sum, n));
+            break;
+        case SampleType_f32:
+            BIN(float, float, sum / (float)n);
+            break;
+        case SampleType_u32:
+            BIN(uint32_t, int64_t, div_round(sum, n));
+            break;
+        default:
+            return FilterStage_Error;
+    }
+    return FilterStage_Emit;
+}
+
+#undef BIN
+
+const struct filter_stage_ops filter_stage_bin = {
+    .name = "bin",
+    .shape = bin_shape,
+    .process = bin_process,
+};
+
+//
+//      FLAT FIELD
+//
+
+static int
+flat_field_shape(const struct filter_stage* self,
+                 const struct ImageShape* in,
+                 struct ImageShape* out)
+{
+    const struct flat_field* ff = self->ctx->flat_field;
+    if (ff && (ff->dark || ff->gain) &&
+        (ff->channels != in->dims.channels || ff->width != in->dims.width ||
+         ff->height != in->dims.height || !is_packed(in) ||
+         in->strides.height != (int64_t)in->dims.channels * in->dims.width))
+        return 0;
+    filter_stage_make_shape(out,
+                            SampleType_f32,
+                            in->dims.channels,
+                            in->dims.width,
+                            in->dims.height,
+                            in->dims.planes);
+    return 1;
+}
+
+static enum FilterStageResult
+flat_field_process(struct filter_stage* self,
+                   const struct VideoFrame* in,
+                   struct VideoFrame* out,
+                   int is_first)
+{
+    (void)is_first;
+    const struct flat_field* ff = self->ctx->flat_field;
+    const float* dark = ff ? ff->dark : 0;
+    const float* gain = ff ? ff->gain : 0;
+    const size_t bps = bytes_of_type(in->shape.type);
+    const size_t n = samples_of(&in->shape);
+    float* x = (float*)out->data;
+    for (size_t beg = 0; beg < n; beg += CHUNK_SAMPLES) {
+        const size_t m = min(n - beg, (size_t)CHUNK_SAMPLES);
+        convert_to_f32(x + beg, in->shape.type, in->data + beg * bps, m);
+        if (dark)
+            for (size_t i = beg; i < beg + m; ++i)
+                x[i] -= dark[i];
+        if (gain)
+            for (size_t i = beg; i < beg + m; ++i)
+                x[i] *= gain[i];
+    }
+    return FilterStage_Emit;
+}
+
+const struct filter_stage_ops filter_stage_flat_field = {
+    .name = "flat field",
+    .shape = flat_field_shape,
+    .process = flat_field_process,
+};
+
+//
+//      CAST
+//
+
+static int
+cast_shape(const struct filter_stage* self,
+           const struct ImageShape* in,
+           struct ImageShape* out)
+{
+    if (!is_packed(in) ||
+        in->strides.height != (int64_t)in->dims.channels * in->dims.width)
+        return 0;
+    filter_stage_make_shape(out,
+                            self->params.sample_type,
+                            in->dims.channels,
+                            in->dims.width,
+                            in->dims.height,
+                            in->dims.planes);
+    return 1;
+}
+
+static enum FilterStageResult
+cast_process(struct filter_stage* self,
+             const struct VideoFrame* in,
+             struct VideoFrame* out,
+             int is_first)
+{
+    (void)self;
+    (void)is_first;
+    const enum SampleType from = in->shape.type, to = out->shape.type;
+    const size_t n = samples_of(&in->shape);
+    if (from == to) {
+        memcpy(out->data, in->data, n * bytes_of_type(from));
+        return FilterStage_Emit;
+    }
+    float buf[CHUNK_SAMPLES];
+    const size_t bytes_in = bytes_of_type(from), bytes_out = bytes_of_type(to);
+    for (size_t beg = 0; beg < n; beg += CHUNK_SAMPLES) {
+        const size_t m = min(n - beg, (size_t)CHUNK_SAMPLES);
+        convert_to_f32(buf, from, in->data + beg * bytes_in, m);
+        convert_from_f32(out->data + beg * bytes_out, to, buf, m);
+    }
+    return FilterStage_Emit;
+}
+
+const struct filter_stage_ops filter_stage_cast = {
+    .name = "cast",
+    .shape = cast_shape,
+    .process = cast_process,
+};
+
+#ifndef NO_UNIT_TESTS
+
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// A frame big enough for the small images used below.
+struct stage_test_frame
+{
+    struct VideoFrame frame;
+    uint8_t data[4 * 8 * 8];
+};
+
+static void
+make_test_frame(struct stage_test_frame* f,
+                enum SampleType type,
+                uint32_t width,
+                uint32_t height)
+{
+    memset(f, 0, sizeof(*f));
+    filter_stage_make_shape(&f->frame.shape, type, 1, width, height, 1);
+    f->frame.bytes_of_frame = sizeof(*f);
+}
+
+/// Crop, bin, flat-field correction and casts each produce the expected
+/// pixels and shapes.
+int
+unit_test__filter_stages_transform_pixels()
+{
+    static struct stage_test_frame in, out;
+    const struct filter_stage_context ctx = { 0 };
+    struct filter_stage stage = { .ctx = &ctx };
+    struct ImageShape shape;
+
+    // 4x4 u8 image whose pixel at (x,y) is 10*y + x.
+    make_test_frame(&in, SampleType_u8, 4, 4);
+    for (int i = 0; i < 16; ++i)
+        in.frame.data[i] = (uint8_t)(10 * (i / 4) + i % 4);
+
+    // Crop is clipped to the image.
+    stage.ops = &filter_stage_crop;
+    stage.params = (struct filter_stage_params){
+        .kind = FilterStage_Crop,
+        .roi = { .x = 1, .y = 2, .width = 10, .height = 1 },
+    };
+    CHECK(stage.ops->shape(&stage, &in.frame.shape, &shape));
+    CHECK(shape.dims.width == 3 && shape.dims.height == 1);
+    make_test_frame(&out, shape.type, 3, 1);
+    CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+          FilterStage_Emit);
+    CHECK(out.frame.data[0] == 21 && out.frame.data[2] == 23);
+    stage.params.roi.x = 4;
+    CHECK(!stage.ops->shape(&stage, &in.frame.shape, &shape));
+
+    // 2x2 binning rounds to the nearest.
+    stage.ops = &filter_stage_bin;
+    stage.params = (struct filter_stage_params){ .kind = FilterStage_Bin,
+                                                 .binning = 2 };
+    CHECK(stage.ops->shape(&stage, &in.frame.shape, &shape));
+    CHECK(shape.dims.width == 2 && shape.dims.height == 2);
+    make_test_frame(&out, shape.type, 2, 2);
+    CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+          FilterStage_Emit);
+    // (0 + 1 + 10 + 11) / 4 = 5.5
+    CHECK(out.frame.data[0] == 6);
+    // (22 + 23 + 32 + 33) / 4 = 27.5
+    CHECK(out.frame.data[3] == 28);
+
+    // Flat-field correction without calibration just converts to f32.
+    stage.ops = &filter_stage_flat_field;
+    stage.params = (struct filter_stage_params){ .kind =
+                                                   FilterStage_FlatField };
+    CHECK(stage.ops->shape(&stage, &in.frame.shape, &shape));
+    CHECK(shape.type == SampleType_f32);
+    make_test_frame(&out, shape.type, 4, 4);
+    CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+          FilterStage_Emit);
+    CHECK(((float*)out.frame.data)[15] == 33.0f);
+
+    // With calibration.
+    {
+        float dark[16], gain[16];
+        for (int i = 0; i < 16; ++i) {
+            dark[i] = 1.0f;
+            gain[i] = 0.5f;
+        }
+        const struct flat_field ff = {
+            .dark = dark, .gain = gain, .channels = 1, .width = 4, .height = 4
+        };
+        const struct filter_stage_context with_ff = { .flat_field = &ff };
+        stage.ctx = &with_ff;
+        CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+              FilterStage_Emit);
+        CHECK(((float*)out.frame.data)[15] == 16.0f);
+
+        // Calibration for another shape is rejected.
+        const struct flat_field wrong = {
+            .gain = gain, .channels = 1, .width = 2, .height = 8
+        };
+        const struct filter_stage_context with_wrong = { .flat_field = &wrong };
+        stage.ctx = &with_wrong;
+        CHECK(!stage.ops->shape(&stage, &in.frame.shape, &shape));
+        stage.ctx = &ctx;
+    }
+
+    // Casts round and saturate.
+    {
+        const float values[] = { -3.6f, 0.4f, 0.5f, 300.0f };
+        make_test_frame(&in, SampleType_f32, 4, 1);
+        memcpy(in.frame.data, values, sizeof(values));
+        stage.ops = &filter_stage_cast;
+        stage.params = (struct filter_stage_params){
+            .kind = FilterStage_Cast,
+            .sample_type = SampleType_u8,
+        };
+        CHECK(stage.ops->shape(&stage, &in.frame.shape, &shape));
+        CHECK(shape.type == SampleType_u8);
+        make_test_frame(&out, shape.type, 4, 1);
+        CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+              FilterStage_Emit);
+        CHECK(out.frame.data[0] == 0 && out.frame.data[1] == 0);
+        CHECK(out.frame.data[2] == 1 && out.frame.data[3] == 255);
+
+        stage.params.sample_type = SampleType_i8;
+        make_test_frame(&out, SampleType_i8, 4, 1);
+        CHECK(stage.ops->process(&stage, &in.frame, &out.frame, 1) ==
+              FilterStage_Emit);
+        CHECK((int8_t)out.frame.data[0] == -4);
+        CHECK((int8_t)out.frame.data[3] == 127);
+    }
+
+    // Bad parameters are rejected up front.
+    {
+        struct filter_stage_params p = { .kind = FilterStage_Bin };
+        CHECK(!filter_stage_params_check(&p));
+        p = (struct filter_stage_params){ .kind = FilterStage_Cast,
+                                          .sample_type = SampleTypeCount };
+        CHECK(!filter_stage_params_check(&p));
+        p = (struct filter_stage_params){ .kind = FilterStageKindCount };
+        CHECK(!filter_stage_params_check(&p));
+    }
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,206 @@
+//! Steps the filter thread applies to frames on their way to storage.
+//!
+//! The filter runs a chain of stages. Each stage reads a frame and writes
+//! into an output frame the chain hands it: a scratch buffer, or the sink's
+//! channel for the last stage. Most stages write one output per input.
+//! Averaging keeps writing into the same output until its window is full.
+//!
+//! Every stage follows the same contract:
+//! - `shape()` says what the stage writes for input of a given shape, or
+//!   rejects the input.
+//! - `process()` reads one input into the current output and returns
+//!   `FilterStage_Emit` once the output is complete.
+//! - `reset()`, when present, drops whatever a stage keeps between outputs.
+
+#ifndef H_ACQUIRE_STAGES_V0
+#define H_ACQUIRE_STAGES_V0
+
+#include "device/props/components.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct band_pool;
+    struct filter_kernels;
+
+    enum FilterStageKind
+    {
+        FilterStage_None = 0,
+        FilterStage_Average,
+        FilterStage_Crop,
+        FilterStage_Bin,
+        FilterStage_FlatField,
+        FilterStage_Cast,
+        FilterStage_Project,
+        FilterStage_Pack,
+        FilterStage_Compress,
+        FilterStageKindCount
+    };
+
+    enum FilterAverageMode
+    {
+        /// One output for every `frame_count` inputs.
+        FilterAverage_Block = 0,
+        /// One output per input: the mean of the last `frame_count` inputs.
+        FilterAverage_Sliding,
+        /// One output per input: `out += alpha * (in - out)`.
+        FilterAverage_Exponential,
+        FilterAverageModeCount
+    };
+
+    /// What a block average emits.
+    enum FilterAverageOutput
+    {
+        /// The mean as f32.
+        FilterAverageOutput_Float = 0,
+        /// The mean in the input's sample type, rounded to the nearest.
+        /// Integer samples are summed in 32 bits.
+        FilterAverageOutput_Native,
+        /// The sum of unsigned integer samples as u32.
+        FilterAverageOutput_Sum,
+        FilterAverageOutputCount
+    };
+
+    enum FilterProjection
+    {
+        FilterProjection_Max = 0,
+        FilterProjection_Min,
+        FilterProjection_Sum,
+        FilterProjectionCount
+    };
+
+    struct filter_stage_params
+    {
+        enum FilterStageKind kind;
+
+        /// Average and Project: number of frames in each output.
+        uint32_t frame_count;
+        enum FilterAverageMode average_mode;
+        /// Average: only block averages emit anything but f32.
+        enum FilterAverageOutput average_output;
+        /// Average: weight of each new frame in an exponential average, in
+        /// (0,1].
+        float alpha;
+
+        /// Crop: region to keep, in pixels. Clipped to the frame.
+        struct
+        {
+            uint32_t x, y, width, height;
+        } roi;
+
+        /// Bin: width and height of the blocks of pixels averaged together.
+        uint32_t binning;
+
+        /// Project: how each pixel of `frame_count` frames is combined. Max
+        /// and Min keep the input's sample type. Sum emits u32 for unsigned
+        /// integer samples and f32 otherwise.
+        enum FilterProjection projection;
+
+        /// Cast: type to convert samples to. Values are rounded to the
+        /// nearest and clamped to the range of the type. Packed types are
+        /// made by a Pack stage instead.
+        enum SampleType sample_type;
+
+        /// Compress: the codec. Only the last stage can compress.
+        enum FrameCompression compression;
+    };
+
+    /// Per-pixel images for flat-field correction, which computes
+    /// `(in - dark) * gain`. The gain is typically
+    /// `mean(flat - dark) / (flat - dark)`.
+    struct flat_field
+    {
+        /// One value per sample of a plane, in frame order. Either may be 0,
+        /// in which case the dark level is 0 or the gain is 1.
+        float* dark;
+        float* gain;
+        uint32_t channels, width, height;
+    };
+
+    /// What the stages of one filter share.
+    struct filter_stage_context
+    {
+        const struct filter_kernels* kernels;
+        struct band_pool* pool;
+        const struct flat_field* flat_field;
+    };
+
+    enum FilterStageResult
+    {
+        /// The output needs more input.
+        FilterStage_Pending = 0,
+        /// The output is complete.
+        FilterStage_Emit,
+        FilterStage_Error
+    };
+
+    struct filter_stage;
+
+    struct filter_stage_ops
+    {
+        const char* name;
+
+        /// @brief Computes the shape of the frames the stage writes for input
+        /// of shape `in`.
+        /// @returns 1 on success, or 0 if the stage can't process `in`.
+        int (*shape)(const struct filter_stage* self,
+                     const struct ImageShape* in,
+                     struct ImageShape* out);
+
+        /// @brief Reads `in` into `out`.
+        /// @details `out` has the shape returned by `shape()` and its header
+        /// is filled in. It stays the same across calls until the stage
+        /// returns `FilterStage_Emit` or is reset. `is_first` is set on the
+        /// first call for a new `out`.
+        enum FilterStageResult (*process)(struct filter_stage* self,
+                                          const struct VideoFrame* in,
+                                          struct VideoFrame* out,
+                                          int is_first);
+
+        /// @brief Optional. Frees `state` and starts over, as when the input
+        /// shape or the chain changes.
+        void (*reset)(struct filter_stage* self);
+    };
+
+    struct filter_stage
+    {
+        const struct filter_stage_ops* ops;
+        struct filter_stage_params params;
+        const struct filter_stage_context* ctx;
+
+        /// Inputs read into the current output.
+        uint32_t count;
+
+        /// Buffers a stage keeps across outputs, allocated with
+        /// memory_alloc(). Freed by `reset()`.
+        void* state;
+        size_t bytes_of_state;
+    };
+
+    extern const struct filter_stage_ops filter_stage_crop;
+    extern const struct filter_stage_ops filter_stage_bin;
+    extern const struct filter_stage_ops filter_stage_flat_field;
+    extern const struct filter_stage_ops filter_stage_cast;
+
+    /// @brief Checks that `params` describe a stage that can be built.
+    /// @returns 1 if so, otherwise 0 after logging the problem.
+    int filter_stage_params_check(const struct filter_stage_params* params);
+
+    /// @brief Fills in `shape` for a densely packed image.
+    void filter_stage_make_shape(struct ImageShape* shape,
+                                 enum SampleType type,
+                                 uint32_t channels,
+                                 uint32_t width,
+                                 uint32_t height,
+                                 uint32_t planes);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_STAGES_V0
@@ -0,0 +1,207 @@
+#include "tee.h"
+#include "logger.h"
+#include "platform.h"
+
+#include <stdio.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define containerof(ptr, T, V) ((T*)(((char*)(ptr)) - offsetof(T, V)))
+#define countof(e) (sizeof(e) / sizeof(*(e)))
+
+/// Called from the output's sink thread, before it lets go of what it has
+/// mapped.
+static void
+sig_output_stop_source(const struct video_sink_s* sink)
+{
+    struct video_tee_output* const output =
+      containerof(sink, struct video_tee_output, sink);
+    // The failed sink won't read on, so it mustn't hold back the queue.
+    channel_reader_detach(output->tee->in, &output->sink.reader);
+    output->tee->sig_stop_source(output->tee);
+}
+
+enum DeviceStatusCode
+video_tee_init(struct video_tee_s* self,
+               uint8_t stream_id,
+               struct channel* in,
+               void (*sig_stop_source)(const struct video_tee_s*))
+{
+    CHECK(in);
+    *self = (struct video_tee_s){ .stream_id = stream_id,
+                                  .in = in,
+                                  .sig_stop_source = sig_stop_source };
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_tee_output* const output = self->outputs + i;
+        output->tee = self;
+        CHECK(video_sink_init(&output->sink,
+                              stream_id,
+                              0,
+                              sig_output_stop_source) == Device_Ok);
+        video_sink_read_from(&output->sink, in);
+        snprintf(output->sink.thread_attributes.name,
+                 sizeof(output->sink.thread_attributes.name),
+                 "acq-tee-%d.%u",
+                 (int)stream_id,
+                 i);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_tee_destroy(struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        video_sink_destroy(&self->outputs[i].sink);
+}
+
+enum DeviceStatusCode
+video_tee_configure(struct video_tee_s* self,
+                    uint32_t i,
+                    const struct DeviceManager* device_manager,
+                    struct DeviceIdentifier* identifier,
+                    struct StorageProperties* settings)
+{
+    CHECK(i < countof(self->outputs));
+    struct video_tee_output* const output = self->outputs + i;
+    output->is_enabled = 0;
+    if (identifier->kind == DeviceKind_None) {
+        if (output->sink.storage) {
+            storage_close(output->sink.storage);
+            output->sink.storage = 0;
+            output->sink.has_applied_settings = 0;
+        }
+        return Device_Ok;
+    }
+
+    const struct video_sink_coalescing coalescing = { 0 };
+    EXPECT(video_sink_configure(&output->sink,
+                                device_manager,
+                                identifier,
+                                settings,
+                                0.0f,
+                                1,
+                                &coalescing,
+                                0) == Device_Ok,
+           "[stream %d] TEE: Failed to configure storage device %u.",
+           self->stream_id,
+           i);
+    output->is_enabled = 1;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+int
+video_tee_reserve_image_shape(struct video_tee_s* self,
+                              const struct ImageShape* shape)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        if (self->outputs[i].is_enabled)
+            CHECK(Device_Ok == storage_reserve_image_shape(
+                                 self->outputs[i].sink.storage, shape));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+size_t
+video_tee_frame_alignment_bytes(const struct video_tee_s* self)
+{
+    // Alignments are powers of two, so the largest is a multiple of the rest.
+    size_t out = 0;
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        const struct video_tee_output* const output = self->outputs + i;
+        if (output->is_enabled &&
+            output->sink.meta.io_alignment_bytes > out)
+            out = output->sink.meta.io_alignment_bytes;
+    }
+    return out;
+}
+
+int
+video_tee_takes_compressed_frames(const struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        const struct video_tee_output* const output = self->outputs + i;
+        if (output->is_enabled &&
+            !output->sink.meta.compressed_frames_are_supported)
+            return 0;
+    }
+    return 1;
+}
+
+int
+video_tee_is_enabled(const struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        if (self->outputs[i].is_enabled)
+            return 1;
+    }
+    return 0;
+}
+
+int
+video_tee_is_running(const struct video_tee_s* self)
+{
+    int is_running = 0;
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        is_running |= load_acquire(&self->outputs[i].sink.is_running);
+    return is_running;
+}
+
+enum DeviceStatusCode
+video_tee_start(struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_sink_s* const sink = &self->outputs[i].sink;
+        if (self->outputs[i].is_enabled) {
+            CHECK(video_sink_start(sink) == Device_Ok);
+        } else {
+            // Otherwise, the reader left over from an earlier acquisition
+            // would hold the stream back.
+            channel_reader_detach(self->in, &sink->reader);
+        }
+    }
+    return Device_Ok;
+Error:
+    // Sinks that did start would wait for frames forever.
+    video_tee_sig_stop(self);
+    channel_wake_readers(self->in);
+    return Device_Err;
+}
+
+void
+video_tee_sig_stop(struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i) {
+        struct video_sink_s* const sink = &self->outputs[i].sink;
+        if (load_acquire(&sink->is_running))
+            store_release(&sink->is_stopping, 1);
+    }
+}
+
+void
+video_tee_discard(struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        video_sink_discard(&self->outputs[i].sink);
+}
+
+void
+video_tee_wait(struct video_tee_s* self)
+{
+    for (uint32_t i = 0; i < countof(self->outputs); ++i)
+        parked_thread_wait(&self->outputs[i].sink.thread);
+}
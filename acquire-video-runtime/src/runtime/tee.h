@@ -0,0 +1,110 @@
+//! Stores a stream's frames with more than one storage device.
+//!
+//! Each output is a sink of its own, with its own storage device, that reads
+//! the stream's queue to storage alongside the stream's sink. Frames aren't
+//! copied: every sink appends them straight from the queue, and the queue
+//! only reuses a frame's bytes once every sink has appended it. So the
+//! slowest device holds back the camera, as the stream's own does.
+
+#ifndef H_ACQUIRE_TEE_V0
+#define H_ACQUIRE_TEE_V0
+
+#include "channel.h"
+#include "sink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Most storage devices one stream can store to besides its own.
+#define TEE_MAX_OUTPUTS (3)
+
+    struct video_tee_s;
+
+    /// One more storage device, and the sink appending to it.
+    struct video_tee_output
+    {
+        /// Set when the output has a storage device.
+        uint8_t is_enabled;
+
+        /// Reads the stream's queue. See video_sink_read_from().
+        struct video_sink_s sink;
+
+        struct video_tee_s* tee;
+    };
+
+    /// The outputs of a stream that store every frame again.
+    struct video_tee_s
+    {
+        uint8_t stream_id;
+
+        /// The stream's queue to storage. Not owned.
+        struct channel* in;
+
+        struct video_tee_output outputs[TEE_MAX_OUTPUTS];
+
+        /// Called when an output's sink fails, so the stream stops.
+        void (*sig_stop_source)(const struct video_tee_s*);
+    };
+
+    enum DeviceStatusCode video_tee_init(
+      struct video_tee_s* self,
+      uint8_t stream_id,
+      struct channel* in,
+      void (*sig_stop_source)(const struct video_tee_s*));
+
+    void video_tee_destroy(struct video_tee_s* self);
+
+    /// @brief Sets the `i`th output to store frames with the storage device
+    /// `identifier`.
+    /// @details A `DeviceKind_None` device turns the output off, and closes
+    /// its storage device. Only call this while the outputs aren't running.
+    enum DeviceStatusCode video_tee_configure(
+      struct video_tee_s* self,
+      uint32_t i,
+      const struct DeviceManager* device_manager,
+      struct DeviceIdentifier* identifier,
+      struct StorageProperties* settings);
+
+    /// @brief Tells each output's storage the shape of the frames.
+    /// @returns 1 on success, otherwise 0.
+    int video_tee_reserve_image_shape(struct video_tee_s* self,
+                                      const struct ImageShape* shape);
+
+    /// @returns The largest `io_alignment_bytes` of the outputs' storage, or
+    /// 0 when no output is enabled. Frames in the stream's queue have to be
+    /// aligned for every device appending them.
+    size_t video_tee_frame_alignment_bytes(const struct video_tee_s* self);
+
+    /// @returns 1 if every enabled output's storage takes compressed frames.
+    int video_tee_takes_compressed_frames(const struct video_tee_s* self);
+
+    /// @returns 1 if any output is enabled.
+    int video_tee_is_enabled(const struct video_tee_s* self);
+
+    /// @returns 1 while any output's sink is still working on the
+    /// acquisition.
+    int video_tee_is_running(const struct video_tee_s* self);
+
+    /// @brief Starts the enabled outputs' sinks.
+    /// @details Call this after the stream's sink was started, so its queue
+    /// is empty, and before anything is written to it.
+    enum DeviceStatusCode video_tee_start(struct video_tee_s* self);
+
+    /// @brief Tells the outputs' sinks to append what's left in the queue
+    /// and stop. The caller wakes the queue's readers.
+    void video_tee_sig_stop(struct video_tee_s* self);
+
+    /// @brief Tells the outputs' sinks to stop and drop what they haven't
+    /// stored yet. See video_sink_discard().
+    void video_tee_discard(struct video_tee_s* self);
+
+    /// @brief Waits for the outputs' sinks to finish the acquisition.
+    void video_tee_wait(struct video_tee_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_TEE_V0
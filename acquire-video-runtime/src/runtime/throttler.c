@@ -1,15 +1,86 @@
 #include "throttler.h"
+#include "logger.h"
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
 
 struct throttler
-throttler_init(float seconds_per_loop)
+throttler_init(float max_sleep_ms)
 {
-    struct throttler out = { .milliseconds = 1e3f * seconds_per_loop };
-    clock_init(&out.clock);
-    return out;
+    return (struct throttler){ .max_sleep_ms = max_sleep_ms,
+                               .sleep_ms = THROTTLER_MIN_SLEEP_MS,
+                               .started = clock_tic(0) };
 }
 
 void
-throttler_wait(struct throttler* self)
+throttler_wait(struct throttler* self, size_t nbytes)
+{
+    if (nbytes) {
+        self->idle_polls = 0;
+        self->sleep_ms = THROTTLER_MIN_SLEEP_MS;
+        return;
+    }
+    if (self->idle_polls < THROTTLER_SPIN_POLLS) {
+        ++self->idle_polls;
+        for (int i = 0; i < 64; ++i)
+            cpu_relax();
+        return;
+    }
+    const uint64_t begin = clock_tic(0);
+    clock_sleep_ms(0, min(self->sleep_ms, self->max_sleep_ms));
+    self->slept_tics += clock_tic(0) - begin;
+    self->sleep_ms = min(2.0f * self->sleep_ms, self->max_sleep_ms);
+}
+
+float
+throttler_duty_cycle(const struct throttler* self)
+{
+    const uint64_t elapsed = clock_tic(0) - self->started;
+    if (!elapsed)
+        return 1.0f;
+    return 1.0f - (float)((double)min(self->slept_tics, elapsed) /
+                          (double)elapsed);
+}
+
+#ifndef NO_UNIT_TESTS
+
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// Empty polls spin first, then sleep for twice as long each time up to the
+/// cap, and a poll that finds work starts over.
+int
+unit_test__throttler_backs_off_when_idle()
 {
-    clock_sleep_ms(&self->clock, self->milliseconds);
+    struct throttler t = throttler_init(0.4f);
+    for (int i = 0; i < THROTTLER_SPIN_POLLS; ++i)
+        throttler_wait(&t, 0);
+    CHECK(t.slept_tics == 0);
+    CHECK(t.sleep_ms == THROTTLER_MIN_SLEEP_MS);
+
+    const float expected[] = { 0.1f, 0.2f, 0.4f, 0.4f };
+    for (int i = 0; i < 4; ++i) {
+        throttler_wait(&t, 0);
+        CHECK(t.sleep_ms == expected[i]);
+    }
+    CHECK(t.slept_tics > 0);
+    CHECK(throttler_duty_cycle(&t) < 1.0f);
+    CHECK(throttler_duty_cycle(&t) >= 0.0f);
+
+    throttler_wait(&t, 100);
+    CHECK(t.idle_polls == 0);
+    CHECK(t.sleep_ms == THROTTLER_MIN_SLEEP_MS);
+    const uint64_t slept = t.slept_tics;
+    throttler_wait(&t, 0);
+    CHECK(t.slept_tics == slept);
+    return 1;
+Error:
+    return 0;
 }
+#endif // NO_UNIT_TESTS
@@ -1,26 +1,65 @@
-//! Utility for ensuring each iteration of a loop takes at least `milliseconds`.
+//! Paces a loop that polls for work nothing can wake it for.
+//!
+//! While polls find work, the loop runs flat out. Once they stop, it spins
+//! for a few polls, in case more is on the way, and then sleeps, twice as
+//! long after each empty poll, up to `max_sleep_ms`. So it keeps up when data
+//! is flowing and hardly wakes up when it isn't.
 //!
 //! Example:
 //!
-//!     struct throttler throttler=throttler_init(0.1); // 100 ms
+//!     struct throttler throttler = throttler_init(2.0f); // sleep <= 2 ms
 //!     while(1) {
-//!         throttler_wait(&throttler);
+//!         size_t nbytes = poll();
+//!         throttler_wait(&throttler, nbytes);
 //!     }
 #ifndef H_ACQUIRE_THROTTLER_V0
 #define H_ACQUIRE_THROTTLER_V0
 
 #include "platform.h"
 
-struct throttler
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
 {
-    struct clock clock;
-    float milliseconds;
-};
+#endif
+
+/// Empty polls, after one that found work, before the throttler sleeps.
+#define THROTTLER_SPIN_POLLS (32)
+
+/// The first sleep after the spinning.
+#define THROTTLER_MIN_SLEEP_MS (0.05f)
+
+    struct throttler
+    {
+        /// The longest the throttler sleeps for.
+        float max_sleep_ms;
+
+        /// The next sleep. Reset when a poll finds work.
+        float sleep_ms;
+
+        /// Empty polls since the last one that found work.
+        uint32_t idle_polls;
+
+        /// clock_tic() at throttler_init(), and the tics slept since.
+        uint64_t started;
+        uint64_t slept_tics;
+    };
+
+    struct throttler throttler_init(float max_sleep_ms);
+
+    /// @brief Paces the loop, given the bytes the poll just before found.
+    /// @details Returns right away when `nbytes` isn't 0.
+    void throttler_wait(struct throttler* self, size_t nbytes);
 
-struct throttler
-throttler_init(float seconds_per_loop);
+    /// @returns The fraction of the time since throttler_init() that the
+    /// loop was awake, between 0 and 1. Near 1 means the loop rarely slept,
+    /// so data kept coming or the cap is short. Near 0 means it mostly slept.
+    float throttler_duty_cycle(const struct throttler* self);
 
-void
-throttler_wait(struct throttler* self);
+#ifdef __cplusplus
+} // extern "C"
+#endif
 
 #endif // H_ACQUIRE_THROTTLER_V0
@@ -0,0 +1,160 @@
+#include "trace.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+int
+trace_ring_reserve(struct trace_ring* self, size_t capacity)
+{
+    free(self->events);
+    *self = (struct trace_ring){ 0 };
+    if (!capacity)
+        return 1;
+    EXPECT(self->events = malloc(capacity * sizeof(struct trace_event)),
+           "Failed to allocate %llu trace events.",
+           (unsigned long long)capacity);
+    self->capacity = capacity;
+    return 1;
+Error:
+    return 0;
+}
+
+void
+trace_ring_clear(struct trace_ring* self)
+{
+    self->count = 0;
+}
+
+void
+trace_ring_record(struct trace_ring* self,
+                  const char* name,
+                  uint64_t begin,
+                  uint64_t end)
+{
+    if (!self->capacity)
+        return;
+    self->events[self->count++ % self->capacity] =
+      (struct trace_event){ .name = name, .begin = begin, .end = end };
+}
+
+/// Index of the oldest event kept, and the number kept.
+static void
+kept_events(const struct trace_ring* ring, size_t* first, size_t* n)
+{
+    *n = ring->capacity ? min(ring->count, ring->capacity) : 0;
+    *first = ring->count > ring->capacity ? ring->count % ring->capacity : 0;
+}
+
+static double
+us_since(uint64_t epoch, uint64_t tic)
+{
+    return 1e-3 * (double)clock_tics_to_ns((int64_t)(tic - epoch));
+}
+
+int
+trace_write_chrome_json(const char* path,
+                        const struct trace_thread* threads,
+                        size_t nthreads)
+{
+    FILE* fp = 0;
+    uint64_t epoch = UINT64_MAX;
+    for (size_t t = 0; t < nthreads; ++t) {
+        const struct trace_ring* ring = threads[t].ring;
+        size_t first, n;
+        kept_events(ring, &first, &n);
+        for (size_t i = 0; i < n; ++i) {
+            const size_t j = (first + i) % ring->capacity;
+            epoch = min(epoch, ring->events[j].begin);
+        }
+    }
+
+    EXPECT(fp = fopen(path, "w"), "Failed to open trace file \"%s\".", path);
+    CHECK(fprintf(fp, "{\"traceEvents\":[\n") > 0);
+    const char* sep = "";
+    for (size_t t = 0; t < nthreads; ++t) {
+        // Names come from thread attributes and don't need escaping.
+        CHECK(fprintf(fp,
+                      "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                      "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                      sep,
+                      (unsigned)t,
+                      threads[t].name ? threads[t].name : "") > 0);
+        sep = ",\n";
+        const struct trace_ring* ring = threads[t].ring;
+        size_t first, n;
+        kept_events(ring, &first, &n);
+        for (size_t i = 0; i < n; ++i) {
+            const struct trace_event* e =
+              ring->events + (first + i) % ring->capacity;
+            CHECK(fprintf(fp,
+                          "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                          "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                          sep,
+                          e->name,
+                          (unsigned)t,
+                          us_since(epoch, e->begin),
+                          us_since(e->begin, e->end)) > 0);
+        }
+    }
+    CHECK(fprintf(fp, "\n]}\n") > 0);
+    CHECK(fclose(fp) == 0);
+    return 1;
+Error:
+    if (fp)
+        fclose(fp);
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// A ring keeps its most recent events, oldest first, and one without any
+/// capacity records nothing.
+int
+unit_test__trace_ring_keeps_latest_events()
+{
+    static const char* names[] = { "a", "b", "c", "d", "e" };
+    struct trace_ring ring = { 0 };
+    size_t first, n;
+
+    trace_ring_record(&ring, "ignored", 0, 1);
+    CHECK(ring.count == 0);
+
+    CHECK(trace_ring_reserve(&ring, 3));
+    for (uint64_t i = 0; i < 5; ++i)
+        trace_ring_record(&ring, names[i], 10 * i, 10 * i + 5);
+    CHECK(ring.count == 5);
+    kept_events(&ring, &first, &n);
+    CHECK(n == 3);
+    for (size_t i = 0; i < n; ++i) {
+        const struct trace_event* e = ring.events + (first + i) % ring.capacity;
+        CHECK(e->name == names[2 + i]);
+        CHECK(e->begin == 10 * (2 + i));
+    }
+
+    trace_ring_clear(&ring);
+    kept_events(&ring, &first, &n);
+    CHECK(n == 0);
+
+    CHECK(trace_ring_reserve(&ring, 0));
+    CHECK(!ring.events && !ring.capacity);
+    return 1;
+Error:
+    trace_ring_reserve(&ring, 0);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
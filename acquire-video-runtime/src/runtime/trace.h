@@ -0,0 +1,83 @@
+//! Optional timeline of what a stream's threads spend their time on.
+//!
+//! Each thread records into its own ring of events, so recording takes no
+//! lock. The rings keep the most recent events. Once the threads are
+//! parked, the rings can be written out as a Chrome trace, which
+//! chrome://tracing and Perfetto can open.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     const uint64_t begin = clock_tic(0);
+//!     storage_append(storage, beg, end);
+//!     trace_ring_record(&ring, "storage_append", begin, clock_tic(0));
+//! ~~~
+//!
+//! Recording into a ring without any capacity does nothing, so tracing costs
+//! a branch when it's off.
+
+#ifndef H_ACQUIRE_TRACE_V0
+#define H_ACQUIRE_TRACE_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct trace_event
+    {
+        /// Must outlive the ring, for example a string literal.
+        const char* name;
+        /// clock_tic() values.
+        uint64_t begin, end;
+    };
+
+    /// Events recorded by one thread.
+    struct trace_ring
+    {
+        struct trace_event* events;
+        size_t capacity;
+        /// Number of events recorded since the ring was last cleared. Only
+        /// the last `capacity` of them are kept.
+        size_t count;
+    };
+
+    /// A ring to write out and the name of the thread that recorded it.
+    struct trace_thread
+    {
+        const char* name;
+        const struct trace_ring* ring;
+    };
+
+    /// @brief Makes room for `capacity` events, dropping any recorded.
+    /// @details A `capacity` of 0 frees the ring and turns recording off.
+    /// @returns 1 on success, otherwise 0, leaving the ring off.
+    int trace_ring_reserve(struct trace_ring* self, size_t capacity);
+
+    /// @brief Drops the recorded events.
+    void trace_ring_clear(struct trace_ring* self);
+
+    /// @brief Records a span of work called `name`.
+    /// @details Only call this from the thread that owns the ring.
+    void trace_ring_record(struct trace_ring* self,
+                           const char* name,
+                           uint64_t begin,
+                           uint64_t end);
+
+    /// @brief Writes the events of `threads` to `path` as a Chrome trace
+    /// in JSON.
+    /// @details Times are in microseconds from the earliest event. Don't
+    /// call this while any of the threads may be recording.
+    /// @returns 1 on success, otherwise 0.
+    int trace_write_chrome_json(const char* path,
+                                const struct trace_thread* threads,
+                                size_t nthreads);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_TRACE_V0
@@ -1,5 +1,8 @@
 
 #include "vfslice.h"
+#include "logger.h"
+
+#include <string.h>
 
 #define offsetby(T, P, B) ((T*)((uint8_t*)(P) + (B)))
 
@@ -27,19 +30,99 @@ vfslice_split_at_delay_ms(const struct vfslice* slice, float delay_ms)
         return *slice;
     }
 
+    struct clock now = { 0 };
+    clock_init(&now);
+    return vfslice_split_at_delay_ms_since(slice, delay_ms, &now);
+}
+
+struct vfslice
+vfslice_split_at_delay_ms_since(const struct vfslice* slice,
+                                float delay_ms,
+                                const struct clock* now)
+{
+    if (slice->beg >= slice->end) {
+        return *slice;
+    }
+
     if (delay_ms < 1.0e-3f) {
         return (struct vfslice){ .beg = slice->end, .end = slice->end };
     }
 
-    struct clock now = { 0 };
-    clock_init(&now);
-    clock_shift_ms(&now, -delay_ms);
+    struct clock cutoff = *now;
+    clock_shift_ms(&cutoff, -delay_ms);
 
     const struct VideoFrame* cur;
     for (cur = slice->beg; cur < slice->end;
          cur = offsetby(const struct VideoFrame, cur, cur->bytes_of_frame)) {
-        if (clock_cmp(&now, cur->timestamps.acq_thread) > 0)
+        if (clock_cmp(&cutoff, cur->timestamps.acq_thread) > 0)
             break;
     }
     return (struct vfslice){ .beg = cur, .end = slice->end };
 }
+
+#ifndef NO_UNIT_TESTS
+
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+#define CHECK(e)                                                               \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE("Expression evaluated as false:\n\t%s", #e);                  \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+
+/// Frames acquired before the delay are split off, up to the first recent
+/// one.
+int
+unit_test__vfslice_split_at_delay_ms()
+{
+    enum
+    {
+        nframes = 6,
+        nold = 4,
+        stride = sizeof(struct VideoFrame) + 8,
+    };
+    static uint8_t buf[nframes * stride];
+    const struct vfslice slice = {
+        .beg = (const struct VideoFrame*)buf,
+        .end = (const struct VideoFrame*)(buf + sizeof(buf)),
+    };
+    const struct VideoFrame* const first_recent =
+      (const struct VideoFrame*)(buf + nold * stride);
+
+    memset(buf, 0, sizeof(buf));
+    for (size_t i = 0; i < nframes; ++i) {
+        if (i == nold)
+            clock_sleep_ms(0, 100.0f);
+        struct VideoFrame* frame = (struct VideoFrame*)(buf + i * stride);
+        frame->bytes_of_frame = stride;
+        frame->frame_id = i;
+        frame->timestamps.acq_thread = clock_tic(0);
+    }
+    struct clock now = { 0 };
+    clock_init(&now);
+    clock_tic(&now);
+
+    CHECK(vfslice_split_at_delay_ms_since(&slice, 50.0f, &now).beg ==
+          first_recent);
+    CHECK(vfslice_split_at_delay_ms(&slice, 50.0f).beg == first_recent);
+    // Nothing is old enough.
+    CHECK(vfslice_split_at_delay_ms_since(&slice, 1e6f, &now).beg ==
+          slice.beg);
+    // No delay takes everything.
+    CHECK(vfslice_split_at_delay_ms_since(&slice, 0.0f, &now).beg ==
+          slice.end);
+    // Later on, every frame is old enough.
+    clock_shift_ms(&now, 1000.0);
+    CHECK(vfslice_split_at_delay_ms_since(&slice, 50.0f, &now).beg ==
+          slice.end);
+    {
+        const struct vfslice empty = { .beg = slice.end, .end = slice.end };
+        CHECK(vfslice_split_at_delay_ms_since(&empty, 50.0f, &now).beg ==
+              slice.end);
+    }
+    return 1;
+Error:
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -30,9 +30,23 @@ extern "C"
 
     struct vfslice_mut make_vfslice_mut(const struct slice slice);
 
+    /// @brief Splits `slice` at the first frame acquired less than
+    /// `delay_ms` ago.
+    /// @returns The frames from there to the end of `slice`.
     struct vfslice vfslice_split_at_delay_ms(const struct vfslice* slice,
                                              float delay_ms);
 
+    /// @brief Like vfslice_split_at_delay_ms(), but measures the delay from
+    /// `now`, a clock last set with clock_tic(), so a caller that already
+    /// read the time doesn't read it again.
+    /// @details Frames are in acquisition order, so the scan stops at the
+    /// first frame that is too recent. A caller that consumes the frames
+    /// before the split only ever visits each frame once, plus the first
+    /// remaining one on each call.
+    struct vfslice vfslice_split_at_delay_ms_since(const struct vfslice* slice,
+                                                   float delay_ms,
+                                                   const struct clock* now);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
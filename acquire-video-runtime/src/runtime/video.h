@@ -2,19 +2,24 @@
 #define H_ACQUIRE_VIDEO_V0
 
 #include <stdint.h>
+#include "annotations.h"
 #include "channel.h"
 #include "sink.h"
 #include "source.h"
+#include "fanout.h"
 #include "filter.h"
+#include "intensity.h"
+#include "preview.h"
+#include "monitor.h"
+#include "stage.h"
+#include "tee.h"
+#include "waveform.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
-    struct video_monitor_s
-    {
-        struct channel_reader reader;
-    };
+    struct AcquireMonitorReader;
 
     struct video_s
     {
@@ -24,9 +29,46 @@ extern "C"
         struct video_monitor_s
           monitor; //< A reader exposed through the public api
 
+        /// Readers opened with `acquire_open_monitor_reader()`, linked
+        /// through their `next` member. Guarded by `readers_lock`.
+        struct AcquireMonitorReader* readers;
+        struct lock readers_lock;
+
+        /// Holds from `acquire_unmap_read_and_hold()` and the like that
+        /// haven't been released.
+        uint32_t read_holds;
+
         struct video_source_s source; //< context for the video source thread
         struct video_filter_s filter; //< context for the video filter thread
         struct video_sink_s sink;     //< context for the video sink thread
+
+        /// Crops the frames going to `sink` into regions stored on their own.
+        struct video_fanout_s fanout;
+
+        /// More storage devices reading the frames going to `sink`.
+        struct video_tee_s tee;
+        struct video_stage_s stage;   //< context for the stage axis thread
+
+        /// Context for the thread feeding the signal device.
+        struct video_waveform_s waveform;
+
+        /// Client records stored with the frames going to `sink`. See
+        /// annotations.h.
+        struct video_annotations_s annotations;
+
+        /// Measures the frames going to `sink`. See intensity.h.
+        struct video_intensity_s intensity;
+        /// Bins the frames going to `sink` for preview readers. See
+        /// preview.h.
+        struct video_preview_s preview;
+
+        /// NUMA node the stream's queues and threads are placed on, or -1 to
+        /// leave them to the system.
+        int32_t numa_node;
+        /// The affinity masks asked for the source, filter and sink threads.
+        /// Masks left at 0 take the CPUs of `numa_node` in their
+        /// `thread_attributes`.
+        uint64_t affinity_masks[3];
     };
 
 #ifdef __cplusplus
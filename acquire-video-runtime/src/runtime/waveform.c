@@ -0,0 +1,345 @@
+#include "waveform.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) AQ_LOG(LogModule_Runtime, 0, __VA_ARGS__)
+#define LOGE(...) AQ_LOG(LogModule_Runtime, 1, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// How long the controller sleeps between checks of the device's output.
+/// Blocks should play for longer than this.
+#define WAVEFORM_POLL_INTERVAL_MS (2.0f)
+
+/// Blocks kept queued on the device ahead of its output: one playing, one
+/// ready to play.
+#define WAVEFORM_BLOCKS_AHEAD (2)
+
+/// Blocks the channel holds for the controller.
+#define WAVEFORM_BLOCKS_PER_CHANNEL (16)
+
+static int
+is_equal(const struct DeviceIdentifier* const a,
+         const struct DeviceIdentifier* const b)
+{
+    return (a->driver_id == b->driver_id) && (a->device_id == b->device_id);
+}
+
+/// Writes blocks to the device until `WAVEFORM_BLOCKS_AHEAD` are queued ahead
+/// of its output. The last block is written again when none are waiting.
+/// @returns 1 on success, otherwise 0.
+static int
+refill(struct video_waveform_s* self)
+{
+    const uint64_t samples_per_block = self->samples_per_block;
+    // Devices that can't say where their output is block in write_ao()
+    // instead, so for them every block queued counts as played.
+    uint64_t played = self->blocks_queued * samples_per_block;
+    if (signal_can_report_output_position(self->signal))
+        CHECK(signal_get_output_position(self->signal, &played) == Device_Ok);
+    const uint64_t wanted = played + WAVEFORM_BLOCKS_AHEAD * samples_per_block;
+    while (self->blocks_queued * samples_per_block < wanted) {
+        const struct slice s = channel_read_map(&self->blocks, &self->reader);
+        const size_t n =
+          (size_t)(s.end - s.beg) >= self->bytes_of_block ? self->bytes_of_block
+                                                          : 0;
+        if (n)
+            memcpy(self->last_block, s.beg, n); // NOLINT
+        channel_read_unmap(&self->blocks, &self->reader, n);
+        if (!n) {
+            if (!self->has_last_block)
+                break;
+            ++self->blocks_repeated;
+        }
+        self->has_last_block = 1;
+        CHECK(signal_write_ao(self->signal,
+                              self->last_block,
+                              self->bytes_of_block) == Device_Ok);
+        ++self->blocks_queued;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+video_waveform_thread(struct video_waveform_s* const self)
+{
+    thread_set_current_attributes(&self->thread_attributes);
+    while (!load_acquire(&self->is_stopping)) {
+        EXPECT(refill(self),
+               "[stream %d] WAVEFORM: Failed to refill the signal device.",
+               (int)self->stream_id);
+        clock_sleep_ms(0, WAVEFORM_POLL_INTERVAL_MS);
+    }
+    LOG("[stream %d] WAVEFORM: Exiting thread", (int)self->stream_id);
+    store_release(&self->is_running, 0);
+    return 0;
+Error:
+    LOGE("[stream %d] WAVEFORM: Exiting thread (Error)", (int)self->stream_id);
+    store_release(&self->is_running, 0);
+    return 1;
+}
+
+/// Makes room for blocks of `samples_per_block` samples of
+/// `bytes_per_sample` bytes each, dropping any blocks that were queued.
+static int
+reserve_blocks(struct video_waveform_s* self,
+               uint32_t samples_per_block,
+               size_t bytes_per_sample)
+{
+    self->samples_per_block = samples_per_block;
+    self->bytes_of_block = (size_t)samples_per_block * bytes_per_sample;
+    free(self->last_block);
+    self->has_last_block = 0;
+    CHECK(self->last_block = malloc(self->bytes_of_block));
+    CHECK(channel_reserve(&self->blocks,
+                          WAVEFORM_BLOCKS_PER_CHANNEL * self->bytes_of_block));
+    // Registers the reader, so blocks written before the stream starts wait
+    // for it.
+    channel_read_map(&self->blocks, &self->reader);
+    channel_read_unmap(&self->blocks, &self->reader, 0);
+    return 1;
+Error:
+    self->bytes_of_block = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_waveform_init(struct video_waveform_s* self, uint8_t stream_id)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    self->stream_id = stream_id;
+    snprintf(self->thread_attributes.name,
+             sizeof(self->thread_attributes.name),
+             "acq-waveform-%d",
+             (int)stream_id);
+    channel_new(&self->blocks, 0);
+    parked_thread_init(
+      &self->thread, (void (*)(void*))video_waveform_thread, self);
+    return Device_Ok;
+}
+
+void
+video_waveform_destroy(struct video_waveform_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->signal)
+        signal_close(self->signal);
+    self->signal = 0;
+    channel_release(&self->blocks);
+    free(self->last_block);
+    self->last_block = 0;
+}
+
+enum DeviceStatusCode
+video_waveform_configure(struct video_waveform_s* self,
+                         const struct DeviceManager* device_manager,
+                         const struct DeviceIdentifier* identifier,
+                         struct SignalProperties* settings,
+                         uint32_t samples_per_block)
+{
+    if (self->signal && (identifier->kind == DeviceKind_None ||
+                         !is_equal(&self->identifier, identifier))) {
+        signal_close(self->signal);
+        self->signal = 0;
+    }
+    self->identifier = *identifier;
+    if (identifier->kind == DeviceKind_None)
+        return Device_Ok;
+    if (!self->signal) {
+        EXPECT(self->signal = signal_open(device_manager, identifier),
+               "[stream %d] WAVEFORM: Failed to open \"%s\".",
+               (int)self->stream_id,
+               identifier->name);
+    }
+    CHECK(signal_set(self->signal, settings) == Device_Ok);
+    CHECK(signal_get(self->signal, settings) == Device_Ok);
+    const size_t bytes_per_sample = signal_bytes_per_output_sample(settings);
+    EXPECT(bytes_per_sample,
+           "[stream %d] WAVEFORM: \"%s\" has no output lines.",
+           (int)self->stream_id,
+           identifier->name);
+    EXPECT(samples_per_block,
+           "[stream %d] WAVEFORM: Expected at least one sample per block.",
+           (int)self->stream_id);
+    CHECK(reserve_blocks(self, samples_per_block, bytes_per_sample));
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_waveform_get(const struct video_waveform_s* self,
+                   struct DeviceIdentifier* identifier,
+                   struct SignalProperties* settings,
+                   uint32_t* samples_per_block)
+{
+    *identifier = self->identifier;
+    *samples_per_block = self->samples_per_block;
+    return self->signal ? signal_get(self->signal, settings) : Device_Ok;
+}
+
+enum DeviceStatusCode
+video_waveform_write(struct video_waveform_s* self,
+                     const uint8_t* data,
+                     size_t nbytes)
+{
+    EXPECT(self->signal && self->bytes_of_block,
+           "[stream %d] WAVEFORM: No signal device is configured.",
+           (int)self->stream_id);
+    EXPECT(nbytes % self->bytes_of_block == 0,
+           "[stream %d] WAVEFORM: Expected whole blocks of %llu bytes. Got "
+           "%llu bytes.",
+           (int)self->stream_id,
+           (unsigned long long)self->bytes_of_block,
+           (unsigned long long)nbytes);
+    for (size_t offset = 0; offset < nbytes; offset += self->bytes_of_block) {
+        // Only the controller makes room, so there's no waiting for it
+        // unless it's running.
+        while (channel_bytes_unread(&self->blocks, &self->reader) +
+                 self->bytes_of_block >
+               self->blocks.capacity) {
+            EXPECT(load_acquire(&self->is_running),
+                   "[stream %d] WAVEFORM: No room for more blocks.",
+                   (int)self->stream_id);
+            clock_sleep_ms(0, WAVEFORM_POLL_INTERVAL_MS);
+        }
+        uint8_t* const block =
+          channel_write_map(&self->blocks, self->bytes_of_block);
+        CHECK(block);
+        memcpy(block, data + offset, self->bytes_of_block); // NOLINT
+        channel_write_unmap(&self->blocks);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_waveform_start(struct video_waveform_s* self)
+{
+    if (!self->signal)
+        return Device_Ok;
+    self->blocks_queued = 0;
+    self->blocks_repeated = 0;
+    self->has_last_block = 0;
+    // Blocks written before the start are queued before the device starts,
+    // so its output begins with them.
+    CHECK(refill(self));
+    CHECK(signal_start(self->signal) == Device_Ok);
+    store_release(&self->is_stopping, 0);
+    store_release(&self->is_running, 1);
+    if (!parked_thread_run(&self->thread)) {
+        store_release(&self->is_running, 0);
+        signal_stop(self->signal);
+        goto Error;
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_waveform_stop(struct video_waveform_s* self)
+{
+    if (!self->signal)
+        return;
+    store_release(&self->is_stopping, 1);
+    parked_thread_wait(&self->thread);
+    signal_stop(self->signal);
+    if (self->blocks_repeated)
+        LOG("[stream %d] WAVEFORM: Repeated %llu of %llu blocks waiting for "
+            "more.",
+            (int)self->stream_id,
+            (unsigned long long)self->blocks_repeated,
+            (unsigned long long)self->blocks_queued);
+}
+
+#ifndef NO_UNIT_TESTS
+
+struct fake_signal
+{
+    struct Signal signal;
+    uint64_t position;
+    uint8_t written[64];
+    size_t nbytes_written;
+};
+
+static enum DeviceStatusCode
+fake_signal_write_ao(struct Signal* signal, uint8_t* buf, size_t nbytes)
+{
+    struct fake_signal* self = (struct fake_signal*)signal;
+    if (self->nbytes_written + nbytes > sizeof(self->written))
+        return Device_Err;
+    memcpy(self->written + self->nbytes_written, buf, nbytes); // NOLINT
+    self->nbytes_written += nbytes;
+    return Device_Ok;
+}
+
+static enum DeviceStatusCode
+fake_signal_get_output_position(const struct Signal* signal,
+                                uint64_t* samples)
+{
+    *samples = ((const struct fake_signal*)signal)->position;
+    return Device_Ok;
+}
+
+/// The device is kept two blocks ahead of its output, from the blocks
+/// written to the channel and then by repeating the last one.
+int
+unit_test__waveform_keeps_two_blocks_ahead_of_output()
+{
+    struct video_waveform_s waveform;
+    struct fake_signal fake = {
+        .signal = { .write_ao = fake_signal_write_ao,
+                    .get_output_position = fake_signal_get_output_position },
+    };
+    const uint8_t blocks[] = { 1, 1, 2, 2, 3, 3 };
+    const uint8_t expected[] = { 1, 1, 2, 2, 3, 3, 3, 3 };
+    video_waveform_init(&waveform, 0);
+    waveform.signal = &fake.signal;
+    CHECK(reserve_blocks(&waveform, 2, 1));
+
+    // Nothing is written until there's a block to write.
+    CHECK(refill(&waveform));
+    CHECK(fake.nbytes_written == 0);
+
+    CHECK(video_waveform_write(&waveform, blocks, sizeof(blocks)) ==
+          Device_Ok);
+    CHECK(refill(&waveform));
+    CHECK(fake.nbytes_written == 4);
+    CHECK(refill(&waveform));
+    CHECK(fake.nbytes_written == 4);
+
+    // Once the first block has played, the third is queued.
+    fake.position = 2;
+    CHECK(refill(&waveform));
+    CHECK(fake.nbytes_written == 6);
+
+    // With none left, the last block is repeated.
+    fake.position = 4;
+    CHECK(refill(&waveform));
+    CHECK(fake.nbytes_written == sizeof(expected));
+    CHECK(memcmp(fake.written, expected, sizeof(expected)) == 0);
+    CHECK(waveform.blocks_repeated == 1);
+
+    waveform.signal = 0;
+    video_waveform_destroy(&waveform);
+    return 1;
+Error:
+    waveform.signal = 0;
+    video_waveform_destroy(&waveform);
+    return 0;
+}
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,103 @@
+#ifndef H_ACQUIRE_RUNTIME_VIDEO_WAVEFORM_V0
+#define H_ACQUIRE_RUNTIME_VIDEO_WAVEFORM_V0
+
+#include "device/props/device.h"
+#include "device/hal/device.manager.h"
+#include "device/hal/experimental/signals.h"
+#include "platform.h"
+#include "runtime/channel.h"
+#include "runtime/parked_thread.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Feeds a signal device's outputs from a channel of waveform blocks
+    /// while a video stream runs. Two blocks are kept queued ahead of the
+    /// device's output, so its clock times the waveform and the host only
+    /// has to refill one block while the other plays.
+    struct video_waveform_s
+    {
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write, with store_release().
+        uint32_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read, with load_acquire().
+        uint32_t is_running;
+
+        uint8_t stream_id;
+
+        /// NULL when the stream has no signal device.
+        struct Signal* signal;
+        struct DeviceIdentifier identifier;
+
+        /// Runs the controller once per acquisition. See parked_thread.h.
+        struct parked_thread thread;
+        struct thread_attributes thread_attributes;
+
+        /// One block of `bytes_of_block` bytes per write, written by
+        /// video_waveform_write().
+        struct channel blocks;
+        struct channel_reader reader;
+
+        /// Samples per output line in a block, and the bytes they take.
+        uint32_t samples_per_block;
+        size_t bytes_of_block;
+
+        /// The block written to the device last. It's written again when the
+        /// channel runs dry, so a periodic waveform only needs writing once.
+        uint8_t* last_block;
+        uint8_t has_last_block;
+
+        /// Only touched by the controller. Blocks written to the device since
+        /// it was started, and how many of them were repeats.
+        uint64_t blocks_queued;
+        uint64_t blocks_repeated;
+    };
+
+    enum DeviceStatusCode video_waveform_init(struct video_waveform_s* self,
+                                              uint8_t stream_id);
+
+    void video_waveform_destroy(struct video_waveform_s* self);
+
+    /// @brief Opens the signal device named by `identifier`, applies
+    /// `settings` to it, and makes room for blocks of `samples_per_block`
+    /// samples per output line.
+    /// @details An identifier of kind `DeviceKind_None` closes any device
+    /// that was open, so the stream has none.
+    enum DeviceStatusCode video_waveform_configure(
+      struct video_waveform_s* self,
+      const struct DeviceManager* device_manager,
+      const struct DeviceIdentifier* identifier,
+      struct SignalProperties* settings,
+      uint32_t samples_per_block);
+
+    /// @brief Query the signal device and its settings. Settings are only
+    /// updated while a device is open.
+    enum DeviceStatusCode video_waveform_get(
+      const struct video_waveform_s* self,
+      struct DeviceIdentifier* identifier,
+      struct SignalProperties* settings,
+      uint32_t* samples_per_block);
+
+    /// @brief Queues whole blocks of waveform from `data`.
+    /// @details Waits for room while running. Otherwise, fails once the
+    /// channel is full. Only one thread may write at a time.
+    enum DeviceStatusCode video_waveform_write(struct video_waveform_s* self,
+                                               const uint8_t* data,
+                                               size_t nbytes);
+
+    /// @brief Queues the first blocks, starts the device, and starts the
+    /// thread refilling it. Does nothing when the stream has no device.
+    enum DeviceStatusCode video_waveform_start(struct video_waveform_s* self);
+
+    /// @brief Stops refilling and stops the device.
+    void video_waveform_stop(struct video_waveform_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_RUNTIME_VIDEO_WAVEFORM_V0
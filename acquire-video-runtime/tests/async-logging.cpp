@@ -0,0 +1,135 @@
+/// @file async-logging.cpp
+/// Test that with acquire_set_async_logging() on, the stream threads' log
+/// messages are reported from one background thread, apart from what's left
+/// when it's turned off, and that every "wrote frame" message is either
+/// reported or counted as dropped.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+static struct
+{
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    uint64_t wrote_frame;
+} reported;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    if (strstr(msg, "SOURCE: wrote frame")) {
+        std::scoped_lock lock(reported.lock);
+        reported.threads.insert(std::this_thread::get_id());
+        ++reported.wrote_frame;
+        return;
+    }
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*empty.*") - 1,
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[0].storage.identifier));
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        props.video[0].camera.settings.exposure_time_us = 1e2f;
+        props.video[0].max_frame_count = 5000;
+        OK(acquire_configure(runtime, &props));
+
+        CHECK(acquire_set_async_logging(nullptr, 1) == AcquireStatus_Error);
+        OK(acquire_set_async_logging(runtime, 1));
+        OK(acquire_set_async_logging(runtime, 1));
+
+        AcquireMetrics before = {};
+        OK(acquire_get_metrics(runtime, &before));
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        OK(acquire_set_async_logging(runtime, 0));
+
+        AcquireMetrics after = {};
+        OK(acquire_get_metrics(runtime, &after));
+        const uint64_t dropped =
+          after.dropped_log_messages - before.dropped_log_messages;
+        {
+            std::scoped_lock lock(reported.lock);
+            LOG("%llu frame messages reported, %llu log messages dropped",
+                (unsigned long long)reported.wrote_frame,
+                (unsigned long long)dropped);
+            // Whatever was still queued is reported from this thread.
+            const size_t nthreads = reported.threads.size() -
+                                    reported.threads.count(
+                                      std::this_thread::get_id());
+            CHECK(nthreads == 1);
+            CHECK(reported.wrote_frame > 0);
+            CHECK(reported.wrote_frame <= props.video[0].max_frame_count);
+            CHECK(reported.wrote_frame + dropped >=
+                  props.video[0].max_frame_count);
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
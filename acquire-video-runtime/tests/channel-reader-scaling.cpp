@@ -0,0 +1,159 @@
+/// @file channel-reader-scaling.cpp
+/// Benchmark. Streams small frames through one channel to 1 to 8 reader
+/// threads and reports the throughput for each count. Readers publish their
+/// cursors from separate cache lines, so adding readers shouldn't slow the
+/// others down much.
+
+#include "runtime/channel.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+static const size_t bytes_of_frame = 64;
+static const uint64_t frame_count = 1ULL << 18;
+static const size_t max_readers = 8;
+
+struct bench
+{
+    struct channel channel;
+    struct channel_reader readers[max_readers];
+    uint64_t frames_read[max_readers];
+    uint64_t checksums[max_readers];
+};
+
+struct reader_packet
+{
+    struct bench* bench;
+    size_t ireader;
+};
+
+static void
+writer_thread(void* bench_)
+{
+    auto* bench = (struct bench*)bench_;
+    for (uint64_t i = 0; i < frame_count; ++i) {
+        auto* p = (uint64_t*)channel_write_map(&bench->channel, bytes_of_frame);
+        if (!p)
+            return;
+        *p = i;
+        channel_write_unmap(&bench->channel);
+    }
+}
+
+static void
+reader_thread(void* packet_)
+{
+    const auto* packet = (const struct reader_packet*)packet_;
+    struct bench* bench = packet->bench;
+    struct channel_reader* reader = bench->readers + packet->ireader;
+    uint64_t nframes = 0, checksum = 0;
+    while (nframes < frame_count &&
+           bench->channel.is_accepting_writes) {
+        struct slice s = channel_read_map_wait(&bench->channel, reader, 100);
+        for (const uint8_t* cur = s.beg; cur < s.end; cur += bytes_of_frame) {
+            checksum += *(const uint64_t*)cur;
+            ++nframes;
+        }
+        channel_read_unmap(&bench->channel, reader, s.end - s.beg);
+    }
+    bench->frames_read[packet->ireader] = nframes;
+    bench->checksums[packet->ireader] = checksum;
+}
+
+/// @returns Frames per second, as seen by every reader.
+static double
+run(size_t nreaders)
+{
+    struct bench bench = {};
+    struct reader_packet packets[max_readers] = {};
+    struct thread writer, readers[max_readers];
+
+    channel_new(&bench.channel, 1ULL << 20);
+    // Register the readers before the writer starts so none of them is lapped.
+    for (size_t i = 0; i < nreaders; ++i)
+        channel_read_map(&bench.channel, bench.readers + i);
+
+    struct clock clock = {};
+    clock_init(&clock);
+    thread_init(&writer);
+    for (size_t i = 0; i < nreaders; ++i) {
+        packets[i] = { .bench = &bench, .ireader = i };
+        thread_init(readers + i);
+        CHECK(thread_create(readers + i, reader_thread, packets + i));
+    }
+    CHECK(thread_create(&writer, writer_thread, &bench));
+    thread_join(&writer);
+    for (size_t i = 0; i < nreaders; ++i)
+        thread_join(readers + i);
+    const double elapsed_ms = clock_toc_ms(&clock);
+    channel_release(&bench.channel);
+
+    const uint64_t expected_checksum = frame_count * (frame_count - 1) / 2;
+    for (size_t i = 0; i < nreaders; ++i) {
+        EXPECT(bench.frames_read[i] == frame_count,
+               "Reader %d of %d saw %llu frames. Expected %llu.",
+               (int)i,
+               (int)nreaders,
+               (unsigned long long)bench.frames_read[i],
+               (unsigned long long)frame_count);
+        CHECK(bench.checksums[i] == expected_checksum);
+    }
+    return 1e3 * (double)frame_count / elapsed_ms;
+}
+
+int
+main()
+{
+    logger_set_reporter(reporter);
+    try {
+        double baseline = 0.0;
+        for (size_t nreaders = 1; nreaders <= max_readers; ++nreaders) {
+            const double fps = run(nreaders);
+            if (nreaders == 1)
+                baseline = fps;
+            LOG("%d reader(s): %.2f Mframes/s (%.2fx of 1 reader)",
+                (int)nreaders,
+                1e-6 * fps,
+                fps / baseline);
+        }
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+        return 1;
+    } catch (...) {
+        ERR("Exception: (unknown)");
+        return 1;
+    }
+    return 0;
+}
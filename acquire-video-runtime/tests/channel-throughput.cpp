@@ -0,0 +1,276 @@
+/// @file channel-throughput.cpp
+/// Benchmark. Streams frames through a channel while sweeping the frame
+/// size, the number of reader threads, and whether the readers are lossy,
+/// and prints the results as JSON: frames/s and GB/s through the channel,
+/// and percentiles of how long each map and unmap took.
+///
+/// Only the first word of each frame is written and read, so the numbers
+/// measure the channel's own overhead rather than memory bandwidth. Writer
+/// map latencies include any time spent waiting for readers to make room.
+
+#include "runtime/channel.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+static const size_t channel_capacity = 64ULL << 20;
+static const size_t max_readers = 4;
+
+/// Each run streams at most this many frames, or this many bytes.
+static const uint64_t max_frame_count = 1ULL << 16;
+static const uint64_t max_bytes_streamed = 1ULL << 30;
+
+/// Clock tics each call took.
+using latencies = std::vector<int64_t>;
+
+struct bench
+{
+    struct channel channel;
+    size_t bytes_of_frame;
+    uint64_t frame_count;
+    std::atomic<int> writer_is_done;
+
+    latencies write_map, write_unmap;
+
+    struct channel_reader readers[max_readers];
+    uint64_t frames_read[max_readers];
+    latencies read_map[max_readers], read_unmap[max_readers];
+};
+
+struct reader_packet
+{
+    struct bench* bench;
+    size_t ireader;
+};
+
+static void
+writer_thread(void* bench_)
+{
+    auto* bench = (struct bench*)bench_;
+    for (uint64_t i = 0; i < bench->frame_count; ++i) {
+        const uint64_t t0 = clock_tic(0);
+        auto* p =
+          (uint64_t*)channel_write_map(&bench->channel, bench->bytes_of_frame);
+        const uint64_t t1 = clock_tic(0);
+        if (!p)
+            break;
+        *p = i;
+        channel_write_unmap(&bench->channel);
+        const uint64_t t2 = clock_tic(0);
+        bench->write_map.push_back((int64_t)(t1 - t0));
+        bench->write_unmap.push_back((int64_t)(t2 - t1));
+    }
+    bench->writer_is_done.store(1);
+    channel_wake_readers(&bench->channel);
+}
+
+static void
+reader_thread(void* packet_)
+{
+    const auto* packet = (const struct reader_packet*)packet_;
+    struct bench* bench = packet->bench;
+    const size_t i = packet->ireader;
+    struct channel_reader* reader = bench->readers + i;
+    uint64_t nframes = 0, last = 0;
+    int is_ordered = 1;
+    while (1) {
+        // Checked before mapping, so nothing committed before the writer
+        // finished is missed.
+        const int writer_is_done = bench->writer_is_done.load();
+        const uint64_t t0 = clock_tic(0);
+        struct slice s = channel_read_map(&bench->channel, reader);
+        bench->read_map[i].push_back((int64_t)(clock_tic(0) - t0));
+        if (s.beg == s.end) {
+            channel_read_unmap(&bench->channel, reader, 0);
+            if (writer_is_done)
+                break;
+            s = channel_read_map_wait(&bench->channel, reader, 100);
+        }
+        for (const uint8_t* cur = s.beg; cur < s.end;
+             cur += bench->bytes_of_frame) {
+            const uint64_t id = *(const uint64_t*)cur;
+            is_ordered &= (nframes == 0) || (id > last);
+            last = id;
+            ++nframes;
+        }
+        const uint64_t t1 = clock_tic(0);
+        channel_read_unmap(&bench->channel, reader, s.end - s.beg);
+        bench->read_unmap[i].push_back((int64_t)(clock_tic(0) - t1));
+    }
+    // Out of order frames are counted as lost.
+    bench->frames_read[i] = is_ordered ? nframes : 0;
+}
+
+/// Appends `name`'s percentiles in nanoseconds to `json`.
+static void
+append_percentiles(std::string& json, const char* name, latencies& tics)
+{
+    char buf[256] = { 0 };
+    std::sort(tics.begin(), tics.end());
+    auto at = [&](double p) {
+        if (tics.empty())
+            return (long long)0;
+        const size_t i = (size_t)(p * (double)(tics.size() - 1));
+        return (long long)clock_tics_to_ns(tics[i]);
+    };
+    snprintf(buf,
+             sizeof(buf),
+             "\"%s\": {\"p50\": %lld, \"p90\": %lld, \"p99\": %lld, "
+             "\"max\": %lld}",
+             name,
+             at(0.5),
+             at(0.9),
+             at(0.99),
+             at(1.0));
+    json += buf;
+}
+
+/// Streams frames of `bytes_of_frame` bytes to `nreaders` readers.
+/// @returns The results as a JSON object.
+static std::string
+run(size_t bytes_of_frame, size_t nreaders, int is_lossy)
+{
+    auto* bench = new struct bench();
+    struct reader_packet packets[max_readers] = {};
+    struct thread writer, readers[max_readers];
+
+    bench->bytes_of_frame = bytes_of_frame;
+    bench->frame_count =
+      std::min(max_frame_count, max_bytes_streamed / bytes_of_frame);
+    bench->write_map.reserve(bench->frame_count);
+    bench->write_unmap.reserve(bench->frame_count);
+
+    channel_new(&bench->channel, channel_capacity);
+    // Register the readers before the writer starts so none of them is lapped.
+    for (size_t i = 0; i < nreaders; ++i) {
+        channel_reader_set_lossy(&bench->channel, bench->readers + i, is_lossy);
+        channel_read_map(&bench->channel, bench->readers + i);
+        channel_read_unmap(&bench->channel, bench->readers + i, 0);
+        bench->read_map[i].reserve(bench->frame_count);
+        bench->read_unmap[i].reserve(bench->frame_count);
+    }
+
+    struct clock clock = {};
+    clock_init(&clock);
+    thread_init(&writer);
+    for (size_t i = 0; i < nreaders; ++i) {
+        packets[i] = { .bench = bench, .ireader = i };
+        thread_init(readers + i);
+        CHECK(thread_create(readers + i, reader_thread, packets + i));
+    }
+    CHECK(thread_create(&writer, writer_thread, bench));
+    thread_join(&writer);
+    const double elapsed_s = 1e-3 * clock_toc_ms(&clock);
+    for (size_t i = 0; i < nreaders; ++i)
+        thread_join(readers + i);
+    channel_release(&bench->channel);
+
+    const uint64_t written = bench->write_map.size();
+    CHECK(written == bench->frame_count);
+    uint64_t min_read = written;
+    latencies read_map, read_unmap;
+    for (size_t i = 0; i < nreaders; ++i) {
+        if (!is_lossy)
+            EXPECT(bench->frames_read[i] == written,
+                   "Reader %d of %d saw %llu frames. Expected %llu.",
+                   (int)i,
+                   (int)nreaders,
+                   (unsigned long long)bench->frames_read[i],
+                   (unsigned long long)written);
+        min_read = std::min(min_read, bench->frames_read[i]);
+        read_map.insert(
+          read_map.end(), bench->read_map[i].begin(), bench->read_map[i].end());
+        read_unmap.insert(read_unmap.end(),
+                          bench->read_unmap[i].begin(),
+                          bench->read_unmap[i].end());
+    }
+
+    char buf[512] = { 0 };
+    snprintf(buf,
+             sizeof(buf),
+             "{\"bytes_of_frame\": %llu, \"readers\": %d, \"mode\": \"%s\", "
+             "\"frames_written\": %llu, \"min_frames_read\": %llu, "
+             "\"frames_per_second\": %.1f, \"gigabytes_per_second\": %.3f, ",
+             (unsigned long long)bytes_of_frame,
+             (int)nreaders,
+             is_lossy ? "lossy" : "lossless",
+             (unsigned long long)written,
+             (unsigned long long)min_read,
+             (double)written / elapsed_s,
+             1e-9 * (double)(written * bytes_of_frame) / elapsed_s);
+    std::string json = buf;
+    append_percentiles(json, "write_map_ns", bench->write_map);
+    json += ", ";
+    append_percentiles(json, "write_unmap_ns", bench->write_unmap);
+    json += ", ";
+    append_percentiles(json, "read_map_ns", read_map);
+    json += ", ";
+    append_percentiles(json, "read_unmap_ns", read_unmap);
+    json += "}";
+    delete bench;
+    return json;
+}
+
+int
+main()
+{
+    logger_set_reporter(reporter);
+    try {
+        std::string json = "{\"benchmark\": \"" TEST "\", \"runs\": [\n";
+        const char* sep = "";
+        for (size_t bytes_of_frame : { 64, 4096, 1 << 20 }) {
+            for (size_t nreaders = 1; nreaders <= max_readers; nreaders *= 2) {
+                for (int is_lossy = 0; is_lossy < 2; ++is_lossy) {
+                    json += sep;
+                    json += "  " + run(bytes_of_frame, nreaders, is_lossy);
+                    sep = ",\n";
+                }
+            }
+        }
+        json += "\n]}\n";
+        fputs(json.c_str(), stdout);
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+        return 1;
+    } catch (...) {
+        ERR("Exception: (unknown)");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+/// @file clock-correlation.cpp
+/// Test that acquire_get_clock_correlation() maps a stream's hardware
+/// timestamps onto the host clock of `timestamps.acq_thread`. The simulated
+/// camera stamps frames with the host clock when it makes them, so the line
+/// has a slope of 1, and maps each frame to no later than it arrived.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+constexpr uint64_t nframes = 100;
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = 64, .y = 48 };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    OK(acquire_configure(runtime, &props));
+}
+
+static VideoFrame*
+next(VideoFrame* cur)
+{
+    return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+
+        // Nothing to go on before the stream runs.
+        AcquireClockCorrelation correlation = {};
+        CHECK(acquire_get_clock_correlation(runtime, 0, &correlation) ==
+              AcquireStatus_Error);
+
+        AcquireMonitorReader* reader = 0;
+        OK(acquire_open_monitor_reader(runtime, 0, nullptr, &reader));
+        std::vector<VideoFrame> frames;
+        struct clock clock = {};
+        clock_init(&clock);
+        OK(acquire_start(runtime));
+        while (frames.size() < nframes) {
+            EXPECT(clock_toc_ms(&clock) < 10e3, "Timed out reading frames.");
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_monitor_reader_map(reader, 100, &beg, &end));
+            for (cur = beg; cur < end; cur = next(cur))
+                frames.push_back(*cur);
+            OK(acquire_monitor_reader_unmap(reader,
+                                            (uint8_t*)end - (uint8_t*)beg));
+        }
+        OK(acquire_stop(runtime));
+        OK(acquire_close_monitor_reader(runtime, reader));
+
+        // The mapping outlives the acquisition.
+        OK(acquire_get_clock_correlation(runtime, 0, &correlation));
+        LOG("%u frames: slope %.9f, residual %f tics.",
+            correlation.sample_count,
+            correlation.host_per_hardware,
+            correlation.residual);
+        CHECK(correlation.sample_count >= 8);
+        CHECK(correlation.sample_count <= nframes);
+        CHECK(correlation.host_per_hardware > 0.99);
+        CHECK(correlation.host_per_hardware < 1.01);
+
+        // Only the frames the line was fit through are sure to arrive no
+        // sooner than they map to, to within the line's error.
+        const uint64_t slack_ns = 100000;
+        for (uint64_t i = nframes - correlation.sample_count; i < nframes;
+             ++i) {
+            const VideoFrame& f = frames[i];
+            const uint64_t host = acquire_hardware_to_host_time(
+              &correlation, f.timestamps.hardware);
+            EXPECT(host <= f.timestamps.acq_thread + slack_ns,
+                   "Frame %llu maps to %lld ns after it arrived.",
+                   (unsigned long long)f.frame_id,
+                   (long long)(host - f.timestamps.acq_thread));
+            EXPECT(host + 100000000 > f.timestamps.acq_thread,
+                   "Frame %llu maps to %lld ns before it arrived.",
+                   (unsigned long long)f.frame_id,
+                   (long long)(f.timestamps.acq_thread - host));
+        }
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,187 @@
+/// @file configure-channel-capacity.cpp
+/// Test that a stream's channel capacity can be configured, that a capacity
+/// too small to hold a frame is rejected, and that frames flow through a
+/// small channel that wraps many times, as reported by the stream stats,
+/// and that each frame's latency is recorded.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static AcquireProperties
+configure(AcquireRuntime* runtime, uint64_t channel_capacity_bytes)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].channel_capacity_bytes = channel_capacity_bytes;
+
+    OK(acquire_configure(runtime, &props));
+    return props;
+}
+
+static void
+acquire(AcquireRuntime* runtime, const AcquireProperties& props)
+{
+    const auto next = [](VideoFrame* cur) -> VideoFrame* {
+        return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+    };
+
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t nbytes_read = 0;
+    {
+        uint64_t nframes = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end; cur = next(cur)) {
+                EXPECT(cur->frame_id == nframes,
+                       "Expected frame %llu. Got %llu.",
+                       (unsigned long long)nframes,
+                       (unsigned long long)cur->frame_id);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(
+              runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            nbytes_read += (uint8_t*)end - (uint8_t*)beg;
+            clock_sleep_ms(0, 1.0f);
+        }
+    }
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStats stats = {};
+    OK(acquire_get_stream_stats(runtime, 0, &stats));
+    const AcquireChannelStats& queue = stats.storage_queue;
+    // Rounded up to whole frames, so the writer fills it to the end.
+    CHECK(queue.capacity_bytes >= props.video[0].channel_capacity_bytes);
+    CHECK(queue.capacity_bytes <
+          props.video[0].channel_capacity_bytes + sizeof(VideoFrame) + 64 * 48);
+    CHECK(stats.monitor_bytes_read == nbytes_read);
+    CHECK(queue.bytes_written >= nbytes_read);
+    CHECK(stats.storage_bytes_read <= queue.bytes_written);
+    CHECK(queue.high_water_bytes <= queue.capacity_bytes);
+    CHECK(queue.wasted_bytes == 0);
+    if (queue.bytes_written > queue.capacity_bytes)
+        CHECK(queue.wrap_count > 0);
+
+    // Every frame was timed through each stage it went through.
+    const AcquireStreamLatency& latency = stats.latency;
+    const uint64_t nframes = props.video[0].max_frame_count;
+    CHECK(latency.camera_to_channel.count == nframes);
+    CHECK(latency.channel_to_filter.count == 0);
+    CHECK(latency.channel_to_sink.count == nframes);
+    CHECK(latency.sink_to_storage.count == nframes);
+    CHECK(latency.sink_to_storage.p50_ms <= latency.sink_to_storage.p99_ms);
+    CHECK(latency.sink_to_storage.p99_ms <= latency.sink_to_storage.max_ms);
+    LOG("Wrapped %llu times. High water mark %llu bytes. Writer blocked "
+        "for %f ms.",
+        (unsigned long long)queue.wrap_count,
+        (unsigned long long)queue.high_water_bytes,
+        queue.writer_blocked_ms);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        // Too small to hold a frame.
+        configure(runtime, 1024);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        // Round trips through the configuration.
+        const AcquireProperties props = configure(runtime, 1ULL << 20);
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        {
+            AcquireProperties actual = {};
+            OK(acquire_get_configuration(runtime, &actual));
+            CHECK(actual.video[0].channel_capacity_bytes == 1ULL << 20);
+        }
+
+        acquire(runtime, props);
+
+        // Resizing between acquisitions.
+        acquire(runtime, configure(runtime, 1ULL << 16));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,144 @@
+/// @file configure-thread-attributes.cpp
+/// Test that the priority and CPU affinity of a stream's threads round trip
+/// through the configuration, that an unknown priority is rejected, and that
+/// a stream with adjusted threads still acquires every frame.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static AcquireProperties
+configure(AcquireRuntime* runtime, uint8_t source_priority)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 10;
+    props.video[0].threads.source.priority = source_priority;
+    props.video[0].threads.sink.affinity_mask = 1;
+
+    acquire_configure(runtime, &props);
+    return props;
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        // Not a priority.
+        configure(runtime, 3);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        const AcquireProperties props = configure(runtime, 1);
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        {
+            AcquireProperties actual = {};
+            OK(acquire_get_configuration(runtime, &actual));
+            CHECK(actual.video[0].threads.source.priority == 1);
+            CHECK(actual.video[0].threads.source.affinity_mask == 0);
+            CHECK(actual.video[0].threads.filter.priority == 0);
+            CHECK(actual.video[0].threads.sink.priority == 0);
+            CHECK(actual.video[0].threads.sink.affinity_mask == 1);
+        }
+
+        // Settings that can't be applied here are logged, not fatal.
+        OK(acquire_start(runtime));
+        {
+            const auto next = [](VideoFrame* cur) -> VideoFrame* {
+                return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+            };
+            struct clock clock = {};
+            static double time_limit_ms = 20000.0;
+            clock_init(&clock);
+            clock_shift_ms(&clock, time_limit_ms);
+            uint64_t nframes = 0;
+            while (nframes < props.video[0].max_frame_count) {
+                EXPECT(clock_cmp_now(&clock) < 0,
+                       "Timeout at %f ms",
+                       clock_toc_ms(&clock) + time_limit_ms);
+                VideoFrame *beg, *end, *cur;
+                OK(acquire_map_read(runtime, 0, &beg, &end));
+                for (cur = beg; cur < end; cur = next(cur))
+                    ++nframes;
+                OK(acquire_unmap_read(
+                  runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+                clock_sleep_ms(0, 1.0f);
+            }
+        }
+        OK(acquire_stop(runtime));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,139 @@
+/// @file device-enumeration-cache.cpp
+/// Test that runtimes after the first list devices from what the first found,
+/// can still open them, and list them afresh when asked to.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Drivers whose devices came from the cache, each time devices were
+/// enumerated.
+static std::vector<int> ncached;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    if (!strncmp(msg, "Enumerated drivers ", 19)) {
+        const char* n = strrchr(msg, ',');
+        ncached.push_back(n ? atoi(n + 1) : -1);
+    }
+    printf("%s%s(%d) - %s: %s\n",
+           is_error ? "ERROR " : "",
+           file,
+           line,
+           function,
+           msg);
+}
+
+static void
+set_env(const char* name, const char* value)
+{
+#ifdef _WIN32
+    CHECK(_putenv_s(name, value) == 0);
+#else
+    CHECK(setenv(name, value, 1) == 0);
+#endif
+}
+
+/// @returns The name of every device `runtime` knows about, in order.
+static std::vector<std::string>
+list_devices(AcquireRuntime* runtime)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+    std::vector<std::string> out;
+    for (uint32_t i = 0; i < device_manager_count(dm); ++i) {
+        struct DeviceIdentifier identifier = {};
+        DEVOK(device_manager_get(&identifier, dm, i));
+        out.emplace_back(identifier.name);
+    }
+    return out;
+}
+
+/// Streams a few frames from the simulated random camera to trash.
+static void
+stream(AcquireRuntime* runtime)
+{
+    auto dm = acquire_device_manager(runtime);
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                "simulated.*random.*",
+                                19,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, "trash", 5, &props.video[0].storage.identifier));
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = 5;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        set_env(DEVICE_MANAGER_LAZY_ENV, "0");
+
+        // The first runtime enumerates every driver.
+        auto runtime = acquire_init(reporter);
+        CHECK(runtime);
+        CHECK(ncached.size() == 1 && ncached[0] == 0);
+        const auto expected = list_devices(runtime);
+        CHECK(!expected.empty());
+        acquire_shutdown(runtime);
+
+        // The next lists them all from the cache, and loads the simulated
+        // devices' driver when one is opened.
+        runtime = acquire_init(reporter);
+        CHECK(runtime);
+        CHECK(ncached.size() == 2 && ncached[1] == 6);
+        CHECK(list_devices(runtime) == expected);
+        stream(runtime);
+
+        // Until asked to list them afresh.
+        DEVOK(device_manager_refresh(acquire_device_manager(runtime)));
+        CHECK(ncached.size() == 3 && ncached[2] == 0);
+        CHECK(list_devices(runtime) == expected);
+        stream(runtime);
+        acquire_shutdown(runtime);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
@@ -0,0 +1,87 @@
+/// @file filter-kernel-throughput.cpp
+/// Benchmark. Times every filter kernel on every instruction set the CPU
+/// supports (plain, AVX2, AVX-512 or NEON) over a range of frame sizes, and
+/// prints the throughput of each as JSON.
+///
+/// Usage: `filter-kernel-throughput [min_ms]`, where `min_ms` is how long
+/// each kernel runs at each size. Longer runs give steadier numbers.
+
+#include "runtime/filter.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+/// Samples per frame: fits in L1, fits in L2, and streams from memory.
+static const size_t frame_sizes[] = { 1 << 12, 1 << 16, 1 << 22 };
+
+static void
+report(void* json_, const struct video_filter_kernel_timing* t)
+{
+    auto* json = (std::string*)json_;
+    char buf[256] = { 0 };
+    snprintf(buf,
+             sizeof(buf),
+             "%s  {\"isa\": \"%s\", \"kernel\": \"%s\", \"samples\": %llu, "
+             "\"gigabytes_per_second\": %.3f}",
+             json->back() == '[' ? "\n" : ",\n",
+             t->isa,
+             t->kernel,
+             (unsigned long long)t->nsamples,
+             1e-9 * t->bytes_per_second);
+    *json += buf;
+}
+
+int
+main(int argc, char* argv[])
+{
+    logger_set_reporter(reporter);
+    const double min_ms = argc > 1 ? atof(argv[1]) : 2.0;
+    try {
+        std::string json = "{\"benchmark\": \"" TEST "\", \"runs\": [";
+        for (const size_t n : frame_sizes)
+            CHECK(video_filter_time_kernels(n, min_ms, report, &json));
+        json += "\n]}\n";
+        fputs(json.c_str(), stdout);
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+        return 1;
+    } catch (...) {
+        ERR("Exception: (unknown)");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+/// @file filter-pipeline.cpp
+/// Test that frames pass through a chain of filter stages configured on a
+/// stream, that storage gets frames of the chain's output shape and type,
+/// that running averages emit a frame for every camera frame, that block
+/// averages can keep the camera's sample type, that projections emit a frame
+/// per window, that 12-bit samples can be packed on their way to storage,
+/// and that invalid stages are rejected.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime, AcquireProperties& props)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 20;
+}
+
+/// Acquires until `expected_nframes` frames have been read, passing each
+/// one to `check`.
+static void
+acquire(AcquireRuntime* runtime,
+        uint64_t expected_nframes,
+        const std::function<void(const VideoFrame*)>& check)
+{
+    const auto next = [](VideoFrame* cur) -> VideoFrame* {
+        return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+    };
+
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t nframes = 0;
+    while (nframes < expected_nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end; cur = next(cur)) {
+            check(cur);
+            ++nframes;
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 1.0f);
+    }
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        AcquireProperties props = {};
+        configure(runtime, props);
+        const uint64_t nframes = props.video[0].max_frame_count;
+
+        // A bin of 0 is rejected.
+        props.video[0].filters[0] = { .kind = AcquireFilter_Bin,
+                                      .binning = 0 };
+        acquire_configure(runtime, &props);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        // (x - 1) * 2, cropped to 32x16 at (8,4), binned 2x and cast to i16.
+        std::vector<float> dark(64 * 48, 1.0f), gain(64 * 48, 2.0f);
+        OK(acquire_set_flat_field(
+          runtime, 0, 1, 64, 48, dark.data(), gain.data()));
+
+        configure(runtime, props);
+        props.video[0].filters[0] = { .kind = AcquireFilter_FlatField };
+        props.video[0].filters[1] = { .kind = AcquireFilter_Crop,
+                                      .roi = { 8, 4, 32, 16 } };
+        props.video[0].filters[2] = { .kind = AcquireFilter_Bin,
+                                      .binning = 2 };
+        props.video[0].filters[3] = { .kind = AcquireFilter_Cast,
+                                      .sample_type = SampleType_i16 };
+        OK(acquire_configure(runtime, &props));
+        {
+            AcquireProperties actual = {};
+            OK(acquire_get_configuration(runtime, &actual));
+            CHECK(actual.video[0].filters[1].kind == AcquireFilter_Crop);
+            CHECK(actual.video[0].filters[1].roi.width == 32);
+            CHECK(actual.video[0].filters[2].binning == 2);
+            CHECK(actual.video[0].filters[3].sample_type == SampleType_i16);
+        }
+
+        acquire(runtime, nframes, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_i16);
+            CHECK(cur->shape.dims.width == 16);
+            CHECK(cur->shape.dims.height == 8);
+            CHECK(cur->shape.strides.height == 16);
+            const int16_t* px = (const int16_t*)cur->data;
+            for (int i = 0; i < 16 * 8; ++i)
+                EXPECT(-2 <= px[i] && px[i] <= 508,
+                       "Pixel %d of frame %llu is %d.",
+                       i,
+                       (unsigned long long)cur->frame_id,
+                       (int)px[i]);
+        });
+
+        // Running averages keep the camera's frame rate.
+        configure(runtime, props);
+        for (auto& filter : props.video[0].filters)
+            filter = {};
+        props.video[0].filters[0] = { .kind = AcquireFilter_Average,
+                                      .frame_count = 4,
+                                      .average_mode = AcquireAverage_Sliding };
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_f32);
+            CHECK(cur->shape.dims.width == 64);
+            CHECK(cur->shape.dims.height == 48);
+        });
+
+        props.video[0].filters[0].average_mode = AcquireAverage_Exponential;
+        props.video[0].filters[0].alpha = 0.25f;
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_f32);
+        });
+
+        // Block averages can keep the camera's sample type.
+        props.video[0].filters[0] = {
+            .kind = AcquireFilter_Average,
+            .frame_count = 2,
+            .average_output = AcquireAverageOutput_Native,
+        };
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes / 2, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_u8);
+            CHECK(cur->bytes_of_frame < sizeof(VideoFrame) + 2 * 64 * 48);
+        });
+
+        // Projections emit one frame per window.
+        props.video[0].filters[0] = {
+            .kind = AcquireFilter_Project,
+            .frame_count = 4,
+            .projection = AcquireProjection_Max,
+        };
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes / 4, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_u8);
+            CHECK(cur->shape.dims.width == 64);
+        });
+
+        // u8 samples cast to u12 and packed take 1.5 bytes each, and unpack
+        // to what the camera sent.
+        props.video[0].filters[0] = { .kind = AcquireFilter_Cast,
+                                      .sample_type = SampleType_u12 };
+        props.video[0].filters[1] = { .kind = AcquireFilter_Pack };
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes, [](const VideoFrame* cur) {
+            CHECK(cur->shape.type == SampleType_u12p);
+            CHECK(bytes_of_image(&cur->shape) == 64 * 48 * 3 / 2);
+            CHECK(cur->bytes_of_frame < sizeof(VideoFrame) + 2 * 64 * 48);
+            std::vector<uint16_t> px(64 * 48);
+            OK(acquire_unpack_frame(cur, px.data(), px.size()));
+            for (size_t i = 0; i < px.size(); ++i)
+                EXPECT(px[i] <= 255,
+                       "Pixel %d of frame %llu is %d.",
+                       (int)i,
+                       (unsigned long long)cur->frame_id,
+                       (int)px[i]);
+        });
+
+        // Nothing can follow a pack.
+        props.video[0].filters[2] = { .kind = AcquireFilter_Crop,
+                                      .roi = { 0, 0, 8, 8 } };
+        acquire_configure(runtime, &props);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+        configure(runtime, props);
+        for (auto& filter : props.video[0].filters)
+            filter = {};
+
+        // The flat field can't change while running, but can afterwards.
+        OK(acquire_set_flat_field(runtime, 0, 1, 64, 48, 0, 0));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
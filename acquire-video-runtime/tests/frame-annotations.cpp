@@ -0,0 +1,238 @@
+/// @file frame-annotations.cpp
+/// Test that records pushed with `acquire_annotate_frame()` while a stream
+/// runs are joined to its frames and written next to the raw file, and that
+/// storage that doesn't take them drops them.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// The layout of the records file, as a reader outside the project would see
+// it.
+#pragma pack(push, 1)
+struct annotation_file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bytes_of_header;
+};
+#pragma pack(pop)
+
+constexpr uint64_t nframes = 200;
+constexpr uint32_t nrecords = 100;
+
+static void
+configure(AcquireRuntime* runtime, const char* storage, const char* filename)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Runs a stream, pushing a record for every other frame while it does,
+/// one for when it started, and one for a frame it never gets to.
+static AcquireStreamStats
+acquire_annotated(AcquireRuntime* runtime,
+                  const char* storage,
+                  const std::string& filename)
+{
+    configure(runtime, storage, filename.c_str());
+    // Not running yet.
+    CHECK(AcquireStatus_Error ==
+          acquire_annotate_frame(
+            runtime, 0, FrameAnnotationJoin_FrameId, 0, 0, 0, 0));
+
+    OK(acquire_start(runtime));
+    // Too big.
+    std::vector<uint8_t> big(4097);
+    CHECK(AcquireStatus_Error ==
+          acquire_annotate_frame(runtime,
+                                 0,
+                                 FrameAnnotationJoin_FrameId,
+                                 0,
+                                 0,
+                                 big.data(),
+                                 big.size()));
+    for (uint32_t i = 0; i < nrecords; ++i)
+        OK(acquire_annotate_frame(
+          runtime, 0, FrameAnnotationJoin_FrameId, 2 * i, i, &i, sizeof(i)));
+    OK(acquire_annotate_frame(runtime,
+                              0,
+                              FrameAnnotationJoin_Timestamp,
+                              clock_tic(0),
+                              nrecords,
+                              0,
+                              0));
+    OK(acquire_annotate_frame(
+      runtime, 0, FrameAnnotationJoin_FrameId, 1ULL << 40, nrecords + 1, 0, 0));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStats stats = {};
+    OK(acquire_get_stream_stats(runtime, 0, &stats));
+    CHECK(stats.annotations_pushed == nrecords + 2);
+    CHECK(stats.annotations_stored + stats.annotations_dropped ==
+          nrecords + 2);
+    return stats;
+}
+
+static std::vector<uint8_t>
+read_file(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Checks the records written next to `filename`, in the order they were
+/// pushed, each with a frame at or after the one it asked for.
+static void
+check_records(const std::string& filename)
+{
+    const std::vector<uint8_t> data = read_file(filename + ".ann");
+    annotation_file_header header = {};
+    CHECK(data.size() >= sizeof(header));
+    memcpy(&header, data.data(), sizeof(header));
+    CHECK(0 == memcmp(header.magic, "acqann\0", sizeof(header.magic)));
+    CHECK(header.version == 1);
+    CHECK(header.bytes_of_header == sizeof(header));
+
+    uint32_t n = 0;
+    uint64_t last_frame_id = 0;
+    for (size_t offset = header.bytes_of_header; offset < data.size();) {
+        FrameAnnotation record = {};
+        CHECK(offset + sizeof(record) <= data.size());
+        memcpy(&record, data.data() + offset, sizeof(record));
+        CHECK(record.bytes_of_annotation % 8 == 0);
+        CHECK(offset + record.bytes_of_annotation <= data.size());
+        EXPECT(record.tag == n, "Expected record %u. Got %u.", n, record.tag);
+        CHECK(record.frame_id < nframes);
+        if (n < nrecords) {
+            CHECK(record.join == FrameAnnotationJoin_FrameId);
+            CHECK(record.frame_id >= 2 * n);
+            CHECK(record.frame_id >= last_frame_id);
+            last_frame_id = record.frame_id;
+            uint32_t payload = 0;
+            CHECK(record.bytes_of_data == sizeof(payload));
+            memcpy(&payload,
+                   data.data() + offset + sizeof(record),
+                   sizeof(payload));
+            CHECK(payload == n);
+        } else {
+            CHECK(record.join == FrameAnnotationJoin_Timestamp);
+            CHECK(record.bytes_of_data == 0);
+        }
+        offset += record.bytes_of_annotation;
+        ++n;
+    }
+    // The last record never found its frame.
+    CHECK(n == nrecords + 1);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        {
+            const std::string filename = std::string(TEST) + ".raw";
+            const AcquireStreamStats stats =
+              acquire_annotated(runtime, "raw", filename);
+            CHECK(stats.annotations_stored == nrecords + 1);
+            CHECK(stats.annotations_dropped == 1);
+            check_records(filename);
+        }
+        {
+            // TIFF files don't keep records.
+            const AcquireStreamStats stats = acquire_annotated(
+              runtime, "tiff", std::string(TEST) + ".tif");
+            CHECK(stats.annotations_stored == 0);
+            CHECK(stats.annotations_dropped == nrecords + 2);
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
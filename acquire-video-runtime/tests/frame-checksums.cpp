@@ -0,0 +1,171 @@
+/// @file frame-checksums.cpp
+/// Test that, with `enable_frame_checksums`, each frame stored in a raw file
+/// carries the CRC32C of its data, in either header layout, and that frames
+/// remade by a filter stage carry that of their own data.
+
+#include "acquire.h"
+#include "crc32c.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 20;
+static const char* const path = TEST ".raw";
+
+static void
+acquire(AcquireRuntime* runtime,
+        int enable_checksums,
+        int enable_compact_frame_headers,
+        int enable_crop)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("raw") - 1, &video.storage.identifier));
+    // The settings read back alias the storage device's own.
+    CHECK(storage_properties_init(&video.storage.settings,
+                                  0,
+                                  path,
+                                  strlen(path) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    video.storage.settings.enable_compact_frame_headers =
+      (uint8_t)enable_compact_frame_headers;
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = 64, .y = 48 };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    video.enable_frame_checksums = (uint8_t)enable_checksums;
+    memset(video.filters, 0, sizeof(video.filters)); // NOLINT
+    if (enable_crop)
+        video.filters[0] = { .kind = AcquireFilter_Crop,
+                             .roi = { 3, 5, 17, 11 } };
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].enable_frame_checksums == enable_checksums);
+    storage_properties_destroy(&video.storage.settings);
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+}
+
+/// Checks each frame's stored checksum against the CRC32C of its data.
+static void
+check_file(int enable_checksums, uint32_t width)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, path));
+    try {
+        CHECK(raw_reader_frame_count(&reader) == nframes);
+        for (size_t i = 0; i < nframes; ++i) {
+            VideoFrame header = {};
+            const uint8_t* data = 0;
+            CHECK(raw_reader_frame_header(&reader, i, &header, &data));
+            CHECK(header.shape.dims.width == width);
+            CHECK(header.has_checksum == (uint32_t)enable_checksums);
+            if (!enable_checksums)
+                continue;
+            const uint32_t expected =
+              crc32c(0, data, bytes_of_image(&header.shape));
+            EXPECT(header.checksum == expected,
+                   "Frame %llu: expected checksum 0x%08x. Got 0x%08x.",
+                   (unsigned long long)i,
+                   expected,
+                   header.checksum);
+        }
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        LOG("crc32c kernels: %s", crc32c_kernels_name());
+
+        acquire(runtime, 1, 0, 0);
+        check_file(1, 64);
+
+        acquire(runtime, 1, 1, 0);
+        check_file(1, 64);
+
+        // Cropped frames aren't the ones the checksum was computed for.
+        acquire(runtime, 1, 0, 1);
+        check_file(1, 17);
+
+        acquire(runtime, 0, 1, 0);
+        check_file(0, 64);
+        remove(path);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
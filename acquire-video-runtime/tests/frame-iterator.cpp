@@ -0,0 +1,175 @@
+/// @file frame-iterator.cpp
+/// Test that clients can step through mapped frames with
+/// acquire_frame_iterator_next(), and list them in batches with
+/// acquire_list_frames(), and that both stop at frames that don't fit.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Frames listed per call. Less than what's usually mapped at once, so the
+/// rest of a region is listed by later calls.
+constexpr size_t batch = 3;
+
+/// A region whose second frame claims to be bigger than what's left.
+static void
+check_truncated_region()
+{
+    alignas(VideoFrame) uint8_t buf[4 * sizeof(VideoFrame)] = {};
+    auto* first = (VideoFrame*)buf;
+    auto* second = (VideoFrame*)(buf + 2 * sizeof(VideoFrame));
+    first->bytes_of_frame = 2 * sizeof(VideoFrame);
+    first->shape.dims = { .channels = 1, .width = 1, .height = 1, .planes = 1 };
+    second->bytes_of_frame = 3 * sizeof(VideoFrame);
+    auto* end = (VideoFrame*)(buf + sizeof(buf));
+
+    auto it = acquire_frame_iterator_init(first, end);
+    CHECK(acquire_frame_iterator_next(&it) == first);
+    CHECK(acquire_frame_iterator_next(&it) == 0);
+    CHECK(acquire_frame_iterator_next(&it) == 0);
+
+    AcquireFrameRef frames[batch] = {};
+    size_t count = 0, nbytes = 0;
+    CHECK(acquire_list_frames(first, end, frames, batch, &count, &nbytes) ==
+          AcquireStatus_Error);
+    CHECK(count == 1);
+    CHECK(frames[0].frame == first);
+    CHECK(nbytes == first->bytes_of_frame);
+
+    // A frame of no size would otherwise be visited forever.
+    second->bytes_of_frame = 0;
+    it = acquire_frame_iterator_init(second, end);
+    CHECK(acquire_frame_iterator_next(&it) == 0);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        check_truncated_region();
+
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*empty.*") - 1,
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[0].storage.identifier));
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        props.video[0].max_frame_count = 100;
+        props.video[0].channel_capacity_bytes = 1ULL << 20;
+        OK(acquire_configure(runtime, &props));
+
+        struct clock clock = {};
+        static double time_limit_ms = 20000.0;
+        clock_init(&clock);
+        clock_shift_ms(&clock, time_limit_ms);
+        OK(acquire_start(runtime));
+        uint64_t nframes = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end;
+            OK(acquire_map_read_wait(runtime, 0, 1000, &beg, &end));
+
+            // The iterator visits the frames the batches list.
+            auto it = acquire_frame_iterator_init(beg, end);
+            AcquireFrameRef frames[batch] = {};
+            size_t count = 0, nbytes = 0;
+            OK(acquire_list_frames(beg, end, frames, batch, &count, &nbytes));
+            CHECK(count <= batch);
+            CHECK(nbytes <= (size_t)((uint8_t*)end - (uint8_t*)beg));
+            for (size_t i = 0; i < count; ++i) {
+                const AcquireFrameRef& f = frames[i];
+                CHECK(f.frame == acquire_frame_iterator_next(&it));
+                EXPECT(f.frame->frame_id == nframes,
+                       "Expected frame %llu. Got %llu.",
+                       (unsigned long long)nframes,
+                       (unsigned long long)f.frame->frame_id);
+                CHECK(f.data == f.frame->data);
+                CHECK(f.bytes_of_data == 64 * 48);
+                CHECK(f.shape.dims.width == 64);
+                CHECK(f.shape.dims.height == 48);
+                CHECK(f.shape.type == SampleType_u8);
+                ++nframes;
+            }
+            // Only the listed frames are released. The rest are mapped again.
+            CHECK(count == batch || (uint8_t*)beg + nbytes == (uint8_t*)end);
+            OK(acquire_unmap_read(runtime, 0, nbytes));
+        }
+        OK(acquire_stop(runtime));
+
+        // An empty region lists nothing.
+        {
+            size_t count = 1, nbytes = 1;
+            OK(acquire_list_frames(0, 0, 0, 0, &count, &nbytes));
+            CHECK(count == 0);
+            CHECK(nbytes == 0);
+            auto it = acquire_frame_iterator_init(0, 0);
+            CHECK(acquire_frame_iterator_next(&it) == 0);
+        }
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
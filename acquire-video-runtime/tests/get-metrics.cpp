@@ -0,0 +1,154 @@
+/// @file get-metrics.cpp
+/// Test that acquire_get_metrics() reports every configured stream, that its
+/// counters only grow while the stream runs, and that after a stop they
+/// account for every frame that went through the camera, filter and storage.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+check_monotonic(const AcquireStreamMetrics& before,
+                const AcquireStreamMetrics& after)
+{
+    CHECK(after.elapsed_ms >= before.elapsed_ms);
+    CHECK(after.frames_in >= before.frames_in);
+    CHECK(after.frames_out >= before.frames_out);
+    CHECK(after.bytes_out >= before.bytes_out);
+    CHECK(after.filtered_frames >= before.filtered_frames);
+    CHECK(after.storage_append.count >= before.storage_append.count);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*") - 1,
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[0].storage.identifier));
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        props.video[0].camera.settings.exposure_time_us = 1e3f;
+        props.video[0].max_frame_count = 100;
+        props.video[0].filters[0] = { .kind = AcquireFilter_Crop,
+                                      .roi = { 8, 8, 32, 16 } };
+        OK(acquire_configure(runtime, &props));
+
+        AcquireMetrics metrics = {};
+        CHECK(acquire_get_metrics(nullptr, &metrics) == AcquireStatus_Error);
+        CHECK(acquire_get_metrics(runtime, nullptr) == AcquireStatus_Error);
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].is_valid);
+        CHECK(metrics.video[0].frames_in == 0);
+        CHECK(metrics.video[0].elapsed_ms == 0.0);
+        for (uint32_t i = 1; i < ACQUIRE_MAX_VIDEO_STREAMS; ++i)
+            CHECK(!metrics.video[i].is_valid);
+
+        OK(acquire_start(runtime));
+        AcquireStreamMetrics last = {};
+        while (acquire_get_state(runtime) == DeviceState_Running) {
+            OK(acquire_get_metrics(runtime, &metrics));
+            check_monotonic(last, metrics.video[0]);
+            last = metrics.video[0];
+            clock_sleep_ms(0, 5.0f);
+        }
+        OK(acquire_stop(runtime));
+
+        OK(acquire_get_metrics(runtime, &metrics));
+        const AcquireStreamMetrics& m = metrics.video[0];
+        check_monotonic(last, m);
+        const uint64_t nframes = props.video[0].max_frame_count;
+        CHECK(m.frames_in == nframes);
+        CHECK(m.frames_out == nframes);
+        CHECK(m.filtered_frames == nframes);
+        CHECK(m.bytes_out >= nframes * 32 * 16);
+        CHECK(m.elapsed_ms > 0.0);
+        CHECK(m.fps_in > 0.0 && m.fps_out > 0.0);
+        CHECK(m.bytes_per_second_out > 0.0);
+        CHECK(m.filter_ms_per_frame >= 0.0);
+        CHECK(m.storage_append.count > 0);
+        CHECK(m.storage_append.p50_ms <= m.storage_append.max_ms);
+        CHECK(m.storage_queue_capacity_bytes > 0);
+        CHECK(m.source_cpu_ms >= 0.0);
+        CHECK(m.filter_cpu_ms >= 0.0);
+        CHECK(m.sink_cpu_ms >= 0.0);
+        LOG("%.1f fps in, %.1f fps out, %.0f B/s to storage, %.3f ms per "
+            "filtered frame, CPU ms source %.1f filter %.1f sink %.1f",
+            m.fps_in,
+            m.fps_out,
+            m.bytes_per_second_out,
+            m.filter_ms_per_frame,
+            m.source_cpu_ms,
+            m.filter_cpu_ms,
+            m.sink_cpu_ms);
+
+        // The clock stops with the stream.
+        clock_sleep_ms(0, 10.0f);
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].elapsed_ms == m.elapsed_ms);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
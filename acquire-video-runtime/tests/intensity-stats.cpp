@@ -0,0 +1,156 @@
+/// @file intensity-stats.cpp
+/// Test that, with `enable_intensity_stats`, acquire_get_intensity_stats()
+/// reports the statistics of the stream's frames while it runs and once it
+/// has stopped, and that it's refused for streams without it.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 50;
+constexpr uint32_t width = 64, height = 48;
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = width, .y = height };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    video.enable_intensity_stats = 1;
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].enable_intensity_stats == 1);
+}
+
+/// Checks what holds for the statistics of any frame of the stream.
+static void
+check_consistent(const AcquireIntensityStats& stats)
+{
+    CHECK(stats.frames_measured > 0);
+    CHECK(stats.frames_measured <= nframes);
+    CHECK(stats.frame_id < nframes);
+    CHECK(stats.sample_type == SampleType_u8);
+    CHECK(stats.sample_count == width * height);
+    CHECK(stats.bin_lo == 0.0);
+    CHECK(stats.bin_width == 1.0);
+    CHECK(stats.min <= stats.mean && stats.mean <= stats.max);
+    CHECK(stats.max <= 255.0);
+    uint64_t total = 0;
+    for (auto count : stats.bins)
+        total += count;
+    CHECK(total == stats.sample_count);
+    CHECK(stats.bins[0] == stats.at_floor);
+    CHECK(stats.bins[255] == stats.at_ceiling);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+
+        AcquireIntensityStats stats = {};
+        OK(acquire_start(runtime));
+        struct clock clock = {};
+        clock_init(&clock);
+        do {
+            EXPECT(clock_toc_ms(&clock) < 10e3, "Timed out waiting for stats.");
+            clock_sleep_ms(0, 1.0f);
+            OK(acquire_get_intensity_stats(runtime, 0, &stats));
+        } while (stats.frames_measured == 0);
+        check_consistent(stats);
+        OK(acquire_stop(runtime));
+
+        // The last frames are measured before the stream stops.
+        OK(acquire_get_intensity_stats(runtime, 0, &stats));
+        check_consistent(stats);
+        CHECK(stats.frame_id == nframes - 1);
+        LOG("Measured %llu of %llu frames. Last: mean %f, stddev %f.",
+            (unsigned long long)stats.frames_measured,
+            (unsigned long long)nframes,
+            stats.mean,
+            stats.stddev);
+        CHECK(stats.stddev > 0.0);
+
+        // Counts start over with the next acquisition.
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        OK(acquire_get_intensity_stats(runtime, 0, &stats));
+        check_consistent(stats);
+        CHECK(stats.frame_id == nframes - 1);
+
+        // Streams without it are refused.
+        CHECK(acquire_get_intensity_stats(runtime, 1, &stats) ==
+              AcquireStatus_Error);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
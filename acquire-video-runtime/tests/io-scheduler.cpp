@@ -0,0 +1,123 @@
+/// @file io-scheduler.cpp
+/// Test that streams sharing a volume take turns appending, and that every
+/// frame still gets stored.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    props.io_bandwidth_bytes_per_second = 100ULL << 20;
+    for (int i = 0; i < 2; ++i) {
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*empty.*") - 1,
+                                    &props.video[i].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[i].storage.identifier));
+        auto* settings = &props.video[i].camera.settings;
+        settings->binning = 1;
+        settings->pixel_type = SampleType_u8;
+        settings->shape = { .x = 256, .y = 256 };
+        settings->exposure_time_us = 1e3;
+        props.video[i].max_frame_count = 100;
+        props.video[i].storage.io_is_scheduled = 1;
+        props.video[i].storage.io_priority = (uint8_t)i;
+        props.video[i].storage.io_share = 0.5f;
+    }
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties got = {};
+    OK(acquire_get_configuration(runtime, &got));
+    CHECK(got.io_bandwidth_bytes_per_second == 100ULL << 20);
+    CHECK(got.video[1].storage.io_is_scheduled);
+    CHECK(got.video[1].storage.io_priority == 1);
+    CHECK(got.video[1].storage.io_share == 0.5f);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        for (uint32_t i = 0; i < 2; ++i) {
+            AcquireStreamStats stats = {};
+            OK(acquire_get_stream_stats(runtime, i, &stats));
+            const AcquireLatencyStats* wait =
+              &stats.latency.io_scheduler_wait;
+            LOG("[stream %d] Waited for a turn %llu times: p50 %f ms, max "
+                "%f ms",
+                (int)i,
+                (unsigned long long)wait->count,
+                wait->p50_ms,
+                wait->max_ms);
+            CHECK(wait->count > 0);
+            CHECK(stats.storage_bytes_read > 0);
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,125 @@
+/// @file lazy-driver-loading.cpp
+/// Test that with lazy driver loading, only the simulated devices are loaded
+/// up front, the rest are loaded when a device can't be found without them,
+/// and devices are listed the same way either way.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+
+/// Messages about drivers being enumerated, like "Enumerated drivers 0-5 in
+/// ...", trimmed to the range of drivers.
+static std::vector<std::string> loads;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    if (!strncmp(msg, "Enumerated drivers ", 19))
+        loads.emplace_back(msg + 19, strcspn(msg + 19, " "));
+    printf("%s%s(%d) - %s: %s\n",
+           is_error ? "ERROR " : "",
+           file,
+           line,
+           function,
+           msg);
+}
+
+static void
+set_env(const char* name, const char* value)
+{
+#ifdef _WIN32
+    CHECK(_putenv_s(name, value) == 0);
+#else
+    CHECK(setenv(name, value, 1) == 0);
+#endif
+}
+
+/// @returns The name of every device `runtime` knows about, in order.
+static std::vector<std::string>
+list_devices(AcquireRuntime* runtime)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+    std::vector<std::string> out;
+    for (uint32_t i = 0; i < device_manager_count(dm); ++i) {
+        struct DeviceIdentifier identifier = {};
+        CHECK(Device_Ok == device_manager_get(&identifier, dm, i));
+        out.emplace_back(identifier.name);
+    }
+    return out;
+}
+
+int
+main()
+{
+    int retval = 1;
+    try {
+        set_env(DEVICE_MANAGER_LAZY_ENV, "0");
+        auto runtime = acquire_init(reporter);
+        CHECK(runtime);
+        CHECK(loads.size() == 1 && loads[0] == "0-5");
+        const auto expected = list_devices(runtime);
+        acquire_shutdown(runtime);
+
+        loads.clear();
+        set_env(DEVICE_MANAGER_LAZY_ENV, "1");
+        runtime = acquire_init(reporter);
+        CHECK(runtime);
+        EXPECT(loads.size() == 1 && loads[0] == "0-0",
+               "Expected only the first driver to be loaded.");
+
+        // Found without loading anything else.
+        auto dm = acquire_device_manager(runtime);
+        struct DeviceIdentifier identifier = {};
+        CHECK(Device_Ok == device_manager_select(dm,
+                                                 DeviceKind_Camera,
+                                                 "simulated.*random.*",
+                                                 19,
+                                                 &identifier));
+        CHECK(loads.size() == 1);
+
+        // Not found until everything's been loaded.
+        CHECK(Device_Err == device_manager_select(dm,
+                                                  DeviceKind_Camera,
+                                                  "no such camera",
+                                                  14,
+                                                  &identifier));
+        CHECK(loads.size() == 2 && loads[1] == "1-5");
+
+        CHECK(list_devices(runtime) == expected);
+        CHECK(loads.size() == 2);
+        acquire_shutdown(runtime);
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    return retval;
+}
@@ -0,0 +1,151 @@
+/// @file live-property-updates.cpp
+/// Test that a running camera's exposure time and shape can be changed with
+/// `acquire_update_properties()` without stopping the stream, and that
+/// changes that don't fit the running stream are refused.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 1ULL << 30;
+    OK(acquire_configure(runtime, &props));
+}
+
+/// Reads till a frame of `width` by `height` pixels comes through.
+/// @returns The id of that frame.
+static uint64_t
+wait_for_shape(AcquireRuntime* runtime, uint32_t width, uint32_t height)
+{
+    for (int i = 0; i < 100; ++i) {
+        VideoFrame *beg = 0, *end = 0;
+        OK(acquire_map_read_wait(runtime, 0, 100, &beg, &end));
+        for (auto* cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            if (cur->shape.dims.width == width &&
+                cur->shape.dims.height == height) {
+                const uint64_t frame_id = cur->frame_id;
+                OK(acquire_unmap_read(
+                  runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+                return frame_id;
+            }
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+    }
+    EXPECT(0, "Timed out waiting for %ux%u frames.", width, height);
+    return 0;
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        CHECK(AcquireStatus_Error ==
+              acquire_update_properties(runtime, &props));
+
+        OK(acquire_start(runtime));
+        const uint64_t first = wait_for_shape(runtime, 64, 48);
+
+        // Exposure and shape change between frames. Frame ids carry on.
+        props.video[0].camera.settings.exposure_time_us = 2e3f;
+        props.video[0].camera.settings.shape = { .x = 32, .y = 24 };
+        OK(acquire_update_properties(runtime, &props));
+        CHECK(props.video[0].camera.settings.shape.x == 32);
+        CHECK(props.video[0].camera.settings.shape.y == 24);
+        CHECK(wait_for_shape(runtime, 32, 24) > first);
+        CHECK(acquire_get_state(runtime) == DeviceState_Running);
+
+        // Frames can't outgrow the queues, and the sample type can't change.
+        AcquireProperties bigger = props;
+        bigger.video[0].camera.settings.shape = { .x = 128, .y = 96 };
+        CHECK(AcquireStatus_Error ==
+              acquire_update_properties(runtime, &bigger));
+        AcquireProperties wider = props;
+        wider.video[0].camera.settings.pixel_type = SampleType_u16;
+        CHECK(AcquireStatus_Error ==
+              acquire_update_properties(runtime, &wider));
+        CHECK(acquire_get_state(runtime) == DeviceState_Running);
+
+        // Back to the full frame, which the queues were sized for.
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        OK(acquire_update_properties(runtime, &props));
+        wait_for_shape(runtime, 64, 48);
+
+        OK(acquire_abort(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,144 @@
+/// @file lossy-monitor-does-not-stall-storage.cpp
+/// Test that a lossy monitor that stops reading doesn't hold back the camera or
+/// storage, and that it resumes at the newest frame.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static AcquireProperties
+configure(AcquireRuntime* runtime)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 500;
+    // Holds about 20 frames, so the monitor is lapped many times.
+    props.video[0].channel_capacity_bytes = 1ULL << 16;
+    props.video[0].monitor_is_lossy = 1;
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].monitor_is_lossy == 1);
+    return props;
+}
+
+static void
+acquire(AcquireRuntime* runtime, const AcquireProperties& props)
+{
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+
+    VideoFrame *beg, *end;
+    OK(acquire_start(runtime));
+
+    // Registers the monitor, then stops reading.
+    OK(acquire_map_read(runtime, 0, &beg, &end));
+    OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+
+    // A lossless monitor would stall the camera here.
+    while (DeviceState_Running == acquire_get_state(runtime)) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        clock_sleep_ms(0, 10.0f);
+    }
+
+    OK(acquire_map_read(runtime, 0, &beg, &end));
+    CHECK(beg < end);
+    EXPECT((uint8_t*)beg + beg->bytes_of_frame == (uint8_t*)end,
+           "Expected only the newest frame.");
+    EXPECT(beg->frame_id == props.video[0].max_frame_count - 1,
+           "Expected frame %llu. Got %llu.",
+           (unsigned long long)props.video[0].max_frame_count - 1,
+           (unsigned long long)beg->frame_id);
+    CHECK(acquire_get_monitor_skipped_frames(runtime, 0) > 0);
+    OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, configure(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
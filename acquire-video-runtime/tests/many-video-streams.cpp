@@ -0,0 +1,144 @@
+/// @file many-video-streams.cpp
+/// Test that one runtime drives more than two video streams at once, each
+/// delivering all of its frames, and that streams past the last are
+/// rejected.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        const uint32_t nstreams = 4;
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        for (uint32_t i = 0; i < nstreams; ++i) {
+            auto& video = props.video[i];
+            DEVOK(device_manager_select(dm,
+                                        DeviceKind_Camera,
+                                        SIZED("simulated.*random.*") - 1,
+                                        &video.camera.identifier));
+            DEVOK(device_manager_select(dm,
+                                        DeviceKind_Storage,
+                                        SIZED("trash") - 1,
+                                        &video.storage.identifier));
+            video.camera.settings.binning = 1;
+            video.camera.settings.pixel_type = SampleType_u8;
+            video.camera.settings.shape = { .x = 32 + 8 * i, .y = 32 };
+            video.camera.settings.exposure_time_us = 1e3f;
+            video.max_frame_count = 20 + 10 * i;
+            video.channel_capacity_bytes = 1ULL << 20;
+        }
+        OK(acquire_configure(runtime, &props));
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+
+        {
+            VideoFrame *beg = 0, *end = 0;
+            CHECK(acquire_map_read(
+                    runtime, ACQUIRE_MAX_VIDEO_STREAMS, &beg, &end) ==
+                  AcquireStatus_Error);
+        }
+
+        const auto next = [](VideoFrame* cur) -> VideoFrame* {
+            return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+        };
+
+        struct clock clock = {};
+        static double time_limit_ms = 20000.0;
+        clock_init(&clock);
+        clock_shift_ms(&clock, time_limit_ms);
+        OK(acquire_start(runtime));
+        uint64_t nframes[nstreams] = {};
+        for (uint32_t done = 0; done < nstreams;) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            done = 0;
+            for (uint32_t i = 0; i < nstreams; ++i) {
+                VideoFrame *beg, *end, *cur;
+                OK(acquire_map_read(runtime, i, &beg, &end));
+                for (cur = beg; cur < end; cur = next(cur)) {
+                    EXPECT(cur->frame_id == nframes[i],
+                           "Stream %u: expected frame %llu. Got %llu.",
+                           i,
+                           (unsigned long long)nframes[i],
+                           (unsigned long long)cur->frame_id);
+                    CHECK(cur->shape.dims.width ==
+                          props.video[i].camera.settings.shape.x);
+                    ++nframes[i];
+                }
+                OK(acquire_unmap_read(
+                  runtime, i, (uint8_t*)end - (uint8_t*)beg));
+                done += nframes[i] == props.video[i].max_frame_count;
+            }
+            clock_sleep_ms(0, 1.0f);
+        }
+        OK(acquire_stop(runtime));
+
+        for (uint32_t i = 0; i < nstreams; ++i) {
+            AcquireStreamStats stats = {};
+            OK(acquire_get_stream_stats(runtime, i, &stats));
+            CHECK(stats.latency.sink_to_storage.count ==
+                  props.video[i].max_frame_count);
+        }
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
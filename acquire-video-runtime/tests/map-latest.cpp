@@ -0,0 +1,160 @@
+/// @file map-latest.cpp
+/// Test that acquire_map_latest() hands out only the newest frame, counting
+/// the frames it skips, so a slow display keeps up with the camera.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static AcquireProperties
+configure(AcquireRuntime* runtime)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 300;
+    // Holds about 20 frames. The monitor is lossless, so a display reading
+    // every frame slowly would hold back the camera.
+    props.video[0].channel_capacity_bytes = 1ULL << 16;
+
+    OK(acquire_configure(runtime, &props));
+    return props;
+}
+
+static void
+acquire(AcquireRuntime* runtime, const AcquireProperties& props)
+{
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+
+    OK(acquire_start(runtime));
+
+    uint64_t handed_out = 0, last_id = 0;
+    VideoFrame* frame = 0;
+    while (1) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        // Checked before mapping, so the last map sees every frame.
+        const int is_running =
+          DeviceState_Running == acquire_get_state(runtime);
+        OK(acquire_map_latest(runtime, 0, &frame));
+        if (frame) {
+            EXPECT(!handed_out || frame->frame_id > last_id,
+                   "Expected frame ids to increase. Got %llu after %llu.",
+                   (unsigned long long)frame->frame_id,
+                   (unsigned long long)last_id);
+            last_id = frame->frame_id;
+            ++handed_out;
+            OK(acquire_unmap_read(runtime, 0, frame->bytes_of_frame));
+        }
+        if (!is_running)
+            break;
+        // A display refreshing slower than the camera.
+        clock_sleep_ms(0, 20.0f);
+    }
+
+    EXPECT(last_id == props.video[0].max_frame_count - 1,
+           "Expected the last frame handed out to be %llu. Got %llu.",
+           (unsigned long long)props.video[0].max_frame_count - 1,
+           (unsigned long long)last_id);
+    const uint64_t skipped = acquire_get_monitor_skipped_frames(runtime, 0);
+    LOG("Handed out %llu frames, skipping %llu.",
+        (unsigned long long)handed_out,
+        (unsigned long long)skipped);
+    CHECK(skipped > 0);
+    CHECK(handed_out + skipped <= props.video[0].max_frame_count);
+
+    // Nothing is left behind the newest frame.
+    OK(acquire_map_latest(runtime, 0, &frame));
+    CHECK(!frame);
+    VideoFrame *beg, *end;
+    OK(acquire_map_read(runtime, 0, &beg, &end));
+    CHECK(beg == end);
+    OK(acquire_unmap_read(runtime, 0, 0));
+
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, configure(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
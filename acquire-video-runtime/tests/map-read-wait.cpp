@@ -0,0 +1,145 @@
+/// @file map-read-wait.cpp
+/// Test that acquire_map_read_wait() blocks until frames arrive instead of
+/// returning empty regions, that it delivers every frame, and that it
+/// returns empty once the stream has no more frames to give.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*") - 1,
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[0].storage.identifier));
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        // Slow enough that a client that doesn't wait would see empty
+        // regions.
+        props.video[0].camera.settings.exposure_time_us = 2e4f;
+        props.video[0].max_frame_count = 20;
+        props.video[0].channel_capacity_bytes = 1ULL << 20;
+        OK(acquire_configure(runtime, &props));
+
+        const auto next = [](VideoFrame* cur) -> VideoFrame* {
+            return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+        };
+
+        struct clock clock = {};
+        static double time_limit_ms = 20000.0;
+        clock_init(&clock);
+        clock_shift_ms(&clock, time_limit_ms);
+        OK(acquire_start(runtime));
+        uint64_t nframes = 0, nempty = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_map_read_wait(runtime, 0, 1000, &beg, &end));
+            nempty += beg == end;
+            for (cur = beg; cur < end; cur = next(cur)) {
+                EXPECT(cur->frame_id == nframes,
+                       "Expected frame %llu. Got %llu.",
+                       (unsigned long long)nframes,
+                       (unsigned long long)cur->frame_id);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        }
+        // A wait can come back empty when the stream stops, but a client
+        // that waits never polls for each frame.
+        EXPECT(nempty <= 2,
+               "Got %llu empty regions.",
+               (unsigned long long)nempty);
+
+        // Nothing more is coming, so the wait comes back empty.
+        {
+            struct clock timer = {};
+            clock_init(&timer);
+            VideoFrame *beg, *end;
+            OK(acquire_map_read_wait(runtime, 0, 50, &beg, &end));
+            CHECK(beg == end);
+            OK(acquire_unmap_read(runtime, 0, 0));
+            CHECK(clock_toc_ms(&timer) < 5000.0);
+        }
+        OK(acquire_stop(runtime));
+
+        // Out of bounds.
+        {
+            VideoFrame *beg, *end;
+            CHECK(acquire_map_read_wait(runtime,
+                                        ACQUIRE_MAX_VIDEO_STREAMS,
+                                        1,
+                                        &beg,
+                                        &end) == AcquireStatus_Error);
+        }
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,153 @@
+/// @file memory-budget.cpp
+/// Test that `memory_budget_bytes` sizes the queues of streams that don't set
+/// `channel_capacity_bytes`, in proportion to their bytes per second, and
+/// that a stream that sets its own keeps it and counts against the budget.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+constexpr uint64_t MiB = 1ULL << 20;
+
+static void
+configure_stream(const DeviceManager* dm,
+                 AcquireProperties::aq_properties_video_s& video,
+                 const char* camera,
+                 uint32_t width,
+                 uint32_t height,
+                 SampleType pixel_type)
+{
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Camera, camera, strlen(camera), &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = pixel_type;
+    video.camera.settings.shape = { .x = width, .y = height };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = 10;
+    video.channel_capacity_bytes = 0;
+}
+
+/// Checks `actual` is `expected` give or take rounding to whole frames.
+static void
+check_near(uint64_t actual, uint64_t expected)
+{
+    EXPECT(actual + MiB / 8 > expected && actual < expected + MiB / 8,
+           "Expected about %llu bytes. Got %llu.",
+           (unsigned long long)expected,
+           (unsigned long long)actual);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquirePropertyMetadata metadata = {};
+        OK(acquire_get_configuration_metadata(runtime, &metadata));
+        CHECK(metadata.memory_budget_bytes.writable);
+        CHECK(metadata.memory_budget_bytes.high > 0.0f);
+
+        // The second stream delivers 8 times the bytes of the first.
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        configure_stream(
+          dm, props.video[0], "simulated.*random.*", 64, 48, SampleType_u8);
+        configure_stream(
+          dm, props.video[1], "simulated.*sin.*", 128, 96, SampleType_u16);
+        props.memory_budget_bytes = 90 * MiB;
+        OK(acquire_configure(runtime, &props));
+
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.memory_budget_bytes == 90 * MiB);
+        check_near(actual.video[0].channel_capacity_bytes, 10 * MiB);
+        check_near(actual.video[1].channel_capacity_bytes, 80 * MiB);
+
+        // Configuring with what was reported splits the budget again.
+        actual.video[1].camera.settings.exposure_time_us = 8e3f;
+        OK(acquire_configure(runtime, &actual));
+        OK(acquire_get_configuration(runtime, &actual));
+        check_near(actual.video[0].channel_capacity_bytes, 45 * MiB);
+        check_near(actual.video[1].channel_capacity_bytes, 45 * MiB);
+
+        // A stream that sizes its own queues keeps them, and averaging
+        // splits a stream's share across two queues.
+        actual.video[0].channel_capacity_bytes = 10 * MiB;
+        actual.video[1].frame_average_count = 2;
+        OK(acquire_configure(runtime, &actual));
+        OK(acquire_get_configuration(runtime, &actual));
+        check_near(actual.video[0].channel_capacity_bytes, 10 * MiB);
+        check_near(actual.video[1].channel_capacity_bytes, 40 * MiB);
+
+        // Streams run with their share.
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        // Without a budget, unsized queues take the default.
+        actual.memory_budget_bytes = 0;
+        actual.video[1].channel_capacity_bytes = 0;
+        OK(acquire_configure(runtime, &actual));
+        OK(acquire_get_configuration(runtime, &actual));
+        check_near(actual.video[1].channel_capacity_bytes, 1024 * MiB);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,186 @@
+/// @file monitor-read-holds.cpp
+/// Test that a stream's queue can be allocated by the client, and that a
+/// region kept with `acquire_unmap_read_and_hold()` stays intact, even on a
+/// lossy monitor, while the client reads on, till it's released.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Stands in for cudaHostAlloc() and cudaFreeHost().
+struct pinned_memory
+{
+    uint8_t* data;
+    size_t nbytes;
+    int allocs, frees;
+};
+
+static void*
+pinned_alloc(void* ctx, size_t nbytes)
+{
+    auto* self = (pinned_memory*)ctx;
+    self->data = (uint8_t*)aligned_alloc(4096, (nbytes + 4095) & ~4095ULL);
+    self->nbytes = nbytes;
+    ++self->allocs;
+    return self->data;
+}
+
+static void
+pinned_free(void* ctx, void* data, size_t nbytes)
+{
+    auto* self = (pinned_memory*)ctx;
+    CHECK(data == self->data && nbytes == self->nbytes);
+    ++self->frees;
+    free(data);
+}
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].channel_capacity_bytes = 1 << 16;
+    props.video[0].monitor_is_lossy = 1;
+    OK(acquire_configure(runtime, &props));
+}
+
+/// Maps the next region, waiting for one.
+static void
+map_next(AcquireRuntime* runtime, VideoFrame** beg, VideoFrame** end)
+{
+    for (int i = 0; i < 100; ++i) {
+        OK(acquire_map_read_wait(runtime, 0, 100, beg, end));
+        if (*end > *beg)
+            return;
+    }
+    EXPECT(0, "Timed out waiting for frames.");
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+    pinned_memory pinned = {};
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+        const AcquireChannelAllocator allocator = {
+            .alloc = pinned_alloc,
+            .free = pinned_free,
+            .ctx = &pinned,
+        };
+        OK(acquire_set_channel_allocator(runtime, 0, &allocator));
+        OK(acquire_start(runtime));
+        CHECK(pinned.allocs == 1);
+        CHECK(AcquireStatus_Error ==
+              acquire_set_channel_allocator(runtime, 0, nullptr));
+
+        VideoFrame *beg = 0, *end = 0;
+        map_next(runtime, &beg, &end);
+        CHECK((uint8_t*)beg >= pinned.data &&
+              (uint8_t*)end <= pinned.data + pinned.nbytes);
+        VideoFrame* const held = beg;
+        const uint64_t held_id = held->frame_id;
+        AcquireReadHold* hold = 0;
+        OK(acquire_unmap_read_and_hold(
+          runtime, 0, (uint8_t*)end - (uint8_t*)beg, &hold));
+        CHECK(hold);
+        CHECK(AcquireStatus_Error ==
+              acquire_unmap_read_and_hold(runtime, 0, 0, &hold));
+
+        // Reads on till the writer is stuck behind the held region, which
+        // would have been overwritten several times over otherwise.
+        uint64_t nframes = 0;
+        for (;;) {
+            OK(acquire_map_read_wait(runtime, 0, 200, &beg, &end));
+            if (end == beg)
+                break;
+            for (auto* cur = beg; cur < end;
+                 cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+                CHECK(cur->frame_id > held_id);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        }
+        CHECK(nframes > 0);
+        CHECK(held->frame_id == held_id);
+        OK(acquire_release_read_hold(hold));
+
+        // Once released, the rest of the frames come through.
+        OK(acquire_stop(runtime));
+
+        // Starting again without the allocator frees the queue with it.
+        OK(acquire_set_channel_allocator(runtime, 0, nullptr));
+        OK(acquire_start(runtime));
+        CHECK(pinned.frees == 1);
+        OK(acquire_stop(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,170 @@
+/// @file monitor-readers.cpp
+/// Test that several readers opened on one stream each see the stream
+/// independently: a lossless reader gets every frame, a decimated one only
+/// every few frames, and readers stay open across acquisitions.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static VideoFrame*
+next(VideoFrame* cur)
+{
+    return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+}
+
+/// Reads from `reader` without waiting. Returns the ids of the frames read.
+static std::vector<uint64_t>
+drain(AcquireMonitorReader* reader)
+{
+    std::vector<uint64_t> ids;
+    VideoFrame *beg, *end, *cur;
+    OK(acquire_monitor_reader_map(reader, 0, &beg, &end));
+    for (cur = beg; cur < end; cur = next(cur))
+        ids.push_back(cur->frame_id);
+    OK(acquire_monitor_reader_unmap(reader, (uint8_t*)end - (uint8_t*)beg));
+    return ids;
+}
+
+static void
+acquire(AcquireRuntime* runtime,
+        AcquireMonitorReader* all,
+        AcquireMonitorReader* some,
+        uint64_t max_frame_count)
+{
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+
+    std::vector<uint64_t> ids_all, ids_some;
+    OK(acquire_start(runtime));
+    while (ids_all.size() < max_frame_count) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        const auto a = drain(all);
+        ids_all.insert(ids_all.end(), a.begin(), a.end());
+        const auto s = drain(some);
+        ids_some.insert(ids_some.end(), s.begin(), s.end());
+        clock_sleep_ms(0, 1.0f);
+    }
+    OK(acquire_stop(runtime));
+
+    for (uint64_t i = 0; i < ids_all.size(); ++i)
+        EXPECT(ids_all[i] == i,
+               "Expected frame %llu. Got %llu.",
+               (unsigned long long)i,
+               (unsigned long long)ids_all[i]);
+    CHECK(!ids_some.empty());
+    CHECK(ids_some.size() <= max_frame_count / 5 + 1);
+    for (size_t i = 1; i < ids_some.size(); ++i)
+        CHECK(ids_some[i] >= ids_some[i - 1] + 5);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*") - 1,
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash") - 1,
+                                    &props.video[0].storage.identifier));
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        props.video[0].camera.settings.exposure_time_us = 1e3f;
+        props.video[0].max_frame_count = 100;
+        props.video[0].channel_capacity_bytes = 1ULL << 20;
+        OK(acquire_configure(runtime, &props));
+
+        {
+            AcquireMonitorReader* reader = 0;
+            CHECK(acquire_open_monitor_reader(runtime,
+                                              ACQUIRE_MAX_VIDEO_STREAMS,
+                                              nullptr,
+                                              &reader) == AcquireStatus_Error);
+        }
+
+        AcquireMonitorReader *all = 0, *some = 0;
+        OK(acquire_open_monitor_reader(runtime, 0, nullptr, &all));
+        const AcquireMonitorReaderProperties every_fifth = {
+            .is_lossy = 1,
+            .every_nth_frame = 5,
+        };
+        OK(acquire_open_monitor_reader(runtime, 0, &every_fifth, &some));
+        CHECK(all && some && all != some);
+
+        acquire(runtime, all, some, props.video[0].max_frame_count);
+        // Readers carry over to the next acquisition.
+        acquire(runtime, all, some, props.video[0].max_frame_count);
+
+        OK(acquire_close_monitor_reader(runtime, all));
+        OK(acquire_close_monitor_reader(runtime, some));
+        CHECK(acquire_close_monitor_reader(runtime, some) ==
+              AcquireStatus_Error);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,126 @@
+/// @file numa-placement.cpp
+/// Test that a stream placed on a NUMA node reports it, keeps the affinity
+/// masks its threads were given, and runs, and that a node the host doesn't
+/// have is left to the system.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+static void
+configure_stream(const DeviceManager* dm,
+                 AcquireProperties::aq_properties_video_s& video)
+{
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = 64, .y = 48 };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = 10;
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquirePropertyMetadata metadata = {};
+        OK(acquire_get_configuration_metadata(runtime, &metadata));
+        CHECK(metadata.video[0].numa_node.writable);
+        CHECK(metadata.video[0].numa_node.high >= 0.0f);
+        const uint32_t last_node = (uint32_t)metadata.video[0].numa_node.high;
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        configure_stream(dm, props.video[0]);
+        props.video[0].use_numa_node = 1;
+        props.video[0].numa_node = (uint8_t)last_node;
+        props.video[0].threads.sink.affinity_mask = 1;
+        OK(acquire_configure(runtime, &props));
+
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].use_numa_node == 1);
+        CHECK(actual.video[0].numa_node == last_node);
+        // The node's CPUs only stand in for masks left at 0.
+        CHECK(actual.video[0].threads.source.affinity_mask == 0);
+        CHECK(actual.video[0].threads.sink.affinity_mask == 1);
+
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        AcquireStreamStats stats = {};
+        OK(acquire_get_stream_stats(runtime, 0, &stats));
+        CHECK(stats.storage_queue.bytes_written > 0);
+
+        // A node past the last is left to the system.
+        actual.video[0].numa_node = (uint8_t)(last_node + 1);
+        OK(acquire_configure(runtime, &actual));
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].use_numa_node == 0);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
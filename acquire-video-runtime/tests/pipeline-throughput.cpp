@@ -0,0 +1,270 @@
+/// @file pipeline-throughput.cpp
+/// Benchmark. Streams from a free running simulated camera to storage over a
+/// matrix of frame shapes, pixel types, averaging windows and storage
+/// devices, and writes what each run achieved as JSON: frame rates, drops,
+/// CPU time per stage and latency percentiles.
+///
+/// The results go to the path given as the first argument, or to
+/// `<test name>.json` in the working directory.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Each run acquires about this many bytes, within the frame limits below.
+static const uint64_t bytes_per_run = 128ULL << 20;
+static const uint64_t min_frames_per_run = 16;
+static const uint64_t max_frames_per_run = 1000;
+
+struct shape
+{
+    uint32_t width, height;
+};
+
+struct run_config
+{
+    struct shape shape;
+    enum SampleType type;
+    uint32_t frame_average_count;
+    const char* storage;
+};
+
+/// @returns `after - before` for CPU times that are -1 when they can't be
+/// read. The stream's threads live across runs, so times are cumulative.
+static double
+cpu_ms_between(double before, double after)
+{
+    if (after < 0)
+        return -1;
+    return after - std::max(before, 0.0);
+}
+
+static void
+append(std::string& json, const char* fmt, ...)
+{
+    char buf[512] = { 0 };
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    json += buf;
+}
+
+static void
+append_latency(std::string& json,
+               const char* name,
+               const AcquireLatencyStats& stats)
+{
+    append(json,
+           ", \"%s\": {\"count\": %llu, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+           "\"max_ms\": %.4f}",
+           name,
+           (unsigned long long)stats.count,
+           stats.p50_ms,
+           stats.p99_ms,
+           stats.max_ms);
+}
+
+/// Streams one configuration to completion.
+/// @returns The results as a JSON object.
+static std::string
+run(AcquireRuntime* runtime, const run_config& config)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    const char* filename = TEST ".out";
+    const uint64_t bytes_of_frame = (uint64_t)config.shape.width *
+                                    config.shape.height *
+                                    bytes_of_type(config.type);
+    const uint64_t nframes =
+      std::clamp(bytes_per_run / bytes_of_frame,
+                 min_frames_per_run,
+                 max_frames_per_run) /
+      config.frame_average_count * config.frame_average_count;
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated: empty") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                config.storage,
+                                strlen(config.storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = config.type;
+    props.video[0].camera.settings.shape = { .x = config.shape.width,
+                                             .y = config.shape.height };
+    // Free running: frames come as fast as the pipeline takes them.
+    props.video[0].camera.settings.exposure_time_us = 0;
+    props.video[0].max_frame_count = nframes;
+    props.video[0].frame_average_count = config.frame_average_count;
+    props.video[0].channel_capacity_bytes = 4 * bytes_per_run;
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquireMetrics before = {};
+    OK(acquire_get_metrics(runtime, &before));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireMetrics metrics = {};
+    AcquireStreamStats stats = {};
+    OK(acquire_get_metrics(runtime, &metrics));
+    OK(acquire_get_stream_stats(runtime, 0, &stats));
+    remove(filename);
+
+    const AcquireStreamMetrics& b = before.video[0];
+    const AcquireStreamMetrics& m = metrics.video[0];
+    EXPECT(m.frames_in == nframes,
+           "Expected %llu frames from the camera. Got %llu.",
+           (unsigned long long)nframes,
+           (unsigned long long)m.frames_in);
+
+    std::string json;
+    append(json,
+           "{\"width\": %u, \"height\": %u, \"pixel_type\": %d, "
+           "\"frame_average_count\": %u, \"storage\": \"%s\", ",
+           config.shape.width,
+           config.shape.height,
+           (int)config.type,
+           config.frame_average_count,
+           config.storage);
+    append(json,
+           "\"elapsed_ms\": %.2f, \"frames_in\": %llu, \"frames_out\": %llu, "
+           "\"fps_in\": %.1f, \"fps_out\": %.1f, "
+           "\"bytes_per_second_out\": %.0f, ",
+           m.elapsed_ms,
+           (unsigned long long)m.frames_in,
+           (unsigned long long)m.frames_out,
+           m.fps_in,
+           m.fps_out,
+           m.bytes_per_second_out);
+    append(json,
+           "\"dropped_frames\": %llu, \"aborted_frames\": %llu, "
+           "\"writer_blocked_ms\": %.2f, \"filter_ms_per_frame\": %.4f, "
+           "\"source_cpu_ms\": %.2f, \"filter_cpu_ms\": %.2f, "
+           "\"sink_cpu_ms\": %.2f",
+           (unsigned long long)m.dropped_frames,
+           (unsigned long long)m.aborted_frames,
+           stats.storage_queue.writer_blocked_ms,
+           m.filter_ms_per_frame,
+           cpu_ms_between(b.source_cpu_ms, m.source_cpu_ms),
+           cpu_ms_between(b.filter_cpu_ms, m.filter_cpu_ms),
+           cpu_ms_between(b.sink_cpu_ms, m.sink_cpu_ms));
+    append_latency(json, "camera_to_channel", stats.latency.camera_to_channel);
+    append_latency(json, "channel_to_filter", stats.latency.channel_to_filter);
+    append_latency(json, "channel_to_sink", stats.latency.channel_to_sink);
+    append_latency(json, "sink_to_storage", stats.latency.sink_to_storage);
+    append_latency(json, "storage_append", m.storage_append);
+    json += "}";
+
+    LOG("%ux%u type %d, average %u, %s: %.1f fps in, %.1f fps out",
+        config.shape.width,
+        config.shape.height,
+        (int)config.type,
+        config.frame_average_count,
+        config.storage,
+        m.fps_in,
+        m.fps_out);
+    return json;
+}
+
+int
+main(int argc, char* argv[])
+{
+    int retval = 1;
+    const char* path = argc > 1 ? argv[1] : TEST ".json";
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        std::string json = "{\"benchmark\": \"" TEST "\", \"runs\": [\n";
+        const char* sep = "";
+        for (const shape s : { shape{ 64, 48 },
+                               shape{ 512, 512 },
+                               shape{ 2048, 2048 } }) {
+            for (const SampleType type : { SampleType_u8, SampleType_u16 }) {
+                for (const uint32_t average : { 1u, 4u }) {
+                    for (const char* storage : { "trash", "raw", "tiff" }) {
+                        const run_config config = { s, type, average, storage };
+                        json += sep;
+                        json += "  " + run(runtime, config);
+                        sep = ",\n";
+                    }
+                }
+            }
+        }
+        json += "\n]}\n";
+
+        FILE* fp = fopen(path, "w");
+        EXPECT(fp, "Failed to open \"%s\" for writing.", path);
+        fputs(json.c_str(), fp);
+        fclose(fp);
+        LOG("Wrote results to \"%s\".", path);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,161 @@
+/// @file preview-stream.cpp
+/// Test that monitor readers opened with `is_preview` read the stream's
+/// frames binned by `preview_binning`, in order, with the stream's frame ids.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+constexpr uint64_t nframes = 50;
+constexpr uint32_t width = 64, height = 48, binning = 4;
+
+static void
+configure(AcquireRuntime* runtime, uint32_t preview_binning)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = width, .y = height };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    video.preview_binning = preview_binning;
+    OK(acquire_configure(runtime, &props));
+}
+
+static VideoFrame*
+next(VideoFrame* cur)
+{
+    return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+}
+
+/// Reads the preview until the stream's last frame arrives.
+/// @returns The number of frames read.
+static uint64_t
+read_preview(AcquireRuntime* runtime, AcquireMonitorReader* reader)
+{
+    uint64_t nread = 0, last_id = 0;
+    struct clock clock = {};
+    clock_init(&clock);
+    OK(acquire_start(runtime));
+    while (!nread || last_id < nframes - 1) {
+        EXPECT(clock_toc_ms(&clock) < 10e3, "Timed out reading the preview.");
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_monitor_reader_map(reader, 100, &beg, &end));
+        for (cur = beg; cur < end; cur = next(cur)) {
+            CHECK(cur->shape.type == SampleType_u8);
+            CHECK(cur->shape.dims.width == width / binning);
+            CHECK(cur->shape.dims.height == height / binning);
+            CHECK(cur->shape.dims.channels == 1);
+            CHECK(cur->bytes_of_frame >=
+                  sizeof(*cur) + (width / binning) * (height / binning));
+            EXPECT(!nread || cur->frame_id > last_id,
+                   "Expected frame ids to increase. Got %llu after %llu.",
+                   (unsigned long long)cur->frame_id,
+                   (unsigned long long)last_id);
+            last_id = cur->frame_id;
+            ++nread;
+        }
+        OK(acquire_monitor_reader_unmap(reader, (uint8_t*)end - (uint8_t*)beg));
+    }
+    OK(acquire_stop(runtime));
+    CHECK(last_id == nframes - 1);
+    return nread;
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime, binning);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        CHECK(props.video[0].preview_binning == binning);
+
+        AcquireMonitorReader* reader = 0;
+        AcquireMonitorReaderProperties reader_props = {};
+        reader_props.is_preview = 1;
+        OK(acquire_open_monitor_reader(runtime, 0, &reader_props, &reader));
+
+        // Readers of the preview see it again in the next acquisition.
+        for (int i = 0; i < 2; ++i) {
+            const uint64_t nread = read_preview(runtime, reader);
+            LOG("Read %llu of %llu frames from the preview.",
+                (unsigned long long)nread,
+                (unsigned long long)nframes);
+        }
+        OK(acquire_close_monitor_reader(runtime, reader));
+
+        // Only blocks of 2, 4 or 8 pixels on a side are binned.
+        AcquireProperties bad = props;
+        bad.video[0].preview_binning = 3;
+        acquire_configure(runtime, &bad);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
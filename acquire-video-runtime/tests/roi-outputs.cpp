@@ -0,0 +1,247 @@
+/// @file roi-outputs.cpp
+/// Test that each region in a stream's `roi_outputs` is stored on its own,
+/// with the pixels of that region of every frame, and that the stream runs as
+/// before once its regions are turned off.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 128, height = 96;
+constexpr uint64_t nframes = 100;
+
+struct Region
+{
+    uint32_t x, y, width, height;
+    const char* path;
+};
+
+/// The second region runs off the frame, so it's clipped to 28x16.
+static const Region regions[] = {
+    { 10, 20, 32, 16, TEST "-roi0.raw" },
+    { 100, 80, 64, 64, TEST "-roi1.raw" },
+};
+
+static void
+select_storage(const DeviceManager* dm,
+               const char* name,
+               size_t bytes_of_name,
+               const char* path,
+               size_t bytes_of_path,
+               DeviceIdentifier* identifier,
+               StorageProperties* settings)
+{
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, name, bytes_of_name, identifier));
+    CHECK(storage_properties_init(
+      settings, 0, path, bytes_of_path, 0, 0, { 1, 1 }, 0));
+}
+
+static void
+configure(AcquireRuntime* runtime, int enable_regions)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    select_storage(dm,
+                   SIZED("raw") - 1,
+                   SIZED(TEST "-full.raw"),
+                   &video.storage.identifier,
+                   &video.storage.settings);
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u16;
+    video.camera.settings.shape = { .x = width, .y = height };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    video.channel_capacity_bytes = 4ULL << 20;
+
+    for (size_t i = 0; i < sizeof(regions) / sizeof(*regions); ++i) {
+        // The settings read back alias the storage device's own.
+        auto& out = video.roi_outputs[i];
+        out = {};
+        if (!enable_regions)
+            continue;
+        out.roi = { regions[i].x,
+                    regions[i].y,
+                    regions[i].width,
+                    regions[i].height };
+        select_storage(dm,
+                       SIZED("raw") - 1,
+                       regions[i].path,
+                       strlen(regions[i].path) + 1,
+                       &out.identifier,
+                       &out.settings);
+    }
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    for (size_t i = 0; i < sizeof(regions) / sizeof(*regions); ++i) {
+        const auto& out = actual.video[0].roi_outputs[i];
+        if (enable_regions) {
+            CHECK(out.identifier.kind == DeviceKind_Storage);
+            CHECK(out.roi.x == regions[i].x);
+            CHECK(out.roi.width == regions[i].width);
+        } else {
+            CHECK(out.identifier.kind == DeviceKind_None);
+        }
+    }
+
+    storage_properties_destroy(&video.storage.settings);
+    for (auto& out : video.roi_outputs)
+        storage_properties_destroy(&out.settings);
+}
+
+/// Compares each frame of `region` with the same region of the frame with
+/// the same index in `full`.
+static void
+check_region(const raw_reader& full, const Region& region)
+{
+    const uint32_t w = std::min(region.width, width - region.x);
+    const uint32_t h = std::min(region.height, height - region.y);
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, region.path));
+    try {
+        EXPECT(raw_reader_frame_count(&reader) == nframes,
+               "Expected %llu frames in %s. Got %llu.",
+               (unsigned long long)nframes,
+               region.path,
+               (unsigned long long)raw_reader_frame_count(&reader));
+        for (size_t i = 0; i < nframes; ++i) {
+            const VideoFrame* a = raw_reader_frame(&full, i);
+            const VideoFrame* b = raw_reader_frame(&reader, i);
+            CHECK(a && b);
+            CHECK(b->frame_id == a->frame_id);
+            CHECK(b->shape.type == SampleType_u16);
+            CHECK(b->shape.dims.width == w);
+            CHECK(b->shape.dims.height == h);
+            const auto* src = (const uint16_t*)a->data;
+            const auto* dst = (const uint16_t*)b->data;
+            for (uint32_t y = 0; y < h; ++y) {
+                EXPECT(memcmp(dst + y * w,
+                              src + (region.y + y) * width + region.x,
+                              w * sizeof(uint16_t)) == 0,
+                       "Row %u of frame %llu in %s doesn't match.",
+                       y,
+                       (unsigned long long)i,
+                       region.path);
+            }
+        }
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+}
+
+static void
+remove_files()
+{
+    remove(TEST "-full.raw");
+    for (const auto& region : regions)
+        remove(region.path);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        remove_files();
+        configure(runtime, 1);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        AcquireMetrics metrics = {};
+        OK(acquire_get_metrics(runtime, &metrics));
+        for (size_t i = 0; i < sizeof(regions) / sizeof(*regions); ++i)
+            CHECK(metrics.video[0].roi_frames_out[i] == nframes);
+        CHECK(metrics.video[0].roi_frames_out[2] == 0);
+
+        raw_reader full = {};
+        CHECK(raw_reader_open(&full, TEST "-full.raw"));
+        try {
+            CHECK(raw_reader_frame_count(&full) == nframes);
+            for (const auto& region : regions)
+                check_region(full, region);
+        } catch (...) {
+            raw_reader_close(&full);
+            throw;
+        }
+        raw_reader_close(&full);
+        remove_files();
+
+        // Without regions, nothing waits on the crops anymore.
+        configure(runtime, 0);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].frames_out == nframes);
+        CHECK(metrics.video[0].roi_frames_out[0] == 0);
+        remove_files();
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
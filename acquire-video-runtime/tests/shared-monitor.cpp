@@ -0,0 +1,251 @@
+/// @file shared-monitor.cpp
+/// Test that a stream sharing its queue hands every frame to a reader that
+/// maps the queue by name, straight from the queue, holding the stream back
+/// like `acquire_map_read()` does. On platforms with fork(), a reader whose
+/// process exits while holding frames must not stop the stream.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "shared_monitor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 256, height = 256;
+constexpr uint64_t nframes = 500;
+// Holds a few dozen frames, so the stream wraps many times.
+constexpr uint64_t channel_capacity_bytes = 8ULL << 20;
+
+/// Unique to this process, so tests running at the same time don't collide.
+static std::string name;
+
+static void
+configure(AcquireRuntime* runtime, AcquireProperties& props)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated: radial sin"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash"),
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].channel_capacity_bytes = channel_capacity_bytes;
+    snprintf(props.video[0].monitor_shared_name,
+             sizeof(props.video[0].monitor_shared_name),
+             "%s",
+             name.c_str());
+}
+
+#ifndef _WIN32
+/// Runs in a child process. Opens a reader, tells the parent through `ready`,
+/// and exits as soon as it has frames mapped, without releasing them.
+/// @returns 0 on success.
+static int
+abandon_reader(int ready)
+{
+    struct shared_monitor monitor;
+    struct clock clock;
+    clock_init(&clock);
+    clock_shift_ms(&clock, 20000.0);
+    // The queue is there once the parent starts the stream.
+    while (!shared_monitor_open(&monitor, name.c_str())) {
+        if (clock_cmp_now(&clock) > 0)
+            return 1;
+        clock_sleep_ms(0, 10.0f);
+    }
+    const char c = 1;
+    if (write(ready, &c, 1) != 1)
+        return 1;
+
+    const VideoFrame *beg = 0, *end = 0;
+    while (beg == end) {
+        if (clock_cmp_now(&clock) > 0 ||
+            !shared_monitor_map(&monitor, 100, &beg, &end))
+            return 1;
+    }
+    return 0;
+}
+#endif
+
+int
+main()
+{
+    name = "acquire-test-" + std::to_string(process_id());
+#ifndef _WIN32
+    // Forked before the runtime starts any threads.
+    int fds[2] = { -1, -1 };
+    if (pipe(fds) != 0)
+        return 1;
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        _exit(abandon_reader(fds[1]));
+    }
+    close(fds[1]);
+#endif
+
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+    struct shared_monitor monitor = {};
+    int is_open = 0;
+    try {
+        CHECK(runtime);
+#ifndef _WIN32
+        CHECK(child > 0);
+#endif
+        AcquireProperties props = {};
+        configure(runtime, props);
+        props.video[0].max_frame_count = 10;
+        OK(acquire_configure(runtime, &props));
+        {
+            AcquireProperties actual = {};
+            OK(acquire_get_configuration(runtime, &actual));
+            CHECK(name == actual.video[0].monitor_shared_name);
+        }
+
+        // The queue is shared once the stream has started.
+        CHECK(!shared_monitor_open(&monitor, name.c_str()));
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        CHECK(shared_monitor_open(&monitor, name.c_str()));
+        is_open = 1;
+#ifndef _WIN32
+        char c = 0;
+        CHECK(read(fds[0], &c, 1) == 1);
+#endif
+
+        // Both readers start with the first frame of the next acquisition.
+        props.video[0].max_frame_count = nframes;
+        OK(acquire_configure(runtime, &props));
+        OK(acquire_start(runtime));
+#ifndef _WIN32
+        // The child exits holding on to frames. The stream stops waiting
+        // for it once it's gone.
+        int status = 0;
+        CHECK(waitpid(child, &status, 0) == child);
+        child = 0;
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+
+        struct clock clock = {};
+        clock_init(&clock);
+        clock_shift_ms(&clock, 20000.0);
+        uint64_t n = 0;
+        while (n < nframes) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timed out after %llu frames.",
+                   (unsigned long long)n);
+            const VideoFrame *beg = 0, *end = 0;
+            CHECK(shared_monitor_map(&monitor, 100, &beg, &end));
+            // Frames are in the shared queue itself.
+            CHECK(beg == end || ((const uint8_t*)beg >= monitor.data &&
+                                 (const uint8_t*)end <=
+                                   monitor.data + monitor.capacity));
+            for (const VideoFrame* cur = beg; cur < end;
+                 cur = (const VideoFrame*)((const uint8_t*)cur +
+                                           cur->bytes_of_frame)) {
+                EXPECT(cur->frame_id == n,
+                       "Expected frame %llu. Got %llu.",
+                       (unsigned long long)n,
+                       (unsigned long long)cur->frame_id);
+                CHECK(cur->shape.dims.width == width);
+                CHECK(cur->shape.dims.height == height);
+                ++n;
+            }
+            shared_monitor_unmap(&monitor,
+                                 (const uint8_t*)end - (const uint8_t*)beg);
+        }
+        CHECK(monitor.skipped == 0);
+        {
+            const float duty = shared_monitor_duty_cycle(&monitor);
+            LOG("Shared monitor duty cycle: %.3f", duty);
+            CHECK(duty >= 0.0f && duty <= 1.0f);
+        }
+        OK(acquire_stop(runtime));
+
+        // Once the runtime lets go of the queue, there's nothing to map, and
+        // nothing left under the name.
+        acquire_shutdown(runtime);
+        runtime = 0;
+        const VideoFrame *beg = 0, *end = 0;
+        CHECK(shared_monitor_map(&monitor, 10, &beg, &end));
+        CHECK(beg == end);
+        shared_monitor_close(&monitor);
+        is_open = 0;
+        CHECK(!shared_monitor_open(&monitor, name.c_str()));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    if (is_open)
+        shared_monitor_close(&monitor);
+    if (runtime)
+        acquire_shutdown(runtime);
+#ifndef _WIN32
+    if (child > 0) {
+        kill(child, SIGKILL);
+        waitpid(child, 0, 0);
+    }
+#endif
+    return retval;
+}
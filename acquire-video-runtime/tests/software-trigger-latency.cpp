@@ -0,0 +1,142 @@
+/// @file software-trigger-latency.cpp
+/// Test that each software trigger is timed till its frame is written to the
+/// storage queue, and that the frame is handed out as soon as it's triggered.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    int line = -1;
+    for (int i = 0; i < metadata.video[0].camera.digital_lines.line_count;
+         ++i)
+        if (!strcmp(metadata.video[0].camera.digital_lines.names[i],
+                    "software"))
+            line = i;
+    CHECK(line >= 0);
+
+    auto* settings = &props.video[0].camera.settings;
+    settings->binning = 1;
+    settings->pixel_type = SampleType_u8;
+    settings->shape = { .x = 64, .y = 48 };
+    // Frames are ready as soon as they're triggered.
+    settings->exposure_time_us = 0;
+    settings->input_triggers.frame_start = {
+        .enable = 1,
+        .line = (uint8_t)line,
+        .kind = Signal_Input,
+        .edge = TriggerEdge_Rising,
+    };
+    props.video[0].max_frame_count = 20;
+    OK(acquire_configure(runtime, &props));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+        OK(acquire_start(runtime));
+
+        for (int i = 0; i < 20; ++i) {
+            VideoFrame *beg = 0, *end = 0;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            EXPECT(beg == end, "Got a frame before trigger %d.", i);
+
+            OK(acquire_execute_trigger(runtime, 0));
+            for (int j = 0; j < 50 && beg == end; ++j)
+                OK(acquire_map_read_wait(runtime, 0, 100, &beg, &end));
+            EXPECT(beg < end, "Timed out waiting for frame %d.", i);
+            CHECK((VideoFrame*)((uint8_t*)beg + beg->bytes_of_frame) == end);
+            CHECK(beg->frame_id == (uint64_t)i);
+            OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        }
+
+        AcquireStreamStats stats = {};
+        OK(acquire_get_stream_stats(runtime, 0, &stats));
+        const AcquireLatencyStats* latency = &stats.latency.trigger_to_channel;
+        LOG("Trigger to channel: p50 %f ms, p99 %f ms, max %f ms",
+            latency->p50_ms,
+            latency->p99_ms,
+            latency->max_ms);
+        EXPECT(latency->count == 20,
+               "Timed %llu triggers.",
+               (unsigned long long)latency->count);
+        CHECK(latency->p50_ms <= latency->max_ms);
+        CHECK(latency->max_ms < 5000.0);
+
+        OK(acquire_stop(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,187 @@
+/// @file startup-latency.cpp
+/// Benchmark. Times how long the runtime takes to get going and to wind
+/// down: acquire_init() (driver loading), the first acquire_configure(), a
+/// reconfigure, acquire_start() up to the first frame, acquire_stop() and
+/// acquire_shutdown(). Each phase is timed over several rounds and written
+/// as JSON.
+///
+/// Usage: `startup-latency [results.json [rounds]]`. Results go to
+/// `<test name>.json` unless a path is given.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Phases timed each round, in the order they run.
+enum phase
+{
+    Phase_Init,
+    Phase_FirstConfigure,
+    Phase_Reconfigure,
+    Phase_StartToFirstFrame,
+    Phase_Stop,
+    Phase_Shutdown,
+    PhaseCount,
+};
+
+static const char* const phase_names[PhaseCount] = {
+    "init",
+    "first_configure",
+    "reconfigure",
+    "start_to_first_frame",
+    "stop",
+    "shutdown",
+};
+
+static void
+configure(AcquireRuntime* runtime, uint32_t width, uint32_t height)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated: uniform random") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 1;
+    OK(acquire_configure(runtime, &props));
+}
+
+/// Runs one round, adding how long each phase took to `ms`.
+static void
+round_trip(std::vector<double> (&ms)[PhaseCount])
+{
+    struct clock clock = {};
+    const auto lap = [&](enum phase p) {
+        ms[p].push_back(clock_toc_ms(&clock));
+        clock_init(&clock);
+    };
+
+    clock_init(&clock);
+    AcquireRuntime* runtime = acquire_init(reporter);
+    lap(Phase_Init);
+    try {
+        CHECK(runtime);
+        configure(runtime, 1920, 1080);
+        lap(Phase_FirstConfigure);
+        configure(runtime, 2048, 2048);
+        lap(Phase_Reconfigure);
+
+        OK(acquire_start(runtime));
+        VideoFrame *beg = nullptr, *end = nullptr;
+        while (beg == end) {
+            OK(acquire_map_read_wait(runtime, 0, 100, &beg, &end));
+            EXPECT(clock_toc_ms(&clock) < 10000.0,
+                   "Timed out waiting for the first frame.");
+        }
+        lap(Phase_StartToFirstFrame);
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        OK(acquire_stop(runtime));
+        lap(Phase_Stop);
+    } catch (...) {
+        acquire_shutdown(runtime);
+        throw;
+    }
+    acquire_shutdown(runtime);
+    lap(Phase_Shutdown);
+}
+
+int
+main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : TEST ".json";
+    const int rounds = argc > 2 ? atoi(argv[2]) : 3;
+    logger_set_reporter(reporter);
+    try {
+        CHECK(rounds > 0);
+        std::vector<double> ms[PhaseCount];
+        for (int i = 0; i < rounds; ++i)
+            round_trip(ms);
+
+        std::string json = "{\"benchmark\": \"" TEST "\", \"phases\": {";
+        for (int p = 0; p < PhaseCount; ++p) {
+            std::sort(ms[p].begin(), ms[p].end());
+            char buf[256] = { 0 };
+            snprintf(buf,
+                     sizeof(buf),
+                     "%s\n  \"%s\": {\"rounds\": %d, \"min_ms\": %.3f, "
+                     "\"median_ms\": %.3f, \"max_ms\": %.3f}",
+                     p ? "," : "",
+                     phase_names[p],
+                     (int)ms[p].size(),
+                     ms[p].front(),
+                     ms[p][ms[p].size() / 2],
+                     ms[p].back());
+            json += buf;
+            LOG("%s: median %.3f ms", phase_names[p], ms[p][ms[p].size() / 2]);
+        }
+        json += "\n}}\n";
+
+        FILE* fp = fopen(path, "w");
+        EXPECT(fp, "Failed to open \"%s\" for writing.", path);
+        fputs(json.c_str(), fp);
+        fclose(fp);
+        LOG("Wrote results to \"%s\".", path);
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+        return 1;
+    } catch (...) {
+        ERR("Exception: (unknown)");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/// @file stop-within-deadline.cpp
+/// Test that acquire_stop_within() returns once its deadline passes, and that
+/// frames still queued for storage then are either dropped and counted, or
+/// stored in the background before the runtime is used again.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &video.camera.identifier));
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("trash") - 1, &video.storage.identifier));
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u8;
+    video.camera.settings.shape = { .x = 64, .y = 48 };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = ~0ULL;
+    // The sink holds every frame back for longer than the test runs, so
+    // frames are still queued when the stream is stopped.
+    video.storage.write_delay_ms = 60e3f;
+    OK(acquire_configure(runtime, &props));
+}
+
+/// Acquires until some frames are queued, then stops within `timeout_ms`.
+/// @returns How long the stop took, in milliseconds.
+static double
+acquire_and_stop(AcquireRuntime* runtime,
+                 uint32_t timeout_ms,
+                 AcquireUndrainedFrames undrained)
+{
+    OK(acquire_start(runtime));
+    AcquireMetrics metrics = {};
+    struct clock clock = {};
+    clock_init(&clock);
+    do {
+        EXPECT(clock_toc_ms(&clock) < 10e3, "Timed out waiting for frames.");
+        clock_sleep_ms(0, 10.0f);
+        OK(acquire_get_metrics(runtime, &metrics));
+    } while (metrics.video[0].frames_in < 20);
+
+    clock_tic(&clock);
+    OK(acquire_stop_within(runtime, timeout_ms, undrained));
+    return clock_toc_ms(&clock);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        configure(runtime);
+
+        // Given time, every frame is stored.
+        acquire_and_stop(runtime, 10000, AcquireUndrained_Discard);
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        AcquireMetrics metrics = {};
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].discarded_frames == 0);
+        CHECK(metrics.video[0].frames_out == metrics.video[0].frames_in);
+
+        // Without, the frames still queued are dropped and counted.
+        const double ms =
+          acquire_and_stop(runtime, 0, AcquireUndrained_Discard);
+        LOG("Discarding stop took %f ms", ms);
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        OK(acquire_get_metrics(runtime, &metrics));
+        LOG("Stored %llu of %llu frames. Discarded %llu.",
+            (unsigned long long)metrics.video[0].frames_out,
+            (unsigned long long)metrics.video[0].frames_in,
+            (unsigned long long)metrics.video[0].discarded_frames);
+        CHECK(metrics.video[0].discarded_frames > 0);
+        CHECK(metrics.video[0].frames_out + metrics.video[0].discarded_frames <=
+              metrics.video[0].frames_in);
+
+        // Or stored after the call returns. Starting again waits for them.
+        acquire_and_stop(runtime, 0, AcquireUndrained_Persist);
+        OK(acquire_stop(runtime));
+        CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].discarded_frames == 0);
+        CHECK(metrics.video[0].frames_out == metrics.video[0].frames_in);
+
+        acquire_and_stop(runtime, 0, AcquireUndrained_Persist);
+        OK(acquire_start(runtime));
+        OK(acquire_abort(runtime));
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
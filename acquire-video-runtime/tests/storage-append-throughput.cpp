@@ -0,0 +1,263 @@
+/// @file storage-append-throughput.cpp
+/// Benchmark. Appends the same synthetic frames straight to storage devices
+/// through the storage HAL, with no camera or runtime threads involved, in
+/// batches of several sizes. Writes the sustained MB/s and the distribution
+/// of append latencies of each device and batch size as JSON.
+///
+/// Usage: `storage-append-throughput [results.json [device...]]`. Devices
+/// are named like `device_manager_select()` expects, so devices from other
+/// drivers found next to the executable can be compared too. The default
+/// is every storage device in acquire-driver-common. Results go to
+/// `<test name>.json` unless a path is given.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/hal/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+
+static const uint32_t width = 512;
+static const uint32_t height = 512;
+static const SampleType pixel_type = SampleType_u16;
+
+/// Each run appends at least this many bytes, and at least
+/// `min_appends_per_run` batches.
+static const uint64_t min_bytes_per_run = 64ULL << 20;
+static const uint64_t min_appends_per_run = 8;
+
+static const size_t batch_sizes[] = { 1, 8, 32 };
+
+/// `count` frames laid out back to back like the runtime hands them to
+/// storage.
+struct batch
+{
+    std::vector<uint64_t> buffer; // 8-byte aligned
+    size_t count, bytes_of_frame;
+
+    VideoFrame* frame(size_t i)
+    {
+        return (VideoFrame*)((uint8_t*)buffer.data() + i * bytes_of_frame);
+    }
+};
+
+static ImageShape
+make_shape()
+{
+    return {
+        .dims = { .channels = 1,
+                  .width = width,
+                  .height = height,
+                  .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = width,
+                     .planes = (int64_t)width * height },
+        .type = pixel_type,
+    };
+}
+
+static batch
+make_batch(size_t count)
+{
+    const ImageShape shape = make_shape();
+    const size_t bytes_of_image = width * height * bytes_of_type(pixel_type);
+    batch b = {};
+    b.count = count;
+    b.bytes_of_frame = (sizeof(VideoFrame) + bytes_of_image + 7) & ~7ULL;
+    b.buffer.resize(count * b.bytes_of_frame / 8);
+    for (size_t i = 0; i < count; ++i) {
+        VideoFrame* frame = b.frame(i);
+        *frame = {};
+        frame->bytes_of_frame = b.bytes_of_frame;
+        frame->shape = shape;
+        // A ramp, so compressing devices see something like an image.
+        for (size_t j = 0; j < bytes_of_image; ++j)
+            frame->data[j] = (uint8_t)(i + j / 64);
+    }
+    return b;
+}
+
+static void
+append(std::string& json, const char* fmt, ...)
+{
+    char buf[512] = { 0 };
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    json += buf;
+}
+
+/// Appends everything in one run to `device`.
+/// @returns The results as a JSON object.
+static std::string
+run(const DeviceManager* dm, const char* device, batch& b)
+{
+    const std::string path = std::string(TEST "-") + device + ".out";
+    std::error_code ec;
+    fs::remove_all(path, ec);
+
+    DeviceIdentifier identifier = {};
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, device, strlen(device), &identifier));
+    Storage* storage = storage_open(dm, &identifier);
+    EXPECT(storage, "Failed to open storage device \"%s\".", device);
+
+    StorageProperties props = {};
+    const char metadata[] = "{}";
+    CHECK(storage_properties_init(&props,
+                                  0,
+                                  path.c_str(),
+                                  path.size() + 1,
+                                  metadata,
+                                  sizeof(metadata),
+                                  { 1, 1 },
+                                  0));
+    DEVOK(storage_set(storage, &props));
+    storage_properties_destroy(&props);
+    const ImageShape shape = make_shape();
+    DEVOK(storage_reserve_image_shape(storage, &shape));
+
+    const uint64_t bytes_of_batch = b.count * b.bytes_of_frame;
+    const uint64_t nappends =
+      std::max(min_appends_per_run,
+               (min_bytes_per_run + bytes_of_batch - 1) / bytes_of_batch);
+    std::vector<double> latencies_ms;
+    latencies_ms.reserve(nappends);
+
+    struct clock clock = {};
+    clock_init(&clock);
+    DEVOK(storage_start(storage));
+    uint64_t frame_id = 0;
+    for (uint64_t i = 0; i < nappends; ++i) {
+        for (size_t j = 0; j < b.count; ++j) {
+            VideoFrame* frame = b.frame(j);
+            frame->frame_id = frame->hardware_frame_id = frame_id++;
+            frame->timestamps.acq_thread = clock_tic(0);
+        }
+        struct clock t = {};
+        clock_init(&t);
+        DEVOK(storage_append(storage, b.frame(0), b.frame(b.count)));
+        latencies_ms.push_back(clock_toc_ms(&t));
+    }
+    // Stopping flushes whatever the device buffered, so it's timed too.
+    DEVOK(storage_stop(storage));
+    const double elapsed_ms = clock_toc_ms(&clock);
+    storage_close(storage);
+    fs::remove_all(path, ec);
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    const auto at = [&](double p) {
+        return latencies_ms[(size_t)(p * (double)(latencies_ms.size() - 1))];
+    };
+    const double bytes = (double)(nappends * bytes_of_batch);
+    std::string json;
+    append(json,
+           "{\"device\": \"%s\", \"frames_per_append\": %llu, "
+           "\"bytes_of_frame\": %llu, \"appends\": %llu, "
+           "\"elapsed_ms\": %.2f, \"megabytes_per_second\": %.1f, ",
+           device,
+           (unsigned long long)b.count,
+           (unsigned long long)b.bytes_of_frame,
+           (unsigned long long)nappends,
+           elapsed_ms,
+           1e-3 * bytes / elapsed_ms);
+    append(json,
+           "\"append_ms\": {\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, "
+           "\"max\": %.4f}}",
+           at(0.5),
+           at(0.9),
+           at(0.99),
+           at(1.0));
+    LOG("%s, %d frames per append: %.1f MB/s, p50 %.3f ms per append",
+        device,
+        (int)b.count,
+        1e-3 * bytes / elapsed_ms,
+        at(0.5));
+    return json;
+}
+
+int
+main(int argc, char* argv[])
+{
+    int retval = 1;
+    const char* path = argc > 1 ? argv[1] : TEST ".json";
+    std::vector<const char*> devices = { "trash", "raw", "tiff", "tiff-json" };
+    if (argc > 2)
+        devices.assign(argv + 2, argv + argc);
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        std::string json = "{\"benchmark\": \"" TEST "\", \"runs\": [\n";
+        const char* sep = "";
+        for (const size_t count : batch_sizes) {
+            batch b = make_batch(count);
+            for (const char* device : devices) {
+                json += sep;
+                json += "  " + run(dm, device, b);
+                sep = ",\n";
+            }
+        }
+        json += "\n]}\n";
+
+        FILE* fp = fopen(path, "w");
+        EXPECT(fp, "Failed to open \"%s\" for writing.", path);
+        fputs(json.c_str(), fp);
+        fclose(fp);
+        LOG("Wrote results to \"%s\".", path);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,196 @@
+/// @file storage-coalesced-writes.cpp
+/// Test that frames gathered into larger writes before storage still land in
+/// the file in order, whether batches are flushed by size, by age or when the
+/// stream stops, and that the coalescing settings round trip through the
+/// configuration.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+struct Coalescing
+{
+    uint64_t bytes;
+    float max_age_ms;
+    uint32_t writer_count;
+};
+
+static void
+configure(AcquireRuntime* runtime, const Coalescing& coalescing)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".bin"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].channel_capacity_bytes = 1ULL << 28;
+    props.video[0].storage.writer_count = coalescing.writer_count;
+    props.video[0].storage.coalesce_bytes = coalescing.bytes;
+    props.video[0].storage.coalesce_max_age_ms = coalescing.max_age_ms;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Reads back the file written by the raw storage device and checks that it
+/// holds every frame, in order, back to back.
+static void
+check_file(uint64_t expected_nframes)
+{
+    std::ifstream file(TEST ".bin", std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+
+    size_t offset = 0;
+    uint64_t nframes = 0;
+    while (offset < nbytes) {
+        VideoFrame frame = {};
+        CHECK(offset + sizeof(frame) <= nbytes);
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        EXPECT(frame.frame_id == nframes,
+               "Expected frame %llu. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)frame.frame_id);
+        CHECK(frame.shape.dims.width == 64);
+        CHECK(frame.shape.dims.height == 48);
+        CHECK(frame.bytes_of_frame >= sizeof(frame) + 64 * 48);
+        offset += frame.bytes_of_frame;
+        ++nframes;
+    }
+    CHECK(offset == nbytes);
+    EXPECT(nframes == expected_nframes,
+           "Expected %llu frames. Got %llu.",
+           (unsigned long long)expected_nframes,
+           (unsigned long long)nframes);
+}
+
+static void
+acquire(AcquireRuntime* runtime, const Coalescing& coalescing)
+{
+    configure(runtime, coalescing);
+    CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        const auto& storage = actual.video[0].storage;
+        CHECK(storage.coalesce_bytes == coalescing.bytes);
+        CHECK(storage.coalesce_max_age_ms == coalescing.max_age_ms);
+        CHECK(storage.writer_count == coalescing.writer_count);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStats stats = {};
+    OK(acquire_get_stream_stats(runtime, 0, &stats));
+    CHECK(stats.latency.sink_to_storage.count == 100);
+    check_file(100);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        // Batches can't take more than half the queue.
+        configure(runtime, { 1ULL << 28, 0.0f, 1 });
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        // Flushed by size.
+        acquire(runtime, { 16 << 10, 0.0f, 1 });
+        acquire(runtime, { 16 << 10, 5.0f, 4 });
+        // Smaller than a frame.
+        acquire(runtime, { 1024, 0.0f, 1 });
+        // Flushed by age, then when the stream stops.
+        acquire(runtime, { 1ULL << 20, 20.0f, 1 });
+        acquire(runtime, { 1ULL << 20, 0.0f, 4 });
+        // Off.
+        acquire(runtime, { 0, 0.0f, 1 });
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,237 @@
+/// @file storage-compressed-frames.cpp
+/// Test that a compress stage writes smaller frames to the queue and to raw
+/// files, that the monitor and the file hold the same frames once they're
+/// decompressed, that frames that don't shrink are stored as they are, and
+/// that chains and storage devices that can't take compressed frames are
+/// rejected.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// Big enough that each frame is compressed as several blocks.
+constexpr uint32_t width = 1024, height = 512;
+constexpr size_t bytes_of_pixels = (size_t)width * height * 2;
+constexpr uint64_t nframes = 20;
+
+static void
+configure(AcquireRuntime* runtime,
+          AcquireProperties& props,
+          const char* camera,
+          const char* storage)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                camera,
+                                strlen(camera),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".raw"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+    props.video[0].frame_average_thread_count = 2;
+    props.video[0].filters[0] = {
+        .kind = AcquireFilter_Compress,
+        .compression = FrameCompression_ShuffleLz4,
+    };
+}
+
+/// Acquires until `expected_nframes` frames have been read, passing each
+/// one to `check`.
+static void
+acquire(AcquireRuntime* runtime,
+        uint64_t expected_nframes,
+        const std::function<void(const VideoFrame*)>& check)
+{
+    const auto next = [](VideoFrame* cur) -> VideoFrame* {
+        return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+    };
+
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t n = 0;
+    while (n < expected_nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end; cur = next(cur)) {
+            check(cur);
+            ++n;
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 1.0f);
+    }
+    OK(acquire_stop(runtime));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        AcquireProperties props = {};
+
+        // Smooth images shrink, and decompress to the same pixels from the
+        // monitor and from the file.
+        remove(TEST ".raw");
+        configure(runtime, props, "simulated: radial sin", "raw");
+        OK(acquire_configure(runtime, &props));
+        {
+            AcquireProperties actual = {};
+            OK(acquire_get_configuration(runtime, &actual));
+            CHECK(actual.video[0].filters[0].kind == AcquireFilter_Compress);
+            CHECK(actual.video[0].filters[0].compression ==
+                  FrameCompression_ShuffleLz4);
+        }
+        std::map<uint64_t, std::vector<uint8_t>> seen;
+        acquire(runtime, nframes, [&](const VideoFrame* cur) {
+            CHECK(cur->compression == FrameCompression_ShuffleLz4);
+            CHECK(cur->bytes_of_data < bytes_of_pixels);
+            CHECK(cur->bytes_of_frame < sizeof(*cur) + bytes_of_pixels);
+            std::vector<uint8_t> px(bytes_of_pixels);
+            OK(acquire_decompress_frame(cur, px.data(), px.size()));
+            seen[cur->frame_id] = std::move(px);
+        });
+        CHECK(acquire_decompress_frame(nullptr, nullptr, 0) ==
+              AcquireStatus_Error);
+
+        raw_reader reader = {};
+        CHECK(raw_reader_open(&reader, TEST ".raw"));
+        try {
+            const size_t n = raw_reader_frame_count(&reader);
+            EXPECT(n == nframes,
+                   "Expected %llu frames. Got %llu.",
+                   (unsigned long long)nframes,
+                   (unsigned long long)n);
+            CHECK(reader.end <
+                  nframes * (sizeof(VideoFrame) + bytes_of_pixels));
+            std::vector<uint8_t> px(bytes_of_pixels);
+            for (size_t i = 0; i < n; ++i) {
+                const VideoFrame* frame = raw_reader_frame(&reader, i);
+                CHECK(frame);
+                OK(acquire_decompress_frame(frame, px.data(), px.size()));
+                CHECK(seen.count(frame->frame_id));
+                EXPECT(px == seen[frame->frame_id],
+                       "Frame %llu in the file doesn't match the monitor's.",
+                       (unsigned long long)frame->frame_id);
+            }
+        } catch (...) {
+            raw_reader_close(&reader);
+            throw;
+        }
+        raw_reader_close(&reader);
+        storage_properties_destroy(&props.video[0].storage.settings);
+        remove(TEST ".raw");
+
+        // Noise doesn't shrink, so it's stored as it is.
+        configure(runtime, props, "simulated: uniform random", "trash");
+        props.video[0].filters[0].compression = FrameCompression_Lz4;
+        OK(acquire_configure(runtime, &props));
+        acquire(runtime, nframes, [](const VideoFrame* cur) {
+            CHECK(cur->compression == FrameCompression_None);
+            CHECK(cur->bytes_of_frame >= sizeof(*cur) + bytes_of_pixels);
+        });
+
+        // Nothing can follow compression.
+        props.video[0].filters[1] = { .kind = AcquireFilter_Crop,
+                                      .roi = { 0, 0, 8, 8 } };
+        acquire_configure(runtime, &props);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+        storage_properties_destroy(&props.video[0].storage.settings);
+
+        // Tiff files and raw files with compact headers can't hold
+        // compressed frames.
+        configure(runtime, props, "simulated: radial sin", "tiff");
+        acquire_configure(runtime, &props);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+        storage_properties_destroy(&props.video[0].storage.settings);
+
+        configure(runtime, props, "simulated: radial sin", "raw");
+        props.video[0].storage.settings.enable_compact_frame_headers = 1;
+        acquire_configure(runtime, &props);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+        storage_properties_destroy(&props.video[0].storage.settings);
+        remove(TEST ".raw");
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,279 @@
+/// @file storage-compressed-tiff.cpp
+/// Test that the TIFF storage device writes a valid chain of compressed
+/// images with each codec it supports, cut into several strips per frame,
+/// both through the file cache and around it, and that LZW strips decode
+/// to whole rows.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 640, height = 480;
+constexpr uint64_t nframes = 20;
+
+/// @returns the storage device's supported compression bits.
+static uint32_t
+configure(AcquireRuntime* runtime,
+          enum StorageCompression compression,
+          uint8_t enable_unbuffered_io)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*sin.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".tif"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_unbuffered_io(
+      &props.video[0].storage.settings, enable_unbuffered_io));
+    CHECK(storage_properties_set_compression(&props.video[0].storage.settings,
+                                             compression));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].storage.settings.compression == compression);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    return metadata.video[0].storage.supported_compression;
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Decodes TIFF's LZW, which widens codes one code early.
+static std::vector<uint8_t>
+lzw_decode(const uint8_t* p, size_t n)
+{
+    std::vector<std::vector<uint8_t>> table;
+    const auto reset = [&]() {
+        table.assign(258, {});
+        for (int i = 0; i < 256; ++i)
+            table[i] = { (uint8_t)i };
+    };
+    reset();
+
+    std::vector<uint8_t> out;
+    size_t bit = 0;
+    uint32_t nbits = 9;
+    int prev = -1;
+    for (;;) {
+        CHECK(bit + nbits <= 8 * n);
+        uint32_t code = 0;
+        for (uint32_t i = 0; i < nbits; ++i, ++bit)
+            code = (code << 1) | ((p[bit >> 3] >> (7 - (bit & 7))) & 1);
+        if (code == 257)
+            break;
+        if (code == 256) {
+            reset();
+            nbits = 9;
+            prev = -1;
+            continue;
+        }
+        std::vector<uint8_t> entry;
+        if (prev < 0) {
+            CHECK(code < 256);
+            entry = table[code];
+        } else {
+            if (code < table.size()) {
+                entry = table[code];
+            } else {
+                CHECK(code == table.size());
+                entry = table[prev];
+                entry.push_back(table[prev][0]);
+            }
+            auto added = table[prev];
+            added.push_back(entry[0]);
+            table.push_back(added);
+        }
+        out.insert(out.end(), entry.begin(), entry.end());
+        prev = (int)code;
+        if (table.size() + 1 >= (1u << nbits) && nbits < 12)
+            ++nbits;
+    }
+    return out;
+}
+
+/// Walks the TIFF's chain of image directories and checks each frame's
+/// compression and strips.
+static void
+check_tiff(const char* filename, enum StorageCompression compression)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    const uint16_t expected_tag[] = { 1, 5, 8, 50000 };
+    const uint64_t bytes_of_tag = 20;
+    uint64_t count = 0, bytes_of_strips = 0;
+    for (uint64_t ifd = u64(8); ifd; ++count) {
+        CHECK(count < nframes);
+        const uint64_t ntags = u64(ifd);
+        uint64_t rows = 0, nstrips = 0, offsets = 0, byte_counts = 0;
+        for (uint64_t i = 0; i < ntags; ++i) {
+            const uint64_t tag = ifd + 8 + i * bytes_of_tag;
+            const uint16_t id = (uint16_t)u64(tag);
+            const uint64_t n = u64(tag + 4);
+            const uint64_t value = u64(tag + 12);
+            switch (id) {
+                case 259:
+                    CHECK((uint16_t)value == expected_tag[compression]);
+                    break;
+                case 278:
+                    rows = (uint32_t)value;
+                    break;
+                case 273:
+                    nstrips = n;
+                    offsets = value;
+                    break;
+                case 279:
+                    CHECK(n == nstrips);
+                    byte_counts = value;
+                    break;
+                default:
+                    break;
+            }
+        }
+        CHECK(rows > 0 && nstrips == (height + rows - 1) / rows);
+        if (compression != StorageCompression_None)
+            CHECK(nstrips > 1);
+        for (uint64_t i = 0; i < nstrips; ++i) {
+            const uint64_t offset =
+              nstrips > 1 ? u64(offsets + 8 * i) : offsets;
+            const uint64_t nbytes =
+              nstrips > 1 ? u64(byte_counts + 8 * i) : byte_counts;
+            CHECK(offset + nbytes <= data.size());
+            bytes_of_strips += nbytes;
+            if (compression == StorageCompression_Lzw) {
+                const uint64_t nrows = std::min(rows, height - i * rows);
+                const auto decoded = lzw_decode(data.data() + offset, nbytes);
+                EXPECT(decoded.size() == nrows * width,
+                       "Expected %llu bytes in strip %llu. Got %llu.",
+                       (unsigned long long)(nrows * width),
+                       (unsigned long long)i,
+                       (unsigned long long)decoded.size());
+            }
+        }
+        ifd = u64(ifd + 8 + ntags * bytes_of_tag);
+    }
+    CHECK(count == nframes);
+    LOG("Compression %d: %llu bytes of strips for %llu bytes of pixels",
+        (int)compression,
+        (unsigned long long)bytes_of_strips,
+        (unsigned long long)(nframes * width * height));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const uint32_t supported =
+          configure(runtime, StorageCompression_None, 0);
+        CHECK(supported & (1u << StorageCompression_Lzw));
+        for (int i = 0; i < StorageCompressionCount; ++i) {
+            const auto compression = (enum StorageCompression)i;
+            if (!((supported >> i) & 1))
+                continue;
+            for (uint8_t unbuffered = 0; unbuffered < 2; ++unbuffered) {
+                configure(runtime, compression, unbuffered);
+                OK(acquire_start(runtime));
+                OK(acquire_stop(runtime));
+                check_tiff(TEST ".tif", compression);
+            }
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
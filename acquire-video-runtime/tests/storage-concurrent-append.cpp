@@ -0,0 +1,177 @@
+/// @file storage-concurrent-append.cpp
+/// Test that frames appended to storage from several writer threads land in
+/// the file in order, and that the number of writers round trips through the
+/// configuration.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime, uint32_t writer_count)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".bin"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].storage.writer_count = writer_count;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Reads back the file written by the raw storage device and checks that it
+/// holds every frame, in order, back to back.
+static void
+check_file(uint64_t expected_nframes)
+{
+    std::ifstream file(TEST ".bin", std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+
+    size_t offset = 0;
+    uint64_t nframes = 0;
+    while (offset < nbytes) {
+        VideoFrame frame = {};
+        CHECK(offset + sizeof(frame) <= nbytes);
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        EXPECT(frame.frame_id == nframes,
+               "Expected frame %llu. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)frame.frame_id);
+        CHECK(frame.shape.dims.width == 64);
+        CHECK(frame.shape.dims.height == 48);
+        CHECK(frame.bytes_of_frame >= sizeof(frame) + 64 * 48);
+        offset += frame.bytes_of_frame;
+        ++nframes;
+    }
+    CHECK(offset == nbytes);
+    EXPECT(nframes == expected_nframes,
+           "Expected %llu frames. Got %llu.",
+           (unsigned long long)expected_nframes,
+           (unsigned long long)nframes);
+}
+
+static void
+acquire(AcquireRuntime* runtime, uint32_t writer_count)
+{
+    configure(runtime, writer_count);
+    CHECK(acquire_get_state(runtime) == DeviceState_Armed);
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].storage.writer_count == writer_count);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStats stats = {};
+    OK(acquire_get_stream_stats(runtime, 0, &stats));
+    CHECK(stats.latency.sink_to_storage.count == 100);
+    check_file(100);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        // More writers than a pool can hold.
+        configure(runtime, 9);
+        CHECK(acquire_get_state(runtime) == DeviceState_AwaitingConfiguration);
+
+        acquire(runtime, 4);
+        // Restarting overwrites the file from the start.
+        acquire(runtime, 4);
+        acquire(runtime, 1);
+        acquire(runtime, 8);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
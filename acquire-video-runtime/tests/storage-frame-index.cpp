@@ -0,0 +1,257 @@
+/// @file storage-frame-index.cpp
+/// Test that the raw and TIFF storage devices write an index next to each
+/// file with a record per frame that points at the frame, including across
+/// rolled over files.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// The layout of an index, as a reader outside the project would see it.
+#pragma pack(push, 1)
+struct frame_index_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bytes_of_record;
+};
+struct frame_index_record
+{
+    uint64_t frame_id;
+    uint64_t offset;
+    uint64_t nbytes;
+    uint64_t hardware_timestamp;
+    uint64_t runtime_timestamp;
+    uint64_t hardware_frame_id;
+};
+#pragma pack(pop)
+
+constexpr uint32_t width = 64, height = 48;
+constexpr uint64_t nframes = 20;
+
+static void
+configure(AcquireRuntime* runtime,
+          const char* storage,
+          const char* filename,
+          uint64_t max_frames_per_file,
+          uint8_t enable_unbuffered_io)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_unbuffered_io(
+      &props.video[0].storage.settings, enable_unbuffered_io));
+    CHECK(storage_properties_set_rollover(
+      &props.video[0].storage.settings, max_frames_per_file, 0));
+    CHECK(storage_properties_set_enable_frame_index(
+      &props.video[0].storage.settings, 1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].storage.frame_index_is_supported);
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+template<typename T>
+static T
+read_at(const std::vector<uint8_t>& data, uint64_t offset)
+{
+    T v = {};
+    CHECK(offset + sizeof(v) <= data.size());
+    memcpy(&v, data.data() + offset, sizeof(v));
+    return v;
+}
+
+/// Checks the index of `filename` against the file.
+/// @returns the number of frames in the file.
+static uint64_t
+check_index(const std::string& filename, bool is_tiff)
+{
+    const std::vector<uint8_t> data = read_file(filename.c_str());
+    const std::vector<uint8_t> index = read_file((filename + ".idx").c_str());
+
+    const auto header = read_at<frame_index_header>(index, 0);
+    CHECK(0 == memcmp(header.magic, "acqidx\0", sizeof(header.magic)));
+    CHECK(header.version == 1);
+    CHECK(header.bytes_of_record == sizeof(frame_index_record));
+    CHECK((index.size() - sizeof(header)) % header.bytes_of_record == 0);
+    const uint64_t n =
+      (index.size() - sizeof(header)) / header.bytes_of_record;
+
+    // The TIFF's images, in the order the chain of ifds lists them.
+    std::vector<uint64_t> ifds;
+    if (is_tiff) {
+        for (uint64_t ifd = read_at<uint64_t>(data, 8); ifd;
+             ifd = read_at<uint64_t>(
+               data, ifd + 8 + read_at<uint64_t>(data, ifd) * 20)) {
+            CHECK(ifds.size() < nframes);
+            ifds.push_back(ifd);
+        }
+        CHECK(ifds.size() == n);
+    }
+
+    uint64_t end = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        const auto record = read_at<frame_index_record>(
+          index, sizeof(header) + i * header.bytes_of_record);
+        CHECK(record.offset >= end);
+        CHECK(record.offset + record.nbytes <= data.size() ||
+              (is_tiff && record.offset < data.size()));
+        end = record.offset + record.nbytes;
+        if (is_tiff) {
+            CHECK(record.offset == ifds[i]);
+        } else {
+            const auto frame = read_at<VideoFrame>(data, record.offset);
+            CHECK(frame.frame_id == record.frame_id);
+            CHECK(frame.bytes_of_frame == record.nbytes);
+            CHECK(frame.timestamps.hardware == record.hardware_timestamp);
+            CHECK(frame.timestamps.acq_thread == record.runtime_timestamp);
+            CHECK(frame.hardware_frame_id == record.hardware_frame_id);
+        }
+    }
+    if (!is_tiff)
+        CHECK(end == data.size());
+    return n;
+}
+
+static void
+acquire_indexed(AcquireRuntime* runtime,
+                const char* storage,
+                const std::string& ext,
+                uint64_t max_frames_per_file,
+                uint8_t enable_unbuffered_io)
+{
+    const auto name = [&](uint64_t i) {
+        return i ? std::string(TEST) + "." + std::to_string(i) + ext
+                 : std::string(TEST) + ext;
+    };
+    configure(runtime,
+              storage,
+              name(0).c_str(),
+              max_frames_per_file,
+              enable_unbuffered_io);
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    const uint64_t frames_per_file =
+      max_frames_per_file ? max_frames_per_file : nframes;
+    const uint64_t nfiles = (nframes + frames_per_file - 1) / frames_per_file;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < nfiles; ++i)
+        total += check_index(name(i), ext == ".tif");
+    CHECK(total == nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        for (uint8_t unbuffered = 0; unbuffered < 2; ++unbuffered) {
+            for (uint64_t max_frames_per_file : { 0, 8 }) {
+                acquire_indexed(
+                  runtime, "raw", ".raw", max_frames_per_file, unbuffered);
+                acquire_indexed(
+                  runtime, "tiff", ".tif", max_frames_per_file, unbuffered);
+            }
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
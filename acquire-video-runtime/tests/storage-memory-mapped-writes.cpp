@@ -0,0 +1,170 @@
+/// @file storage-memory-mapped-writes.cpp
+/// Test that the raw storage device writes complete files when asked to write
+/// through a memory mapped file, that the setting round trips through the
+/// configuration, and that raw storage falls back to one writer.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime,
+          const char* storage,
+          const char* filename,
+          uint32_t writer_count)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_memory_mapped_io(
+      &props.video[0].storage.settings, 1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].storage.writer_count = writer_count;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].storage.settings.enable_memory_mapped_io == 1);
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Checks that the raw file holds every frame, in order, back to back, and
+/// no padding after the last one.
+static void
+check_raw(const char* filename, uint64_t expected_nframes)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    size_t offset = 0;
+    uint64_t nframes = 0;
+    while (offset < data.size()) {
+        VideoFrame frame = {};
+        CHECK(offset + sizeof(frame) <= data.size());
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        EXPECT(frame.frame_id == nframes,
+               "Expected frame %llu. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)frame.frame_id);
+        CHECK(frame.bytes_of_frame >= sizeof(frame) + 64 * 48);
+        offset += frame.bytes_of_frame;
+        ++nframes;
+    }
+    CHECK(offset == data.size());
+    CHECK(nframes == expected_nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        configure(runtime, "raw", TEST ".bin", 1);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_raw(TEST ".bin", 100);
+
+        // Only one thread at a time may write to a mapped file.
+        configure(runtime, "raw", TEST ".bin", 4);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_raw(TEST ".bin", 100);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
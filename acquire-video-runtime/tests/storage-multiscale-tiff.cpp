@@ -0,0 +1,286 @@
+/// @file storage-multiscale-tiff.cpp
+/// Test that the TIFF storage device writes each frame's downsampled levels
+/// as its SubIFDs when multiscale is enabled, halving until neither side is
+/// longer than 256 pixels, and that each level is the 2x2 average of the one
+/// before it. Checked for 8 and 16 bit pixels, buffered and unbuffered.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// Odd sizes, so each level drops a row or a column somewhere.
+constexpr uint32_t width = 1202, height = 701;
+constexpr uint64_t nframes = 5;
+// 601x350, 300x175 and 150x87.
+constexpr uint32_t nlevels = 3;
+
+static void
+configure(AcquireRuntime* runtime,
+          enum SampleType type,
+          bool enable_unbuffered_io)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*sin.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".tif"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    auto* settings = &props.video[0].storage.settings;
+    CHECK(storage_properties_set_enable_multiscale(settings, 1));
+    settings->enable_unbuffered_io = enable_unbuffered_io;
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = type;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(settings);
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+struct image_t
+{
+    uint32_t width, height, subfile_type;
+    std::vector<uint32_t> pixels;
+    // Number of SubIFDs, and where their offsets are.
+    uint64_t nsub, sub;
+};
+
+/// Reads the single strip image of the ifd at `ifd`.
+static image_t
+read_image(const std::vector<uint8_t>& data,
+           uint64_t ifd,
+           size_t bytes_of_pixel)
+{
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    const uint64_t bytes_of_tag = 20;
+    image_t out = {};
+    uint64_t offset = 0, nbytes = 0;
+    const uint64_t ntags = u64(ifd);
+    for (uint64_t i = 0; i < ntags; ++i) {
+        const uint64_t tag = ifd + 8 + i * bytes_of_tag;
+        const uint16_t id = (uint16_t)u64(tag);
+        const uint64_t n = u64(tag + 4);
+        const uint64_t value = u64(tag + 12);
+        switch (id) {
+            case 254:
+                out.subfile_type = (uint32_t)value;
+                break;
+            case 256:
+                out.width = (uint32_t)value;
+                break;
+            case 257:
+                out.height = (uint32_t)value;
+                break;
+            case 273:
+                CHECK(n == 1);
+                offset = value;
+                break;
+            case 279:
+                nbytes = value;
+                break;
+            case 330:
+                // A single SubIFD's offset is kept in the tag.
+                out.nsub = n;
+                out.sub = n > 1 ? value : tag + 12;
+                break;
+            default:
+                break;
+        }
+    }
+    const uint64_t npx = (uint64_t)out.width * out.height;
+    // Frames are padded to a multiple of 8 bytes, and written with it.
+    CHECK(nbytes >= npx * bytes_of_pixel);
+    CHECK(offset + nbytes <= data.size());
+    out.pixels.resize(npx);
+    for (uint64_t i = 0; i < npx; ++i) {
+        uint16_t v = 0;
+        memcpy(&v, data.data() + offset + i * bytes_of_pixel, bytes_of_pixel);
+        out.pixels[i] = v;
+    }
+    return out;
+}
+
+static uint32_t
+avg(uint32_t a, uint32_t b)
+{
+    return (a + b + 1) >> 1;
+}
+
+/// Walks the TIFF's chain of image directories and checks each frame's
+/// levels, each against the one before it.
+static void
+check_tiff(const char* filename, size_t bytes_of_pixel)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    const uint64_t bytes_of_tag = 20;
+    uint64_t count = 0;
+    for (uint64_t ifd = u64(8); ifd; ++count) {
+        CHECK(count < nframes);
+        const image_t frame = read_image(data, ifd, bytes_of_pixel);
+        CHECK(frame.width == width && frame.height == height);
+        CHECK(frame.subfile_type == 2);
+        EXPECT(frame.nsub == nlevels,
+               "Expected %u levels. Got %llu.",
+               nlevels,
+               (unsigned long long)frame.nsub);
+
+        image_t prev = frame;
+        for (uint64_t level = 0; level < frame.nsub; ++level) {
+            const image_t im =
+              read_image(data, u64(frame.sub + 8 * level), bytes_of_pixel);
+            CHECK(im.subfile_type == 1);
+            CHECK(im.nsub == 0);
+            CHECK(im.width == prev.width / 2 && im.height == prev.height / 2);
+            uint64_t nonzero = 0;
+            for (uint32_t y = 0; y < im.height; ++y) {
+                const uint32_t* r0 = prev.pixels.data() + 2 * y * prev.width;
+                const uint32_t* r1 = r0 + prev.width;
+                for (uint32_t x = 0; x < im.width; ++x) {
+                    const uint32_t expected =
+                      avg(avg(r0[2 * x], r1[2 * x]),
+                          avg(r0[2 * x + 1], r1[2 * x + 1]));
+                    const uint32_t v = im.pixels[y * im.width + x];
+                    EXPECT(v == expected,
+                           "Level %llu, (%u,%u): Expected %u. Got %u.",
+                           (unsigned long long)level + 1,
+                           x,
+                           y,
+                           expected,
+                           v);
+                    nonzero += v != 0;
+                }
+            }
+            CHECK(nonzero > 0);
+            prev = im;
+        }
+        CHECK(prev.width <= 256 && prev.height <= 256);
+        ifd = u64(ifd + 8 + u64(ifd) * bytes_of_tag);
+    }
+    CHECK(count == nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        {
+            AcquirePropertyMetadata metadata = {};
+            configure(runtime, SampleType_u8, false);
+            OK(acquire_get_configuration_metadata(runtime, &metadata));
+            CHECK(metadata.video[0].storage.multiscale_is_supported);
+        }
+        const struct
+        {
+            enum SampleType type;
+            size_t bytes_of_pixel;
+            bool enable_unbuffered_io;
+        } cases[] = {
+            { SampleType_u8, 1, false },
+            { SampleType_u16, 2, true },
+        };
+        for (const auto& c : cases) {
+            configure(runtime, c.type, c.enable_unbuffered_io);
+            OK(acquire_start(runtime));
+            OK(acquire_stop(runtime));
+            check_tiff(TEST ".tif", c.bytes_of_pixel);
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
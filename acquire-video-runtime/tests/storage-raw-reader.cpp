@@ -0,0 +1,182 @@
+/// @file storage-raw-reader.cpp
+/// Test that the raw reader finds every frame the raw storage device wrote,
+/// with and without the frame index, including while the file is still
+/// being written.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 64, height = 48;
+constexpr uint64_t nframes = 200;
+
+static void
+configure(AcquireRuntime* runtime, uint8_t enable_frame_index)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".raw"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_frame_index(
+      &props.video[0].storage.settings, enable_frame_index));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Checks the frames the reader has found so far.
+static void
+check_frames(const raw_reader& reader)
+{
+    const size_t n = raw_reader_frame_count(&reader);
+    CHECK(n <= nframes);
+    CHECK(raw_reader_frame(&reader, n) == nullptr);
+    raw_reader_prefetch(&reader, 0, n);
+    for (size_t i = 0; i < n; ++i) {
+        const VideoFrame* frame = raw_reader_frame(&reader, i);
+        CHECK(frame);
+        // Ids skip any frames the camera dropped.
+        if (i)
+            CHECK(frame->frame_id > raw_reader_frame(&reader, i - 1)->frame_id);
+        CHECK(frame->shape.dims.width == width);
+        CHECK(frame->shape.dims.height == height);
+        CHECK(frame->shape.type == SampleType_u8);
+        CHECK(frame->bytes_of_frame >= sizeof(*frame) + width * height);
+    }
+}
+
+static void
+read_while_writing(AcquireRuntime* runtime, uint8_t enable_frame_index)
+{
+    remove(TEST ".raw");
+    remove(TEST ".raw.idx");
+    configure(runtime, enable_frame_index);
+    OK(acquire_start(runtime));
+
+    // The file is there once the stream has started, with disk space
+    // reserved past what's been written.
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, TEST ".raw"));
+    try {
+        // Until the writer has all the frames, or long after it should.
+        struct clock clock;
+        clock_init(&clock);
+        size_t last = 0;
+        while (last < nframes && clock_toc_ms(&clock) < 10e3) {
+            CHECK(raw_reader_refresh(&reader));
+            CHECK(raw_reader_frame_count(&reader) >= last);
+            last = raw_reader_frame_count(&reader);
+            check_frames(reader);
+            clock_sleep_ms(0, 1);
+        }
+        OK(acquire_stop(runtime));
+
+        CHECK(raw_reader_refresh(&reader));
+        check_frames(reader);
+        EXPECT(raw_reader_frame_count(&reader) == nframes,
+               "Expected %llu frames. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)raw_reader_frame_count(&reader));
+        CHECK(!!reader.has_index == !!enable_frame_index);
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+
+    // And once it's done.
+    CHECK(raw_reader_open(&reader, TEST ".raw"));
+    const size_t n = raw_reader_frame_count(&reader);
+    check_frames(reader);
+    raw_reader_close(&reader);
+    CHECK(n == nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        read_while_writing(runtime, 0);
+        read_while_writing(runtime, 1);
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,258 @@
+/// @file storage-rollover.cpp
+/// Test that the raw and TIFF storage devices start a new file each time the
+/// current one reaches its frame or byte limit, naming the files after the
+/// first with their index, and that they leave no empty file behind.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 64, height = 48;
+constexpr uint64_t nframes = 20;
+
+/// @returns The alignment storage asks frames to be padded to.
+static uint32_t
+configure(AcquireRuntime* runtime,
+          const char* storage,
+          const char* filename,
+          uint64_t max_frames_per_file,
+          uint64_t max_bytes_per_file,
+          uint8_t enable_unbuffered_io)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_unbuffered_io(
+      &props.video[0].storage.settings, enable_unbuffered_io));
+    CHECK(storage_properties_set_rollover(&props.video[0].storage.settings,
+                                          max_frames_per_file,
+                                          max_bytes_per_file));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].storage.rollover_is_supported);
+    return metadata.video[0].storage.io_alignment_bytes;
+}
+
+static bool
+file_exists(const std::string& filename)
+{
+    return std::ifstream(filename, std::ios::binary).good();
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// @returns the number of frames in the raw file `filename`.
+static uint64_t
+count_raw_frames(const std::string& filename)
+{
+    const std::vector<uint8_t> data = read_file(filename.c_str());
+    uint64_t count = 0;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        CHECK(offset + sizeof(VideoFrame) <= data.size());
+        VideoFrame frame = {};
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        CHECK(frame.shape.dims.width == width);
+        CHECK(frame.bytes_of_frame > 0);
+        offset += frame.bytes_of_frame;
+        ++count;
+    }
+    CHECK(offset == data.size());
+    return count;
+}
+
+/// @returns the number of images in the TIFF file `filename`.
+static uint64_t
+count_tiff_frames(const std::string& filename)
+{
+    const std::vector<uint8_t> data = read_file(filename.c_str());
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    CHECK(data.size() >= 16 && data[0] == 'I' && data[1] == 'I');
+    uint64_t count = 0;
+    for (uint64_t ifd = u64(8); ifd; ++count) {
+        CHECK(count < nframes);
+        ifd = u64(ifd + 8 + u64(ifd) * 20);
+    }
+    return count;
+}
+
+/// Acquires `nframes` into a series of files starting at `base` + `ext` and
+/// checks each file holds `frames_per_file` frames, the last the rest.
+static void
+acquire_series(AcquireRuntime* runtime,
+               const char* storage,
+               const std::string& base,
+               const std::string& ext,
+               uint64_t frames_per_file,
+               uint64_t max_frames_per_file,
+               uint64_t max_bytes_per_file,
+               uint8_t enable_unbuffered_io)
+{
+    const auto name = [&](uint64_t i) {
+        return i ? base + "." + std::to_string(i) + ext : base + ext;
+    };
+    const uint64_t nfiles = (nframes + frames_per_file - 1) / frames_per_file;
+    for (uint64_t i = 0; i <= nfiles; ++i)
+        remove(name(i).c_str());
+
+    configure(runtime,
+              storage,
+              name(0).c_str(),
+              max_frames_per_file,
+              max_bytes_per_file,
+              enable_unbuffered_io);
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < nfiles; ++i) {
+        EXPECT(file_exists(name(i)), "Expected \"%s\".", name(i).c_str());
+        const uint64_t n = ext == ".raw" ? count_raw_frames(name(i))
+                                         : count_tiff_frames(name(i));
+        const uint64_t expected =
+          i + 1 < nfiles ? frames_per_file : nframes - total;
+        EXPECT(n == expected,
+               "Expected %llu frames in \"%s\". Got %llu.",
+               (unsigned long long)expected,
+               name(i).c_str(),
+               (unsigned long long)n);
+        total += n;
+    }
+    // The file prepared for after the last one is removed.
+    EXPECT(!file_exists(name(nfiles)),
+           "Expected no \"%s\".",
+           name(nfiles).c_str());
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        for (uint8_t unbuffered = 0; unbuffered < 2; ++unbuffered) {
+            // Each raw frame is a header and its pixels, padded to 8 bytes,
+            // or to the alignment unbuffered files ask for.
+            const uint64_t alignment = std::max<uint64_t>(
+              8, configure(runtime, "raw", TEST ".raw", 0, 0, unbuffered));
+            const uint64_t bytes_of_frame =
+              (sizeof(VideoFrame) + width * height + alignment - 1) /
+              alignment * alignment;
+            acquire_series(
+              runtime, "raw", TEST, ".raw", 7, 7, 0, unbuffered);
+            acquire_series(runtime,
+                           "raw",
+                           TEST,
+                           ".raw",
+                           3,
+                           0,
+                           3 * bytes_of_frame + 1,
+                           unbuffered);
+            acquire_series(
+              runtime, "tiff", TEST, ".tif", 7, 7, 0, unbuffered);
+        }
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,190 @@
+/// @file storage-striped-raw.cpp
+/// Test that the raw storage device deals frames round-robin over the files
+/// listed in its URI, writes a manifest of them, and refuses to stripe
+/// unbuffered files.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 64, height = 48;
+// Not a multiple of the number of files, so they end up different sizes.
+constexpr uint64_t nframes = 20;
+constexpr size_t nstripes = 3;
+static const char* const paths[nstripes] = {
+    TEST ".0.raw",
+    TEST ".1.raw",
+    TEST ".2.raw",
+};
+
+static void
+configure(AcquireRuntime* runtime, uint8_t enable_unbuffered_io)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    std::string uri;
+    for (size_t i = 0; i < nstripes; ++i)
+        uri += (i ? ";" : "") + std::string(paths[i]);
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  uri.c_str(),
+                                  uri.size() + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_unbuffered_io(
+      &props.video[0].storage.settings, enable_unbuffered_io));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Reads the frames back in the order they were dealt out and checks that
+/// they come out in the order they were acquired.
+static void
+check_stripes()
+{
+    std::vector<uint8_t> data[nstripes];
+    uint64_t offsets[nstripes] = {};
+    for (size_t i = 0; i < nstripes; ++i)
+        data[i] = read_file(paths[i]);
+
+    uint64_t count = 0, last_id = 0;
+    for (size_t i = 0;; i = (i + 1) % nstripes, ++count) {
+        if (offsets[i] == data[i].size()) {
+            // Once the file a frame would be in has run out, so have the
+            // others.
+            for (size_t j = 0; j < nstripes; ++j)
+                CHECK(offsets[j] == data[j].size());
+            break;
+        }
+        VideoFrame frame = {};
+        CHECK(offsets[i] + sizeof(frame) <= data[i].size());
+        memcpy(&frame, data[i].data() + offsets[i], sizeof(frame));
+        // Ids skip any frames the camera dropped.
+        EXPECT(count == 0 || frame.frame_id > last_id,
+               "Expected a frame after %llu in \"%s\". Got %llu.",
+               (unsigned long long)last_id,
+               paths[i],
+               (unsigned long long)frame.frame_id);
+        last_id = frame.frame_id;
+        CHECK(frame.shape.dims.width == width);
+        CHECK(frame.shape.dims.height == height);
+        offsets[i] += frame.bytes_of_frame;
+        CHECK(offsets[i] <= data[i].size());
+    }
+    CHECK(count == nframes);
+
+    const std::vector<uint8_t> manifest =
+      read_file(TEST ".0.raw.stripes.json");
+    const std::string expected = "{\"stripes\":[\"" TEST ".0.raw\",\"" TEST
+                                 ".1.raw\",\"" TEST ".2.raw\"],"
+                                 "\"frames_per_stripe\":1}\n";
+    CHECK(std::string(manifest.begin(), manifest.end()) == expected);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        configure(runtime, 0);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_stripes();
+
+        // Frames can't be written to unbuffered files at any offset, so the
+        // stream isn't configured and can't start.
+        configure(runtime, 1);
+        CHECK(AcquireStatus_Ok != acquire_start(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
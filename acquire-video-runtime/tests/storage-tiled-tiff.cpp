@@ -0,0 +1,298 @@
+/// @file storage-tiled-tiff.cpp
+/// Test that the TIFF storage device writes frames as tiles when the first
+/// two acquisition dimensions have chunk sizes, padding the tiles on the
+/// right and bottom edges with zeros, with and without compression, and that
+/// it refuses tiles TIFF doesn't allow.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+// Neither is a multiple of the tile size, so the last row and column of
+// tiles are padded.
+constexpr uint32_t width = 600, height = 400;
+constexpr uint32_t tile_width = 128, tile_length = 64;
+constexpr uint64_t nframes = 10;
+
+static void
+configure(AcquireRuntime* runtime,
+          enum StorageCompression compression,
+          uint32_t tile_w,
+          uint32_t tile_h)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*sin.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  SIZED(TEST ".tif"),
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  3));
+    auto* settings = &props.video[0].storage.settings;
+    CHECK(storage_properties_set_dimension(
+      settings, 0, SIZED("x"), DimensionType_Space, width, tile_w, 0));
+    CHECK(storage_properties_set_dimension(
+      settings, 1, SIZED("y"), DimensionType_Space, height, tile_h, 0));
+    CHECK(storage_properties_set_dimension(
+      settings, 2, SIZED("t"), DimensionType_Time, 0, 1, 0));
+    CHECK(storage_properties_set_compression(settings, compression));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = width, .y = height };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = nframes;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(settings);
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Decodes TIFF's LZW, which widens codes one code early.
+static std::vector<uint8_t>
+lzw_decode(const uint8_t* p, size_t n)
+{
+    std::vector<std::vector<uint8_t>> table;
+    const auto reset = [&]() {
+        table.assign(258, {});
+        for (int i = 0; i < 256; ++i)
+            table[i] = { (uint8_t)i };
+    };
+    reset();
+
+    std::vector<uint8_t> out;
+    size_t bit = 0;
+    uint32_t nbits = 9;
+    int prev = -1;
+    for (;;) {
+        CHECK(bit + nbits <= 8 * n);
+        uint32_t code = 0;
+        for (uint32_t i = 0; i < nbits; ++i, ++bit)
+            code = (code << 1) | ((p[bit >> 3] >> (7 - (bit & 7))) & 1);
+        if (code == 257)
+            break;
+        if (code == 256) {
+            reset();
+            nbits = 9;
+            prev = -1;
+            continue;
+        }
+        std::vector<uint8_t> entry;
+        if (prev < 0) {
+            CHECK(code < 256);
+            entry = table[code];
+        } else {
+            if (code < table.size()) {
+                entry = table[code];
+            } else {
+                CHECK(code == table.size());
+                entry = table[prev];
+                entry.push_back(table[prev][0]);
+            }
+            auto added = table[prev];
+            added.push_back(entry[0]);
+            table.push_back(added);
+        }
+        out.insert(out.end(), entry.begin(), entry.end());
+        prev = (int)code;
+        if (table.size() + 1 >= (1u << nbits) && nbits < 12)
+            ++nbits;
+    }
+    return out;
+}
+
+/// Walks the TIFF's chain of image directories and checks each frame's
+/// tiles.
+static void
+check_tiff(const char* filename, enum StorageCompression compression)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    const uint64_t bytes_of_tag = 20;
+    const uint32_t across = (width + tile_width - 1) / tile_width;
+    const uint32_t down = (height + tile_length - 1) / tile_length;
+    const uint64_t bytes_of_tile = (uint64_t)tile_width * tile_length;
+    uint64_t count = 0;
+    for (uint64_t ifd = u64(8); ifd; ++count) {
+        CHECK(count < nframes);
+        const uint64_t ntags = u64(ifd);
+        uint64_t tw = 0, tl = 0, ntiles = 0, offsets = 0, byte_counts = 0;
+        for (uint64_t i = 0; i < ntags; ++i) {
+            const uint64_t tag = ifd + 8 + i * bytes_of_tag;
+            const uint16_t id = (uint16_t)u64(tag);
+            const uint64_t n = u64(tag + 4);
+            const uint64_t value = u64(tag + 12);
+            // Strips and tiles don't mix.
+            CHECK(id != 273 && id != 278 && id != 279);
+            switch (id) {
+                case 322:
+                    tw = (uint32_t)value;
+                    break;
+                case 323:
+                    tl = (uint32_t)value;
+                    break;
+                case 324:
+                    ntiles = n;
+                    offsets = value;
+                    break;
+                case 325:
+                    CHECK(n == ntiles);
+                    byte_counts = value;
+                    break;
+                default:
+                    break;
+            }
+        }
+        CHECK(tw == tile_width && tl == tile_length);
+        CHECK(ntiles == across * down);
+
+        uint64_t nonzero = 0;
+        for (uint64_t i = 0; i < ntiles; ++i) {
+            const uint64_t offset = u64(offsets + 8 * i);
+            const uint64_t nbytes = u64(byte_counts + 8 * i);
+            CHECK(offset + nbytes <= data.size());
+            std::vector<uint8_t> tile(data.data() + offset,
+                                      data.data() + offset + nbytes);
+            if (compression == StorageCompression_Lzw)
+                tile = lzw_decode(tile.data(), tile.size());
+            if (compression == StorageCompression_None ||
+                compression == StorageCompression_Lzw) {
+                EXPECT(tile.size() == bytes_of_tile,
+                       "Expected %llu bytes in tile %llu. Got %llu.",
+                       (unsigned long long)bytes_of_tile,
+                       (unsigned long long)i,
+                       (unsigned long long)tile.size());
+                // Pixels past the edges of the frame are zero.
+                const uint32_t x = (uint32_t)(i % across) * tile_width;
+                const uint32_t y = (uint32_t)(i / across) * tile_length;
+                for (uint32_t r = 0; r < tile_length; ++r) {
+                    for (uint32_t c = 0; c < tile_width; ++c) {
+                        const uint8_t v = tile[r * tile_width + c];
+                        if (x + c >= width || y + r >= height)
+                            CHECK(v == 0);
+                        else
+                            nonzero += v != 0;
+                    }
+                }
+            }
+        }
+        if (compression == StorageCompression_None ||
+            compression == StorageCompression_Lzw)
+            CHECK(nonzero > 0);
+        ifd = u64(ifd + 8 + ntags * bytes_of_tag);
+    }
+    CHECK(count == nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        {
+            AcquirePropertyMetadata metadata = {};
+            configure(
+              runtime, StorageCompression_None, tile_width, tile_length);
+            OK(acquire_get_configuration_metadata(runtime, &metadata));
+            CHECK(metadata.video[0].storage.chunking_is_supported);
+        }
+        for (auto compression :
+             { StorageCompression_None, StorageCompression_Lzw }) {
+            configure(runtime, compression, tile_width, tile_length);
+            OK(acquire_start(runtime));
+            OK(acquire_stop(runtime));
+            check_tiff(TEST ".tif", compression);
+        }
+        // TIFF needs tiles to be a multiple of 16 on a side, so the stream
+        // isn't configured and can't start.
+        configure(runtime, StorageCompression_None, 100, 64);
+        CHECK(AcquireStatus_Ok != acquire_start(runtime));
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,213 @@
+/// @file storage-unbuffered-writes.cpp
+/// Test that the raw and TIFF storage devices write complete files when asked
+/// to write around the file cache, that the setting round trips through the
+/// configuration, that raw storage falls back to one writer, and that frames
+/// are padded out to the alignment raw storage asks for.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// @returns The alignment the storage device asks frames to be padded to.
+static uint32_t
+configure(AcquireRuntime* runtime,
+          const char* storage,
+          const char* filename,
+          uint32_t writer_count)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage,
+                                strlen(storage),
+                                &props.video[0].storage.identifier));
+    CHECK(storage_properties_init(&props.video[0].storage.settings,
+                                  0,
+                                  filename,
+                                  strlen(filename) + 1,
+                                  0,
+                                  0,
+                                  { 1, 1 },
+                                  0));
+    CHECK(storage_properties_set_enable_unbuffered_io(
+      &props.video[0].storage.settings, 1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+    props.video[0].storage.writer_count = writer_count;
+
+    OK(acquire_configure(runtime, &props));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].storage.settings.enable_unbuffered_io == 1);
+
+    AcquirePropertyMetadata metadata = {};
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    // Unbuffered raw files are written one append at a time.
+    if (!strcmp(storage, "raw"))
+        CHECK(!metadata.video[0].storage.concurrent_append_is_supported);
+    return metadata.video[0].storage.io_alignment_bytes;
+}
+
+static std::vector<uint8_t>
+read_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK(file.good());
+    const size_t nbytes = (size_t)file.tellg();
+    std::vector<uint8_t> data(nbytes);
+    file.seekg(0);
+    file.read((char*)data.data(), (std::streamsize)nbytes);
+    CHECK(file.good());
+    return data;
+}
+
+/// Checks that the raw file holds every frame, in order, back to back, each
+/// padded to `alignment` bytes, and no padding after the last one.
+static void
+check_raw(const char* filename, uint64_t expected_nframes, uint32_t alignment)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    size_t offset = 0;
+    uint64_t nframes = 0;
+    while (offset < data.size()) {
+        VideoFrame frame = {};
+        CHECK(offset + sizeof(frame) <= data.size());
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        EXPECT(frame.frame_id == nframes,
+               "Expected frame %llu. Got %llu.",
+               (unsigned long long)nframes,
+               (unsigned long long)frame.frame_id);
+        CHECK(frame.bytes_of_frame >= sizeof(frame) + 64 * 48);
+        CHECK(frame.bytes_of_frame % alignment == 0);
+        offset += frame.bytes_of_frame;
+        ++nframes;
+    }
+    CHECK(offset == data.size());
+    CHECK(nframes == expected_nframes);
+}
+
+/// Walks the TIFF's chain of image directories and checks that there's one
+/// 64 pixel wide image per frame.
+static void
+check_tiff(const char* filename, uint64_t expected_nframes)
+{
+    const std::vector<uint8_t> data = read_file(filename);
+    const auto u64 = [&](uint64_t offset) -> uint64_t {
+        uint64_t v = 0;
+        CHECK(offset + sizeof(v) <= data.size());
+        memcpy(&v, data.data() + offset, sizeof(v));
+        return v;
+    };
+    // An ifd is a tag count, 20 bytes per tag, then the next ifd's offset.
+    const uint64_t bytes_of_tag = 20;
+    uint64_t nframes = 0;
+    for (uint64_t ifd = u64(8); ifd; ++nframes) {
+        CHECK(nframes < expected_nframes);
+        const uint64_t ntags = u64(ifd);
+        CHECK(ntags > 0);
+        // The first tag is the image width.
+        CHECK((uint16_t)u64(ifd + 8) == 256);
+        CHECK((uint16_t)u64(ifd + 8 + 12) == 64);
+        ifd = u64(ifd + 8 + ntags * bytes_of_tag);
+    }
+    CHECK(nframes == expected_nframes);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        uint32_t alignment = configure(runtime, "raw", TEST ".bin", 1);
+        CHECK(alignment > 1);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_raw(TEST ".bin", 100, alignment);
+
+        // Unbuffered raw files can't be written at arbitrary offsets.
+        alignment = configure(runtime, "raw", TEST ".bin", 4);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_raw(TEST ".bin", 100, alignment);
+
+        configure(runtime, "tiff", TEST ".tif", 1);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        check_tiff(TEST ".tif", 100);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,210 @@
+/// @file tee-outputs.cpp
+/// Test that a stream's `tee_outputs` store every frame the stream's own
+/// storage does, and that the stream runs as before once they're turned off.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+#include "raw_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint32_t width = 128, height = 96;
+constexpr uint64_t nframes = 100;
+
+static const char* const paths[] = {
+    TEST "-0.raw",
+    TEST "-1.raw",
+    TEST "-2.raw",
+};
+
+static void
+select_storage(const DeviceManager* dm,
+               const char* path,
+               DeviceIdentifier* identifier,
+               StorageProperties* settings)
+{
+    DEVOK(device_manager_select(
+      dm, DeviceKind_Storage, SIZED("raw") - 1, identifier));
+    CHECK(storage_properties_init(
+      settings, 0, path, strlen(path) + 1, 0, 0, { 1, 1 }, 0));
+}
+
+static void
+configure(AcquireRuntime* runtime, int enable_tees)
+{
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    auto& video = props.video[0];
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &video.camera.identifier));
+    select_storage(
+      dm, paths[0], &video.storage.identifier, &video.storage.settings);
+    video.camera.settings.binning = 1;
+    video.camera.settings.pixel_type = SampleType_u16;
+    video.camera.settings.shape = { .x = width, .y = height };
+    video.camera.settings.exposure_time_us = 1e3f;
+    video.max_frame_count = nframes;
+    // Holds a few dozen frames, so the queue wraps.
+    video.channel_capacity_bytes = 2ULL << 20;
+
+    for (size_t i = 0; i < ACQUIRE_MAX_TEE_OUTPUTS; ++i) {
+        // The settings read back alias the storage device's own.
+        auto& out = video.tee_outputs[i];
+        out = {};
+        if (enable_tees && i + 1 < sizeof(paths) / sizeof(*paths))
+            select_storage(dm, paths[i + 1], &out.identifier, &out.settings);
+    }
+    OK(acquire_configure(runtime, &props));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    for (size_t i = 0; i < ACQUIRE_MAX_TEE_OUTPUTS; ++i) {
+        const auto& out = actual.video[0].tee_outputs[i];
+        CHECK((out.identifier.kind == DeviceKind_Storage) ==
+              (enable_tees && i + 1 < sizeof(paths) / sizeof(*paths)));
+    }
+
+    storage_properties_destroy(&video.storage.settings);
+    for (auto& out : video.tee_outputs)
+        storage_properties_destroy(&out.settings);
+}
+
+/// Compares the frames stored at `path` with those in `expected`.
+static void
+check_copy(const raw_reader& expected, const char* path)
+{
+    raw_reader reader = {};
+    CHECK(raw_reader_open(&reader, path));
+    try {
+        EXPECT(raw_reader_frame_count(&reader) == nframes,
+               "Expected %llu frames in %s. Got %llu.",
+               (unsigned long long)nframes,
+               path,
+               (unsigned long long)raw_reader_frame_count(&reader));
+        for (size_t i = 0; i < nframes; ++i) {
+            const VideoFrame* a = raw_reader_frame(&expected, i);
+            const VideoFrame* b = raw_reader_frame(&reader, i);
+            CHECK(a && b);
+            CHECK(b->frame_id == a->frame_id);
+            CHECK(b->shape.dims.width == width);
+            CHECK(b->shape.dims.height == height);
+            EXPECT(memcmp(a->data, b->data, bytes_of_image(&a->shape)) == 0,
+                   "Frame %llu in %s doesn't match.",
+                   (unsigned long long)i,
+                   path);
+        }
+    } catch (...) {
+        raw_reader_close(&reader);
+        throw;
+    }
+    raw_reader_close(&reader);
+}
+
+static void
+remove_files()
+{
+    for (const char* path : paths)
+        remove(path);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        remove_files();
+        configure(runtime, 1);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        AcquireMetrics metrics = {};
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].frames_out == nframes);
+        CHECK(metrics.video[0].tee_frames_out[0] == nframes);
+        CHECK(metrics.video[0].tee_frames_out[1] == nframes);
+        CHECK(metrics.video[0].tee_frames_out[2] == 0);
+        CHECK(metrics.video[0].tee_bytes_out[0] ==
+              metrics.video[0].bytes_out);
+
+        raw_reader expected = {};
+        CHECK(raw_reader_open(&expected, paths[0]));
+        try {
+            CHECK(raw_reader_frame_count(&expected) == nframes);
+            check_copy(expected, paths[1]);
+            check_copy(expected, paths[2]);
+        } catch (...) {
+            raw_reader_close(&expected);
+            throw;
+        }
+        raw_reader_close(&expected);
+        remove_files();
+
+        // Without tees, nothing else reads the queue.
+        configure(runtime, 0);
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+        OK(acquire_get_metrics(runtime, &metrics));
+        CHECK(metrics.video[0].frames_out == nframes);
+        CHECK(metrics.video[0].tee_frames_out[0] == 0);
+        remove_files();
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,162 @@
+/// @file trace-pipeline.cpp
+/// Test that acquire_set_trace() writes a Chrome trace of the stream's
+/// threads at acquire_stop(), that it can't be changed while running, and
+/// that turning it off stops writing traces.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static void
+configure(AcquireRuntime* runtime)
+{
+    CHECK(runtime);
+
+    const DeviceManager* dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3f;
+    props.video[0].max_frame_count = 100;
+
+    OK(acquire_configure(runtime, &props));
+}
+
+/// Reads frames until `nframes` have come through.
+static void
+drain(AcquireRuntime* runtime, uint64_t nframes)
+{
+    const auto next = [](VideoFrame* cur) -> VideoFrame* {
+        return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+    };
+
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    uint64_t n = 0;
+    while (n < nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end; cur = next(cur))
+            ++n;
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 1.0f);
+    }
+}
+
+static std::string
+read_trace()
+{
+    std::ifstream file(TEST ".json");
+    CHECK(file.is_open());
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        configure(runtime);
+        CHECK(AcquireStatus_Error ==
+              acquire_set_trace(runtime, TEST ".json", 0));
+        OK(acquire_set_trace(runtime, TEST ".json", 1024));
+
+        OK(acquire_start(runtime));
+        CHECK(AcquireStatus_Error ==
+              acquire_set_trace(runtime, TEST ".json", 1024));
+        drain(runtime, 100);
+        OK(acquire_stop(runtime));
+
+        const std::string trace = read_trace();
+        CHECK(trace.find("\"traceEvents\"") != std::string::npos);
+        CHECK(trace.find("\"acq-source-0\"") != std::string::npos);
+        CHECK(trace.find("\"camera_get_frame\"") != std::string::npos);
+        CHECK(trace.find("\"channel_write_map\"") != std::string::npos);
+        CHECK(trace.find("\"storage_append\"") != std::string::npos);
+
+        // Turning tracing off leaves the last trace alone.
+        OK(acquire_set_trace(runtime, 0, 0));
+        OK(acquire_start(runtime));
+        drain(runtime, 100);
+        OK(acquire_stop(runtime));
+        CHECK(read_trace() == trace);
+
+        retval = 0;
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,136 @@
+/// @file trash-throughput-summary.cpp
+/// Test that the trash storage device, which discards what it's given, logs
+/// how many frames and bytes reached it and how long they took to get there
+/// when it's stopped.
+
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static struct
+{
+    std::mutex lock;
+    std::vector<std::string> summary;
+} reported;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    if (strstr(msg, "Trash: ")) {
+        std::scoped_lock lock(reported.lock);
+        reported.summary.emplace_back(msg);
+    }
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+constexpr uint64_t nframes = 50;
+constexpr uint64_t bytes_of_pixels = 64 * 48;
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        CHECK(runtime);
+        const DeviceManager* dm = acquire_device_manager(runtime);
+        CHECK(dm);
+
+        AcquireProperties props = {};
+        OK(acquire_get_configuration(runtime, &props));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Camera,
+                                    SIZED("simulated.*random.*"),
+                                    &props.video[0].camera.identifier));
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("trash"),
+                                    &props.video[0].storage.identifier));
+
+        props.video[0].camera.settings.binning = 1;
+        props.video[0].camera.settings.pixel_type = SampleType_u8;
+        props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+        props.video[0].camera.settings.exposure_time_us = 1e3;
+        props.video[0].max_frame_count = nframes;
+
+        OK(acquire_configure(runtime, &props));
+        OK(acquire_start(runtime));
+        OK(acquire_stop(runtime));
+
+        std::scoped_lock lock(reported.lock);
+        CHECK(!reported.summary.empty());
+
+        unsigned long long frames = 0, bytes = 0, appends = 0;
+        EXPECT(sscanf(reported.summary[0].c_str(),
+                      "Trash: %llu frames, %llu bytes in %llu appends",
+                      &frames,
+                      &bytes,
+                      &appends) == 3,
+               "Unexpected summary: %s",
+               reported.summary[0].c_str());
+        EXPECT(frames == nframes,
+               "Expected %llu frames. Got %llu.",
+               (unsigned long long)nframes,
+               frames);
+        // Each frame carries a header as well as its pixels.
+        CHECK(bytes > nframes * bytes_of_pixels);
+        CHECK(appends >= 1 && appends <= nframes);
+
+        bool has_latency = false, has_histogram = false;
+        for (const auto& line : reported.summary) {
+            has_latency |= line.find("Latency from the camera") != line.npos;
+            has_histogram |= line.find("Latency of [") != line.npos;
+        }
+        CHECK(has_latency);
+        CHECK(has_histogram);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& e) {
+        ERR("Exception: %s", e.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+    acquire_shutdown(runtime);
+    return retval;
+}
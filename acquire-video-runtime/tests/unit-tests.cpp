@@ -41,6 +41,46 @@ extern "C"
     int unit_test__storage__copy_string();
     int unit_test__monotonic_clock_increases_monotonically();
     int unit_test__clock_sleep_ms_accepts_null();
+    int unit_test__channel_lockfree_readers_see_every_frame();
+    int unit_test__channel_lossy_reader_does_not_stall_writer();
+    int unit_test__channel_lossy_reader_resumes_at_newest_write();
+    int unit_test__channel_read_map_latest_skips_backlog();
+    int unit_test__channel_detached_reader_stops_holding_writer();
+    int unit_test__channel_stats_track_occupancy_and_wraps();
+    int unit_test__channel_whole_frames_fill_to_the_end();
+    int unit_test__channel_batched_writes_commit_together();
+    int unit_test__channel_reader_waits_past_bytes_seen();
+    int unit_test__channel_pads_frames_to_alignment();
+    int unit_test__channel_write_unmap_bytes_commits_less();
+    int unit_test__channel_uses_client_allocator();
+    int unit_test__channel_holds_keep_regions_from_writer();
+    int unit_test__video_source_writes_bursts_in_batches();
+    int unit_test__video_source_uses_get_frames();
+    int unit_test__video_source_stops_while_waiting_for_frames();
+    int unit_test__video_source_counts_dropped_frames();
+    int unit_test__video_source_skips_unchanged_camera_settings();
+    int unit_test__video_source_caches_camera_meta();
+    int unit_test__latency_histogram_percentiles_are_close();
+    int unit_test__filter_kernels_match_plain();
+    int unit_test__band_pool_covers_every_item_once();
+    int unit_test__throttler_backs_off_when_idle();
+    int unit_test__parked_thread_runs_once_per_request();
+    int unit_test__parked_thread_timed_wait_gives_up();
+    int unit_test__trace_ring_keeps_latest_events();
+    int unit_test__filter_stages_transform_pixels();
+    int unit_test__filter_running_averages();
+    int unit_test__filter_integer_averages();
+    int unit_test__filter_projections();
+    int unit_test__filter_pack_stage_round_trips();
+    int unit_test__vfslice_split_at_delay_ms();
+    int unit_test__monitor_decimation();
+    int unit_test__waveform_keeps_two_blocks_ahead_of_output();
+    int unit_test__intensity_stats_match_samples();
+    int unit_test__preview_bins_by_halving();
+    int unit_test__clock_sync_fits_drift_and_latency();
+    int unit_test__annotations_join_frames();
+    int unit_test__io_scheduler_orders_batches();
+    int unit_test__chunker_assembles_layers_of_chunks();
 }
 
 //
@@ -63,6 +103,46 @@ main()
         CASE(unit_test__storage__copy_string),
         CASE(unit_test__monotonic_clock_increases_monotonically),
         CASE(unit_test__clock_sleep_ms_accepts_null),
+        CASE(unit_test__channel_lockfree_readers_see_every_frame),
+        CASE(unit_test__channel_lossy_reader_does_not_stall_writer),
+        CASE(unit_test__channel_lossy_reader_resumes_at_newest_write),
+        CASE(unit_test__channel_read_map_latest_skips_backlog),
+        CASE(unit_test__channel_detached_reader_stops_holding_writer),
+        CASE(unit_test__channel_stats_track_occupancy_and_wraps),
+        CASE(unit_test__channel_whole_frames_fill_to_the_end),
+        CASE(unit_test__channel_batched_writes_commit_together),
+        CASE(unit_test__channel_reader_waits_past_bytes_seen),
+        CASE(unit_test__channel_pads_frames_to_alignment),
+        CASE(unit_test__channel_write_unmap_bytes_commits_less),
+        CASE(unit_test__channel_uses_client_allocator),
+        CASE(unit_test__channel_holds_keep_regions_from_writer),
+        CASE(unit_test__video_source_writes_bursts_in_batches),
+        CASE(unit_test__video_source_uses_get_frames),
+        CASE(unit_test__video_source_stops_while_waiting_for_frames),
+        CASE(unit_test__video_source_counts_dropped_frames),
+        CASE(unit_test__video_source_skips_unchanged_camera_settings),
+        CASE(unit_test__video_source_caches_camera_meta),
+        CASE(unit_test__latency_histogram_percentiles_are_close),
+        CASE(unit_test__filter_kernels_match_plain),
+        CASE(unit_test__band_pool_covers_every_item_once),
+        CASE(unit_test__throttler_backs_off_when_idle),
+        CASE(unit_test__parked_thread_runs_once_per_request),
+        CASE(unit_test__parked_thread_timed_wait_gives_up),
+        CASE(unit_test__trace_ring_keeps_latest_events),
+        CASE(unit_test__filter_stages_transform_pixels),
+        CASE(unit_test__filter_running_averages),
+        CASE(unit_test__filter_integer_averages),
+        CASE(unit_test__filter_projections),
+        CASE(unit_test__filter_pack_stage_round_trips),
+        CASE(unit_test__vfslice_split_at_delay_ms),
+        CASE(unit_test__monitor_decimation),
+        CASE(unit_test__waveform_keeps_two_blocks_ahead_of_output),
+        CASE(unit_test__intensity_stats_match_samples),
+        CASE(unit_test__preview_bins_by_halving),
+        CASE(unit_test__clock_sync_fits_drift_and_latency),
+        CASE(unit_test__annotations_join_frames),
+        CASE(unit_test__io_scheduler_orders_batches),
+        CASE(unit_test__chunker_assembles_layers_of_chunks),
 #undef CASE
     };
 